@@ -11,6 +11,7 @@
 #include "adler32_p.h"
 
 uint32_t adler32_c(uint32_t adler, const unsigned char *buf, size_t len);
+uint32_t adler32_copy_c(uint32_t adler, unsigned char *dst, const unsigned char *src, size_t len);
 static uint32_t adler32_combine_(uint32_t adler1, uint32_t adler2, z_off64_t len2);
 
 #define DO1(buf, i)  {adler += (buf)[i]; sum2 += adler;}
@@ -88,6 +89,19 @@ uint32_t adler32_c(uint32_t adler, const unsigned char *buf, size_t len) {
     return adler | (sum2 << 16);
 }
 
+/* ========================================================================= */
+uint32_t adler32_copy_c(uint32_t adler, unsigned char *dst, const unsigned char *src, size_t len) {
+    while (len) {
+        size_t n = len < CHECKSUM_COPY_CHUNK ? len : CHECKSUM_COPY_CHUNK;
+        memcpy(dst, src, n);
+        adler = functable.adler32(adler, dst, n);
+        dst += n;
+        src += n;
+        len -= n;
+    }
+    return adler;
+}
+
 uint32_t ZEXPORT PREFIX(adler32_z)(uint32_t adler, const unsigned char *buf, size_t len) {
     return functable.adler32(adler, buf, len);
 }
@@ -7,6 +7,7 @@
 
 extern int arm_cpu_has_neon;
 extern int arm_cpu_has_crc32;
+extern int arm_cpu_has_pmull;
 
 void ZLIB_INTERNAL arm_check_features(void);
 
@@ -17,6 +17,16 @@ static int arm_has_crc32() {
 #endif
 }
 
+static int arm_has_pmull() {
+#if defined(__linux__) && defined(HWCAP_PMULL)
+  return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0 ? 1 : 0;
+#elif defined(ARM_NOCHECK_PMULL)
+  return 1;
+#else
+  return 0;
+#endif
+}
+
 /* AArch64 has neon. */
 #if !defined(__aarch64__) && !defined(_M_ARM64)
 static inline int arm_has_neon()
@@ -39,6 +49,7 @@ static inline int arm_has_neon()
 
 ZLIB_INTERNAL int arm_cpu_has_neon;
 ZLIB_INTERNAL int arm_cpu_has_crc32;
+ZLIB_INTERNAL int arm_cpu_has_pmull;
 
 void ZLIB_INTERNAL arm_check_features(void) {
 #if defined(__aarch64__) || defined(_M_ARM64)
@@ -47,4 +58,5 @@ void ZLIB_INTERNAL arm_check_features(void) {
   arm_cpu_has_neon = arm_has_neon();
 #endif
   arm_cpu_has_crc32 = arm_has_crc32();
+  arm_cpu_has_pmull = arm_has_pmull();
 }
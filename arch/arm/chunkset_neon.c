@@ -0,0 +1,123 @@
+/* chunkset_neon.c -- NEON inline functions to copy small data chunks.
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#include "../../zbuild.h"
+#include "../../zutil.h"
+
+typedef uint8x16_t chunk_t;
+
+#define CHUNK_SIZE 16
+
+#define HAVE_CHUNKMEMSET_3
+#if defined(__aarch64__) || defined(_M_ARM64)
+#  define HAVE_CHUNKMEMSET_6
+#endif
+
+ZLIB_INTERNAL unsigned char* chunkcopy_neon(unsigned char *out, unsigned char const *from, unsigned len);
+ZLIB_INTERNAL unsigned char* chunkunroll_neon(unsigned char *out, unsigned *dist, unsigned *len);
+
+static inline chunk_t chunkmemset_1(unsigned char *from) {
+    return vld1q_dup_u8(from);
+}
+
+static inline chunk_t chunkmemset_2(unsigned char *from) {
+    int16_t c;
+    memcpy(&c, from, sizeof(c));
+    return vreinterpretq_u8_s16(vdupq_n_s16(c));
+}
+
+static inline chunk_t chunkmemset_4(unsigned char *from) {
+    int32_t c;
+    memcpy(&c, from, sizeof(c));
+    return vreinterpretq_u8_s32(vdupq_n_s32(c));
+}
+
+static inline chunk_t chunkmemset_8(unsigned char *from) {
+    return vcombine_u8(vld1_u8(from), vld1_u8(from));
+}
+
+static inline unsigned char *chunkmemset_3(unsigned char *out, unsigned char *from, unsigned dist, unsigned len) {
+    uint8x8x3_t chunks;
+    unsigned sz = sizeof(chunks);
+    if (len < sz) {
+        out = chunkunroll_neon(out, &dist, &len);
+        return chunkcopy_neon(out, out - dist, len);
+    }
+
+    /* Load 3 bytes 'a,b,c' from FROM and duplicate across all lanes:
+       chunks[0] = {a,a,a,a,a,a,a,a}
+       chunks[1] = {b,b,b,b,b,b,b,b}
+       chunks[2] = {c,c,c,c,c,c,c,c}. */
+    chunks = vld3_dup_u8(from);
+
+    unsigned rem = len % sz;
+    len -= rem;
+    while (len) {
+        /* Store "a,b,c, ..., a,b,c". */
+        vst3_u8(out, chunks);
+        out += sz;
+        len -= sz;
+    }
+
+    if (!rem)
+        return out;
+
+    /* Last, deal with the case when LEN is not a multiple of SZ. */
+    out = chunkunroll_neon(out, &dist, &rem);
+    return chunkcopy_neon(out, out - dist, rem);
+}
+
+#ifdef HAVE_CHUNKMEMSET_6
+static inline unsigned char *chunkmemset_6(unsigned char *out, unsigned char *from, unsigned dist, unsigned len) {
+    uint16x8x3_t chunks;
+    unsigned sz = sizeof(chunks);
+    if (len < sz) {
+        out = chunkunroll_neon(out, &dist, &len);
+        return chunkcopy_neon(out, out - dist, len);
+    }
+
+    /* Load 6 bytes 'ab,cd,ef' from FROM and duplicate across all lanes:
+       chunks[0] = {ab,ab,ab,ab,ab,ab,ab,ab}
+       chunks[1] = {cd,cd,cd,cd,cd,cd,cd,cd}
+       chunks[2] = {ef,ef,ef,ef,ef,ef,ef,ef}. */
+    chunks = vld3q_dup_u16((unsigned short *)from);
+
+    unsigned rem = len % sz;
+    len -= rem;
+    while (len) {
+        /* Store "ab,cd,ef, ..., ab,cd,ef". */
+        vst3q_u16((unsigned short *)out, chunks);
+        out += sz;
+        len -= sz;
+    }
+
+    if (!rem)
+        return out;
+
+    /* Last, deal with the case when LEN is not a multiple of SZ. */
+    out = chunkunroll_neon(out, &dist, &rem);
+    return chunkcopy_neon(out, out - dist, rem);
+}
+#endif
+
+static inline chunk_t loadchunk(unsigned char const *s) {
+    return vld1q_u8(s);
+}
+
+static inline void storechunk(unsigned char *d, chunk_t c) {
+    vst1q_u8(d, c);
+}
+
+#define CHUNKSIZE        chunksize_neon
+#define CHUNKCOPY        chunkcopy_neon
+#define CHUNKCOPY_SAFE   chunkcopy_safe_neon
+#define CHUNKUNROLL      chunkunroll_neon
+#define CHUNKMEMSET      chunkmemset_neon
+#define CHUNKMEMSET_SAFE chunkmemset_safe_neon
+
+#include "../../chunkset_tpl.h"
+
+#endif
@@ -0,0 +1,96 @@
+/* crc32_pmull.c -- compute the CRC-32 using carry-less multiplication (PMULL)
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * This is the folding approach of arch/x86/crc_folding.c, using the same
+ * constants: the input is folded 64 bytes at a time into four 128-bit
+ * registers, which are then folded into one. Rather than doing the Barrett
+ * reduction with more multiplies, the last 128 bits and the tail are handed
+ * to the CRC32 instructions, so both extensions are needed.
+ */
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32) && defined(ARM_PMULL_CRC)
+#include <arm_acle.h>
+#include <arm_neon.h>
+#include "../../zbuild.h"
+#include "../../zutil.h"
+
+extern uint32_t crc32_acle(uint32_t, const unsigned char *, uint64_t);
+
+/* Fold crc over the width given by the constants in k, and add data */
+static inline uint64x2_t fold_128(uint64x2_t crc, uint64x2_t data, poly64x2_t k) {
+    poly64x2_t p_crc = vreinterpretq_p64_u64(crc);
+    uint64x2_t lo = vreinterpretq_u64_p128(vmull_p64(vgetq_lane_p64(p_crc, 0), vgetq_lane_p64(k, 0)));
+    uint64x2_t hi = vreinterpretq_u64_p128(vmull_high_p64(p_crc, k));
+
+    return veorq_u64(veorq_u64(lo, hi), data);
+}
+
+uint32_t ZLIB_INTERNAL crc32_pmull(uint32_t crc, const unsigned char *buf, uint64_t len) {
+    /* x^(512+32) and x^(512-32) mod P, for folding over 64 bytes */
+    static const uint64_t ALIGNED_(16) fold4_k[2] = { 0x154442bd4, 0x1c6e41596 };
+    /* x^(128+32) and x^(128-32) mod P, for folding over 16 bytes */
+    static const uint64_t ALIGNED_(16) fold1_k[2] = { 0x1751997d0, 0x0ccaa009e };
+    const poly64x2_t k4 = vreinterpretq_p64_u64(vld1q_u64(fold4_k));
+    const poly64x2_t k1 = vreinterpretq_p64_u64(vld1q_u64(fold1_k));
+    uint64x2_t crc0, crc1, crc2, crc3;
+    uint32_t c;
+
+    /* The CRC32 instructions are faster than setting up the folding state for short inputs */
+    if (len < 64)
+        return crc32_acle(crc, buf, len);
+
+    /* Start from an empty folding state and xor the initial CRC into the
+     * first four bytes, which is the same as preloading the shift register.
+     */
+    crc0 = vld1q_u64((const uint64_t *)buf);
+    crc1 = vld1q_u64((const uint64_t *)(buf + 16));
+    crc2 = vld1q_u64((const uint64_t *)(buf + 32));
+    crc3 = vld1q_u64((const uint64_t *)(buf + 48));
+    crc0 = veorq_u64(crc0, vsetq_lane_u64((uint64_t)(~crc), vdupq_n_u64(0), 0));
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64) {
+        crc0 = fold_128(crc0, vld1q_u64((const uint64_t *)buf), k4);
+        crc1 = fold_128(crc1, vld1q_u64((const uint64_t *)(buf + 16)), k4);
+        crc2 = fold_128(crc2, vld1q_u64((const uint64_t *)(buf + 32)), k4);
+        crc3 = fold_128(crc3, vld1q_u64((const uint64_t *)(buf + 48)), k4);
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Each register is 16 bytes ahead of the previous one */
+    crc1 = fold_128(crc0, crc1, k1);
+    crc2 = fold_128(crc1, crc2, k1);
+    crc3 = fold_128(crc2, crc3, k1);
+
+    while (len >= 16) {
+        crc3 = fold_128(crc3, vld1q_u64((const uint64_t *)buf), k1);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* The remaining 128 bits have the same CRC as the input so far */
+    c = __crc32d(0, vgetq_lane_u64(crc3, 0));
+    c = __crc32d(c, vgetq_lane_u64(crc3, 1));
+
+    return crc32_acle(~c, buf, len);
+}
+
+/* Low 64 bits of the carry-less product of a and b */
+static inline uint64_t pmull_lo64(uint64_t a, uint64_t b) {
+    return vgetq_lane_u64(vreinterpretq_u64_p128(vmull_p64((poly64_t)a, (poly64_t)b)), 0);
+}
+
+/* Multiply two reflected polynomials modulo P, for crc32_combine(), the same
+   way as crc32_multmodp_pclmulqdq() in arch/x86/crc_folding.c. */
+uint32_t ZLIB_INTERNAL crc32_multmodp_pmull(uint32_t a, uint32_t b) {
+    uint64_t p, t;
+
+    p = pmull_lo64(a, b) << 1;
+    t = pmull_lo64(p & 0xffffffff, 0x1f7011641);
+    t = pmull_lo64(t & 0xffffffff, 0x1db710641);
+    return (uint32_t)((p ^ t) >> 32);
+}
+
+#endif
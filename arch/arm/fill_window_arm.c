@@ -14,6 +14,7 @@
 #include "../../deflate.h"
 #include "../../deflate_p.h"
 #include "../../functable.h"
+#include "../../ztrace.h"
 
 extern ZLIB_INTERNAL int read_buf(PREFIX3(stream) *strm, unsigned char *buf, unsigned size);
 
@@ -61,6 +62,7 @@ void fill_window_arm(deflate_state *s) {
     unsigned int wsize = s->w_size;
 
     Assert(s->lookahead < MIN_LOOKAHEAD, "already enough lookahead");
+    STATS_TIMER_START(start);
 
     do {
         more = s->window_size - s->lookahead - s->strstart;
@@ -83,7 +85,9 @@ void fill_window_arm(deflate_state *s) {
 
             slide_hash_chain(s->head, s->hash_size, wsize);
             slide_hash_chain(s->prev, wsize, wsize);
+            STATS_ADD(s, slide_hash, 1);
             more += wsize;
+            ZTRACE3(deflate_slide, s->strm, wsize, s->strm->total_in);
         }
         if (s->strm->avail_in == 0)
             break;
@@ -122,7 +126,7 @@ void fill_window_arm(deflate_state *s) {
             }
             if (insert_cnt > 0)
             {
-                functable.insert_string(s, str, insert_cnt);
+                s->insert_string(s, str, insert_cnt);
                 s->insert -= slen;
             }
         }
@@ -166,4 +170,5 @@ void fill_window_arm(deflate_state *s) {
     }
 
     Assert((unsigned long)s->strstart <= s->window_size - MIN_LOOKAHEAD, "not enough room for search");
+    STATS_TIMER_END(s, fill_window_ns, start);
 }
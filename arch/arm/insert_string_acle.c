@@ -9,6 +9,19 @@
 #include <arm_acle.h>
 #include "../../zbuild.h"
 #include "../../deflate.h"
+#include "../../deflate_p.h"
+
+static inline uint32_t hash_acle(deflate_state *const s, const Pos str) {
+    uint32_t val;
+
+    memcpy(&val, &s->window[str], sizeof(val));
+    if (HASH_BYTES(s) == 3)
+        val &= 0xFFFFFF;
+
+    if (HASH_BYTES(s) == 5)
+        return __crc32cb(__crc32cw(0, val), s->window[str+4]) & s->hash_mask;
+    return __crc32cw(0, val) & s->hash_mask;
+}
 
 /* ===========================================================================
  * Insert string str in the dictionary and set match_head to the previous head
@@ -19,35 +32,35 @@
  *    (except for the last MIN_MATCH-1 bytes of the input file).
  */
 Pos insert_string_acle(deflate_state *const s, const Pos str, unsigned int count) {
-    Pos p, lp, ret;
+    unsigned int hashes[INSERT_BATCH];
+    Pos ret = 0;
+    unsigned int idx, i, n;
 
     if (UNLIKELY(count == 0)) {
-        return s->prev[str & s->w_mask];
+        return POS_WINDOW(s, s->prev[str & s->w_mask]);
     }
 
-    ret = 0;
-    lp = str + count - 1; /* last position */
-
-    for (p = str; p <= lp; p++) {
-        uint32_t val, h, hm;
-        memcpy(&val, &s->window[p], sizeof(val));
-
-        if (s->level >= TRIGGER_LEVEL)
-            val &= 0xFFFFFF;
-
-        h = __crc32w(0, val);
-        hm = h & s->hash_mask;
-
-        Pos head = s->head[hm];
-        if (head != p) {
-            s->prev[p & s->w_mask] = head;
-            s->head[hm] = p;
-            if (p == lp)
-              ret = head;
-        } else if (p == lp) {
-          ret = p;
-        }
+    /* The CRC instructions of a batch are independent, so they are pipelined */
+    if (count == 1) {
+        hashes[0] = hash_acle(s, str);
+        return insert_hashed(s, str, hashes, 1);
+    }
+    for (idx = 0; idx < count; idx += n) {
+        n = count - idx < INSERT_BATCH ? count - idx : INSERT_BATCH;
+        for (i = 0; i < n; i++)
+            hashes[i] = hash_acle(s, str+idx+i);
+        ret = insert_hashed(s, str+idx, hashes, n);
     }
     return ret;
 }
+
+/* ===========================================================================
+ * Clear the hash table entries of the count strings starting at str.
+ */
+void clear_hash_acle(deflate_state *const s, const Pos str, unsigned int count) {
+    unsigned int idx;
+
+    for (idx = 0; idx < count; idx++)
+        s->head[hash_acle(s, str+idx)] = 0;
+}
 #endif
@@ -0,0 +1,41 @@
+/* rle258_neon.c -- NEON version of rle258
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#include "../../zbuild.h"
+#include "../../deflate.h"
+#if defined(_MSC_VER) && !defined(__clang__)
+#  include "ctzl.h"
+#endif
+
+/* NEON has no movemask, so each comparison result is narrowed to four bits
+ * per byte, and the first clear nibble of the two 32-bit halves gives the
+ * first byte that differs from the broadcast one.
+ */
+unsigned ZLIB_INTERNAL rle258_neon(const unsigned char *src, unsigned char c) {
+    const uint8x16_t v_c = vdupq_n_u8(c);
+    unsigned len = 0;
+
+    do {
+        uint8x16_t v_cmp = vceqq_u8(vld1q_u8(src + len), v_c);
+        uint32x2_t v_mask = vreinterpret_u32_u8(vshrn_n_u16(vreinterpretq_u16_u8(v_cmp), 4));
+        uint32_t lo = ~vget_lane_u32(v_mask, 0);
+        uint32_t hi = ~vget_lane_u32(v_mask, 1);
+
+        if (lo)
+            return len + (unsigned)__builtin_ctzl(lo) / 4;
+        if (hi)
+            return len + 8 + (unsigned)__builtin_ctzl(hi) / 4;
+        len += 16;
+    } while (len < 256);
+
+    if (src[len] == c) {
+        len++;
+        if (src[len] == c)
+            len++;
+    }
+    return len;
+}
+#endif
@@ -0,0 +1,35 @@
+/* slide_neon.c -- NEON optimized hash slide
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#include "../../zbuild.h"
+#include "../../deflate.h"
+
+/* Subtract wsize from each entry with unsigned saturation, so entries below
+ * it become NIL, eight entries at a time and two vectors per iteration.
+ */
+static inline void slide_hash_chain(Pos *table, unsigned entries, uint16x8_t v_wsize) {
+    Pos *p = table;
+
+    do {
+        uint16x8_t v0 = vld1q_u16(p);
+        uint16x8_t v1 = vld1q_u16(p + 8);
+
+        vst1q_u16(p, vqsubq_u16(v0, v_wsize));
+        vst1q_u16(p + 8, vqsubq_u16(v1, v_wsize));
+        p += 16;
+        entries -= 16;
+    } while (entries > 0);
+}
+
+ZLIB_INTERNAL void slide_hash_neon(deflate_state *s) {
+    const uint16x8_t v_wsize = vdupq_n_u16((uint16_t)s->w_size);
+
+    STATS_ADD(s, slide_hash, 1);
+
+    slide_hash_chain(s->head, s->hash_size, v_wsize);
+    slide_hash_chain(s->prev, s->w_size, v_wsize);
+}
+#endif
@@ -88,3 +88,9 @@ void ZLIB_INTERNAL dfltcc_free_window(PREFIX3(streamp) strm, void *w)
     if (w)
         ZFREE(strm, *(void **)((unsigned char *)w - sizeof(void *)));
 }
+
+/* Space on top of the generic allocations for zng_deflateArenaSize() and zng_inflateArenaSize() */
+size_t ZLIB_INTERNAL dfltcc_arena_extra(void)
+{
+    return 8 + sizeof(struct dfltcc_state) + 2 * ARENA_ALIGN + sizeof(void *) + PAGE_ALIGN;
+}
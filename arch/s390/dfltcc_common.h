@@ -13,6 +13,7 @@ void ZLIB_INTERNAL dfltcc_copy_state(void *dst, const void *src, uInt size);
 void ZLIB_INTERNAL dfltcc_reset(PREFIX3(streamp) strm, uInt size);
 void ZLIB_INTERNAL *dfltcc_alloc_window(PREFIX3(streamp) strm, uInt items, uInt size);
 void ZLIB_INTERNAL dfltcc_free_window(PREFIX3(streamp) strm, void *w);
+size_t ZLIB_INTERNAL dfltcc_arena_extra(void);
 
 #define ZALLOC_STATE dfltcc_alloc_state
 
@@ -26,4 +27,8 @@ void ZLIB_INTERNAL dfltcc_free_window(PREFIX3(streamp) strm, void *w);
 
 #define TRY_FREE_WINDOW dfltcc_free_window
 
+#define DEFLATE_ARENA_EXTRA dfltcc_arena_extra()
+
+#define INFLATE_ARENA_EXTRA dfltcc_arena_extra()
+
 #endif
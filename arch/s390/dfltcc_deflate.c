@@ -277,8 +277,11 @@ again:
 
    DFLTCC does not support all zlib settings, e.g. generation of non-compressed
    blocks or alternative window sizes. When such settings are applied on the
-   fly with deflateParams, we need to convert between hardware and software
-   window formats.
+   fly with deflateParams, the open block is closed with the old settings and
+   the history is handed over between the hardware and software window
+   formats, so that the stream goes on in hardware whenever the settings allow
+   it. DFLTCC keeps up to 32K of history in a circular buffer at the start of
+   the window, while software keeps it linear, ending at strstart.
 */
 static int dfltcc_was_deflate_used(PREFIX3(streamp) strm)
 {
@@ -288,10 +291,53 @@ static int dfltcc_was_deflate_used(PREFIX3(streamp) strm)
     return strm->total_in > 0 || param->nt == 0 || param->hl > 0;
 }
 
-int ZLIB_INTERNAL dfltcc_deflate_params(PREFIX3(streamp) strm, int level, int strategy)
+static void dfltcc_history_to_window(deflate_state *state, struct dfltcc_param_v0 *param)
+{
+    unsigned char *window = state->window;
+
+    /* The software window is twice HB_SIZE, so the part of the history that
+     * wraps around can go after the end of the circular buffer first.
+     */
+    if (param->ho + param->hl > HB_SIZE)
+        memcpy(window + HB_SIZE, window, param->ho + param->hl - HB_SIZE);
+    memmove(window, window + param->ho, param->hl);
+    if (param->hl != 0)
+        state->strstart = param->hl;
+    state->block_start = (long)state->strstart;
+    state->lookahead = 0;
+    state->insert = 0;
+    state->match_available = 0;
+    state->match_length = MIN_MATCH-1;
+    state->prev_length = MIN_MATCH-1;
+
+    /* Positions in head[] from before the hardware took over would be past
+     * strstart now. deflateParams() hashes the window again.
+     */
+    memset(state->head, 0, state->hash_size * sizeof(*state->head));
+    param->ho = 0;
+    param->hl = 0;
+    param->nt = 1;
+}
+
+static void dfltcc_window_to_history(deflate_state *state, struct dfltcc_param_v0 *param)
+{
+    unsigned int n = state->strstart < HB_SIZE ? state->strstart : HB_SIZE;
+
+    memmove(state->window, state->window + state->strstart - n, n);
+    if (n != 0)
+        state->strstart = n; /* Nonzero before the header for FDICT */
+    state->block_start = (long)state->strstart;
+    param->ho = 0;
+    param->hl = n;
+    param->nt = n == 0;
+    param->bcf = 0;
+}
+
+int ZLIB_INTERNAL dfltcc_deflate_params(PREFIX3(streamp) strm, int level, int strategy, int *rehash)
 {
     deflate_state *state = (deflate_state *)strm->state;
     struct dfltcc_state *dfltcc_state = GET_DFLTCC_STATE(state);
+    struct dfltcc_param_v0 *param = &dfltcc_state->param;
     int could_deflate = dfltcc_can_deflate(strm);
     int can_deflate = dfltcc_are_params_ok(level, state->w_bits, strategy, dfltcc_state->level_mask,
                                            state->reproducible);
@@ -300,12 +346,29 @@ int ZLIB_INTERNAL dfltcc_deflate_params(PREFIX3(streamp) strm, int level, int st
         /* We continue to work in the same mode - no changes needed */
         return Z_OK;
 
-    if (!dfltcc_was_deflate_used(strm))
-        /* DFLTCC was not used yet - no changes needed */
+    if (could_deflate ? !dfltcc_was_deflate_used(strm) : strm->total_in == 0 && state->strstart == 0)
+        /* Nothing was compressed yet - no changes needed */
         return Z_OK;
 
-    /* Switching between hardware and software is not implemented */
-    return Z_STREAM_ERROR;
+    /* Close the block in the current mode. DFLTCC leaves its block open when
+     * there is no input, so end it by hand as on Z_FINISH.
+     */
+    if (state->last_flush != -2 && PREFIX(deflate)(strm, Z_BLOCK) == Z_STREAM_ERROR)
+        return Z_STREAM_ERROR;
+    if (strm->avail_in || (could_deflate ? param->cf : state->lookahead || state->block_open ||
+                                                 (long)state->strstart != state->block_start))
+        return Z_BUF_ERROR;
+    if (could_deflate) {
+        if (param->bcf) {
+            send_eobs(strm, param);
+            param->bcf = 0;
+            dfltcc_state->block_threshold = strm->total_in + dfltcc_state->block_size;
+        }
+        dfltcc_history_to_window(state, param);
+        *rehash = 1;
+    } else
+        dfltcc_window_to_history(state, param);
+    return Z_OK;
 }
 
 int ZLIB_INTERNAL dfltcc_can_set_reproducible(PREFIX3(streamp) strm, int reproducible)
@@ -5,7 +5,7 @@
 
 int ZLIB_INTERNAL dfltcc_can_deflate(PREFIX3(streamp) strm);
 int ZLIB_INTERNAL dfltcc_deflate(PREFIX3(streamp) strm, int flush, block_state *result);
-int ZLIB_INTERNAL dfltcc_deflate_params(PREFIX3(streamp) strm, int level, int strategy);
+int ZLIB_INTERNAL dfltcc_deflate_params(PREFIX3(streamp) strm, int level, int strategy, int *rehash);
 int ZLIB_INTERNAL dfltcc_can_set_reproducible(PREFIX3(streamp) strm, int reproducible);
 int ZLIB_INTERNAL dfltcc_deflate_set_dictionary(PREFIX3(streamp) strm,
                                                 const unsigned char *dictionary, uInt dict_length);
@@ -26,12 +26,12 @@ int ZLIB_INTERNAL dfltcc_deflate_get_dictionary(PREFIX3(streamp) strm, unsigned
 #define DEFLATE_RESET_KEEP_HOOK(strm) \
     dfltcc_reset((strm), sizeof(deflate_state))
 
-#define DEFLATE_PARAMS_HOOK(strm, level, strategy) \
+#define DEFLATE_PARAMS_HOOK(strm, level, strategy, rehash) \
     do { \
         int err; \
 \
-        err = dfltcc_deflate_params((strm), (level), (strategy)); \
-        if (err == Z_STREAM_ERROR) \
+        err = dfltcc_deflate_params((strm), (level), (strategy), &(rehash)); \
+        if (err != Z_OK) \
             return err; \
     } while (0)
 
@@ -50,4 +50,10 @@ int ZLIB_INTERNAL dfltcc_deflate_get_dictionary(PREFIX3(streamp) strm, unsigned
 
 #define DEFLATE_CAN_SET_REPRODUCIBLE dfltcc_can_set_reproducible
 
+/* Each DFLTCC stream starts with a block of fixed codes and renews its dynamic
+ * codes every DFLTCC_BLOCK_SIZE bytes, so the chunks of zng_deflateParallel()
+ * are that large by default.
+ */
+#define DEFLATE_PARALLEL_CHUNK (1024*1024)
+
 #endif
@@ -0,0 +1,98 @@
+/* adler32_avx.c -- compute the Adler-32 checksum of a data stream using AVX2
+ * Copyright (C) 1995-2011, 2016 Mark Adler
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zbuild.h"
+#include "../../zutil.h"
+#include "../../adler32_p.h"
+
+#ifdef X86_AVX2_ADLER32
+
+#include <immintrin.h>
+
+/* Same scheme as adler32_ssse3, with one 32-byte load per block */
+#define ADLER32_BLOCK 32
+
+static inline uint32_t hsum256(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    return (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+uint32_t ZLIB_INTERNAL adler32_avx2(uint32_t adler, const unsigned char *buf, size_t len) {
+    uint32_t sum2;
+    size_t blocks;
+
+    /* split Adler-32 into component sums */
+    sum2 = (adler >> 16) & 0xffff;
+    adler &= 0xffff;
+
+    /* in case user likes doing a byte at a time, keep it fast */
+    if (len == 1)
+        return adler32_len_1(adler, buf, sum2);
+
+    /* initial Adler-32 value (deferred check for len == 1 speed) */
+    if (buf == NULL)
+        return 1L;
+
+    /* in case short lengths are provided, keep it somewhat fast */
+    if (len < 16)
+        return adler32_len_16(adler, buf, len, sum2);
+
+    blocks = len / ADLER32_BLOCK;
+    len -= blocks * ADLER32_BLOCK;
+
+    while (blocks) {
+        const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                             16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i v_ps, v_s1, v_s2;
+        unsigned n = NMAX / ADLER32_BLOCK;
+
+        if (n > blocks)
+            n = (unsigned)blocks;
+        blocks -= n;
+
+        v_ps = _mm256_setr_epi32((int)(adler * n), 0, 0, 0, 0, 0, 0, 0);
+        v_s1 = _mm256_setzero_si256();
+        v_s2 = _mm256_setr_epi32((int)sum2, 0, 0, 0, 0, 0, 0, 0);
+
+        do {
+            const __m256i bytes = _mm256_loadu_si256((const __m256i *)buf);
+            __m256i mad;
+
+            v_ps = _mm256_add_epi32(v_ps, v_s1);
+            v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+            mad = _mm256_maddubs_epi16(bytes, tap);
+            v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(mad, ones));
+
+            buf += ADLER32_BLOCK;
+        } while (--n);
+
+        v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+
+        adler += hsum256(v_s1);
+        sum2 = hsum256(v_s2);
+
+        MOD(adler);
+        MOD(sum2);
+    }
+
+    /* do remaining bytes (less than one block, still just one modulo) */
+    if (len) {
+        while (len--) {
+            adler += *buf++;
+            sum2 += adler;
+        }
+        MOD(adler);
+        MOD(sum2);
+    }
+
+    /* return recombined sums */
+    return adler | (sum2 << 16);
+}
+
+#endif
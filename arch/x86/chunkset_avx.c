@@ -0,0 +1,60 @@
+/* chunkset_avx.c -- AVX2 inline functions to copy small data chunks.
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zbuild.h"
+#include "../../zutil.h"
+
+#ifdef X86_AVX_CHUNKSET
+#include <immintrin.h>
+
+typedef __m256i chunk_t;
+
+#define CHUNK_SIZE 32
+
+static inline chunk_t chunkmemset_1(unsigned char *from) {
+    int8_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm256_set1_epi8(c);
+}
+
+static inline chunk_t chunkmemset_2(unsigned char *from) {
+    int16_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm256_set1_epi16(c);
+}
+
+static inline chunk_t chunkmemset_4(unsigned char *from) {
+    int32_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm256_set1_epi32(c);
+}
+
+static inline chunk_t chunkmemset_8(unsigned char *from) {
+    int64_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm256_set1_epi64x(c);
+}
+
+static inline chunk_t chunkmemset_16(unsigned char *from) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)from));
+}
+
+static inline chunk_t loadchunk(unsigned char const *s) {
+    return _mm256_loadu_si256((__m256i *)s);
+}
+
+static inline void storechunk(unsigned char *d, chunk_t c) {
+    _mm256_storeu_si256((__m256i *)d, c);
+}
+
+#define CHUNKSIZE        chunksize_avx2
+#define CHUNKCOPY        chunkcopy_avx2
+#define CHUNKCOPY_SAFE   chunkcopy_safe_avx2
+#define CHUNKUNROLL      chunkunroll_avx2
+#define CHUNKMEMSET      chunkmemset_avx2
+#define CHUNKMEMSET_SAFE chunkmemset_safe_avx2
+
+#include "../../chunkset_tpl.h"
+
+#endif
@@ -0,0 +1,56 @@
+/* chunkset_sse.c -- SSE2 inline functions to copy small data chunks.
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zbuild.h"
+#include "../../zutil.h"
+
+#ifdef X86_SSE2
+#include <immintrin.h>
+
+typedef __m128i chunk_t;
+
+#define CHUNK_SIZE 16
+
+static inline chunk_t chunkmemset_1(unsigned char *from) {
+    int8_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm_set1_epi8(c);
+}
+
+static inline chunk_t chunkmemset_2(unsigned char *from) {
+    int16_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm_set1_epi16(c);
+}
+
+static inline chunk_t chunkmemset_4(unsigned char *from) {
+    int32_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm_set1_epi32(c);
+}
+
+static inline chunk_t chunkmemset_8(unsigned char *from) {
+    int64_t c;
+    memcpy(&c, from, sizeof(c));
+    return _mm_set1_epi64x(c);
+}
+
+static inline chunk_t loadchunk(unsigned char const *s) {
+    return _mm_loadu_si128((__m128i *)s);
+}
+
+static inline void storechunk(unsigned char *d, chunk_t c) {
+    _mm_storeu_si128((__m128i *)d, c);
+}
+
+#define CHUNKSIZE        chunksize_sse2
+#define CHUNKCOPY        chunkcopy_sse2
+#define CHUNKCOPY_SAFE   chunkcopy_safe_sse2
+#define CHUNKUNROLL      chunkunroll_sse2
+#define CHUNKMEMSET      chunkmemset_sse2
+#define CHUNKMEMSET_SAFE chunkmemset_safe_sse2
+
+#include "../../chunkset_tpl.h"
+
+#endif
@@ -0,0 +1,43 @@
+/* compare258_avx.c -- AVX2 version of compare258 and longest_match
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zbuild.h"
+#include "../../deflate.h"
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#  include "../../fallback_builtins.h"
+#endif
+
+#ifdef X86_AVX2
+/* Compare 32 bytes at a time, then the remaining 2 bytes one by one */
+unsigned ZLIB_INTERNAL compare258_avx2(const unsigned char *src0, const unsigned char *src1) {
+    unsigned len = 0;
+
+    do {
+        __m256i ymm_src0, ymm_src1, ymm_cmp;
+        unsigned mask;
+
+        ymm_src0 = _mm256_loadu_si256((__m256i *)(src0 + len));
+        ymm_src1 = _mm256_loadu_si256((__m256i *)(src1 + len));
+        ymm_cmp = _mm256_cmpeq_epi8(ymm_src0, ymm_src1);
+        mask = (unsigned)_mm256_movemask_epi8(ymm_cmp);
+        if (mask != 0xFFFFFFFF)
+            return len + (unsigned)__builtin_ctzl(~mask);
+        len += 32;
+    } while (len < 256);
+
+    if (src0[len] == src1[len]) {
+        len++;
+        if (src0[len] == src1[len])
+            len++;
+    }
+    return len;
+}
+
+#define LONGEST_MATCH   longest_match_avx2
+#define COMPARE258      compare258_avx2
+
+#include "../../match_tpl.h"
+#endif
@@ -0,0 +1,43 @@
+/* compare258_avx512.c -- AVX-512 version of compare258 and longest_match
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zbuild.h"
+#include "../../deflate.h"
+
+#include <immintrin.h>
+
+#ifdef X86_AVX512
+/* Compare 64 bytes at a time, then the remaining 2 bytes one by one */
+unsigned ZLIB_INTERNAL compare258_avx512(const unsigned char *src0, const unsigned char *src1) {
+    unsigned len = 0;
+
+    do {
+        __m512i zmm_src0, zmm_src1;
+        __mmask64 mask;
+
+        zmm_src0 = _mm512_loadu_si512((const void *)(src0 + len));
+        zmm_src1 = _mm512_loadu_si512((const void *)(src1 + len));
+        mask = _mm512_cmpneq_epi8_mask(zmm_src0, zmm_src1);
+        if (mask != 0)
+#ifdef _MSC_VER
+            return len + (unsigned)_tzcnt_u64(mask);
+#else
+            return len + (unsigned)__builtin_ctzll(mask);
+#endif
+        len += 64;
+    } while (len < 256);
+
+    if (src0[len] == src1[len]) {
+        len++;
+        if (src0[len] == src1[len])
+            len++;
+    }
+    return len;
+}
+
+#define LONGEST_MATCH   longest_match_avx512
+#define COMPARE258      compare258_avx512
+
+#include "../../match_tpl.h"
+#endif
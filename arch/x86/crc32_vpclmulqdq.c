@@ -0,0 +1,69 @@
+/* crc32_vpclmulqdq.c -- compute the CRC32 using 512-bit carry-less multiplication
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Extends the folding approach of crc_folding.c to four 512-bit registers, so
+ * that 256 bytes are folded per iteration. Once fewer than 256 bytes remain,
+ * the state is reduced to the four 128-bit registers used by crc_folding.c and
+ * finished there.
+ */
+
+#ifdef X86_VPCLMULQDQ_CRC
+
+#include "../../zbuild.h"
+#include <immintrin.h>
+
+#include "crc_folding.h"
+
+static inline __m512i fold_512(__m512i zmm_crc, __m512i zmm_data, __m512i zmm_fold) {
+    __m512i zmm_lo = _mm512_clmulepi64_epi128(zmm_crc, zmm_fold, 0x01);
+    __m512i zmm_hi = _mm512_clmulepi64_epi128(zmm_crc, zmm_fold, 0x10);
+
+    /* zmm_lo ^ zmm_hi ^ zmm_data */
+    return _mm512_ternarylogic_epi32(zmm_lo, zmm_hi, zmm_data, 0x96);
+}
+
+uint32_t ZLIB_INTERNAL crc32_vpclmulqdq(uint32_t crc, const unsigned char *buf, uint64_t len) {
+    /* x^(2048+32) and x^(2048-32) mod P, for folding over 256 bytes */
+    const __m512i zmm_fold16 = _mm512_broadcast_i32x4(_mm_set_epi32(0x00000001, 0x1542778a,
+                                                                    0x00000001, 0x322d1430));
+    /* x^(512+32) and x^(512-32) mod P, for folding over 64 bytes */
+    const __m512i zmm_fold4 = _mm512_broadcast_i32x4(_mm_set_epi32(0x00000001, 0x54442bd4,
+                                                                   0x00000001, 0xc6e41596));
+    unsigned char ALIGNED_(64) crc0[64];
+    __m512i zmm_crc0, zmm_crc1, zmm_crc2, zmm_crc3;
+
+    if (len < 256)
+        return crc32_pclmulqdq(crc, buf, len);
+
+    /* Xor the initial CRC into the first four bytes, see crc32_pclmulqdq */
+    zmm_crc0 = _mm512_loadu_si512((__m512i *)buf);
+    zmm_crc1 = _mm512_loadu_si512((__m512i *)buf + 1);
+    zmm_crc2 = _mm512_loadu_si512((__m512i *)buf + 2);
+    zmm_crc3 = _mm512_loadu_si512((__m512i *)buf + 3);
+    zmm_crc0 = _mm512_xor_si512(zmm_crc0, _mm512_inserti32x4(_mm512_setzero_si512(),
+                                                             _mm_cvtsi32_si128((int)~crc), 0));
+    buf += 256;
+    len -= 256;
+
+    while (len >= 256) {
+        zmm_crc0 = fold_512(zmm_crc0, _mm512_loadu_si512((__m512i *)buf), zmm_fold16);
+        zmm_crc1 = fold_512(zmm_crc1, _mm512_loadu_si512((__m512i *)buf + 1), zmm_fold16);
+        zmm_crc2 = fold_512(zmm_crc2, _mm512_loadu_si512((__m512i *)buf + 2), zmm_fold16);
+        zmm_crc3 = fold_512(zmm_crc3, _mm512_loadu_si512((__m512i *)buf + 3), zmm_fold16);
+
+        buf += 256;
+        len -= 256;
+    }
+
+    /* Each register is 64 bytes ahead of the previous one */
+    zmm_crc1 = fold_512(zmm_crc0, zmm_crc1, zmm_fold4);
+    zmm_crc2 = fold_512(zmm_crc1, zmm_crc2, zmm_fold4);
+    zmm_crc3 = fold_512(zmm_crc2, zmm_crc3, zmm_fold4);
+
+    /* CRC_SAVE */
+    _mm512_store_si512((__m512i *)crc0, zmm_crc3);
+
+    return crc_fold_final(crc0, buf, len);
+}
+
+#endif
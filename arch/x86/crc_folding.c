@@ -25,6 +25,8 @@
 
 #include "crc_folding.h"
 
+extern uint32_t crc32_little(uint32_t, const unsigned char *, uint64_t);
+
 ZLIB_INTERNAL void crc_fold_init(deflate_state *const s) {
     /* CRC_SAVE */
     _mm_storeu_si128((__m128i *)s->crc0 + 0, _mm_cvtsi32_si128(0x9db42487));
@@ -385,19 +387,13 @@ static const unsigned ALIGNED_(16) crc_mask2[4] = {
     0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
 };
 
-uint32_t ZLIB_INTERNAL crc_fold_512to32(deflate_state *const s) {
+static uint32_t crc_fold_reduce(__m128i xmm_crc0, __m128i xmm_crc1, __m128i xmm_crc2, __m128i xmm_crc3) {
     const __m128i xmm_mask  = _mm_load_si128((__m128i *)crc_mask);
     const __m128i xmm_mask2 = _mm_load_si128((__m128i *)crc_mask2);
 
     uint32_t crc;
     __m128i x_tmp0, x_tmp1, x_tmp2, crc_fold;
 
-    /* CRC_LOAD */
-    __m128i xmm_crc0 = _mm_loadu_si128((__m128i *)s->crc0 + 0);
-    __m128i xmm_crc1 = _mm_loadu_si128((__m128i *)s->crc0 + 1);
-    __m128i xmm_crc2 = _mm_loadu_si128((__m128i *)s->crc0 + 2);
-    __m128i xmm_crc3 = _mm_loadu_si128((__m128i *)s->crc0 + 3);
-
     /*
      * k1
      */
@@ -454,5 +450,180 @@ uint32_t ZLIB_INTERNAL crc_fold_512to32(deflate_state *const s) {
     return ~crc;
 }
 
+uint32_t ZLIB_INTERNAL crc_fold_512to32(deflate_state *const s) {
+    /* CRC_LOAD */
+    __m128i xmm_crc0 = _mm_loadu_si128((__m128i *)s->crc0 + 0);
+    __m128i xmm_crc1 = _mm_loadu_si128((__m128i *)s->crc0 + 1);
+    __m128i xmm_crc2 = _mm_loadu_si128((__m128i *)s->crc0 + 2);
+    __m128i xmm_crc3 = _mm_loadu_si128((__m128i *)s->crc0 + 3);
+
+    return crc_fold_reduce(xmm_crc0, xmm_crc1, xmm_crc2, xmm_crc3);
+}
+
+/*
+ * Fold the remaining len bytes of src into the 512-bit folding state saved at
+ * crc0, and return the finished CRC. Unlike crc_fold_copy this needs no
+ * alignment of src, so it can serve plain crc32() calls. When copy is set,
+ * the data is also stored to dst on its way through the registers.
+ */
+static inline uint32_t crc_fold_tail(const unsigned char *crc0, unsigned char *dst, const unsigned char *src,
+                                     uint64_t len, const int copy) {
+    __m128i xmm_t0, xmm_t1, xmm_t2, xmm_t3;
+    __m128i xmm_crc_part = _mm_setzero_si128();
+
+    /* CRC_LOAD */
+    __m128i xmm_crc0 = _mm_loadu_si128((__m128i *)crc0 + 0);
+    __m128i xmm_crc1 = _mm_loadu_si128((__m128i *)crc0 + 1);
+    __m128i xmm_crc2 = _mm_loadu_si128((__m128i *)crc0 + 2);
+    __m128i xmm_crc3 = _mm_loadu_si128((__m128i *)crc0 + 3);
+
+    while (len >= 64) {
+        xmm_t0 = _mm_loadu_si128((__m128i *)src);
+        xmm_t1 = _mm_loadu_si128((__m128i *)src + 1);
+        xmm_t2 = _mm_loadu_si128((__m128i *)src + 2);
+        xmm_t3 = _mm_loadu_si128((__m128i *)src + 3);
+
+        fold_4(&xmm_crc0, &xmm_crc1, &xmm_crc2, &xmm_crc3);
+
+        if (copy) {
+            _mm_storeu_si128((__m128i *)dst, xmm_t0);
+            _mm_storeu_si128((__m128i *)dst + 1, xmm_t1);
+            _mm_storeu_si128((__m128i *)dst + 2, xmm_t2);
+            _mm_storeu_si128((__m128i *)dst + 3, xmm_t3);
+            dst += 64;
+        }
+
+        xmm_crc0 = _mm_xor_si128(xmm_crc0, xmm_t0);
+        xmm_crc1 = _mm_xor_si128(xmm_crc1, xmm_t1);
+        xmm_crc2 = _mm_xor_si128(xmm_crc2, xmm_t2);
+        xmm_crc3 = _mm_xor_si128(xmm_crc3, xmm_t3);
+
+        src += 64;
+        len -= 64;
+    }
+
+    if (len >= 48) {
+        xmm_t0 = _mm_loadu_si128((__m128i *)src);
+        xmm_t1 = _mm_loadu_si128((__m128i *)src + 1);
+        xmm_t2 = _mm_loadu_si128((__m128i *)src + 2);
+
+        fold_3(&xmm_crc0, &xmm_crc1, &xmm_crc2, &xmm_crc3);
+
+        if (copy) {
+            _mm_storeu_si128((__m128i *)dst, xmm_t0);
+            _mm_storeu_si128((__m128i *)dst + 1, xmm_t1);
+            _mm_storeu_si128((__m128i *)dst + 2, xmm_t2);
+            dst += 48;
+        }
+
+        xmm_crc1 = _mm_xor_si128(xmm_crc1, xmm_t0);
+        xmm_crc2 = _mm_xor_si128(xmm_crc2, xmm_t1);
+        xmm_crc3 = _mm_xor_si128(xmm_crc3, xmm_t2);
+
+        src += 48;
+        len -= 48;
+    } else if (len >= 32) {
+        xmm_t0 = _mm_loadu_si128((__m128i *)src);
+        xmm_t1 = _mm_loadu_si128((__m128i *)src + 1);
+
+        fold_2(&xmm_crc0, &xmm_crc1, &xmm_crc2, &xmm_crc3);
+
+        if (copy) {
+            _mm_storeu_si128((__m128i *)dst, xmm_t0);
+            _mm_storeu_si128((__m128i *)dst + 1, xmm_t1);
+            dst += 32;
+        }
+
+        xmm_crc2 = _mm_xor_si128(xmm_crc2, xmm_t0);
+        xmm_crc3 = _mm_xor_si128(xmm_crc3, xmm_t1);
+
+        src += 32;
+        len -= 32;
+    } else if (len >= 16) {
+        xmm_t0 = _mm_loadu_si128((__m128i *)src);
+
+        fold_1(&xmm_crc0, &xmm_crc1, &xmm_crc2, &xmm_crc3);
+
+        if (copy) {
+            _mm_storeu_si128((__m128i *)dst, xmm_t0);
+            dst += 16;
+        }
+
+        xmm_crc3 = _mm_xor_si128(xmm_crc3, xmm_t0);
+
+        src += 16;
+        len -= 16;
+    }
+
+    if (len) {
+        memcpy(&xmm_crc_part, src, (size_t)len);
+        if (copy)
+            memcpy(dst, src, (size_t)len);
+        partial_fold((size_t)len, &xmm_crc0, &xmm_crc1, &xmm_crc2, &xmm_crc3, &xmm_crc_part);
+    }
+
+    return crc_fold_reduce(xmm_crc0, xmm_crc1, xmm_crc2, xmm_crc3);
+}
+
+uint32_t ZLIB_INTERNAL crc_fold_final(const unsigned char *crc0, const unsigned char *src, uint64_t len) {
+    return crc_fold_tail(crc0, NULL, src, len, 0);
+}
+
+/* Start from an empty folding state and xor the initial CRC into the first
+ * four bytes, which is the same as preloading the shift register.
+ */
+static inline void crc_fold_start(unsigned char *crc0, uint32_t crc, const unsigned char *src) {
+    __m128i xmm_t0 = _mm_loadu_si128((__m128i *)src);
+    xmm_t0 = _mm_xor_si128(xmm_t0, _mm_cvtsi32_si128((int)~crc));
+
+    /* CRC_SAVE */
+    _mm_store_si128((__m128i *)crc0 + 0, xmm_t0);
+    memcpy(crc0 + 16, src + 16, 48);
+}
+
+uint32_t ZLIB_INTERNAL crc32_pclmulqdq(uint32_t crc, const unsigned char *buf, uint64_t len) {
+    unsigned char ALIGNED_(16) crc0[64];
+
+    /* The table is faster than setting up the folding state for short inputs */
+    if (len < 64)
+        return crc32_little(crc, buf, len);
+
+    crc_fold_start(crc0, crc, buf);
+    return crc_fold_tail(crc0, NULL, buf + 64, len - 64, 0);
+}
+
+uint32_t ZLIB_INTERNAL crc32_copy_pclmulqdq(uint32_t crc, unsigned char *dst, const unsigned char *src, size_t len) {
+    unsigned char ALIGNED_(16) crc0[64];
+
+    if (len < 64) {
+        memcpy(dst, src, len);
+        return crc32_little(crc, dst, len);
+    }
+
+    crc_fold_start(crc0, crc, src);
+    memcpy(dst, src, 64);
+    return crc_fold_tail(crc0, dst + 64, src + 64, len - 64, 1);
+}
+
+/*
+ * Multiply two reflected polynomials modulo P, for crc32_combine(). The
+ * carry-less product of the two is shifted up one bit, so that its high half
+ * holds the low powers, and then Barrett reduced to 32 bits with the reflected
+ * constants floor(x^64 / P) and P.
+ */
+uint32_t ZLIB_INTERNAL crc32_multmodp_pclmulqdq(uint32_t a, uint32_t b) {
+    const __m128i xmm_k = _mm_set_epi64x(0x1f7011641, 0x1db710641);
+    const __m128i xmm_lo = _mm_set_epi32(0, 0, 0, -1);
+    __m128i xmm_p, xmm_t;
+
+    xmm_p = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)a), _mm_cvtsi32_si128((int)b), 0);
+    xmm_p = _mm_slli_epi64(xmm_p, 1);
+
+    xmm_t = _mm_clmulepi64_si128(_mm_and_si128(xmm_p, xmm_lo), xmm_k, 0x10);
+    xmm_t = _mm_clmulepi64_si128(_mm_and_si128(xmm_t, xmm_lo), xmm_k, 0x00);
+    xmm_p = _mm_xor_si128(xmm_p, xmm_t);
+    return (uint32_t)_mm_extract_epi32(xmm_p, 1);
+}
+
 #endif
 
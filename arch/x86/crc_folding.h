@@ -15,5 +15,9 @@
 ZLIB_INTERNAL void crc_fold_init(deflate_state *const);
 ZLIB_INTERNAL uint32_t crc_fold_512to32(deflate_state *const);
 ZLIB_INTERNAL void crc_fold_copy(deflate_state *const, unsigned char *, const unsigned char *, long);
+ZLIB_INTERNAL uint32_t crc_fold_final(const unsigned char *, const unsigned char *, uint64_t);
+
+ZLIB_INTERNAL uint32_t crc32_pclmulqdq(uint32_t, const unsigned char *, uint64_t);
+ZLIB_INTERNAL uint32_t crc32_copy_pclmulqdq(uint32_t, unsigned char *, const unsigned char *, size_t);
 
 #endif
@@ -15,6 +15,7 @@
 #include "../../deflate.h"
 #include "../../deflate_p.h"
 #include "../../functable.h"
+#include "../../ztrace.h"
 
 extern int read_buf(PREFIX3(stream) *strm, unsigned char *buf, unsigned size);
 void slide_hash_sse2(deflate_state *s);
@@ -25,6 +26,7 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
     unsigned int wsize = s->w_size;
 
     Assert(s->lookahead < MIN_LOOKAHEAD, "already enough lookahead");
+    STATS_TIMER_START(start);
 
     do {
         more = (unsigned)(s->window_size -(unsigned long)s->lookahead -(unsigned long)s->strstart);
@@ -59,6 +61,7 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
              */
             slide_hash_sse2(s);
             more += wsize;
+            ZTRACE3(deflate_slide, s->strm, wsize, s->strm->total_in);
         }
         if (s->strm->avail_in == 0) break;
 
@@ -83,11 +86,11 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
             unsigned int str = s->strstart - s->insert;
             s->ins_h = s->window[str];
             if (str >= 1)
-                functable.insert_string(s, str + 2 - MIN_MATCH, 1);
+                s->insert_string(s, str + 2 - MIN_MATCH, 1);
 #if MIN_MATCH != 3
 #error Call insert_string() MIN_MATCH-3 more times
             while (s->insert) {
-                functable.insert_string(s, str, 1);
+                s->insert_string(s, str, 1);
                 str++;
                 s->insert--;
                 if (s->lookahead + s->insert < MIN_MATCH)
@@ -100,7 +103,7 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
             }else{
                 count = s->insert;
             }
-            functable.insert_string(s, str, count);
+            s->insert_string(s, str, count);
             s->insert -= count;
 #endif
         }
@@ -143,5 +146,6 @@ ZLIB_INTERNAL void fill_window_sse(deflate_state *s) {
     }
 
     Assert((unsigned long)s->strstart <= s->window_size - MIN_LOOKAHEAD, "not enough room for search");
+    STATS_TIMER_END(s, fill_window_ns, start);
 }
 #endif
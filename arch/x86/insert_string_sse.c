@@ -11,61 +11,92 @@
 #  include <nmmintrin.h>
 #endif
 #include "../../deflate.h"
+#include "../../deflate_p.h"
 
-/* ===========================================================================
- * Insert string str in the dictionary and set match_head to the previous head
- * of the hash chain (the most recent string with same hash key). Return
- * the previous length of the hash chain.
- * IN  assertion: all calls to to INSERT_STRING are made with consecutive
- *    input characters and the first MIN_MATCH bytes of str are valid
- *    (except for the last MIN_MATCH-1 bytes of the input file).
- */
 #ifdef X86_SSE42_CRC_HASH
-ZLIB_INTERNAL Pos insert_string_sse(deflate_state *const s, const Pos str, unsigned int count) {
-    Pos ret = 0;
-    unsigned int idx;
+static inline unsigned int hash_sse(deflate_state *const s, const Pos str) {
     unsigned int *ip, val, h;
 
-    for (idx = 0; idx < count; idx++) {
-        ip = (unsigned *)&s->window[str+idx];
-        memcpy(&val, ip, sizeof(val));
-        h = 0;
+    ip = (unsigned *)&s->window[str];
+    memcpy(&val, ip, sizeof(val));
+    h = 0;
 
-        if (s->level >= TRIGGER_LEVEL)
-            val &= 0xFFFFFF;
+    if (HASH_BYTES(s) == 3)
+        val &= 0xFFFFFF;
 
 #if defined(X86_SSE42_CRC_INTRIN)
 #  ifdef _MSC_VER
-        h = _mm_crc32_u32(h, val);
+    h = _mm_crc32_u32(h, val);
+    if (HASH_BYTES(s) == 5)
+        h = _mm_crc32_u8(h, s->window[str+4]);
 #  else
-        h = __builtin_ia32_crc32si(h, val);
+    h = __builtin_ia32_crc32si(h, val);
+    if (HASH_BYTES(s) == 5)
+        h = __builtin_ia32_crc32qi(h, s->window[str+4]);
 #  endif
 #else
 #  ifdef _MSC_VER
-        __asm {
-            mov edx, h
-            mov eax, val
-            crc32 eax, edx
-            mov val, eax
-        };
+    __asm {
+        mov edx, h
+        mov eax, val
+        crc32 eax, edx
+        mov val, eax
+    };
+    if (HASH_BYTES(s) == 5)
+        h = _mm_crc32_u8(h, s->window[str+4]);
 #  else
+    __asm__ __volatile__ (
+        "crc32 %1,%0\n\t"
+        : "+r" (h)
+        : "r" (val)
+    );
+    if (HASH_BYTES(s) == 5) {
+        unsigned char c = s->window[str+4];
         __asm__ __volatile__ (
-            "crc32 %1,%0\n\t"
+            "crc32b %1,%0\n\t"
             : "+r" (h)
-            : "r" (val)
+            : "q" (c)
         );
+    }
 #  endif
 #endif
-        Pos head = s->head[h & s->hash_mask];
-        if (head != str+idx) {
-            s->prev[(str+idx) & s->w_mask] = head;
-            s->head[h & s->hash_mask] = str+idx;
-            if (idx == count-1)
-              ret = head;
-        } else if (idx == count - 1) {
-          ret = str + idx;
-        }
+    return h & s->hash_mask;
+}
+
+/* ===========================================================================
+ * Insert string str in the dictionary and set match_head to the previous head
+ * of the hash chain (the most recent string with same hash key). Return
+ * the previous length of the hash chain.
+ * IN  assertion: all calls to to INSERT_STRING are made with consecutive
+ *    input characters and the first MIN_MATCH bytes of str are valid
+ *    (except for the last MIN_MATCH-1 bytes of the input file).
+ */
+ZLIB_INTERNAL Pos insert_string_sse(deflate_state *const s, const Pos str, unsigned int count) {
+    unsigned int hashes[INSERT_BATCH];
+    Pos ret = 0;
+    unsigned int idx, i, n;
+
+    /* The CRC instructions of a batch are independent, so they are pipelined */
+    if (count == 1) {
+        hashes[0] = hash_sse(s, str);
+        return insert_hashed(s, str, hashes, 1);
+    }
+    for (idx = 0; idx < count; idx += n) {
+        n = count - idx < INSERT_BATCH ? count - idx : INSERT_BATCH;
+        for (i = 0; i < n; i++)
+            hashes[i] = hash_sse(s, str+idx+i);
+        ret = insert_hashed(s, str+idx, hashes, n);
     }
     return ret;
 }
+
+/* ===========================================================================
+ * Clear the hash table entries of the count strings starting at str.
+ */
+ZLIB_INTERNAL void clear_hash_sse(deflate_state *const s, const Pos str, unsigned int count) {
+    unsigned int idx;
+
+    for (idx = 0; idx < count; idx++)
+        s->head[hash_sse(s, str+idx)] = 0;
+}
 #endif
@@ -0,0 +1,38 @@
+/* rle258_avx.c -- AVX2 version of rle258
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zbuild.h"
+#include "../../deflate.h"
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#  include "../../fallback_builtins.h"
+#endif
+
+#ifdef X86_AVX2
+/* Compare 32 bytes at a time with the broadcast byte, then the remaining 2 bytes one by one */
+unsigned ZLIB_INTERNAL rle258_avx2(const unsigned char *src, unsigned char c) {
+    const __m256i ymm_c = _mm256_set1_epi8((char)c);
+    unsigned len = 0;
+
+    do {
+        __m256i ymm_src, ymm_cmp;
+        unsigned mask;
+
+        ymm_src = _mm256_loadu_si256((__m256i *)(src + len));
+        ymm_cmp = _mm256_cmpeq_epi8(ymm_src, ymm_c);
+        mask = (unsigned)_mm256_movemask_epi8(ymm_cmp);
+        if (mask != 0xFFFFFFFF)
+            return len + (unsigned)__builtin_ctzl(~mask);
+        len += 32;
+    } while (len < 256);
+
+    if (src[len] == c) {
+        len++;
+        if (src[len] == c)
+            len++;
+    }
+    return len;
+}
+#endif
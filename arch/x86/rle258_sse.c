@@ -0,0 +1,38 @@
+/* rle258_sse.c -- SSE2 version of rle258
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "../../zbuild.h"
+#include "../../deflate.h"
+
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#  include "../../fallback_builtins.h"
+#endif
+
+#ifdef X86_SSE2
+/* Compare 16 bytes at a time with the broadcast byte, then the remaining 2 bytes one by one */
+unsigned ZLIB_INTERNAL rle258_sse2(const unsigned char *src, unsigned char c) {
+    const __m128i xmm_c = _mm_set1_epi8((char)c);
+    unsigned len = 0;
+
+    do {
+        __m128i xmm_src, xmm_cmp;
+        unsigned mask;
+
+        xmm_src = _mm_loadu_si128((__m128i *)(src + len));
+        xmm_cmp = _mm_cmpeq_epi8(xmm_src, xmm_c);
+        mask = (unsigned)_mm_movemask_epi8(xmm_cmp);
+        if (mask != 0xFFFF)
+            return len + (unsigned)__builtin_ctzl(~mask);
+        len += 16;
+    } while (len < 256);
+
+    if (src[len] == c) {
+        len++;
+        if (src[len] == c)
+            len++;
+    }
+    return len;
+}
+#endif
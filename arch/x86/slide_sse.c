@@ -19,6 +19,8 @@ ZLIB_INTERNAL void slide_hash_sse2(deflate_state *s) {
     unsigned wsize = s->w_size;
     const __m128i xmm_wsize = _mm_set1_epi16(s->w_size);
 
+    STATS_ADD(s, slide_hash, 1);
+
     n = s->hash_size;
     p = &s->head[n] - 8;
     do {
@@ -18,9 +18,13 @@
 #endif
 
 ZLIB_INTERNAL int x86_cpu_has_sse2;
+ZLIB_INTERNAL int x86_cpu_has_ssse3;
 ZLIB_INTERNAL int x86_cpu_has_sse42;
 ZLIB_INTERNAL int x86_cpu_has_pclmulqdq;
+ZLIB_INTERNAL int x86_cpu_has_vpclmulqdq;
 ZLIB_INTERNAL int x86_cpu_has_tzcnt;
+ZLIB_INTERNAL int x86_cpu_has_avx2;
+ZLIB_INTERNAL int x86_cpu_has_avx512;
 
 static void cpuid(int info, unsigned* eax, unsigned* ebx, unsigned* ecx, unsigned* edx) {
 #ifdef _MSC_VER
@@ -44,25 +48,50 @@ static void cpuid(int info, unsigned* eax, unsigned* ebx, unsigned* ecx, unsigne
 #endif
 }
 
+static uint64_t xgetbv(unsigned int xcr) {
+#ifdef _MSC_VER
+    return _xgetbv(xcr);
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(xcr));
+    return (uint64_t)edx << 32 | eax;
+#endif
+}
+
 void ZLIB_INTERNAL x86_check_features(void) {
     unsigned eax, ebx, ecx, edx;
     unsigned maxbasic;
+    uint64_t xcr0 = 0;
 
     cpuid(0, &maxbasic, &ebx, &ecx, &edx);
 
     cpuid(1 /*CPU_PROCINFO_AND_FEATUREBITS*/, &eax, &ebx, &ecx, &edx);
 
     x86_cpu_has_sse2 = edx & 0x4000000;
+    x86_cpu_has_ssse3 = ecx & 0x200;
     x86_cpu_has_sse42 = ecx & 0x100000;
     x86_cpu_has_pclmulqdq = ecx & 0x2;
 
+    // check that the OS saves the YMM and ZMM registers (OSXSAVE bit)
+    if (ecx & 0x8000000)
+        xcr0 = xgetbv(0);
+
     if (maxbasic >= 7) {
         cpuid(7, &eax, &ebx, &ecx, &edx);
 
         // check BMI1 bit
         // Reference: https://software.intel.com/sites/default/files/article/405250/how-to-detect-new-instruction-support-in-the-4th-generation-intel-core-processor-family.pdf
         x86_cpu_has_tzcnt = ebx & 0x8;
+        // check AVX2 bit, and AVX512F plus AVX512BW bits
+        x86_cpu_has_avx2 = (ebx & 0x20) && (xcr0 & 0x6) == 0x6;
+        x86_cpu_has_avx512 = (ebx & 0x40010000) == 0x40010000 && (xcr0 & 0xe6) == 0xe6;
+        // check VPCLMULQDQ bit, usable with AVX512F registers
+        x86_cpu_has_vpclmulqdq = (ecx & 0x400) && (ebx & 0x10000) && (xcr0 & 0xe6) == 0xe6 &&
+            x86_cpu_has_pclmulqdq;
     } else {
         x86_cpu_has_tzcnt = 0;
+        x86_cpu_has_avx2 = 0;
+        x86_cpu_has_avx512 = 0;
+        x86_cpu_has_vpclmulqdq = 0;
     }
 }
@@ -7,9 +7,13 @@
 #define CPU_H_
 
 extern int x86_cpu_has_sse2;
+extern int x86_cpu_has_ssse3;
 extern int x86_cpu_has_sse42;
 extern int x86_cpu_has_pclmulqdq;
+extern int x86_cpu_has_vpclmulqdq;
 extern int x86_cpu_has_tzcnt;
+extern int x86_cpu_has_avx2;
+extern int x86_cpu_has_avx512;
 
 void ZLIB_INTERNAL x86_check_features(void);
 
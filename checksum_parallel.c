@@ -0,0 +1,104 @@
+/* checksum_parallel.c -- compute the Adler-32 or CRC-32 of a buffer using several threads
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * The buffer is cut into one piece per thread, the check value of each piece
+ * is computed on its own, and the results are joined with the combine
+ * functions, which take time independent of the length of the pieces. The
+ * first piece continues from the check value passed in, so the result is the
+ * same as that of adler32_z() or crc32_z() on the whole buffer.
+ */
+
+#ifndef ZLIB_COMPAT
+
+#include "zbuild.h"
+#include "zutil.h"
+#include "zthread.h"
+
+/* Smallest piece worth handing to a thread of its own */
+#define CHECKSUM_PARALLEL_MIN (1024*1024)
+
+typedef struct {
+    const unsigned char *buf;   /* start of the piece */
+    size_t len;                 /* length of the piece */
+    uint32_t check;             /* initial, and then final, check value */
+    int crc;                    /* true for CRC-32, false for Adler-32 */
+} checksum_piece;
+
+static void *checksum_worker(void *arg) {
+    checksum_piece *p = (checksum_piece *)arg;
+
+    if (p->crc)
+        p->check = zng_crc32_z(p->check, p->buf, p->len);
+    else
+        p->check = zng_adler32_z(p->check, p->buf, p->len);
+    return NULL;
+}
+
+static uint32_t checksum_parallel(uint32_t check, const unsigned char *buf, size_t len, int threads, int crc) {
+#ifdef Z_HAVE_THREADS
+    checksum_piece *pieces;
+    z_thread_t *tids;
+    size_t size, pos;
+    unsigned int count, started, i;
+
+    if (buf == NULL || threads < 2 || len / 2 < CHECKSUM_PARALLEL_MIN)
+        return crc ? zng_crc32_z(check, buf, len) : zng_adler32_z(check, buf, len);
+    count = len / CHECKSUM_PARALLEL_MIN < (size_t)threads ? (unsigned int)(len / CHECKSUM_PARALLEL_MIN)
+                                                           : (unsigned int)threads;
+
+    pieces = (checksum_piece *)malloc(count * sizeof(checksum_piece));
+    tids = (z_thread_t *)malloc(count * sizeof(z_thread_t));
+    if (pieces == NULL || tids == NULL) {
+        free(pieces);
+        free(tids);
+        return crc ? zng_crc32_z(check, buf, len) : zng_adler32_z(check, buf, len);
+    }
+
+    /* Pieces of whole pages, with what is left over in the last one */
+    size = (len / count) & ~(size_t)4095;
+    for (i = 0, pos = 0; i < count; i++, pos += size) {
+        pieces[i].buf = buf + pos;
+        pieces[i].len = i == count - 1 ? len - pos : size;
+        pieces[i].check = i == 0 ? check : crc ? 0 : 1;
+        pieces[i].crc = crc;
+    }
+
+    /* The first piece is done on the calling thread, and so is whatever could
+       not be handed to a thread */
+    for (started = 1; started < count; started++) {
+        if (z_thread_create(&tids[started], checksum_worker, &pieces[started]) != 0)
+            break;
+    }
+    checksum_worker(&pieces[0]);
+    for (i = started; i < count; i++)
+        checksum_worker(&pieces[i]);
+    for (i = 1; i < started; i++)
+        z_thread_join(tids[i]);
+
+    check = pieces[0].check;
+    for (i = 1; i < count; i++) {
+        if (crc)
+            check = zng_crc32_combine64(check, pieces[i].check, (z_off64_t)pieces[i].len);
+        else
+            check = zng_adler32_combine64(check, pieces[i].check, (z_off64_t)pieces[i].len);
+    }
+    free(pieces);
+    free(tids);
+    return check;
+#else
+    (void)threads;
+    return crc ? zng_crc32_z(check, buf, len) : zng_adler32_z(check, buf, len);
+#endif
+}
+
+/* ========================================================================= */
+uint32_t ZEXPORT zng_adler32_parallel(uint32_t adler, const unsigned char *buf, size_t len, int threads) {
+    return checksum_parallel(adler, buf, len, threads, 0);
+}
+
+/* ========================================================================= */
+uint32_t ZEXPORT zng_crc32_parallel(uint32_t crc, const unsigned char *buf, size_t len, int threads) {
+    return checksum_parallel(crc, buf, len, threads, 1);
+}
+
+#endif
@@ -0,0 +1,53 @@
+/* chunkset.c -- inline functions to copy small data chunks.
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "zbuild.h"
+#include "zutil.h"
+#include "memcopy.h"
+
+#ifdef INFFAST_CHUNKSIZE
+
+/* Used when the CPU lacks the vector extensions the build was configured for */
+typedef uint64_t chunk_t;
+
+#define CHUNK_SIZE 8
+
+static inline chunk_t chunkmemset_1(unsigned char *from) {
+    uint8_t c;
+    memcpy(&c, from, sizeof(c));
+    return 0x0101010101010101ULL * c;
+}
+
+static inline chunk_t chunkmemset_2(unsigned char *from) {
+    uint16_t c;
+    memcpy(&c, from, sizeof(c));
+    return 0x0001000100010001ULL * c;
+}
+
+static inline chunk_t chunkmemset_4(unsigned char *from) {
+    uint32_t c;
+    memcpy(&c, from, sizeof(c));
+    return 0x0000000100000001ULL * c;
+}
+
+static inline chunk_t loadchunk(unsigned char const *s) {
+    chunk_t c;
+    memcpy(&c, s, sizeof(c));
+    return c;
+}
+
+static inline void storechunk(unsigned char *d, chunk_t c) {
+    memcpy(d, &c, sizeof(c));
+}
+
+#define CHUNKSIZE        chunksize_c
+#define CHUNKCOPY        chunkcopy_c
+#define CHUNKCOPY_SAFE   chunkcopy_safe_c
+#define CHUNKUNROLL      chunkunroll_c
+#define CHUNKMEMSET      chunkmemset_c
+#define CHUNKMEMSET_SAFE chunkmemset_safe_c
+
+#include "chunkset_tpl.h"
+
+#endif
@@ -0,0 +1,202 @@
+/* chunkset_tpl.h -- inline functions to copy small data chunks.
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Include this file after defining chunk_t, CHUNK_SIZE (a literal equal to
+ * sizeof(chunk_t)), loadchunk(), storechunk() and chunkmemset_{1,2,4}, plus
+ * chunkmemset_8 if CHUNK_SIZE > 8 and chunkmemset_16 if CHUNK_SIZE > 16. The
+ * names of the generated functions are given by CHUNKSIZE, CHUNKCOPY,
+ * CHUNKCOPY_SAFE, CHUNKUNROLL, CHUNKMEMSET and CHUNKMEMSET_SAFE. Define
+ * HAVE_CHUNKMEMSET_3 or HAVE_CHUNKMEMSET_6 to provide special cases for those
+ * distances, declaring CHUNKUNROLL and CHUNKCOPY first if they need them.
+ */
+
+/* Returns the chunk size */
+ZLIB_INTERNAL unsigned CHUNKSIZE(void) {
+    return sizeof(chunk_t);
+}
+
+/*
+   Behave like memcpy, but assume that it's OK to overwrite at least
+   CHUNK_SIZE bytes of output even if the length is shorter than this,
+   that the length is non-zero, and that `from` lags `out` by at least
+   CHUNK_SIZE bytes (or that they don't overlap at all or simply that
+   the distance is less than the length of the copy).
+
+   Aside from better memory bus utilisation, this means that short copies
+   (CHUNK_SIZE bytes or fewer) will fall straight through the loop
+   without iteration, which will hopefully make the branch prediction more
+   reliable.
+ */
+ZLIB_INTERNAL unsigned char* CHUNKCOPY(unsigned char *out, unsigned char const *from, unsigned len) {
+    --len;
+    storechunk(out, loadchunk(from));
+    out += (len % CHUNK_SIZE) + 1;
+    from += (len % CHUNK_SIZE) + 1;
+    len /= CHUNK_SIZE;
+    while (len > 0) {
+        storechunk(out, loadchunk(from));
+        out += CHUNK_SIZE;
+        from += CHUNK_SIZE;
+        --len;
+    }
+    return out;
+}
+
+/*
+   Behave like chunkcopy, but avoid writing beyond of legal output.
+ */
+ZLIB_INTERNAL unsigned char* CHUNKCOPY_SAFE(unsigned char *out, unsigned char const *from, unsigned len,
+                                           unsigned char *safe) {
+    if ((safe - out) < (ptrdiff_t)CHUNK_SIZE) {
+#if CHUNK_SIZE > 16
+        if (len & 16) {
+            memcpy(out, from, 16);
+            out += 16;
+            from += 16;
+        }
+#endif
+        if (len & 8) {
+            memcpy(out, from, 8);
+            out += 8;
+            from += 8;
+        }
+        if (len & 4) {
+            memcpy(out, from, 4);
+            out += 4;
+            from += 4;
+        }
+        if (len & 2) {
+            memcpy(out, from, 2);
+            out += 2;
+            from += 2;
+        }
+        if (len & 1) {
+            *out++ = *from++;
+        }
+        return out;
+    }
+    return CHUNKCOPY(out, from, len);
+}
+
+/*
+   Perform short copies until distance can be rewritten as being at least
+   CHUNK_SIZE.
+
+   This assumes that it's OK to overwrite at least the first
+   2*CHUNK_SIZE bytes of output even if the copy is shorter than this.
+   This assumption holds because inflate_fast() starts every iteration with at
+   least 258 bytes of output space available (258 being the maximum length
+   output from a single token; see inflate_fast()'s assumptions below).
+ */
+ZLIB_INTERNAL unsigned char* CHUNKUNROLL(unsigned char *out, unsigned *dist, unsigned *len) {
+    unsigned char const *from = out - *dist;
+    while (*dist < *len && *dist < CHUNK_SIZE) {
+        storechunk(out, loadchunk(from));
+        out += *dist;
+        *len -= *dist;
+        *dist += *dist;
+    }
+    return out;
+}
+
+/* Copy DIST bytes from OUT - DIST into OUT + DIST * k, for 0 <= k < LEN/DIST. Return OUT + LEN. */
+ZLIB_INTERNAL unsigned char* CHUNKMEMSET(unsigned char *out, unsigned dist, unsigned len) {
+    /* Debug performance related issues when len < sizeof(uint64_t):
+       Assert(len >= sizeof(uint64_t), "chunkmemset should be called on larger chunks"); */
+    Assert(dist > 0, "cannot have a distance 0");
+
+    unsigned char *from = out - dist;
+    chunk_t chunk;
+    unsigned sz = sizeof(chunk);
+    if (len < sz) {
+#if CHUNK_SIZE > 16
+        /* Wide chunks leave many short matches, which are still worth
+           doing a chunk at a time if they need more than a few bytes. */
+        if (len >= 16) {
+            out = CHUNKUNROLL(out, &dist, &len);
+            return CHUNKCOPY(out, out - dist, len);
+        }
+#endif
+        do {
+            *out++ = *from++;
+            --len;
+        } while (len != 0);
+        return out;
+    }
+
+    switch (dist) {
+    case 1: {
+        chunk = chunkmemset_1(from);
+        break;
+    }
+    case 2: {
+        chunk = chunkmemset_2(from);
+        break;
+    }
+#ifdef HAVE_CHUNKMEMSET_3
+    case 3:
+        return chunkmemset_3(out, from, dist, len);
+#endif
+    case 4: {
+        chunk = chunkmemset_4(from);
+        break;
+    }
+#ifdef HAVE_CHUNKMEMSET_6
+    case 6:
+        return chunkmemset_6(out, from, dist, len);
+#endif
+#if CHUNK_SIZE > 8
+    case 8: {
+        chunk = chunkmemset_8(from);
+        break;
+    }
+#endif
+#if CHUNK_SIZE > 16
+    case 16: {
+        chunk = chunkmemset_16(from);
+        break;
+    }
+#endif
+    case CHUNK_SIZE:
+        chunk = loadchunk(from);
+        break;
+
+    default:
+        out = CHUNKUNROLL(out, &dist, &len);
+        return CHUNKCOPY(out, out - dist, len);
+    }
+
+    unsigned rem = len % sz;
+    len -= rem;
+    while (len) {
+        storechunk(out, chunk);
+        out += sz;
+        len -= sz;
+    }
+
+    /* Last, deal with the case when LEN is not a multiple of SZ. */
+    if (rem)
+        memcpy(out, &chunk, rem);
+    out += rem;
+    return out;
+}
+
+ZLIB_INTERNAL unsigned char* CHUNKMEMSET_SAFE(unsigned char *out, unsigned dist, unsigned len, unsigned left) {
+    if (left < (unsigned)(3 * CHUNK_SIZE)) {
+        while (len > 0) {
+          *out = *(out - dist);
+          out++;
+          --len;
+        }
+        return out;
+    }
+
+    return CHUNKMEMSET(out, dist, len);
+}
+
+#undef CHUNKSIZE
+#undef CHUNKCOPY
+#undef CHUNKCOPY_SAFE
+#undef CHUNKUNROLL
+#undef CHUNKMEMSET
+#undef CHUNKMEMSET_SAFE
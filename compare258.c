@@ -0,0 +1,89 @@
+/* compare258.c -- portable string compare and longest_match
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "zbuild.h"
+#include "deflate.h"
+#include "match_p.h"
+
+/* ===========================================================================
+ * Return the number of leading bytes that are equal in src0 and src1, up to
+ * 258. This is the fallback of functable.compare258; the x86 versions live in
+ * arch/x86/compare258_*.c.
+ */
+unsigned ZLIB_INTERNAL compare258_c(const unsigned char *src0, const unsigned char *src1) {
+    unsigned len = 0;
+
+#ifdef std3_longest_match
+    /* Unaligned little endian loads with a fast ctzl, as std3_longest_match */
+    do {
+        unsigned long sv, mv, diff;
+
+        memcpy(&sv, src0 + len, sizeof(sv));
+        memcpy(&mv, src1 + len, sizeof(mv));
+        diff = sv ^ mv;
+        if (diff)
+            return len + (unsigned)__builtin_ctzl(diff) / 8;
+        len += sizeof(unsigned long);
+    } while (len < 256);
+#else
+    do {
+        if (src0[len] != src1[len])
+            return len;
+        len++;
+    } while (len < 256);
+#endif
+
+    if (src0[len] == src1[len]) {
+        len++;
+        if (src0[len] == src1[len])
+            len++;
+    }
+    return len;
+}
+
+/* ===========================================================================
+ * Return the number of leading bytes of src that are equal to c, up to 258.
+ * This is the fallback of functable.rle258, which deflate_rle uses to measure
+ * the run of the previous byte; the SIMD versions live in
+ * arch/x86/rle258_*.c and arch/arm/rle258_neon.c.
+ */
+unsigned ZLIB_INTERNAL rle258_c(const unsigned char *src, unsigned char c) {
+    unsigned len = 0;
+
+#ifdef std3_longest_match
+    /* Compare a word at a time against c repeated in every byte */
+    const unsigned long pattern = ((unsigned long)-1 / 0xff) * c;
+
+    do {
+        unsigned long sv, diff;
+
+        memcpy(&sv, src + len, sizeof(sv));
+        diff = sv ^ pattern;
+        if (diff)
+            return len + (unsigned)__builtin_ctzl(diff) / 8;
+        len += sizeof(unsigned long);
+    } while (len < 256);
+#else
+    do {
+        if (src[len] != c)
+            return len;
+        len++;
+    } while (len < 256);
+#endif
+
+    if (src[len] == c) {
+        len++;
+        if (src[len] == c)
+            len++;
+    }
+    return len;
+}
+
+/* ===========================================================================
+ * Out-of-line copy of the longest_match variant selected in match_p.h, used
+ * by functable.longest_match when no faster version is available.
+ */
+unsigned ZLIB_INTERNAL longest_match_c(deflate_state *const s, IPos cur_match) {
+    return longest_match(s, cur_match);
+}
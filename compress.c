@@ -13,6 +13,51 @@
 # include "zlib-ng.h"
 #endif
 
+/* ===========================================================================
+ * Compress all of source with the initialized or reset stream.
+ */
+static int deflate_all(PREFIX3(stream) *stream, unsigned char *dest, z_size_t *destLen,
+                       const unsigned char *source, z_size_t sourceLen) {
+    int err;
+    const unsigned int max = (unsigned int)-1;
+    z_size_t left;
+
+    left = *destLen;
+    *destLen = 0;
+
+    stream->next_out = dest;
+    stream->avail_out = 0;
+    stream->next_in = (const unsigned char *)source;
+    stream->avail_in = 0;
+
+    do {
+        if (stream->avail_out == 0) {
+            stream->avail_out = left > (unsigned long)max ? max : (unsigned int)left;
+            left -= stream->avail_out;
+        }
+        if (stream->avail_in == 0) {
+            stream->avail_in = sourceLen > (unsigned long)max ? max : (unsigned int)sourceLen;
+            sourceLen -= stream->avail_in;
+        }
+        err = PREFIX(deflate)(stream, sourceLen ? Z_NO_FLUSH : Z_FINISH);
+    } while (err == Z_OK);
+
+    *destLen = (z_size_t)stream->total_out;
+    return err == Z_STREAM_END ? Z_OK : err;
+}
+
+/* ===========================================================================
+ * Compress all of source with the initialized stream and end it.
+ */
+static int compress_stream(PREFIX3(stream) *stream, unsigned char *dest, z_size_t *destLen,
+                           const unsigned char *source, z_size_t sourceLen) {
+    int err;
+
+    err = deflate_all(stream, dest, destLen, source, sourceLen);
+    PREFIX(deflateEnd)(stream);
+    return err;
+}
+
 /* ===========================================================================
      Compresses the source buffer into the destination buffer. The level
    parameter has the same meaning as in deflateInit.  sourceLen is the byte
@@ -28,40 +73,17 @@ int ZEXPORT PREFIX(compress2)(unsigned char *dest, z_size_t *destLen, const unsi
                         z_size_t sourceLen, int level) {
     PREFIX3(stream) stream;
     int err;
-    const unsigned int max = (unsigned int)-1;
-    z_size_t left;
-
-    left = *destLen;
-    *destLen = 0;
 
     stream.zalloc = NULL;
     stream.zfree = NULL;
     stream.opaque = NULL;
 
     err = PREFIX(deflateInit)(&stream, level);
-    if (err != Z_OK)
+    if (err != Z_OK) {
+        *destLen = 0;
         return err;
-
-    stream.next_out = dest;
-    stream.avail_out = 0;
-    stream.next_in = (const unsigned char *)source;
-    stream.avail_in = 0;
-
-    do {
-        if (stream.avail_out == 0) {
-            stream.avail_out = left > (unsigned long)max ? max : (unsigned int)left;
-            left -= stream.avail_out;
-        }
-        if (stream.avail_in == 0) {
-            stream.avail_in = sourceLen > (unsigned long)max ? max : (unsigned int)sourceLen;
-            sourceLen -= stream.avail_in;
-        }
-        err = PREFIX(deflate)(&stream, sourceLen ? Z_NO_FLUSH : Z_FINISH);
-    } while (err == Z_OK);
-
-    *destLen = (z_size_t)stream.total_out;
-    PREFIX(deflateEnd)(&stream);
-    return err == Z_STREAM_END ? Z_OK : err;
+    }
+    return compress_stream(&stream, dest, destLen, source, sourceLen);
 }
 
 /* ===========================================================================
@@ -77,3 +99,85 @@ int ZEXPORT PREFIX(compress)(unsigned char *dest, z_size_t *destLen, const unsig
 z_size_t ZEXPORT PREFIX(compressBound)(z_size_t sourceLen) {
     return sourceLen + (sourceLen >> 12) + (sourceLen >> 14) + (sourceLen >> 25) + 13;
 }
+
+#ifndef ZLIB_COMPAT
+#define ONESHOT_LOOKAHEAD 262   /* MIN_LOOKAHEAD in deflate.h */
+
+/* ===========================================================================
+   Choose the smallest window that still reaches back over all of source, and
+   a symbol buffer that holds all of it, as for such inputs the larger default
+   ones only cost memory and the time to set them up. If the default memLevel
+   for deflateInit() is changed, then this function needs to be updated.
+ */
+static void oneshot_params(size_t sourceLen, int *windowBits, int *memLevel) {
+    int bits = 9;
+
+    while (bits < MAX_WBITS && ((size_t)1 << bits) - ONESHOT_LOOKAHEAD < sourceLen)
+        bits++;
+    *windowBits = bits;
+    *memLevel = bits - 6 < 8 ? bits - 6 : 8;
+}
+
+size_t ZEXPORT zng_compress_oneshot_size(size_t sourceLen, int level) {
+    int windowBits, memLevel;
+
+    oneshot_params(sourceLen, &windowBits, &memLevel);
+    return zng_deflateArenaSize(level, windowBits, memLevel);
+}
+
+int ZEXPORT zng_compress_oneshot(unsigned char *dest, size_t *destLen, const unsigned char *source, size_t sourceLen,
+                                 int level, void *scratch, size_t scratch_size) {
+    zng_stream stream;
+    int windowBits, memLevel, err;
+
+    oneshot_params(sourceLen, &windowBits, &memLevel);
+    err = zng_deflateInitArena(&stream, scratch, scratch_size, level, Z_DEFLATED, windowBits, memLevel,
+                               Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        *destLen = 0;
+        return err;
+    }
+    return compress_stream(&stream, dest, destLen, source, sourceLen);
+}
+
+int ZEXPORT zng_compress_batch(const zng_iovec *inputs, zng_iovec *outputs, size_t n, int level) {
+    zng_stream stream;
+    size_t i, max = 0;
+    int windowBits, memLevel, err;
+
+    if (n == 0)
+        return Z_OK;
+    if (inputs == NULL || outputs == NULL)
+        return Z_STREAM_ERROR;
+
+    /* One stream for all of the records, sized for the longest */
+    for (i = 0; i < n; i++)
+        if (max < inputs[i].iov_len)
+            max = inputs[i].iov_len;
+    oneshot_params(max, &windowBits, &memLevel);
+    stream.zalloc = NULL;
+    stream.zfree = NULL;
+    stream.opaque = NULL;
+    err = zng_deflateInit2(&stream, level, Z_DEFLATED, windowBits, memLevel, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        for (i = 0; i < n; i++)
+            outputs[i].iov_len = 0;
+        return err;
+    }
+
+    /* A reset between the records only clears what the last one used */
+    for (i = 0; i < n; i++) {
+        if (i != 0)
+            err = zng_deflateReset(&stream);
+        if (err == Z_OK)
+            err = deflate_all(&stream, (unsigned char *)outputs[i].iov_base, &outputs[i].iov_len,
+                              (const unsigned char *)inputs[i].iov_base, inputs[i].iov_len);
+        if (err != Z_OK)
+            break;
+    }
+    for (; i < n; i++)
+        outputs[i].iov_len = 0;
+    zng_deflateEnd(&stream);
+    return err;
+}
+#endif
@@ -21,6 +21,7 @@
 
 
 /* Local functions for crc concatenation */
+static uint32_t x2nmodp(z_off64_t n, unsigned k);
 static uint32_t crc32_combine_(uint32_t crc1, uint32_t crc2, z_off64_t len2);
 static void crc32_combine_gen_(uint32_t *op, z_off64_t len2);
 
@@ -36,6 +37,19 @@ uint32_t ZEXPORT PREFIX(crc32_z)(uint32_t crc, const unsigned char *buf, size_t
 
     return functable.crc32(crc, buf, len);
 }
+/* ========================================================================= */
+ZLIB_INTERNAL uint32_t crc32_copy_c(uint32_t crc, unsigned char *dst, const unsigned char *src, size_t len) {
+    while (len) {
+        size_t n = len < CHECKSUM_COPY_CHUNK ? len : CHECKSUM_COPY_CHUNK;
+        memcpy(dst, src, n);
+        crc = functable.crc32(crc, dst, n);
+        dst += n;
+        src += n;
+        len -= n;
+    }
+    return crc;
+}
+
 /* ========================================================================= */
 #define DO1 crc = crc_table[0][((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8)
 #define DO8 DO1; DO1; DO1; DO1; DO1; DO1; DO1; DO1
@@ -172,14 +186,29 @@ ZLIB_INTERNAL uint32_t crc32_big(uint32_t crc, const unsigned char *buf, uint64_
 
 
 /* ========================================================================= */
-static uint32_t crc32_combine_(uint32_t crc1, uint32_t crc2, z_off64_t len2) {
-    int n;
+ZLIB_INTERNAL uint32_t crc32_multmodp_c(uint32_t a, uint32_t b) {
+    return multmodp(a, b);
+}
+
+/* Return x^(n * 2^k) modulo p(x). Appending len zero bytes to a message
+   multiplies its CRC by x2nmodp(len, 3). */
+static uint32_t x2nmodp(z_off64_t n, unsigned k) {
+    uint32_t p;
+
+    p = (uint32_t)1 << 31;              /* x^0 == 1 */
+    while (n) {
+        if (n & 1)
+            p = functable.crc32_multmodp(x2n_table[k & (GF2_DIM - 1)], p);
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
 
+/* ========================================================================= */
+static uint32_t crc32_combine_(uint32_t crc1, uint32_t crc2, z_off64_t len2) {
     if (len2 > 0)
-        /* operator for 2^n zeros repeats every GF2_DIM n values */
-        for (n = 0; len2; n = (n + 1) % GF2_DIM, len2 >>= 1)
-            if (len2 & 1)
-                crc1 = gf2_matrix_times(crc_comb[n], crc1);
+        crc1 = functable.crc32_multmodp(x2nmodp(len2, 3), crc1);
     return crc1 ^ crc2;
 }
 
@@ -197,8 +226,14 @@ uint32_t ZEXPORT PREFIX(crc32_combine64)(uint32_t crc1, uint32_t crc2, z_off64_t
 #include "arch/x86/crc_folding.h"
 
 ZLIB_INTERNAL void crc_finalize(deflate_state *const s) {
-    if (x86_cpu_has_pclmulqdq)
+    if (x86_cpu_has_pclmulqdq) {
         s->strm->adler = crc_fold_512to32(s);
+        /* The folding cannot start from a given CRC, so one of a stream from
+           zng_deflateDeserialize() is joined with that of the input since */
+        if (s->crc_prior_set)
+            s->strm->adler = PREFIX(crc32_combine64)(s->crc_prior, s->strm->adler,
+                                                     (z_off64_t)(s->strm->total_in - s->crc_prior_len));
+    }
 }
 #endif
 
@@ -206,6 +241,7 @@ ZLIB_INTERNAL void crc_reset(deflate_state *const s) {
 #ifdef X86_PCLMULQDQ_CRC
     if (x86_cpu_has_pclmulqdq) {
         crc_fold_init(s);
+        s->crc_prior_set = 0;
         return;
     }
 #endif
@@ -226,44 +262,15 @@ ZLIB_INTERNAL void copy_with_crc(PREFIX3(stream) *strm, unsigned char *dst, unsi
 /* ========================================================================= */
 static void crc32_combine_gen_(uint32_t *op, z_off64_t len2)
 {
-    uint32_t row;
+    uint32_t p;
     int j;
-    unsigned i;
-
-    /* if len2 is zero or negative, return the identity matrix */
-    if (len2 <= 0) {
-        row = 1;
-        for (j = 0; j < GF2_DIM; j++) {
-            op[j] = row;
-            row <<= 1;
-        }
-        return;
-    }
 
-    /* at least one bit in len2 is set -- find it, and copy the operator
-       corresponding to that position into op */
-    i = 0;
-    for (;;) {
-        if (len2 & 1) {
-            for (j = 0; j < GF2_DIM; j++)
-                op[j] = crc_comb[i][j];
-            break;
-        }
-        len2 >>= 1;
-        i = (i + 1) % GF2_DIM;
-    }
-
-    /* for each remaining bit set in len2 (if any), multiply op by the operator
-       corresponding to that position */
-    for (;;) {
-        len2 >>= 1;
-        i = (i + 1) % GF2_DIM;
-        if (len2 == 0)
-            break;
-        if (len2 & 1)
-            for (j = 0; j < GF2_DIM; j++)
-                op[j] = gf2_matrix_times(crc_comb[i], op[j]);
-    }
+    /* row j of the operator is the power for len2 zero bytes times the
+       polynomial of bit j -- if len2 is zero or negative, that is the
+       identity matrix */
+    p = len2 > 0 ? x2nmodp(len2, 3) : (uint32_t)1 << 31;
+    for (j = 0; j < GF2_DIM; j++)
+        op[j] = functable.crc32_multmodp(p, (uint32_t)1 << j);
 }
 
 /* ========================================================================= */
@@ -282,3 +289,27 @@ uint32_t ZEXPORT PREFIX(crc32_combine_op)(uint32_t crc1, uint32_t crc2, const ui
 {
     return gf2_matrix_times(op, crc1) ^ crc2;
 }
+
+#ifndef ZLIB_COMPAT
+/* ========================================================================= */
+uint32_t ZEXPORT PREFIX(crc32_combine_batch)(uint32_t crc, const uint32_t *crcs, const z_off64_t *lens, size_t count)
+{
+    z_off64_t last = 0;
+    uint32_t p = 0;
+    size_t i;
+
+    /* chunks are often all of one length, so keep the power for the last
+       length instead of working it out again for each chunk */
+    for (i = 0; i < count; i++) {
+        if (lens[i] > 0) {
+            if (lens[i] != last) {
+                p = x2nmodp(lens[i], 3);
+                last = lens[i];
+            }
+            crc = functable.crc32_multmodp(p, crc);
+        }
+        crc ^= crcs[i];
+    }
+    return crc;
+}
+#endif
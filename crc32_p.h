@@ -15,5 +15,24 @@ static inline uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
     return sum;
 }
 
+/* Return a(x) multiplied by b(x) modulo p(x), where p(x) is the CRC polynomial,
+   reflected. For speed, this requires that a not be zero. */
+static inline uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t m, p;
+
+    m = (uint32_t)1 << 31;
+    p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ 0xedb88320 : b >> 1;
+    }
+    return p;
+}
+
 
 #endif /* CRC32_P_H_ */
@@ -52,8 +52,8 @@
 #include "zbuild.h"
 #include "deflate.h"
 #include "deflate_p.h"
-#include "match_p.h"
 #include "functable.h"
+#include "ztrace.h"
 
 const char zng_deflate_copyright[] = " deflate 1.2.11.f Copyright 1995-2016 Jean-loup Gailly and Mark Adler ";
 /*
@@ -82,8 +82,9 @@ const char zng_deflate_copyright[] = " deflate 1.2.11.f Copyright 1995-2016 Jean
 #  define DEFLATE_GET_DICTIONARY_HOOK(strm, dict, dict_len) do {} while (0)
 /* Invoked at the end of deflateResetKeep(). Useful for initializing arch-specific extension blocks. */
 #  define DEFLATE_RESET_KEEP_HOOK(strm) do {} while (0)
-/* Invoked at the beginning of deflateParams(). Useful for updating arch-specific compression parameters. */
-#  define DEFLATE_PARAMS_HOOK(strm, level, strategy) do {} while (0)
+/* Invoked at the beginning of deflateParams(). Useful for updating arch-specific compression parameters. Sets
+ * rehash when the strings of the window have to be hashed again. */
+#  define DEFLATE_PARAMS_HOOK(strm, level, strategy, rehash) do {} while (0)
 /* Adjusts the upper bound on compressed data length based on compression parameters and uncompressed data length.
  * Useful when arch-specific deflation code behaves differently than regular zlib-ng algorithms. */
 #  define DEFLATE_BOUND_ADJUST_COMPLEN(strm, complen, sourceLen) do {} while (0)
@@ -96,6 +97,8 @@ const char zng_deflate_copyright[] = " deflate 1.2.11.f Copyright 1995-2016 Jean
 #  define DEFLATE_NEED_CHECKSUM(strm) 1
 /* Returns whether reproducibility parameter can be set to a given value. */
 #  define DEFLATE_CAN_SET_REPRODUCIBLE(strm, reproducible) 1
+/* Extra arena space needed by the allocation hooks above, see zng_deflateArenaSize(). */
+#  define DEFLATE_ARENA_EXTRA 0
 #endif
 
 /* ===========================================================================
@@ -108,15 +111,52 @@ static int deflateStateCheck      (PREFIX3(stream) *strm);
 static block_state deflate_stored (deflate_state *s, int flush);
 ZLIB_INTERNAL block_state deflate_fast         (deflate_state *s, int flush);
 ZLIB_INTERNAL block_state deflate_quick        (deflate_state *s, int flush);
+ZLIB_INTERNAL block_state deflate_quick_dynamic(deflate_state *s, int flush);
 #ifndef NO_MEDIUM_STRATEGY
 ZLIB_INTERNAL block_state deflate_medium       (deflate_state *s, int flush);
+ZLIB_INTERNAL void deflate_medium_reset        (deflate_state *s);
+ZLIB_INTERNAL int  deflate_medium_pending      (deflate_state *s);
+ZLIB_INTERNAL int  deflate_medium_copy         (deflate_state *ds, deflate_state *ss);
+ZLIB_INTERNAL void deflate_medium_end          (deflate_state *s);
 #endif
 ZLIB_INTERNAL block_state deflate_slow         (deflate_state *s, int flush);
+#ifndef ZLIB_COMPAT
+ZLIB_INTERNAL block_state deflate_bucket       (deflate_state *s, int flush);
+ZLIB_INTERNAL block_state deflate_optimal      (deflate_state *s, int flush);
+#endif
 static block_state deflate_rle   (deflate_state *s, int flush);
 static block_state deflate_huff  (deflate_state *s, int flush);
+static block_state deflate_level (deflate_state *s, int flush);
+static block_state prescan_run   (deflate_state *s, int huff, int flush);
+static block_state deflate_prescan(deflate_state *s, int flush);
 static void lm_init              (deflate_state *s);
+static void set_trees            (deflate_state *s);
+static void reset_hash           (deflate_state *s);
 static void putShortMSB          (deflate_state *s, uint16_t b);
 ZLIB_INTERNAL unsigned read_buf  (PREFIX3(stream) *strm, unsigned char *buf, unsigned size);
+#ifndef ZLIB_COMPAT
+static int deflate_wake          (zng_stream *strm);
+static int deflate_own           (zng_stream *strm);
+
+/* Give a stream that zng_deflateIdle() left idle its buffers back before they
+ * are used, or return Z_MEM_ERROR if they cannot be had.
+ */
+#  define WAKE_OR_RETURN(strm) \
+    do { if ((strm)->state->idle && deflate_wake(strm) != Z_OK) return Z_MEM_ERROR; } while (0)
+
+/* Same, and also give a stream that zng_deflateCopyShared() left sharing the
+ * window, prev and head with other streams copies of its own before they are
+ * written.
+ */
+#  define OWN_OR_RETURN(strm) \
+    do { \
+        WAKE_OR_RETURN(strm); \
+        if ((strm)->state->share != NULL && deflate_own(strm) != Z_OK) return Z_MEM_ERROR; \
+    } while (0)
+#else
+#  define WAKE_OR_RETURN(strm) do {} while (0)
+#  define OWN_OR_RETURN(strm) do {} while (0)
+#endif
 
 extern void crc_reset(deflate_state *const s);
 #ifdef X86_PCLMULQDQ_CRC
@@ -132,7 +172,7 @@ extern void copy_with_crc(PREFIX3(stream) *strm, unsigned char *dst, unsigned lo
 /* Tail of hash chains */
 
 /* Values for max_lazy_match, good_match and max_chain_length, depending on
- * the desired pack level (0..9). The values given below have been tuned to
+ * the desired pack level (0..MAX_LEVEL). The values given below have been tuned to
  * exclude worst case performance for pathological files. Better values may be
  * found for specific files.
  */
@@ -144,11 +184,11 @@ typedef struct config_s {
     compress_func func;
 } config;
 
-static const config configuration_table[10] = {
+static const config configuration_table[MAX_LEVEL+1] = {
 /*      good lazy nice chain */
 /* 0 */ {0,    0,  0,    0, deflate_stored},  /* store only */
 
-#ifdef X86_QUICK_STRATEGY
+#ifdef QUICK_STRATEGY
 /* 1 */ {4,    4,  8,    4, deflate_quick},
 /* 2 */ {4,    4,  8,    4, deflate_fast}, /* max speed, no lazy matches */
 #else
@@ -170,17 +210,50 @@ static const config configuration_table[10] = {
 
 /* 7 */ {8,   32, 128,  256, deflate_slow},
 /* 8 */ {32, 128, 258, 1024, deflate_slow},
-/* 9 */ {32, 258, 258, 4096, deflate_slow}}; /* max compression */
+/* 9 */ {32, 258, 258, 4096, deflate_slow}, /* max compression */
+
+#ifndef ZLIB_COMPAT
+/* 10 */ {32,  2, 258, 1024, deflate_optimal}, /* near-optimal parsing */
+/* 11 */ {32,  4, 258, 4096, deflate_optimal},
+/* 12 */ {32, 10, 258, 8192, deflate_optimal},
+#endif
+};
 
 /* Note: the deflate() code requires max_lazy >= MIN_MATCH and max_chain >= 4
  * For deflate_fast() (levels <= 3) good is ignored and lazy has a different
  * meaning.
  */
 
+/* The compression function of the level for the stream, which is that of the
+ * configuration table unless Z_DEFLATE_SEARCH asked for another one.
+ */
+static compress_func level_func(deflate_state *s, int level) {
+    if (level >= 1 && level <= 9) {
+        switch (s->search) {
+            case SEARCH_GREEDY:
+                return deflate_fast;
+            case SEARCH_LAZY:
+                return deflate_slow;
+            case SEARCH_MEDIUM:
+#ifdef NO_MEDIUM_STRATEGY
+                return deflate_slow;
+#else
+                return deflate_medium;
+#endif
+        }
+    }
+    return configuration_table[level].func;
+}
+
 /* rank Z_BLOCK between Z_NO_FLUSH and Z_PARTIAL_FLUSH */
 #define RANK(f) (((f) * 2) - ((f) > 4 ? 9 : 0))
 
 
+/* Hash the strings again on reset instead of clearing the whole table if
+ * there are at most hash_size / REHASH_RATIO of them.
+ */
+#define REHASH_RATIO 16
+
 /* ===========================================================================
  * Initialize the hash table (avoiding 64K overflow for 16 bit systems).
  * prev[] will be initialized on the fly.
@@ -190,16 +263,49 @@ static const config configuration_table[10] = {
     memset((unsigned char *)s->head, 0, (unsigned)(s->hash_size - 1) * sizeof(*s->head)); \
   } while (0)
 
+#ifdef DEFLATE_POS32
+/* Entries are rebased before pos_base and the window indexes added to it could
+ * overflow a Pos.
+ */
+#define POS_BASE_MAX 0x80000000U
+
+/* ===========================================================================
+ * Slide the hash table when sliding the window down. With 32-bit entries this
+ * only moves pos_base, and the entries are rewritten once every POS_BASE_MAX
+ * bytes of input.
+ */
+ZLIB_INTERNAL void slide_hash_c(deflate_state *s) {
+    uint32_t base;
+    unsigned int n;
+    Pos *p;
+
+    s->pos_base += s->w_size;
+    if (s->pos_base < POS_BASE_MAX)
+        return;
+
+    STATS_ADD(s, slide_hash, 1);
+
+    base = s->pos_base;
+    for (n = s->hash_size, p = s->head; n != 0; n--, p++)
+        *p = (Pos)(*p > base ? *p - base : NIL);
+    for (n = s->w_size, p = s->prev; n != 0; n--, p++)
+        *p = (Pos)(*p > base ? *p - base : NIL);
+    s->pos_base = 0;
+}
+#else
 /* ===========================================================================
  * Slide the hash table when sliding the window down (could be avoided with 32
- * bit values at the expense of memory usage). We slide even when level == 0 to
- * keep the hash table consistent if we switch back to level > 0 later.
+ * bit values at the expense of memory usage, see DEFLATE_POS32). We slide even
+ * when level == 0 to keep the hash table consistent if we switch back to
+ * level > 0 later.
  */
 ZLIB_INTERNAL void slide_hash_c(deflate_state *s) {
     unsigned n;
     Pos *p;
     unsigned int wsize = s->w_size;
 
+    STATS_ADD(s, slide_hash, 1);
+
     n = s->hash_size;
     p = &s->head[n];
 #ifdef NOT_TWEAK_COMPILER
@@ -251,6 +357,18 @@ ZLIB_INTERNAL void slide_hash_c(deflate_state *s) {
             }
 #endif /* NOT_TWEAK_COMPILER */
 }
+#endif /* DEFLATE_POS32 */
+
+/* ===========================================================================
+ * Point the tree fields of the state into s->trees.
+ */
+static void set_trees(deflate_state *s) {
+    s->dyn_ltree = s->trees->dyn_ltree;
+    s->dyn_dtree = s->trees->dyn_dtree;
+    s->bl_tree = s->trees->bl_tree;
+    s->heap = s->trees->heap;
+    s->depth = s->trees->depth;
+}
 
 /* ========================================================================= */
 int ZEXPORT PREFIX(deflateInit_)(PREFIX3(stream) *strm, int level, const char *version, int stream_size) {
@@ -261,7 +379,7 @@ int ZEXPORT PREFIX(deflateInit_)(PREFIX3(stream) *strm, int level, const char *v
 /* ========================================================================= */
 int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method, int windowBits,
                            int memLevel, int strategy, const char *version, int stream_size) {
-    unsigned window_padding = 0;
+    unsigned window_padding = 1;    /* the 5 byte hash reads two bytes past the last string */
     deflate_state *s;
     int wrap = 1;
     static const char my_version[] = PREFIX2(VERSION);
@@ -299,21 +417,29 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
 #endif
     }
     if (memLevel < 1 || memLevel > MAX_MEM_LEVEL || method != Z_DEFLATED || windowBits < 8 ||
-        windowBits > 15 || level < 0 || level > 9 || strategy < 0 || strategy > Z_FIXED ||
+        windowBits > 15 || level < 0 || level > MAX_LEVEL || strategy < 0 || strategy > MAX_STRATEGY ||
         (windowBits == 8 && wrap != 1)) {
         return Z_STREAM_ERROR;
     }
     if (windowBits == 8)
         windowBits = 9;  /* until 256-byte window bug fixed */
 
-#ifdef X86_QUICK_STRATEGY
+#ifdef QUICK_STRATEGY
     if (level == 1)
         windowBits = 13;
 #endif
 
+#ifndef ZLIB_COMPAT
+    /* Place all of the stream in one region for zng_stream_set_numa_node() */
+    zng_node_map(strm, zng_deflateArenaSize(level, windowBits, memLevel));
+#endif
     s = (deflate_state *) ZALLOC_STATE(strm, 1, sizeof(deflate_state));
-    if (s == NULL)
+    if (s == NULL) {
+#ifndef ZLIB_COMPAT
+        zng_node_unmap(strm);
+#endif
         return Z_MEM_ERROR;
+    }
     strm->state = (struct internal_state *)s;
     s->strm = strm;
     s->status = INIT_STATE;     /* to pass state test in deflateReset() */
@@ -333,17 +459,17 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
 
     s->hash_size = 1 << s->hash_bits;
     s->hash_mask = s->hash_size - 1;
-#if !defined(__x86_64__) && !defined(_M_X64) && !defined(__i386) && !defined(_M_IX86)
+    s->hash_bytes = 0;
     s->hash_shift =  ((s->hash_bits+MIN_MATCH-1)/MIN_MATCH);
-#endif
+    s->hash_func = HASH_FUNC_DEFAULT;
+    functable_hash_select(s, HASH_FUNC_DEFAULT);
 
 #ifdef X86_PCLMULQDQ_CRC
     window_padding = 8;
 #endif
 
-    s->window = (unsigned char *) ZALLOC_WINDOW(strm, s->w_size + window_padding, 2*sizeof(unsigned char));
+    s->window = (unsigned char *) ZALLOC_WINDOW(strm, s->w_size + window_padding, WINDOW_FACTOR*sizeof(unsigned char));
     s->prev   = (Pos *)  ZALLOC(strm, s->w_size, sizeof(Pos));
-    memset(s->prev, 0, s->w_size * sizeof(Pos));
     s->head   = (Pos *)  ZALLOC(strm, s->hash_size, sizeof(Pos));
 
     s->high_water = 0;      /* nothing written to s->window yet */
@@ -371,7 +497,8 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
      * 8*n bits into pending_buf. (Note that the symbol buffer fills when n-1
      * symbols are written.) The closest the writing gets to what is unread is
      * then n+14 bits. Here n is lit_bufsize, which is 16384 by default, and
-     * can range from 128 to 32768.
+     * can range from 128 to 32768, or to MAX_LIT_BUFSIZE when set with
+     * zng_deflateSetParams().
      *
      * Therefore, at a minimum, there are 142 bits of space between what is
      * written and what is read in the overlain buffers, so the symbols cannot
@@ -391,14 +518,31 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
 
     s->pending_buf = (unsigned char *) ZALLOC(strm, s->lit_bufsize, 4);
     s->pending_buf_size = (unsigned long)s->lit_bufsize * 4;
+    s->hash_rehash = 0;     /* head[] is not initialized yet */
+#ifdef DEFLATE_POS32
+    s->pos_base = 0;
+#endif
+    s->trees = (tree_state *) ZALLOC(strm, 1, sizeof(tree_state));
+    s->opt = NULL;
+    s->medium_pipe = NULL;
+#ifndef ZLIB_COMPAT
+    s->idle = 0;
+    s->idle_window = NULL;
+    s->idle_have = 0;
+    s->share = NULL;
+#endif
+    if (level > 9)
+        s->opt = (opt_state *) ZALLOC(strm, 1, sizeof(opt_state));
 
     if (s->window == NULL || s->prev == NULL || s->head == NULL ||
-        s->pending_buf == NULL) {
+        s->pending_buf == NULL || s->trees == NULL || (level > 9 && s->opt == NULL)) {
         s->status = FINISH_STATE;
         strm->msg = ERR_MSG(Z_MEM_ERROR);
         PREFIX(deflateEnd)(strm);
         return Z_MEM_ERROR;
     }
+    memset(s->prev, 0, s->w_size * sizeof(Pos));
+    set_trees(s);
     s->sym_buf = s->pending_buf + s->lit_bufsize;
     s->sym_end = (s->lit_bufsize - 1) * 3;
     /* We avoid equality with lit_bufsize*3 because of wraparound at 64K
@@ -410,7 +554,23 @@ int ZEXPORT PREFIX(deflateInit2_)(PREFIX3(stream) *strm, int level, int method,
     s->strategy = strategy;
     s->method = (unsigned char)method;
     s->block_open = 0;
+    s->quick_dynamic = 0;
+    s->prescan = 0;
+    s->pipeline = 0;
+    s->search = SEARCH_DEFAULT;
     s->reproducible = 0;
+    s->block_split = -1;
+    s->auto_flush = 0;
+    s->flush_in = 0;
+    s->max_input = 0;
+    s->target_speed = 0;
+    s->target_output = 0;
+    s->adapt_in = s->adapt_out = s->adapt_time = 0;
+    s->adapt_level = level;
+#ifndef ZLIB_COMPAT
+    s->gather = NULL;
+    s->gather_cnt = 0;
+#endif
 
     return PREFIX(deflateReset)(strm);
 }
@@ -448,6 +608,7 @@ int ZEXPORT PREFIX(deflateSetDictionary)(PREFIX3(stream) *strm, const unsigned c
 
     if (deflateStateCheck(strm) || dictionary == NULL)
         return Z_STREAM_ERROR;
+    OWN_OR_RETURN(strm);
     s = strm->state;
     wrap = s->wrap;
     if (wrap == 2 || (wrap == 1 && s->status != INIT_STATE) || s->lookahead)
@@ -458,6 +619,7 @@ int ZEXPORT PREFIX(deflateSetDictionary)(PREFIX3(stream) *strm, const unsigned c
         strm->adler = functable.adler32(strm->adler, dictionary, dictLength);
     DEFLATE_SET_DICTIONARY_HOOK(strm, dictionary, dictLength);  /* hook for IBM Z DFLTCC */
     s->wrap = 0;                    /* avoid computing Adler-32 in read_buf */
+    s->hash_rehash = 0;             /* the last strings are hashed before the input follows */
 
     /* if dictionary would fill window, just replace the history */
     if (dictLength >= s->w_size) {
@@ -480,7 +642,7 @@ int ZEXPORT PREFIX(deflateSetDictionary)(PREFIX3(stream) *strm, const unsigned c
     while (s->lookahead >= MIN_MATCH) {
         str = s->strstart;
         n = s->lookahead - (MIN_MATCH-1);
-        functable.insert_string(s, str, n);
+        s->insert_string(s, str, n);
         s->strstart = str + n;
         s->lookahead = MIN_MATCH-1;
         functable.fill_window(s);
@@ -504,6 +666,7 @@ int ZEXPORT PREFIX(deflateGetDictionary)(PREFIX3(stream) *strm, unsigned char *d
 
     if (deflateStateCheck(strm))
         return Z_STREAM_ERROR;
+    WAKE_OR_RETURN(strm);
     DEFLATE_GET_DICTIONARY_HOOK(strm, dictionary, dictLength);  /* hook for IBM Z DFLTCC */
     s = strm->state;
     len = s->strstart + s->lookahead;
@@ -523,6 +686,7 @@ int ZEXPORT PREFIX(deflateResetKeep)(PREFIX3(stream) *strm) {
     if (deflateStateCheck(strm)) {
         return Z_STREAM_ERROR;
     }
+    OWN_OR_RETURN(strm);
 
     strm->total_in = strm->total_out = 0;
     strm->msg = NULL; /* use zfree if we ever allocate msg dynamically */
@@ -548,8 +712,19 @@ int ZEXPORT PREFIX(deflateResetKeep)(PREFIX3(stream) *strm) {
 #endif
         strm->adler = functable.adler32(0L, NULL, 0);
     s->last_flush = -2;
+    s->block_open = 0;
+    s->flush_in = 0;
+    s->adapt_in = s->adapt_out = s->adapt_time = 0;
+    s->prescan_left = 0;
+    s->prescan_huff = 0;
+#ifndef NO_MEDIUM_STRATEGY
+    deflate_medium_reset(s);
+#endif
 
     zng_tr_init(s);
+#ifdef DEFLATE_STATS
+    memset(&s->stats, 0, sizeof(s->stats));
+#endif
 
     DEFLATE_RESET_KEEP_HOOK(strm);  /* hook for IBM Z DFLTCC */
 
@@ -561,8 +736,10 @@ int ZEXPORT PREFIX(deflateReset)(PREFIX3(stream) *strm) {
     int ret;
 
     ret = PREFIX(deflateResetKeep)(strm);
-    if (ret == Z_OK)
+    if (ret == Z_OK) {
+        reset_hash(strm->state);
         lm_init(strm->state);
+    }
     return ret;
 }
 
@@ -592,6 +769,7 @@ int ZEXPORT PREFIX(deflatePrime)(PREFIX3(stream) *strm, int bits, int value) {
 
     if (deflateStateCheck(strm))
         return Z_STREAM_ERROR;
+    WAKE_OR_RETURN(strm);
     s = strm->state;
     if (bits < 0 || bits > 16 ||
         s->sym_buf < s->pending_out + ((Buf_size + 7) >> 3))
@@ -600,7 +778,7 @@ int ZEXPORT PREFIX(deflatePrime)(PREFIX3(stream) *strm, int bits, int value) {
         put = Buf_size - s->bi_valid;
         if (put > bits)
             put = bits;
-        s->bi_buf |= (uint16_t)((value & ((1 << put) - 1)) << s->bi_valid);
+        s->bi_buf |= (uint64_t)(value & ((1 << put) - 1)) << s->bi_valid;
         s->bi_valid += put;
         zng_tr_flush_bits(s);
         value >>= put;
@@ -609,25 +787,121 @@ int ZEXPORT PREFIX(deflatePrime)(PREFIX3(stream) *strm, int bits, int value) {
     return Z_OK;
 }
 
+/* ===========================================================================
+ * The way the strings are hashed at the level of s: the number of bytes that
+ * insert_string() hashes, MIN_MATCH for the rolling hash whatever the level,
+ * or 0 for the CRC hash of deflate_quick() where that is not the same.
+ */
+static unsigned int level_hash(deflate_state *s) {
+#ifdef QUICK_STRATEGY
+    if (s->level == 1 && s->search == SEARCH_DEFAULT && s->strategy != Z_HUFFMAN_ONLY && s->strategy != Z_RLE &&
+        QUICK_CPU_CHECK && (HASH_BYTES(s) != 4 || (s->hash_func != HASH_FUNC_DEFAULT && s->hash_func != HASH_FUNC_CRC)))
+        return 0;
+#endif
+    if (s->hash_func == HASH_FUNC_ROLLING)
+        return MIN_MATCH;
+    return HASH_BYTES(s);
+}
+
+/* ===========================================================================
+ * Hash the strings of the window again for a level that hashes them another
+ * way, so that the matches into the input before the change of level are
+ * still found. deflate_quick() has a hash of its own, so for it the table is
+ * just cleared.
+ */
+static void rehash_window(deflate_state *s) {
+    unsigned int start, end, bytes = HASH_BYTES(s);
+
+    CLEAR_HASH(s);
+    s->hash_rehash = 0;
+    if (level_hash(s) == 0)
+        return;
+    start = s->strstart > MAX_DIST(s) ? s->strstart - MAX_DIST(s) : 0;
+    end = s->strstart;
+    if (s->lookahead < bytes - 1)
+        end = end > start + (bytes - 1 - s->lookahead) ? end - (bytes - 1 - s->lookahead) : start;
+    if (end > start)
+        s->insert_string(s, start, end - start);
+}
+
+/* ===========================================================================
+ * Get the stream ready for deflateParams() to go on with another compression
+ * function in the middle of the block, and return true, or return false if
+ * the block has to end first. The symbols tallied so far stay in the block
+ * whichever function tallied them: the literal that deflate_slow() may have
+ * pending is tallied here, as in prescan_run(), and the literals that
+ * deflate_huff() gave as a run are turned into symbols. Stored blocks, the
+ * optimal parse and the buckets keep state of their own, and so do a block of
+ * fixed codes that deflate_quick() left open and the matches that the helper
+ * of Z_DEFLATE_PIPELINE found but that were not emitted yet. sym_buf shares
+ * pending_buf with the output, so nothing is tallied while the output of the
+ * last block is still pending, as in deflate() itself.
+ */
+static int deflate_switch(deflate_state *s, int level, int strategy) {
+    int bflush;
+
+    if (s->level == 0 || level == 0 || s->level > 9 || level > 9 || s->block_open != 0)
+        return 0;
+#ifndef ZLIB_COMPAT
+    if (s->strategy == Z_BUCKET || strategy == Z_BUCKET)
+        return 0;
+#else
+    (void)strategy;
+#endif
+#ifndef NO_MEDIUM_STRATEGY
+    if (deflate_medium_pending(s))
+        return 0;
+#endif
+    if (s->pending != 0) {
+        flush_pending(s->strm);
+        if (s->pending != 0)
+            return 0;
+    }
+
+    if (s->lit_block)
+        zng_tr_lits_to_syms(s, s->window + s->block_start);
+    if (s->match_available) {
+        zng_tr_tally_lit(s, s->window[s->strstart-1], bflush);
+        if (bflush)
+            FLUSH_BLOCK_ONLY(s, 0);
+    }
+    s->match_available = 0;
+    s->match_length = MIN_MATCH-1;
+    s->prev_length = MIN_MATCH-1;
+    return 1;
+}
+
 /* ========================================================================= */
 int ZEXPORT PREFIX(deflateParams)(PREFIX3(stream) *strm, int level, int strategy) {
     deflate_state *s;
     compress_func func;
+    unsigned int hash;
+    int rehash = 0;
 
     if (deflateStateCheck(strm))
         return Z_STREAM_ERROR;
+    OWN_OR_RETURN(strm);
     s = strm->state;
 
     if (level == Z_DEFAULT_COMPRESSION)
         level = 6;
-    if (level < 0 || level > 9 || strategy < 0 || strategy > Z_FIXED) {
+    if (level < 0 || level > MAX_LEVEL || strategy < 0 || strategy > MAX_STRATEGY) {
         return Z_STREAM_ERROR;
     }
-    DEFLATE_PARAMS_HOOK(strm, level, strategy);  /* hook for IBM Z DFLTCC */
-    func = configuration_table[s->level].func;
+    DEFLATE_PARAMS_HOOK(strm, level, strategy, rehash);  /* hook for IBM Z DFLTCC */
+    if (level > 9 && s->opt == NULL) {
+        s->opt = (opt_state *) ZALLOC(strm, 1, sizeof(opt_state));
+        if (s->opt == NULL)
+            return Z_MEM_ERROR;
+        s->opt->next_item = OPT_SEGMENT;
+        s->opt->have_costs = 0;
+    }
+    func = level_func(s, s->level);
 
-    if ((strategy != s->strategy || func != configuration_table[level].func) &&
-        s->last_flush != -2) {
+    /* Go on in the same block where the new function can take over from the
+       old one, and otherwise end the block first */
+    if ((strategy != s->strategy || func != level_func(s, level)) &&
+        s->last_flush != -2 && !deflate_switch(s, level, strategy)) {
         /* Flush the last buffer: */
         int err = PREFIX(deflate)(strm, Z_BLOCK);
         if (err == Z_STREAM_ERROR)
@@ -635,6 +909,14 @@ int ZEXPORT PREFIX(deflateParams)(PREFIX3(stream) *strm, int level, int strategy
         if (strm->avail_in || (s->strstart - s->block_start) + s->lookahead)
             return Z_BUF_ERROR;
     }
+#ifndef NO_MEDIUM_STRATEGY
+    /* deflate_medium() hashes the strings of the next match before it is
+       emitted, so the others could find the strings at strstart and past it
+       already in the table */
+    if (func == deflate_medium && s->lookahead != 0 && (strategy != s->strategy || func != level_func(s, level)))
+        rehash = 1;
+#endif
+    hash = level_hash(s);
     if (s->level != level) {
         if (s->level == 0 && s->matches != 0) {
             if (s->matches == 1) {
@@ -645,12 +927,30 @@ int ZEXPORT PREFIX(deflateParams)(PREFIX3(stream) *strm, int level, int strategy
             s->matches = 0;
         }
         s->level = level;
+        s->hash_rehash = 0;         /* the hash function depends on the level */
         s->max_lazy_match   = configuration_table[level].max_lazy;
         s->good_match       = configuration_table[level].good_length;
         s->nice_match       = configuration_table[level].nice_length;
         s->max_chain_length = configuration_table[level].max_chain;
+        s->chain_cut = 0;
+    }
+    s->adapt_level = level;
+#ifndef ZLIB_COMPAT
+    /* The buckets and the hash chains do not share the layout of head[] */
+    if ((strategy == Z_BUCKET) != (s->strategy == Z_BUCKET)) {
+        CLEAR_HASH(s);
+        s->hash_rehash = 0;
     }
+#endif
     s->strategy = strategy;
+
+    /* The strings in the window, if any, are hashed again for a new hash */
+    if (level != 0 &&
+#ifndef ZLIB_COMPAT
+        s->strategy != Z_BUCKET &&
+#endif
+        s->strstart != 0 && (rehash || level_hash(s) != hash))
+        rehash_window(s);
     return Z_OK;
 }
 
@@ -665,40 +965,17 @@ int ZEXPORT PREFIX(deflateTune)(PREFIX3(stream) *strm, int good_length, int max_
     s->max_lazy_match = (unsigned int)max_lazy;
     s->nice_match = nice_length;
     s->max_chain_length = (unsigned int)max_chain;
+    s->chain_cut = 0;
     return Z_OK;
 }
 
 /* =========================================================================
- * For the default windowBits of 15 and memLevel of 8, this function returns
- * a close to exact, as well as small, upper bound on the compressed size.
- * They are coded as constants here for a reason--if the #define's are
- * changed, then this function needs to be changed as well.  The return
- * value for 15 and 8 only works for those exact settings.
- *
- * For any setting other than those defaults for windowBits and memLevel,
- * the value returned is a conservative worst case for the maximum expansion
- * resulting from using fixed blocks instead of stored blocks, which deflate
- * can emit on compressed data for some combinations of the parameters.
- *
- * This function could be more sophisticated to provide closer upper bounds for
- * every combination of windowBits and memLevel.  But even the conservative
- * upper bound of about 14% expansion does not seem onerous for output buffer
- * allocation.
+ * Return the length of the header and trailer that the wrapper of the stream
+ * adds to the compressed data.
  */
-unsigned long ZEXPORT PREFIX(deflateBound)(PREFIX3(stream) *strm, unsigned long sourceLen) {
-    deflate_state *s;
-    unsigned long complen, wraplen;
-
-    /* conservative upper bound for compressed data */
-    complen = sourceLen + ((sourceLen + 7) >> 3) + ((sourceLen + 63) >> 6) + 5;
-    DEFLATE_BOUND_ADJUST_COMPLEN(strm, complen, sourceLen);  /* hook for IBM Z DFLTCC */
-
-    /* if can't get parameters, return conservative bound plus zlib wrapper */
-    if (deflateStateCheck(strm))
-        return complen + 6;
+static unsigned long wrapper_len(deflate_state *s) {
+    unsigned long wraplen;
 
-    /* compute wrapper length */
-    s = strm->state;
     switch (s->wrap) {
     case 0:                                 /* raw deflate */
         wraplen = 0;
@@ -734,10 +1011,82 @@ unsigned long ZEXPORT PREFIX(deflateBound)(PREFIX3(stream) *strm, unsigned long
     default:                                /* for compiler happiness */
         wraplen = 6;
     }
+    return wraplen;
+}
+
+/* =========================================================================
+ * Tell whether deflate() compresses with deflate_quick(), which writes all of
+ * the input of a deflate() call with Z_FINISH as a single block with the fixed
+ * codes, never falling back to a stored block.
+ */
+static int uses_quick(deflate_state *s) {
+#ifdef QUICK_STRATEGY
+    return s->level == 1 && s->search == SEARCH_DEFAULT && QUICK_CPU_CHECK && !s->quick_dynamic && !s->prescan &&
+#  ifndef ZLIB_COMPAT
+           s->strategy != Z_BUCKET &&
+#  endif
+           s->strategy != Z_HUFFMAN_ONLY && s->strategy != Z_RLE;
+#else
+    (void)s;
+    return 0;
+#endif
+}
+
+/* =========================================================================
+ * For the default windowBits of 15 and memLevel of 8, this function returns
+ * a close to exact, as well as small, upper bound on the compressed size.
+ * They are coded as constants here for a reason--if the #define's are
+ * changed, then this function needs to be changed as well.  The return
+ * value for 15 and 8 only works for those exact settings.
+ *
+ * Level 0 and deflate_quick() get an exact bound for any windowBits and
+ * memLevel. Level 0 copies the input of a deflate() call with Z_FINISH and
+ * room for all of the output directly to next_out, in stored blocks of
+ * MAX_STORED bytes with 5 bytes of header each. deflate_quick() writes one
+ * block with the fixed codes, where a literal takes at most 9 bits and a
+ * match less than 9 bits per byte, plus 3 bits of block header and 7 of end
+ * of block, and a byte more as it only tells that it has finished if some of
+ * next_out is left.
+ *
+ * For any setting other than those, the value returned is a conservative
+ * worst case for the maximum expansion resulting from using fixed blocks
+ * instead of stored blocks, which deflate can emit on compressed data for
+ * some combinations of the parameters.
+ *
+ * This function could be more sophisticated to provide closer upper bounds for
+ * every combination of windowBits and memLevel.  But even the conservative
+ * upper bound of about 14% expansion does not seem onerous for output buffer
+ * allocation.
+ */
+unsigned long ZEXPORT PREFIX(deflateBound)(PREFIX3(stream) *strm, unsigned long sourceLen) {
+    deflate_state *s;
+    unsigned long complen, wraplen;
+
+    /* conservative upper bound for compressed data */
+    complen = sourceLen + ((sourceLen + 7) >> 3) + ((sourceLen + 63) >> 6) + 5;
+    DEFLATE_BOUND_ADJUST_COMPLEN(strm, complen, sourceLen);  /* hook for IBM Z DFLTCC */
+
+    /* if can't get parameters, return conservative bound plus zlib wrapper */
+    if (deflateStateCheck(strm))
+        return complen + 6;
+
+    /* compute wrapper length */
+    s = strm->state;
+    wraplen = wrapper_len(s);
+
+    if (DEFLATE_NEED_CONSERVATIVE_BOUND(strm))  /* hook for IBM Z DFLTCC */
+        return complen + wraplen;
+
+    /* stored blocks, an empty input taking one */
+    if (s->level == 0)
+        return sourceLen + 5 * (sourceLen ? (sourceLen - 1) / MAX_STORED + 1 : 1) + wraplen;
+
+    /* a single block with the fixed codes */
+    if (uses_quick(s))
+        return sourceLen + ((sourceLen + 25) >> 3) + wraplen;
 
     /* if not default parameters, return conservative bound */
-    if (DEFLATE_NEED_CONSERVATIVE_BOUND(strm) ||  /* hook for IBM Z DFLTCC */
-            s->w_bits != 15 || s->hash_bits != 8 + 7)
+    if (s->w_bits != 15 || s->hash_bits != 8 + 7)
         return complen + wraplen;
 
     /* default settings: return tight bound for that case */
@@ -792,13 +1141,14 @@ ZLIB_INTERNAL void flush_pending(PREFIX3(stream) *strm) {
     } while (0)
 
 /* ========================================================================= */
-int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
+static int deflate_run(PREFIX3(stream) *strm, int flush) {
     int old_flush; /* value of flush param for previous deflate call */
     deflate_state *s;
 
     if (deflateStateCheck(strm) || flush > Z_BLOCK || flush < 0) {
         return Z_STREAM_ERROR;
     }
+    OWN_OR_RETURN(strm);
     s = strm->state;
 
     if (strm->next_out == NULL || (strm->avail_in != 0 && strm->next_in == NULL) ||
@@ -810,6 +1160,8 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
 
     old_flush = s->last_flush;
     s->last_flush = flush;
+    if (flush != Z_NO_FLUSH && flush != Z_FINISH)
+        s->hash_rehash = 0;     /* the last strings may be hashed before the input that follows */
 
     /* Flush as much pending output as possible */
     if (s->pending != 0) {
@@ -889,7 +1241,7 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
             put_byte(s, 0);
             put_byte(s, 0);
             put_byte(s, 0);
-            put_byte(s, s->level == 9 ? 2 :
+            put_byte(s, s->level >= 9 ? 2 :
                      (s->strategy >= Z_HUFFMAN_ONLY || s->level < 2 ? 4 : 0));
             put_byte(s, OS_CODE);
             s->status = BUSY_STATE;
@@ -912,7 +1264,7 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
             put_byte(s, (unsigned char)((s->gzhead->time >> 8) & 0xff));
             put_byte(s, (unsigned char)((s->gzhead->time >> 16) & 0xff));
             put_byte(s, (unsigned char)((s->gzhead->time >> 24) & 0xff));
-            put_byte(s, s->level == 9 ? 2 :
+            put_byte(s, s->level >= 9 ? 2 :
                      (s->strategy >= Z_HUFFMAN_ONLY || s->level < 2 ? 4 : 0));
             put_byte(s, s->gzhead->os & 0xff);
             if (s->gzhead->extra != NULL) {
@@ -1024,15 +1376,18 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
      */
     if (strm->avail_in != 0 || s->lookahead != 0 || (flush != Z_NO_FLUSH && s->status != FINISH_STATE)) {
         block_state bstate;
+        STATS_TIMER_START(start);
 
         bstate = DEFLATE_HOOK(strm, flush, &bstate) ? bstate :  /* hook for IBM Z DFLTCC */
                  s->level == 0 ? deflate_stored(s, flush) :
                  s->strategy == Z_HUFFMAN_ONLY ? deflate_huff(s, flush) :
                  s->strategy == Z_RLE ? deflate_rle(s, flush) :
-#ifdef X86_QUICK_STRATEGY
-                 (s->level == 1 && !x86_cpu_has_sse42) ? deflate_fast(s, flush) :
+#ifndef ZLIB_COMPAT
+                 s->strategy == Z_BUCKET ? deflate_bucket(s, flush) :
 #endif
-                 (*(configuration_table[s->level].func))(s, flush);
+                 s->prescan ? deflate_prescan(s, flush) :
+                 deflate_level(s, flush);
+        STATS_TIMER_END(s, compress_ns, start);
 
         if (bstate == finish_started || bstate == finish_done) {
             s->status = FINISH_STATE;
@@ -1052,7 +1407,10 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
         }
         if (bstate == block_done) {
             if (flush == Z_PARTIAL_FLUSH) {
-                zng_tr_align(s);
+                /* the empty block is only needed to push out a partial byte */
+                zng_tr_flush_bits(s);
+                if (s->bi_valid)
+                    zng_tr_align(s);
             } else if (flush != Z_BLOCK) { /* FULL_FLUSH or SYNC_FLUSH */
                 zng_tr_stored_block(s, (char*)0, 0L, 0);
                 /* For a full flush, this empty block will be recognized
@@ -1109,6 +1467,161 @@ int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
     return s->pending != 0 ? Z_OK : Z_STREAM_END;
 }
 
+/* Input measured before the level is picked again, a few blocks' worth */
+#define ADAPT_WINDOW (64*1024)
+
+/* A level up is only taken when the speed beats the target by 1/ADAPT_MARGIN,
+   so that the level does not swing back and forth on small changes */
+#define ADAPT_MARGIN 4
+
+/* ===========================================================================
+ * Pick the level for Z_DEFLATE_TARGET_SPEED and Z_DEFLATE_TARGET_OUTPUT once
+ * enough input was measured: one down when deflate() compresses input slower
+ * than needed, one up when it is faster by the margin. The output target
+ * needs the input speed at which the output, at the measured ratio, comes out
+ * at that speed.
+ */
+static void deflate_adapt(deflate_state *s) {
+    double speed, need;
+
+    if (s->adapt_in < ADAPT_WINDOW || s->adapt_time == 0)
+        return;
+    speed = (double)s->adapt_in * 1e6 / (double)s->adapt_time;     /* KB/s */
+    need = (double)s->target_speed;
+    if (s->target_output != 0 && s->adapt_out != 0 &&
+        (double)s->target_output * (double)s->adapt_in / (double)s->adapt_out > need)
+        need = (double)s->target_output * (double)s->adapt_in / (double)s->adapt_out;
+    s->adapt_in = s->adapt_out = s->adapt_time = 0;
+
+    if (s->level < 1 || s->level > 9 || s->strategy == Z_HUFFMAN_ONLY || s->strategy == Z_RLE)
+        return;
+#ifndef ZLIB_COMPAT
+    if (s->strategy == Z_BUCKET)
+        return;
+#endif
+    if (speed < need && s->level > 1)
+        s->adapt_level = s->level - 1;
+    else if (speed > need + need / ADAPT_MARGIN && s->level < 9)
+        s->adapt_level = s->level + 1;
+}
+
+/* ===========================================================================
+ * deflate() with Z_DEFLATE_AUTO_FLUSH and the targets of speed.
+ */
+static int deflate_auto(PREFIX3(stream) *strm, int flush) {
+    deflate_state *s = strm->state;
+    uint32_t avail, used;
+    unsigned long out;
+    uint64_t start = 0;
+    int adapt, ret;
+
+    if (s->auto_flush == 0 && s->target_speed == 0 && s->target_output == 0)
+        return deflate_run(strm, flush);
+
+    /* count the input compressed since the last flush that completed, and
+       for the targets the time it took */
+    avail = strm->avail_in;
+    out = strm->total_out;
+    adapt = s->target_speed != 0 || s->target_output != 0;
+    if (adapt)
+        start = deflate_clock();
+    ret = deflate_run(strm, flush);
+    if (adapt) {
+        s->adapt_time += deflate_clock() - start;
+        s->adapt_in += avail - strm->avail_in;
+        s->adapt_out += strm->total_out - out;
+        deflate_adapt(s);
+    }
+    if (ret != Z_OK && ret != Z_STREAM_END)
+        return ret;
+
+    if (s->auto_flush != 0) {
+        used = avail - strm->avail_in;
+        if (used >= s->auto_flush || s->flush_in >= s->auto_flush - used)
+            s->flush_in = s->auto_flush;
+        else
+            s->flush_in += used;
+        if (flush != Z_NO_FLUSH && flush != Z_BLOCK) {
+            if (strm->avail_out != 0)
+                s->flush_in = 0;
+        } else if (s->flush_in >= s->auto_flush && strm->avail_out != 0 && s->status != FINISH_STATE) {
+            /* with Z_DEFLATE_AUTO_FLUSH, flush once enough input went in --
+               all of it was taken if there is room for output, and if there
+               is not, the flush is made by the next call */
+            ret = deflate_run(strm, Z_PARTIAL_FLUSH);
+            if (strm->avail_out != 0)
+                s->flush_in = 0;
+        }
+    }
+
+    /* change to the level picked once all the input given was taken, ending
+       the block there as deflateParams() does if the compression function
+       changes -- if there is not enough room for that, the next call tries
+       again */
+    if (s->adapt_level != s->level && ret == Z_OK && strm->avail_in == 0 && strm->avail_out != 0 &&
+        s->status != FINISH_STATE)
+        PREFIX(deflateParams)(strm, s->adapt_level, s->strategy);
+    return ret;
+}
+
+/* ========================================================================= */
+int ZEXPORT PREFIX(deflate)(PREFIX3(stream) *strm, int flush) {
+    deflate_state *s;
+    uint32_t rest = 0;
+#ifndef ZLIB_COMPAT
+    size_t gather_cnt;
+#endif
+    int ret;
+
+    if (deflateStateCheck(strm))
+        return deflate_run(strm, flush);
+    s = strm->state;
+    if (s->max_input == 0)
+        return deflate_auto(strm, flush);
+
+    /* with Z_DEFLATE_MAX_INPUT, hide the input past the limit from this call,
+       and the flush with it, as the flush is for the end of the input */
+    if (strm->avail_in > s->max_input) {
+        rest = strm->avail_in - s->max_input;
+        strm->avail_in = s->max_input;
+        if (flush >= 0 && flush <= Z_BLOCK && s->status != FINISH_STATE)
+            flush = Z_NO_FLUSH;
+    }
+#ifndef ZLIB_COMPAT
+    /* zng_deflatev() loads its fragments between the calls */
+    gather_cnt = s->gather_cnt;
+    s->gather_cnt = 0;
+#endif
+    ret = deflate_auto(strm, flush);
+#ifndef ZLIB_COMPAT
+    s->gather_cnt = gather_cnt;
+#endif
+    strm->avail_in += rest;
+    return ret;
+}
+
+/* ===========================================================================
+ * Free the window, prev and head of strm, or only give them up if other
+ * streams still share them.
+ */
+static void free_window(PREFIX3(stream) *strm) {
+    deflate_state *s = strm->state;
+
+#ifndef ZLIB_COMPAT
+    if (s->share != NULL) {
+        if (z_atomic_decrement(s->share) != 0) {
+            s->share = NULL;
+            return;
+        }
+        ZFREE(strm, (void *)s->share);
+        s->share = NULL;
+    }
+#endif
+    TRY_FREE(strm, s->head);
+    TRY_FREE(strm, s->prev);
+    TRY_FREE_WINDOW(strm, s->window);
+}
+
 /* ========================================================================= */
 int ZEXPORT PREFIX(deflateEnd)(PREFIX3(stream) *strm) {
     int status;
@@ -1119,57 +1632,109 @@ int ZEXPORT PREFIX(deflateEnd)(PREFIX3(stream) *strm) {
     status = strm->state->status;
 
     /* Deallocate in reverse order of allocations: */
+#ifndef NO_MEDIUM_STRATEGY
+    deflate_medium_end(strm->state);
+#endif
+#ifndef ZLIB_COMPAT
+    TRY_FREE(strm, strm->state->idle_window);
+#endif
+    TRY_FREE(strm, strm->state->opt);
+    TRY_FREE(strm, strm->state->trees);
     TRY_FREE(strm, strm->state->pending_buf);
-    TRY_FREE(strm, strm->state->head);
-    TRY_FREE(strm, strm->state->prev);
-    TRY_FREE_WINDOW(strm, strm->state->window);
+    free_window(strm);
 
     ZFREE_STATE(strm, strm->state);
     strm->state = NULL;
+#ifndef ZLIB_COMPAT
+    zng_node_unmap(strm);
+#endif
 
     return status == BUSY_STATE ? Z_DATA_ERROR : Z_OK;
 }
 
 /* =========================================================================
- * Copy the source state to the destination state.
+ * Copy the source state to the destination state. If shared is true, the
+ * copy uses the window, prev and head of the source until one of them writes
+ * to them, and only the pending output and symbols are copied.
  */
-int ZEXPORT PREFIX(deflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source) {
+static int deflate_copy(PREFIX3(stream) *dest, PREFIX3(stream) *source, int shared) {
     deflate_state *ds;
     deflate_state *ss;
 
-    if (deflateStateCheck(source) || dest == NULL) {
-        return Z_STREAM_ERROR;
-    }
-
     ss = source->state;
+#ifndef ZLIB_COMPAT
+    if (shared && ss->share == NULL) {
+        ss->share = (z_atomic_t *) ZALLOC(source, 1, sizeof(z_atomic_t));
+        if (ss->share == NULL)
+            return Z_MEM_ERROR;
+        *ss->share = 1;
+    }
+#endif
 
     memcpy((void *)dest, (void *)source, sizeof(PREFIX3(stream)));
+#ifndef ZLIB_COMPAT
+    /* A copy of the stream gets a region of its own */
+    zng_node_copy(dest);
+#endif
 
     ds = (deflate_state *) ZALLOC_STATE(dest, 1, sizeof(deflate_state));
-    if (ds == NULL)
+    if (ds == NULL) {
+#ifndef ZLIB_COMPAT
+        zng_node_unmap(dest);
+#endif
         return Z_MEM_ERROR;
+    }
     dest->state = (struct internal_state *) ds;
     ZCOPY_STATE((void *)ds, (void *)ss, sizeof(deflate_state));
     ds->strm = dest;
 
-    ds->window = (unsigned char *) ZALLOC_WINDOW(dest, ds->w_size, 2*sizeof(unsigned char));
-    ds->prev   = (Pos *)  ZALLOC(dest, ds->w_size, sizeof(Pos));
-    ds->head   = (Pos *)  ZALLOC(dest, ds->hash_size, sizeof(Pos));
+    if (shared) {
+#ifndef ZLIB_COMPAT
+        z_atomic_increment(ss->share);
+#endif
+    } else {
+#ifndef ZLIB_COMPAT
+        ds->share = NULL;
+#endif
+        ds->window = (unsigned char *) ZALLOC_WINDOW(dest, ds->w_size, WINDOW_FACTOR*sizeof(unsigned char));
+        ds->prev   = (Pos *)  ZALLOC(dest, ds->w_size, sizeof(Pos));
+        ds->head   = (Pos *)  ZALLOC(dest, ds->hash_size, sizeof(Pos));
+    }
     ds->pending_buf = (unsigned char *) ZALLOC(dest, ds->lit_bufsize, 4);
-
-    if (ds->window == NULL || ds->prev == NULL || ds->head == NULL || ds->pending_buf == NULL) {
+    ds->trees = (tree_state *) ZALLOC(dest, 1, sizeof(tree_state));
+    ds->opt = NULL;
+    if (ss->opt != NULL)
+        ds->opt = (opt_state *) ZALLOC(dest, 1, sizeof(opt_state));
+    ds->medium_pipe = NULL;
+
+    if (ds->window == NULL || ds->prev == NULL || ds->head == NULL || ds->pending_buf == NULL ||
+        ds->trees == NULL || (ss->opt != NULL && ds->opt == NULL)) {
         PREFIX(deflateEnd)(dest);
         return Z_MEM_ERROR;
     }
-
-    memcpy(ds->window, ss->window, ds->w_size * 2 * sizeof(unsigned char));
-    memcpy((void *)ds->prev, (void *)ss->prev, ds->w_size * sizeof(Pos));
-    memcpy((void *)ds->head, (void *)ss->head, ds->hash_size * sizeof(Pos));
-    memcpy(ds->pending_buf, ss->pending_buf, (unsigned int)ds->pending_buf_size);
+    if (ss->opt != NULL)
+        memcpy(ds->opt, ss->opt, sizeof(opt_state));
+#ifndef NO_MEDIUM_STRATEGY
+    if (deflate_medium_copy(ds, ss) != Z_OK) {
+        PREFIX(deflateEnd)(dest);
+        return Z_MEM_ERROR;
+    }
+#endif
 
     ds->pending_out = ds->pending_buf + (ss->pending_out - ss->pending_buf);
     ds->sym_buf = ds->pending_buf + ds->lit_bufsize;
+    if (shared) {
+        memcpy(ds->pending_out, ss->pending_out, ss->pending);
+        memcpy(ds->sym_buf, ss->sym_buf, ss->sym_next);
+    } else {
+        memcpy(ds->window, ss->window, ds->w_size * WINDOW_FACTOR * sizeof(unsigned char));
+        memcpy((void *)ds->prev, (void *)ss->prev, ds->w_size * sizeof(Pos));
+        memcpy((void *)ds->head, (void *)ss->head, ds->hash_size * sizeof(Pos));
+        memcpy(ds->pending_buf, ss->pending_buf, (unsigned int)ds->pending_buf_size);
+    }
+    memcpy(ds->trees, ss->trees, sizeof(tree_state));
 
+    set_trees(ds);
     ds->l_desc.dyn_tree = ds->dyn_ltree;
     ds->d_desc.dyn_tree = ds->dyn_dtree;
     ds->bl_desc.dyn_tree = ds->bl_tree;
@@ -1177,14 +1742,35 @@ int ZEXPORT PREFIX(deflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source)
     return Z_OK;
 }
 
+/* ========================================================================= */
+int ZEXPORT PREFIX(deflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source) {
+    if (deflateStateCheck(source) || dest == NULL) {
+        return Z_STREAM_ERROR;
+    }
+    WAKE_OR_RETURN(source);
+    return deflate_copy(dest, source, 0);
+}
+
+#ifndef ZLIB_COMPAT
 /* ===========================================================================
- * Read a new buffer from the current input stream, update the adler32
- * and total number of bytes read.  All deflate() input goes through
- * this function so some applications may wish to modify it to avoid
- * allocating a large strm->next_in buffer and copying from it.
- * (See also flush_pending()).
+ * Move next_in to the next nonempty input fragment of zng_deflatev(), if any.
  */
-ZLIB_INTERNAL unsigned read_buf(PREFIX3(stream) *strm, unsigned char *buf, unsigned size) {
+static void gather_next(deflate_state *s) {
+    PREFIX3(stream) *strm = s->strm;
+
+    while (strm->avail_in == 0 && s->gather_cnt != 0) {
+        strm->next_in = (const unsigned char *)s->gather->iov_base;
+        strm->avail_in = (uint32_t)s->gather->iov_len;
+        s->gather++;
+        s->gather_cnt--;
+    }
+}
+#endif
+
+/* ===========================================================================
+ * Copy up to size bytes from next_in to buf for read_buf().
+ */
+static unsigned read_input(PREFIX3(stream) *strm, unsigned char *buf, unsigned size) {
     uint32_t len = strm->avail_in;
 
     if (len > size)
@@ -1213,13 +1799,34 @@ ZLIB_INTERNAL unsigned read_buf(PREFIX3(stream) *strm, unsigned char *buf, unsig
     return len;
 }
 
+/* ===========================================================================
+ * Read a new buffer from the current input stream, update the adler32
+ * and total number of bytes read.  All deflate() input goes through
+ * this function so some applications may wish to modify it to avoid
+ * allocating a large strm->next_in buffer and copying from it.
+ * (See also flush_pending()).
+ */
+ZLIB_INTERNAL unsigned read_buf(PREFIX3(stream) *strm, unsigned char *buf, unsigned size) {
+    unsigned len = read_input(strm, buf, size);
+
+#ifndef ZLIB_COMPAT
+    /* Go on through the fragments of zng_deflatev(), leaving the next one
+     * loaded when buf is full.
+     */
+    while (strm->avail_in == 0 && strm->state->gather_cnt != 0) {
+        gather_next(strm->state);
+        if (len < size)
+            len += read_input(strm, buf + len, size - len);
+    }
+#endif
+    return len;
+}
+
 /* ===========================================================================
  * Initialize the "longest match" routines for a new zlib stream
  */
 static void lm_init(deflate_state *s) {
-    s->window_size = (unsigned long)2L*s->w_size;
-
-    CLEAR_HASH(s);
+    s->window_size = (unsigned long)WINDOW_FACTOR*s->w_size;
 
     /* Set the default configuration parameters:
      */
@@ -1227,6 +1834,8 @@ static void lm_init(deflate_state *s) {
     s->good_match       = configuration_table[s->level].good_length;
     s->nice_match       = configuration_table[s->level].nice_length;
     s->max_chain_length = configuration_table[s->level].max_chain;
+    s->chain_cut = 0;
+    s->guard_searches = s->guard_steps = 0;
 
     s->strstart = 0;
     s->block_start = 0L;
@@ -1236,6 +1845,74 @@ static void lm_init(deflate_state *s) {
     s->match_available = 0;
     s->match_start = 0;
     s->ins_h = 0;
+    if (s->opt != NULL) {
+        s->opt->next_item = OPT_SEGMENT;
+        s->opt->have_costs = 0;
+    }
+}
+
+/* Chain length below which chain_guard() does not cut the chains further */
+#define CHAIN_FLOOR 64
+
+/* ===========================================================================
+ * Adapt the length of the hash chains that longest_match() follows to the
+ * data, every CHAIN_WINDOW searches. On data where most strings have many
+ * earlier occurrences that almost match, as with long runs of a few nearly
+ * identical patterns, every search follows the chain to its end without
+ * reaching nice_match, and the higher levels slow down twenty times or
+ * more. When the searches took on average more than half of the chain
+ * length, the length is halved, down to CHAIN_FLOOR, and when they took
+ * less than a quarter, it is doubled again, up to max_chain_length. This
+ * depends only on the data, so the output stays reproducible.
+ */
+void ZLIB_INTERNAL chain_guard(deflate_state *s) {
+    unsigned int chain = s->max_chain_length >> s->chain_cut;
+    uint32_t steps = s->guard_steps / CHAIN_WINDOW;
+
+    if (steps > chain / 2 && chain / 2 >= CHAIN_FLOOR)
+        s->chain_cut++;
+    else if (steps < chain / 4 && s->chain_cut != 0)
+        s->chain_cut--;
+    s->guard_searches = s->guard_steps = 0;
+}
+
+/* ===========================================================================
+ * Clear the hash table for a reset. Every string in head[] is one of the
+ * strings in the window, so if the previous input was short, it is cheaper
+ * to hash those strings again and clear just their entries than to clear the
+ * whole table. That needs the strings to be hashed the same way as when they
+ * were inserted, from input that has not changed since, which hash_rehash
+ * tracks.
+ */
+static void reset_hash(deflate_state *s) {
+    unsigned int used = s->strstart + s->lookahead;
+
+#ifdef QUICK_STRATEGY
+    /* deflate_quick() hashes four bytes with the CRC hash whatever is asked for */
+    if (s->level == 1 && (HASH_BYTES(s) != 4 || (s->hash_func != HASH_FUNC_DEFAULT && s->hash_func != HASH_FUNC_CRC)))
+        s->hash_rehash = 0;
+#endif
+#ifndef ZLIB_COMPAT
+    /* deflate_bucket() does not hash the way clear_hash() does */
+    if (s->strategy == Z_BUCKET)
+        s->hash_rehash = 0;
+#endif
+#ifdef DEFLATE_POS32
+    /* Entries of strings that left the window are not cleared when it slides */
+    if (s->pos_base != 0)
+        s->hash_rehash = 0;
+    s->pos_base = 0;
+#endif
+
+    /* The strings at the end of the input may have been hashed even though
+     * they are shorter than MIN_MATCH, so clear all that start in the input.
+     */
+    if (s->hash_rehash && used <= s->hash_size / REHASH_RATIO && used + MIN_LOOKAHEAD <= s->window_size) {
+        s->clear_hash(s, 0, used);
+    } else {
+        CLEAR_HASH(s);
+    }
+    s->hash_rehash = 1;
 }
 
 #ifdef ZLIB_DEBUG
@@ -1280,38 +1957,39 @@ void ZLIB_INTERNAL fill_window_c(deflate_state *s) {
     unsigned n;
     unsigned more;    /* Amount of free space at the end of the window. */
     unsigned int wsize = s->w_size;
+    unsigned int slide = WINDOW_SLIDE(s);
 
     Assert(s->lookahead < MIN_LOOKAHEAD, "already enough lookahead");
+    STATS_TIMER_START(start);
 
     do {
         more = (unsigned)(s->window_size -(unsigned long)s->lookahead -(unsigned long)s->strstart);
 
         /* If the window is almost full and there is insufficient lookahead,
-         * move the upper half to the lower one to make room in the upper half.
+         * move the last wsize bytes down to make room after them.
          */
-        if (s->strstart >= wsize+MAX_DIST(s)) {
-            memcpy(s->window, s->window+wsize, (unsigned)wsize - more);
-            s->match_start -= wsize;
-            s->strstart    -= wsize; /* we now have strstart >= MAX_DIST */
-            s->block_start -= (long) wsize;
+        if (s->strstart >= slide+MAX_DIST(s)) {
+            memcpy(s->window, s->window+slide, (unsigned)wsize - more);
+            s->match_start -= slide;
+            s->strstart    -= slide; /* we now have strstart >= MAX_DIST */
+            s->block_start -= (long) slide;
             if (s->insert > s->strstart)
                 s->insert = s->strstart;
-            functable.slide_hash(s);
-            more += wsize;
+            for (n = WINDOW_FACTOR - 1; n != 0; n--)
+                functable.slide_hash(s);
+            more += slide;
+            ZTRACE3(deflate_slide, s->strm, slide, s->strm->total_in);
         }
         if (s->strm->avail_in == 0)
             break;
 
         /* If there was no sliding:
-         *    strstart <= WSIZE+MAX_DIST-1 && lookahead <= MIN_LOOKAHEAD - 1 &&
+         *    strstart <= SLIDE+MAX_DIST-1 && lookahead <= MIN_LOOKAHEAD - 1 &&
          *    more == window_size - lookahead - strstart
-         * => more >= window_size - (MIN_LOOKAHEAD-1 + WSIZE + MAX_DIST-1)
-         * => more >= window_size - 2*WSIZE + 2
-         * In the BIG_MEM or MMAP case (not yet supported),
-         *   window_size == input_size + MIN_LOOKAHEAD  &&
-         *   strstart + s->lookahead <= input_size => more >= MIN_LOOKAHEAD.
-         * Otherwise, window_size == 2*WSIZE so more >= 2.
-         * If there was sliding, more >= WSIZE. So in all cases, more >= 2.
+         * => more >= window_size - (MIN_LOOKAHEAD-1 + SLIDE + MAX_DIST-1)
+         * => more >= window_size - SLIDE - WSIZE + 2
+         * and window_size == SLIDE + WSIZE so more >= 2.
+         * If there was sliding, more >= SLIDE. So in all cases, more >= 2.
          */
         Assert(more >= 2, "more < 2");
 
@@ -1323,11 +2001,11 @@ void ZLIB_INTERNAL fill_window_c(deflate_state *s) {
             unsigned int str = s->strstart - s->insert;
             s->ins_h = s->window[str];
             if (str >= 1)
-                functable.insert_string(s, str + 2 - MIN_MATCH, 1);
+                s->insert_string(s, str + 2 - MIN_MATCH, 1);
 #if MIN_MATCH != 3
 #error Call insert_string() MIN_MATCH-3 more times
             while (s->insert) {
-                functable.insert_string(s, str, 1);
+                s->insert_string(s, str, 1);
                 str++;
                 s->insert--;
                 if (s->lookahead + s->insert < MIN_MATCH)
@@ -1340,7 +2018,7 @@ void ZLIB_INTERNAL fill_window_c(deflate_state *s) {
             }else{
                 count = s->insert;
             }
-            functable.insert_string(s,str,count);
+            s->insert_string(s,str,count);
             s->insert -= count;
 #endif
         }
@@ -1384,6 +2062,7 @@ void ZLIB_INTERNAL fill_window_c(deflate_state *s) {
 
     Assert((unsigned long)s->strstart <= s->window_size - MIN_LOOKAHEAD,
            "not enough room for search");
+    STATS_TIMER_END(s, fill_window_ns, start);
 }
 
 /* ===========================================================================
@@ -1503,10 +2182,10 @@ static block_state deflate_stored(deflate_state *s, int flush) {
         else {
             if (s->window_size - s->strstart <= used) {
                 /* Slide the window down. */
-                s->strstart -= s->w_size;
-                memcpy(s->window, s->window + s->w_size, s->strstart);
-                if (s->matches < 2)
-                    s->matches++;   /* add a pending slide_hash() */
+                s->strstart -= WINDOW_SLIDE(s);
+                memcpy(s->window, s->window + WINDOW_SLIDE(s), s->strstart);
+                /* add the pending slide_hash() calls, more than one clears the hash */
+                s->matches = MIN(s->matches + WINDOW_FACTOR - 1, 2);
                 if (s->insert > s->strstart)
                     s->insert = s->strstart;
             }
@@ -1530,14 +2209,13 @@ static block_state deflate_stored(deflate_state *s, int flush) {
 
     /* Fill the window with any remaining input. */
     have = s->window_size - s->strstart;
-    if (s->strm->avail_in > have && s->block_start >= (long)s->w_size) {
+    if (s->strm->avail_in > have && s->block_start >= (long)WINDOW_SLIDE(s)) {
         /* Slide the window down. */
-        s->block_start -= s->w_size;
-        s->strstart -= s->w_size;
-        memcpy(s->window, s->window + s->w_size, s->strstart);
-        if (s->matches < 2)
-            s->matches++;           /* add a pending slide_hash() */
-        have += s->w_size;          /* more space now */
+        s->block_start -= WINDOW_SLIDE(s);
+        s->strstart -= WINDOW_SLIDE(s);
+        memcpy(s->window, s->window + WINDOW_SLIDE(s), s->strstart);
+        s->matches = MIN(s->matches + WINDOW_FACTOR - 1, 2);
+        have += WINDOW_SLIDE(s);    /* more space now */
         if (s->insert > s->strstart)
             s->insert = s->strstart;
     }
@@ -1584,13 +2262,12 @@ static block_state deflate_stored(deflate_state *s, int flush) {
  */
 static block_state deflate_rle(deflate_state *s, int flush) {
     int bflush;                     /* set if current block must be flushed */
-    unsigned int prev;              /* byte at distance one to match */
-    unsigned char *scan, *strend;   /* scan goes up to strend for length of run */
+    unsigned char *scan;            /* start of the run */
 
     for (;;) {
         /* Make sure that we always have enough lookahead, except
          * at the end of the input file. We need MAX_MATCH bytes
-         * for the longest run, plus one for the unrolled loop.
+         * for the longest run.
          */
         if (s->lookahead <= MAX_MATCH) {
             functable.fill_window(s);
@@ -1604,21 +2281,14 @@ static block_state deflate_rle(deflate_state *s, int flush) {
         /* See how many times the previous byte repeats */
         s->match_length = 0;
         if (s->lookahead >= MIN_MATCH && s->strstart > 0) {
-            scan = s->window + s->strstart - 1;
-            prev = *scan;
-            if (prev == *++scan && prev == *++scan && prev == *++scan) {
-                strend = s->window + s->strstart + MAX_MATCH;
-                do {
-                } while (prev == *++scan && prev == *++scan &&
-                         prev == *++scan && prev == *++scan &&
-                         prev == *++scan && prev == *++scan &&
-                         prev == *++scan && prev == *++scan &&
-                         scan < strend);
-                s->match_length = MAX_MATCH - (unsigned int)(strend - scan);
+            scan = s->window + s->strstart;
+            /* Check the first byte here, so that literals skip the call */
+            if (scan[0] == scan[-1]) {
+                s->match_length = functable.rle258(scan, scan[-1]);
                 if (s->match_length > s->lookahead)
                     s->match_length = s->lookahead;
             }
-            Assert(scan <= s->window+(unsigned int)(s->window_size-1), "wild scan");
+            Assert(scan + MAX_MATCH <= s->window+(unsigned int)(s->window_size-1), "wild scan");
         }
 
         /* Emit match if have run of MIN_MATCH or longer, else emit literal */
@@ -1656,6 +2326,7 @@ static block_state deflate_rle(deflate_state *s, int flush) {
  */
 static block_state deflate_huff(deflate_state *s, int flush) {
     int bflush;             /* set if current block must be flushed */
+    unsigned int n;         /* number of literals tallied at once */
 
     for (;;) {
         /* Make sure that we have a literal to write. */
@@ -1668,12 +2339,26 @@ static block_state deflate_huff(deflate_state *s, int flush) {
             }
         }
 
-        /* Output a literal byte */
         s->match_length = 0;
-        Tracevv((stderr, "%c", s->window[s->strstart]));
-        zng_tr_tally_lit(s, s->window[s->strstart], bflush);
-        s->lookahead--;
-        s->strstart++;
+        if (s->sym_next != 0 ? !s->lit_block : s->sym_end / 3 > MAX_DIST(s)) {
+            /* Output a literal byte, to finish a block of matches left by
+             * deflate_prescan(), or when the window may not keep a whole block.
+             */
+            Tracevv((stderr, "%c", s->window[s->strstart]));
+            zng_tr_tally_lit(s, s->window[s->strstart], bflush);
+            s->lookahead--;
+            s->strstart++;
+        } else {
+            /* Tally the literals up to the next check for the end of the block.
+             * They are sent from the window, which keeps all of the block since
+             * it holds no more than sym_end / 3 of them.
+             */
+            Assert(s->sym_next != 0 || s->block_start == (long)s->strstart, "block without symbols");
+            n = MIN(s->lookahead, (s->sym_check - s->sym_next) / 3);
+            bflush = zng_tr_tally_lits(s, s->window + s->strstart, n);
+            s->lookahead -= n;
+            s->strstart += n;
+        }
         if (bflush)
             FLUSH_BLOCK(s, 0);
     }
@@ -1687,6 +2372,145 @@ static block_state deflate_huff(deflate_state *s, int flush) {
     return block_done;
 }
 
+/* ===========================================================================
+ * The compression function of the level, for the strategies that have none of
+ * their own.
+ */
+static block_state deflate_level(deflate_state *s, int flush) {
+    /* deflate_prescan() may come here with literals left by deflate_huff() */
+    if (s->lit_block)
+        zng_tr_lits_to_syms(s, s->window + s->block_start);
+#ifdef QUICK_STRATEGY
+    if (s->level == 1 && s->search == SEARCH_DEFAULT && !QUICK_CPU_CHECK)
+        return deflate_fast(s, flush);
+    if (s->level == 1 && s->search == SEARCH_DEFAULT && s->quick_dynamic)
+        return deflate_quick_dynamic(s, flush);
+#endif
+    return (*level_func(s, s->level))(s, flush);
+}
+
+/* Input is sampled in pieces of PRESCAN_PIECE bytes, PRESCAN_SAMPLES runs of
+ * PRESCAN_RUN bytes spread over each, and pieces too short for that are not
+ * sampled.
+ */
+#define PRESCAN_PIECE   65536
+#define PRESCAN_SAMPLES 16
+#define PRESCAN_RUN     256
+
+/* ===========================================================================
+ * Tell whether the bytes sampled from buf are spread so evenly over the 256
+ * values that they cannot be coded in much less than 8 bits each. For n
+ * bytes with counts c[i], an entropy of less than 7.6 bits per byte would
+ * make the sum of the c[i]^2 more than n^2 / 200. Random and already
+ * compressed data are close to n^2 / 240. The counts go to four tables in
+ * turn so that runs of the same byte do not wait on their own increments.
+ */
+static int prescan_hopeless(const unsigned char *buf, unsigned int len) {
+    uint32_t count[4][256];
+    uint64_t sum = 0;
+    unsigned int i, j, c, n = PRESCAN_SAMPLES * PRESCAN_RUN;
+
+    if (len < n)
+        return 0;
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < PRESCAN_SAMPLES; i++) {
+        const unsigned char *run = buf + (size_t)(len - PRESCAN_RUN) * i / (PRESCAN_SAMPLES - 1);
+
+        for (j = 0; j < PRESCAN_RUN; j += 4) {
+            count[0][run[j]]++;
+            count[1][run[j+1]]++;
+            count[2][run[j+2]]++;
+            count[3][run[j+3]]++;
+        }
+    }
+    for (i = 0; i < 256; i++) {
+        c = count[0][i] + count[1][i] + count[2][i] + count[3][i];
+        sum += c * c;
+    }
+    return sum * 200 <= (uint64_t)n * n;
+}
+
+/* ===========================================================================
+ * Compress with deflate_huff() if huff is true, and otherwise with the
+ * function of the level. deflate_huff() leaves nothing pending between
+ * calls, and deflate_slow() leaves at most a literal, which is written here
+ * before the switch. A block that deflate_quick() left open has to be ended
+ * by it first.
+ */
+static block_state prescan_run(deflate_state *s, int huff, int flush) {
+    int bflush;
+
+    if (!huff || s->block_open != 0)
+        return deflate_level(s, flush);
+    if (s->match_available) {
+        zng_tr_tally_lit(s, s->window[s->strstart-1], bflush);
+        s->match_available = 0;
+        s->match_length = MIN_MATCH-1;
+        if (bflush)
+            FLUSH_BLOCK_ONLY(s, 0);
+        if (s->strm->avail_out == 0)
+            return need_more;
+    }
+    return deflate_huff(s, flush);
+}
+
+/* ===========================================================================
+ * Compress the input in pieces of up to PRESCAN_PIECE bytes, each with
+ * deflate_huff() if prescan_hopeless() says so, and otherwise with the
+ * function of the level. The verdict on a piece is kept until all of it is
+ * read, however many calls that takes, and the part of it read ahead into
+ * the window is compressed the same way before the next verdict applies.
+ */
+static block_state deflate_prescan(deflate_state *s, int flush) {
+    PREFIX3(stream) *strm = s->strm;
+    block_state bstate;
+    unsigned int piece, rest;
+    int huff;
+
+    do {
+        if (s->prescan_left == 0) {
+            piece = MIN(strm->avail_in, PRESCAN_PIECE);
+            huff = prescan_hopeless(strm->next_in, piece);
+            if (huff != s->prescan_huff && s->lookahead != 0) {
+                rest = strm->avail_in;
+                strm->avail_in = 0;
+                bstate = prescan_run(s, s->prescan_huff, Z_NO_FLUSH);
+                strm->avail_in = rest;
+                if (strm->avail_out == 0)
+                    return bstate;
+            }
+            s->prescan_left = piece;
+            s->prescan_huff = huff;
+        }
+        piece = MIN(strm->avail_in, s->prescan_left);
+        rest = strm->avail_in - piece;
+        strm->avail_in = piece;
+        bstate = prescan_run(s, s->prescan_huff, rest ? Z_NO_FLUSH : flush);
+        s->prescan_left -= piece - strm->avail_in;
+        strm->avail_in += rest;
+    } while (rest != 0 && bstate == need_more && strm->avail_out != 0);
+    return bstate;
+}
+
+#ifdef DEFLATE_STATS
+/* ===========================================================================
+ * Add the statistics of another stream, such as a zng_deflateParallel() chunk.
+ */
+void ZLIB_INTERNAL deflate_stats_add(deflate_stats *dst, const deflate_stats *src) {
+    dst->stored_blocks += src->stored_blocks;
+    dst->fixed_blocks += src->fixed_blocks;
+    dst->dynamic_blocks += src->dynamic_blocks;
+    dst->literals += src->literals;
+    dst->matches += src->matches;
+    dst->match_bytes += src->match_bytes;
+    dst->chain_steps += src->chain_steps;
+    dst->slide_hash += src->slide_hash;
+    dst->compress_ns += src->compress_ns;
+    dst->fill_window_ns += src->fill_window_ns;
+    dst->flush_block_ns += src->flush_block_ns;
+}
+#endif
+
 #ifndef ZLIB_COMPAT
 /* =========================================================================
  * Checks whether buffer size is sufficient and whether this parameter is a duplicate.
@@ -1702,6 +2526,53 @@ static int deflateSetParamPre(zng_deflate_param_value **out, size_t min_size, zn
     return buf_error;
 }
 
+/* =========================================================================
+ * Replace the hash table with an empty one of 1 << bits entries.
+ */
+static int deflateSetHashBits(zng_stream *strm, unsigned int bits) {
+    deflate_state *s = strm->state;
+    Pos *head;
+
+    if (bits == s->hash_bits)
+        return Z_OK;
+    head = (Pos *)ZALLOC(strm, 1U << bits, sizeof(Pos));
+    if (head == NULL)
+        return Z_MEM_ERROR;
+    ZFREE(strm, s->head);
+    s->head = head;
+    s->hash_bits = bits;
+    s->hash_size = 1U << bits;
+    s->hash_mask = s->hash_size - 1;
+    s->hash_shift =  ((s->hash_bits+MIN_MATCH-1)/MIN_MATCH);
+    CLEAR_HASH(s);
+    s->hash_rehash = 0;
+    return Z_OK;
+}
+
+/* ===========================================================================
+ * Change the number of symbols in a block. pending_buf is replaced, so this
+ * can only be done while nothing has been written to it.
+ */
+static int deflateSetLitBufsize(zng_stream *strm, unsigned int lit_bufsize) {
+    deflate_state *s = strm->state;
+    unsigned char *pending_buf;
+
+    if (lit_bufsize == s->lit_bufsize)
+        return Z_OK;
+    pending_buf = (unsigned char *)ZALLOC(strm, lit_bufsize, 4);
+    if (pending_buf == NULL)
+        return Z_MEM_ERROR;
+    ZFREE(strm, s->pending_buf);
+    s->pending_buf = pending_buf;
+    s->pending_buf_size = (unsigned long)lit_bufsize * 4;
+    s->pending_out = s->pending_buf;
+    s->lit_bufsize = lit_bufsize;
+    s->sym_buf = s->pending_buf + lit_bufsize;
+    s->sym_end = (lit_bufsize - 1) * 3;
+    zng_tr_init(s);
+    return Z_OK;
+}
+
 /* ========================================================================= */
 int ZEXPORT zng_deflateSetParams(zng_stream *strm, zng_deflate_param_value *params, size_t count) {
     size_t i;
@@ -1709,6 +2580,23 @@ int ZEXPORT zng_deflateSetParams(zng_stream *strm, zng_deflate_param_value *para
     zng_deflate_param_value *new_level = NULL;
     zng_deflate_param_value *new_strategy = NULL;
     zng_deflate_param_value *new_reproducible = NULL;
+    zng_deflate_param_value *new_hash_bits = NULL;
+    zng_deflate_param_value *new_hash_bytes = NULL;
+    zng_deflate_param_value *new_block_split = NULL;
+    zng_deflate_param_value *new_lit_bufsize = NULL;
+    zng_deflate_param_value *new_auto_flush = NULL;
+    zng_deflate_param_value *new_quick_dynamic = NULL;
+    zng_deflate_param_value *new_hash_func = NULL;
+    zng_deflate_param_value *new_prescan = NULL;
+    zng_deflate_param_value *new_pipeline = NULL;
+    zng_deflate_param_value *new_good_length = NULL;
+    zng_deflate_param_value *new_max_lazy = NULL;
+    zng_deflate_param_value *new_nice_length = NULL;
+    zng_deflate_param_value *new_max_chain = NULL;
+    zng_deflate_param_value *new_search = NULL;
+    zng_deflate_param_value *new_target_speed = NULL;
+    zng_deflate_param_value *new_target_output = NULL;
+    zng_deflate_param_value *new_max_input = NULL;
     int param_buf_error;
     int version_error = 0;
     int buf_error = 0;
@@ -1723,6 +2611,7 @@ int ZEXPORT zng_deflateSetParams(zng_stream *strm, zng_deflate_param_value *para
     /* Check whether the stream state is consistent. */
     if (deflateStateCheck(strm))
         return Z_STREAM_ERROR;
+    OWN_OR_RETURN(strm);
     s = strm->state;
 
     /* Check buffer sizes and detect duplicates. */
@@ -1737,6 +2626,57 @@ int ZEXPORT zng_deflateSetParams(zng_stream *strm, zng_deflate_param_value *para
             case Z_DEFLATE_REPRODUCIBLE:
                 param_buf_error = deflateSetParamPre(&new_reproducible, sizeof(int), &params[i]);
                 break;
+            case Z_DEFLATE_HASH_BITS:
+                param_buf_error = deflateSetParamPre(&new_hash_bits, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_HASH_BYTES:
+                param_buf_error = deflateSetParamPre(&new_hash_bytes, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_BLOCK_SPLIT:
+                param_buf_error = deflateSetParamPre(&new_block_split, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_LIT_BUFSIZE:
+                param_buf_error = deflateSetParamPre(&new_lit_bufsize, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_AUTO_FLUSH:
+                param_buf_error = deflateSetParamPre(&new_auto_flush, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_QUICK_DYNAMIC:
+                param_buf_error = deflateSetParamPre(&new_quick_dynamic, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_HASH_FUNC:
+                param_buf_error = deflateSetParamPre(&new_hash_func, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_PRESCAN:
+                param_buf_error = deflateSetParamPre(&new_prescan, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_PIPELINE:
+                param_buf_error = deflateSetParamPre(&new_pipeline, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_GOOD_LENGTH:
+                param_buf_error = deflateSetParamPre(&new_good_length, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_MAX_LAZY:
+                param_buf_error = deflateSetParamPre(&new_max_lazy, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_NICE_LENGTH:
+                param_buf_error = deflateSetParamPre(&new_nice_length, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_MAX_CHAIN:
+                param_buf_error = deflateSetParamPre(&new_max_chain, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_SEARCH:
+                param_buf_error = deflateSetParamPre(&new_search, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_TARGET_SPEED:
+                param_buf_error = deflateSetParamPre(&new_target_speed, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_TARGET_OUTPUT:
+                param_buf_error = deflateSetParamPre(&new_target_output, sizeof(int), &params[i]);
+                break;
+            case Z_DEFLATE_MAX_INPUT:
+                param_buf_error = deflateSetParamPre(&new_max_input, sizeof(int), &params[i]);
+                break;
             default:
                 params[i].status = Z_VERSION_ERROR;
                 version_error = 1;
@@ -1773,6 +2713,167 @@ int ZEXPORT zng_deflateSetParams(zng_stream *strm, zng_deflate_param_value *para
             stream_error = 1;
         }
     }
+    /* The hash table can only change while it has nothing in it */
+    if (new_hash_bits != NULL) {
+        val = *(int *)new_hash_bits->buf;
+        if (val < 8 || val > MAX_HASH_BITS || s->strstart != 0 || s->lookahead != 0)
+            ret = Z_STREAM_ERROR;
+        else
+            ret = deflateSetHashBits(strm, (unsigned int)val);
+        if (ret != Z_OK) {
+            new_hash_bits->status = ret;
+            stream_error = 1;
+        }
+    }
+    if (new_hash_bytes != NULL) {
+        val = *(int *)new_hash_bytes->buf;
+        if ((val != 0 && (val < MIN_MATCH || val > 5)) || s->strstart != 0 || s->lookahead != 0) {
+            new_hash_bytes->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else {
+            s->hash_bytes = (unsigned int)val;
+            s->hash_rehash = 0;
+        }
+    }
+    if (new_hash_func != NULL) {
+        val = *(int *)new_hash_func->buf;
+        if (s->strstart != 0 || s->lookahead != 0 || functable_hash_select(s, val) != 0) {
+            new_hash_func->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else {
+            s->hash_func = val;
+            s->hash_rehash = 0;
+        }
+    }
+    if (new_block_split != NULL) {
+        val = *(int *)new_block_split->buf;
+        if (val < -1 || val > 1) {
+            new_block_split->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->block_split = val;
+    }
+    if (new_auto_flush != NULL) {
+        val = *(int *)new_auto_flush->buf;
+        if (val < 0) {
+            new_auto_flush->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->auto_flush = (unsigned int)val;
+    }
+    /* A block of static codes that is still open has to be ended first */
+    if (new_quick_dynamic != NULL) {
+        val = *(int *)new_quick_dynamic->buf;
+        if (val < 0 || val > 1 || s->block_open != 0) {
+            new_quick_dynamic->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->quick_dynamic = val;
+    }
+    if (new_prescan != NULL) {
+        val = *(int *)new_prescan->buf;
+        if (val < 0 || val > 1) {
+            new_prescan->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->prescan = val;
+    }
+    if (new_pipeline != NULL) {
+        val = *(int *)new_pipeline->buf;
+        if (val < 0 || val > 1) {
+            new_pipeline->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->pipeline = val;
+    }
+    /* After Z_DEFLATE_LEVEL, which sets these back to the values of the level */
+    if (new_good_length != NULL) {
+        val = *(int *)new_good_length->buf;
+        if (val < 0 || val > MAX_MATCH) {
+            new_good_length->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->good_match = (unsigned int)val;
+    }
+    if (new_max_lazy != NULL) {
+        val = *(int *)new_max_lazy->buf;
+        if (val < 1 || val > MAX_MATCH) {
+            new_max_lazy->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->max_lazy_match = (unsigned int)val;
+    }
+    if (new_nice_length != NULL) {
+        val = *(int *)new_nice_length->buf;
+        if (val < MIN_MATCH || val > MAX_MATCH) {
+            new_nice_length->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->nice_match = val;
+    }
+    if (new_max_chain != NULL) {
+        val = *(int *)new_max_chain->buf;
+        if (val < 4 || val > MAX_MAX_CHAIN) {
+            new_max_chain->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else {
+            s->max_chain_length = (unsigned int)val;
+            s->chain_cut = 0;
+        }
+    }
+    /* The search can only change where a new one can start, as in deflateParams() */
+    if (new_search != NULL) {
+        val = *(int *)new_search->buf;
+        if (val < SEARCH_DEFAULT || val > SEARCH_MEDIUM ||
+            (val != s->search && ((s->strstart - s->block_start) + s->lookahead != 0 || s->block_open != 0))) {
+            new_search->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else
+            s->search = val;
+    }
+    /* A new target starts a new measurement */
+    if (new_target_speed != NULL) {
+        val = *(int *)new_target_speed->buf;
+        if (val < 0) {
+            new_target_speed->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else {
+            s->target_speed = (unsigned int)val;
+            s->adapt_in = s->adapt_out = s->adapt_time = 0;
+        }
+    }
+    if (new_target_output != NULL) {
+        val = *(int *)new_target_output->buf;
+        if (val < 0) {
+            new_target_output->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else {
+            s->target_output = (unsigned int)val;
+            s->adapt_in = s->adapt_out = s->adapt_time = 0;
+        }
+    }
+    if (new_max_input != NULL) {
+        val = *(int *)new_max_input->buf;
+        if (val < 0) {
+            new_max_input->status = Z_STREAM_ERROR;
+            stream_error = 1;
+        } else {
+            s->max_input = (unsigned int)val;
+        }
+    }
+    /* The symbol buffer can only change before anything has been written */
+    if (new_lit_bufsize != NULL) {
+        val = *(int *)new_lit_bufsize->buf;
+        if (val < 128 || val > MAX_LIT_BUFSIZE || s->strstart != 0 || s->lookahead != 0 ||
+            s->pending != 0 || s->bi_valid != 0)
+            ret = Z_STREAM_ERROR;
+        else
+            ret = deflateSetLitBufsize(strm, (unsigned int)val);
+        if (ret != Z_OK) {
+            new_lit_bufsize->status = ret;
+            stream_error = 1;
+        }
+    }
 
     /* Report version errors only if there are no real errors. */
     return stream_error ? Z_STREAM_ERROR : (version_error ? Z_VERSION_ERROR : Z_OK);
@@ -1814,14 +2915,1069 @@ int ZEXPORT zng_deflateGetParams(zng_stream *strm, zng_deflate_param_value *para
                 else
                     *(int *)params[i].buf = s->reproducible;
                 break;
-            default:
-                params[i].status = Z_VERSION_ERROR;
-                version_error = 1;
+            case Z_DEFLATE_HASH_BITS:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->hash_bits;
                 break;
-        }
-        if (params[i].status == Z_BUF_ERROR)
-            buf_error = 1;
-    }
-    return buf_error ? Z_BUF_ERROR : (version_error ? Z_VERSION_ERROR : Z_OK);
+            case Z_DEFLATE_HASH_BYTES:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->hash_bytes;
+                break;
+            case Z_DEFLATE_BLOCK_SPLIT:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = s->block_split;
+                break;
+            case Z_DEFLATE_LIT_BUFSIZE:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->lit_bufsize;
+                break;
+            case Z_DEFLATE_AUTO_FLUSH:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->auto_flush;
+                break;
+            case Z_DEFLATE_QUICK_DYNAMIC:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = s->quick_dynamic;
+                break;
+            case Z_DEFLATE_HASH_FUNC:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = s->hash_func;
+                break;
+            case Z_DEFLATE_PRESCAN:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = s->prescan;
+                break;
+            case Z_DEFLATE_PIPELINE:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = s->pipeline;
+                break;
+            case Z_DEFLATE_GOOD_LENGTH:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->good_match;
+                break;
+            case Z_DEFLATE_MAX_LAZY:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->max_lazy_match;
+                break;
+            case Z_DEFLATE_NICE_LENGTH:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = s->nice_match;
+                break;
+            case Z_DEFLATE_MAX_CHAIN:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->max_chain_length;
+                break;
+            case Z_DEFLATE_SEARCH:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = s->search;
+                break;
+            case Z_DEFLATE_TARGET_SPEED:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->target_speed;
+                break;
+            case Z_DEFLATE_TARGET_OUTPUT:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->target_output;
+                break;
+            case Z_DEFLATE_MAX_INPUT:
+                if (params[i].size < sizeof(int))
+                    params[i].status = Z_BUF_ERROR;
+                else
+                    *(int *)params[i].buf = (int)s->max_input;
+                break;
+            default:
+                params[i].status = Z_VERSION_ERROR;
+                version_error = 1;
+                break;
+        }
+        if (params[i].status == Z_BUF_ERROR)
+            buf_error = 1;
+    }
+    return buf_error ? Z_BUF_ERROR : (version_error ? Z_VERSION_ERROR : Z_OK);
+}
+
+/* ========================================================================= */
+size_t ZEXPORT zng_deflateArenaSize(int level, int windowBits, int memLevel) {
+    unsigned int w_bits, hash_bits, lit_bufsize;
+    unsigned window_padding = 1;
+    size_t allocs;
+
+#if defined(X86_CPUID)
+    x86_check_features();
+#endif
+
+    /* Same parameter handling and sizes as deflateInit2_() */
+    if (level == Z_DEFAULT_COMPRESSION)
+        level = 6;
+    if (windowBits < 0)
+        windowBits = -windowBits;
+#ifdef GZIP
+    else if (windowBits > 15)
+        windowBits -= 16;
+#endif
+    if (memLevel < 1 || memLevel > MAX_MEM_LEVEL || windowBits < 8 || windowBits > 15 || level < 0 || level > MAX_LEVEL)
+        return 0;
+    if (windowBits == 8)
+        windowBits = 9;
+#ifdef QUICK_STRATEGY
+    if (level == 1)
+        windowBits = 13;
+#endif
+    w_bits = (unsigned int)windowBits;
+
+#ifdef X86_SSE42_CRC_HASH
+    if (x86_cpu_has_sse42)
+        hash_bits = 15;
+    else
+#endif
+        hash_bits = (unsigned int)memLevel + 7;
+#ifdef X86_PCLMULQDQ_CRC
+    window_padding = 8;
+#endif
+    lit_bufsize = 1U << (memLevel + 6);
+
+    allocs = ARENA_ROUND(sizeof(deflate_state)) +
+             ARENA_ROUND(((1U << w_bits) + window_padding) * WINDOW_FACTOR) +
+             ARENA_ROUND((1U << w_bits) * sizeof(Pos)) +
+             ARENA_ROUND((1U << hash_bits) * sizeof(Pos)) +
+             ARENA_ROUND(lit_bufsize * 4) +
+             ARENA_ROUND(sizeof(tree_state));
+    if (level > 9)
+        allocs += ARENA_ROUND(sizeof(opt_state));
+    return ARENA_SIZE(allocs + DEFLATE_ARENA_EXTRA);
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateInitArena(zng_stream *strm, void *arena, size_t arena_size, int level, int method,
+                                 int windowBits, int memLevel, int strategy) {
+    zng_arena *a;
+
+    if (strm == NULL)
+        return Z_STREAM_ERROR;
+    a = zng_arena_init(arena, arena_size);
+    if (a == NULL)
+        return Z_MEM_ERROR;
+    strm->zalloc = zng_arena_alloc;
+    strm->zfree = zng_arena_free;
+    strm->opaque = a;
+    return zng_deflateInit2_(strm, level, method, windowBits, memLevel, strategy, ZLIBNG_VERSION,
+                             (int)sizeof(zng_stream));
+}
+
+/* ========================================================================= */
+struct zng_deflate_dict_s {
+    int level;                  /* parameters the hash chains were built for */
+    unsigned int w_bits;
+    unsigned int hash_bits;
+    unsigned int hash_bytes;
+    int hash_func;
+    uint32_t adler;             /* Adler-32 of the whole dictionary */
+    unsigned int length;        /* bytes of dictionary kept in the window */
+    unsigned int insert;        /* bytes at the end left to insert */
+    unsigned int ins_h;
+    unsigned char *window;      /* the last length bytes of the dictionary */
+    Pos *prev;                  /* prev[] for the first length positions */
+    Pos *head;                  /* all of head[] */
+#ifdef DEFLATE_POS32
+    uint32_t pos_base;
+#endif
+};
+
+zng_deflate_dict * ZEXPORT zng_deflatePrepareDictionary(const uint8_t *dictionary, uint32_t dictLength, int level,
+                                                        int windowBits, int memLevel) {
+    zng_deflate_dict *dict;
+    zng_stream tmp;
+    deflate_state *s;
+    size_t head_size, prev_size;
+
+    if (dictionary == NULL)
+        return NULL;
+
+    /* Build the hash chains on a raw stream with the same window and hash table sizes */
+    if (windowBits < 0)
+        windowBits = -windowBits;
+#ifdef GZIP
+    else if (windowBits > 15)
+        windowBits -= 16;
+#endif
+    memset(&tmp, 0, sizeof(tmp));
+    if (zng_deflateInit2(&tmp, level, Z_DEFLATED, -windowBits, memLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+    if (zng_deflateSetDictionary(&tmp, dictionary, dictLength) != Z_OK) {
+        zng_deflateEnd(&tmp);
+        return NULL;
+    }
+    s = tmp.state;
+
+    head_size = s->hash_size * sizeof(Pos);
+    prev_size = s->strstart * sizeof(Pos);
+    dict = (zng_deflate_dict *)zng_calloc(NULL, 1, sizeof(zng_deflate_dict) + head_size + prev_size + s->strstart);
+    if (dict == NULL) {
+        zng_deflateEnd(&tmp);
+        return NULL;
+    }
+    dict->level = s->level;
+    dict->w_bits = s->w_bits;
+    dict->hash_bits = s->hash_bits;
+    dict->hash_bytes = s->hash_bytes;
+    dict->hash_func = s->hash_func;
+    dict->adler = functable.adler32(1L, dictionary, dictLength);
+    dict->length = s->strstart;
+    dict->insert = s->insert;
+    dict->ins_h = s->ins_h;
+    dict->head = (Pos *)(dict + 1);
+    dict->prev = dict->head + s->hash_size;
+    dict->window = (unsigned char *)(dict->prev + dict->length);
+    memcpy(dict->head, s->head, head_size);
+    memcpy(dict->prev, s->prev, prev_size);
+    memcpy(dict->window, s->window, dict->length);
+#ifdef DEFLATE_POS32
+    dict->pos_base = s->pos_base;
+#endif
+
+    zng_deflateEnd(&tmp);
+    return dict;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateSetPreparedDictionary(zng_stream *strm, const zng_deflate_dict *dict) {
+    deflate_state *s;
+
+    if (deflateStateCheck(strm) || dict == NULL)
+        return Z_STREAM_ERROR;
+    OWN_OR_RETURN(strm);
+    s = strm->state;
+    if (s->wrap == 2 || (s->wrap == 1 && s->status != INIT_STATE) || s->lookahead || s->strstart)
+        return Z_STREAM_ERROR;
+    if (s->level != dict->level || s->w_bits != dict->w_bits || s->hash_bits != dict->hash_bits ||
+        s->hash_bytes != dict->hash_bytes || s->hash_func != dict->hash_func)
+        return Z_DATA_ERROR;
+
+    if (s->wrap == 1)
+        strm->adler = dict->adler;
+    DEFLATE_SET_DICTIONARY_HOOK(strm, dict->window, dict->length);  /* hook for IBM Z DFLTCC */
+
+    /* Same state as deflateSetDictionary() leaves, without hashing the dictionary again */
+    memcpy(s->window, dict->window, dict->length);
+    memcpy((void *)s->prev, (const void *)dict->prev, dict->length * sizeof(Pos));
+    memcpy((void *)s->head, (const void *)dict->head, s->hash_size * sizeof(Pos));
+#ifdef DEFLATE_POS32
+    s->pos_base = dict->pos_base;
+#endif
+    s->hash_rehash = 0;
+    s->ins_h = dict->ins_h;
+    s->strstart = dict->length;
+    s->block_start = (long)s->strstart;
+    s->insert = dict->insert;
+    s->match_length = s->prev_length = MIN_MATCH-1;
+    s->match_available = 0;
+    return Z_OK;
+}
+
+/* ========================================================================= */
+void ZEXPORT zng_deflateFreePreparedDictionary(zng_deflate_dict *dict) {
+    if (dict != NULL)
+        zng_cfree(NULL, dict);
+}
+
+/* ===========================================================================
+ * Return true if the stream is at the end of a block with all of its output
+ * delivered, so that nothing but the window and the bits of the last byte are
+ * needed to go on.
+ */
+static int deflate_at_rest(deflate_state *s) {
+    if (s->pending != 0 || s->lookahead != 0 || s->sym_next != 0 || s->lit_block != 0 ||
+        s->block_open != 0 || s->match_available || s->block_start != (long)s->strstart)
+        return 0;
+#ifndef NO_MEDIUM_STRATEGY
+    if (deflate_medium_pending(s))
+        return 0;
+#endif
+    return 1;
+}
+
+/* ===========================================================================
+ * Allocate the buffers of an idle stream again and put back the bytes of the
+ * window that zng_deflateIdle() kept, hashed as deflateSetDictionary() would,
+ * so that the next block can refer to them. The stream stays idle if any of
+ * the buffers cannot be had.
+ */
+static int deflate_wake(zng_stream *strm) {
+    deflate_state *s = strm->state;
+    unsigned window_padding = 1;
+
+#ifdef X86_PCLMULQDQ_CRC
+    window_padding = 8;
+#endif
+    s->window = (unsigned char *) ZALLOC_WINDOW(strm, s->w_size + window_padding, WINDOW_FACTOR*sizeof(unsigned char));
+    s->prev   = (Pos *)  ZALLOC(strm, s->w_size, sizeof(Pos));
+    s->head   = (Pos *)  ZALLOC(strm, s->hash_size, sizeof(Pos));
+    s->pending_buf = (unsigned char *) ZALLOC(strm, s->lit_bufsize, 4);
+    s->trees = (tree_state *) ZALLOC(strm, 1, sizeof(tree_state));
+    if (s->level > 9)
+        s->opt = (opt_state *) ZALLOC(strm, 1, sizeof(opt_state));
+
+    if (s->window == NULL || s->prev == NULL || s->head == NULL ||
+        s->pending_buf == NULL || s->trees == NULL || (s->level > 9 && s->opt == NULL)) {
+        TRY_FREE(strm, s->opt);
+        TRY_FREE(strm, s->trees);
+        TRY_FREE(strm, s->pending_buf);
+        TRY_FREE(strm, s->head);
+        TRY_FREE(strm, s->prev);
+        TRY_FREE_WINDOW(strm, s->window);
+        s->opt = NULL;
+        s->trees = NULL;
+        s->pending_buf = NULL;
+        s->head = s->prev = NULL;
+        s->window = NULL;
+        return Z_MEM_ERROR;
+    }
+    memset(s->prev, 0, s->w_size * sizeof(Pos));
+    if (s->opt != NULL) {
+        s->opt->next_item = OPT_SEGMENT;
+        s->opt->have_costs = 0;
+    }
+    s->pending_out = s->pending_buf;
+    s->sym_buf = s->pending_buf + s->lit_bufsize;
+
+    /* The block is empty, but the bits of a byte not yet written stay in
+       bi_buf */
+    memset(s->trees, 0, sizeof(tree_state));
+    set_trees(s);
+    s->dyn_ltree[END_BLOCK].Freq = 1;
+    s->l_desc.dyn_tree = s->dyn_ltree;
+    s->d_desc.dyn_tree = s->dyn_dtree;
+    s->bl_desc.dyn_tree = s->bl_tree;
+
+    if (s->idle_window != NULL) {
+        memcpy(s->window, s->idle_window, s->idle_have);
+        ZFREE(strm, s->idle_window);
+        s->idle_window = NULL;
+    }
+    s->strstart = s->idle_have;
+    s->block_start = (long)s->idle_have;
+    s->lookahead = 0;
+    s->insert = s->strstart < MIN_MATCH-1 ? s->strstart : MIN_MATCH-1;
+    s->high_water = 0;
+    s->matches = 0;
+#ifdef DEFLATE_POS32
+    s->pos_base = 0;
+#endif
+    if (s->level == 0 || s->strategy == Z_BUCKET) {
+        CLEAR_HASH(s);
+        s->hash_rehash = 0;
+        s->insert = 0;
+    } else {
+        rehash_window(s);
+    }
+    s->idle_have = 0;
+    s->idle = 0;
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateIdle(zng_stream *strm, unsigned keep) {
+    deflate_state *s;
+
+    if (deflateStateCheck(strm) || strm->zalloc == zng_arena_alloc)
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (s->idle)
+        return Z_OK;
+    if (!deflate_at_rest(s))
+        return Z_BUF_ERROR;
+
+    if (keep > s->strstart)
+        keep = s->strstart;
+    if (keep > s->w_size)
+        keep = s->w_size;
+    if (keep != 0) {
+        s->idle_window = (unsigned char *) ZALLOC(strm, keep, 1);
+        if (s->idle_window == NULL)
+            return Z_MEM_ERROR;
+        memcpy(s->idle_window, s->window + s->strstart - keep, keep);
+    }
+    s->idle_have = keep;
+
+#ifndef NO_MEDIUM_STRATEGY
+    deflate_medium_end(s);
+#endif
+    TRY_FREE(strm, s->opt);
+    TRY_FREE(strm, s->trees);
+    TRY_FREE(strm, s->pending_buf);
+    free_window(strm);
+    s->opt = NULL;
+    s->trees = NULL;
+    s->dyn_ltree = s->dyn_dtree = s->bl_tree = NULL;
+    s->heap = NULL;
+    s->depth = NULL;
+    s->pending_buf = s->pending_out = s->sym_buf = NULL;
+    s->head = s->prev = NULL;
+    s->window = NULL;
+    s->idle = 1;
+    return Z_OK;
+}
+
+/* ===========================================================================
+ * Give a stream that shares its window, prev and head with others copies of
+ * its own, or just keep them if the others have given theirs up already. Only
+ * the part of the window that was written is copied. The stream goes on
+ * sharing if the copies cannot be had.
+ */
+static int deflate_own(zng_stream *strm) {
+    deflate_state *s = strm->state;
+    unsigned window_padding = 1;
+    unsigned char *window;
+    unsigned long used;
+    Pos *prev, *head;
+
+    if (z_atomic_load(s->share) == 1) {
+        ZFREE(strm, (void *)s->share);
+        s->share = NULL;
+        return Z_OK;
+    }
+
+#ifdef X86_PCLMULQDQ_CRC
+    window_padding = 8;
+#endif
+    window = (unsigned char *) ZALLOC_WINDOW(strm, s->w_size + window_padding, WINDOW_FACTOR*sizeof(unsigned char));
+    prev   = (Pos *)  ZALLOC(strm, s->w_size, sizeof(Pos));
+    head   = (Pos *)  ZALLOC(strm, s->hash_size, sizeof(Pos));
+    if (window == NULL || prev == NULL || head == NULL) {
+        TRY_FREE(strm, head);
+        TRY_FREE(strm, prev);
+        TRY_FREE_WINDOW(strm, window);
+        return Z_MEM_ERROR;
+    }
+
+    /* Bytes past high_water were never written, and are not read either */
+    used = s->high_water > s->strstart + s->lookahead ? s->high_water : s->strstart + s->lookahead;
+    if (used > s->window_size)
+        used = s->window_size;
+    memcpy(window, s->window, used);
+    memcpy((void *)prev, (void *)s->prev, s->w_size * sizeof(Pos));
+    memcpy((void *)head, (void *)s->head, s->hash_size * sizeof(Pos));
+
+    /* The other streams may have given theirs up while these were copied */
+    free_window(strm);
+    s->window = window;
+    s->prev = prev;
+    s->head = head;
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateCopyShared(zng_stream *dest, zng_stream *source) {
+    if (deflateStateCheck(source) || dest == NULL)
+        return Z_STREAM_ERROR;
+    WAKE_OR_RETURN(source);
+
+    /* The copy of a stream in an arena or a region of its own is allocated
+       there, so it cannot use the buffers of the source */
+    if (source->zalloc == zng_arena_alloc || source->zalloc == zng_node_alloc)
+        return deflate_copy(dest, source, 0);
+    return deflate_copy(dest, source, 1);
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateHibernate(zng_stream *strm, unsigned keep, void *blob, size_t *blob_len) {
+    hibernate_header head;
+    deflate_state *s;
+    size_t need;
+    int ret;
+
+    if (deflateStateCheck(strm) || blob_len == NULL)
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (!s->idle) {
+        if (keep > s->strstart)
+            keep = s->strstart;
+        if (keep > s->w_size)
+            keep = s->w_size;
+    } else {
+        keep = s->idle_have;
+    }
+    need = sizeof(hibernate_header) + sizeof(deflate_state) + keep;
+    if (blob == NULL) {
+        *blob_len = need;
+        return Z_OK;
+    }
+    if (*blob_len < need)
+        return Z_BUF_ERROR;
+    ret = zng_deflateIdle(strm, keep);
+    if (ret != Z_OK)
+        return ret;
+
+    head.magic = HIBERNATE_DEFLATE;
+    head.state_size = sizeof(deflate_state);
+    head.window_size = s->idle_have;
+    head.data_type = strm->data_type;
+    head.adler = strm->adler;
+    head.total_in = strm->total_in;
+    head.total_out = strm->total_out;
+    memcpy(blob, &head, sizeof(head));
+    memcpy((unsigned char *)blob + sizeof(head), s, sizeof(deflate_state));
+    if (s->idle_window != NULL) {
+        memcpy((unsigned char *)blob + sizeof(head) + sizeof(deflate_state), s->idle_window, s->idle_have);
+        ZFREE(strm, s->idle_window);
+    }
+    *blob_len = need;
+
+    ZFREE_STATE(strm, s);
+    strm->state = NULL;
+    zng_node_unmap(strm);
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateRestore(zng_stream *strm, const void *blob, size_t blob_len) {
+    hibernate_header head;
+    deflate_state *s;
+
+    if (strm == NULL || blob == NULL)
+        return Z_STREAM_ERROR;
+    if (blob_len < sizeof(head))
+        return Z_DATA_ERROR;
+    memcpy(&head, blob, sizeof(head));
+    if (head.magic != HIBERNATE_DEFLATE || head.state_size != sizeof(deflate_state) ||
+        blob_len != sizeof(head) + sizeof(deflate_state) + head.window_size)
+        return Z_DATA_ERROR;
+
+    strm->msg = NULL;
+    if (strm->zalloc == NULL) {
+        strm->zalloc = zng_calloc;
+        strm->opaque = NULL;
+    }
+    if (strm->zfree == NULL)
+        strm->zfree = zng_cfree;
+    s = (deflate_state *) ZALLOC_STATE(strm, 1, sizeof(deflate_state));
+    if (s == NULL)
+        return Z_MEM_ERROR;
+    memcpy(s, (const unsigned char *)blob + sizeof(head), sizeof(deflate_state));
+    if (!s->idle || s->idle_have != head.window_size) {
+        ZFREE_STATE(strm, s);
+        return Z_DATA_ERROR;
+    }
+    s->idle_window = NULL;
+    s->share = NULL;
+    if (head.window_size != 0) {
+        s->idle_window = (unsigned char *) ZALLOC(strm, head.window_size, 1);
+        if (s->idle_window == NULL) {
+            ZFREE_STATE(strm, s);
+            return Z_MEM_ERROR;
+        }
+        memcpy(s->idle_window, (const unsigned char *)blob + sizeof(head) + sizeof(deflate_state), head.window_size);
+    }
+    s->strm = strm;
+    s->gather = NULL;
+    s->gather_cnt = 0;
+    strm->state = s;
+    strm->data_type = head.data_type;
+    strm->adler = head.adler;
+    strm->total_in = head.total_in;
+    strm->total_out = head.total_out;
+    return Z_OK;
+}
+
+/* ===========================================================================
+ * Return true if a stream can be serialized with the given status: not while
+ * a gzip header is written, nor before one given to deflateSetHeader() is.
+ */
+static int serialize_status(int status, PREFIX(gz_headerp) gzhead) {
+#ifdef GZIP
+    if (status == GZIP_STATE)
+        return gzhead == NULL;
+#else
+    (void)gzhead;
+#endif
+    return status == INIT_STATE || status == BUSY_STATE || status == FINISH_STATE;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateSerialize(zng_stream *strm, void *buf, size_t *len) {
+    zng_deflate_param_value param;
+    const unsigned char *history;
+    deflate_state *s;
+    zng_wire w;
+    unsigned int have;
+    int id, val, count;
+
+    if (deflateStateCheck(strm) || len == NULL)
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if ((!s->idle && !deflate_at_rest(s)) || !serialize_status(s->status, s->gzhead))
+        return Z_BUF_ERROR;
+    if (s->idle) {
+        history = s->idle_window;
+        have = s->idle_have;
+    } else {
+        have = s->strstart < s->w_size ? s->strstart : s->w_size;
+        history = s->window + s->strstart - have;
+    }
+#ifdef X86_PCLMULQDQ_CRC
+    /* Bring strm->adler up to date with the folded CRC */
+    if (s->wrap == 2 && s->status == BUSY_STATE)
+        crc_finalize(s);
+#endif
+
+    w.buf = (unsigned char *)buf;
+    w.size = buf == NULL ? 0 : *len;
+    w.len = 0;
+    zng_wire_put(&w, SERIALIZE_DEFLATE, 4);
+    zng_wire_put(&w, SERIALIZE_VERSION, 1);
+    zng_wire_put(&w, (uint32_t)strm->data_type, 4);
+    zng_wire_put(&w, strm->adler, 4);
+    zng_wire_put(&w, strm->total_in, 8);
+    zng_wire_put(&w, strm->total_out, 8);
+
+    zng_wire_put(&w, (unsigned)s->status, 2);
+    zng_wire_put(&w, (uint32_t)s->wrap, 1);
+    zng_wire_put(&w, s->w_bits, 1);
+    zng_wire_put(&w, (uint32_t)s->last_flush, 1);
+    zng_wire_put(&w, s->bi_buf, 8);
+    zng_wire_put(&w, s->bi_valid, 1);
+
+    /* Everything that zng_deflateSetParams() can set, as pairs of the
+       parameter and its value */
+    param.buf = &val;
+    param.size = sizeof(val);
+    for (count = 0, id = Z_DEFLATE_LEVEL; id <= Z_DEFLATE_MAX_INPUT; id++) {
+        param.param = (zng_deflate_param)id;
+        if (zng_deflateGetParams(strm, &param, 1) == Z_OK)
+            count++;
+    }
+    zng_wire_put(&w, (unsigned)count, 1);
+    for (id = Z_DEFLATE_LEVEL; id <= Z_DEFLATE_MAX_INPUT; id++) {
+        param.param = (zng_deflate_param)id;
+        if (zng_deflateGetParams(strm, &param, 1) != Z_OK)
+            continue;
+        zng_wire_put(&w, (unsigned)id, 1);
+        zng_wire_put(&w, (uint32_t)val, 4);
+    }
+
+    zng_wire_put(&w, have, 4);
+    zng_wire_put_buf(&w, history, have);
+
+    if (buf != NULL && w.len > *len)
+        return Z_BUF_ERROR;
+    *len = w.len;
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateDeserialize(zng_stream *strm, const void *buf, size_t len) {
+    zng_deflate_param_value params[Z_DEFLATE_MAX_INPUT + 1];
+    int vals[Z_DEFLATE_MAX_INPUT + 1];
+    const unsigned char *history;
+    deflate_state *s;
+    zng_wire w;
+    unsigned int status, w_bits, bi_valid, have;
+    int wrap, last_flush, count, i, ret;
+    uint64_t bi_buf;
+    uint32_t adler;
+    size_t total_in, total_out;
+    int data_type;
+
+    if (strm == NULL || buf == NULL)
+        return Z_STREAM_ERROR;
+    w.buf = (unsigned char *)buf;
+    w.size = len;
+    w.len = 0;
+    w.bad = 0;
+    if (zng_wire_get(&w, 4) != SERIALIZE_DEFLATE)
+        return Z_DATA_ERROR;
+    if (zng_wire_get(&w, 1) != SERIALIZE_VERSION)
+        return Z_VERSION_ERROR;
+    data_type = (int)zng_wire_get(&w, 4);
+    adler = (uint32_t)zng_wire_get(&w, 4);
+    total_in = (size_t)zng_wire_get(&w, 8);
+    total_out = (size_t)zng_wire_get(&w, 8);
+    status = (unsigned int)zng_wire_get(&w, 2);
+    wrap = (int)(int8_t)zng_wire_get(&w, 1);
+    w_bits = (unsigned int)zng_wire_get(&w, 1);
+    last_flush = (int)(int8_t)zng_wire_get(&w, 1);
+    bi_buf = zng_wire_get(&w, 8);
+    bi_valid = (unsigned int)zng_wire_get(&w, 1);
+    count = (int)zng_wire_get(&w, 1);
+    if (w.bad || count > Z_DEFLATE_MAX_INPUT + 1)
+        return Z_DATA_ERROR;
+    for (i = 0; i < count; i++) {
+        params[i].param = (zng_deflate_param)zng_wire_get(&w, 1);
+        vals[i] = (int)(uint32_t)zng_wire_get(&w, 4);
+        params[i].buf = &vals[i];
+        params[i].size = sizeof(vals[i]);
+    }
+    have = (unsigned int)zng_wire_get(&w, 4);
+    history = zng_wire_get_buf(&w, have);
+    if (w.bad || w.len != len || w_bits < 9 || w_bits > MAX_WBITS || have > (1U << w_bits) ||
+        wrap < -2 || wrap > 2 || bi_valid >= Buf_size || !serialize_status((int)status, NULL))
+        return Z_DATA_ERROR;
+
+    ret = PREFIX(deflateInit2)(strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                               wrap == 0 ? -(int)w_bits : abs(wrap) == 2 ? (int)w_bits + 16 : (int)w_bits,
+                               DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK)
+        return ret;
+    ret = zng_deflateSetParams(strm, params, (size_t)count);
+    if (ret == Z_OK)
+        ret = zng_deflateIdle(strm, 0);
+    if (ret != Z_OK) {
+        PREFIX(deflateEnd)(strm);
+        return ret == Z_STREAM_ERROR || ret == Z_BUF_ERROR ? Z_DATA_ERROR : ret;
+    }
+
+    /* The window comes back when the stream is next used, as from
+       zng_deflateIdle() */
+    s = strm->state;
+    if (have != 0) {
+        s->idle_window = (unsigned char *) ZALLOC(strm, have, 1);
+        if (s->idle_window == NULL) {
+            PREFIX(deflateEnd)(strm);
+            return Z_MEM_ERROR;
+        }
+        memcpy(s->idle_window, history, have);
+        s->idle_have = have;
+    }
+    s->status = (int)status;
+    s->wrap = wrap;
+    s->last_flush = last_flush;
+    s->bi_buf = bi_buf;
+    s->bi_valid = (int)bi_valid;
+    strm->data_type = data_type;
+    strm->adler = adler;
+    strm->total_in = total_in;
+    strm->total_out = total_out;
+#ifdef X86_PCLMULQDQ_CRC
+    s->crc_prior_set = 1;
+    s->crc_prior = adler;
+    s->crc_prior_len = total_in;
+#endif
+    return Z_OK;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateGetStats(zng_stream *strm, zng_deflate_stats *stats) {
+#ifdef DEFLATE_STATS
+    const deflate_stats *st;
+    uint64_t other_ns;
+#endif
+
+    if (deflateStateCheck(strm) || stats == NULL)
+        return Z_STREAM_ERROR;
+    memset(stats, 0, sizeof(*stats));
+#ifdef DEFLATE_STATS
+    st = &strm->state->stats;
+    stats->stored_blocks = st->stored_blocks;
+    stats->fixed_blocks = st->fixed_blocks;
+    stats->dynamic_blocks = st->dynamic_blocks;
+    stats->literals = st->literals;
+    stats->matches = st->matches;
+    stats->match_bytes = st->match_bytes;
+    if (st->matches != 0)
+        stats->avg_match_length = (double)st->match_bytes / (double)st->matches;
+    stats->chain_steps = st->chain_steps;
+    stats->slide_hash = st->slide_hash;
+    stats->fill_window_ns = st->fill_window_ns;
+    stats->flush_block_ns = st->flush_block_ns;
+    /* fill_window also runs outside of the compress functions, from
+     * deflateSetDictionary(), so the difference may be negative */
+    other_ns = st->fill_window_ns + st->flush_block_ns;
+    stats->match_ns = st->compress_ns > other_ns ? st->compress_ns - other_ns : 0;
+    return Z_OK;
+#else
+    return Z_VERSION_ERROR;
+#endif
+}
+
+/* ===========================================================================
+ * zng_deflateEstimate() parses the whole input, or ESTIMATE_SAMPLES runs of
+ * ESTIMATE_RUN bytes spread over longer input, greedily with one probe of a
+ * table of 4-byte strings per position, as deflate_quick() does, and prices
+ * the literals and matches found as deflate would code them.
+ */
+#define ESTIMATE_RUN        65536
+#define ESTIMATE_SAMPLES    8
+#define ESTIMATE_HASH_BITS  12
+#define ESTIMATE_TREE_BITS  600     /* typical header of a dynamic block */
+
+typedef struct {
+    uint32_t lit[4][256];   /* literals, counted into four tables in turn */
+    uint32_t len[LENGTH_CODES];
+    uint32_t dist[D_CODES];
+    uint64_t literals;
+    uint64_t matches;
+} estimate_counts;
+
+/* Return log2(x) in 256ths of a bit, for 0 < x < 2^32, within 1/64 of a bit.
+   The fraction f of the mantissa 1 + f gives log2(1 + f) as close to
+   f + 0.3465 * f * (1 - f). */
+static uint32_t log2_q8(uint64_t x) {
+    uint32_t n = 0, f;
+
+    if (x >> 16) n += 16;
+    if (x >> (n + 8)) n += 8;
+    if (x >> (n + 4)) n += 4;
+    if (x >> (n + 2)) n += 2;
+    if (x >> (n + 1)) n += 1;
+    f = (uint32_t)(n > 8 ? x >> (n - 8) : x << (8 - n)) & 255;
+    return (n << 8) + f + ((f * (256 - f) * 89) >> 16);
+}
+
+/* Return the bits of count symbols out of total, in 256ths of a bit, if each
+   is coded in as many bits as its information content. */
+static uint64_t entropy_q8(uint64_t count, uint64_t total) {
+    return count ? count * (uint64_t)(log2_q8(total) - log2_q8(count)) : 0;
+}
+
+static void estimate_run(estimate_counts *e, const unsigned char *buf, uint32_t len, uint32_t max_dist, int strategy) {
+    uint32_t head[1 << ESTIMATE_HASH_BITS];     /* positions plus one */
+    uint32_t i = 0, n = (uint32_t)e->literals;
+    unsigned bits = ESTIMATE_HASH_BITS;
+
+    /* A smaller table for short input, which would not fill this one */
+    while (bits > 6 && (1U << bits) > len)
+        bits--;
+    memset(head, 0, sizeof(uint32_t) << bits);
+    while (i < len) {
+        uint32_t dist = 0, match = 0, left = len - i;
+
+        if (left >= 4 && strategy != Z_HUFFMAN_ONLY) {
+            uint32_t val, prev_val;
+
+            memcpy(&val, buf + i, sizeof(val));
+            if (strategy == Z_RLE) {
+                dist = i != 0;
+            } else {
+                uint32_t h = (val * 2654435761U) >> (32 - bits), prev = head[h];
+
+                head[h] = i + 1;
+                if (prev != 0 && i + 1 - prev <= max_dist)
+                    dist = i + 1 - prev;
+            }
+            if (dist != 0)
+                memcpy(&prev_val, buf + i - dist, sizeof(prev_val));
+            if (dist != 0 && val == prev_val) {
+                if (left >= MAX_MATCH) {
+                    match = functable.compare258(buf + i, buf + i - dist);
+                } else {
+                    match = 4;
+                    while (match < left && buf[i + match] == buf[i + match - dist])
+                        match++;
+                }
+            }
+        }
+
+        if (match != 0) {
+            e->len[zng_length_code[match - MIN_MATCH]]++;
+            e->dist[d_code(dist - 1)]++;
+            e->matches++;
+            i += match;
+        } else {
+            e->lit[n & 3][buf[i]]++;
+            n++;
+            i++;
+        }
+    }
+    e->literals = n;
+}
+
+/* ========================================================================= */
+unsigned long ZEXPORT zng_deflateEstimate(zng_stream *strm, const unsigned char *source, unsigned long sourceLen) {
+    deflate_state *s;
+    estimate_counts e;
+    unsigned long bound, parsed = 0, estimate;
+    uint64_t symbols, blocks, extra = 0, dynamic = 0, fixed, stored, bits;
+    uint32_t max_dist;
+    unsigned i;
+
+    bound = zng_deflateBound(strm, sourceLen);
+    if (deflateStateCheck(strm) || (source == NULL && sourceLen != 0) || strm->state->level == 0)
+        return bound;
+    s = strm->state;
+
+    memset(&e, 0, sizeof(e));
+    max_dist = MAX_DIST(s);
+    if (uses_quick(s))
+        max_dist = MIN(max_dist, 8191);
+    if (sourceLen <= ESTIMATE_RUN * ESTIMATE_SAMPLES) {
+        estimate_run(&e, source, (uint32_t)sourceLen, max_dist, s->strategy);
+        parsed = sourceLen;
+    } else {
+        for (i = 0; i < ESTIMATE_SAMPLES; i++) {
+            estimate_run(&e, source + (sourceLen - ESTIMATE_RUN) / (ESTIMATE_SAMPLES - 1) * i, ESTIMATE_RUN,
+                         max_dist, s->strategy);
+            parsed += ESTIMATE_RUN;
+        }
+    }
+
+    /* Price each symbol of a dynamic block by its information content, and
+       those of the other blocks as they are coded */
+    symbols = e.literals + e.matches + 1;
+    blocks = symbols / (s->lit_bufsize - 1) + 1;
+    fixed = 10 * blocks;
+    for (i = 0; i < 256; i++) {
+        uint64_t count = (uint64_t)e.lit[0][i] + e.lit[1][i] + e.lit[2][i] + e.lit[3][i];
+
+        dynamic += entropy_q8(count, symbols);
+        fixed += count * (i < 144 ? 8 : 9);
+    }
+    for (i = 0; i < LENGTH_CODES; i++) {
+        dynamic += entropy_q8(e.len[i], symbols);
+        extra += e.len[i] * (uint64_t)(i < 8 || i == LENGTH_CODES - 1 ? 0 : (i - 4) / 4);
+        fixed += e.len[i] * (uint64_t)(i < 23 ? 7 : 8);
+    }
+    for (i = 0; i < D_CODES; i++) {
+        dynamic += entropy_q8(e.dist[i], e.matches);
+        extra += e.dist[i] * (uint64_t)(i < 4 ? 0 : (i - 2) / 2);
+    }
+    dynamic = (dynamic >> 8) + extra + ESTIMATE_TREE_BITS * blocks;
+    fixed += 5 * e.matches + extra;
+    stored = (uint64_t)parsed * 8 + 40 * ((uint64_t)parsed / MAX_STORED + 1);
+
+    /* deflate_quick() and Z_FIXED have the fixed codes, and otherwise deflate
+       takes the smallest of the three for each block */
+    if (uses_quick(s)) {
+        bits = fixed;
+    } else if (s->strategy == Z_FIXED) {
+        bits = MIN(fixed, stored);
+    } else {
+        bits = MIN(MIN(dynamic, fixed), stored);
+    }
+    if (parsed < sourceLen)
+        bits = bits / parsed * sourceLen + bits % parsed * sourceLen / parsed;
+
+    estimate = (unsigned long)((bits + 7) >> 3) + wrapper_len(s);
+    return MIN(estimate, bound);
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateScatter(zng_stream *strm, const zng_iovec *iov, size_t iovcnt, size_t *written, int flush) {
+    unsigned char *next_out;
+    uint32_t avail_out;
+    size_t i, total = 0;
+    int ret = Z_BUF_ERROR;
+
+    if (deflateStateCheck(strm) || (iov == NULL && iovcnt != 0) || written == NULL)
+        return Z_STREAM_ERROR;
+    next_out = strm->next_out;
+    avail_out = strm->avail_out;
+
+    /* Fill each buffer in turn, until deflate() leaves room in one */
+    for (i = 0; i < iovcnt; i++) {
+        unsigned char *buf = (unsigned char *)iov[i].iov_base;
+        size_t left = iov[i].iov_len;
+
+        while (left != 0) {
+            uint32_t have = left > UINT32_MAX ? UINT32_MAX : (uint32_t)left;
+
+            strm->next_out = buf;
+            strm->avail_out = have;
+            ret = PREFIX(deflate)(strm, flush);
+            have -= strm->avail_out;
+            buf += have;
+            left -= have;
+            total += have;
+            if ((ret != Z_OK && ret != Z_BUF_ERROR) || strm->avail_out != 0)
+                goto done;
+        }
+    }
+done:
+    strm->next_out = next_out;
+    strm->avail_out = avail_out;
+    *written = total;
+    /* Like deflate(), only an error if no progress was made at all */
+    if (ret == Z_BUF_ERROR && total != 0)
+        ret = Z_OK;
+    return ret;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflatev(zng_stream *strm, const zng_iovec *iov, size_t iovcnt, size_t *consumed, int flush) {
+    deflate_state *s;
+    const unsigned char *next_in;
+    uint32_t avail_in;
+    size_t total_in, total_out, i;
+    unsigned int max_input;
+    int more, ret;
+
+    if (deflateStateCheck(strm) || (iov == NULL && iovcnt != 0) || consumed == NULL)
+        return Z_STREAM_ERROR;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > UINT32_MAX || (iov[i].iov_base == NULL && iov[i].iov_len != 0))
+            return Z_STREAM_ERROR;
+    }
+    s = strm->state;
+    next_in = strm->next_in;
+    avail_in = strm->avail_in;
+    total_in = strm->total_in;
+    total_out = strm->total_out;
+
+    /* read_buf() moves on to the next fragment whenever one is used up, so
+     * the compress functions see the fragments as a single input. Between
+     * the calls here the same is done for when the input was consumed some
+     * other way, and flush is only passed once the last one is loaded.
+     */
+    s->gather = iov;
+    s->gather_cnt = iovcnt;
+    strm->next_in = NULL;
+    strm->avail_in = 0;
+    gather_next(s);
+    max_input = s->max_input;
+    do {
+        more = s->gather_cnt != 0;
+        if (max_input != 0) {
+            /* Z_DEFLATE_MAX_INPUT is for all of the fragments together */
+            if (strm->total_in - total_in >= max_input)
+                break;
+            s->max_input = max_input - (unsigned int)(strm->total_in - total_in);
+        }
+        ret = PREFIX(deflate)(strm, more ? Z_NO_FLUSH : flush);
+        if (ret != Z_OK || strm->avail_out == 0)
+            break;
+        gather_next(s);
+    } while (more);
+    s->max_input = max_input;
+    s->gather = NULL;
+    s->gather_cnt = 0;
+
+    *consumed = strm->total_in - total_in;
+    strm->next_in = next_in;
+    strm->avail_in = avail_in;
+    /* Like deflate(), only an error if no progress was made at all */
+    if (ret == Z_BUF_ERROR && (*consumed != 0 || strm->total_out != total_out))
+        ret = Z_OK;
+    return ret;
 }
 #endif
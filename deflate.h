@@ -14,6 +14,9 @@
 
 #include "zutil.h"
 #include "zendian.h"
+#ifndef ZLIB_COMPAT
+#  include "zthread.h"
+#endif
 
 /* define NO_GZIP when compiling if you want to disable gzip header and
    trailer creation by deflate().  NO_GZIP would be used to avoid linking in
@@ -23,6 +26,16 @@
 #  define GZIP
 #endif
 
+/* deflate_quick() is used at level 1 when the CPU can compute a CRC-32C in one
+   instruction, which QUICK_CPU_CHECK tells at run time */
+#if defined(X86_QUICK_STRATEGY)
+#  define QUICK_STRATEGY
+#  define QUICK_CPU_CHECK x86_cpu_has_sse42
+#elif defined(ARM_QUICK_STRATEGY) && defined(__ARM_FEATURE_CRC32)
+#  define QUICK_STRATEGY
+#  define QUICK_CPU_CHECK arm_cpu_has_crc32
+#endif
+
 #define NIL 0
 /* Tail of hash chains */
 
@@ -52,12 +65,15 @@
 #define MAX_BITS 15
 /* All codes must not exceed MAX_BITS bits */
 
-#define Buf_size 16
+#define Buf_size 64
 /* size of bit buffer in bi_buf */
 
 #define END_BLOCK 256
 /* end of block literal code */
 
+#define SPLIT_TYPES 12
+/* number of symbol types compared to decide on ending a block early */
+
 #define INIT_STATE    42    /* zlib header -> BUSY_STATE */
 #ifdef GZIP
 #  define GZIP_STATE  57    /* gzip header -> BUSY_STATE | EXTRA_STATE */
@@ -74,8 +90,8 @@
 /* Data structure describing a single value and its code string. */
 typedef struct ct_data_s {
     union {
-        uint16_t  freq;       /* frequency count */
         uint16_t  code;       /* bit string */
+        uint32_t  freq;       /* frequency count, wider than 16 bits for large sym_buf */
     } fc;
     union {
         uint16_t  dad;        /* father node in Huffman tree */
@@ -96,12 +112,129 @@ typedef struct tree_desc_s {
     const static_tree_desc *stat_desc; /* the corresponding static tree */
 } tree_desc;
 
+/* The trees of the block being built and the scratch space used to build
+ * them. They are kept apart from the rest of the state so that a stream left
+ * idle by zng_deflateIdle() can give them back.
+ */
+typedef struct tree_state_s {
+    ct_data dyn_ltree[HEAP_SIZE];           /* literal and length tree */
+    ct_data dyn_dtree[2*D_CODES+1];         /* distance tree */
+    ct_data bl_tree[2*BL_CODES+1];          /* Huffman tree for bit lengths */
+    int heap[2*L_CODES+1];                  /* symbols sorted to build the Huffman trees */
+    unsigned char depth[2*L_CODES+1];       /* depth of each subtree, for the ZLIB_DEBUG check */
+} tree_state;
+
+#ifdef DEFLATE_POS32
+typedef uint32_t Pos;
+#else
 typedef uint16_t Pos;
+#endif
 typedef unsigned IPos;
 
 /* A Pos is an index in the character window. We use short instead of int to
  * save space in the various tables. IPos is used only for parameter passing.
+ *
+ * With DEFLATE_POS32, head[] and prev[] hold window indexes plus pos_base,
+ * which grows by w_size each time the window slides, so that sliding does
+ * not have to update the tables. POS_ENTRY() turns a window index into a
+ * table entry, and POS_WINDOW() turns an entry back into a window index, or
+ * NIL if the string has left the window.
+ */
+/* The window holds WINDOW_FACTOR * w_size bytes. When it is full, the last
+ * w_size bytes, which matches can still reach, are copied down to its start,
+ * so the window is copied once every WINDOW_SLIDE(s) bytes of input, and the
+ * hash tables are slid WINDOW_FACTOR - 1 times. With 16-bit entries all of
+ * the window must be within reach of a Pos, with DEFLATE_POS32 it is larger
+ * so that the copy costs a seventh of a byte for each byte of input instead
+ * of a whole one, and sliding the hash tables only moves pos_base.
+ */
+#ifdef DEFLATE_POS32
+#  define WINDOW_FACTOR 8
+#else
+#  define WINDOW_FACTOR 2
+#endif
+#define WINDOW_SLIDE(s) ((WINDOW_FACTOR - 1) * (s)->w_size)
+
+#ifdef DEFLATE_POS32
+#  define POS_ENTRY(s, pos) ((Pos)((pos) + (s)->pos_base))
+#  define POS_WINDOW(s, ent) ((Pos)((ent) > (s)->pos_base ? (ent) - (s)->pos_base : NIL))
+#else
+#  define POS_ENTRY(s, pos) ((Pos)(pos))
+#  define POS_WINDOW(s, ent) (ent)
+#endif
+
+/* With DEFLATE_CHAIN_PREFETCH, longest_match() prefetches the next candidate
+ * of the hash chain and insert_hashed() the entries of head[] it is about to
+ * update. That is only done on x86-64 and AArch64: the prefetches add loads
+ * to the loops, and they can evict lines still in use on the parts with small
+ * caches that are common among the other CPU families.
+ */
+#if defined(DEFLATE_CHAIN_PREFETCH) && \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) || defined(_M_ARM64))
+#  define CHAIN_PREFETCH(addr) PREFETCH_L1(addr)
+#endif
+
+#ifdef DEFLATE_STATS
+/* Statistics of a deflate stream, see zng_deflateGetStats(). The time of the
+ * compress functions includes that spent in fill_window and
+ * zng_tr_flush_block, which is subtracted when the stats are reported.
+ */
+typedef struct {
+    uint64_t stored_blocks;
+    uint64_t fixed_blocks;
+    uint64_t dynamic_blocks;
+    uint64_t literals;
+    uint64_t matches;
+    uint64_t match_bytes;
+    uint64_t chain_steps;
+    uint64_t slide_hash;
+    uint64_t compress_ns;
+    uint64_t fill_window_ns;
+    uint64_t flush_block_ns;
+} deflate_stats;
+
+void ZLIB_INTERNAL deflate_stats_add(deflate_stats *dst, const deflate_stats *src);
+
+#  define STATS_ADD(s, field, n) ((s)->stats.field += (n))
+#  define STATS_TIMER_START(t) uint64_t t = deflate_clock()
+#  define STATS_TIMER_END(s, field, t) STATS_ADD(s, field, deflate_clock() - (t))
+#else
+#  define STATS_ADD(s, field, n) do {} while (0)
+#  define STATS_TIMER_START(t) do {} while (0)
+#  define STATS_TIMER_END(s, field, t) do {} while (0)
+#endif
+
+/* State of deflate_optimal(), for levels above 9. The input is parsed
+ * OPT_SEGMENT positions at a time, keeping up to OPT_MATCHES matches of
+ * increasing length for each position, and the parse of a segment is kept
+ * until all of it has been sent.
  */
+#define OPT_SEGMENT    8192
+#define OPT_MATCHES    8
+#define OPT_MAX_PASSES 15
+
+typedef struct {
+    uint16_t len;               /* match length, or 1 for a literal */
+    uint16_t dist;              /* match distance, or 0 for a literal */
+} opt_match;
+
+typedef struct {
+    opt_match matches[OPT_SEGMENT][OPT_MATCHES];    /* matches at each position */
+    unsigned char nmatches[OPT_SEGMENT];            /* number of matches at each position */
+    uint32_t cost[OPT_SEGMENT+1];                   /* cost in bits of the cheapest way to each position */
+    opt_match path[OPT_SEGMENT+1];                  /* last step of the cheapest way to each position */
+    opt_match items[OPT_SEGMENT];                   /* parse of the segment, sent from next_item on */
+    unsigned int next_item;                         /* OPT_SEGMENT when all of the parse was sent */
+    int have_costs;                                 /* costs below are from the previous segment */
+    unsigned char lit_cost[LITERALS];
+    unsigned char len_cost[MAX_MATCH-MIN_MATCH+1];
+    unsigned char dist_cost[D_CODES];
+    uint32_t lfreq[L_CODES];                        /* literal and length frequencies of a parse */
+    uint32_t dfreq[D_CODES];                        /* distance frequencies of a parse */
+} opt_state;
+
+/* Helper thread of deflate_medium() for Z_DEFLATE_PIPELINE, in deflate_medium.c */
+typedef struct pipe_state_s pipe_state;
 
 typedef struct internal_state {
     PREFIX3(stream)      *strm;            /* pointer back to this zlib stream */
@@ -118,6 +251,9 @@ typedef struct internal_state {
 
 #ifdef X86_PCLMULQDQ_CRC
     unsigned crc0[4 * 5];
+    int crc_prior_set;      /* true if crc0 started after the input below */
+    uint32_t crc_prior;     /* CRC-32 of the input before, and its length */
+    size_t crc_prior_len;
 #endif
 
                 /* used by deflate.c: */
@@ -149,14 +285,25 @@ typedef struct internal_state {
 
     Pos *head; /* Heads of the hash chains or NIL. */
 
+#ifdef DEFLATE_POS32
+    uint32_t pos_base; /* added to window indexes in head[] and prev[] */
+#endif
+
     unsigned int  ins_h;             /* hash index of string to be inserted */
     unsigned int  hash_size;         /* number of elements in hash table */
     unsigned int  hash_bits;         /* log2(hash_size) */
     unsigned int  hash_mask;         /* hash_size-1 */
+    int           hash_rehash;       /* head[] can be cleared by hashing the window again */
+    unsigned int  hash_bytes;        /* bytes hashed by insert_string(), or 0 to follow the level */
+    int           hash_func;         /* one of the HASH_FUNC_* values below */
+
+    Pos  (* insert_string) (struct internal_state *const s, const Pos str, unsigned int count);
+    void (* clear_hash)    (struct internal_state *const s, const Pos str, unsigned int count);
+    /* The hash functions of the stream, as picked for hash_func by
+     * functable_hash_select()
+     */
 
-    #if !defined(__x86_64__) && !defined(_M_X64) && !defined(__i386) && !defined(_M_IX86)
     unsigned int  hash_shift;
-    #endif
     /* Number of bits by which ins_h must be shifted at each input
      * step. It must be such that after MIN_MATCH steps, the oldest
      * byte no longer takes part in the hash key, that is:
@@ -186,6 +333,13 @@ typedef struct internal_state {
      * speed.
      */
 
+    unsigned int chain_cut;
+    uint32_t guard_searches, guard_steps;
+    /* The hash chains are searched up to max_chain_length >> chain_cut, which
+     * chain_guard() raises while the searches run the chains out, and the
+     * searches and their steps since it last looked.
+     */
+
     unsigned int max_lazy_match;
     /* Attempt to find a better match only when the current match is strictly
      * smaller than this value. This mechanism is used only for compression
@@ -197,7 +351,7 @@ typedef struct internal_state {
      * max_insert_length is used only for compression levels <= 3.
      */
 
-    int level;    /* compression level (1..9) */
+    int level;    /* compression level (1..MAX_LEVEL) */
     int strategy; /* favor or force Huffman coding*/
 
     unsigned int good_match;
@@ -205,11 +359,19 @@ typedef struct internal_state {
 
     int nice_match; /* Stop searching when current match exceeds this */
 
+    int search;
+    /* The match search of levels 1 to 9, one of the SEARCH_* values below, or
+     * SEARCH_DEFAULT for that of the level.
+     */
+
+    opt_state *opt; /* used by deflate_optimal(), allocated for levels above 9 */
+
                 /* used by trees.c: */
     /* Didn't use ct_data typedef below to suppress compiler warning */
-    struct ct_data_s dyn_ltree[HEAP_SIZE];   /* literal and length tree */
-    struct ct_data_s dyn_dtree[2*D_CODES+1]; /* distance tree */
-    struct ct_data_s bl_tree[2*BL_CODES+1];  /* Huffman tree for bit lengths */
+    struct ct_data_s *dyn_ltree;             /* literal and length tree */
+    struct ct_data_s *dyn_dtree;             /* distance tree */
+    struct ct_data_s *bl_tree;               /* Huffman tree for bit lengths */
+    struct tree_state_s *trees;              /* where these and heap, depth are */
 
     struct tree_desc_s l_desc;               /* desc. for literal tree */
     struct tree_desc_s d_desc;               /* desc. for distance tree */
@@ -218,23 +380,26 @@ typedef struct internal_state {
     uint16_t bl_count[MAX_BITS+1];
     /* number of codes at each bit length for an optimal tree */
 
-    int heap[2*L_CODES+1];      /* heap used to build the Huffman trees */
+    int *heap;                  /* symbols sorted by frequency to build the Huffman trees */
     int heap_len;               /* number of elements in the heap */
     int heap_max;               /* element of largest frequency */
-    /* The sons of heap[n] are heap[2*n] and heap[2*n+1]. heap[0] is not used.
-     * The same heap array is used to build all trees.
+    /* With ZLIB_DEBUG, build_tree() checks its code lengths against those of
+     * the classic construction with a heap, where the sons of heap[n] are
+     * heap[2*n] and heap[2*n+1] and heap[0] is not used.
      */
 
-    unsigned char depth[2*L_CODES+1];
+    unsigned char *depth;
     /* Depth of each subtree used as tie breaker for trees of equal frequency
+     * in that heap
      */
 
     unsigned char *sym_buf;       /* buffer for distances and literals/lengths */
 
     unsigned int  lit_bufsize;
     /* Size of match buffer for literals/lengths.  There are 4 reasons for
-     * limiting lit_bufsize to 64K:
-     *   - frequencies can be kept in 16 bit counters
+     * limiting lit_bufsize to 64K by default (zng_deflateSetParams() allows up
+     * to MAX_LIT_BUFSIZE, for fewer trees to build and send):
+     *   - frequencies can be kept in 16 bit counters (they are 32 bits now)
      *   - if compression is not successful for the first block, all input
      *     data is still in the window so we can still emit a stored block even
      *     when input comes from standard input.  (This can also be done for
@@ -253,6 +418,8 @@ typedef struct internal_state {
 
     unsigned int sym_next;      /* running index in sym_buf */
     unsigned int sym_end;       /* symbol table full when sym_next reaches this */
+    unsigned int sym_check;     /* check for the end of the block when sym_next reaches this */
+    int lit_block;              /* the block is all literals, sent from the window and not sym_buf */
 
     unsigned long opt_len;        /* bit length of current block with optimal trees */
     unsigned long static_len;     /* bit length of current block with static trees */
@@ -264,13 +431,13 @@ typedef struct internal_state {
     unsigned long bits_sent;      /* bit length of compressed data sent mod 2^32 */
 #endif
 
-    uint16_t bi_buf;
+    uint64_t bi_buf;
     /* Output buffer. bits are inserted starting at the bottom (least
-     * significant bits).
+     * significant bits), and written out 8 bytes at a time.
      */
     int bi_valid;
-    /* Number of valid bits in bi_buf.  All bits above the last valid bit
-     * are always zero.
+    /* Number of valid bits in bi_buf, always less than Buf_size.  All bits
+     * above the last valid bit are always zero.
      */
 
     unsigned long high_water;
@@ -281,12 +448,83 @@ typedef struct internal_state {
      */
     int block_open;
     /* Whether or not a block is currently open for the QUICK deflation scheme.
-     * This is set to 1 if there is an active block, or 0 if the block was just
-     * closed.
+     * This is set to 1 if there is an active block, 2 if the active block is
+     * the last one, or 0 if the block was just closed.
+     */
+    int quick_dynamic;
+    /* Whether the QUICK scheme tallies symbols for dynamic trees instead of
+     * writing them with the static trees.
+     */
+    int prescan;
+    /* Whether each piece of input is sampled first, and only given literals
+     * by deflate_huff() if its bytes look incompressible.
+     */
+    unsigned int prescan_left;
+    int prescan_huff;
+    /* Bytes of input left in the piece that was sampled last, and whether
+     * they go to deflate_huff().
+     */
+    int pipeline;
+    pipe_state *medium_pipe;
+    /* Whether deflate_medium() finds matches in a helper thread, and that
+     * helper, or NULL until it is first needed.
      */
     int reproducible;
     /* Whether reproducible compression results are required.
      */
+    int block_split;
+    /* Whether to end blocks where the statistics of the symbols change, or -1
+     * to decide by the level.
+     */
+    uint32_t split_obs[SPLIT_TYPES];
+    /* Symbols of the current block by type, as counted at the last check.
+     */
+    unsigned int auto_flush;
+    unsigned int flush_in;
+    /* Input bytes after which deflate() makes a Z_PARTIAL_FLUSH by itself, or
+     * 0 for never, and the input compressed since the last flush.
+     */
+    unsigned int max_input;
+    /* Input bytes that one call of deflate() takes at most, or 0 for no
+     * limit.
+     */
+    unsigned int target_speed;
+    unsigned int target_output;
+    /* Speeds in KB/s of input and of output that deflate() picks the level
+     * for by itself, or 0 for none.
+     */
+    uint64_t adapt_in, adapt_out, adapt_time;
+    int adapt_level;
+    /* Bytes in, bytes out and nanoseconds spent in deflate() since the level
+     * was last picked, and the level picked, which waits for the end of the
+     * input given if it needs the end of the block.
+     */
+
+#ifndef ZLIB_COMPAT
+    const zng_iovec *gather;
+    size_t gather_cnt;
+    /* Input fragments of zng_deflatev() not yet loaded into next_in, or NULL
+     * outside of that function.
+     */
+
+    int idle;
+    unsigned char *idle_window;
+    unsigned int idle_have;
+    /* True while zng_deflateIdle() has the buffers freed, and the last
+     * idle_have bytes of the window that it kept in idle_window.
+     */
+
+    z_atomic_t *share;
+    /* Number of streams using window, prev and head, which zng_deflateCopyShared()
+     * made them share, or NULL if this stream has them to itself.
+     */
+#endif
+
+#ifdef DEFLATE_STATS
+    deflate_stats stats;
+    /* Counters and phase times reported by zng_deflateGetStats().
+     */
+#endif
 
 } deflate_state;
 
@@ -314,6 +552,26 @@ static inline void put_short(deflate_state *s, uint16_t w) {
   s->pending += 2;
 }
 
+/* ===========================================================================
+ * Output a 32-bit or a 64-bit word LSB first on the stream.
+ * IN assertion: there is enough room in pendingBuf.
+ */
+static inline void put_uint32(deflate_state *s, uint32_t dw) {
+#if BYTE_ORDER == BIG_ENDIAN
+  dw = ZSWAP32(dw);
+#endif
+  memcpy(&(s->pending_buf[s->pending]), &dw, sizeof(uint32_t));
+  s->pending += 4;
+}
+
+static inline void put_uint64(deflate_state *s, uint64_t lld) {
+#if BYTE_ORDER == BIG_ENDIAN
+  lld = ZSWAP64(lld);
+#endif
+  memcpy(&(s->pending_buf[s->pending]), &lld, sizeof(uint64_t));
+  s->pending += 8;
+}
+
 #define MIN_LOOKAHEAD (MAX_MATCH+MIN_MATCH+1)
 /* Minimum amount of lookahead, except at the end of the input file.
  * See deflate.c for comments about the MIN_MATCH+1.
@@ -328,17 +586,40 @@ static inline void put_short(deflate_state *s, uint16_t w) {
 /* Number of bytes after end of data in window to initialize in order to avoid
    memory checker errors from longest match routines */
 
+#define CHAIN_WINDOW 1024
+/* Number of searches of the hash chains over which chain_guard() measures
+ * their length.
+ */
+
+#define CHAIN_GUARD(s, steps) do { \
+    (s)->guard_steps += (steps); \
+    if (++(s)->guard_searches == CHAIN_WINDOW) \
+        chain_guard(s); \
+} while (0)
+/* Count a search of steps entries of a hash chain, at the end of each
+ * longest_match() variant.
+ */
+
 
 void ZLIB_INTERNAL fill_window_c(deflate_state *s);
 void ZLIB_INTERNAL slide_hash_c(deflate_state *s);
+unsigned ZLIB_INTERNAL longest_match_c(deflate_state *const s, IPos cur_match);
+void ZLIB_INTERNAL chain_guard(deflate_state *s);
+unsigned ZLIB_INTERNAL compare258_c(const unsigned char *src0, const unsigned char *src1);
+unsigned ZLIB_INTERNAL rle258_c(const unsigned char *src, unsigned char c);
 
         /* in trees.c */
 void ZLIB_INTERNAL zng_tr_init(deflate_state *s);
 int ZLIB_INTERNAL zng_tr_tally(deflate_state *s, unsigned dist, unsigned lc);
+int ZLIB_INTERNAL zng_tr_tally_lits(deflate_state *s, const unsigned char *buf, unsigned len);
+void ZLIB_INTERNAL zng_tr_lits_to_syms(deflate_state *s, const unsigned char *buf);
+int ZLIB_INTERNAL zng_tr_block_end(deflate_state *s);
 void ZLIB_INTERNAL zng_tr_flush_block(deflate_state *s, char *buf, unsigned long stored_len, int last);
 void ZLIB_INTERNAL zng_tr_flush_bits(deflate_state *s);
 void ZLIB_INTERNAL zng_tr_align(deflate_state *s);
 void ZLIB_INTERNAL zng_tr_stored_block(deflate_state *s, char *buf, unsigned long stored_len, int last);
+void ZLIB_INTERNAL zng_tr_costs(deflate_state *s, const uint32_t *lfreq, const uint32_t *dfreq,
+                                unsigned char *lit_cost, unsigned char *len_cost, unsigned char *dist_cost);
 void ZLIB_INTERNAL bi_windup(deflate_state *s);
 unsigned ZLIB_INTERNAL bi_reverse(unsigned code, int len);
 void ZLIB_INTERNAL flush_pending(PREFIX3(streamp) strm);
@@ -349,19 +630,20 @@ void ZLIB_INTERNAL flush_pending(PREFIX3(streamp) strm);
  * used.
  */
 
+extern const unsigned char ZLIB_INTERNAL zng_length_code[];
+extern const unsigned char ZLIB_INTERNAL zng_dist_code[];
+
 #ifndef ZLIB_DEBUG
 /* Inline versions of _tr_tally for speed: */
 
-  extern const unsigned char ZLIB_INTERNAL zng_length_code[];
-  extern const unsigned char ZLIB_INTERNAL zng_dist_code[];
-
 # define zng_tr_tally_lit(s, c, flush) \
   { unsigned char cc = (c); \
     s->sym_buf[s->sym_next++] = 0; \
     s->sym_buf[s->sym_next++] = 0; \
     s->sym_buf[s->sym_next++] = cc; \
     s->dyn_ltree[cc].Freq++; \
-    flush = (s->sym_next == s->sym_end); \
+    STATS_ADD(s, literals, 1); \
+    flush = (s->sym_next == s->sym_check && zng_tr_block_end(s)); \
   }
 # define zng_tr_tally_dist(s, distance, length, flush) \
   { unsigned char len = (unsigned char)(length); \
@@ -372,7 +654,9 @@ void ZLIB_INTERNAL flush_pending(PREFIX3(streamp) strm);
     dist--; \
     s->dyn_ltree[zng_length_code[len]+LITERALS+1].Freq++; \
     s->dyn_dtree[d_code(dist)].Freq++; \
-    flush = (s->sym_next == s->sym_end); \
+    STATS_ADD(s, matches, 1); \
+    STATS_ADD(s, match_bytes, (unsigned)len + MIN_MATCH); \
+    flush = (s->sym_next == s->sym_check && zng_tr_block_end(s)); \
   }
 #else
 #   define zng_tr_tally_lit(s, c, flush) flush = zng_tr_tally(s, 0, c)
@@ -393,21 +677,76 @@ void ZLIB_INTERNAL flush_pending(PREFIX3(streamp) strm);
 #define TRIGGER_LEVEL 5
 #endif
 
-#if defined(__x86_64__) || defined(_M_X64) || defined(__i386) || defined(_M_IX86)
-#define UPDATE_HASH(s, h, i) \
+/* Largest level accepted by deflateInit2() and deflateParams() */
+#ifdef ZLIB_COMPAT
+#  define MAX_LEVEL 9
+#else
+#  define MAX_LEVEL 12
+#endif
+
+/* Largest strategy accepted by deflateInit2() and deflateParams() */
+#ifdef ZLIB_COMPAT
+#  define MAX_STRATEGY Z_FIXED
+#else
+#  define MAX_STRATEGY Z_BUCKET
+#endif
+
+/* Largest hash table that can be asked for with zng_deflateSetParams() */
+#define MAX_HASH_BITS 20
+
+/* Largest symbol buffer that can be asked for with zng_deflateSetParams() */
+#define MAX_LIT_BUFSIZE (1 << 18)
+
+/* Hash functions that can be asked for with zng_deflateSetParams(), with the
+   same values as Z_HASH_DEFAULT and the others in zlib-ng.h */
+#define HASH_FUNC_DEFAULT  0
+#define HASH_FUNC_MULTIPLY 1
+#define HASH_FUNC_CRC      2
+#define HASH_FUNC_ROLLING  3
+
+/* Match searches that can be asked for with zng_deflateSetParams(), with the
+   same values as Z_SEARCH_DEFAULT and the others in zlib-ng.h */
+#define SEARCH_DEFAULT 0
+#define SEARCH_GREEDY  1
+#define SEARCH_LAZY    2
+#define SEARCH_MEDIUM  3
+
+/* Largest hash chain length that can be asked for with zng_deflateSetParams() */
+#define MAX_MAX_CHAIN 65535
+
+/* Number of bytes hashed by the hash functions that depend on the string alone */
+#define HASH_BYTES(s) ((s)->hash_bytes ? (s)->hash_bytes : ((s)->level < TRIGGER_LEVEL ? 4 : 3))
+
+#define HASH_CALC_POS(s, h, i) \
     do {\
-        if (s->level < TRIGGER_LEVEL) \
+        if (HASH_BYTES(s) == 4) \
             h = (3483 * (s->window[i]) +\
                  23081* (s->window[i+1]) +\
                  6954 * (s->window[i+2]) +\
                  20947* (s->window[i+3])) & s->hash_mask;\
+        else if (HASH_BYTES(s) == 5) \
+            h = (3483 * (s->window[i]) +\
+                 23081* (s->window[i+1]) +\
+                 6954 * (s->window[i+2]) +\
+                 20947* (s->window[i+3]) +\
+                 13971* (s->window[i+4])) & s->hash_mask;\
         else\
             h = (25881* (s->window[i]) +\
                  24674* (s->window[i+1]) +\
                  25811* (s->window[i+2])) & s->hash_mask;\
     } while (0)
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386) || defined(_M_IX86)
+#define UPDATE_HASH(s, h, i) HASH_CALC_POS(s, h, i)
 #else
-#   define UPDATE_HASH(s, h, i) (h = (((h) << s->hash_shift) ^ (s->window[i + (MIN_MATCH-1)])) & s->hash_mask)
+/* The rolling hash only covers MIN_MATCH bytes, so longer ones fall back to the positional hash */
+#   define UPDATE_HASH(s, h, i) \
+    do {\
+        if (s->hash_bytes > MIN_MATCH) \
+            HASH_CALC_POS(s, h, i);\
+        else\
+            h = (((h) << s->hash_shift) ^ (s->window[i + (MIN_MATCH-1)])) & s->hash_mask;\
+    } while (0)
 #endif
 
 #ifdef ZLIB_DEBUG
@@ -434,20 +773,20 @@ void ZLIB_INTERNAL flush_pending(PREFIX3(streamp) strm);
 #endif
 
 /* If not enough room in bit_buf, use (valid) bits from bit_buf and
- * (16 - bit_valid) bits from value, leaving (width - (16-bit_valid))
- * unused bits in value.
+ * (64 - bits_valid) bits from value, leaving (len - (64 - bits_valid))
+ * unused bits in value. As len is at most 16 bits, bits_valid is not 0 when
+ * bit_buf is full, so the shifts are always by less than 64.
  */
 #define send_bits(s, t_val, t_len, bit_buf, bits_valid) {\
-    int val = t_val;\
+    uint64_t val = (uint64_t)(t_val);\
     int len = t_len;\
-    send_debug_trace(s, val, len);\
-    if (bits_valid > (int)Buf_size - len) {\
-        bit_buf |= (uint16_t)val << bits_valid;\
-        put_short(s, bit_buf);\
-        bit_buf = (uint16_t)val >> (Buf_size - bits_valid);\
+    send_debug_trace(s, (int)val, len);\
+    bit_buf |= val << bits_valid;\
+    if (bits_valid >= (int)Buf_size - len) {\
+        put_uint64(s, bit_buf);\
+        bit_buf = val >> (Buf_size - bits_valid);\
         bits_valid += len - Buf_size;\
     } else {\
-        bit_buf |= (uint16_t)(val) << bits_valid;\
         bits_valid += len;\
     }\
 }
@@ -0,0 +1,141 @@
+/* deflate_bucket.c -- compress data using hash buckets instead of hash chains
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * For Z_BUCKET, head[] is used as a table of buckets of BUCKET_WAYS positions
+ * each, most recent first, and prev[] is not used at all. Looking up a string
+ * then reads the few candidates of one bucket, which share a cache line,
+ * instead of following the chain through prev[] one cache miss at a time.
+ * Only the last BUCKET_WAYS strings with each hash can be found, which is
+ * still a wider search than the single candidate of the fastest levels.
+ */
+
+#ifndef ZLIB_COMPAT
+
+#include "zbuild.h"
+#include "deflate.h"
+#include "deflate_p.h"
+#include "functable.h"
+
+#define BUCKET_SHIFT 2                      /* log2 of positions per bucket */
+#define BUCKET_WAYS  (1 << BUCKET_SHIFT)
+#define BUCKET_BYTES 4                      /* bytes hashed to select a bucket */
+
+/* ===========================================================================
+ * Return the bucket for the BUCKET_BYTES bytes at str.
+ */
+static inline Pos *bucket_find(deflate_state *s, uint32_t str) {
+    uint32_t val;
+
+    memcpy(&val, s->window + str, sizeof(val));
+    val = (val * 2654435761U) >> (32 - (s->hash_bits - BUCKET_SHIFT));
+    return s->head + (val << BUCKET_SHIFT);
+}
+
+static inline void bucket_insert(deflate_state *s, Pos *bucket, uint32_t str) {
+    memmove(bucket + 1, bucket, (BUCKET_WAYS - 1) * sizeof(Pos));
+    bucket[0] = POS_ENTRY(s, str);
+}
+
+/* ===========================================================================
+ * Return the length of the longest match for the string at strstart among
+ * the positions in bucket, and set match_start to it. A length less than
+ * BUCKET_BYTES means there was no match. The length may exceed lookahead.
+ */
+static inline unsigned bucket_match(deflate_state *s, const Pos *bucket) {
+    unsigned char *scan = s->window + s->strstart;
+    uint32_t scan_start, match_start;
+    unsigned best_len = 0, len, i;
+
+    memcpy(&scan_start, scan, sizeof(scan_start));
+    for (i = 0; i < BUCKET_WAYS; i++) {
+        uint32_t cur_match = POS_WINDOW(s, bucket[i]);
+
+        /* Empty entries are NIL, and entries put in head[] by insert_string()
+         * for a dictionary are only guaranteed to be in the past.
+         */
+        if (cur_match == NIL || s->strstart - cur_match > MAX_DIST(s))
+            continue;
+        memcpy(&match_start, s->window + cur_match, sizeof(match_start));
+        if (match_start != scan_start)
+            continue;
+        len = functable.compare258(scan, s->window + cur_match);
+        if (len > best_len) {
+            best_len = len;
+            s->match_start = cur_match;
+            if (len >= s->nice_match)
+                break;
+        }
+    }
+    return best_len;
+}
+
+/* ===========================================================================
+ * Compress as much as possible from the input stream, return the current
+ * block state. Like deflate_fast(), matches are taken as found and the
+ * strings inside a match are only inserted for matches up to
+ * max_insert_length.
+ */
+ZLIB_INTERNAL block_state deflate_bucket(deflate_state *s, int flush) {
+    Pos *bucket;
+    unsigned match_len, end;
+    int bflush;                 /* set if current block must be flushed */
+
+    for (;;) {
+        /* Make sure that we always have enough lookahead, except
+         * at the end of the input file. We need MAX_MATCH bytes
+         * for the next match, plus BUCKET_BYTES bytes to insert the
+         * string following the next match.
+         */
+        if (s->lookahead < MIN_LOOKAHEAD) {
+            functable.fill_window(s);
+            if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH) {
+                return need_more;
+            }
+            if (s->lookahead == 0)
+                break; /* flush the current block */
+        }
+
+        match_len = 0;
+        if (s->lookahead >= BUCKET_BYTES) {
+            Assert((uint64_t)s->strstart <= s->window_size-MIN_LOOKAHEAD, "need lookahead");
+            bucket = bucket_find(s, s->strstart);
+            match_len = bucket_match(s, bucket);
+            bucket_insert(s, bucket, s->strstart);
+            if (match_len > s->lookahead)
+                match_len = s->lookahead;
+        }
+
+        if (match_len >= BUCKET_BYTES) {
+            check_match(s, s->strstart, s->match_start, match_len);
+
+            zng_tr_tally_dist(s, s->strstart - s->match_start, match_len - MIN_MATCH, bflush);
+
+            s->lookahead -= match_len;
+            end = s->strstart + match_len;
+            if (match_len <= s->max_insert_length && s->lookahead >= BUCKET_BYTES) {
+                for (s->strstart++; s->strstart < end; s->strstart++)
+                    bucket_insert(s, bucket_find(s, s->strstart), s->strstart);
+            }
+            s->strstart = end;
+        } else {
+            /* No match, output a literal byte */
+            Tracevv((stderr, "%c", s->window[s->strstart]));
+            zng_tr_tally_lit(s, s->window[s->strstart], bflush);
+            s->lookahead--;
+            s->strstart++;
+        }
+        if (bflush)
+            FLUSH_BLOCK(s, 0);
+    }
+    /* Nothing is left for fill_window() to insert, it would use the hash chains */
+    s->insert = 0;
+    if (flush == Z_FINISH) {
+        FLUSH_BLOCK(s, 1);
+        return finish_done;
+    }
+    if (s->sym_next)
+        FLUSH_BLOCK(s, 0);
+    return block_done;
+}
+
+#endif
@@ -10,8 +10,8 @@
 #include "zbuild.h"
 #include "deflate.h"
 #include "deflate_p.h"
-#include "match_p.h"
 #include "functable.h"
+#include "zthread.h"
 
 struct match {
     unsigned int match_start;
@@ -65,7 +65,7 @@ static void insert_match(deflate_state *s, struct match match) {
 
             if (match.match_length) {
                 if (match.strstart >= match.orgstart) {
-                    functable.insert_string(s, match.strstart, 1);
+                    s->insert_string(s, match.strstart, 1);
                 }
             }
         }
@@ -75,9 +75,9 @@ static void insert_match(deflate_state *s, struct match match) {
         if (match.match_length > 0) {
             if (match.strstart >= match.orgstart) {
                 if (match.strstart + match.match_length - 1 >= match.orgstart) {
-                    functable.insert_string(s, match.strstart, match.match_length);
+                    s->insert_string(s, match.strstart, match.match_length);
                 } else {
-                    functable.insert_string(s, match.strstart, match.orgstart - match.strstart + 1);
+                    s->insert_string(s, match.strstart, match.orgstart - match.strstart + 1);
                 }
                 match.strstart += match.match_length;
                 match.match_length = 0;
@@ -96,7 +96,7 @@ static void insert_match(deflate_state *s, struct match match) {
 #ifdef NOT_TWEAK_COMPILER
         do {
             if (LIKELY(match.strstart >= match.orgstart)) {
-                functable.insert_string(s, match.strstart, 1);
+                s->insert_string(s, match.strstart, 1);
             }
             match.strstart++;
             /* strstart never exceeds WSIZE-MAX_MATCH, so there are
@@ -106,12 +106,12 @@ static void insert_match(deflate_state *s, struct match match) {
 #else
         if (LIKELY(match.strstart >= match.orgstart)) {
             if (LIKELY(match.strstart + match.match_length - 1 >= match.orgstart)) {
-                functable.insert_string(s, match.strstart, match.match_length);
+                s->insert_string(s, match.strstart, match.match_length);
             } else {
-                functable.insert_string(s, match.strstart, match.orgstart - match.strstart + 1);
+                s->insert_string(s, match.strstart, match.orgstart - match.strstart + 1);
             }
         } else if (match.orgstart < match.strstart + match.match_length) {
-            functable.insert_string(s, match.orgstart, match.strstart + match.match_length - match.orgstart);
+            s->insert_string(s, match.orgstart, match.strstart + match.match_length - match.orgstart);
         }
         match.strstart += match.match_length;
         match.match_length = 0;
@@ -122,9 +122,9 @@ static void insert_match(deflate_state *s, struct match match) {
         s->ins_h = s->window[match.strstart];
         if (match.strstart >= (MIN_MATCH - 2))
 #ifndef NOT_TWEAK_COMPILER
-            functable.insert_string(s, match.strstart + 2 - MIN_MATCH, MIN_MATCH - 2);
+            s->insert_string(s, match.strstart + 2 - MIN_MATCH, MIN_MATCH - 2);
 #else
-            functable.insert_string(s, match.strstart + 2 - MIN_MATCH, 1);
+            s->insert_string(s, match.strstart + 2 - MIN_MATCH, 1);
 #if MIN_MATCH != 3
 #warning    Call insert_string() MIN_MATCH-3 more times
 #endif
@@ -198,14 +198,317 @@ static void fizzle_matches(deflate_state *s, struct match *current, struct match
     }
 }
 
+/* ===========================================================================
+ * Set *current_match to the match at s->strstart, which is *next_match if one
+ * was found last time, and insert its strings in the hash table. Then look
+ * one match ahead into *next_match, which may shorten the current one. What
+ * is found does not depend on the emitted symbols, only on s->strstart and
+ * s->lookahead, which emit_match() leaves as they would be after the match.
+ */
+static void find_matches(deflate_state *s, struct match *current_match, struct match *next_match) {
+    IPos hash_head = 0;   /* head of the hash chain */
+
+    s->prev_length = 2;
+
+    /* Insert the string window[strstart .. strstart+2] in the
+     * dictionary, and set hash_head to the head of the hash chain:
+     */
+
+    /* If we already have a future match from a previous round, just use that */
+    if (next_match->match_length > 0) {
+        *current_match = *next_match;
+        next_match->match_length = 0;
+
+    } else {
+        hash_head = 0;
+        if (s->lookahead >= MIN_MATCH) {
+            hash_head = s->insert_string(s, s->strstart, 1);
+        }
+
+        /* set up the initial match to be a 1 byte literal */
+        current_match->match_start = 0;
+        current_match->match_length = 1;
+        current_match->strstart = s->strstart;
+        current_match->orgstart = current_match->strstart;
+
+        /* Find the longest match, discarding those <= prev_length.
+         * At this point we have always match_length < MIN_MATCH
+         */
+
+        if (hash_head != 0 && s->strstart - hash_head <= MAX_DIST2) {
+            /* To simplify the code, we prevent matches with the string
+             * of window index 0 (in particular we have to avoid a match
+             * of the string with itself at the start of the input file).
+             */
+            current_match->match_length = functable.longest_match(s, hash_head);
+            current_match->match_start = s->match_start;
+            if (current_match->match_length < MIN_MATCH)
+                current_match->match_length = 1;
+            if (current_match->match_start >= current_match->strstart) {
+                /* this can happen due to some restarts */
+                current_match->match_length = 1;
+            }
+        }
+    }
+
+    insert_match(s, *current_match);
+
+    /* now, look ahead one */
+    if (s->lookahead > MIN_LOOKAHEAD && (current_match->strstart + current_match->match_length) < (s->window_size - MIN_LOOKAHEAD)) {
+        s->strstart = current_match->strstart + current_match->match_length;
+        hash_head = s->insert_string(s, s->strstart, 1);
+
+        /* set up the initial match to be a 1 byte literal */
+        next_match->match_start = 0;
+        next_match->match_length = 1;
+        next_match->strstart = s->strstart;
+        next_match->orgstart = next_match->strstart;
+
+        /* Find the longest match, discarding those <= prev_length.
+         * At this point we have always match_length < MIN_MATCH
+         */
+        if (hash_head != 0 && s->strstart - hash_head <= MAX_DIST2) {
+            /* To simplify the code, we prevent matches with the string
+             * of window index 0 (in particular we have to avoid a match
+             * of the string with itself at the start of the input file).
+             */
+            next_match->match_length = functable.longest_match(s, hash_head);
+            next_match->match_start = s->match_start;
+            if (next_match->match_start >= next_match->strstart) {
+                /* this can happen due to some restarts */
+                next_match->match_length = 1;
+            }
+            if (next_match->match_length < MIN_MATCH)
+                next_match->match_length = 1;
+            else
+                fizzle_matches(s, current_match, next_match);
+        }
+
+        /* short matches with a very long distance are rarely a good idea encoding wise */
+        if (next_match->match_length == 3 && (next_match->strstart - next_match->match_start) > 12000)
+                next_match->match_length = 1;
+        s->strstart = current_match->strstart;
+
+    } else {
+        next_match->match_length = 0;
+    }
+}
+
+#ifdef Z_HAVE_THREADS
+/* ===========================================================================
+ * With Z_DEFLATE_PIPELINE, the matches are found by a helper thread while the
+ * calling thread emits them and writes the blocks. Each run of the helper
+ * covers what deflate_medium() would do between two calls of fill_window():
+ * it works on a copy of the state, shares the window and the hash table, and
+ * adds a record for each match to rec[], which the caller emits as they come.
+ * The window is only filled again once all of a run is emitted, and the
+ * caller never returns with the helper busy. If next_out fills up, the caller
+ * waits for the end of the run and keeps the records not emitted yet for the
+ * next call, so that the matches do not depend on the timing of the threads.
+ *
+ * A record is the match length in the low 16 bits, or one or two literals if
+ * less than MIN_MATCH, and the distance of a match in the high 16 bits.
+ */
+
+/* Runs shorter than this are not worth handing over to the helper */
+#define MEDIUM_PIPE_MIN 8192
+
+/* Records that the helper adds before publishing them */
+#define MEDIUM_PIPE_STEP 256
+
+struct pipe_state_s {
+    deflate_state fs;           /* copy of the state given to the helper for a run */
+    uint32_t *rec;              /* records of the run, window_size of them */
+    unsigned int have;          /* records published so far */
+    unsigned int next;          /* records emitted so far, only used by the caller */
+    int busy;                   /* true while the helper is on a run */
+    int quit;                   /* end the helper */
+    int started;                /* true once the helper thread is running */
+    z_thread_t tid;
+    z_mutex_t lock;
+    z_cond_t cond;              /* signals changes of have, busy and quit */
+};
+
+static void medium_pipe_run(pipe_state *p) {
+    deflate_state *s = &p->fs;
+    struct match current_match, next_match;
+    unsigned int n = 0;
+
+    memset(&current_match, 0, sizeof(struct match));
+    memset(&next_match, 0, sizeof(struct match));
+
+    while (s->lookahead >= MIN_LOOKAHEAD) {
+        find_matches(s, &current_match, &next_match);
+        p->rec[n++] = current_match.match_length < MIN_MATCH ? current_match.match_length :
+                      current_match.match_length | (current_match.strstart - current_match.match_start) << 16;
+
+        /* as emit_match() would leave them */
+        s->lookahead -= current_match.match_length;
+        s->strstart += current_match.match_length;
+
+        if (n % MEDIUM_PIPE_STEP == 0) {
+            z_mutex_lock(&p->lock);
+            p->have = n;
+            z_cond_broadcast(&p->cond);
+            z_mutex_unlock(&p->lock);
+        }
+    }
+
+    z_mutex_lock(&p->lock);
+    p->have = n;
+    p->busy = 0;
+    z_cond_broadcast(&p->cond);
+    z_mutex_unlock(&p->lock);
+}
+
+static void *medium_pipe_helper(void *arg) {
+    pipe_state *p = (pipe_state *)arg;
+
+    z_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->busy && !p->quit)
+            z_cond_wait(&p->cond, &p->lock);
+        if (p->quit)
+            break;
+        z_mutex_unlock(&p->lock);
+        medium_pipe_run(p);
+        z_mutex_lock(&p->lock);
+    }
+    z_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* Allocate the pipe_state of s, without starting the helper. Return NULL if
+ * out of memory.
+ */
+static pipe_state *medium_pipe_alloc(deflate_state *s) {
+    PREFIX3(stream) *strm = s->strm;
+    pipe_state *p;
+
+    p = (pipe_state *)ZALLOC(strm, 1, sizeof(pipe_state));
+    if (p == NULL)
+        return NULL;
+    p->rec = (uint32_t *)ZALLOC(strm, s->window_size, sizeof(uint32_t));
+    if (p->rec == NULL || z_mutex_init(&p->lock) != 0) {
+        if (p->rec != NULL)
+            ZFREE(strm, p->rec);
+        ZFREE(strm, p);
+        return NULL;
+    }
+    if (z_cond_init(&p->cond) != 0) {
+        z_mutex_destroy(&p->lock);
+        ZFREE(strm, p->rec);
+        ZFREE(strm, p);
+        return NULL;
+    }
+    p->have = p->next = 0;
+    p->busy = p->quit = p->started = 0;
+    s->medium_pipe = p;
+    return p;
+}
+
+/* Start a run of the helper from s->strstart, starting the helper itself the
+ * first time. Return false if the helper cannot be had.
+ */
+static int medium_pipe_start(deflate_state *s) {
+    pipe_state *p = s->medium_pipe;
+
+    if (p == NULL && (p = medium_pipe_alloc(s)) == NULL)
+        return 0;
+    if (!p->started) {
+        if (z_thread_create(&p->tid, medium_pipe_helper, p) != 0)
+            return 0;
+        p->started = 1;
+    }
+
+    memcpy(&p->fs, s, sizeof(deflate_state));
+    p->next = 0;
+    z_mutex_lock(&p->lock);
+    p->have = 0;
+    p->busy = 1;
+    z_cond_broadcast(&p->cond);
+    z_mutex_unlock(&p->lock);
+    return 1;
+}
+
+/* Emit the records of the run, as the helper publishes them if it is busy.
+ * Return true if next_out filled up, in which case the rest of the records
+ * wait for the next call.
+ */
+static int medium_pipe_emit(deflate_state *s) {
+    pipe_state *p = s->medium_pipe;
+    struct match match;
+    unsigned int have;
+    int busy, full = 0;
+
+    z_mutex_lock(&p->lock);
+    have = p->have;
+    busy = p->busy;
+    z_mutex_unlock(&p->lock);
+
+    for (;;) {
+        if (p->next == have) {
+            if (!busy)
+                break;
+            z_mutex_lock(&p->lock);
+            while (p->have == p->next && p->busy)
+                z_cond_wait(&p->cond, &p->lock);
+            have = p->have;
+            busy = p->busy;
+            z_mutex_unlock(&p->lock);
+            continue;
+        }
+
+        match.match_length = p->rec[p->next] & 0xffff;
+        match.strstart = s->strstart;
+        match.match_start = s->strstart - (p->rec[p->next] >> 16);
+        p->next++;
+        if (emit_match(s, match)) {
+            s->strstart += match.match_length;
+            FLUSH_BLOCK_ONLY(s, 0);
+            full = s->strm->avail_out == 0;
+            if (full)
+                break;
+        } else {
+            s->strstart += match.match_length;
+        }
+    }
+
+    if (busy) {
+        z_mutex_lock(&p->lock);
+        while (p->busy)
+            z_cond_wait(&p->cond, &p->lock);
+        z_mutex_unlock(&p->lock);
+    }
+    if (p->next == p->have) {
+        /* The run is over, and the state is where the helper left its copy */
+        Assert(s->strstart == p->fs.strstart && s->lookahead == p->fs.lookahead, "run out of step");
+        s->ins_h = p->fs.ins_h;
+        s->chain_cut = p->fs.chain_cut;
+        s->guard_searches = p->fs.guard_searches;
+        s->guard_steps = p->fs.guard_steps;
+#ifdef DEFLATE_STATS
+        s->stats.chain_steps = p->fs.stats.chain_steps;
+#endif
+    }
+    return full;
+}
+#endif /* Z_HAVE_THREADS */
+
 ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
     struct match current_match, next_match;
+#ifdef Z_HAVE_THREADS
+    int pipeline = s->pipeline;
+
+    /* Emit what is left of the last run first */
+    if (s->medium_pipe != NULL && s->medium_pipe->next != s->medium_pipe->have && medium_pipe_emit(s))
+        return need_more;
+#endif
 
     memset(&current_match, 0, sizeof(struct match));
     memset(&next_match, 0, sizeof(struct match));
 
     for (;;) {
-        IPos hash_head = 0;   /* head of the hash chain */
         int bflush;           /* set if current block must be flushed */
 
         /* Make sure that we always have enough lookahead, except
@@ -222,90 +525,22 @@ ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
                 break; /* flush the current block */
             next_match.match_length = 0;
         }
-        s->prev_length = 2;
 
-        /* Insert the string window[strstart .. strstart+2] in the
-         * dictionary, and set hash_head to the head of the hash chain:
+#ifdef Z_HAVE_THREADS
+        /* Hand the matches up to the next fill_window() over to the helper,
+         * which always starts without a next_match, as after fill_window()
          */
-
-        /* If we already have a future match from a previous round, just use that */
-        if (next_match.match_length > 0) {
-            current_match = next_match;
-            next_match.match_length = 0;
-
-        } else {
-            hash_head = 0;
-            if (s->lookahead >= MIN_MATCH) {
-                hash_head = functable.insert_string(s, s->strstart, 1);
-            }
-
-            /* set up the initial match to be a 1 byte literal */
-            current_match.match_start = 0;
-            current_match.match_length = 1;
-            current_match.strstart = s->strstart;
-            current_match.orgstart = current_match.strstart;
-
-            /* Find the longest match, discarding those <= prev_length.
-             * At this point we have always match_length < MIN_MATCH
-             */
-
-            if (hash_head != 0 && s->strstart - hash_head <= MAX_DIST2) {
-                /* To simplify the code, we prevent matches with the string
-                 * of window index 0 (in particular we have to avoid a match
-                 * of the string with itself at the start of the input file).
-                 */
-                current_match.match_length = longest_match(s, hash_head);
-                current_match.match_start = s->match_start;
-                if (current_match.match_length < MIN_MATCH)
-                    current_match.match_length = 1;
-                if (current_match.match_start >= current_match.strstart) {
-                    /* this can happen due to some restarts */
-                    current_match.match_length = 1;
-                }
+        if (pipeline && next_match.match_length == 0 && s->lookahead >= MEDIUM_PIPE_MIN) {
+            if (medium_pipe_start(s)) {
+                if (medium_pipe_emit(s))
+                    return need_more;
+                continue;
             }
+            pipeline = 0;
         }
+#endif
 
-        insert_match(s, current_match);
-
-        /* now, look ahead one */
-        if (s->lookahead > MIN_LOOKAHEAD && (current_match.strstart + current_match.match_length) < (s->window_size - MIN_LOOKAHEAD)) {
-            s->strstart = current_match.strstart + current_match.match_length;
-            hash_head = functable.insert_string(s, s->strstart, 1);
-
-            /* set up the initial match to be a 1 byte literal */
-            next_match.match_start = 0;
-            next_match.match_length = 1;
-            next_match.strstart = s->strstart;
-            next_match.orgstart = next_match.strstart;
-
-            /* Find the longest match, discarding those <= prev_length.
-             * At this point we have always match_length < MIN_MATCH
-             */
-            if (hash_head != 0 && s->strstart - hash_head <= MAX_DIST2) {
-                /* To simplify the code, we prevent matches with the string
-                 * of window index 0 (in particular we have to avoid a match
-                 * of the string with itself at the start of the input file).
-                 */
-                next_match.match_length = longest_match(s, hash_head);
-                next_match.match_start = s->match_start;
-                if (next_match.match_start >= next_match.strstart) {
-                    /* this can happen due to some restarts */
-                    next_match.match_length = 1;
-                }
-                if (next_match.match_length < MIN_MATCH)
-                    next_match.match_length = 1;
-                else
-                    fizzle_matches(s, &current_match, &next_match);
-            }
-
-            /* short matches with a very long distance are rarely a good idea encoding wise */
-            if (next_match.match_length == 3 && (next_match.strstart - next_match.match_start) > 12000)
-                    next_match.match_length = 1;
-            s->strstart = current_match.strstart;
-
-        } else {
-            next_match.match_length = 0;
-        }
+        find_matches(s, &current_match, &next_match);
 
         /* now emit the current match */
         bflush = emit_match(s, current_match);
@@ -326,4 +561,83 @@ ZLIB_INTERNAL block_state deflate_medium(deflate_state *s, int flush) {
 
     return block_done;
 }
+
+#ifdef Z_HAVE_THREADS
+/* ===========================================================================
+ * Drop the records of Z_DEFLATE_PIPELINE left for the next call, if any.
+ */
+void ZLIB_INTERNAL deflate_medium_reset(deflate_state *s) {
+    if (s->medium_pipe != NULL)
+        s->medium_pipe->next = s->medium_pipe->have = 0;
+}
+
+/* ===========================================================================
+ * Tell whether Z_DEFLATE_PIPELINE has records left for the next call.
+ */
+int ZLIB_INTERNAL deflate_medium_pending(deflate_state *s) {
+    return s->medium_pipe != NULL && s->medium_pipe->next != s->medium_pipe->have;
+}
+
+/* ===========================================================================
+ * Give the copy ds of ss the records that ss has left for the next call, if
+ * any. The copy starts a helper of its own when it needs one. Return Z_OK or
+ * Z_MEM_ERROR.
+ */
+int ZLIB_INTERNAL deflate_medium_copy(deflate_state *ds, deflate_state *ss) {
+    pipe_state *sp = ss->medium_pipe, *dp;
+
+    ds->medium_pipe = NULL;
+    if (sp == NULL || sp->next == sp->have)
+        return Z_OK;
+    dp = medium_pipe_alloc(ds);
+    if (dp == NULL)
+        return Z_MEM_ERROR;
+    memcpy(&dp->fs, &sp->fs, sizeof(deflate_state));
+    memcpy(dp->rec, sp->rec + sp->next, (sp->have - sp->next) * sizeof(uint32_t));
+    dp->have = sp->have - sp->next;
+    return Z_OK;
+}
+
+/* ===========================================================================
+ * End the helper of Z_DEFLATE_PIPELINE and free its memory, if any.
+ */
+void ZLIB_INTERNAL deflate_medium_end(deflate_state *s) {
+    PREFIX3(stream) *strm = s->strm;
+    pipe_state *p = s->medium_pipe;
+
+    if (p == NULL)
+        return;
+    if (p->started) {
+        z_mutex_lock(&p->lock);
+        p->quit = 1;
+        z_cond_broadcast(&p->cond);
+        z_mutex_unlock(&p->lock);
+        z_thread_join(p->tid);
+    }
+    z_cond_destroy(&p->cond);
+    z_mutex_destroy(&p->lock);
+    ZFREE(strm, p->rec);
+    ZFREE(strm, p);
+    s->medium_pipe = NULL;
+}
+#else
+void ZLIB_INTERNAL deflate_medium_reset(deflate_state *s) {
+    (void)s;
+}
+
+int ZLIB_INTERNAL deflate_medium_pending(deflate_state *s) {
+    (void)s;
+    return 0;
+}
+
+int ZLIB_INTERNAL deflate_medium_copy(deflate_state *ds, deflate_state *ss) {
+    (void)ss;
+    ds->medium_pipe = NULL;
+    return Z_OK;
+}
+
+void ZLIB_INTERNAL deflate_medium_end(deflate_state *s) {
+    (void)s;
+}
+#endif
 #endif
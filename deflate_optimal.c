@@ -0,0 +1,236 @@
+/* deflate_optimal.c -- compress data using near-optimal parsing
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Rather than taking matches greedily or with one step of lazy evaluation,
+ * the levels above 9 find the matches at every position of a segment of the
+ * input and then choose the cheapest way through it, as a shortest path over
+ * the positions where each literal and each match length is an edge costing
+ * its number of bits. The costs come from the Huffman code lengths that the
+ * current block would get, computed by zng_tr_costs() from the symbols of
+ * the previous parse, so parsing the same segment again with the new costs
+ * converges on a cheaper parse. max_lazy_match is the number of passes.
+ */
+
+#ifndef ZLIB_COMPAT
+
+#include "zbuild.h"
+#include "deflate.h"
+#include "deflate_p.h"
+#include "functable.h"
+
+/* ===========================================================================
+ * Insert the n strings at strstart and find their matches. Each position
+ * gets the matches that were longer than all nearer ones, up to the end of
+ * the segment, keeping the OPT_MATCHES longest. After a match of nice_match
+ * or more, the positions inside it are only inserted.
+ */
+static void opt_find_matches(deflate_state *s, opt_state *opt, unsigned n) {
+    unsigned char *window = s->window;
+    Pos *prev = s->prev;
+    unsigned int wmask = s->w_mask;
+    unsigned int i, skip = 0;
+
+    for (i = 0; i < n; i++) {
+        unsigned int str = s->strstart + i;
+        unsigned int limit = str > MAX_DIST(s) ? str - MAX_DIST(s) : NIL;
+        unsigned int max_len = n - i, best_len = MIN_MATCH-1, chain_length = s->max_chain_length;
+        unsigned int cur_match, len, count = 0;
+        unsigned char *scan = window + str;
+        opt_match *matches = opt->matches[i];
+
+        opt->nmatches[i] = 0;
+        if (s->lookahead - i < MIN_MATCH)
+            continue;
+        cur_match = s->insert_string(s, str, 1);
+        if (skip != 0) {
+            skip--;
+            continue;
+        }
+        if (max_len > MAX_MATCH)
+            max_len = MAX_MATCH;
+        if (max_len < MIN_MATCH)
+            continue;
+
+        while (cur_match > limit && chain_length-- != 0) {
+            unsigned char *match = window + cur_match;
+
+            Assert(cur_match < str, "no future");
+            STATS_ADD(s, chain_steps, 1);
+            if (match[best_len] == scan[best_len] && match[0] == scan[0] && match[1] == scan[1]) {
+                len = functable.compare258(scan, match);
+                if (len > max_len)
+                    len = max_len;
+                if (len > best_len) {
+                    if (count == OPT_MATCHES) {
+                        memmove(matches, matches + 1, (OPT_MATCHES - 1) * sizeof(opt_match));
+                        count--;
+                    }
+                    matches[count].len = (uint16_t)len;
+                    matches[count].dist = (uint16_t)(str - cur_match);
+                    count++;
+                    best_len = len;
+                    if (len >= (unsigned int)s->nice_match || len == max_len)
+                        break;
+                }
+            }
+            cur_match = POS_WINDOW(s, prev[cur_match & wmask]);
+        }
+        opt->nmatches[i] = (unsigned char)count;
+        if (best_len >= (unsigned int)s->nice_match)
+            skip = best_len - 1;
+    }
+}
+
+/* ===========================================================================
+ * Find the cheapest parse of the n positions at strstart with the current
+ * costs, and leave it in items from next_item on.
+ */
+static void opt_parse(deflate_state *s, opt_state *opt, unsigned n) {
+    const unsigned char *scan = s->window + s->strstart;
+    uint32_t *cost = opt->cost;
+    opt_match *path = opt->path;
+    unsigned int i, j, len, k;
+
+    cost[0] = 0;
+    for (i = 1; i <= n; i++)
+        cost[i] = UINT32_MAX;
+
+    for (i = 0; i < n; i++) {
+        uint32_t base = cost[i], c;
+
+        c = base + opt->lit_cost[scan[i]];
+        if (c < cost[i+1]) {
+            cost[i+1] = c;
+            path[i+1].len = 1;
+            path[i+1].dist = 0;
+        }
+
+        /* Each match also stands for the shorter lengths at its distance that
+         * no nearer match covers.
+         */
+        len = MIN_MATCH;
+        for (j = 0; j < opt->nmatches[i]; j++) {
+            const opt_match *m = &opt->matches[i][j];
+            uint32_t dist_cost = base + opt->dist_cost[d_code(m->dist - 1)];
+
+            for (; len <= m->len; len++) {
+                c = dist_cost + opt->len_cost[len - MIN_MATCH];
+                if (c < cost[i+len]) {
+                    cost[i+len] = c;
+                    path[i+len].len = (uint16_t)len;
+                    path[i+len].dist = m->dist;
+                }
+            }
+        }
+    }
+
+    /* Follow the cheapest steps back from the end */
+    k = OPT_SEGMENT;
+    for (i = n; i > 0; i -= path[i].len)
+        opt->items[--k] = path[i];
+    opt->next_item = k;
+}
+
+/* ===========================================================================
+ * Set the costs for the next pass from the symbols of the current parse.
+ */
+static void opt_update_costs(deflate_state *s, opt_state *opt) {
+    const unsigned char *scan = s->window + s->strstart;
+    unsigned int k;
+
+    memset(opt->lfreq, 0, sizeof(opt->lfreq));
+    memset(opt->dfreq, 0, sizeof(opt->dfreq));
+    for (k = opt->next_item; k < OPT_SEGMENT; k++) {
+        const opt_match *item = &opt->items[k];
+
+        if (item->dist == 0) {
+            opt->lfreq[*scan]++;
+        } else {
+            opt->lfreq[zng_length_code[item->len - MIN_MATCH] + LITERALS + 1]++;
+            opt->dfreq[d_code(item->dist - 1)]++;
+        }
+        scan += item->len;
+    }
+    zng_tr_costs(s, opt->lfreq, opt->dfreq, opt->lit_cost, opt->len_cost, opt->dist_cost);
+    opt->have_costs = 1;
+}
+
+/* ===========================================================================
+ * Compress as much as possible from the input stream, return the current
+ * block state.
+ */
+ZLIB_INTERNAL block_state deflate_optimal(deflate_state *s, int flush) {
+    opt_state *opt = s->opt;
+    unsigned int n, pass, passes;
+    int bflush = 0;             /* set if current block must be flushed */
+
+    passes = s->max_lazy_match;
+    if (passes < 1)
+        passes = 1;
+    else if (passes > OPT_MAX_PASSES)
+        passes = OPT_MAX_PASSES;
+
+    for (;;) {
+        /* Send what is left of the last parse */
+        while (opt->next_item < OPT_SEGMENT) {
+            const opt_match *item = &opt->items[opt->next_item++];
+
+            if (item->dist == 0) {
+                Tracevv((stderr, "%c", s->window[s->strstart]));
+                zng_tr_tally_lit(s, s->window[s->strstart], bflush);
+            } else {
+                check_match(s, s->strstart, s->strstart - item->dist, item->len);
+                zng_tr_tally_dist(s, item->dist, item->len - MIN_MATCH, bflush);
+            }
+            s->strstart += item->len;
+            s->lookahead -= item->len;
+            if (bflush)
+                FLUSH_BLOCK(s, 0);
+        }
+
+        /* Make sure that we always have enough lookahead, except
+         * at the end of the input file.
+         */
+        if (s->lookahead < MIN_LOOKAHEAD) {
+            functable.fill_window(s);
+            if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH) {
+                return need_more;
+            }
+            if (s->lookahead == 0)
+                break; /* flush the current block */
+        }
+
+        /* Leave MAX_MATCH bytes to look ahead into unless this is the end
+         * of the input, and keep the compares of the segment in the window.
+         * After fill_window(), there is room for at least MIN_LOOKAHEAD -
+         * MAX_MATCH positions.
+         */
+        n = s->lookahead;
+        if (flush == Z_NO_FLUSH)
+            n -= MAX_MATCH;
+        if (n > OPT_SEGMENT)
+            n = OPT_SEGMENT;
+        if (n > s->window_size - MAX_MATCH - s->strstart)
+            n = (unsigned int)(s->window_size - MAX_MATCH - s->strstart);
+        Assert(n > 0, "empty segment");
+
+        opt_find_matches(s, opt, n);
+        if (!opt->have_costs)
+            zng_tr_costs(s, NULL, NULL, opt->lit_cost, opt->len_cost, opt->dist_cost);
+        for (pass = 0; pass < passes; pass++) {
+            if (pass != 0)
+                opt_update_costs(s, opt);
+            opt_parse(s, opt, n);
+        }
+    }
+    s->insert = s->strstart < MIN_MATCH-1 ? s->strstart : MIN_MATCH-1;
+    if (flush == Z_FINISH) {
+        FLUSH_BLOCK(s, 1);
+        return finish_done;
+    }
+    if (s->sym_next)
+        FLUSH_BLOCK(s, 0);
+    return block_done;
+}
+
+#endif
@@ -35,11 +35,11 @@ static inline Pos insert_string_c(deflate_state *const s, const Pos str, unsigne
         UPDATE_HASH(s, s->ins_h, str+idx);
 
         Pos head = s->head[s->ins_h];
-        if (head != str+idx) {
+        if (head != POS_ENTRY(s, str+idx)) {
           s->prev[(str+idx) & s->w_mask] = head;
-          s->head[s->ins_h] = str+idx;
+          s->head[s->ins_h] = POS_ENTRY(s, str+idx);
           if (idx == count - 1)
-            ret = head;
+            ret = POS_WINDOW(s, head);
         } else if (idx == count - 1) {
           ret = str + idx;
         }
@@ -47,6 +47,144 @@ static inline Pos insert_string_c(deflate_state *const s, const Pos str, unsigne
     return ret;
 }
 
+/* ===========================================================================
+ * Insert the count strings starting at str, whose hash values are in hashes,
+ * and return the previous head of the chain of the last one. The hash
+ * functions that depend on the string alone hash a batch of INSERT_BATCH
+ * strings into hashes before inserting them: the window bytes they read may
+ * alias the stores to head[] and prev[] as far as the compiler knows, so
+ * hashing each string just before its stores would keep the hashes of a run
+ * from overlapping each other.
+ */
+#define INSERT_BATCH 16
+
+static inline Pos insert_hashed(deflate_state *const s, const Pos str, const unsigned int *hashes,
+                                unsigned int count) {
+    Pos ret = 0;
+    unsigned int idx;
+
+#ifdef CHAIN_PREFETCH
+    /* The entries of the batch are all known before the first is updated */
+    for (idx = 1; idx < count; idx++)
+        CHAIN_PREFETCH(s->head + hashes[idx]);
+#endif
+    for (idx = 0; idx < count; idx++) {
+        Pos head = s->head[hashes[idx]];
+        if (head != POS_ENTRY(s, str+idx)) {
+            s->prev[(str+idx) & s->w_mask] = head;
+            s->head[hashes[idx]] = POS_ENTRY(s, str+idx);
+            if (idx == count - 1)
+                ret = POS_WINDOW(s, head);
+        } else if (idx == count - 1) {
+            ret = str + idx;
+        }
+    }
+    return ret;
+}
+
+/* ===========================================================================
+ * Clear the hash table entries of the count strings starting at str, by
+ * hashing them the same way as insert_string_c(). The rolling hash of a
+ * string depends on the strings inserted before it, so without a hash that
+ * only depends on the string itself the whole table is cleared.
+ */
+static inline void clear_hash_c(deflate_state *const s, const Pos str, unsigned int count) {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386) || defined(_M_IX86)
+    unsigned int idx, h;
+
+    for (idx = 0; idx < count; idx++) {
+        UPDATE_HASH(s, h, str+idx);
+        s->head[h] = 0;
+    }
+#else
+    (void)str;
+    (void)count;
+    memset(s->head, 0, s->hash_size * sizeof(*s->head));
+#endif
+}
+
+/* ===========================================================================
+ * Multiplicative hash of the string at str: its bytes as a little-endian
+ * number times the 32-bit golden ratio, of which the top hash_bits bits are
+ * the best mixed.
+ */
+#define HASH_MUL_GOLDEN 2654435761U
+
+static inline unsigned int hash_mul(deflate_state *const s, const Pos str) {
+    const unsigned char *p = s->window + str;
+    uint32_t val, h;
+
+    val = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+    if (HASH_BYTES(s) != 3)
+        val |= (uint32_t)p[3] << 24;
+    h = val * HASH_MUL_GOLDEN;
+    if (HASH_BYTES(s) == 5)
+        h = (h ^ p[4]) * HASH_MUL_GOLDEN;
+    return h >> (32 - s->hash_bits);
+}
+
+/* ===========================================================================
+ * Insert the count strings starting at str with the multiplicative hash, as
+ * insert_string_c() does with its own. The batch of hashes is a plain loop
+ * of loads, multiplies and shifts, which compilers can vectorize.
+ */
+static inline Pos insert_string_mul(deflate_state *const s, const Pos str, unsigned int count) {
+    unsigned int hashes[INSERT_BATCH];
+    Pos ret = 0;
+    unsigned int idx, i, n;
+
+    if (count == 1) {
+        hashes[0] = hash_mul(s, str);
+        return insert_hashed(s, str, hashes, 1);
+    }
+    for (idx = 0; idx < count; idx += n) {
+        n = count - idx < INSERT_BATCH ? count - idx : INSERT_BATCH;
+        for (i = 0; i < n; i++)
+            hashes[i] = hash_mul(s, str+idx+i);
+        ret = insert_hashed(s, str+idx, hashes, n);
+    }
+    return ret;
+}
+
+static inline void clear_hash_mul(deflate_state *const s, const Pos str, unsigned int count) {
+    unsigned int idx;
+
+    for (idx = 0; idx < count; idx++)
+        s->head[hash_mul(s, str+idx)] = 0;
+}
+
+/* ===========================================================================
+ * Insert the count strings starting at str with the rolling hash of zlib,
+ * which adds the last byte of each string to ins_h and so always covers
+ * MIN_MATCH bytes, whatever hash_bytes asks for.
+ */
+static inline Pos insert_string_roll(deflate_state *const s, const Pos str, unsigned int count) {
+    Pos ret = 0;
+    unsigned int idx;
+
+    for (idx = 0; idx < count; idx++) {
+        s->ins_h = ((s->ins_h << s->hash_shift) ^ s->window[str+idx + (MIN_MATCH-1)]) & s->hash_mask;
+        Pos head = s->head[s->ins_h];
+        if (head != POS_ENTRY(s, str+idx)) {
+            s->prev[(str+idx) & s->w_mask] = head;
+            s->head[s->ins_h] = POS_ENTRY(s, str+idx);
+            if (idx == count - 1)
+                ret = POS_WINDOW(s, head);
+        } else if (idx == count - 1) {
+            ret = str + idx;
+        }
+    }
+    return ret;
+}
+
+/* The hash of a string depends on the strings inserted before it, so the
+   whole table is cleared */
+static inline void clear_hash_roll(deflate_state *const s, const Pos str, unsigned int count) {
+    (void)str;
+    (void)count;
+    memset(s->head, 0, s->hash_size * sizeof(*s->head));
+}
+
 /* ===========================================================================
  * Flush the current block, with given end-of-file flag.
  * IN assertion: strstart is set to the end of the current match.
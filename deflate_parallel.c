@@ -0,0 +1,382 @@
+/* deflate_parallel.c -- compress a buffer using several threads
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * The input is cut into fixed-size chunks which are compressed independently
+ * as raw deflate data, each by its own deflate_state.  Every chunk but the
+ * first is primed with the last window of the preceding input as a preset
+ * dictionary, so that matches may still reach back across chunk boundaries.
+ * Every chunk but the last ends with a sync flush, which leaves it on a byte
+ * boundary with no final block, so the chunks simply concatenate into one
+ * deflate stream.  The per-chunk check values are joined with the combine
+ * functions and the stream is wrapped in a zlib or gzip header and trailer.
+ *
+ * Since the chunk boundaries depend only on the chunk size and never on the
+ * number of threads, the output is the same for any thread count.
+ */
+
+#ifndef ZLIB_COMPAT
+
+#include "zbuild.h"
+#include "deflate.h"
+#include "zthread.h"
+
+/* ===========================================================================
+ *  Architecture-specific hooks, as in deflate.c.
+ */
+#ifdef S390_DFLTCC_DEFLATE
+#  include "arch/s390/dfltcc_deflate.h"
+#else
+/* Returns whether zlib-ng should compute a checksum. Set to 0 if arch-specific deflation code already does that. */
+#  define DEFLATE_NEED_CHECKSUM(strm) 1
+/* Chunk size of zng_deflateParallel() when none is given. */
+#  define DEFLATE_PARALLEL_CHUNK (128*1024)
+#endif
+
+typedef struct {
+    const unsigned char *in;    /* chunk input */
+    unsigned int in_len;        /* chunk input length */
+    const unsigned char *dict;  /* preceding input used as dictionary */
+    unsigned int dict_len;      /* length of the dictionary, up to w_size */
+    unsigned char *out;         /* compressed output */
+    unsigned int out_size;      /* size of the output buffer */
+    unsigned int out_len;       /* length of the compressed output */
+    uint32_t check;             /* crc32 or adler32 of the chunk input */
+    int last;                   /* true for the final chunk */
+    int err;                    /* result of compressing this chunk */
+#ifdef DEFLATE_STATS
+    deflate_stats stats;        /* statistics of the chunk's stream */
+#endif
+} parallel_chunk;
+
+typedef struct {
+    zng_stream *strm;           /* parent stream, for settings and allocation */
+    parallel_chunk *chunks;
+    unsigned int count;         /* number of chunks */
+    unsigned int first;         /* first chunk handled by this worker */
+    unsigned int stride;        /* distance between chunks of this worker */
+    int mem_level;
+} parallel_job;
+
+/* ===========================================================================
+ * Compress one chunk as raw deflate data with the parent stream's settings.
+ */
+static int parallel_deflate_chunk(zng_stream *parent, int mem_level, parallel_chunk *c) {
+    deflate_state *s = parent->state;
+    zng_stream strm;
+    uint32_t adler;
+    int err, hw_check;
+
+    strm.zalloc = parent->zalloc;
+    strm.zfree = parent->zfree;
+    strm.opaque = parent->opaque;
+
+    err = zng_deflateInit2(&strm, s->level, Z_DEFLATED, -(int)s->w_bits, mem_level, s->strategy);
+    if (err == Z_OK && strm.state->lit_bufsize != s->lit_bufsize) {
+        int lit_bufsize = (int)s->lit_bufsize;
+        zng_deflate_param_value param = { Z_DEFLATE_LIT_BUFSIZE, &lit_bufsize, sizeof(lit_bufsize), Z_OK };
+        err = zng_deflateSetParams(&strm, &param, 1);
+        if (err != Z_OK)
+            zng_deflateEnd(&strm);
+    }
+    if (err != Z_OK)
+        return err;
+    strm.state->reproducible = s->reproducible;
+    strm.state->block_split = s->block_split;
+    strm.state->good_match = s->good_match;
+    strm.state->max_lazy_match = s->max_lazy_match;
+    strm.state->nice_match = s->nice_match;
+    strm.state->max_chain_length = s->max_chain_length;
+    strm.state->search = s->search;
+
+    if (c->dict_len != 0) {
+        err = zng_deflateSetDictionary(&strm, c->dict, c->dict_len);
+        if (err != Z_OK) {
+            zng_deflateEnd(&strm);
+            return err;
+        }
+    }
+
+    strm.next_in = c->in;
+    strm.avail_in = c->in_len;
+    strm.next_out = c->out;
+    strm.avail_out = c->out_size;
+
+    do {
+        err = zng_deflate(&strm, c->last ? Z_FINISH : Z_SYNC_FLUSH);
+    } while (err == Z_OK && strm.avail_out != 0 && (c->last || strm.avail_in != 0));
+
+    if (c->last ? err != Z_STREAM_END : (err != Z_OK || strm.avail_in != 0 || strm.avail_out == 0))
+        err = err < 0 ? err : Z_BUF_ERROR;
+    else
+        err = Z_OK;
+
+    c->out_len = c->out_size - strm.avail_out;
+#ifdef DEFLATE_STATS
+    c->stats = strm.state->stats;
+#endif
+    /* Where the hardware compressed the chunk, it also took the Adler-32 of it on the way */
+    hw_check = !DEFLATE_NEED_CHECKSUM(&strm);
+    adler = (uint32_t)strm.adler;
+    zng_deflateEnd(&strm);
+    if (err != Z_OK)
+        return err;
+
+    if (s->wrap == 1)
+        c->check = hw_check ? adler : zng_adler32_z(1, c->in, c->in_len);
+#ifdef GZIP
+    else if (s->wrap == 2)
+        c->check = zng_crc32_z(0, c->in, c->in_len);
+#endif
+    return Z_OK;
+}
+
+static void *parallel_worker(void *arg) {
+    parallel_job *job = (parallel_job *)arg;
+    unsigned int i;
+
+    for (i = job->first; i < job->count; i += job->stride) {
+        parallel_chunk *c = &job->chunks[i];
+        c->err = parallel_deflate_chunk(job->strm, job->mem_level, c);
+    }
+    return NULL;
+}
+
+/* ===========================================================================
+ * Write the zlib or gzip header for the joined stream.
+ */
+static unsigned int parallel_header(deflate_state *s, unsigned char *buf) {
+    unsigned int n = 0;
+
+#ifdef GZIP
+    if (s->wrap == 2) {
+        buf[n++] = 31;
+        buf[n++] = 139;
+        buf[n++] = 8;
+        buf[n++] = 0;
+        buf[n++] = 0;
+        buf[n++] = 0;
+        buf[n++] = 0;
+        buf[n++] = 0;
+        buf[n++] = s->level >= 9 ? 2 : (s->strategy >= Z_HUFFMAN_ONLY || s->level < 2 ? 4 : 0);
+        buf[n++] = OS_CODE;
+    } else
+#endif
+    if (s->wrap == 1) {
+        unsigned int header = (Z_DEFLATED + ((s->w_bits-8)<<4)) << 8;
+        unsigned int level_flags;
+
+        if (s->strategy >= Z_HUFFMAN_ONLY || s->level < 2)
+            level_flags = 0;
+        else if (s->level < 6)
+            level_flags = 1;
+        else if (s->level == 6)
+            level_flags = 2;
+        else
+            level_flags = 3;
+        header |= (level_flags << 6);
+        header += 31 - (header % 31);
+
+        buf[n++] = (unsigned char)(header >> 8);
+        buf[n++] = (unsigned char)(header & 0xff);
+    }
+    return n;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_deflateParallel(zng_stream *strm, int threads, size_t chunk_size) {
+    deflate_state *s;
+    parallel_chunk *chunks;
+    parallel_job *jobs;
+    unsigned char *out;
+    unsigned char header[10];
+    unsigned int count, i, hlen, tlen;
+    unsigned long total;
+    uint32_t check;
+    int mem_level, err;
+
+    if (strm == NULL || strm->zalloc == NULL || strm->zfree == NULL || strm->state == NULL)
+        return Z_STREAM_ERROR;
+    s = strm->state;
+    if (s->strm != strm || threads < 1)
+        return Z_STREAM_ERROR;
+
+    /* Only a fresh stream without a preset dictionary can be split up */
+    if ((s->status != INIT_STATE && s->status != GZIP_STATE) || strm->total_in != 0 || s->strstart != 0)
+        return Z_STREAM_ERROR;
+    if (strm->next_out == NULL || (strm->avail_in != 0 && strm->next_in == NULL))
+        ERR_RETURN(strm, Z_STREAM_ERROR);
+
+    if (chunk_size == 0)
+        chunk_size = DEFLATE_PARALLEL_CHUNK;
+    if (chunk_size < s->w_size)
+        chunk_size = s->w_size;
+    if (chunk_size > (1U << 30))
+        chunk_size = 1U << 30;
+
+    /* A single chunk or a custom gzip header gains nothing from splitting */
+    if (strm->avail_in <= chunk_size
+#ifdef GZIP
+        || s->gzhead != NULL
+#endif
+        )
+        return zng_deflate(strm, Z_FINISH);
+
+    count = (unsigned int)((strm->avail_in + chunk_size - 1) / chunk_size);
+    if ((unsigned int)threads > count)
+        threads = (int)count;
+
+    mem_level = 0;
+    while ((1UL << (mem_level + 6)) < s->lit_bufsize && mem_level < MAX_MEM_LEVEL)
+        mem_level++;
+
+    chunks = (parallel_chunk *)ZALLOC(strm, count, sizeof(parallel_chunk));
+    jobs = (parallel_job *)ZALLOC(strm, (unsigned int)threads, sizeof(parallel_job));
+    if (chunks == NULL || jobs == NULL) {
+        TRY_FREE(strm, chunks);
+        TRY_FREE(strm, jobs);
+        ERR_RETURN(strm, Z_MEM_ERROR);
+    }
+    memset(chunks, 0, count * sizeof(parallel_chunk));
+
+    err = Z_OK;
+    for (i = 0; i < count; i++) {
+        parallel_chunk *c = &chunks[i];
+        size_t start = (size_t)i * chunk_size;
+        size_t len = strm->avail_in - start;
+
+        if (len > chunk_size)
+            len = chunk_size;
+        c->in = strm->next_in + start;
+        c->in_len = (unsigned int)len;
+        c->dict_len = (unsigned int)(start < s->w_size ? start : s->w_size);
+        c->dict = c->in - c->dict_len;
+        c->last = i == count - 1;
+        /* Worst case of stored blocks plus the sync flush marker */
+        c->out_size = (unsigned int)(len + ((len + 7) >> 3) + ((len + 63) >> 6) + 5 + 16);
+        c->out = (unsigned char *)ZALLOC(strm, c->out_size, 1);
+        if (c->out == NULL) {
+            err = Z_MEM_ERROR;
+            break;
+        }
+    }
+
+    if (err == Z_OK) {
+        unsigned int started = 0;
+#ifdef Z_HAVE_THREADS
+        z_thread_t *tids = NULL;
+
+        if (threads > 1)
+            tids = (z_thread_t *)ZALLOC(strm, (unsigned int)threads - 1, sizeof(z_thread_t));
+#endif
+        for (i = 0; i < (unsigned int)threads; i++) {
+            jobs[i].strm = strm;
+            jobs[i].chunks = chunks;
+            jobs[i].count = count;
+            jobs[i].first = i;
+            jobs[i].stride = (unsigned int)threads;
+            jobs[i].mem_level = mem_level;
+        }
+#ifdef Z_HAVE_THREADS
+        /* Worker 0 runs on the calling thread */
+        if (tids != NULL) {
+            for (started = 0; started < (unsigned int)threads - 1; started++) {
+                if (z_thread_create(&tids[started], parallel_worker, &jobs[started + 1]) != 0)
+                    break;
+            }
+        }
+#endif
+        parallel_worker(&jobs[0]);
+#ifdef Z_HAVE_THREADS
+        for (i = 0; i < started; i++)
+            z_thread_join(tids[i]);
+        TRY_FREE(strm, tids);
+#endif
+        /* Whatever could not be handed to a thread is done here */
+        for (i = started + 1; i < (unsigned int)threads; i++)
+            parallel_worker(&jobs[i]);
+
+        for (i = 0; i < count && err == Z_OK; i++)
+            err = chunks[i].err;
+    }
+
+    if (err == Z_OK) {
+        hlen = parallel_header(s, header);
+        tlen = s->wrap == 2 ? 8 : s->wrap == 1 ? 4 : 0;
+        total = hlen + tlen;
+        for (i = 0; i < count; i++)
+            total += chunks[i].out_len;
+
+        /* Leave the stream untouched if the joined result does not fit */
+        if (total > strm->avail_out)
+            err = Z_BUF_ERROR;
+    }
+
+    if (err == Z_OK) {
+        out = strm->next_out;
+        memcpy(out, header, hlen);
+        out += hlen;
+
+        check = chunks[0].check;
+        memcpy(out, chunks[0].out, chunks[0].out_len);
+        out += chunks[0].out_len;
+        for (i = 1; i < count; i++) {
+            if (s->wrap == 1)
+                check = zng_adler32_combine64(check, chunks[i].check, (z_off64_t)chunks[i].in_len);
+#ifdef GZIP
+            else if (s->wrap == 2)
+                check = zng_crc32_combine64(check, chunks[i].check, (z_off64_t)chunks[i].in_len);
+#endif
+            memcpy(out, chunks[i].out, chunks[i].out_len);
+            out += chunks[i].out_len;
+        }
+#ifdef DEFLATE_STATS
+        for (i = 0; i < count; i++)
+            deflate_stats_add(&s->stats, &chunks[i].stats);
+#endif
+
+#ifdef GZIP
+        if (s->wrap == 2) {
+            uint32_t isize = strm->avail_in;
+
+            *out++ = (unsigned char)(check & 0xff);
+            *out++ = (unsigned char)((check >> 8) & 0xff);
+            *out++ = (unsigned char)((check >> 16) & 0xff);
+            *out++ = (unsigned char)((check >> 24) & 0xff);
+            *out++ = (unsigned char)(isize & 0xff);
+            *out++ = (unsigned char)((isize >> 8) & 0xff);
+            *out++ = (unsigned char)((isize >> 16) & 0xff);
+            *out++ = (unsigned char)((isize >> 24) & 0xff);
+        } else
+#endif
+        if (s->wrap == 1) {
+            *out++ = (unsigned char)(check >> 24);
+            *out++ = (unsigned char)((check >> 16) & 0xff);
+            *out++ = (unsigned char)((check >> 8) & 0xff);
+            *out++ = (unsigned char)(check & 0xff);
+        }
+
+        strm->next_in += strm->avail_in;
+        strm->total_in += strm->avail_in;
+        strm->avail_in = 0;
+        strm->next_out += total;
+        strm->avail_out -= (unsigned int)total;
+        strm->total_out += total;
+        strm->adler = check;
+
+        s->status = FINISH_STATE;
+        s->last_flush = Z_FINISH;
+        if (s->wrap > 0)
+            s->wrap = -s->wrap;
+    }
+
+    for (i = 0; i < count; i++)
+        TRY_FREE(strm, chunks[i].out);
+    ZFREE(strm, chunks);
+    ZFREE(strm, jobs);
+
+    if (err != Z_OK)
+        ERR_RETURN(strm, err);
+    return Z_STREAM_END;
+}
+
+#endif /* !ZLIB_COMPAT */
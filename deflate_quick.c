@@ -17,144 +17,45 @@
  * For conditions of distribution and use, see copyright notice in zlib.h
  */
 
-#include "../../zbuild.h"
-#include <immintrin.h>
-#ifdef _MSC_VER
+#include "zbuild.h"
+#if defined(X86_QUICK_STRATEGY) && defined(_MSC_VER)
 #  include <nmmintrin.h>
+#elif defined(ARM_QUICK_STRATEGY) && defined(__ARM_FEATURE_CRC32)
+#  include <arm_acle.h>
 #endif
-#include "../../deflate.h"
-#include "../../memcopy.h"
+#include "deflate.h"
+#include "deflate_p.h"
+#include "memcopy.h"
+#include "functable.h"
+
+#ifdef QUICK_STRATEGY
 
 #ifdef ZLIB_DEBUG
 #  include <ctype.h>
 #endif
 
-extern void fill_window_sse(deflate_state *s);
 extern void flush_pending(PREFIX3(stream) *strm);
 
-static inline long compare258(const unsigned char *const src0, const unsigned char *const src1) {
-#ifdef _MSC_VER
-    long cnt;
-
-    cnt = 0;
-    do {
-#define mode  _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY
-
-        int ret;
-        __m128i xmm_src0, xmm_src1;
-
-        xmm_src0 = _mm_loadu_si128((__m128i *)(src0 + cnt));
-        xmm_src1 = _mm_loadu_si128((__m128i *)(src1 + cnt));
-        ret = _mm_cmpestri(xmm_src0, 16, xmm_src1, 16, mode);
-        if (_mm_cmpestrc(xmm_src0, 16, xmm_src1, 16, mode)) {
-            cnt += ret;
-            break;
-        }
-        cnt += 16;
-
-        xmm_src0 = _mm_loadu_si128((__m128i *)(src0 + cnt));
-        xmm_src1 = _mm_loadu_si128((__m128i *)(src1 + cnt));
-        ret = _mm_cmpestri(xmm_src0, 16, xmm_src1, 16, mode);
-        if (_mm_cmpestrc(xmm_src0, 16, xmm_src1, 16, mode)) {
-            cnt += ret;
-            break;
-        }
-        cnt += 16;
-    } while (cnt < 256);
-
-    if (memcmp(src0 + cnt, src1 + cnt, sizeof(uint16_t)) == 0) {
-        cnt += 2;
-    } else if (*(src0 + cnt) == *(src1 + cnt)) {
-        cnt++;
-    }
-    return cnt;
-#else
-    uintptr_t ax, dx, cx;
-    __m128i xmm_src0;
-
-    ax = 16;
-    dx = 16;
-    /* set cx to something, otherwise gcc thinks it's used
-       uninitalised */
-    cx = 0;
-
-    __asm__ __volatile__ (
-    "1:"
-        "movdqu     -16(%[src0], %[ax]), %[xmm_src0]\n\t"
-        "pcmpestri  $0x18, -16(%[src1], %[ax]), %[xmm_src0]\n\t"
-        "jc         2f\n\t"
-        "add        $16, %[ax]\n\t"
-
-        "movdqu     -16(%[src0], %[ax]), %[xmm_src0]\n\t"
-        "pcmpestri  $0x18, -16(%[src1], %[ax]), %[xmm_src0]\n\t"
-        "jc         2f\n\t"
-        "add        $16, %[ax]\n\t"
-
-        "cmp        $256 + 16, %[ax]\n\t"
-        "jb         1b\n\t"
-
-# if !defined(__x86_64__)
-        "movzwl     -16(%[src0], %[ax]), %[dx]\n\t"
-# else
-        "movzwq     -16(%[src0], %[ax]), %[dx]\n\t"
-# endif
-        "xorw       -16(%[src1], %[ax]), %%dx\n\t"
-        "jnz        3f\n\t"
-
-        "add        $2, %[ax]\n\t"
-        "jmp        4f\n\t"
-    "3:\n\t"
-        "rep; bsf   %[dx], %[cx]\n\t"
-        "shr        $3, %[cx]\n\t"
-    "2:"
-        "add        %[cx], %[ax]\n\t"
-    "4:"
-    : [ax] "+a" (ax),
-      [cx] "+c" (cx),
-      [dx] "+d" (dx),
-      [xmm_src0] "=x" (xmm_src0)
-    : [src0] "r" (src0),
-      [src1] "r" (src1)
-    : "cc"
-    );
-    return ax - 16;
-#endif
-}
-
 static const unsigned quick_len_codes[MAX_MATCH-MIN_MATCH+1];
 static const unsigned quick_dist_codes[8192];
 
 static inline void quick_send_bits(deflate_state *const s,
-                                   const int value1, const int length1,
-                                   const int value2, const int length2) {
-    unsigned offset2 = s->bi_valid + length1;
-    unsigned width = s->bi_valid + length1 + length2;
-    unsigned bytes_out = width / 8;
+                                   const uint32_t value1, const uint32_t length1,
+                                   const uint32_t value2, const uint32_t length2) {
+    uint64_t value = (uint64_t)value1 | ((uint64_t)value2 << length1);
+    uint32_t width = (uint32_t)s->bi_valid + length1 + length2;
 
     /* Concatenate the new bits with the bits currently in the buffer */
-    unsigned out = s->bi_buf | (value1 << s->bi_valid);
-    if (width < 32) {
-      out |= (value2 << offset2);
-      /* Shift out the valid LSBs written out. */
-      s->bi_buf = out >> (bytes_out * 8);
-    } else /* width => 32 */ {
-      unsigned bits_that_fit = 32 - offset2;
-      unsigned mask = (1 << bits_that_fit) - 1;
-      /* Zero out the high bits of value2 such that the shift by offset2 will
-         not cause undefined behavior. */
-      out |= ((value2 & mask) << offset2);
-
-      /* Save in s->bi_buf the bits of value2 that do not fit: they will be
-         written in a next full byte. */
-      s->bi_buf = (width == 32) ? 0 : value2 >> bits_that_fit;
+    s->bi_buf |= value << s->bi_valid;
+    if (width >= Buf_size) {
+      /* The buffer is full, write it out and keep in it the bits of value
+         that did not fit. bi_valid is not 0 here, as the codes take at most
+         31 bits. */
+      put_uint64(s, s->bi_buf);
+      s->bi_buf = value >> (Buf_size - s->bi_valid);
+      width -= Buf_size;
     }
-
-    s->bi_valid = width - (bytes_out * 8);
-
-    /* Taking advantage of the fact that LSB comes first, write to output buffer */
-    memcpy(s->pending_buf + s->pending, &out, sizeof(out));
-
-    s->pending += bytes_out;
+    s->bi_valid = (int)width;
 }
 
 static inline void static_emit_ptr(deflate_state *const s, const int lc, const unsigned dist) {
@@ -163,12 +64,15 @@ static inline void static_emit_ptr(deflate_state *const s, const int lc, const u
     unsigned code2 = quick_dist_codes[dist-1] >> 8;
     unsigned len2  = quick_dist_codes[dist-1] & 0xFF;
     quick_send_bits(s, code1, len1, code2, len2);
+    STATS_ADD(s, matches, 1);
+    STATS_ADD(s, match_bytes, lc + MIN_MATCH);
 }
 
-const ct_data static_ltree[L_CODES+2];
+extern const ct_data static_ltree[L_CODES+2];
 
 static inline void static_emit_lit(deflate_state *const s, const int lit) {
     quick_send_bits(s, static_ltree[lit].Code, static_ltree[lit].Len, 0, 0);
+    STATS_ADD(s, literals, 1);
     Tracecv(isgraph(lit), (stderr, " '%c' ", lit));
 }
 
@@ -178,6 +82,7 @@ static void static_emit_tree(deflate_state *const s, const int flush) {
     last = flush == Z_FINISH ? 1 : 0;
     Tracev((stderr, "\n--- Emit Tree: Last: %u\n", last));
     send_bits(s, (STATIC_TREES << 1)+ last, 3, s->bi_buf, s->bi_valid);
+    STATS_ADD(s, fixed_blocks, 1);
 #ifdef ZLIB_DEBUG
     s->compressed_len += 3;
 #endif
@@ -198,11 +103,19 @@ static void static_emit_end_block(deflate_state *const s, int last) {
     s->block_open = 0;
 }
 
+/* The hash is the CRC-32C of four bytes, which both SSE4.2 and the ARMv8 CRC
+   extension compute in one instruction, so level 1 gives the same output on
+   either */
 static inline Pos quick_insert_string(deflate_state *const s, const Pos str) {
     Pos ret;
     unsigned h = 0;
 
-#ifdef _MSC_VER
+#if defined(ARM_QUICK_STRATEGY)
+    uint32_t val;
+
+    memcpy(&val, s->window + str, sizeof(val));
+    h = __crc32cw(h, val);
+#elif defined(_MSC_VER)
     h = _mm_crc32_u32(h, *(unsigned *)(s->window + str));
 #else
     __asm__ __volatile__ (
@@ -213,8 +126,8 @@ static inline Pos quick_insert_string(deflate_state *const s, const Pos str) {
     );
 #endif
 
-    ret = s->head[h & s->hash_mask];
-    s->head[h & s->hash_mask] = str;
+    ret = POS_WINDOW(s, s->head[h & s->hash_mask]);
+    s->head[h & s->hash_mask] = POS_ENTRY(s, str);
     return ret;
 }
 
@@ -222,35 +135,54 @@ ZLIB_INTERNAL block_state deflate_quick(deflate_state *s, int flush) {
     IPos hash_head;
     unsigned dist, match_len;
 
-    if (s->block_open == 0) {
-        static_emit_tree(s, flush);
-        s->block_open = 1;
+    /* Nothing can be written after flush_pending() leaves output pending, so
+       each flush is followed by a return when avail_out is used up. A block
+       stays open across such a return and is only started once there is
+       input for it. */
+
+    /* Symbols tallied by deflate_quick_dynamic() share pending_buf with the
+       bits written here, so they go out in a block of their own first */
+    if (s->sym_next)
+        FLUSH_BLOCK(s, 0);
+
+    /* A block started before Z_FINISH was not marked as the last one */
+    if (s->block_open == 1 && flush == Z_FINISH) {
+        static_emit_end_block(s, 0);
+        if (s->strm->avail_out == 0)
+            return need_more;
     }
 
-    do {
-        if (s->pending + 4 >= s->pending_buf_size) {
+    for (;;) {
+        if (s->pending + (Buf_size >> 3) >= s->pending_buf_size) {
             flush_pending(s->strm);
-            if (flush != Z_FINISH) {
+            if (s->strm->avail_out == 0)
                 return need_more;
-            }
         }
 
         if (s->lookahead < MIN_LOOKAHEAD) {
-            fill_window_sse(s);
+            functable.fill_window(s);
             if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH) {
-                static_emit_end_block(s, 0);
+                if (s->block_open)
+                    static_emit_end_block(s, 0);
                 return need_more;
             }
             if (s->lookahead == 0)
                 break;
         }
 
+        if (s->block_open == 0) {
+            static_emit_tree(s, flush);
+            s->block_open = flush == Z_FINISH ? 2 : 1;
+        }
+
         if (s->lookahead >= MIN_MATCH) {
             hash_head = quick_insert_string(s, s->strstart);
             dist = s->strstart - hash_head;
 
-            if (dist > 0 && (dist-1) < (s->w_size - 1)) {
-                match_len = compare258(s->window + s->strstart, s->window + s->strstart - dist);
+            /* quick_dist_codes[] only reaches back 8K, less than the window
+               after deflateParams() from another level */
+            if (dist > 0 && (dist-1) < (MIN(s->w_size, 8192) - 1)) {
+                match_len = functable.compare258(s->window + s->strstart, s->window + s->strstart - dist);
 
                 if (match_len >= MIN_MATCH) {
                     if (match_len > s->lookahead)
@@ -270,21 +202,86 @@ ZLIB_INTERNAL block_state deflate_quick(deflate_state *s, int flush) {
         static_emit_lit(s, s->window[s->strstart]);
         s->strstart++;
         s->lookahead--;
-    } while (s->strm->avail_out != 0);
+    }
 
-    if (s->strm->avail_out == 0 && flush != Z_FINISH)
-        return need_more;
+    /* Make room for the end of the block */
+    if (s->pending + (Buf_size >> 3) >= s->pending_buf_size) {
+        flush_pending(s->strm);
+        if (s->strm->avail_out == 0)
+            return need_more;
+    }
 
     s->insert = s->strstart < MIN_MATCH - 1 ? s->strstart : MIN_MATCH-1;
     if (flush == Z_FINISH) {
+        if (s->block_open == 0)
+            static_emit_tree(s, flush);
         static_emit_end_block(s, 1);
         if (s->strm->avail_out == 0)
-            return s->strm->avail_in == 0 ? finish_started : need_more;
-        else
-            return finish_done;
+            return finish_started;
+        return finish_done;
     }
 
-    static_emit_end_block(s, 0);
+    if (s->block_open)
+        static_emit_end_block(s, 0);
+    if (s->strm->avail_out == 0)
+        return need_more;
+    return block_done;
+}
+
+/* ===========================================================================
+ * Same search as deflate_quick(), one probe of the hash table per position
+ * and no strings inserted inside matches, but with the symbols tallied for
+ * blocks with dynamic trees, as selected by Z_DEFLATE_QUICK_DYNAMIC. The
+ * frequencies are counted as the symbols are tallied, so building the trees
+ * is the only extra work, once per block.
+ */
+ZLIB_INTERNAL block_state deflate_quick_dynamic(deflate_state *s, int flush) {
+    IPos hash_head;
+    unsigned dist, match_len;
+    int bflush;
+
+    for (;;) {
+        if (s->lookahead < MIN_LOOKAHEAD) {
+            functable.fill_window(s);
+            if (s->lookahead < MIN_LOOKAHEAD && flush == Z_NO_FLUSH)
+                return need_more;
+            if (s->lookahead == 0)
+                break; /* flush the current block */
+        }
+
+        match_len = 0;
+        if (s->lookahead >= MIN_MATCH) {
+            hash_head = quick_insert_string(s, s->strstart);
+            dist = s->strstart - hash_head;
+
+            if (dist > 0 && dist <= MAX_DIST(s)) {
+                match_len = functable.compare258(s->window + s->strstart, s->window + hash_head);
+                if (match_len > s->lookahead)
+                    match_len = s->lookahead;
+            }
+        }
+
+        if (match_len >= MIN_MATCH) {
+            check_match(s, s->strstart, hash_head, match_len);
+            zng_tr_tally_dist(s, s->strstart - hash_head, match_len - MIN_MATCH, bflush);
+            s->lookahead -= match_len;
+            s->strstart += match_len;
+        } else {
+            Tracevv((stderr, "%c", s->window[s->strstart]));
+            zng_tr_tally_lit(s, s->window[s->strstart], bflush);
+            s->lookahead--;
+            s->strstart++;
+        }
+        if (bflush)
+            FLUSH_BLOCK(s, 0);
+    }
+    s->insert = s->strstart < MIN_MATCH - 1 ? s->strstart : MIN_MATCH-1;
+    if (flush == Z_FINISH) {
+        FLUSH_BLOCK(s, 1);
+        return finish_done;
+    }
+    if (s->sym_next)
+        FLUSH_BLOCK(s, 0);
     return block_done;
 }
 
@@ -2405,3 +2402,5 @@ static const unsigned quick_dist_codes[8192] = {
     0x00ff1310, 0x00ff3310, 0x00ff5310, 0x00ff7310,
     0x00ff9310, 0x00ffb310, 0x00ffd310, 0x00fff310,
 };
+
+#endif
@@ -9,11 +9,14 @@
 #include "deflate_p.h"
 
 #include "functable.h"
+#include "memcopy.h"
 /* insert_string */
 #ifdef X86_SSE42_CRC_HASH
 extern Pos insert_string_sse(deflate_state *const s, const Pos str, unsigned int count);
+extern void clear_hash_sse(deflate_state *const s, const Pos str, unsigned int count);
 #elif defined(ARM_ACLE_CRC_HASH)
 extern Pos insert_string_acle(deflate_state *const s, const Pos str, unsigned int count);
+extern void clear_hash_acle(deflate_state *const s, const Pos str, unsigned int count);
 #endif
 
 /* fill_window */
@@ -27,15 +30,93 @@ extern void fill_window_arm(deflate_state *s);
 #ifdef X86_SSE2
 void slide_hash_sse2(deflate_state *s);
 #endif
+#ifdef X86_AVX2
+void slide_hash_avx2(deflate_state *s);
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+void slide_hash_neon(deflate_state *s);
+#endif
+
+/* longest_match and compare258 */
+#ifdef X86_SSE42_CMP_STR
+extern unsigned compare258_sse(const unsigned char *src0, const unsigned char *src1);
+#endif
+#ifdef X86_AVX2
+extern unsigned longest_match_avx2(deflate_state *const s, IPos cur_match);
+extern unsigned compare258_avx2(const unsigned char *src0, const unsigned char *src1);
+#endif
+#ifdef X86_AVX512
+extern unsigned longest_match_avx512(deflate_state *const s, IPos cur_match);
+extern unsigned compare258_avx512(const unsigned char *src0, const unsigned char *src1);
+#endif
+
+/* rle258 */
+#ifdef X86_SSE2
+extern unsigned rle258_sse2(const unsigned char *src, unsigned char c);
+#endif
+#ifdef X86_AVX2
+extern unsigned rle258_avx2(const unsigned char *src, unsigned char c);
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+extern unsigned rle258_neon(const unsigned char *src, unsigned char c);
+#endif
+
+/* chunk functions for inflate */
+#ifdef INFFAST_CHUNKSIZE
+extern unsigned chunksize_c(void);
+extern unsigned char* chunkcopy_c(unsigned char *out, unsigned char const *from, unsigned len);
+extern unsigned char* chunkcopy_safe_c(unsigned char *out, unsigned char const *from, unsigned len,
+                                       unsigned char *safe);
+extern unsigned char* chunkunroll_c(unsigned char *out, unsigned *dist, unsigned *len);
+extern unsigned char* chunkmemset_c(unsigned char *out, unsigned dist, unsigned len);
+extern unsigned char* chunkmemset_safe_c(unsigned char *out, unsigned dist, unsigned len, unsigned left);
+#endif
+#ifdef X86_SSE2
+extern unsigned chunksize_sse2(void);
+extern unsigned char* chunkcopy_sse2(unsigned char *out, unsigned char const *from, unsigned len);
+extern unsigned char* chunkcopy_safe_sse2(unsigned char *out, unsigned char const *from, unsigned len,
+                                          unsigned char *safe);
+extern unsigned char* chunkunroll_sse2(unsigned char *out, unsigned *dist, unsigned *len);
+extern unsigned char* chunkmemset_sse2(unsigned char *out, unsigned dist, unsigned len);
+extern unsigned char* chunkmemset_safe_sse2(unsigned char *out, unsigned dist, unsigned len, unsigned left);
+#endif
+#ifdef X86_AVX_CHUNKSET
+extern unsigned chunksize_avx2(void);
+extern unsigned char* chunkcopy_avx2(unsigned char *out, unsigned char const *from, unsigned len);
+extern unsigned char* chunkcopy_safe_avx2(unsigned char *out, unsigned char const *from, unsigned len,
+                                          unsigned char *safe);
+extern unsigned char* chunkunroll_avx2(unsigned char *out, unsigned *dist, unsigned *len);
+extern unsigned char* chunkmemset_avx2(unsigned char *out, unsigned dist, unsigned len);
+extern unsigned char* chunkmemset_safe_avx2(unsigned char *out, unsigned dist, unsigned len, unsigned left);
+#endif
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+extern unsigned chunksize_neon(void);
+extern unsigned char* chunkcopy_neon(unsigned char *out, unsigned char const *from, unsigned len);
+extern unsigned char* chunkcopy_safe_neon(unsigned char *out, unsigned char const *from, unsigned len,
+                                          unsigned char *safe);
+extern unsigned char* chunkunroll_neon(unsigned char *out, unsigned *dist, unsigned *len);
+extern unsigned char* chunkmemset_neon(unsigned char *out, unsigned dist, unsigned len);
+extern unsigned char* chunkmemset_safe_neon(unsigned char *out, unsigned dist, unsigned len, unsigned left);
+#endif
 
 /* adler32 */
 extern uint32_t adler32_c(uint32_t adler, const unsigned char *buf, size_t len);
+#ifdef X86_SSSE3_ADLER32
+extern uint32_t adler32_ssse3(uint32_t adler, const unsigned char *buf, size_t len);
+#endif
+#ifdef X86_AVX2_ADLER32
+extern uint32_t adler32_avx2(uint32_t adler, const unsigned char *buf, size_t len);
+#endif
 #if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && defined(ARM_NEON_ADLER32)
 extern uint32_t adler32_neon(uint32_t adler, const unsigned char *buf, size_t len);
 #endif
 
+extern uint32_t adler32_copy_c(uint32_t adler, unsigned char *dst, const unsigned char *src, size_t len);
+
 /* CRC32 */
 ZLIB_INTERNAL uint32_t crc32_generic(uint32_t, const unsigned char *, uint64_t);
+extern uint32_t crc32_copy_c(uint32_t crc, unsigned char *dst, const unsigned char *src, size_t len);
+extern uint32_t crc32_multmodp_c(uint32_t a, uint32_t b);
 
 #ifdef DYNAMIC_CRC_TABLE
 extern volatile int crc_table_empty;
@@ -45,6 +126,19 @@ extern void make_crc_table(void);
 #ifdef __ARM_FEATURE_CRC32
 extern uint32_t crc32_acle(uint32_t, const unsigned char *, uint64_t);
 #endif
+#ifdef ARM_PMULL_CRC
+extern uint32_t crc32_pmull(uint32_t, const unsigned char *, uint64_t);
+extern uint32_t crc32_multmodp_pmull(uint32_t, uint32_t);
+#endif
+
+#ifdef X86_PCLMULQDQ_CRC
+extern uint32_t crc32_pclmulqdq(uint32_t, const unsigned char *, uint64_t);
+extern uint32_t crc32_copy_pclmulqdq(uint32_t, unsigned char *, const unsigned char *, size_t);
+extern uint32_t crc32_multmodp_pclmulqdq(uint32_t, uint32_t);
+#endif
+#ifdef X86_VPCLMULQDQ_CRC
+extern uint32_t crc32_vpclmulqdq(uint32_t, const unsigned char *, uint64_t);
+#endif
 
 #if BYTE_ORDER == LITTLE_ENDIAN
 extern uint32_t crc32_little(uint32_t, const unsigned char *, uint64_t);
@@ -55,82 +149,224 @@ extern uint32_t crc32_big(uint32_t, const unsigned char *, uint64_t);
 
 /* stub definitions */
 ZLIB_INTERNAL Pos insert_string_stub(deflate_state *const s, const Pos str, unsigned int count);
+ZLIB_INTERNAL void clear_hash_stub(deflate_state *const s, const Pos str, unsigned int count);
 ZLIB_INTERNAL void fill_window_stub(deflate_state *s);
 ZLIB_INTERNAL uint32_t adler32_stub(uint32_t adler, const unsigned char *buf, size_t len);
 ZLIB_INTERNAL uint32_t crc32_stub(uint32_t crc, const unsigned char *buf, uint64_t len);
 ZLIB_INTERNAL void slide_hash_stub(deflate_state *s);
+ZLIB_INTERNAL unsigned longest_match_stub(deflate_state *const s, IPos cur_match);
+ZLIB_INTERNAL unsigned compare258_stub(const unsigned char *src0, const unsigned char *src1);
+ZLIB_INTERNAL unsigned rle258_stub(const unsigned char *src, unsigned char c);
+ZLIB_INTERNAL uint32_t crc32_copy_stub(uint32_t crc, unsigned char *dst, const unsigned char *src, size_t len);
+ZLIB_INTERNAL unsigned chunksize_stub(void);
+ZLIB_INTERNAL unsigned char* chunkcopy_stub(unsigned char *out, unsigned char const *from, unsigned len);
+ZLIB_INTERNAL unsigned char* chunkcopy_safe_stub(unsigned char *out, unsigned char const *from, unsigned len,
+                                                 unsigned char *safe);
+ZLIB_INTERNAL unsigned char* chunkunroll_stub(unsigned char *out, unsigned *dist, unsigned *len);
+ZLIB_INTERNAL unsigned char* chunkmemset_stub(unsigned char *out, unsigned dist, unsigned len);
+ZLIB_INTERNAL unsigned char* chunkmemset_safe_stub(unsigned char *out, unsigned dist, unsigned len, unsigned left);
+ZLIB_INTERNAL uint32_t crc32_multmodp_stub(uint32_t a, uint32_t b);
 
 /* functable init */
-ZLIB_INTERNAL __thread struct functable_s functable = {
+ZLIB_INTERNAL struct functable_s functable = {
                                             fill_window_stub,
                                             insert_string_stub,
+                                            clear_hash_stub,
                                             adler32_stub,
                                             crc32_stub,
-                                            slide_hash_stub
+                                            slide_hash_stub,
+                                            longest_match_stub,
+                                            compare258_stub,
+                                            rle258_stub,
+                                            adler32_copy_c,
+                                            crc32_copy_stub,
+                                            chunksize_stub,
+                                            chunkcopy_stub,
+                                            chunkcopy_safe_stub,
+                                            chunkunroll_stub,
+                                            chunkmemset_stub,
+                                            chunkmemset_safe_stub,
+                                            crc32_multmodp_stub
                                           };
 
+/* The functable is shared by all threads. The first call of any stub picks
+ * every entry at once, and threads that race to do so store the same values.
+ * An entry is stored only after everything that it depends on, so a thread
+ * that sees it needs no check of its own.
+ */
+#if defined(_MSC_VER)
+#  define FUNCTABLE_BARRIER() MemoryBarrier()
+#  define FUNCTABLE_ASSIGN(ft, name) \
+    (void)InterlockedExchangePointer((void * volatile *)&functable.name, (void *)(ft).name)
+#else
+#  define FUNCTABLE_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#  define FUNCTABLE_ASSIGN(ft, name) __atomic_store(&functable.name, &(ft).name, __ATOMIC_RELEASE)
+#endif
 
-/* stub functions */
-ZLIB_INTERNAL Pos insert_string_stub(deflate_state *const s, const Pos str, unsigned int count) {
-    // Initialize default
-    functable.insert_string=&insert_string_c;
+/* Checksums may be computed before any stream was initialized, so make sure
+ * the CPU features are known before picking an implementation.
+ */
+static void cpu_check_features(void) {
+#if defined(X86_CPUID)
+    x86_check_features();
+#elif defined(ARM_GETAUXVAL)
+    arm_check_features();
+#endif
+}
 
-    #ifdef X86_SSE42_CRC_HASH
-    if (x86_cpu_has_sse42)
-        functable.insert_string=&insert_string_sse;
-    #elif defined(__ARM_FEATURE_CRC32) && defined(ARM_ACLE_CRC_HASH)
-    if (arm_cpu_has_crc32)
-        functable.insert_string=&insert_string_acle;
-    #endif
+/* Pick the insert_string and clear_hash pair for hash, one of the HASH_FUNC_*
+ * values, and return 0, or return -1 if the CPU cannot compute that hash.
+ * The default is the CRC hash where there is one.
+ */
+static int hash_select(int hash, insert_string_func *insert_string, clear_hash_func *clear_hash) {
+    switch (hash) {
+        case HASH_FUNC_DEFAULT:
+        case HASH_FUNC_CRC:
+            #ifdef X86_SSE42_CRC_HASH
+            if (x86_cpu_has_sse42) {
+                *insert_string=&insert_string_sse;
+                *clear_hash=&clear_hash_sse;
+                return 0;
+            }
+            #elif defined(__ARM_FEATURE_CRC32) && defined(ARM_ACLE_CRC_HASH)
+            if (arm_cpu_has_crc32) {
+                *insert_string=&insert_string_acle;
+                *clear_hash=&clear_hash_acle;
+                return 0;
+            }
+            #endif
+            if (hash == HASH_FUNC_CRC)
+                return -1;
+            *insert_string=&insert_string_c;
+            *clear_hash=&clear_hash_c;
+            return 0;
+        case HASH_FUNC_MULTIPLY:
+            *insert_string=&insert_string_mul;
+            *clear_hash=&clear_hash_mul;
+            return 0;
+        case HASH_FUNC_ROLLING:
+            *insert_string=&insert_string_roll;
+            *clear_hash=&clear_hash_roll;
+            return 0;
+        default:
+            return -1;
+    }
+}
 
-    return functable.insert_string(s, str, count);
+ZLIB_INTERNAL int functable_hash_select(deflate_state *const s, int hash) {
+    return hash_select(hash, &s->insert_string, &s->clear_hash);
 }
 
-ZLIB_INTERNAL void fill_window_stub(deflate_state *s) {
+static void fill_window_select(struct functable_s *ft) {
     // Initialize default
-    functable.fill_window=&fill_window_c;
+    ft->fill_window=&fill_window_c;
 
-    #if defined(X86_SSE2)
+    #if defined(DEFLATE_POS32)
+    // The arch versions slide 16-bit positions themselves
+    #elif defined(X86_SSE2)
     # if !defined(__x86_64__) && !defined(_M_X64) && !defined(X86_NOCHECK_SSE2)
     if (x86_cpu_has_sse2)
     # endif
-        functable.fill_window=&fill_window_sse;
+        ft->fill_window=&fill_window_sse;
     #elif defined(ARM_GETAUXVAL)
-        functable.fill_window=&fill_window_arm;
+        ft->fill_window=&fill_window_arm;
     #endif
+}
 
-    functable.fill_window(s);
+static void slide_hash_select(struct functable_s *ft) {
+    // Initialize default
+    ft->slide_hash=&slide_hash_c;
+
+    #ifndef DEFLATE_POS32
+    # ifdef X86_SSE2
+    #  if !defined(__x86_64__) && !defined(_M_X64) && !defined(X86_NOCHECK_SSE2)
+    if (x86_cpu_has_sse2)
+    #  endif
+        ft->slide_hash=&slide_hash_sse2;
+    # endif
+    # ifdef X86_AVX2
+    if (x86_cpu_has_avx2)
+        ft->slide_hash=&slide_hash_avx2;
+    # endif
+    # if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    if (arm_cpu_has_neon)
+        ft->slide_hash=&slide_hash_neon;
+    # endif
+    #endif
 }
 
-ZLIB_INTERNAL void slide_hash_stub(deflate_state *s) {
+static void longest_match_select(struct functable_s *ft) {
+    // Initialize default
+    ft->longest_match=&longest_match_c;
+
+    #ifdef X86_AVX2
+    if (x86_cpu_has_avx2)
+        ft->longest_match=&longest_match_avx2;
+    #endif
+    #ifdef X86_AVX512
+    if (x86_cpu_has_avx512)
+        ft->longest_match=&longest_match_avx512;
+    #endif
+}
+
+static void compare258_select(struct functable_s *ft) {
+    // Initialize default
+    ft->compare258=&compare258_c;
+
+    #ifdef X86_SSE42_CMP_STR
+    if (x86_cpu_has_sse42)
+        ft->compare258=&compare258_sse;
+    #endif
+    #ifdef X86_AVX2
+    if (x86_cpu_has_avx2)
+        ft->compare258=&compare258_avx2;
+    #endif
+    #ifdef X86_AVX512
+    if (x86_cpu_has_avx512)
+        ft->compare258=&compare258_avx512;
+    #endif
+}
+
+static void rle258_select(struct functable_s *ft) {
     // Initialize default
-    functable.slide_hash=&slide_hash_c;
+    ft->rle258=&rle258_c;
 
     #ifdef X86_SSE2
     # if !defined(__x86_64__) && !defined(_M_X64) && !defined(X86_NOCHECK_SSE2)
     if (x86_cpu_has_sse2)
     # endif
-        functable.slide_hash=&slide_hash_sse2;
+        ft->rle258=&rle258_sse2;
+    #endif
+    #ifdef X86_AVX2
+    if (x86_cpu_has_avx2)
+        ft->rle258=&rle258_avx2;
+    #endif
+    #if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    if (arm_cpu_has_neon)
+        ft->rle258=&rle258_neon;
     #endif
-
-    functable.slide_hash(s);
 }
 
-ZLIB_INTERNAL uint32_t adler32_stub(uint32_t adler, const unsigned char *buf, size_t len) {
+static void adler32_select(struct functable_s *ft) {
     // Initialize default
-    functable.adler32=&adler32_c;
+    ft->adler32=&adler32_c;
+    ft->adler32_copy=&adler32_copy_c;
 
     #if (defined(__ARM_NEON__) || defined(__ARM_NEON)) && defined(ARM_NEON_ADLER32)
     if (arm_cpu_has_neon)
-        functable.adler32=&adler32_neon;
+        ft->adler32=&adler32_neon;
+    #endif
+    #ifdef X86_SSSE3_ADLER32
+    if (x86_cpu_has_ssse3)
+        ft->adler32=&adler32_ssse3;
+    #endif
+    #ifdef X86_AVX2_ADLER32
+    if (x86_cpu_has_avx2)
+        ft->adler32=&adler32_avx2;
     #endif
-
-    return functable.adler32(adler, buf, len);
 }
 
-ZLIB_INTERNAL uint32_t crc32_stub(uint32_t crc, const unsigned char *buf, uint64_t len) {
-
-
+static void crc32_select(struct functable_s *ft) {
    Assert(sizeof(uint64_t) >= sizeof(size_t),
           "crc32_z takes size_t but internally we have a uint64_t len");
 /* return a function pointer for optimized arches here after a capability test */
@@ -142,19 +378,226 @@ ZLIB_INTERNAL uint32_t crc32_stub(uint32_t crc, const unsigned char *buf, uint64
 
     if (sizeof(void *) == sizeof(ptrdiff_t)) {
 #if BYTE_ORDER == LITTLE_ENDIAN
-      functable.crc32=crc32_little;
+      ft->crc32=crc32_little;
 #  if defined(__ARM_FEATURE_CRC32) && defined(ARM_ACLE_CRC_HASH)
       if (arm_cpu_has_crc32)
-        functable.crc32=crc32_acle;
+        ft->crc32=crc32_acle;
+#    ifdef ARM_PMULL_CRC
+      if (arm_cpu_has_crc32 && arm_cpu_has_pmull)
+        ft->crc32=crc32_pmull;
+#    endif
+#  endif
+#  ifdef X86_PCLMULQDQ_CRC
+      if (x86_cpu_has_pclmulqdq)
+        ft->crc32=crc32_pclmulqdq;
+#  endif
+#  ifdef X86_VPCLMULQDQ_CRC
+      if (x86_cpu_has_vpclmulqdq)
+        ft->crc32=crc32_vpclmulqdq;
 #  endif
 #elif BYTE_ORDER == BIG_ENDIAN
-        functable.crc32=crc32_big;
+        ft->crc32=crc32_big;
 #else
 #  error No endian defined
 #endif
     } else {
-        functable.crc32=crc32_generic;
+        ft->crc32=crc32_generic;
+    }
+
+    // Initialize default
+    ft->crc32_copy=&crc32_copy_c;
+    ft->crc32_multmodp=&crc32_multmodp_c;
+
+    #ifdef X86_PCLMULQDQ_CRC
+    if (x86_cpu_has_pclmulqdq) {
+        ft->crc32_copy=&crc32_copy_pclmulqdq;
+        ft->crc32_multmodp=&crc32_multmodp_pclmulqdq;
+    }
+    #endif
+    #if defined(__ARM_FEATURE_CRC32) && defined(ARM_PMULL_CRC)
+    if (arm_cpu_has_pmull)
+        ft->crc32_multmodp=&crc32_multmodp_pmull;
+    #endif
+}
+
+/* The chunk functions assume that they all use the same chunk size, so they
+ * are always switched together.
+ */
+static void chunkset_select(struct functable_s *ft) {
+#ifdef INFFAST_CHUNKSIZE
+    // Initialize default
+    ft->chunksize=&chunksize_c;
+    ft->chunkcopy=&chunkcopy_c;
+    ft->chunkcopy_safe=&chunkcopy_safe_c;
+    ft->chunkunroll=&chunkunroll_c;
+    ft->chunkmemset=&chunkmemset_c;
+    ft->chunkmemset_safe=&chunkmemset_safe_c;
+
+    #ifdef X86_SSE2
+    # if !defined(__x86_64__) && !defined(_M_X64) && !defined(X86_NOCHECK_SSE2)
+    if (x86_cpu_has_sse2)
+    # endif
+    {
+        ft->chunksize=&chunksize_sse2;
+        ft->chunkcopy=&chunkcopy_sse2;
+        ft->chunkcopy_safe=&chunkcopy_safe_sse2;
+        ft->chunkunroll=&chunkunroll_sse2;
+        ft->chunkmemset=&chunkmemset_sse2;
+        ft->chunkmemset_safe=&chunkmemset_safe_sse2;
+    }
+    #endif
+    #ifdef X86_AVX_CHUNKSET
+    if (x86_cpu_has_avx2) {
+        ft->chunksize=&chunksize_avx2;
+        ft->chunkcopy=&chunkcopy_avx2;
+        ft->chunkcopy_safe=&chunkcopy_safe_avx2;
+        ft->chunkunroll=&chunkunroll_avx2;
+        ft->chunkmemset=&chunkmemset_avx2;
+        ft->chunkmemset_safe=&chunkmemset_safe_avx2;
+    }
+    #endif
+    #if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    if (arm_cpu_has_neon) {
+        ft->chunksize=&chunksize_neon;
+        ft->chunkcopy=&chunkcopy_neon;
+        ft->chunkcopy_safe=&chunkcopy_safe_neon;
+        ft->chunkunroll=&chunkunroll_neon;
+        ft->chunkmemset=&chunkmemset_neon;
+        ft->chunkmemset_safe=&chunkmemset_safe_neon;
     }
+    #endif
+#else
+    ft->chunksize=functable.chunksize;
+    ft->chunkcopy=functable.chunkcopy;
+    ft->chunkcopy_safe=functable.chunkcopy_safe;
+    ft->chunkunroll=functable.chunkunroll;
+    ft->chunkmemset=functable.chunkmemset;
+    ft->chunkmemset_safe=functable.chunkmemset_safe;
+#endif
+}
+
+/* Detect the CPU once and fill in every entry of the functable */
+static void functable_init(void) {
+    struct functable_s ft;
+
+    cpu_check_features();
+
+    // insert_string and clear_hash must hash the same way
+    hash_select(HASH_FUNC_DEFAULT, &ft.insert_string, &ft.clear_hash);
+    fill_window_select(&ft);
+    slide_hash_select(&ft);
+    longest_match_select(&ft);
+    compare258_select(&ft);
+    rle258_select(&ft);
+    adler32_select(&ft);
+    crc32_select(&ft);
+    chunkset_select(&ft);
+
+    FUNCTABLE_BARRIER();
+    FUNCTABLE_ASSIGN(ft, fill_window);
+    FUNCTABLE_ASSIGN(ft, insert_string);
+    FUNCTABLE_ASSIGN(ft, clear_hash);
+    FUNCTABLE_ASSIGN(ft, adler32);
+    FUNCTABLE_ASSIGN(ft, crc32);
+    FUNCTABLE_ASSIGN(ft, slide_hash);
+    FUNCTABLE_ASSIGN(ft, longest_match);
+    FUNCTABLE_ASSIGN(ft, compare258);
+    FUNCTABLE_ASSIGN(ft, rle258);
+    FUNCTABLE_ASSIGN(ft, adler32_copy);
+    FUNCTABLE_ASSIGN(ft, crc32_copy);
+    FUNCTABLE_ASSIGN(ft, chunksize);
+    FUNCTABLE_ASSIGN(ft, chunkcopy);
+    FUNCTABLE_ASSIGN(ft, chunkcopy_safe);
+    FUNCTABLE_ASSIGN(ft, chunkunroll);
+    FUNCTABLE_ASSIGN(ft, chunkmemset);
+    FUNCTABLE_ASSIGN(ft, chunkmemset_safe);
+    FUNCTABLE_ASSIGN(ft, crc32_multmodp);
+    FUNCTABLE_BARRIER();
+}
+
+/* stub functions */
+ZLIB_INTERNAL Pos insert_string_stub(deflate_state *const s, const Pos str, unsigned int count) {
+    functable_init();
+    return functable.insert_string(s, str, count);
+}
+
+ZLIB_INTERNAL void clear_hash_stub(deflate_state *const s, const Pos str, unsigned int count) {
+    functable_init();
+    functable.clear_hash(s, str, count);
+}
+
+ZLIB_INTERNAL void fill_window_stub(deflate_state *s) {
+    functable_init();
+    functable.fill_window(s);
+}
+
+ZLIB_INTERNAL void slide_hash_stub(deflate_state *s) {
+    functable_init();
+    functable.slide_hash(s);
+}
+
+ZLIB_INTERNAL unsigned longest_match_stub(deflate_state *const s, IPos cur_match) {
+    functable_init();
+    return functable.longest_match(s, cur_match);
+}
+
+ZLIB_INTERNAL unsigned compare258_stub(const unsigned char *src0, const unsigned char *src1) {
+    functable_init();
+    return functable.compare258(src0, src1);
+}
+
+ZLIB_INTERNAL unsigned rle258_stub(const unsigned char *src, unsigned char c) {
+    functable_init();
+    return functable.rle258(src, c);
+}
+
+ZLIB_INTERNAL uint32_t adler32_stub(uint32_t adler, const unsigned char *buf, size_t len) {
+    functable_init();
+    return functable.adler32(adler, buf, len);
+}
 
+ZLIB_INTERNAL uint32_t crc32_stub(uint32_t crc, const unsigned char *buf, uint64_t len) {
+    functable_init();
     return functable.crc32(crc, buf, len);
 }
+
+ZLIB_INTERNAL uint32_t crc32_copy_stub(uint32_t crc, unsigned char *dst, const unsigned char *src, size_t len) {
+    functable_init();
+    return functable.crc32_copy(crc, dst, src, len);
+}
+
+ZLIB_INTERNAL uint32_t crc32_multmodp_stub(uint32_t a, uint32_t b) {
+    functable_init();
+    return functable.crc32_multmodp(a, b);
+}
+
+ZLIB_INTERNAL unsigned chunksize_stub(void) {
+    functable_init();
+    return functable.chunksize();
+}
+
+ZLIB_INTERNAL unsigned char* chunkcopy_stub(unsigned char *out, unsigned char const *from, unsigned len) {
+    functable_init();
+    return functable.chunkcopy(out, from, len);
+}
+
+ZLIB_INTERNAL unsigned char* chunkcopy_safe_stub(unsigned char *out, unsigned char const *from, unsigned len,
+                                                 unsigned char *safe) {
+    functable_init();
+    return functable.chunkcopy_safe(out, from, len, safe);
+}
+
+ZLIB_INTERNAL unsigned char* chunkunroll_stub(unsigned char *out, unsigned *dist, unsigned *len) {
+    functable_init();
+    return functable.chunkunroll(out, dist, len);
+}
+
+ZLIB_INTERNAL unsigned char* chunkmemset_stub(unsigned char *out, unsigned dist, unsigned len) {
+    functable_init();
+    return functable.chunkmemset(out, dist, len);
+}
+
+ZLIB_INTERNAL unsigned char* chunkmemset_safe_stub(unsigned char *out, unsigned dist, unsigned len, unsigned left) {
+    functable_init();
+    return functable.chunkmemset_safe(out, dist, len, left);
+}
@@ -8,15 +8,43 @@
 
 #include "deflate.h"
 
+typedef Pos  (* insert_string_func) (deflate_state *const s, const Pos str, unsigned int count);
+typedef void (* clear_hash_func)    (deflate_state *const s, const Pos str, unsigned int count);
+
 struct functable_s {
     void     (* fill_window)    (deflate_state *s);
     Pos      (* insert_string)  (deflate_state *const s, const Pos str, unsigned int count);
+    void     (* clear_hash)     (deflate_state *const s, const Pos str, unsigned int count);
     uint32_t (* adler32)        (uint32_t adler, const unsigned char *buf, size_t len);
     uint32_t (* crc32)          (uint32_t crc, const unsigned char *buf, uint64_t len);
     void     (* slide_hash)     (deflate_state *s);
+    unsigned (* longest_match)  (deflate_state *const s, IPos cur_match);
+    unsigned (* compare258)     (const unsigned char *src0, const unsigned char *src1);
+    unsigned (* rle258)         (const unsigned char *src, unsigned char c);
+    uint32_t (* adler32_copy)   (uint32_t adler, unsigned char *dst, const unsigned char *src, size_t len);
+    uint32_t (* crc32_copy)     (uint32_t crc, unsigned char *dst, const unsigned char *src, size_t len);
+    unsigned (* chunksize)      (void);
+    unsigned char* (* chunkcopy)        (unsigned char *out, unsigned char const *from, unsigned len);
+    unsigned char* (* chunkcopy_safe)   (unsigned char *out, unsigned char const *from, unsigned len,
+                                         unsigned char *safe);
+    unsigned char* (* chunkunroll)      (unsigned char *out, unsigned *dist, unsigned *len);
+    unsigned char* (* chunkmemset)      (unsigned char *out, unsigned dist, unsigned len);
+    unsigned char* (* chunkmemset_safe) (unsigned char *out, unsigned dist, unsigned len, unsigned left);
+    uint32_t (* crc32_multmodp) (uint32_t a, uint32_t b);
 };
 
-ZLIB_INTERNAL extern __thread struct functable_s functable;
+/* Copy and checksum functions without a fused kernel work in pieces of this
+ * size, so that the copied data is still in the L1 cache when it is summed.
+ */
+#define CHECKSUM_COPY_CHUNK 4096
+
+ZLIB_INTERNAL extern struct functable_s functable;
+
+/* Set the insert_string and clear_hash of s for hash, one of the HASH_FUNC_*
+ * values in deflate.h, and return 0, or return -1 if the CPU cannot compute
+ * that hash. The functable has the ones for HASH_FUNC_DEFAULT.
+ */
+ZLIB_INTERNAL int functable_hash_select(deflate_state *const s, int hash);
 
 
 #endif
@@ -46,6 +46,28 @@
 #  include <io.h>
 #endif
 
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#  include <sys/mman.h>     /* for mmap(), munmap(), madvise() */
+#  include <sys/stat.h>     /* for fstat() and st_blksize */
+#  define GZ_MMAP           /* also means posix_memalign() is there */
+#endif
+
+#include "zthread.h"
+#include "ztrace.h"
+#ifdef Z_HAVE_THREADS
+#  define GZ_AIO
+#endif
+
+#if defined(WIN32) && !defined(__BORLANDC__)
+#  define LSEEK _lseeki64
+#else
+#if defined(_LARGEFILE64_SOURCE) && _LFS64_LARGEFILE-0
+#  define LSEEK lseek64
+#else
+#  define LSEEK lseek
+#endif
+#endif
+
 #if defined(_WIN32) || defined(__MINGW__)
 #  define WIDECHAR
 #endif
@@ -104,6 +126,41 @@
 #define GZBUFSIZE 8192
 #endif
 
+/* largest buffer size picked for a file when gzbuffer() is not called, which
+   makes the output buffer when reading one huge page */
+#define GZBUFMAX 1048576
+
+/* smallest buffer size picked for the first read with 'p' */
+#define GZ_PREFIX_MIN 1024
+
+/* alignment of buffers allocated with 'H' that are at least a huge page, and
+   of the smaller ones */
+#define GZ_HUGE_PAGE 2097152
+#define GZ_PAGE 4096
+
+/* how much is read or written with 'D' between drops from the page cache */
+#define GZ_DROP 8388608
+
+/* most compression threads that can be requested with 'P' */
+#define GZ_MAX_THREADS 64
+
+/* With 'B', the gzip members are in the BGZF form: each has an extra field
+   that starts with a "BC" subfield giving the length of the member less one
+   in two bytes, and holds up to GZ_BGZF_BLOCK bytes of input in at most
+   GZ_BGZF_MAX bytes.  After the data members come index members, which are
+   empty members whose extra field has a "ZI" subfield after the "BC" one with
+   four bytes for each data member, its length less one and its input length,
+   then a GZ_BGZF_LOC byte locator member with a "ZL" subfield giving in
+   eight bytes each the distance back from it to the first index member and
+   the number of data members, and last the GZ_BGZF_EOF byte empty member that
+   BGZF ends with.  All numbers are little-endian. */
+#define GZ_BGZF_BLOCK 65280
+#define GZ_BGZF_MAX 65536
+#define GZ_BGZF_HEAD 18                 /* header of a data member */
+#define GZ_BGZF_ENTRIES ((GZ_BGZF_MAX - 32) / 4)    /* most entries in an index member */
+#define GZ_BGZF_LOC 48
+#define GZ_BGZF_EOF 28
+
 /* gzip modes, also provide a little integrity check on the passed structure */
 #define GZ_NONE 0
 #define GZ_READ 7247
@@ -115,6 +172,52 @@
 #define COPY 1      /* copy input directly */
 #define GZIP 2      /* decompress a gzip stream */
 
+#ifdef GZ_AIO
+/* background I/O thread for 'A', with at most one read or write in flight */
+typedef struct {
+    z_thread_t thread;
+    z_mutex_t lock;         /* protects busy, quit, and the request */
+    z_cond_t cond;          /* signals a new request or a finished one */
+    int busy;               /* a request is waiting for the thread or running */
+    int quit;               /* the thread should exit */
+    int pending;            /* a request was made and its result not taken */
+        /* request and result */
+    int write;              /* the request is a write rather than a read */
+    unsigned char *buf;     /* buffer to read into or to write from */
+    unsigned len;           /* number of bytes to read or write */
+    unsigned got;           /* number of bytes read or written */
+    int err;                /* errno of a failed read or write, or 0 */
+    int end;                /* the read reached the end of the file */
+        /* buffers */
+    unsigned char *spare;   /* buffer to read ahead into or to deflate into next */
+    unsigned char *next;    /* read ahead data not used yet */
+    unsigned have;          /* number of bytes at next */
+    int eof;                /* the read ahead reached the end of the file */
+} gz_aio;
+
+/* states of a job for the threads of 'P' */
+#define GZ_JOB_FREE 0           /* being set up by the calling thread */
+#define GZ_JOB_QUEUED 1         /* waiting for a thread */
+#define GZ_JOB_RUNNING 2        /* being compressed or decompressed */
+#define GZ_JOB_DONE 3           /* waiting for the calling thread */
+#endif
+
+/* access point for gzseek() from zng_gzindex_build(), where decompression can
+   start without decompressing what comes before */
+typedef struct {
+    z_off64_t out;          /* offset in the uncompressed data */
+    z_off64_t in;           /* offset in the file of the first full byte */
+    int bits;               /* number of bits (0-7) from the byte before that */
+    unsigned wsize;         /* length of window */
+    unsigned char *window;  /* the uncompressed data before the point */
+} gz_point;
+
+typedef struct {
+    unsigned have;          /* number of access points in list */
+    unsigned size;          /* number of access points allocated */
+    gz_point *list;         /* access points in order of offset */
+} gz_index;
+
 /* internal gzip file state data structure */
 typedef struct {
         /* exposed contents for gzgetc() macro */
@@ -127,7 +230,11 @@ typedef struct {
     int fd;                 /* file descriptor */
     char *path;             /* path or fd for error messages */
     unsigned size;          /* buffer size, zero if not allocated yet */
-    unsigned want;          /* requested buffer size, default is GZBUFSIZE */
+    unsigned want;          /* requested buffer size, default picked for the file */
+    int huge;               /* true if buffers should be in huge pages */
+    int drop;               /* true if file data should not stay cached */
+    z_off64_t drop_pos;     /* file data before this was dropped from the cache */
+    z_off64_t drop_mid;     /* writing: writeback started up to here */
     unsigned char *in;      /* input buffer (double-sized when writing) */
     unsigned char *out;     /* output buffer (double-sized when reading) */
     int direct;             /* 0 if processing gzip, 1 if transparent */
@@ -136,10 +243,35 @@ typedef struct {
     z_off64_t start;        /* where the gzip data started, for rewinding */
     int eof;                /* true if end of input file reached */
     int past;               /* true if read requested past end */
+    int map_want;           /* true if the file should be read through mmap() */
+    unsigned char *map;     /* mapping of the whole file, or NULL if not mapped */
+    size_t map_size;        /* length of the mapping */
+    gz_index *index;        /* access points for gzseek(), or NULL if none */
+    int raw;                /* true if inflating raw from an access point */
+    unsigned trailer;       /* gzip trailer bytes to skip after a raw member */
+    int tail;               /* true if the end was checked for the index of 'B' */
+    int prefix;             /* true for 'p', sizing the buffers by the first read */
+    int whole;              /* true while inflate reaches back into out instead of a window */
+        /* background I/O */
+    int aio_want;           /* true if reads or writes should be in the background */
+#ifdef GZ_AIO
+    gz_aio *aio;            /* background I/O state, or NULL if not in use */
+#endif
+    int threads;            /* number of threads requested with 'P' */
+#ifdef GZ_AIO
+    struct gz_par_s *par;   /* parallel compression state, or NULL if not in use */
+    struct gz_rpar_s *rpar; /* parallel decompression state, or NULL if not in use */
+#endif
         /* just for writing */
     int level;              /* compression level */
     int strategy;           /* compression strategy */
     int reset;              /* true if a reset is pending after a Z_FINISH */
+    int bgzf;               /* true for 'B', writing BGZF members and an index */
+    unsigned char *bgzf_in; /* input of the member being filled, without 'P' */
+    unsigned bgzf_have;     /* bytes at bgzf_in */
+    unsigned char *bgzf_list;   /* four bytes for each member written, as in the index */
+    uint64_t bgzf_count;    /* number of members written */
+    uint64_t bgzf_size;     /* number of members there is room for in bgzf_list */
         /* seek request */
     z_off64_t skip;         /* amount to skip (already rewound if backwards) */
     int seek;               /* true if seek request pending */
@@ -153,6 +285,14 @@ typedef gz_state *gz_statep;
 
 /* shared functions */
 void ZLIB_INTERNAL gz_error(gz_state *, int, const char *);
+void ZLIB_INTERNAL *gz_alloc(gz_state *, size_t);
+void ZLIB_INTERNAL gz_drop(gz_state *, int);
+#ifdef GZ_AIO
+int ZLIB_INTERNAL gz_aio_init(gz_state *);
+void ZLIB_INTERNAL gz_aio_submit(gz_state *, int, unsigned char *, unsigned);
+int ZLIB_INTERNAL gz_aio_wait(gz_state *);
+void ZLIB_INTERNAL gz_aio_end(gz_state *);
+#endif
 
 /* GT_OFF(x), where x is an unsigned value, is true if x > maximum z_off64_t
    value -- needed when comparing unsigned to z_off64_t, which is signed
@@ -3,21 +3,16 @@
  * For conditions of distribution and use, see copyright notice in zlib.h
  */
 
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE 1     /* For posix_memalign(), madvise(), and sync_file_range() with -std=c99. */
+#endif
+
 #include "zbuild.h"
 #include "gzguts.h"
 
-#if defined(WIN32) && !defined(__BORLANDC__)
-#  define LSEEK _lseeki64
-#else
-#if defined(_LARGEFILE64_SOURCE) && _LFS64_LARGEFILE-0
-#  define LSEEK lseek64
-#else
-#  define LSEEK lseek
-#endif
-#endif
-
 /* Local functions */
 static void gz_reset(gz_state *);
+static void gz_want(gz_state *);
 static gzFile gz_open(const void *, int, const char *);
 
 /* Reset gzip file state */
@@ -27,6 +22,8 @@ static void gz_reset(gz_state *state) {
         state->eof = 0;             /* not at end of file */
         state->past = 0;            /* have not read past end yet */
         state->how = LOOK;          /* look for gzip header */
+        state->raw = 0;             /* not started from an access point */
+        state->trailer = 0;         /* no trailer to skip */
     }
     else                            /* for writing ... */
         state->reset = 0;           /* no deflateReset pending */
@@ -36,6 +33,30 @@ static void gz_reset(gz_state *state) {
     state->strm.avail_in = 0;       /* no input data yet */
 }
 
+/* Pick the buffer size for a newly opened file, which gzbuffer() can still
+   change.  It is at least GZBUFSIZE and the block size of the file system, and
+   when reading a regular file, it is doubled up to GZBUFMAX while it is less
+   than an eighth of the rest of the file, so that large files are read with
+   few large reads.  With 'p', the first read picks it instead. */
+static void gz_want(gz_state *state) {
+#ifdef GZ_MMAP
+    struct stat st;
+    unsigned want = state->want;
+
+    if (state->prefix || fstat(state->fd, &st) == -1)
+        return;
+    if (st.st_blksize > 0 && st.st_blksize <= GZBUFMAX)
+        while (want < (unsigned)st.st_blksize)
+            want <<= 1;
+    if (state->mode == GZ_READ && S_ISREG(st.st_mode))
+        while (want < GZBUFMAX && (z_off64_t)want < ((z_off64_t)st.st_size - state->start) >> 3)
+            want <<= 1;
+    state->want = want;
+#else
+    (void)state;
+#endif
+}
+
 /* Open a gzip file either by name or file descriptor. */
 static gzFile gz_open(const void *path, int fd, const char *mode) {
     gz_state *state;
@@ -57,7 +78,11 @@ static gzFile gz_open(const void *path, int fd, const char *mode) {
     if (state == NULL)
         return NULL;
     state->size = 0;            /* no buffers allocated yet */
-    state->want = GZBUFSIZE;    /* requested buffer size */
+    state->want = GZBUFSIZE;    /* requested buffer size, before gz_want() */
+    state->huge = 0;
+    state->drop = 0;
+    state->drop_pos = 0;
+    state->drop_mid = 0;
     state->msg = NULL;          /* no error message yet */
 
     /* interpret mode */
@@ -65,6 +90,25 @@ static gzFile gz_open(const void *path, int fd, const char *mode) {
     state->level = Z_DEFAULT_COMPRESSION;
     state->strategy = Z_DEFAULT_STRATEGY;
     state->direct = 0;
+    state->map_want = 0;
+    state->map = NULL;
+    state->index = NULL;
+    state->tail = 0;
+    state->prefix = 0;
+    state->whole = 0;
+    state->bgzf = 0;
+    state->bgzf_in = NULL;
+    state->bgzf_have = 0;
+    state->bgzf_list = NULL;
+    state->bgzf_count = 0;
+    state->bgzf_size = 0;
+    state->aio_want = 0;
+    state->threads = 0;
+#ifdef GZ_AIO
+    state->aio = NULL;
+    state->par = NULL;
+    state->rpar = NULL;
+#endif
     while (*mode) {
         if (*mode >= '0' && *mode <= '9') {
             state->level = *mode - '0';
@@ -111,6 +155,40 @@ static gzFile gz_open(const void *path, int fd, const char *mode) {
             case 'T':
                 state->direct = 1;
                 break;
+            case 'H':
+                state->huge = 1;
+                break;
+            case 'B':
+                state->bgzf = 1;
+                break;
+            case 'p':
+                state->prefix = 1;
+                break;
+#ifdef POSIX_FADV_DONTNEED
+            case 'D':
+                state->drop = 1;
+                break;
+#endif
+#ifdef GZ_MMAP
+            case 'm':
+                state->map_want = 1;
+                break;
+#endif
+#ifdef GZ_AIO
+            case 'A':
+                state->aio_want = 1;
+                break;
+#endif
+            case 'P':       /* the thread count is not a level, even if unused */
+                state->threads = 0;
+                while (mode[1] >= '0' && mode[1] <= '9') {
+                    if (state->threads < GZ_MAX_THREADS)
+                        state->threads = state->threads * 10 + (mode[1] - '0');
+                    mode++;
+                }
+                if (state->threads > GZ_MAX_THREADS)
+                    state->threads = GZ_MAX_THREADS;
+                break;
             default:        /* could consider as an error, but just ignore */
                 {}
             }
@@ -203,6 +281,13 @@ static gzFile gz_open(const void *path, int fd, const char *mode) {
         if (state->start == -1) state->start = 0;
     }
 
+    /* size the buffers for the file */
+    gz_want(state);
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (state->drop && state->mode == GZ_READ)
+        (void)posix_fadvise(state->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
     /* initialize stream */
     gz_reset(state);
 
@@ -277,7 +362,15 @@ int ZEXPORT PREFIX(gzrewind)(gzFile file) {
     if (state->mode != GZ_READ || (state->err != Z_OK && state->err != Z_BUF_ERROR))
         return -1;
 
-    /* back up and start over */
+    /* back up and start over, dropping what was read ahead */
+#ifdef GZ_AIO
+    if (state->aio != NULL) {
+        if (gz_aio_wait(state) == -1)
+            return -1;
+        state->aio->have = 0;
+        state->aio->eof = 0;
+    }
+#endif
     if (LSEEK(state->fd, state->start, SEEK_SET) == -1)
         return -1;
     gz_reset(state);
@@ -314,7 +407,17 @@ z_off64_t ZEXPORT PREFIX(gzseek64)(gzFile file, z_off64_t offset, int whence) {
 
     /* if within raw area while reading, just go there */
     if (state->mode == GZ_READ && state->how == COPY && state->x.pos + offset >= 0) {
-        ret = LSEEK(state->fd, offset - (z_off64_t)state->x.have, SEEK_CUR);
+        n = 0;
+#ifdef GZ_AIO
+        if (state->aio != NULL) {
+            if (gz_aio_wait(state) == -1)
+                return -1;
+            n = state->aio->have;
+            state->aio->have = 0;
+            state->aio->eof = 0;
+        }
+#endif
+        ret = LSEEK(state->fd, offset - (z_off64_t)state->x.have - (z_off64_t)n, SEEK_CUR);
         if (ret == -1)
             return -1;
         state->x.have = 0;
@@ -399,11 +502,20 @@ z_off64_t ZEXPORT PREFIX(gzoffset64)(gzFile file) {
         return -1;
 
     /* compute and return effective offset in file */
+#ifdef GZ_AIO
+    if (state->aio != NULL && gz_aio_wait(state) == -1)
+        return -1;
+#endif
     offset = LSEEK(state->fd, 0, SEEK_CUR);
     if (offset == -1)
         return -1;
-    if (state->mode == GZ_READ)             /* reading */
+    if (state->mode == GZ_READ) {           /* reading */
         offset -= state->strm.avail_in;     /* don't count buffered input */
+#ifdef GZ_AIO
+        if (state->aio != NULL)
+            offset -= state->aio->have;     /* or input read ahead */
+#endif
+    }
     return offset;
 }
 
@@ -501,6 +613,217 @@ void ZLIB_INTERNAL gz_error(gz_state *state, int err, const char *msg) {
     (void)snprintf(state->msg, strlen(state->path) + strlen(msg) + 3, "%s%s%s", state->path, ": ", msg);
 }
 
+/* Allocate a buffer of len bytes for state->in, state->out, or the background
+   I/O spare, all of which are freed with free().  With 'H', a buffer of at
+   least a huge page is aligned to one and the kernel is asked to back it with
+   huge pages, which cuts the TLB misses from streaming through it, and smaller
+   buffers are page aligned.  Return NULL if out of memory. */
+void ZLIB_INTERNAL *gz_alloc(gz_state *state, size_t len) {
+#ifdef GZ_MMAP
+    if (state->huge) {
+        size_t align = len >= GZ_HUGE_PAGE ? GZ_HUGE_PAGE : GZ_PAGE;
+        void *buf;
+
+        if (posix_memalign(&buf, align, len) != 0)
+            return NULL;
+#  ifdef MADV_HUGEPAGE
+        if (align == GZ_HUGE_PAGE)
+            (void)madvise(buf, len, MADV_HUGEPAGE);
+#  endif
+        return buf;
+    }
+#else
+    (void)state;
+#endif
+    return malloc(len);
+}
+
+/* With 'D', drop the file data that was read or written from the page cache
+   once another GZ_DROP bytes of it went by, so that streaming through a large
+   file does not push everything else out of the cache.  Written data has to
+   reach the disk before it can be dropped.  Where sync_file_range() is
+   available, the writeback of each GZ_DROP bytes is started when they are
+   written and waited for GZ_DROP bytes later, otherwise fsync() waits for it.
+   If last is true, ask for the rest to be dropped, which is as the file is
+   closed.  This is only advice to the system, so errors are ignored. */
+void ZLIB_INTERNAL gz_drop(gz_state *state, int last) {
+#ifdef POSIX_FADV_DONTNEED
+    z_off64_t pos, end;
+
+    pos = LSEEK(state->fd, 0, SEEK_CUR);
+    if (pos == -1)
+        return;
+    if (pos < state->drop_mid)          /* rewound */
+        state->drop_pos = state->drop_mid = 0;
+    if (last) {
+        (void)posix_fadvise(state->fd, (off_t)state->drop_pos, 0, POSIX_FADV_DONTNEED);
+        return;
+    }
+    if (pos - state->drop_mid < GZ_DROP)
+        return;
+
+    end = pos;
+    if (state->mode == GZ_WRITE) {
+#ifdef SYNC_FILE_RANGE_WRITE
+        end = state->drop_mid;
+        if (end > state->drop_pos)
+            (void)sync_file_range(state->fd, (off_t)state->drop_pos, (off_t)(end - state->drop_pos),
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        (void)sync_file_range(state->fd, (off_t)state->drop_mid, (off_t)(pos - state->drop_mid),
+                              SYNC_FILE_RANGE_WRITE);
+#else
+        (void)fsync(state->fd);
+#endif
+    }
+    if (end > state->drop_pos)
+        (void)posix_fadvise(state->fd, (off_t)state->drop_pos, (off_t)(end - state->drop_pos), POSIX_FADV_DONTNEED);
+    state->drop_pos = end;
+    state->drop_mid = pos;
+#else
+    (void)state;
+    (void)last;
+#endif
+}
+
+#ifdef GZ_AIO
+/* Run the reads and writes requested by gz_aio_submit() until told to quit.
+   The loops are those of gz_load() and gz_comp(), except that a short write
+   is continued. */
+static void *gz_aio_run(void *arg) {
+    gz_state *state = (gz_state *)arg;
+    gz_aio *aio = state->aio;
+    ssize_t ret;
+
+    z_mutex_lock(&aio->lock);
+    for (;;) {
+        while (!aio->busy && !aio->quit)
+            z_cond_wait(&aio->cond, &aio->lock);
+        if (aio->quit)
+            break;
+        z_mutex_unlock(&aio->lock);
+
+        aio->got = 0;
+        aio->err = 0;
+        aio->end = 0;
+        do {
+            if (aio->write)
+                ret = write(state->fd, aio->buf + aio->got, aio->len - aio->got);
+            else
+                ret = read(state->fd, aio->buf + aio->got, aio->len - aio->got);
+            if (ret <= 0)
+                break;
+            aio->got += (unsigned)ret;
+        } while (aio->got < aio->len);
+        if (ret < 0)
+            aio->err = errno;
+        else if (ret == 0)
+            aio->end = 1;
+        if (state->drop)
+            gz_drop(state, 0);
+
+        z_mutex_lock(&aio->lock);
+        aio->busy = 0;
+        z_cond_signal(&aio->cond);
+    }
+    z_mutex_unlock(&aio->lock);
+    return NULL;
+}
+
+/* Start the background I/O thread with a spare buffer of state->want bytes.
+   Return -1 if that is not possible, in which case state->aio is left NULL,
+   or 0 on success. */
+int ZLIB_INTERNAL gz_aio_init(gz_state *state) {
+    gz_aio *aio;
+
+    aio = (gz_aio *)calloc(1, sizeof(gz_aio));
+    if (aio == NULL)
+        return -1;
+    aio->spare = (unsigned char *)gz_alloc(state, state->want);
+    if (aio->spare == NULL)
+        goto fail;
+    if (z_mutex_init(&aio->lock) != 0)
+        goto fail;
+    if (z_cond_init(&aio->cond) != 0) {
+        z_mutex_destroy(&aio->lock);
+        goto fail;
+    }
+    state->aio = aio;
+    if (z_thread_create(&aio->thread, gz_aio_run, state) != 0) {
+        state->aio = NULL;
+        z_cond_destroy(&aio->cond);
+        z_mutex_destroy(&aio->lock);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    free(aio->spare);
+    free(aio);
+    return -1;
+}
+
+/* Have the thread read len bytes into buf, or write len bytes from buf if
+   write is true.  Any earlier request must have been waited for. */
+void ZLIB_INTERNAL gz_aio_submit(gz_state *state, int write, unsigned char *buf, unsigned len) {
+    gz_aio *aio = state->aio;
+
+    z_mutex_lock(&aio->lock);
+    aio->write = write;
+    aio->buf = buf;
+    aio->len = len;
+    aio->busy = 1;
+    aio->pending = 1;
+    z_cond_signal(&aio->cond);
+    z_mutex_unlock(&aio->lock);
+}
+
+/* Wait for the request in flight, if any.  A read leaves its data at
+   aio->next and aio->have.  Return -1 and set the error if the read or write
+   failed, otherwise 0. */
+int ZLIB_INTERNAL gz_aio_wait(gz_state *state) {
+    gz_aio *aio = state->aio;
+
+    if (!aio->pending)
+        return 0;
+    z_mutex_lock(&aio->lock);
+    while (aio->busy)
+        z_cond_wait(&aio->cond, &aio->lock);
+    z_mutex_unlock(&aio->lock);
+    aio->pending = 0;
+
+    if (aio->err || (aio->write && aio->got != aio->len)) {
+        errno = aio->err;
+        gz_error(state, Z_ERRNO, zstrerror());
+        return -1;
+    }
+    if (!aio->write) {
+        aio->next = aio->buf;
+        aio->have = aio->got;
+        aio->eof = aio->end;
+    }
+    return 0;
+}
+
+/* Wait for the request in flight and stop the thread, if it was started. */
+void ZLIB_INTERNAL gz_aio_end(gz_state *state) {
+    gz_aio *aio = state->aio;
+
+    if (aio == NULL)
+        return;
+    (void)gz_aio_wait(state);
+    z_mutex_lock(&aio->lock);
+    aio->quit = 1;
+    z_cond_signal(&aio->cond);
+    z_mutex_unlock(&aio->lock);
+    z_thread_join(aio->thread);
+    z_cond_destroy(&aio->cond);
+    z_mutex_destroy(&aio->lock);
+    free(aio->spare);
+    free(aio);
+    state->aio = NULL;
+}
+#endif
+
 #ifndef INT_MAX
 /* portably return maximum value for an int (when limits.h presumed not
    available) -- we need to do this to cover cases where 2's complement not
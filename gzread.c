@@ -8,11 +8,28 @@
 
 /* Local functions */
 static int gz_load(gz_state *, unsigned char *, unsigned, unsigned *);
+#ifdef GZ_AIO
+static int gz_load_ahead(gz_state *, unsigned char *, unsigned, unsigned *);
+#endif
 static int gz_avail(gz_state *);
+#ifdef GZ_MMAP
+static void gz_map(gz_state *);
+#endif
 static int gz_look(gz_state *);
+static int gz_whole_end(gz_state *);
 static int gz_decomp(gz_state *);
 static int gz_fetch(gz_state *);
 static int gz_skip(gz_state *, z_off64_t);
+#ifndef ZLIB_COMPAT
+static int gz_index_auto(gz_state *);
+static int gz_index_jump(gz_state *, z_off64_t *);
+static void gz_index_free(gz_index *);
+#  ifdef GZ_AIO
+#    define GZ_RPAR
+static int gz_rpar_decomp(gz_state *);
+static void gz_rpar_end(gz_state *);
+#  endif
+#endif
 static size_t gz_read(gz_state *, void *, size_t);
 
 /* Use read() to load a buffer -- return -1 on error, otherwise 0.  Read from
@@ -22,22 +39,70 @@ static size_t gz_read(gz_state *, void *, size_t);
 static int gz_load(gz_state *state, unsigned char *buf, unsigned len, unsigned *have) {
     ssize_t ret;
 
+#ifdef GZ_AIO
+    if (state->aio != NULL)
+        return gz_load_ahead(state, buf, len, have);
+#endif
     *have = 0;
+    ZTRACE2(gz_load_start, state->fd, len);
     do {
         ret = read(state->fd, buf + *have, len - *have);
         if (ret <= 0)
             break;
         *have += (unsigned)ret;
     } while (*have < len);
+    ZTRACE2(gz_load_done, state->fd, *have);
     if (ret < 0) {
         gz_error(state, Z_ERRNO, zstrerror());
         return -1;
     }
     if (ret == 0)
         state->eof = 1;
+    if (state->drop)
+        gz_drop(state, 0);
     return 0;
 }
 
+#ifdef GZ_AIO
+/* Like gz_load(), but take the data from what the background thread read
+   ahead, and have it start reading the next buffer as soon as that is used
+   up, so the read overlaps with the decompression of this data.  Loading a
+   whole empty input buffer swaps it with the read ahead buffer instead of
+   copying. */
+static int gz_load_ahead(gz_state *state, unsigned char *buf, unsigned len, unsigned *have) {
+    gz_aio *aio = state->aio;
+    unsigned n;
+
+    *have = 0;
+    while (*have < len && !state->eof) {
+        if (aio->have == 0) {
+            if (!aio->pending)
+                gz_aio_submit(state, 0, aio->spare, state->size);
+            if (gz_aio_wait(state) == -1)
+                return -1;
+        }
+        if (buf == state->in && len == state->size && aio->next == aio->spare) {
+            state->in = aio->spare;
+            aio->spare = buf;
+            n = aio->have;
+        } else {
+            n = len - *have < aio->have ? len - *have : aio->have;
+            memcpy(buf + *have, aio->next, n);
+            aio->next += n;
+        }
+        *have += n;
+        aio->have -= n;
+        if (aio->have == 0) {
+            if (aio->eof)
+                state->eof = 1;
+            else
+                gz_aio_submit(state, 0, aio->spare, state->size);
+        }
+    }
+    return 0;
+}
+#endif
+
 /* Load up input buffer and set eof flag if last data loaded -- return -1 on
    error, 0 otherwise.  Note that the eof flag is set when the end of the input
    file is reached, even though there may be unused data in the buffer.  Once
@@ -51,6 +116,34 @@ static int gz_avail(gz_state *state) {
 
     if (state->err != Z_OK && state->err != Z_BUF_ERROR)
         return -1;
+#ifdef GZ_MMAP
+    if (state->map != NULL && state->eof == 0) {
+        /* point inflate into the mapping at the file position instead of
+           reading, and move the file position past what is handed out so
+           that gzoffset(), gzrewind() and gzseek() work as with read() */
+        z_off64_t pos;
+        size_t left;
+
+        if (strm->avail_in)
+            pos = (z_off64_t)(strm->next_in - state->map);
+        else if ((pos = LSEEK(state->fd, 0, SEEK_CUR)) == -1) {
+            gz_error(state, Z_ERRNO, zstrerror());
+            return -1;
+        }
+        left = (uint64_t)pos < state->map_size ? state->map_size - (size_t)pos : 0;
+        if (left > UINT_MAX)
+            left = UINT_MAX;
+        else
+            state->eof = 1;
+        if (LSEEK(state->fd, pos + (z_off64_t)left, SEEK_SET) == -1) {
+            gz_error(state, Z_ERRNO, zstrerror());
+            return -1;
+        }
+        strm->next_in = left ? state->map + pos : NULL;
+        strm->avail_in = (uint32_t)left;
+        return 0;
+    }
+#endif
     if (state->eof == 0) {
         if (strm->avail_in) {       /* copy what's there to the start */
             unsigned char *p = state->in;
@@ -68,6 +161,28 @@ static int gz_avail(gz_state *state) {
     return 0;
 }
 
+#ifdef GZ_MMAP
+/* Map the whole input file for reading if it was opened with 'm', it is a
+   regular file, and it is larger than the input buffer. state->map is left
+   NULL if the file is not mapped, in which case read() is used as usual. */
+static void gz_map(gz_state *state) {
+    struct stat st;
+    void *map;
+
+    if (fstat(state->fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size <= (z_off64_t)state->want ||
+        (uint64_t)st.st_size > SIZE_MAX)
+        return;
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, state->fd, 0);
+    if (map == MAP_FAILED)
+        return;
+#ifdef POSIX_MADV_SEQUENTIAL
+    posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+    state->map = (unsigned char *)map;
+    state->map_size = (size_t)st.st_size;
+}
+#endif
+
 /* Look for gzip header, set up for inflate or copy.  state->x.have must be 0.
    If this is the first time in, allocate required memory.  state->how will be
    left unchanged if there is no more input data available, will be set to COPY
@@ -82,10 +197,16 @@ static int gz_look(gz_state *state) {
 
     /* allocate read buffers and inflate memory */
     if (state->size == 0) {
-        /* allocate buffers */
-        state->in = (unsigned char *)malloc(state->want);
-        state->out = (unsigned char *)malloc(state->want << 1);
-        if (state->in == NULL || state->out == NULL) {
+        /* allocate buffers, except for the input when the file is mapped */
+        state->in = NULL;
+#ifdef GZ_MMAP
+        if (state->map_want && state->map == NULL)
+            gz_map(state);
+        if (state->map == NULL)
+#endif
+            state->in = (unsigned char *)gz_alloc(state, state->want);
+        state->out = (unsigned char *)gz_alloc(state, (size_t)state->want << 1);
+        if ((state->in == NULL && state->map == NULL) || state->out == NULL) {
             free(state->out);
             free(state->in);
             gz_error(state, Z_MEM_ERROR, "out of memory");
@@ -106,6 +227,39 @@ static int gz_look(gz_state *state) {
             gz_error(state, Z_MEM_ERROR, "out of memory");
             return -1;
         }
+
+        /* with 'p', decompress into out without a window for as long as the
+           output fits there, which a prefix of up to twice size always does */
+#ifndef ZLIB_COMPAT
+        if (state->prefix && state->threads <= 1) {
+            zng_inflateWholeBuffer(strm, 1);
+            strm->next_out = state->out;
+            state->whole = 1;
+        }
+#endif
+
+        /* read ahead in the background if requested, unless mapped */
+#ifdef GZ_AIO
+        if (state->aio_want && state->map == NULL)
+            (void)gz_aio_init(state);
+#endif
+    }
+
+    /* skip the trailer of a member that was decompressed from an access point,
+       which inflate left in the input since it only decoded the deflate data */
+    while (state->trailer) {
+        unsigned n;
+
+        if (strm->avail_in == 0) {
+            if (gz_avail(state) == -1)
+                return -1;
+            if (strm->avail_in == 0)
+                return 0;
+        }
+        n = strm->avail_in < state->trailer ? strm->avail_in : state->trailer;
+        strm->next_in += n;
+        strm->avail_in -= n;
+        state->trailer -= n;
     }
 
     /* get at least the magic bytes in the input buffer */
@@ -125,7 +279,7 @@ static int gz_look(gz_state *state) {
        single byte is sufficient indication that it is not a gzip file) */
     if (strm->avail_in > 1 &&
             strm->next_in[0] == 31 && strm->next_in[1] == 139) {
-        PREFIX(inflateReset)(strm);
+        PREFIX(inflateReset2)(strm, 15 + 16);   /* may have been raw */
         state->how = GZIP;
         state->direct = 0;
         return 0;
@@ -144,6 +298,17 @@ static int gz_look(gz_state *state) {
        the output buffer is larger than the input buffer, which also assures
        space for gzungetc() */
     state->x.next = state->out;
+#ifdef GZ_MMAP
+    if (state->map != NULL && strm->avail_in) {
+        /* the mapped input can be larger, so leave it for gz_load() */
+        if (LSEEK(state->fd, (z_off64_t)(strm->next_in - state->map), SEEK_SET) == -1) {
+            gz_error(state, Z_ERRNO, zstrerror());
+            return -1;
+        }
+        strm->avail_in = 0;
+        state->eof = 0;
+    }
+#endif
     if (strm->avail_in) {
         memcpy(state->x.next, strm->next_in, strm->avail_in);
         state->x.have = strm->avail_in;
@@ -154,6 +319,23 @@ static int gz_look(gz_state *state) {
     return 0;
 }
 
+/* Leave the whole-buffer mode of 'p', copying the output that is still within
+   reach into a window, so that the output can go anywhere from now on.  This
+   must be called while the output before strm->next_out is as inflate() left
+   it.  Returns 0 on success, -1 on failure. */
+static int gz_whole_end(gz_state *state) {
+    if (!state->whole)
+        return 0;
+#ifndef ZLIB_COMPAT
+    if (zng_inflateWholeBuffer(&(state->strm), 0) != Z_OK) {
+        gz_error(state, Z_MEM_ERROR, "out of memory");
+        return -1;
+    }
+#endif
+    state->whole = 0;
+    return 0;
+}
+
 /* Decompress from input to the provided next_out and avail_out in the state.
    On return, state->x.have and state->x.next point to the just decompressed
    data.  If the gzip stream completes, state->how is reset to LOOK to look for
@@ -164,6 +346,17 @@ static int gz_decomp(gz_state *state) {
     unsigned had;
     PREFIX3(stream) *strm = &(state->strm);
 
+#ifdef GZ_RPAR
+    /* with 'P' and an index, take the output of the threads where they have it */
+    if (state->threads > 1 && gz_index_auto(state) == -1)
+        return -1;
+    if (state->threads > 1 && state->index != NULL) {
+        ret = gz_rpar_decomp(state);
+        if (ret != 1)
+            return ret;
+    }
+#endif
+
     /* fill output buffer up to end of deflate stream */
     had = strm->avail_out;
     do {
@@ -196,8 +389,13 @@ static int gz_decomp(gz_state *state) {
     state->x.next = strm->next_out - state->x.have;
 
     /* if the gzip stream completed successfully, look for another */
-    if (ret == Z_STREAM_END)
+    if (ret == Z_STREAM_END) {
         state->how = LOOK;
+        if (state->raw) {
+            state->raw = 0;
+            state->trailer = 8;
+        }
+    }
 
     /* good decompression */
     return 0;
@@ -227,8 +425,12 @@ static int gz_fetch(gz_state *state) {
             state->x.next = state->out;
             return 0;
         case GZIP:      /* -> GZIP or LOOK (if end of gzip stream) */
-            strm->avail_out = state->size << 1;
-            strm->next_out = state->out;
+            /* in whole-buffer mode go on after the output of the last call */
+            if (state->whole && strm->next_out == state->out + (state->size << 1) && gz_whole_end(state) == -1)
+                return -1;
+            if (!state->whole)
+                strm->next_out = state->out;
+            strm->avail_out = (unsigned)(state->out + (state->size << 1) - strm->next_out);
             if (gz_decomp(state) == -1)
                 return -1;
         }
@@ -240,6 +442,13 @@ static int gz_fetch(gz_state *state) {
 static int gz_skip(gz_state *state, z_off64_t len) {
     unsigned n;
 
+#ifndef ZLIB_COMPAT
+    /* start from an access point instead if there is one on the way, using
+       the index at the end of a file written with 'B' if there is no other */
+    if (gz_index_auto(state) == -1 || (state->index != NULL && gz_index_jump(state, &len) == -1))
+        return -1;
+#endif
+
     /* skip over len bytes or reach end-of-file, whichever comes first */
     while (len)
         /* skip over whatever is in output buffer */
@@ -274,6 +483,17 @@ static size_t gz_read(gz_state *state, void *buf, size_t len) {
     if (len == 0)
         return 0;
 
+    /* with 'p', size the buffers by the first read, so that twice the size
+       holds it, unless gzbuffer() asked for less */
+    if (state->prefix && state->size == 0) {
+        unsigned want = GZ_PREFIX_MIN;
+
+        while (want < state->want && (size_t)want << 1 <= len)
+            want <<= 1;
+        if (want < state->want)
+            state->want = want;
+    }
+
     /* process a skip request */
     if (state->seek) {
         state->seek = 0;
@@ -323,6 +543,8 @@ static size_t gz_read(gz_state *state, void *buf, size_t len) {
 
         /* large len -- decompress directly into user buffer */
         else {  /* state->how == GZIP */
+            if (gz_whole_end(state) == -1)
+                return 0;
             state->strm.avail_out = n;
             state->strm.next_out = (unsigned char *)buf;
             if (gz_decomp(state) == -1)
@@ -459,6 +681,10 @@ int ZEXPORT PREFIX(gzungetc)(int c, gzFile file) {
     if (c < 0)
         return -1;
 
+    /* the pushed bytes may go over the output that inflate reaches back into */
+    if (gz_whole_end(state) == -1)
+        return -1;
+
     /* if output buffer empty, put byte at end (allows more pushing) */
     if (state->x.have == 0) {
         state->x.have = 1;
@@ -550,6 +776,271 @@ char * ZEXPORT PREFIX(gzgets)(gzFile file, char *buf, int len) {
     return str;
 }
 
+#ifndef ZLIB_COMPAT
+/* -- see zlib-ng.h -- */
+const unsigned char * ZEXPORT PREFIX(gzpeek)(gzFile file, unsigned *len) {
+    gz_state *state;
+
+    /* check parameters and get internal structure */
+    if (len == NULL)
+        return NULL;
+    *len = 0;
+    if (file == NULL)
+        return NULL;
+    state = (gz_state *)file;
+
+    /* check that we're reading and that there's no (serious) error */
+    if (state->mode != GZ_READ || (state->err != Z_OK && state->err != Z_BUF_ERROR))
+        return NULL;
+
+    /* process a skip request */
+    if (state->seek) {
+        state->seek = 0;
+        if (gz_skip(state, state->skip) == -1)
+            return NULL;
+    }
+
+    /* lend what is in the output buffer, getting more if it is empty */
+    if (state->x.have == 0 && gz_fetch(state) == -1)
+        return NULL;                    /* error */
+    if (state->x.have == 0) {           /* end of file */
+        state->past = 1;
+        return NULL;
+    }
+    *len = state->x.have;
+    return state->x.next;
+}
+
+/* -- see zlib-ng.h -- */
+int ZEXPORT PREFIX(gzconsume)(gzFile file, unsigned len) {
+    gz_state *state;
+
+    /* get internal structure */
+    if (file == NULL)
+        return -1;
+    state = (gz_state *)file;
+
+    /* check that we're reading, and that len is no more than gzpeek() lent */
+    if (state->mode != GZ_READ || (state->err != Z_OK && state->err != Z_BUF_ERROR) ||
+        state->seek || len > state->x.have)
+        return -1;
+    state->x.have -= len;
+    state->x.next += len;
+    state->x.pos += len;
+    return 0;
+}
+
+/* Append len bytes at buf to the partial line in *part, which has *have bytes
+   in *size allocated.  Return -1 if out of memory, otherwise 0. */
+static int gz_line_add(unsigned char **part, size_t *have, size_t *size, const unsigned char *buf, size_t len) {
+    if (*size - *have < len) {
+        size_t size2 = *size ? *size : 256;
+        unsigned char *part2;
+
+        while (size2 - *have < len)
+            size2 <<= 1;
+        part2 = (unsigned char *)realloc(*part, size2);
+        if (part2 == NULL)
+            return -1;
+        *part = part2;
+        *size = size2;
+    }
+    memcpy(*part + *have, buf, len);
+    *have += len;
+    return 0;
+}
+
+/* -- see zlib-ng.h -- */
+int ZEXPORT PREFIX(gzgetlines)(gzFile file, gzline_func line, void *opaque) {
+    gz_state *state;
+    const unsigned char *next, *end, *eol;
+    unsigned char *part = NULL;     /* line continued from an earlier buffer */
+    size_t have = 0, size = 0, n;
+    int ret = 0;
+
+    /* check parameters and get internal structure */
+    if (file == NULL || line == NULL)
+        return -1;
+    state = (gz_state *)file;
+
+    /* check that we're reading and that there's no (serious) error */
+    if (state->mode != GZ_READ || (state->err != Z_OK && state->err != Z_BUF_ERROR))
+        return -1;
+
+    /* process a skip request */
+    if (state->seek) {
+        state->seek = 0;
+        if (gz_skip(state, state->skip) == -1)
+            return -1;
+    }
+
+    for (;;) {
+        /* assure that something is in the output buffer */
+        if (state->x.have == 0 && gz_fetch(state) == -1) {
+            ret = -1;
+            break;
+        }
+        if (state->x.have == 0) {       /* end of file, with the last line */
+            state->past = 1;
+            if (have)
+                ret = line(opaque, (const char *)part, have);
+            break;
+        }
+        next = state->x.next;
+        end = next + state->x.have;
+
+        /* hand out the lines in the buffer where they are, each consumed
+           before the call so that a stop leaves the file just after it */
+        if (have == 0) {
+            while ((eol = (const unsigned char *)memchr(next, '\n', (size_t)(end - next))) != NULL) {
+                n = (size_t)(eol - next) + 1;
+                state->x.have -= (unsigned)n;
+                state->x.next += n;
+                state->x.pos += n;
+                ret = line(opaque, (const char *)next, n);
+                if (ret)
+                    goto done;
+                next = eol + 1;
+            }
+            if (next == end)
+                continue;
+        }
+
+        /* copy a line that continues past the buffer, up to its end if that
+           is in this buffer */
+        eol = (const unsigned char *)memchr(next, '\n', (size_t)(end - next));
+        n = eol == NULL ? (size_t)(end - next) : (size_t)(eol - next) + 1;
+        if (gz_line_add(&part, &have, &size, next, n) == -1) {
+            gz_error(state, Z_MEM_ERROR, "out of memory");
+            ret = -1;
+            break;
+        }
+        state->x.have -= (unsigned)n;
+        state->x.next += n;
+        state->x.pos += n;
+        if (eol != NULL) {
+            ret = line(opaque, (const char *)part, have);
+            have = 0;
+            if (ret)
+                break;
+        }
+    }
+
+  done:
+    free(part);
+    return ret;
+}
+
+/* Check the rest of the gzip stream being decoded with zng_inflateVerify(),
+   counting its length in state->x.pos.  Like gz_decomp(), but an input file
+   that ends before the stream does is an error.  Returns 0 on success, -1 on
+   failure. */
+static int gz_verify(gz_state *state) {
+    int ret;
+    size_t had;
+    zng_stream *strm = &(state->strm);
+
+    do {
+        /* get more input for zng_inflateVerify() */
+        if (strm->avail_in == 0 && gz_avail(state) == -1)
+            return -1;
+        if (strm->avail_in == 0) {
+            gz_error(state, Z_BUF_ERROR, "unexpected end of file");
+            return -1;
+        }
+
+        /* check and handle errors */
+        had = strm->total_out;
+        ret = zng_inflateVerify(strm, Z_NO_FLUSH);
+        state->x.pos += (z_off64_t)(strm->total_out - had);
+        if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT) {
+            gz_error(state, Z_STREAM_ERROR, "internal error: inflate stream corrupt");
+            return -1;
+        }
+        if (ret == Z_MEM_ERROR) {
+            gz_error(state, Z_MEM_ERROR, "out of memory");
+            return -1;
+        }
+        if (ret == Z_DATA_ERROR) {              /* deflate stream invalid */
+            gz_error(state, Z_DATA_ERROR, strm->msg == NULL ? "compressed data error" : strm->msg);
+            return -1;
+        }
+    } while (ret != Z_STREAM_END);
+
+    /* look for another gzip stream */
+    state->how = LOOK;
+    if (state->raw) {
+        state->raw = 0;
+        state->trailer = 8;
+    }
+    return 0;
+}
+
+/* -- see zlib-ng.h -- */
+int ZEXPORT PREFIX(gztest)(gzFile file) {
+    gz_state *state;
+    unsigned n;
+
+    /* get internal structure */
+    if (file == NULL)
+        return -1;
+    state = (gz_state *)file;
+
+    /* check that we're reading and that there's no (serious) error */
+    if (state->mode != GZ_READ || (state->err != Z_OK && state->err != Z_BUF_ERROR))
+        return -1;
+
+    /* process a skip request */
+    if (state->seek) {
+        state->seek = 0;
+        if (gz_skip(state, state->skip) == -1)
+            return -1;
+    }
+
+    for (;;) {
+        /* pass over whatever is in the output buffer */
+        state->x.pos += state->x.have;
+        state->x.next += state->x.have;
+        state->x.have = 0;
+
+        switch (state->how) {
+        case LOOK:      /* -> LOOK at the end, COPY or GZIP */
+            if (gz_look(state) == -1)
+                return -1;
+            if (state->how == LOOK) {
+                state->x.pos += state->x.have;
+                state->x.have = 0;
+                state->past = 1;
+                return 0;
+            }
+            break;
+        case COPY:      /* -> COPY until the end */
+            if (gz_load(state, state->out, state->size << 1, &n) == -1)
+                return -1;
+            if (n == 0) {
+                state->past = 1;
+                return 0;
+            }
+            state->x.pos += n;
+            break;
+        case GZIP:      /* -> LOOK at the end of the gzip stream */
+#ifdef GZ_RPAR
+            /* the threads decompress the regions of the index into the output */
+            if (state->threads > 1 && state->index != NULL) {
+                if (gz_fetch(state) == -1)
+                    return -1;
+                if (state->x.have == 0 && state->how == GZIP && state->eof && state->strm.avail_in == 0)
+                    return -1;      /* unexpected end of file, from gz_decomp() */
+                break;
+            }
+#endif
+            if (gz_whole_end(state) == -1 || gz_verify(state) == -1)
+                return -1;
+        }
+    }
+}
+#endif
+
 /* -- see zlib.h -- */
 int ZEXPORT PREFIX(gzdirect)(gzFile file) {
     gz_state *state;
@@ -569,6 +1060,1027 @@ int ZEXPORT PREFIX(gzdirect)(gzFile file) {
     return state->direct;
 }
 
+#ifndef ZLIB_COMPAT
+/* Serialized index: "gzix", a version byte and three zero bytes, the number of
+   access points in four bytes, then for each point its out and in offsets in
+   eight bytes, bits in one, and the window length in two followed by the
+   window.  All numbers are little-endian. */
+#define GZ_INDEX_HEAD 12
+#define GZ_INDEX_POINT 19
+#define GZ_INDEX_WINDOW 32768
+
+static const unsigned char gz_index_magic[8] = {'g', 'z', 'i', 'x', 1, 0, 0, 0};
+
+static void gz_index_put(unsigned char *buf, uint64_t val, int n) {
+    while (n--) {
+        *buf++ = (unsigned char)val;
+        val >>= 8;
+    }
+}
+
+static uint64_t gz_index_get(const unsigned char *buf, int n) {
+    uint64_t val = 0;
+
+    while (n--)
+        val = (val << 8) + buf[n];
+    return val;
+}
+
+/* Free an index and its windows. */
+static void gz_index_free(gz_index *index) {
+    unsigned i;
+
+    if (index == NULL)
+        return;
+    for (i = 0; i < index->have; i++)
+        free(index->list[i].window);
+    free(index->list);
+    free(index);
+}
+
+/* Make room for one more access point in index, and return it with its window
+   allocated for wsize bytes, or NULL if out of memory.  The point is not
+   counted yet. */
+static gz_point *gz_index_grow(gz_index *index, unsigned wsize) {
+    gz_point *point;
+
+    if (index->have == index->size) {
+        unsigned size = index->size ? index->size << 1 : 16;
+        gz_point *list = (gz_point *)realloc(index->list, size * sizeof(gz_point));
+
+        if (list == NULL)
+            return NULL;
+        index->list = list;
+        index->size = size;
+    }
+    point = index->list + index->have;
+    point->wsize = wsize;
+    point->window = (unsigned char *)malloc(wsize ? wsize : 1);
+    return point->window == NULL ? NULL : point;
+}
+
+/* Add an access point at uncompressed offset out for where inflate stopped on
+   a block boundary.  Return -1 on error, 0 otherwise. */
+static int gz_index_add(gz_state *state, gz_index *index, z_off64_t out) {
+    PREFIX3(stream) *strm = &(state->strm);
+    gz_point *point;
+    unsigned wsize;
+    z_off64_t in;
+
+    in = PREFIX(gzoffset64)((gzFile)state);
+    if (in == -1) {
+        gz_error(state, Z_ERRNO, zstrerror());
+        return -1;
+    }
+    PREFIX(inflateGetDictionary)(strm, NULL, &wsize);
+    point = gz_index_grow(index, wsize);
+    if (point == NULL) {
+        gz_error(state, Z_MEM_ERROR, "out of memory");
+        return -1;
+    }
+    PREFIX(inflateGetDictionary)(strm, point->window, &wsize);
+    point->out = out;
+    point->in = in;
+    point->bits = strm->data_type & 7;
+    index->have++;
+    return 0;
+}
+
+/* Return the number of access points in index at or before out. */
+static unsigned gz_index_find(gz_index *index, z_off64_t out) {
+    unsigned lo = 0, hi = index->have, mid;
+
+    while (lo < hi) {
+        mid = lo + ((hi - lo) >> 1);
+        if (index->list[mid].out <= out)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Set up to decompress from point, discarding any input and output that is
+   buffered.  Return -1 on error, 0 otherwise. */
+static int gz_index_start(gz_state *state, gz_point *point) {
+    PREFIX3(stream) *strm = &(state->strm);
+
+    /* go to the point, dropping what was read ahead */
+#ifdef GZ_AIO
+    if (state->aio != NULL) {
+        if (gz_aio_wait(state) == -1)
+            return -1;
+        state->aio->have = 0;
+        state->aio->eof = 0;
+    }
+#endif
+    if (LSEEK(state->fd, point->in - (point->bits ? 1 : 0), SEEK_SET) == -1) {
+        gz_error(state, Z_ERRNO, zstrerror());
+        return -1;
+    }
+    strm->avail_in = 0;
+    state->eof = 0;
+    state->past = 0;
+    state->x.have = 0;
+
+    /* decode raw deflate data from the point, with the window before it */
+    PREFIX(inflateReset2)(strm, -15);
+    if (point->bits) {
+        if (gz_avail(state) == -1)
+            return -1;
+        if (strm->avail_in == 0) {
+            gz_error(state, Z_BUF_ERROR, "unexpected end of file");
+            return -1;
+        }
+        PREFIX(inflatePrime)(strm, point->bits, strm->next_in[0] >> (8 - point->bits));
+        strm->next_in++;
+        strm->avail_in--;
+    }
+    if (point->wsize)
+        PREFIX(inflateSetDictionary)(strm, point->window, point->wsize);
+    state->how = GZIP;
+    state->direct = 0;
+    state->raw = 1;
+    state->trailer = 0;
+    state->x.pos = point->out;
+    return 0;
+}
+
+/* Jump to the last access point at or before the position *len bytes ahead,
+   if that is past the data decompressed so far, and set *len to the amount
+   left to skip from there.  Return -1 on error, 0 otherwise. */
+static int gz_index_jump(gz_state *state, z_off64_t *len) {
+    gz_index *index = state->index;
+    z_off64_t target = state->x.pos + *len;
+    gz_point *point;
+    unsigned n;
+
+    n = gz_index_find(index, target);
+    if (n == 0)
+        return 0;
+    point = index->list + n - 1;
+    if (point->out <= state->x.pos + (z_off64_t)state->x.have)
+        return 0;
+
+    /* allocate the buffers and inflate state if nothing was read yet */
+    if (state->size == 0 && gz_look(state) == -1)
+        return -1;
+
+    /* a raw stream from a point has its window set as the dictionary */
+    if (gz_whole_end(state) == -1 || gz_index_start(state, point) == -1)
+        return -1;
+    *len = target - point->out;
+    return 0;
+}
+
+#ifdef GZ_RPAR
+/* With 'P' and an index, the regions between access points are decompressed
+   by a pool of threads, and the calling thread hands out their output in
+   order.  Region 0 starts at the beginning of the file and every later region
+   at an access point, and each ends at the next access point, so a thread can
+   decompress a region from its compressed data and the window of its point
+   alone.  The calling thread reads the compressed data of each region for its
+   thread, unless the file is mapped, and continues on its own after the last
+   access point, or where a region is larger than GZ_RPAR_MAX.  Reading at any
+   other position, as after a seek that did not land on an access point, is
+   done by the calling thread up to the next access point, where the threads
+   take over again. */
+#define GZ_RPAR_MAX (1 << 26)   /* largest region, compressed or not */
+
+typedef struct {
+    int state;              /* one of GZ_JOB_* */
+    const unsigned char *in;    /* compressed data of the region */
+    unsigned in_len;        /* bytes at in */
+    unsigned char *buf;     /* allocated buffer for in when not mapped */
+    unsigned buf_size;      /* bytes allocated at buf */
+    unsigned char *out;     /* the uncompressed data */
+    unsigned out_len;       /* bytes of uncompressed data in the region */
+    unsigned out_size;      /* bytes allocated at out */
+    int gzip;               /* true if the region starts with a gzip header */
+    int bits;               /* bits to prime from the first byte of in */
+    const unsigned char *dict;  /* window of the access point */
+    unsigned dict_len;      /* bytes at dict */
+    int err;                /* inflate() error, or Z_OK */
+    const char *msg;        /* inflate() error message */
+} gz_rjob;
+
+typedef struct gz_rpar_s {
+    z_mutex_t lock;         /* protects job states and quit */
+    z_cond_t work;          /* signals a queued job or quit */
+    z_cond_t done;          /* signals a finished job */
+    z_thread_t thread[GZ_MAX_THREADS];
+    int started;            /* number of threads running */
+    int quit;               /* the threads should exit */
+    gz_rjob *job;           /* ring of jobs, twice as many as threads */
+    unsigned jobs;          /* number of jobs in the ring */
+    unsigned head;          /* next job to queue */
+    unsigned tail;          /* oldest job not used up */
+    unsigned run;           /* next job for a thread to take */
+    unsigned queued;        /* number of jobs queued and not used up */
+    int active;             /* true while regions are handed out */
+    int resync;             /* true if the calling thread must restart at pos */
+    unsigned next;          /* next region to queue */
+    unsigned stop;          /* region after the last one to queue */
+    unsigned used;          /* output of the oldest job handed out */
+    z_off64_t pos;          /* uncompressed offset of the next output */
+} gz_rpar;
+
+/* Decompress one region with strm, switching to the next gzip member at the
+   end of each one. */
+static void gz_rpar_inflate(gz_rjob *job, PREFIX3(stream) *strm) {
+    const unsigned char *in = job->in;
+    unsigned len = job->in_len, n;
+    int raw = !job->gzip, ret;
+
+    ret = PREFIX(inflateReset2)(strm, raw ? -MAX_WBITS : MAX_WBITS + 16);
+    if (ret == Z_OK && job->bits) {
+        ret = PREFIX(inflatePrime)(strm, job->bits, in[0] >> (8 - job->bits));
+        in++;
+        len--;
+    }
+    if (ret == Z_OK && job->dict_len)
+        ret = PREFIX(inflateSetDictionary)(strm, job->dict, job->dict_len);
+    strm->next_in = in;
+    strm->avail_in = len;
+    strm->next_out = job->out;
+    strm->avail_out = job->out_len;
+    while (ret == Z_OK && strm->avail_out) {
+        ret = PREFIX(inflate)(strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            /* skip the trailer that a raw member leaves, and decode the header
+               of the next member */
+            if (raw) {
+                n = strm->avail_in < 8 ? strm->avail_in : 8;
+                strm->next_in += n;
+                strm->avail_in -= n;
+                raw = 0;
+            }
+            ret = strm->avail_out ? PREFIX(inflateReset2)(strm, MAX_WBITS + 16) : Z_OK;
+        }
+    }
+    job->err = ret;
+    job->msg = strm->msg;
+}
+
+/* Decompress the queued jobs in ring order until told to quit. */
+static void *gz_rpar_run(void *arg) {
+    gz_rpar *rpar = (gz_rpar *)arg;
+    PREFIX3(stream) strm;
+    gz_rjob *job;
+    int ret;
+
+    strm.zalloc = NULL;
+    strm.zfree = NULL;
+    strm.opaque = NULL;
+    strm.next_in = NULL;
+    strm.avail_in = 0;
+    ret = PREFIX(inflateInit2)(&strm, -MAX_WBITS);
+
+    z_mutex_lock(&rpar->lock);
+    for (;;) {
+        while (rpar->job[rpar->run].state != GZ_JOB_QUEUED && !rpar->quit)
+            z_cond_wait(&rpar->work, &rpar->lock);
+        if (rpar->quit)
+            break;
+        job = &rpar->job[rpar->run];
+        job->state = GZ_JOB_RUNNING;
+        rpar->run = (rpar->run + 1) % rpar->jobs;
+        z_mutex_unlock(&rpar->lock);
+
+        if (ret == Z_OK)
+            gz_rpar_inflate(job, &strm);
+        else
+            job->err = ret;
+
+        z_mutex_lock(&rpar->lock);
+        job->state = GZ_JOB_DONE;
+        z_cond_broadcast(&rpar->done);
+    }
+    z_mutex_unlock(&rpar->lock);
+    if (ret == Z_OK)
+        PREFIX(inflateEnd)(&strm);
+    return NULL;
+}
+
+/* Allocate the jobs and start state->threads threads.  Return -1 if there is
+   not enough memory or no thread could be started, leaving state->rpar NULL,
+   or 0 on success. */
+static int gz_rpar_init(gz_state *state) {
+    gz_rpar *rpar;
+
+    rpar = (gz_rpar *)calloc(1, sizeof(gz_rpar));
+    if (rpar == NULL)
+        return -1;
+    rpar->jobs = (unsigned)state->threads << 1;
+    rpar->job = (gz_rjob *)calloc(rpar->jobs, sizeof(gz_rjob));
+    if (rpar->job != NULL && z_mutex_init(&rpar->lock) == 0) {
+        if (z_cond_init(&rpar->work) == 0) {
+            if (z_cond_init(&rpar->done) == 0) {
+                while (rpar->started < state->threads &&
+                       z_thread_create(&rpar->thread[rpar->started], gz_rpar_run, rpar) == 0)
+                    rpar->started++;
+                if (rpar->started) {
+                    state->rpar = rpar;
+                    return 0;
+                }
+                z_cond_destroy(&rpar->done);
+            }
+            z_cond_destroy(&rpar->work);
+        }
+        z_mutex_destroy(&rpar->lock);
+    }
+    free(rpar->job);
+    free(rpar);
+    return -1;
+}
+
+/* Wait for the queued jobs and drop them. */
+static void gz_rpar_drain(gz_state *state) {
+    gz_rpar *rpar = state->rpar;
+
+    if (rpar == NULL)
+        return;
+    z_mutex_lock(&rpar->lock);
+    while (rpar->queued) {
+        gz_rjob *job = &rpar->job[rpar->tail];
+
+        while (job->state != GZ_JOB_DONE)
+            z_cond_wait(&rpar->done, &rpar->lock);
+        job->state = GZ_JOB_FREE;
+        rpar->tail = (rpar->tail + 1) % rpar->jobs;
+        rpar->queued--;
+    }
+    z_mutex_unlock(&rpar->lock);
+    rpar->active = 0;
+    rpar->resync = 0;
+    rpar->used = 0;
+}
+
+/* Stop the threads and free the jobs, if running. */
+static void gz_rpar_end(gz_state *state) {
+    gz_rpar *rpar = state->rpar;
+    unsigned i;
+
+    if (rpar == NULL)
+        return;
+    gz_rpar_drain(state);
+    z_mutex_lock(&rpar->lock);
+    rpar->quit = 1;
+    z_cond_broadcast(&rpar->work);
+    z_mutex_unlock(&rpar->lock);
+    for (i = 0; i < (unsigned)rpar->started; i++)
+        z_thread_join(rpar->thread[i]);
+    z_cond_destroy(&rpar->done);
+    z_cond_destroy(&rpar->work);
+    z_mutex_destroy(&rpar->lock);
+    for (i = 0; i < rpar->jobs; i++) {
+        free(rpar->job[i].buf);
+        free(rpar->job[i].out);
+    }
+    free(rpar->job);
+    free(rpar);
+    state->rpar = NULL;
+}
+
+/* Get the extent of region r of the index.  Return 0 if it can be given to a
+   thread, or -1 if it is too large or there is no such region. */
+static int gz_rpar_region(gz_state *state, unsigned r, z_off64_t *in, unsigned *in_len, unsigned *out_len) {
+    gz_index *index = state->index;
+    gz_point *end;
+    z_off64_t from_in, from_out;
+
+    if (r >= index->have)
+        return -1;
+    end = index->list + r;
+    if (r == 0) {
+        from_in = state->start;
+        from_out = 0;
+    } else {
+        from_in = end[-1].in - (end[-1].bits ? 1 : 0);
+        from_out = end[-1].out;
+    }
+    if (end->in - from_in > GZ_RPAR_MAX || end->out - from_out > GZ_RPAR_MAX || end->in <= from_in)
+        return -1;
+    *in = from_in;
+    *in_len = (unsigned)(end->in - from_in);
+    *out_len = (unsigned)(end->out - from_out);
+    return 0;
+}
+
+/* Get the compressed data of the next region and queue it.  Return -1 on
+   error, otherwise 0. */
+static int gz_rpar_queue(gz_state *state) {
+    gz_rpar *rpar = state->rpar;
+    gz_rjob *job = &rpar->job[rpar->head];
+    unsigned r = rpar->next, got, len;
+    z_off64_t in = 0;
+    ssize_t ret;
+
+    (void)gz_rpar_region(state, r, &in, &job->in_len, &job->out_len);
+    if (job->out_size < job->out_len) {
+        free(job->out);
+        job->out = (unsigned char *)malloc(job->out_len);
+        job->out_size = job->out == NULL ? 0 : job->out_len;
+        if (job->out == NULL) {
+            gz_error(state, Z_MEM_ERROR, "out of memory");
+            return -1;
+        }
+    }
+    len = job->in_len;
+#ifdef GZ_MMAP
+    if (state->map != NULL) {
+        if ((uint64_t)in + len > state->map_size) {
+            gz_error(state, Z_BUF_ERROR, "unexpected end of file");
+            return -1;
+        }
+        job->in = state->map + in;
+    } else
+#endif
+    {
+        if (job->buf_size < len) {
+            free(job->buf);
+            job->buf = (unsigned char *)malloc(len);
+            job->buf_size = job->buf == NULL ? 0 : len;
+            if (job->buf == NULL) {
+                gz_error(state, Z_MEM_ERROR, "out of memory");
+                return -1;
+            }
+        }
+        if (LSEEK(state->fd, in, SEEK_SET) == -1) {
+            gz_error(state, Z_ERRNO, zstrerror());
+            return -1;
+        }
+        for (got = 0; got < len; got += (unsigned)ret) {
+            ret = read(state->fd, job->buf + got, len - got);
+            if (ret < 0) {
+                gz_error(state, Z_ERRNO, zstrerror());
+                return -1;
+            }
+            if (ret == 0) {
+                gz_error(state, Z_BUF_ERROR, "unexpected end of file");
+                return -1;
+            }
+        }
+        job->in = job->buf;
+    }
+    job->gzip = r == 0;
+    job->bits = r ? state->index->list[r - 1].bits : 0;
+    job->dict = r ? state->index->list[r - 1].window : NULL;
+    job->dict_len = r ? state->index->list[r - 1].wsize : 0;
+
+    z_mutex_lock(&rpar->lock);
+    job->state = GZ_JOB_QUEUED;
+    z_cond_signal(&rpar->work);
+    z_mutex_unlock(&rpar->lock);
+    rpar->head = (rpar->head + 1) % rpar->jobs;
+    rpar->queued++;
+    rpar->next++;
+    return 0;
+}
+
+/* Like gz_decomp(), but for 'P' with an index: take the output from the
+   threads when the position is at the start of a region or inside the ones
+   being handed out.  Return -1 on error, 0 if data was provided, or 1 if
+   gz_decomp() should go on decompressing itself, in which case avail_out is
+   limited so that it stops at the next access point. */
+static int gz_rpar_decomp(gz_state *state) {
+    gz_index *index = state->index;
+    PREFIX3(stream) *strm = &(state->strm);
+    gz_rpar *rpar;
+    gz_rjob *job;
+    z_off64_t in;
+    unsigned r, in_len, out_len, n;
+
+    if (state->rpar == NULL && gz_rpar_init(state) == -1) {
+        state->threads = 0;         /* decompress without threads */
+        return 1;
+    }
+    rpar = state->rpar;
+
+    /* a seek or a rewind leaves what the threads have */
+    if (state->x.pos != rpar->pos)
+        gz_rpar_drain(state);
+
+    /* restart on this thread after the last region handed out */
+    if (rpar->resync) {
+        rpar->resync = 0;
+        if (gz_index_start(state, index->list + rpar->stop - 1) == -1)
+            return -1;
+    }
+
+    /* start the threads at a region that begins here */
+    if (!rpar->active) {
+        r = state->x.pos == 0 ? 0 : gz_index_find(index, state->x.pos);
+        if (r && index->list[r - 1].out != state->x.pos)
+            r = index->have;
+        rpar->next = r;
+        while (gz_rpar_region(state, r, &in, &in_len, &out_len) == 0)
+            r++;
+        rpar->stop = r;
+        if (rpar->next == rpar->stop) {
+            n = gz_index_find(index, state->x.pos);
+            if (n < index->have && index->list[n].out - state->x.pos < (z_off64_t)strm->avail_out)
+                strm->avail_out = (unsigned)(index->list[n].out - state->x.pos);
+            return 1;
+        }
+        if (state->aio != NULL) {
+            if (gz_aio_wait(state) == -1)
+                return -1;
+            state->aio->have = 0;
+            state->aio->eof = 0;
+        }
+        rpar->active = 1;
+        rpar->pos = state->x.pos;
+        rpar->used = 0;
+    }
+
+    /* keep the threads busy, and wait for the oldest region */
+    while (rpar->next < rpar->stop && rpar->queued < rpar->jobs)
+        if (gz_rpar_queue(state) == -1)
+            return -1;
+    job = &rpar->job[rpar->tail];
+    z_mutex_lock(&rpar->lock);
+    while (job->state != GZ_JOB_DONE)
+        z_cond_wait(&rpar->done, &rpar->lock);
+    z_mutex_unlock(&rpar->lock);
+    if (job->err != Z_OK) {
+        if (job->err == Z_MEM_ERROR)
+            gz_error(state, Z_MEM_ERROR, "out of memory");
+        else
+            gz_error(state, Z_DATA_ERROR, job->msg == NULL ? "compressed data error" : job->msg);
+        return -1;
+    }
+
+    /* hand out what fits */
+    n = job->out_len - rpar->used;
+    if (n > strm->avail_out)
+        n = strm->avail_out;
+    memcpy(strm->next_out, job->out + rpar->used, n);
+    strm->next_out += n;
+    strm->avail_out -= n;
+    state->x.have = n;
+    state->x.next = strm->next_out - n;
+    rpar->used += n;
+    rpar->pos += n;
+    if (rpar->used == job->out_len) {
+        z_mutex_lock(&rpar->lock);
+        job->state = GZ_JOB_FREE;
+        z_mutex_unlock(&rpar->lock);
+        rpar->tail = (rpar->tail + 1) % rpar->jobs;
+        rpar->queued--;
+        rpar->used = 0;
+        if (rpar->queued == 0 && rpar->next == rpar->stop) {
+            rpar->active = 0;
+            rpar->resync = 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+/* Read len bytes at offset off of the file into buf, leaving the file
+   position anywhere.  Return the number of bytes read, which is less than len at the
+   end of the file, or -1 on error. */
+static int gz_index_read(gz_state *state, z_off64_t off, unsigned char *buf, unsigned len) {
+    unsigned got;
+    ssize_t ret;
+
+#ifdef GZ_MMAP
+    if (state->map != NULL) {
+        got = (uint64_t)off < state->map_size ? (unsigned)(state->map_size - (size_t)off < len ?
+                                                           state->map_size - (size_t)off : len) : 0;
+        memcpy(buf, state->map + off, got);
+        return (int)got;
+    }
+#endif
+    if (LSEEK(state->fd, off, SEEK_SET) == -1) {
+        gz_error(state, Z_ERRNO, zstrerror());
+        return -1;
+    }
+    for (got = 0; got < len; got += (unsigned)ret) {
+        ret = read(state->fd, buf + got, len - got);
+        if (ret < 0) {
+            gz_error(state, Z_ERRNO, zstrerror());
+            return -1;
+        }
+        if (ret == 0)
+            break;
+    }
+    return (int)got;
+}
+
+/* Add access points at the starts of the data members from the index that
+   'B' writes at the end of the file, which takes reading only that index.
+   Return 1 if the points were added, 0 if there is no such index or it is not
+   for all of the file from state->start, leaving index empty, or -1 on
+   error. */
+static int gz_index_tail(gz_state *state, gz_index *index, z_off64_t span) {
+    static const unsigned char eof[GZ_BGZF_EOF] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0,
+                                                   27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    unsigned char tail[GZ_BGZF_LOC + GZ_BGZF_EOF], *buf, *entry;
+    z_off64_t end, loc, at, in = 0, out = 0, last = 0;
+    uint64_t back, count, have = 0;
+    unsigned xlen, total, i;
+    gz_point *point;
+    int got;
+
+    /* find the locator */
+#ifdef GZ_MMAP
+    if (state->map != NULL)
+        end = (z_off64_t)state->map_size;
+    else
+#endif
+        end = LSEEK(state->fd, 0, SEEK_END);
+    if (end == -1 || end - state->start < (z_off64_t)sizeof(tail))
+        return 0;
+    loc = end - (z_off64_t)sizeof(tail);
+    got = gz_index_read(state, loc, tail, sizeof(tail));
+    if (got == -1)
+        return -1;
+    if (got < (int)sizeof(tail) || memcmp(tail + GZ_BGZF_LOC, eof, GZ_BGZF_EOF) ||
+        memcmp(tail, eof, 10) || tail[10] != 26 || tail[11] != 0 || memcmp(tail + 12, eof + 12, 4) ||
+        tail[16] != GZ_BGZF_LOC - 1 || tail[17] != 0 || tail[18] != 'Z' || tail[19] != 'L' ||
+        tail[20] != 16 || tail[21] != 0)
+        return 0;
+    back = gz_index_get(tail + 22, 8);
+    count = gz_index_get(tail + 30, 8);
+    if (back > (uint64_t)(loc - state->start))
+        return 0;
+
+    /* add a point for each data member from the index members */
+    buf = (unsigned char *)malloc(GZ_BGZF_MAX);
+    if (buf == NULL) {
+        gz_error(state, Z_MEM_ERROR, "out of memory");
+        return -1;
+    }
+    for (at = loc - (z_off64_t)back; at < loc; at += total) {
+        got = gz_index_read(state, at, buf, GZ_BGZF_HEAD + 4);
+        if (got == -1)
+            goto fail;
+        if (got < GZ_BGZF_HEAD + 4 || memcmp(buf, eof, 10) || memcmp(buf + 12, eof + 12, 4) ||
+            buf[18] != 'Z' || buf[19] != 'I')
+            break;
+        xlen = buf[10] + ((unsigned)buf[11] << 8);
+        total = buf[16] + ((unsigned)buf[17] << 8) + 1;
+        if (xlen != 10 + buf[20] + ((unsigned)buf[21] << 8) || ((xlen - 10) & 3) || total != 12 + xlen + 10 ||
+            total > loc - at)
+            break;
+        got = gz_index_read(state, at, buf, total);
+        if (got == -1)
+            goto fail;
+        if (got < (int)total)
+            break;
+        for (i = 0, entry = buf + 22; i < (xlen - 10) >> 2; i++, entry += 4) {
+            if (out - last >= span) {
+                point = gz_index_grow(index, 0);
+                if (point == NULL) {
+                    gz_error(state, Z_MEM_ERROR, "out of memory");
+                    goto fail;
+                }
+                point->out = out;
+                point->in = state->start + in + GZ_BGZF_HEAD;
+                point->bits = 0;
+                index->have++;
+                last = out;
+            }
+            in += entry[0] + ((unsigned)entry[1] << 8) + 1;
+            out += entry[2] + ((unsigned)entry[3] << 8);
+            have++;
+        }
+    }
+    free(buf);
+
+    /* the data members must be all of what comes before the index */
+    if (at == loc && have == count && state->start + in == loc - (z_off64_t)back)
+        return 1;
+    while (index->have)
+        free(index->list[--index->have].window);
+    return 0;
+
+  fail:
+    free(buf);
+    return -1;
+}
+
+/* Add access points at the starts of the gzip members if every member is in
+   the BGZF form, which gives its compressed length in a "BC" extra subfield,
+   using its trailer for the uncompressed length.  That reads only the headers
+   and trailers.  Return 1 if the points were added, 0 if the file is not all
+   BGZF members, leaving index empty, or -1 on error. */
+static int gz_index_bgzf(gz_state *state, gz_index *index, z_off64_t span) {
+    unsigned char head[18], tail[4];
+    z_off64_t at = state->start, out = 0, last = 0;
+    unsigned xlen, total;
+    gz_point *point;
+    int got;
+
+    /* use the index of 'B' if the file ends with one */
+    got = gz_index_tail(state, index, span);
+    if (got)
+        return got;
+
+    for (;;) {
+        got = gz_index_read(state, at, head, sizeof(head));
+        if (got == -1)
+            return -1;
+        if (got == 0 && at != state->start)
+            return 1;
+        if (got < (int)sizeof(head) || head[0] != 31 || head[1] != 139 || head[2] != 8 || head[3] != 4 ||
+            head[12] != 'B' || head[13] != 'C' || head[14] != 2 || head[15] != 0)
+            break;
+        xlen = head[10] + ((unsigned)head[11] << 8);
+        total = head[16] + ((unsigned)head[17] << 8) + 1;
+        if (xlen < 6 || total < 12 + xlen + 8)
+            break;
+        got = gz_index_read(state, at + total - 4, tail, sizeof(tail));
+        if (got == -1)
+            return -1;
+        if (got < (int)sizeof(tail))
+            break;
+        if (out - last >= span) {
+            point = gz_index_grow(index, 0);
+            if (point == NULL) {
+                gz_error(state, Z_MEM_ERROR, "out of memory");
+                return -1;
+            }
+            point->out = out;
+            point->in = at + 12 + xlen;
+            point->bits = 0;
+            index->have++;
+            last = out;
+        }
+        out += (z_off64_t)gz_index_get(tail, 4);
+        at += total;
+    }
+
+    /* not BGZF, drop what was found and go back to the start */
+    while (index->have)
+        free(index->list[--index->have].window);
+    if (LSEEK(state->fd, state->start, SEEK_SET) == -1) {
+        gz_error(state, Z_ERRNO, zstrerror());
+        return -1;
+    }
+    return 0;
+}
+
+/* The first time that a seek or 'P' could use an index and there is none,
+   look for the one that 'B' writes at the end of the file, leaving the file
+   position as it was.  Return -1 on error, 0 otherwise. */
+static int gz_index_auto(gz_state *state) {
+    gz_index *index;
+    z_off64_t pos = -1;
+    int ret;
+
+    if (state->tail || state->index != NULL)
+        return 0;
+    state->tail = 1;
+#ifdef GZ_MMAP
+    if (state->map == NULL)
+#endif
+    {
+#ifdef GZ_AIO
+        if (state->aio != NULL && gz_aio_wait(state) == -1)
+            return -1;
+#endif
+        pos = LSEEK(state->fd, 0, SEEK_CUR);
+        if (pos == -1)          /* not seekable */
+            return 0;
+    }
+    index = (gz_index *)malloc(sizeof(gz_index));
+    if (index == NULL) {
+        gz_error(state, Z_MEM_ERROR, "out of memory");
+        return -1;
+    }
+    index->have = 0;
+    index->size = 0;
+    index->list = NULL;
+    ret = gz_index_tail(state, index, 1);
+    if (pos != -1 && LSEEK(state->fd, pos, SEEK_SET) == -1) {
+        gz_error(state, Z_ERRNO, zstrerror());
+        ret = -1;
+    }
+    if (ret == 1 && index->have)
+        state->index = index;
+    else
+        gz_index_free(index);
+    return ret == -1 ? -1 : 0;
+}
+
+/* -- see zlib-ng.h -- */
+int ZEXPORT PREFIX(gzindex_build)(gzFile file, z_off64_t span) {
+    gz_state *state;
+    PREFIX3(stream) *strm;
+    gz_index *index;
+    z_off64_t pos, out, last;
+    unsigned had;
+    int ret, bgzf;
+
+    /* get internal structure */
+    if (file == NULL)
+        return -1;
+    state = (gz_state *)file;
+    strm = &(state->strm);
+
+    /* check that we're reading and that there's no (serious) error */
+    if (state->mode != GZ_READ || (state->err != Z_OK && state->err != Z_BUF_ERROR) || span <= 0)
+        return -1;
+
+    /* drop the old index and start over */
+    pos = PREFIX(gztell64)(file);
+#ifdef GZ_RPAR
+    gz_rpar_drain(state);
+#endif
+    gz_index_free(state->index);
+    state->index = NULL;
+    index = (gz_index *)malloc(sizeof(gz_index));
+    if (index == NULL) {
+        gz_error(state, Z_MEM_ERROR, "out of memory");
+        return -1;
+    }
+    index->have = 0;
+    index->size = 0;
+    index->list = NULL;
+    if (PREFIX(gzrewind)(file) == -1) {
+        gz_index_free(index);
+        return -1;
+    }
+
+    /* decompress each gzip stream a block at a time, adding a point on the
+       first block boundary after every span bytes of output, unless the
+       members say where they are */
+    bgzf = gz_index_bgzf(state, index, span);
+    if (bgzf == -1)
+        goto fail;
+    out = last = 0;
+    while (!bgzf) {
+        if (gz_look(state) == -1 || gz_whole_end(state) == -1)
+            goto fail;
+        if (state->how != GZIP)     /* end of input, trailing garbage, or not gzip */
+            break;
+        do {
+            if (strm->avail_in == 0 && gz_avail(state) == -1)
+                goto fail;
+            if (strm->avail_in == 0) {
+                gz_error(state, Z_BUF_ERROR, "unexpected end of file");
+                goto fail;
+            }
+            had = state->size << 1;
+            strm->next_out = state->out;
+            strm->avail_out = had;
+            ret = PREFIX(inflate)(strm, Z_BLOCK);
+            out += had - strm->avail_out;
+            if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT) {
+                gz_error(state, Z_STREAM_ERROR, "internal error: inflate stream corrupt");
+                goto fail;
+            }
+            if (ret == Z_MEM_ERROR) {
+                gz_error(state, Z_MEM_ERROR, "out of memory");
+                goto fail;
+            }
+            if (ret == Z_DATA_ERROR) {
+                gz_error(state, Z_DATA_ERROR, strm->msg == NULL ? "compressed data error" : strm->msg);
+                goto fail;
+            }
+            if ((strm->data_type & 192) == 128 && out - last >= span) {
+                if (gz_index_add(state, index, out) == -1)
+                    goto fail;
+                last = out;
+            }
+        } while (ret != Z_STREAM_END);
+        state->how = LOOK;
+    }
+
+    /* go back to where the file was, using the new index */
+    state->index = index;
+    if (PREFIX(gzrewind)(file) == -1 || (pos && PREFIX(gzseek64)(file, pos, SEEK_SET) == -1))
+        return -1;
+    return (int)index->have;
+
+  fail:
+    gz_index_free(index);
+    return -1;
+}
+
+/* -- see zlib-ng.h -- */
+size_t ZEXPORT PREFIX(gzindex_save)(gzFile file, void *buf, size_t len) {
+    gz_state *state;
+    gz_index *index;
+    unsigned char *next;
+    size_t size;
+    unsigned i;
+
+    /* get internal structure */
+    if (file == NULL)
+        return 0;
+    state = (gz_state *)file;
+    index = state->index;
+    if (state->mode != GZ_READ || index == NULL)
+        return 0;
+
+    /* get the length, and stop there if it does not fit */
+    size = GZ_INDEX_HEAD;
+    for (i = 0; i < index->have; i++)
+        size += GZ_INDEX_POINT + index->list[i].wsize;
+    if (buf == NULL || len < size)
+        return size;
+
+    next = (unsigned char *)buf;
+    memcpy(next, gz_index_magic, sizeof(gz_index_magic));
+    gz_index_put(next + 8, index->have, 4);
+    next += GZ_INDEX_HEAD;
+    for (i = 0; i < index->have; i++) {
+        gz_point *point = index->list + i;
+
+        gz_index_put(next, (uint64_t)point->out, 8);
+        gz_index_put(next + 8, (uint64_t)point->in, 8);
+        next[16] = (unsigned char)point->bits;
+        gz_index_put(next + 17, point->wsize, 2);
+        memcpy(next + GZ_INDEX_POINT, point->window, point->wsize);
+        next += GZ_INDEX_POINT + point->wsize;
+    }
+    return size;
+}
+
+/* -- see zlib-ng.h -- */
+int ZEXPORT PREFIX(gzindex_load)(gzFile file, const void *buf, size_t len) {
+    gz_state *state;
+    gz_index *index;
+    const unsigned char *next, *end;
+    uint64_t have, i;
+
+    /* get internal structure */
+    if (file == NULL || buf == NULL)
+        return -1;
+    state = (gz_state *)file;
+    if (state->mode != GZ_READ)
+        return -1;
+
+    next = (const unsigned char *)buf;
+    end = next + len;
+    if (len < GZ_INDEX_HEAD || memcmp(next, gz_index_magic, sizeof(gz_index_magic)))
+        return -1;
+    have = gz_index_get(next + 8, 4);
+    if (have > INT_MAX)
+        return -1;
+    next += GZ_INDEX_HEAD;
+
+    index = (gz_index *)malloc(sizeof(gz_index));
+    if (index == NULL) {
+        gz_error(state, Z_MEM_ERROR, "out of memory");
+        return -1;
+    }
+    index->have = 0;
+    index->size = 0;
+    index->list = NULL;
+    for (i = 0; i < have; i++) {
+        uint64_t out, in;
+        unsigned bits, wsize;
+        gz_point *point;
+
+        /* check the point against the end of the buffer and the one before */
+        if ((size_t)(end - next) < GZ_INDEX_POINT)
+            goto invalid;
+        out = gz_index_get(next, 8);
+        in = gz_index_get(next + 8, 8);
+        bits = next[16];
+        wsize = (unsigned)gz_index_get(next + 17, 2);
+        next += GZ_INDEX_POINT;
+        if ((z_off64_t)out <= 0 || (uint64_t)(z_off64_t)out != out || (z_off64_t)in < 0 ||
+            (uint64_t)(z_off64_t)in != in || bits > 7 || wsize > GZ_INDEX_WINDOW ||
+            (size_t)(end - next) < wsize ||
+            (index->have && ((z_off64_t)out <= index->list[index->have - 1].out ||
+                             (z_off64_t)in < index->list[index->have - 1].in)))
+            goto invalid;
+
+        point = gz_index_grow(index, wsize);
+        if (point == NULL) {
+            gz_index_free(index);
+            gz_error(state, Z_MEM_ERROR, "out of memory");
+            return -1;
+        }
+        memcpy(point->window, next, wsize);
+        next += wsize;
+        point->out = (z_off64_t)out;
+        point->in = (z_off64_t)in;
+        point->bits = (int)bits;
+        index->have++;
+    }
+    if (next != end)
+        goto invalid;
+
+#ifdef GZ_RPAR
+    gz_rpar_drain(state);
+#endif
+    gz_index_free(state->index);
+    state->index = index;
+    return (int)index->have;
+
+  invalid:
+    gz_index_free(index);
+    return -1;
+}
+#endif
+
 /* -- see zlib.h -- */
 int ZEXPORT PREFIX(gzclose_r)(gzFile file) {
     int ret, err;
@@ -585,11 +2097,26 @@ int ZEXPORT PREFIX(gzclose_r)(gzFile file) {
         return Z_STREAM_ERROR;
 
     /* free memory and close file */
+#ifdef GZ_RPAR
+    gz_rpar_end(state);
+#endif
+#ifdef GZ_AIO
+    gz_aio_end(state);
+#endif
     if (state->size) {
         PREFIX(inflateEnd)(&(state->strm));
         free(state->out);
         free(state->in);
     }
+#ifdef GZ_MMAP
+    if (state->map != NULL)
+        munmap(state->map, state->map_size);
+#endif
+    if (state->drop)
+        gz_drop(state, 1);
+#ifndef ZLIB_COMPAT
+    gz_index_free(state->index);
+#endif
     err = state->err == Z_BUF_ERROR ? Z_BUF_ERROR : Z_OK;
     gz_error(state, Z_OK, NULL);
     free(state->path);
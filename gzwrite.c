@@ -10,9 +10,563 @@
 /* Local functions */
 static int gz_init(gz_state *);
 static int gz_comp(gz_state *, int);
+static int gz_bgzf_write(gz_state *, const unsigned char *, unsigned);
+static unsigned gz_bgzf_member(PREFIX3(stream) *, int, int, const unsigned char *, unsigned, unsigned char *);
+static int gz_bgzf_note(gz_state *, unsigned, unsigned);
+static int gz_bgzf_put(gz_state *, const unsigned char *, unsigned);
+static int gz_bgzf_comp(gz_state *, int);
+static int gz_bgzf_end(gz_state *);
+#ifdef GZ_AIO
+static int gz_par_init(gz_state *);
+static int gz_par_comp(gz_state *, int);
+static void gz_par_end(gz_state *);
+#endif
 static int gz_zero(gz_state *, z_off64_t);
 static size_t gz_write(gz_state *, void const *, size_t);
 
+/* gzip header of a BGZF member up to its length, and the empty member that
+   ends a BGZF file */
+static const unsigned char gz_bgzf_head[16] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0};
+static const unsigned char gz_bgzf_eof[GZ_BGZF_EOF] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0,
+                                                       27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/* Write len bytes at buf to the file.  Return -1 on a write error, or 0 on
+   success. */
+static int gz_bgzf_write(gz_state *state, const unsigned char *buf, unsigned len) {
+    ssize_t got;
+    unsigned have;
+
+    for (have = 0; have < len; have += (unsigned)got) {
+        got = write(state->fd, buf + have, len - have);
+        if (got <= 0) {
+            gz_error(state, Z_ERRNO, zstrerror());
+            return -1;
+        }
+    }
+    if (len && state->drop)
+        gz_drop(state, 0);
+    return 0;
+}
+
+/* Compress the len bytes at in, at most GZ_BGZF_BLOCK, into one BGZF member
+   at out, which has room for GZ_BGZF_MAX bytes, using strm set up for raw
+   deflate.  Input that does not fit compressed is stored.  Return the length
+   of the member, or 0 on a deflate error. */
+static unsigned gz_bgzf_member(PREFIX3(stream) *strm, int level, int strategy, const unsigned char *in,
+                               unsigned len, unsigned char *out) {
+    uint32_t check;
+    unsigned n;
+    int ret;
+
+    if (PREFIX(deflateReset)(strm) != Z_OK || PREFIX(deflateParams)(strm, level, strategy) != Z_OK)
+        return 0;
+    strm->next_in = in;
+    strm->avail_in = len;
+    strm->next_out = out + GZ_BGZF_HEAD;
+    strm->avail_out = GZ_BGZF_MAX - GZ_BGZF_HEAD - 8;
+    ret = PREFIX(deflate)(strm, Z_FINISH);
+    if (ret == Z_STREAM_END)
+        n = GZ_BGZF_MAX - GZ_BGZF_HEAD - 8 - strm->avail_out;
+    else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+        /* one stored block */
+        out[GZ_BGZF_HEAD] = 1;
+        out[GZ_BGZF_HEAD + 1] = (unsigned char)len;
+        out[GZ_BGZF_HEAD + 2] = (unsigned char)(len >> 8);
+        out[GZ_BGZF_HEAD + 3] = (unsigned char)~len;
+        out[GZ_BGZF_HEAD + 4] = (unsigned char)(~len >> 8);
+        memcpy(out + GZ_BGZF_HEAD + 5, in, len);
+        n = len + 5;
+    } else
+        return 0;
+    n += GZ_BGZF_HEAD + 8;
+
+    memcpy(out, gz_bgzf_head, sizeof(gz_bgzf_head));
+    out[16] = (unsigned char)(n - 1);
+    out[17] = (unsigned char)((n - 1) >> 8);
+    check = (uint32_t)PREFIX(crc32)(0, in, len);
+    out += n - 8;
+    out[0] = (unsigned char)check;
+    out[1] = (unsigned char)(check >> 8);
+    out[2] = (unsigned char)(check >> 16);
+    out[3] = (unsigned char)(check >> 24);
+    out[4] = (unsigned char)len;
+    out[5] = (unsigned char)(len >> 8);
+    out[6] = 0;
+    out[7] = 0;
+    return n;
+}
+
+/* Add a member of size bytes holding len bytes of input to the list for the
+   index.  Return -1 if out of memory, or 0 on success. */
+static int gz_bgzf_note(gz_state *state, unsigned size, unsigned len) {
+    unsigned char *entry;
+
+    if (state->bgzf_count == state->bgzf_size) {
+        uint64_t more = state->bgzf_size ? state->bgzf_size << 1 : 1024;
+        unsigned char *list = (size_t)(more << 2) >> 2 != more ? NULL :
+                              (unsigned char *)realloc(state->bgzf_list, (size_t)(more << 2));
+
+        if (list == NULL) {
+            gz_error(state, Z_MEM_ERROR, "out of memory");
+            return -1;
+        }
+        state->bgzf_list = list;
+        state->bgzf_size = more;
+    }
+    entry = state->bgzf_list + (size_t)(state->bgzf_count++ << 2);
+    entry[0] = (unsigned char)(size - 1);
+    entry[1] = (unsigned char)((size - 1) >> 8);
+    entry[2] = (unsigned char)len;
+    entry[3] = (unsigned char)(len >> 8);
+    return 0;
+}
+
+/* Compress the len bytes at in into a member and write it.  Return -1 on
+   error, or 0 on success. */
+static int gz_bgzf_put(gz_state *state, const unsigned char *in, unsigned len) {
+    unsigned char *out = state->bgzf_in + GZ_BGZF_BLOCK;
+    unsigned n;
+
+    n = gz_bgzf_member(&(state->strm), state->level, state->strategy, in, len, out);
+    if (n == 0) {
+        gz_error(state, Z_STREAM_ERROR, "internal error: deflate stream corrupt");
+        return -1;
+    }
+    if (gz_bgzf_write(state, out, n) == -1)
+        return -1;
+    return gz_bgzf_note(state, n, len);
+}
+
+/* Like gz_comp(), but for 'B' without 'P': gather the input into members of
+   GZ_BGZF_BLOCK bytes, writing each one when it is full, and what there is of
+   the last one on any flush. */
+static int gz_bgzf_comp(gz_state *state, int flush) {
+    PREFIX3(stream) *strm = &(state->strm);
+    const unsigned char *next = strm->next_in;
+    unsigned left = strm->avail_in, n;
+
+    strm->avail_in = 0;
+    while (left) {
+        if (state->bgzf_have == 0 && left >= GZ_BGZF_BLOCK) {
+            /* a whole member straight from the input */
+            n = GZ_BGZF_BLOCK;
+            if (gz_bgzf_put(state, next, n) == -1)
+                return -1;
+        } else {
+            n = GZ_BGZF_BLOCK - state->bgzf_have;
+            if (n > left)
+                n = left;
+            memcpy(state->bgzf_in + state->bgzf_have, next, n);
+            state->bgzf_have += n;
+            if (state->bgzf_have == GZ_BGZF_BLOCK) {
+                if (gz_bgzf_put(state, state->bgzf_in, GZ_BGZF_BLOCK) == -1)
+                    return -1;
+                state->bgzf_have = 0;
+            }
+        }
+        next += n;
+        left -= n;
+    }
+
+    if (flush != Z_NO_FLUSH && state->bgzf_have) {
+        if (gz_bgzf_put(state, state->bgzf_in, state->bgzf_have) == -1)
+            return -1;
+        state->bgzf_have = 0;
+    }
+    return 0;
+}
+
+/* Make an empty BGZF member at out with a subfield named id after the "BC"
+   one, holding the len bytes at data.  Return the length of the member. */
+static unsigned gz_bgzf_empty(unsigned char *out, const char *id, const unsigned char *data, unsigned len) {
+    unsigned xlen = 6 + 4 + len, n = 12 + xlen + 2 + 8;
+
+    memcpy(out, gz_bgzf_head, sizeof(gz_bgzf_head));
+    out[10] = (unsigned char)xlen;
+    out[11] = (unsigned char)(xlen >> 8);
+    out[16] = (unsigned char)(n - 1);
+    out[17] = (unsigned char)((n - 1) >> 8);
+    out[18] = (unsigned char)id[0];
+    out[19] = (unsigned char)id[1];
+    out[20] = (unsigned char)len;
+    out[21] = (unsigned char)(len >> 8);
+    memcpy(out + 22, data, len);
+    out += 22 + len;
+    out[0] = 3;     /* last fixed block with nothing in it */
+    memset(out + 1, 0, 9);
+    return n;
+}
+
+/* Write the index members, the locator, and the end-of-file member after the
+   data members.  Return -1 on error, or 0 on success. */
+static int gz_bgzf_end(gz_state *state) {
+    unsigned char *out = state->bgzf_in + GZ_BGZF_BLOCK, loc[16];
+    uint64_t done, back = 0;
+    unsigned k, n;
+
+    for (done = 0; done < state->bgzf_count; done += k) {
+        k = state->bgzf_count - done < GZ_BGZF_ENTRIES ? (unsigned)(state->bgzf_count - done) : GZ_BGZF_ENTRIES;
+        n = gz_bgzf_empty(out, "ZI", state->bgzf_list + (size_t)(done << 2), k << 2);
+        if (gz_bgzf_write(state, out, n) == -1)
+            return -1;
+        back += n;
+    }
+    for (k = 0; k < 8; k++) {
+        loc[k] = (unsigned char)(back >> (k << 3));
+        loc[8 + k] = (unsigned char)(state->bgzf_count >> (k << 3));
+    }
+    n = gz_bgzf_empty(out, "ZL", loc, sizeof(loc));
+    if (gz_bgzf_write(state, out, n) == -1 || gz_bgzf_write(state, gz_bgzf_eof, GZ_BGZF_EOF) == -1)
+        return -1;
+    return 0;
+}
+
+#ifdef GZ_AIO
+/* With 'P', the input is cut into chunks that are compressed by a pool of
+   threads, and the compressed chunks are written in order by the calling
+   thread.  Every chunk but the first of a gzip member is primed with the 32K
+   of input before it as a dictionary, and ends with a sync flush so that the
+   chunks concatenate into one deflate stream.  The first chunk is compressed
+   as gzip to get the header, and the calling thread writes the trailer from
+   the combined check values, unless the member fits in that one chunk.  The
+   chunk boundaries only depend on the flushes, so the output is the same for
+   any number of threads.  With 'B', each chunk is of GZ_BGZF_BLOCK bytes and
+   is compressed into a BGZF member of its own. */
+#define GZ_PAR_CHUNK 131072     /* input bytes compressed by each job */
+#define GZ_PAR_DICT 32768       /* dictionary bytes kept before the input */
+#define GZ_PAR_OUT (GZ_PAR_CHUNK + (GZ_PAR_CHUNK >> 3) + (GZ_PAR_CHUNK >> 6) + 64)
+
+typedef struct {
+    int state;              /* one of GZ_JOB_* */
+    unsigned char *in;      /* GZ_PAR_DICT bytes for the dictionary, then the input */
+    unsigned dict;          /* bytes of dictionary just before the input */
+    unsigned len;           /* bytes of input */
+    unsigned char *out;     /* GZ_PAR_OUT bytes for the output and the trailer */
+    unsigned out_len;       /* bytes of output */
+    int level;              /* compression level when queued */
+    int strategy;           /* compression strategy when queued */
+    int first;              /* true for the first chunk of a gzip member */
+    int flush;              /* Z_SYNC_FLUSH, or Z_FINISH for the last chunk */
+    int bgzf;               /* true if the chunk is a whole BGZF member for 'B' */
+    uint32_t check;         /* crc32 of the input */
+    int err;                /* deflate() error, or Z_OK */
+} gz_job;
+
+typedef struct gz_par_s {
+    z_mutex_t lock;         /* protects job states, run, and quit */
+    z_cond_t work;          /* signals a queued job or quit */
+    z_cond_t done;          /* signals a finished job */
+    z_thread_t thread[GZ_MAX_THREADS];
+    int started;            /* number of threads running */
+    int quit;               /* the threads should exit */
+    gz_job *job;            /* ring of jobs, twice as many as threads */
+    unsigned jobs;          /* number of jobs in the ring */
+    unsigned head;          /* job being filled */
+    unsigned tail;          /* oldest job not written */
+    unsigned run;           /* next job for a thread to take */
+    unsigned queued;        /* number of jobs queued and not written */
+    int member;             /* true if a chunk of the gzip member was queued */
+    uint32_t check;         /* crc32 of the member written so far */
+    uint32_t isize;         /* length of the member written so far, modulo 2^32 */
+} gz_par;
+
+/* Compress one job as the next part of the gzip member. */
+static void gz_par_deflate(gz_job *job) {
+    PREFIX3(stream) strm;
+    int ret;
+
+    strm.zalloc = NULL;
+    strm.zfree = NULL;
+    strm.opaque = NULL;
+    ret = PREFIX(deflateInit2)(&strm, job->level, Z_DEFLATED, job->first && !job->bgzf ? MAX_WBITS + 16 : -MAX_WBITS,
+                               DEF_MEM_LEVEL, job->strategy);
+    if (ret != Z_OK) {
+        job->err = ret;
+        return;
+    }
+    if (job->bgzf) {
+        job->out_len = gz_bgzf_member(&strm, job->level, job->strategy, job->in + GZ_PAR_DICT, job->len, job->out);
+        job->err = job->out_len ? Z_OK : Z_STREAM_ERROR;
+        (void)PREFIX(deflateEnd)(&strm);
+        return;
+    }
+    if (job->dict)
+        ret = PREFIX(deflateSetDictionary)(&strm, job->in + GZ_PAR_DICT - job->dict, job->dict);
+    strm.next_in = job->in + GZ_PAR_DICT;
+    strm.avail_in = job->len;
+    strm.next_out = job->out;
+    strm.avail_out = GZ_PAR_OUT - 8;
+    if (ret == Z_OK) {
+        do {
+            ret = PREFIX(deflate)(&strm, job->flush);
+        } while (ret == Z_OK && strm.avail_out != 0 && (job->flush == Z_FINISH || strm.avail_in != 0));
+        if (ret == Z_OK || ret == Z_STREAM_END)
+            ret = strm.avail_in == 0 && strm.avail_out != 0 ? Z_OK : Z_BUF_ERROR;
+    }
+    job->out_len = GZ_PAR_OUT - 8 - strm.avail_out;
+    job->err = ret;
+    (void)PREFIX(deflateEnd)(&strm);
+    job->check = (uint32_t)PREFIX(crc32)(0, job->in + GZ_PAR_DICT, job->len);
+}
+
+/* Compress the queued jobs in ring order until told to quit. */
+static void *gz_par_run(void *arg) {
+    gz_par *par = (gz_par *)arg;
+    gz_job *job;
+
+    z_mutex_lock(&par->lock);
+    for (;;) {
+        while (par->job[par->run].state != GZ_JOB_QUEUED && !par->quit)
+            z_cond_wait(&par->work, &par->lock);
+        if (par->quit)
+            break;
+        job = &par->job[par->run];
+        job->state = GZ_JOB_RUNNING;
+        par->run = (par->run + 1) % par->jobs;
+        z_mutex_unlock(&par->lock);
+
+        gz_par_deflate(job);
+
+        z_mutex_lock(&par->lock);
+        job->state = GZ_JOB_DONE;
+        z_cond_broadcast(&par->done);
+    }
+    z_mutex_unlock(&par->lock);
+    return NULL;
+}
+
+/* Allocate the jobs and start state->threads threads.  Return -1 if there is
+   not enough memory or no thread could be started, leaving state->par NULL,
+   or 0 on success. */
+static int gz_par_init(gz_state *state) {
+    gz_par *par;
+    unsigned i;
+
+    par = (gz_par *)calloc(1, sizeof(gz_par));
+    if (par == NULL)
+        return -1;
+    par->jobs = (unsigned)state->threads << 1;
+    par->job = (gz_job *)calloc(par->jobs, sizeof(gz_job));
+    if (par->job == NULL) {
+        free(par);
+        return -1;
+    }
+    for (i = 0; i < par->jobs; i++) {
+        par->job[i].in = (unsigned char *)malloc(GZ_PAR_DICT + GZ_PAR_CHUNK);
+        par->job[i].out = (unsigned char *)malloc(GZ_PAR_OUT);
+        if (par->job[i].in == NULL || par->job[i].out == NULL)
+            break;
+    }
+    if (i == par->jobs && z_mutex_init(&par->lock) == 0) {
+        if (z_cond_init(&par->work) == 0) {
+            if (z_cond_init(&par->done) == 0) {
+                while (par->started < state->threads &&
+                       z_thread_create(&par->thread[par->started], gz_par_run, par) == 0)
+                    par->started++;
+                if (par->started) {
+                    state->par = par;
+                    return 0;
+                }
+                z_cond_destroy(&par->done);
+            }
+            z_cond_destroy(&par->work);
+        }
+        z_mutex_destroy(&par->lock);
+    }
+    for (i = 0; i < par->jobs; i++) {
+        free(par->job[i].in);
+        free(par->job[i].out);
+    }
+    free(par->job);
+    free(par);
+    return -1;
+}
+
+/* Wait for the oldest job and write its output, and the gzip trailer after
+   the last chunk of a member.  Return -1 on error, otherwise 0. */
+static int gz_par_write(gz_state *state) {
+    gz_par *par = state->par;
+    gz_job *job = &par->job[par->tail];
+    unsigned char *out;
+    ssize_t got;
+    unsigned have;
+
+    z_mutex_lock(&par->lock);
+    while (job->state != GZ_JOB_DONE)
+        z_cond_wait(&par->done, &par->lock);
+    z_mutex_unlock(&par->lock);
+    if (job->err != Z_OK) {
+        gz_error(state, job->err == Z_MEM_ERROR ? Z_MEM_ERROR : Z_STREAM_ERROR,
+                 job->err == Z_MEM_ERROR ? "out of memory" : "internal error: deflate stream corrupt");
+        return -1;
+    }
+
+    /* the first chunk of a member that is also its last has its trailer */
+    if (job->first) {
+        par->check = job->check;
+        par->isize = job->len;
+    } else {
+        par->check = (uint32_t)PREFIX(crc32_combine)(par->check, job->check, (z_off_t)job->len);
+        par->isize += job->len;
+        if (job->flush == Z_FINISH) {
+            out = job->out + job->out_len;
+            out[0] = (unsigned char)par->check;
+            out[1] = (unsigned char)(par->check >> 8);
+            out[2] = (unsigned char)(par->check >> 16);
+            out[3] = (unsigned char)(par->check >> 24);
+            out[4] = (unsigned char)par->isize;
+            out[5] = (unsigned char)(par->isize >> 8);
+            out[6] = (unsigned char)(par->isize >> 16);
+            out[7] = (unsigned char)(par->isize >> 24);
+            job->out_len += 8;
+        }
+    }
+
+    for (have = 0; have < job->out_len; have += (unsigned)got) {
+        got = write(state->fd, job->out + have, job->out_len - have);
+        if (got <= 0) {
+            gz_error(state, Z_ERRNO, zstrerror());
+            return -1;
+        }
+    }
+    if (state->drop)
+        gz_drop(state, 0);
+    if (job->bgzf && gz_bgzf_note(state, job->out_len, job->len) == -1)
+        return -1;
+
+    z_mutex_lock(&par->lock);
+    job->state = GZ_JOB_FREE;
+    z_mutex_unlock(&par->lock);
+    par->tail = (par->tail + 1) % par->jobs;
+    par->queued--;
+    return 0;
+}
+
+/* Return true if job is done, reading its state under the lock with which the
+   threads change it. */
+static int gz_par_done(gz_par *par, gz_job *job) {
+    int done;
+
+    z_mutex_lock(&par->lock);
+    done = job->state == GZ_JOB_DONE;
+    z_mutex_unlock(&par->lock);
+    return done;
+}
+
+/* Queue the job being filled to end with flush, and set up the next one,
+   priming it with the end of this input if the member continues and dict is
+   true.  Return -1 on error, otherwise 0. */
+static int gz_par_queue(gz_state *state, int flush, int dict) {
+    gz_par *par = state->par;
+    gz_job *job = &par->job[par->head], *next;
+    unsigned n;
+
+    job->level = state->level;
+    job->strategy = state->strategy;
+    job->first = !par->member;
+    job->flush = flush;
+    job->bgzf = state->bgzf;
+    par->member = flush != Z_FINISH;
+    z_mutex_lock(&par->lock);
+    job->state = GZ_JOB_QUEUED;
+    z_cond_signal(&par->work);
+    z_mutex_unlock(&par->lock);
+    par->queued++;
+    par->head = (par->head + 1) % par->jobs;
+
+    /* write what is done, waiting if the ring is full */
+    while (par->queued == par->jobs ||
+           (par->queued && gz_par_done(par, &par->job[par->tail])))
+        if (gz_par_write(state) == -1)
+            return -1;
+
+    next = &par->job[par->head];
+    next->len = 0;
+    next->dict = 0;
+    if (par->member && dict) {
+        n = job->dict + job->len;
+        if (n > GZ_PAR_DICT)
+            n = GZ_PAR_DICT;
+        memcpy(next->in + GZ_PAR_DICT - n, job->in + GZ_PAR_DICT + job->len - n, n);
+        next->dict = n;
+    }
+    return 0;
+}
+
+/* Like gz_comp(), but for 'P': add the input to the job being filled, queue
+   each job that is full, and on a flush queue what there is and write all of
+   the queued jobs. */
+static int gz_par_comp(gz_state *state, int flush) {
+    gz_par *par = state->par;
+    PREFIX3(stream) *strm = &(state->strm);
+    unsigned chunk = state->bgzf ? GZ_BGZF_BLOCK : GZ_PAR_CHUNK;
+    gz_job *job;
+    unsigned n;
+
+    /* check for a pending reset */
+    if (state->reset) {
+        /* don't start a new gzip member unless there is data to write */
+        if (strm->avail_in == 0)
+            return 0;
+        state->reset = 0;
+    }
+
+    while (strm->avail_in) {
+        job = &par->job[par->head];
+        n = chunk - job->len;
+        if (n > strm->avail_in)
+            n = strm->avail_in;
+        memcpy(job->in + GZ_PAR_DICT + job->len, strm->next_in, n);
+        job->len += n;
+        strm->next_in += n;
+        strm->avail_in -= n;
+        if (job->len == chunk && gz_par_queue(state, state->bgzf ? Z_FINISH : Z_SYNC_FLUSH, 1) == -1)
+            return -1;
+    }
+
+    /* with 'B' every chunk is a member of its own, and none is empty */
+    if (flush != Z_NO_FLUSH) {
+        if (((flush == Z_FINISH && !state->bgzf) || par->job[par->head].len) &&
+            gz_par_queue(state, flush == Z_FINISH || state->bgzf ? Z_FINISH : Z_SYNC_FLUSH,
+                         flush != Z_FULL_FLUSH) == -1)
+            return -1;
+        while (par->queued)
+            if (gz_par_write(state) == -1)
+                return -1;
+    }
+
+    /* if that completed a gzip member, allow another to start */
+    if (flush == Z_FINISH)
+        state->reset = 1;
+    return 0;
+}
+
+/* Stop the threads and free the jobs, if running. */
+static void gz_par_end(gz_state *state) {
+    gz_par *par = state->par;
+    unsigned i;
+
+    if (par == NULL)
+        return;
+    z_mutex_lock(&par->lock);
+    par->quit = 1;
+    z_cond_broadcast(&par->work);
+    z_mutex_unlock(&par->lock);
+    for (i = 0; i < (unsigned)par->started; i++)
+        z_thread_join(par->thread[i]);
+    z_cond_destroy(&par->done);
+    z_cond_destroy(&par->work);
+    z_mutex_destroy(&par->lock);
+    for (i = 0; i < par->jobs; i++) {
+        free(par->job[i].in);
+        free(par->job[i].out);
+    }
+    free(par->job);
+    free(par);
+    state->par = NULL;
+}
+#endif
+
 /* Initialize state for writing a gzip file.  Mark initialization by setting
    state->size to non-zero.  Return -1 on a memory allocation failure, or 0 on
    success. */
@@ -21,7 +575,7 @@ static int gz_init(gz_state *state) {
     PREFIX3(stream) *strm = &(state->strm);
 
     /* allocate input buffer (double size for gzprintf) */
-    state->in = (unsigned char *)malloc(state->want << 1);
+    state->in = (unsigned char *)gz_alloc(state, (size_t)state->want << 1);
     if (state->in == NULL) {
         gz_error(state, Z_MEM_ERROR, "out of memory");
         return -1;
@@ -31,25 +585,49 @@ static int gz_init(gz_state *state) {
     /* only need output buffer and deflate state if compressing */
     if (!state->direct) {
         /* allocate output buffer */
-        state->out = (unsigned char *)malloc(state->want);
+        state->out = (unsigned char *)gz_alloc(state, state->want);
         if (state->out == NULL) {
             free(state->in);
             gz_error(state, Z_MEM_ERROR, "out of memory");
             return -1;
         }
 
-        /* allocate deflate memory, set up for gzip compression */
+        /* with 'B', room for a member's input and for the member */
+        if (state->bgzf) {
+            state->bgzf_in = (unsigned char *)malloc(GZ_BGZF_BLOCK + GZ_BGZF_MAX);
+            if (state->bgzf_in == NULL) {
+                free(state->out);
+                free(state->in);
+                gz_error(state, Z_MEM_ERROR, "out of memory");
+                return -1;
+            }
+        }
+
+        /* allocate deflate memory, set up for gzip compression, or raw
+           deflate for the members of 'B' */
         strm->zalloc = NULL;
         strm->zfree = NULL;
         strm->opaque = NULL;
-        ret = PREFIX(deflateInit2)(strm, state->level, Z_DEFLATED, MAX_WBITS + 16, DEF_MEM_LEVEL, state->strategy);
+        ret = PREFIX(deflateInit2)(strm, state->level, Z_DEFLATED, state->bgzf ? -MAX_WBITS : MAX_WBITS + 16,
+                                   DEF_MEM_LEVEL, state->strategy);
         if (ret != Z_OK) {
+            free(state->bgzf_in);
+            state->bgzf_in = NULL;
             free(state->out);
             free(state->in);
             gz_error(state, Z_MEM_ERROR, "out of memory");
             return -1;
         }
         strm->next_in = NULL;
+
+        /* compress in parallel, or write behind in the background, if
+           requested, where 'B' writes its members itself */
+#ifdef GZ_AIO
+        if (state->threads > 1)
+            (void)gz_par_init(state);
+        if (state->aio_want && state->par == NULL && !state->bgzf)
+            (void)gz_aio_init(state);
+#endif
     }
 
     /* mark state as initialized */
@@ -82,15 +660,26 @@ static int gz_comp(gz_state *state, int flush) {
 
     /* write directly if requested */
     if (state->direct) {
+        ZTRACE2(gz_comp_start, state->fd, strm->avail_in);
         got = write(state->fd, strm->next_in, strm->avail_in);
+        ZTRACE2(gz_comp_done, state->fd, got);
         if (got < 0 || (unsigned)got != strm->avail_in) {
             gz_error(state, Z_ERRNO, zstrerror());
             return -1;
         }
         strm->avail_in = 0;
+        if (state->drop)
+            gz_drop(state, 0);
         return 0;
     }
 
+#ifdef GZ_AIO
+    if (state->par != NULL)
+        return gz_par_comp(state, flush);
+#endif
+    if (state->bgzf)
+        return gz_bgzf_comp(state, flush);
+
     /* check for a pending reset */
     if (state->reset) {
         /* don't start a new gzip member unless there is data to write */
@@ -107,10 +696,33 @@ static int gz_comp(gz_state *state, int flush) {
            doing Z_FINISH then don't write until we get to Z_STREAM_END */
         if (strm->avail_out == 0 || (flush != Z_NO_FLUSH && (flush != Z_FINISH || ret == Z_STREAM_END))) {
             have = (unsigned)(strm->next_out - state->x.next);
-            if (have && ((got = write(state->fd, state->x.next, (unsigned long)have)) < 0 || (unsigned)got != have)) {
-                gz_error(state, Z_ERRNO, zstrerror());
-                return -1;
+#ifdef GZ_AIO
+            if (state->aio != NULL) {
+                /* hand the data to the background thread, and continue in
+                   the other buffer if this one is full */
+                if (have) {
+                    if (gz_aio_wait(state) == -1)
+                        return -1;
+                    gz_aio_submit(state, 1, state->x.next, have);
+                }
+                if (strm->avail_out == 0) {
+                    unsigned char *next = state->aio->spare;
+                    state->aio->spare = state->out;
+                    state->out = next;
+                }
+            } else
+#endif
+            if (have) {
+                ZTRACE2(gz_comp_start, state->fd, have);
+                got = write(state->fd, state->x.next, (unsigned long)have);
+                ZTRACE2(gz_comp_done, state->fd, got);
+                if (got < 0 || (unsigned)got != have) {
+                    gz_error(state, Z_ERRNO, zstrerror());
+                    return -1;
+                }
             }
+            if (have && state->drop)
+                gz_drop(state, 0);
             if (strm->avail_out == 0) {
                 strm->avail_out = state->size;
                 strm->next_out = state->out;
@@ -129,6 +741,12 @@ static int gz_comp(gz_state *state, int flush) {
         have -= strm->avail_out;
     } while (have);
 
+    /* make sure that a flush has reached the file */
+#ifdef GZ_AIO
+    if (state->aio != NULL && flush != Z_NO_FLUSH && gz_aio_wait(state) == -1)
+        return -1;
+#endif
+
     /* if that completed a deflate stream, allow another to start */
     if (flush == Z_FINISH)
         state->reset = 1;
@@ -451,6 +1069,7 @@ int ZEXPORT PREFIX(gzflush)(gzFile file, int flush) {
 int ZEXPORT PREFIX(gzsetparams)(gzFile file, int level, int strategy) {
     gz_state *state;
     PREFIX3(stream) *strm;
+    int ret;
 
     /* get internal structure */
     if (file == NULL)
@@ -476,9 +1095,18 @@ int ZEXPORT PREFIX(gzsetparams)(gzFile file, int level, int strategy) {
     /* change compression parameters for subsequent input */
     if (state->size) {
         /* flush previous input with previous parameters before changing */
-        if (strm->avail_in && gz_comp(state, Z_BLOCK) == -1)
+        if ((strm->avail_in || state->bgzf_have
+#ifdef GZ_AIO
+             || state->par != NULL
+#endif
+            ) && gz_comp(state, Z_BLOCK) == -1)
             return state->err;
-        PREFIX(deflateParams)(strm, level, strategy);
+        /* each member of 'B' takes them when it is compressed */
+        if (!state->bgzf) {
+            ret = PREFIX(deflateParams)(strm, level, strategy);
+            if (ret != Z_OK)
+                return ret;
+        }
     }
     state->level = level;
     state->strategy = strategy;
@@ -506,16 +1134,26 @@ int ZEXPORT PREFIX(gzclose_w)(gzFile file) {
             ret = state->err;
     }
 
-    /* flush, free memory, and close file */
+    /* flush, end with the index for 'B', free memory, and close file */
     if (gz_comp(state, Z_FINISH) == -1)
         ret = state->err;
+    else if (state->bgzf && !state->direct && gz_bgzf_end(state) == -1)
+        ret = state->err;
+#ifdef GZ_AIO
+    gz_par_end(state);
+    gz_aio_end(state);
+#endif
+    if (state->drop)
+        gz_drop(state, 1);
     if (state->size) {
         if (!state->direct) {
             (void)PREFIX(deflateEnd)(&(state->strm));
             free(state->out);
+            free(state->bgzf_in);
         }
         free(state->in);
     }
+    free(state->bgzf_list);
     gz_error(state, Z_OK, NULL);
     free(state->path);
     if (close(state->fd) == -1)
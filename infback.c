@@ -16,6 +16,7 @@
 #include "inflate.h"
 #include "inffast.h"
 #include "inflate_p.h"
+#include "memcopy.h"
 
 /*
    strm provides memory allocation functions in zalloc and zfree, or
@@ -50,9 +51,39 @@ int ZEXPORT PREFIX(inflateBackInit_)(PREFIX3(stream) *strm, int windowBits, unsi
     state->window = window;
     state->wnext = 0;
     state->whave = 0;
+    state->dict_have = 0;
     return Z_OK;
 }
 
+#ifndef ZLIB_COMPAT
+/* Bytes that the caller leaves after the ring, which the wide copies of
+   inflate_fast() may load past its end, as past the padded window of
+   inflate() */
+#define RING_SLACK 64
+#if defined(INFFAST_CHUNKSIZE) && INFFAST_CHUNKSIZE > RING_SLACK
+#  error RING_SLACK is too small for INFFAST_CHUNKSIZE
+#endif
+
+/*
+   The window is a ring of window_size bytes rather than 2**windowBits, so
+   that out() is called less often. Distances still reach back at most 32K,
+   which the ring always holds. The slack after it is cleared, so that the
+   loads past the end read no uninitialized memory.
+ */
+int ZEXPORT zng_inflateBackInitRing(zng_stream *strm, unsigned char *window, size_t window_size) {
+    int ret;
+
+    if (window_size < (1U << MAX_WBITS) || window_size > (1U << 30))
+        return Z_STREAM_ERROR;
+    ret = zng_inflateBackInit_(strm, MAX_WBITS, window, ZLIBNG_VERSION, (int)sizeof(zng_stream));
+    if (ret == Z_OK) {
+        ((struct inflate_state *)strm->state)->wsize = (unsigned)window_size;
+        memset(window + window_size, 0, RING_SLACK);
+    }
+    return ret;
+}
+#endif
+
 /*
    Private macros for inflateBack()
    Look in inflate_p.h for macros shared with inflate()
@@ -83,18 +114,18 @@ int ZEXPORT PREFIX(inflateBackInit_)(PREFIX3(stream) *strm, int windowBits, unsi
     } while (0)
 
 /* Assure that some output space is available, by writing out the window
-   if it's full.  If the write fails, return from inflateBack() with a
-   Z_BUF_ERROR. */
+   from where the last write stopped if it's full.  If the write fails,
+   return from inflateBack() with a Z_BUF_ERROR. */
 #define ROOM() \
     do { \
         if (left == 0) { \
-            put = state->window; \
-            left = state->wsize; \
-            state->whave = left; \
-            if (out(out_desc, put, left)) { \
+            state->whave = state->wsize; \
+            if (put != sent && out(out_desc, sent, (uint32_t)(put - sent))) { \
                 ret = Z_BUF_ERROR; \
                 goto inf_leave; \
             } \
+            put = sent = state->window; \
+            left = state->wsize; \
         } \
     } while (0)
 
@@ -129,6 +160,7 @@ int ZEXPORT PREFIX(inflateBack)(PREFIX3(stream) *strm, in_func in, void *in_desc
     struct inflate_state *state;
     const unsigned char *next;  /* next input */
     unsigned char *put;         /* next output */
+    unsigned char *sent;        /* output not written by out() yet */
     unsigned have, left;        /* available input and output */
     uint32_t hold;              /* bit buffer */
     unsigned bits;              /* bits in bit buffer */
@@ -156,12 +188,22 @@ int ZEXPORT PREFIX(inflateBack)(PREFIX3(stream) *strm, in_func in, void *in_desc
     hold = 0;
     bits = 0;
     put = state->window;
+    sent = put;
     left = state->wsize;
 
     /* Inflate until end of block marked as last */
     for (;;)
         switch (state->mode) {
         case TYPE:
+            /* write out a ring larger than 32K on block boundaries once half
+               of it is waiting, so that out() is called with large writes */
+            if (state->wsize > (1U << MAX_WBITS) && (unsigned)(put - sent) >= state->wsize >> 1) {
+                if (out(out_desc, sent, (uint32_t)(put - sent))) {
+                    ret = Z_BUF_ERROR;
+                    goto inf_leave;
+                }
+                sent = put;
+            }
             /* determine and dispatch block type */
             if (state->last) {
                 BYTEBITS();
@@ -332,6 +374,7 @@ int ZEXPORT PREFIX(inflateBack)(PREFIX3(stream) *strm, in_func in, void *in_desc
                 state->mode = BAD;
                 break;
             }
+            zng_inflate_table_pairs(state->lencode, state->lenbits, state->lenpair);
             state->distcode = (const code *)(state->next);
             state->distbits = 6;
             ret = zng_inflate_table(DISTS, state->lens + state->nlen, state->ndist,
@@ -476,8 +519,8 @@ int ZEXPORT PREFIX(inflateBack)(PREFIX3(stream) *strm, in_func in, void *in_desc
         case DONE:
             /* inflate stream terminated properly -- write leftover output */
             ret = Z_STREAM_END;
-            if (left < state->wsize) {
-                if (out(out_desc, state->window, state->wsize - left))
+            if (put != sent) {
+                if (out(out_desc, sent, (uint32_t)(put - sent)))
                     ret = Z_BUF_ERROR;
             }
             goto inf_leave;
@@ -10,6 +10,27 @@
 #include "inffast.h"
 #include "inflate_p.h"
 #include "memcopy.h"
+#include "functable.h"
+
+/* Fill hold with 56 to 63 bits of input, see the comment about hold below */
+#define REFILL() \
+    do { \
+        hold |= load_64_bits(in, bits); \
+        in += (63 ^ bits) >> 3; \
+        bits |= 56; \
+    } while (0)
+
+/* Write the one or two literals of an entry from the pair table. Both bytes
+   are always stored, out only advances past the ones that were decoded. */
+#define PUTLITERALS() \
+    do { \
+        Tracevv((stderr, here->op ? "inflate:         literals 0x%02x 0x%02x\n" : \
+                "inflate:         literal 0x%02x\n", here->val & 0xff, here->val >> 8)); \
+        out[0] = (unsigned char)(here->val); \
+        out[1] = (unsigned char)(here->val >> 8); \
+        out += 1 + (here->op >> 7); \
+        DROPBITS(here->bits); \
+    } while (0)
 
 /*
    Decode literal, length, and distance codes and write out the resulting
@@ -43,12 +64,13 @@
 
     - On some architectures, it can be significantly faster (e.g. up to 1.2x
       faster on x86_64) to load from strm->next_in 64 bits, or 8 bytes, at a
-      time, so INFLATE_FAST_MIN_HAVE == 8.
+      time. Each iteration loads at most twice and advances by at most 7 bytes
+      per load, so INFLATE_FAST_MIN_HAVE == 15.
 
     - The maximum bytes that a single length/distance pair can output is 258
-      bytes, which is the maximum length that can be coded.  inflate_fast()
-      requires strm->avail_out >= 258 for each loop to avoid checking for
-      output space.
+      bytes, which is the maximum length that can be coded.  Up to four literals
+      may be decoded ahead of it, so inflate_fast() requires strm->avail_out >=
+      262 for each loop to avoid checking for output space.
  */
 void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start) {
     /* start: inflate()'s starting value for strm->avail_out */
@@ -60,6 +82,7 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
     unsigned char *end;         /* while out < end, enough space available */
 #ifdef INFFAST_CHUNKSIZE
     unsigned char *safe;        /* can use chunkcopy provided out < safe */
+    unsigned chunksize;         /* bytes copied at a time by the chunk functions */
 #endif
 #ifdef INFLATE_STRICT
     unsigned dmax;              /* maximum distance from zlib header */
@@ -68,6 +91,8 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
     unsigned whave;             /* valid bytes in the window */
     unsigned wnext;             /* window write index */
     unsigned char *window;      /* allocated sliding window, if wsize != 0 */
+    unsigned dict_have;         /* prepared dictionary bytes before the window */
+    unsigned char *dict_end;    /* end of the prepared dictionary */
 
     /* hold is a local copy of strm->hold. By default, hold satisfies the same
        invariants that strm->hold does, namely that (hold >> bits) == 0. This
@@ -81,21 +106,20 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
        above.
 
        However, on some little endian architectures, it can be significantly
-       faster to load 64 bits once instead of 8 bits six times:
+       faster to load 64 bits at once and keep as many of them as fit:
 
-       if (bits <= 16) {
-         hold |= next_8_bytes_of_input << bits; in += 6; bits += 48;
-       }
+       hold |= next_8_bytes_of_input << bits; in += (63 ^ bits) >> 3; bits |= 56;
 
-       Unlike the simpler one byte load, shifting the next_8_bytes_of_input
-       by bits will overflow and lose those high bits, up to 2 bytes' worth.
-       The conservative estimate is therefore that we have read only 6 bytes
-       (48 bits). Again, as per the NOTES above, 48 bits is sufficient for the
-       rest of the iteration, and we will not need to load another 8 bytes.
+       Shifting the next_8_bytes_of_input by bits overflows and loses the high
+       bits, so only the whole bytes that made it into hold are consumed. This
+       leaves between 56 and 63 bits in hold without a branch, which is enough
+       for a length/distance pair (48 bits, see the NOTES above) or for three
+       entries of the pair table, see inflate_table_pairs(). After that the
+       loop either starts over or loads again.
 
        Inside this function, we no longer satisfy (hold >> bits) == 0, but
-       this is not problematic, even if that overflow does not land on an 8 bit
-       byte boundary. Those excess bits will eventually shift down lower as the
+       this is not problematic, even if the bits of the next partial byte do not
+       land on an 8 bit byte boundary. Those excess bits will eventually shift down lower as the
        Huffman decoder consumes input, and when new input bits need to be loaded
        into the bits variable, the same input bits will be or'ed over those
        existing bits. A bitwise or is idempotent: (a | b | b) equals (a | b).
@@ -108,9 +132,10 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
     */
     uint64_t hold;              /* local strm->hold */
     unsigned bits;              /* local strm->bits */
+    code const *lroot;          /* local strm->lenpair */
     code const *lcode;          /* local strm->lencode */
     code const *dcode;          /* local strm->distcode */
-    unsigned lmask;             /* mask for first level of length codes */
+    unsigned pmask;             /* mask for lenpair lookups */
     unsigned dmask;             /* mask for first level of distance codes */
     const code *here;           /* retrieved table entry */
     unsigned op;                /* code bits, operation, extra bits, or */
@@ -129,6 +154,7 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
 
 #ifdef INFFAST_CHUNKSIZE
     safe = out + strm->avail_out;
+    chunksize = functable.chunksize();
 #endif
 #ifdef INFLATE_STRICT
     dmax = state->dmax;
@@ -137,22 +163,35 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
     whave = state->whave;
     wnext = state->wnext;
     window = state->window;
+    dict_have = state->dict_have;
+    dict_end = (unsigned char *)state->dict_end;
     hold = state->hold;
     bits = state->bits;
+    lroot = state->lenpair;
     lcode = state->lencode;
     dcode = state->distcode;
-    lmask = (1U << state->lenbits) - 1;
+    pmask = (1U << PAIR_BITS) - 1;
     dmask = (1U << state->distbits) - 1;
 
     /* decode literals and length/distances until end-of-block or not enough
        input data or output space */
     do {
-        if (bits < 15) {
-            hold |= load_64_bits(in, bits);
-            in += 6;
-            bits += 48;
+        REFILL();
+        here = lroot + (hold & pmask);
+        if ((here->op & 127) == 0) {            /* up to three literal entries */
+            PUTLITERALS();
+            here = lroot + (hold & pmask);
+            if ((here->op & 127) == 0) {
+                PUTLITERALS();
+                here = lroot + (hold & pmask);
+                if ((here->op & 127) == 0) {
+                    PUTLITERALS();
+                    continue;
+                }
+            }
+            /* enough bits for a length/distance pair */
+            REFILL();
         }
-        here = lcode + (hold & lmask);
       dolen:
         DROPBITS(here->bits);
         op = here->op;
@@ -165,20 +204,10 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
             len = here->val;
             op &= 15;                           /* number of extra bits */
             if (op) {
-                if (bits < op) {
-                    hold |= load_64_bits(in, bits);
-                    in += 6;
-                    bits += 48;
-                }
                 len += BITS(op);
                 DROPBITS(op);
             }
             Tracevv((stderr, "inflate:         length %u\n", len));
-            if (bits < 15) {
-                hold |= load_64_bits(in, bits);
-                in += 6;
-                bits += 48;
-            }
             here = dcode + (hold & dmask);
           dodist:
             DROPBITS(here->bits);
@@ -186,11 +215,6 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
             if (op & 16) {                      /* distance base */
                 dist = here->val;
                 op &= 15;                       /* number of extra bits */
-                if (bits < op) {
-                    hold |= load_64_bits(in, bits);
-                    in += 6;
-                    bits += 48;
-                }
                 dist += BITS(op);
 #ifdef INFLATE_STRICT
                 if (dist > dmax) {
@@ -204,6 +228,37 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
                 op = (unsigned)(out - beg);     /* max distance in output */
                 if (dist > op) {                /* see if copy from window */
                     op = dist - op;             /* distance back in window */
+                    if (op > whave && op - whave <= dict_have) {
+                        op -= whave;            /* distance back in prepared dictionary */
+                        from = dict_end - op;
+                        if (op >= len) {        /* all from dictionary */
+#ifdef INFFAST_CHUNKSIZE
+                            out = functable.chunkcopy_safe(out, from, len, safe);
+#else
+                            out = chunk_copy(out, from, 0, len);
+#endif
+                            continue;
+                        }
+                        len -= op;              /* some from dictionary */
+#ifdef INFFAST_CHUNKSIZE
+                        out = functable.chunkcopy_safe(out, from, op, safe);
+#else
+                        do {
+                            *out++ = *from++;
+                        } while (--op);
+#endif
+                        op = whave;
+                        if (op == 0) {          /* rest from output */
+#ifdef INFFAST_CHUNKSIZE
+                            out = functable.chunkunroll(out, &dist, &len);
+                            out = functable.chunkcopy_safe(out, out - dist, len, safe);
+#else
+                            from = out - dist;
+                            out = chunk_copy(out, from, (int) (out - from), len);
+#endif
+                            continue;
+                        }
+                    }
                     if (op > whave) {
                         if (state->sane) {
                             strm->msg = (char *)"invalid distance too far back";
@@ -241,7 +296,7 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
                         from += wsize - op;
                         if (op < len) {         /* some from end of window */
                             len -= op;
-                            out = chunkcopysafe(out, from, op, safe);
+                            out = functable.chunkcopy_safe(out, from, op, safe);
                             from = window;      /* more from start of window */
                             op = wnext;
                             /* This (rare) case can create a situation where
@@ -251,11 +306,11 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
                     }
                     if (op < len) {             /* still need some from output */
                         len -= op;
-                        out = chunkcopysafe(out, from, op, safe);
-                        out = chunkunroll(out, &dist, &len);
-                        out = chunkcopysafe(out, out - dist, len, safe);
+                        out = functable.chunkcopy_safe(out, from, op, safe);
+                        out = functable.chunkunroll(out, &dist, &len);
+                        out = functable.chunkcopy_safe(out, out - dist, len, safe);
                     } else {
-                        out = chunkcopysafe(out, from, len, safe);
+                        out = functable.chunkcopy_safe(out, from, len, safe);
                     }
 #else
                     from = window;
@@ -307,10 +362,10 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
                        operations can write beyond `out+len` so long as they
                        stay within 258 bytes of `out`.
                     */
-                    if (dist >= len || dist >= INFFAST_CHUNKSIZE)
-                        out = chunkcopy(out, out - dist, len);
+                    if (dist >= len || dist >= chunksize)
+                        out = functable.chunkcopy(out, out - dist, len);
                     else
-                        out = chunkmemset(out, dist, len);
+                        out = functable.chunkmemset(out, dist, len);
 #else
                     if (len < sizeof(uint64_t))
                       out = set_bytes(out, out - dist, dist, len);
@@ -364,6 +419,214 @@ void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start)
     return;
 }
 
+#ifndef ZLIB_COMPAT
+/* Local copy of what inflate_fast() keeps in variables, for each stream of
+   inflate_fast_lanes() */
+struct fast_lane {
+    PREFIX3(stream) *strm;
+    const unsigned char *in;
+    const unsigned char *last;
+    unsigned char *out;
+    unsigned char *beg;
+    unsigned char *end;
+#ifdef INFFAST_CHUNKSIZE
+    unsigned char *safe;
+#endif
+#ifdef INFLATE_STRICT
+    unsigned dmax;
+#endif
+    uint64_t hold;
+    unsigned bits;
+    code const *lroot;
+    code const *lcode;
+    code const *dcode;
+    unsigned dmask;
+};
+
+/*
+   Decode n streams, at most INFLATE_LANES, like inflate_fast() does one, but
+   one literal entry of the pair table or one length/distance pair of each
+   stream in turn. The decoding of a symbol waits for the table lookups of the
+   one before it, which leaves most of the CPU idle when there is only one
+   stream. The symbols of different streams do not depend on each other, so
+   interleaving them keeps several lookups in flight.
+
+   Entry assumptions, for each stream, besides those of inflate_fast():
+
+        the stream is in whole-buffer mode, and the output since that was set
+        is all there is, without a window or a prepared dictionary
+
+   A stream leaves the loop when inflate_fast() would return, with the same
+   state->mode, and the others go on without it.
+ */
+void ZLIB_INTERNAL zng_inflate_fast_lanes(PREFIX3(stream) **strm, unsigned n) {
+    struct fast_lane lanes[INFLATE_LANES];
+    struct fast_lane *lane;
+    struct inflate_state *state;
+#ifdef INFFAST_CHUNKSIZE
+    unsigned chunksize;         /* bytes copied at a time by the chunk functions */
+#endif
+    const unsigned char *in;    /* local lane->in */
+    unsigned char *out;         /* local lane->out */
+    uint64_t hold;              /* local lane->hold */
+    unsigned bits;              /* local lane->bits */
+    unsigned pmask;             /* mask for lenpair lookups */
+    const code *here;           /* retrieved table entry */
+    unsigned op;                /* code bits, operation, extra bits */
+    unsigned len;               /* match length, unused bytes */
+    unsigned dist;              /* match distance */
+    int live;                   /* lanes still decoding */
+    int stop;                   /* true if the lane reached the end of a block or an error */
+    int i;
+
+#ifdef INFFAST_CHUNKSIZE
+    chunksize = functable.chunksize();
+#endif
+    pmask = (1U << PAIR_BITS) - 1;
+    for (i = 0; i < (int)n; i++) {
+        lane = lanes + i;
+        state = (struct inflate_state *)strm[i]->state;
+        Assert(state->whole && state->whave == 0 && state->dict_have == 0, "lane without whole buffer");
+        lane->strm = strm[i];
+        lane->in = strm[i]->next_in;
+        lane->last = lane->in + (strm[i]->avail_in - (INFLATE_FAST_MIN_HAVE - 1));
+        lane->out = strm[i]->next_out;
+        lane->beg = lane->out - state->whole_have;
+        lane->end = lane->out + (strm[i]->avail_out - (INFLATE_FAST_MIN_LEFT - 1));
+#ifdef INFFAST_CHUNKSIZE
+        lane->safe = lane->out + strm[i]->avail_out;
+#endif
+#ifdef INFLATE_STRICT
+        lane->dmax = state->dmax;
+#endif
+        lane->hold = state->hold;
+        lane->bits = state->bits;
+        lane->lroot = state->lenpair;
+        lane->lcode = state->lencode;
+        lane->dcode = state->distcode;
+        lane->dmask = (1U << state->distbits) - 1;
+    }
+
+    live = (int)n;
+    while (live) {
+        for (i = 0; i < live; i++) {
+            lane = lanes + i;
+            state = (struct inflate_state *)lane->strm->state;
+            in = lane->in;
+            out = lane->out;
+            hold = lane->hold;
+            bits = lane->bits;
+            stop = 0;
+
+            REFILL();
+            here = lane->lroot + (hold & pmask);
+            if ((here->op & 127) == 0) {        /* one or two literals */
+                PUTLITERALS();
+                goto next;
+            }
+          dolen:
+            DROPBITS(here->bits);
+            op = here->op;
+            if (op == 0) {                      /* literal */
+                *out++ = (unsigned char)(here->val);
+            } else if (op & 16) {               /* length base */
+                len = here->val;
+                op &= 15;
+                if (op) {
+                    len += BITS(op);
+                    DROPBITS(op);
+                }
+                here = lane->dcode + (hold & lane->dmask);
+              dodist:
+                DROPBITS(here->bits);
+                op = here->op;
+                if (op & 16) {                  /* distance base */
+                    dist = here->val;
+                    op &= 15;
+                    dist += BITS(op);
+                    DROPBITS(op);
+#ifdef INFLATE_STRICT
+                    if (dist > lane->dmax) {
+                        lane->strm->msg = (char *)"invalid distance too far back";
+                        state->mode = BAD;
+                        stop = 1;
+                        goto next;
+                    }
+#endif
+                    /* There is no window, see the entry assumptions */
+                    if (dist > (unsigned)(out - lane->beg)) {
+                        lane->strm->msg = (char *)"invalid distance too far back";
+                        state->mode = BAD;
+                        stop = 1;
+                        goto next;
+                    }
+#ifdef INFFAST_CHUNKSIZE
+                    if (dist >= len || dist >= chunksize)
+                        out = functable.chunkcopy(out, out - dist, len);
+                    else
+                        out = functable.chunkmemset(out, dist, len);
+#else
+                    if (len < sizeof(uint64_t))
+                      out = set_bytes(out, out - dist, dist, len);
+                    else if (dist == 1)
+                      out = byte_memset(out, len);
+                    else
+                      out = chunk_memset(out, out - dist, dist, len);
+#endif
+                } else if ((op & 64) == 0) {    /* 2nd level distance code */
+                    here = lane->dcode + here->val + BITS(op);
+                    goto dodist;
+                } else {
+                    lane->strm->msg = (char *)"invalid distance code";
+                    state->mode = BAD;
+                    stop = 1;
+                }
+            } else if ((op & 64) == 0) {        /* 2nd level length code */
+                here = lane->lcode + here->val + BITS(op);
+                goto dolen;
+            } else if (op & 32) {               /* end-of-block */
+                state->mode = TYPE;
+                stop = 1;
+            } else {
+                lane->strm->msg = (char *)"invalid literal/length code";
+                state->mode = BAD;
+                stop = 1;
+            }
+
+          next:
+            lane->in = in;
+            lane->out = out;
+            lane->hold = hold;
+            lane->bits = bits;
+            if (!stop && in < lane->last && out < lane->end)
+                continue;
+
+            /* return unused bytes and update the state, as inflate_fast() does */
+            len = bits >> 3;
+            in -= len;
+            bits -= len << 3;
+            hold &= (UINT64_C(1) << bits) - 1;
+            lane->strm->next_in = in;
+            lane->strm->next_out = out;
+            lane->strm->avail_in =
+                (unsigned)(in < lane->last ? (INFLATE_FAST_MIN_HAVE - 1) + (lane->last - in)
+                                           : (INFLATE_FAST_MIN_HAVE - 1) - (in - lane->last));
+            lane->strm->avail_out =
+                (unsigned)(out < lane->end ? (INFLATE_FAST_MIN_LEFT - 1) + (lane->end - out)
+                                           : (INFLATE_FAST_MIN_LEFT - 1) - (out - lane->end));
+            state->hold = (uint32_t)hold;
+            state->bits = bits;
+
+            /* the last lane takes the place of this one */
+            lanes[i--] = lanes[--live];
+        }
+    }
+}
+#endif
+
+#undef REFILL
+#undef PUTLITERALS
+
 /*
    inflate_fast() speedups that turned out slower (on a PowerPC G3 750CXe):
    - Using bit fields for code structure
@@ -11,8 +11,11 @@
  */
 
 void ZLIB_INTERNAL zng_inflate_fast(PREFIX3(stream) *strm, unsigned long start);
+#ifndef ZLIB_COMPAT
+void ZLIB_INTERNAL zng_inflate_fast_lanes(PREFIX3(stream) **strm, unsigned n);
+#endif
 
-#define INFLATE_FAST_MIN_HAVE 8
-#define INFLATE_FAST_MIN_LEFT 258
+#define INFLATE_FAST_MIN_HAVE 15
+#define INFLATE_FAST_MIN_LEFT 262
 
 #endif /* INFFAST_H_ */
@@ -12,6 +12,7 @@
 #include "inffixed.h"
 #include "memcopy.h"
 #include "functable.h"
+#include "ztrace.h"
 
 /* Architecture-specific hooks. */
 #ifdef S390_DFLTCC_INFLATE
@@ -36,11 +37,19 @@
 #  define INFLATE_NEED_UPDATEWINDOW(strm) 1
 /* Invoked at the beginning of inflateMark(). Useful for updating arch-specific pointers and offsets. */
 #  define INFLATE_MARK_HOOK(strm) do {} while (0)
+/* Extra arena space needed by the allocation hooks above, see zng_inflateArenaSize(). */
+#  define INFLATE_ARENA_EXTRA 0
 #endif
 
 /* function prototypes */
 static int inflateStateCheck(PREFIX3(stream) *strm);
-static int updatewindow(PREFIX3(stream) *strm, const unsigned char *end, uint32_t copy);
+static int updatewindow(PREFIX3(stream) *strm, const unsigned char *end, uint32_t copy, int cksum);
+static void free_window(PREFIX3(stream) *strm, struct inflate_state *state);
+#ifndef ZLIB_COMPAT
+static int own_window(PREFIX3(stream) *strm, struct inflate_state *state, uint32_t copy);
+#endif
+static int cached_tables(struct inflate_state *state);
+static void keep_tables(struct inflate_state *state);
 static uint32_t syncsearch(uint32_t *have, const unsigned char *buf, uint32_t len);
 
 static int inflateStateCheck(PREFIX3(stream) *strm) {
@@ -75,6 +84,7 @@ int ZEXPORT PREFIX(inflateResetKeep)(PREFIX3(stream) *strm) {
     state->lencode = state->distcode = state->next = state->codes;
     state->sane = 1;
     state->back = -1;
+    state->whole_have = 0;
     INFLATE_RESET_KEEP_HOOK(strm);  /* hook for IBM Z DFLTCC */
     Tracev((stderr, "inflate: reset\n"));
     return Z_OK;
@@ -89,6 +99,7 @@ int ZEXPORT PREFIX(inflateReset)(PREFIX3(stream) *strm) {
     state->wsize = 0;
     state->whave = 0;
     state->wnext = 0;
+    state->dict_have = 0;
     return PREFIX(inflateResetKeep)(strm);
 }
 
@@ -116,10 +127,8 @@ int ZEXPORT PREFIX(inflateReset2)(PREFIX3(stream) *strm, int windowBits) {
     /* set number of window bits, free window if different */
     if (windowBits && (windowBits < 8 || windowBits > 15))
         return Z_STREAM_ERROR;
-    if (state->window != NULL && state->wbits != (unsigned)windowBits) {
-        ZFREE_WINDOW(strm, state->window);
-        state->window = NULL;
-    }
+    if (state->window != NULL && state->wbits != (unsigned)windowBits)
+        free_window(strm, state);
 
     /* update state and reset the rest of it */
     state->wrap = wrap;
@@ -155,6 +164,17 @@ int ZEXPORT PREFIX(inflateInit2_)(PREFIX3(stream) *strm, int windowBits, const c
     strm->state = (struct internal_state *)state;
     state->strm = strm;
     state->window = NULL;
+    state->whole = 0;
+    state->cache_nlen = 0;
+    state->cache_pairs = 0;
+#ifndef ZLIB_COMPAT
+    state->gather = NULL;
+    state->gather_cnt = 0;
+    state->share = NULL;
+    state->verify = NULL;
+    state->lane = 0;
+    state->max_output = 0;
+#endif
     state->mode = HEAD;     /* to pass state test in inflateReset2() */
     ret = PREFIX(inflateReset2)(strm, windowBits);
     if (ret != Z_OK) {
@@ -198,6 +218,8 @@ void ZLIB_INTERNAL fixedtables(struct inflate_state *state) {
     state->lenbits = 9;
     state->distcode = distfix;
     state->distbits = 5;
+    zng_inflate_table_pairs(state->lencode, state->lenbits, state->lenpair);
+    state->cache_pairs = 0;
 }
 
 int ZLIB_INTERNAL inflate_ensure_window(struct inflate_state *state)
@@ -227,6 +249,83 @@ int ZLIB_INTERNAL inflate_ensure_window(struct inflate_state *state)
     return 0;
 }
 
+/* Free the window, or only give it up if other streams still share it */
+static void free_window(PREFIX3(stream) *strm, struct inflate_state *state) {
+#ifndef ZLIB_COMPAT
+    if (state->share != NULL) {
+        if (z_atomic_decrement(state->share) != 0) {
+            state->share = NULL;
+            state->window = NULL;
+            return;
+        }
+        ZFREE(strm, (void *)state->share);
+        state->share = NULL;
+    }
+#endif
+    ZFREE_WINDOW(strm, state->window);
+    state->window = NULL;
+}
+
+#ifndef ZLIB_COMPAT
+/* Give a stream that shares its window with others a copy of its own before
+   updatewindow() writes copy bytes to it, or just keep the window if the others
+   have given theirs up already. Nothing is copied if the window is about to be
+   written over in whole. Return 1 if the copy could not be had. */
+static int own_window(PREFIX3(stream) *strm, struct inflate_state *state, uint32_t copy) {
+    unsigned char *window = state->window;
+    uint32_t keep = 0;
+
+    if (z_atomic_load(state->share) == 1) {
+        ZFREE(strm, (void *)state->share);
+        state->share = NULL;
+        return 0;
+    }
+    state->window = NULL;
+    if (inflate_ensure_window(state)) {
+        state->window = window;
+        return 1;
+    }
+    if (copy < state->wsize)
+        keep = state->whave;
+    memcpy(state->window, window, keep);
+
+    /* The other streams may have given theirs up while it was copied */
+    if (z_atomic_decrement(state->share) == 0) {
+        ZFREE_WINDOW(strm, window);
+        ZFREE(strm, (void *)state->share);
+    }
+    state->share = NULL;
+    return 0;
+}
+#endif
+
+/* Return true if the tables in codes[] were built from the code lengths in lens[] */
+static int cached_tables(struct inflate_state *state) {
+    unsigned i;
+
+    if (state->nlen != state->cache_nlen || state->ndist != state->cache_ndist)
+        return 0;
+    for (i = 0; i < state->nlen + state->ndist; i++)
+        if (state->lens[i] != state->cache_lens[i])
+            return 0;
+    return 1;
+}
+
+/* Remember the code lengths and layout of the tables just built in codes[] */
+static void keep_tables(struct inflate_state *state) {
+    unsigned i;
+
+    for (i = 0; i < state->nlen + state->ndist; i++)
+        state->cache_lens[i] = (unsigned char)state->lens[i];
+    state->cache_nlen = state->nlen;
+    state->cache_ndist = state->ndist;
+    state->cache_lenbits = state->lenbits;
+    state->cache_distbits = state->distbits;
+    state->cache_dist = (unsigned)(state->distcode - state->codes);
+    state->cache_used = (unsigned)(state->next - state->codes);
+    state->cache_pairs = 1;
+}
+
 /*
    Update the window with the last wsize (normally 32K) bytes written before
    returning.  If window does not exist yet, create it.  This is only called
@@ -240,28 +339,46 @@ int ZLIB_INTERNAL inflate_ensure_window(struct inflate_state *state)
    upon return from inflate(), and since all distances after the first 32K of
    output will fall in the output data, making match copies simpler and faster.
    The advantage may be dependent on the size of the processor's data caches.
+
+   If cksum is true, the check value is updated with all copy bytes before end.
+   The bytes that go to the window are summed while they are copied, so that
+   they only pass through the cache once.
  */
-static int updatewindow(PREFIX3(stream) *strm, const unsigned char *end, uint32_t copy) {
+static int updatewindow(PREFIX3(stream) *strm, const unsigned char *end, uint32_t copy, int cksum) {
     struct inflate_state *state;
     uint32_t dist;
 
     state = (struct inflate_state *)strm->state;
 
+#ifndef ZLIB_COMPAT
+    if (state->share != NULL && own_window(strm, state, copy)) return 1;
+#endif
     if (inflate_ensure_window(state)) return 1;
 
+/* copy len bytes to the window, updating the check value on the way if requested */
+#define WINDOW_COPY(dst, src, len) \
+    do { \
+        if (cksum) \
+            state->check = UPDATE_COPY(state->check, dst, src, len); \
+        else \
+            memcpy(dst, src, len); \
+    } while (0)
+
     /* copy state->wsize or less output bytes into the circular window */
     if (copy >= state->wsize) {
-        memcpy(state->window, end - state->wsize, state->wsize);
+        if (cksum && copy > state->wsize)
+            state->check = UPDATE(state->check, end - copy, copy - state->wsize);
+        WINDOW_COPY(state->window, end - state->wsize, state->wsize);
         state->wnext = 0;
         state->whave = state->wsize;
     } else {
         dist = state->wsize - state->wnext;
         if (dist > copy)
             dist = copy;
-        memcpy(state->window + state->wnext, end - copy, dist);
+        WINDOW_COPY(state->window + state->wnext, end - copy, dist);
         copy -= dist;
         if (copy) {
-            memcpy(state->window, end - copy, copy);
+            WINDOW_COPY(state->window, end - copy, copy);
             state->wnext = copy;
             state->whave = state->wsize;
         } else {
@@ -272,6 +389,10 @@ static int updatewindow(PREFIX3(stream) *strm, const unsigned char *end, uint32_
                 state->whave += dist;
         }
     }
+#undef WINDOW_COPY
+    /* a prepared dictionary is only reached past a window that is not full yet */
+    if (state->dict_have > state->wsize - state->whave)
+        state->dict_have = state->wsize - state->whave;
     return 0;
 }
 
@@ -380,12 +501,17 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
     uint32_t hold;              /* bit buffer */
     unsigned bits;              /* bits in bit buffer */
     uint32_t in, out;           /* save starting available input and output */
+    uint32_t reach;             /* output of earlier calls that can be copied from */
+    uint32_t held;              /* avail_out held back so that out does not overflow */
+    int limited;                /* whether held includes room past zng_inflateMaxOutput() */
     unsigned copy;              /* number of stored or match bytes to copy */
     unsigned char *from;        /* where to copy match bytes from */
     code here;                  /* current decoding table entry */
     code last;                  /* parent table entry */
+    code *table;                /* next available space in lenlens[] */
     unsigned len;               /* length to copy for repeats, bits to drop */
     int ret;                    /* return code */
+    int cksum;                  /* whether the check value needs updating */
 #ifdef GUNZIP
     unsigned char hbuf[4];      /* buffer for gzip header crc calculation */
 #endif
@@ -401,8 +527,30 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
         state->mode = TYPEDO;
     LOAD();
     in = have;
-    out = left;
+    reach = held = 0;
+    limited = 0;
+    if (state->whole) {
+        /* Matches reach back into the output of the earlier calls instead of
+           the window, by counting it as output of this call */
+        reach = state->whole_have;
+        if (left > UINT32_MAX - reach) {
+            held = left - (UINT32_MAX - reach);
+            left -= held;
+        }
+    }
+#ifndef ZLIB_COMPAT
+    /* With zng_inflateMaxOutput(), hold back the room past the limit */
+    if (state->max_output != 0 && left > state->max_output) {
+        limited = 1;
+        held += left - state->max_output;
+        left = state->max_output;
+    }
+#endif
+    out = left + reach;
     ret = Z_OK;
+#ifndef ZLIB_COMPAT
+  inf_gather:
+#endif
     for (;;)
         switch (state->mode) {
         case HEAD:
@@ -603,6 +751,7 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
         case DICT:
             if (state->havedict == 0) {
                 RESTORE();
+                strm->avail_out += held;
                 return Z_NEED_DICT;
             }
             strm->adler = state->check = functable.adler32(0L, NULL, 0);
@@ -703,6 +852,7 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
             }
 #endif
             Tracev((stderr, "inflate:       table sizes ok\n"));
+            ZTRACE4(inflate_table_start, strm, state->nlen, state->ndist, state->ncode);
             state->have = 0;
             state->mode = LENLENS;
 
@@ -715,10 +865,11 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
             }
             while (state->have < 19)
                 state->lens[order[state->have++]] = 0;
-            state->next = state->codes;
-            state->lencode = (const code *)(state->next);
+            /* built apart from codes[], which may hold tables that the code lengths repeat */
+            table = state->lenlens;
+            state->lencode = (const code *)table;
             state->lenbits = 7;
-            ret = zng_inflate_table(CODES, state->lens, 19, &(state->next), &(state->lenbits), state->work);
+            ret = zng_inflate_table(CODES, state->lens, 19, &table, &(state->lenbits), state->work);
             if (ret) {
                 strm->msg = (char *)"invalid code lengths set";
                 state->mode = BAD;
@@ -787,9 +938,30 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
                 break;
             }
 
+            /* reuse the tables in codes[] if they were built from the same code lengths,
+               as they often are in the blocks of messages from the same compressor */
+            if (cached_tables(state)) {
+                state->next = state->codes + state->cache_used;
+                state->lencode = (const code *)state->codes;
+                state->lenbits = state->cache_lenbits;
+                state->distcode = (const code *)(state->codes + state->cache_dist);
+                state->distbits = state->cache_distbits;
+                if (!state->cache_pairs) {
+                    zng_inflate_table_pairs(state->lencode, state->lenbits, state->lenpair);
+                    state->cache_pairs = 1;
+                }
+                Tracev((stderr, "inflate:       codes ok (cached)\n"));
+                ZTRACE4(inflate_table_done, strm, state->nlen, state->ndist, 1);
+                state->mode = LEN_;
+                if (flush == Z_TREES)
+                    goto inf_leave;
+                break;
+            }
+
             /* build code tables -- note: do not change the lenbits or distbits
                values here (9 and 6) without reading the comments in inftrees.h
                concerning the ENOUGH constants, which depend on those values */
+            state->cache_nlen = 0;
             state->next = state->codes;
             state->lencode = (const code *)(state->next);
             state->lenbits = 9;
@@ -799,6 +971,7 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
                 state->mode = BAD;
                 break;
             }
+            zng_inflate_table_pairs(state->lencode, state->lenbits, state->lenpair);
             state->distcode = (const code *)(state->next);
             state->distbits = 6;
             ret = zng_inflate_table(DISTS, state->lens + state->nlen, state->ndist,
@@ -808,7 +981,9 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
                 state->mode = BAD;
                 break;
             }
+            keep_tables(state);
             Tracev((stderr, "inflate:       codes ok\n"));
+            ZTRACE4(inflate_table_done, strm, state->nlen, state->ndist, 0);
             state->mode = LEN_;
             if (flush == Z_TREES)
                 goto inf_leave;
@@ -820,6 +995,10 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
             /* use inflate_fast() if we have enough input and output */
             if (have >= INFLATE_FAST_MIN_HAVE &&
                 left >= INFLATE_FAST_MIN_LEFT) {
+#ifndef ZLIB_COMPAT
+                if (state->lane)
+                    goto inf_leave;
+#endif
                 RESTORE();
                 zng_inflate_fast(strm, out);
                 LOAD();
@@ -945,41 +1124,46 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
             copy = out - left;
             if (state->offset > copy) {         /* copy from window */
                 copy = state->offset - copy;
-                if (copy > state->whave) {
-                    if (state->sane) {
-                        strm->msg = (char *)"invalid distance too far back";
-                        state->mode = BAD;
-                        break;
-                    }
+                if (copy > state->whave && copy - state->whave <= state->dict_have) {
+                    copy -= state->whave;       /* copy from prepared dictionary */
+                    from = (unsigned char *)state->dict_end - copy;
+                } else {
+                    if (copy > state->whave) {
+                        if (state->sane) {
+                            strm->msg = (char *)"invalid distance too far back";
+                            state->mode = BAD;
+                            break;
+                        }
 #ifdef INFLATE_ALLOW_INVALID_DISTANCE_TOOFAR_ARRR
-                    Trace((stderr, "inflate.c too far\n"));
-                    copy -= state->whave;
-                    if (copy > state->length)
-                        copy = state->length;
-                    if (copy > left)
-                        copy = left;
-                    left -= copy;
-                    state->length -= copy;
-                    do {
-                        *put++ = 0;
-                    } while (--copy);
-                    if (state->length == 0)
-                        state->mode = LEN;
-                    break;
+                        Trace((stderr, "inflate.c too far\n"));
+                        copy -= state->whave;
+                        if (copy > state->length)
+                            copy = state->length;
+                        if (copy > left)
+                            copy = left;
+                        left -= copy;
+                        state->length -= copy;
+                        do {
+                            *put++ = 0;
+                        } while (--copy);
+                        if (state->length == 0)
+                            state->mode = LEN;
+                        break;
 #endif
-                }
-                if (copy > state->wnext) {
-                    copy -= state->wnext;
-                    from = state->window + (state->wsize - copy);
-                } else {
-                    from = state->window + (state->wnext - copy);
+                    }
+                    if (copy > state->wnext) {
+                        copy -= state->wnext;
+                        from = state->window + (state->wsize - copy);
+                    } else {
+                        from = state->window + (state->wnext - copy);
+                    }
                 }
                 if (copy > state->length)
                     copy = state->length;
                 if (copy > left)
                     copy = left;
 #if defined(INFFAST_CHUNKSIZE)
-                put = chunkcopysafe(put, from, copy, put + left);
+                put = functable.chunkcopy_safe(put, from, copy, put + left);
 #else
                 if (copy >= sizeof(uint64_t))
                     put = chunk_memcpy(put, from, copy);
@@ -991,7 +1175,7 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
                 if (copy > left)
                     copy = left;
 #if defined(INFFAST_CHUNKSIZE)
-                put = chunkmemsetsafe(put, state->offset, copy, left);
+                put = functable.chunkmemset_safe(put, state->offset, copy, left);
 #else
                 if (copy >= sizeof(uint64_t))
                     put = chunk_memset(put, put - state->offset, state->offset, copy);
@@ -1016,12 +1200,13 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
         case CHECK:
             if (state->wrap) {
                 NEEDBITS(32);
-                out -= left;
+                out -= left + reach;
                 strm->total_out += out;
                 state->total += out;
                 if (INFLATE_NEED_CHECKSUM(strm) && (state->wrap & 4) && out)
                     strm->adler = state->check = UPDATE(state->check, put - out, out);
                 out = left;
+                reach = 0;
                 if ((state->wrap & 4) && (
 #ifdef GUNZIP
                      state->flags ? hold :
@@ -1076,25 +1261,50 @@ int ZEXPORT PREFIX(inflate)(PREFIX3(stream) *strm, int flush) {
        Note: a memory error from inflate() is non-recoverable.
      */
   inf_leave:
+#ifndef ZLIB_COMPAT
+    /* Carry on with the next input fragment of zng_inflatev(), if any, so
+       that the window is only updated once for all of them */
+    if (have == 0 && state->gather_cnt != 0 && left != 0 && ret == Z_OK && state->mode < BAD &&
+            flush != Z_BLOCK && flush != Z_TREES) {
+        strm->total_in += in;
+        while (have == 0 && state->gather_cnt != 0) {
+            next = (const unsigned char *)state->gather->iov_base;
+            have = (unsigned)state->gather->iov_len;
+            state->gather++;
+            state->gather_cnt--;
+        }
+        in = have;
+        if (have != 0)
+            goto inf_gather;
+    }
+#endif
     RESTORE();
-    if (INFLATE_NEED_UPDATEWINDOW(strm) &&
-            (state->wsize || (out != strm->avail_out && state->mode < BAD &&
+    in -= strm->avail_in;
+    out -= strm->avail_out + reach;
+    strm->avail_out += held;
+    if (state->whole)
+        state->whole_have = out < (1U << MAX_WBITS) - reach ? reach + out : (1U << MAX_WBITS);
+    cksum = INFLATE_NEED_CHECKSUM(strm) && (state->wrap & 4) && out;
+    if (INFLATE_NEED_UPDATEWINDOW(strm) && !state->whole &&
+            (state->wsize || (out != 0 && state->mode < BAD &&
                  (state->mode < CHECK || flush != Z_FINISH)))) {
-        if (updatewindow(strm, strm->next_out, out - strm->avail_out)) {
+        if (updatewindow(strm, strm->next_out, out, cksum)) {
             state->mode = MEM;
             return Z_MEM_ERROR;
         }
+        if (cksum) {
+            strm->adler = state->check;
+            cksum = 0;
+        }
     }
-    in -= strm->avail_in;
-    out -= strm->avail_out;
     strm->total_in += in;
     strm->total_out += out;
     state->total += out;
-    if (INFLATE_NEED_CHECKSUM(strm) && (state->wrap & 4) && out)
+    if (cksum)
         strm->adler = state->check = UPDATE(state->check, strm->next_out - out, out);
     strm->data_type = (int)state->bits + (state->last ? 64 : 0) +
                       (state->mode == TYPE ? 128 : 0) + (state->mode == LEN_ || state->mode == COPY_ ? 256 : 0);
-    if (((in == 0 && out == 0) || flush == Z_FINISH) && ret == Z_OK)
+    if (((in == 0 && out == 0) || (flush == Z_FINISH && !(limited && left == 0))) && ret == Z_OK)
         ret = Z_BUF_ERROR;
     return ret;
 }
@@ -1105,7 +1315,11 @@ int ZEXPORT PREFIX(inflateEnd)(PREFIX3(stream) *strm) {
         return Z_STREAM_ERROR;
     state = (struct inflate_state *)strm->state;
     if (state->window != NULL)
-        ZFREE_WINDOW(strm, state->window);
+        free_window(strm, state);
+#ifndef ZLIB_COMPAT
+    if (state->verify != NULL)
+        ZFREE(strm, state->verify);
+#endif
     ZFREE_STATE(strm, strm->state);
     strm->state = NULL;
     Tracev((stderr, "inflate: end\n"));
@@ -1120,13 +1334,17 @@ int ZEXPORT PREFIX(inflateGetDictionary)(PREFIX3(stream) *strm, unsigned char *d
         return Z_STREAM_ERROR;
     state = (struct inflate_state *)strm->state;
 
-    /* copy dictionary */
+    /* copy dictionary, starting with what is still in reach of a prepared one */
+    if (state->dict_have && dictionary != NULL) {
+        memcpy(dictionary, state->dict_end - state->dict_have, state->dict_have);
+        dictionary += state->dict_have;
+    }
     if (state->whave && dictionary != NULL) {
         memcpy(dictionary, state->window + state->wnext, state->whave - state->wnext);
         memcpy(dictionary + state->whave - state->wnext, state->window, state->wnext);
     }
     if (dictLength != NULL)
-        *dictLength = state->whave;
+        *dictLength = state->dict_have + state->whave;
     return Z_OK;
 }
 
@@ -1152,7 +1370,7 @@ int ZEXPORT PREFIX(inflateSetDictionary)(PREFIX3(stream) *strm, const unsigned c
 
     /* copy dictionary to window using updatewindow(), which will amend the
        existing dictionary if appropriate */
-    ret = updatewindow(strm, dictionary + dictLength, dictLength);
+    ret = updatewindow(strm, dictionary + dictLength, dictLength, 0);
     if (ret) {
         state->mode = MEM;
         return Z_MEM_ERROR;
@@ -1310,8 +1528,14 @@ int ZEXPORT PREFIX(inflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source)
     if (state->lencode >= state->codes && state->lencode <= state->codes + ENOUGH - 1) {
         copy->lencode = copy->codes + (state->lencode - state->codes);
         copy->distcode = copy->codes + (state->distcode - state->codes);
+    } else if (state->lencode == state->lenlens) {
+        copy->lencode = copy->lenlens;
     }
     copy->next = copy->codes + (state->next - state->codes);
+#ifndef ZLIB_COMPAT
+    copy->share = NULL;
+    copy->verify = NULL;
+#endif
     if (window != NULL) {
         wsize = 1U << state->wbits;
         memcpy(window, state->window, wsize);
@@ -1321,6 +1545,49 @@ int ZEXPORT PREFIX(inflateCopy)(PREFIX3(stream) *dest, PREFIX3(stream) *source)
     return Z_OK;
 }
 
+#ifndef ZLIB_COMPAT
+int ZEXPORT zng_inflateCopyShared(zng_stream *dest, zng_stream *source) {
+    struct inflate_state *state;
+    struct inflate_state *copy;
+
+    /* check input */
+    if (inflateStateCheck(source) || dest == NULL)
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)source->state;
+
+    /* without a window there is nothing to share, and the copy of a stream in
+       an arena or a region of its own is allocated there */
+    if (state->window == NULL || source->zalloc == zng_arena_alloc || source->zalloc == zng_node_alloc)
+        return zng_inflateCopy(dest, source);
+    if (state->share == NULL) {
+        state->share = (z_atomic_t *)ZALLOC(source, 1, sizeof(z_atomic_t));
+        if (state->share == NULL)
+            return Z_MEM_ERROR;
+        *state->share = 1;
+    }
+
+    /* copy state, and share the window */
+    copy = (struct inflate_state *)
+           ZALLOC_STATE(source, 1, sizeof(struct inflate_state));
+    if (copy == NULL)
+        return Z_MEM_ERROR;
+    memcpy((void *)dest, (void *)source, sizeof(zng_stream));
+    ZCOPY_STATE((void *)copy, (void *)state, sizeof(struct inflate_state));
+    copy->strm = dest;
+    if (state->lencode >= state->codes && state->lencode <= state->codes + ENOUGH - 1) {
+        copy->lencode = copy->codes + (state->lencode - state->codes);
+        copy->distcode = copy->codes + (state->distcode - state->codes);
+    } else if (state->lencode == state->lenlens) {
+        copy->lencode = copy->lenlens;
+    }
+    copy->next = copy->codes + (state->next - state->codes);
+    copy->verify = NULL;
+    z_atomic_increment(state->share);
+    dest->state = (struct internal_state *)copy;
+    return Z_OK;
+}
+#endif
+
 int ZEXPORT PREFIX(inflateUndermine)(PREFIX3(stream) *strm, int subvert) {
     struct inflate_state *state;
 
@@ -1350,6 +1617,26 @@ int ZEXPORT PREFIX(inflateValidate)(PREFIX3(stream) *strm, int check) {
     return Z_OK;
 }
 
+/* The window is not kept up to date in whole-buffer mode, so leaving it after
+   output was made takes the window from the output before next_out, which
+   must still be as inflate() left it */
+int ZLIB_INTERNAL inflate_whole_buffer(PREFIX3(stream) *strm, int whole) {
+    struct inflate_state *state;
+
+    if (inflateStateCheck(strm))
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)strm->state;
+    if (!whole && state->whole && state->whole_have != 0) {
+        if (updatewindow(strm, strm->next_out, state->whole_have, 0)) {
+            state->mode = MEM;
+            return Z_MEM_ERROR;
+        }
+        state->whole_have = 0;
+    }
+    state->whole = whole != 0;
+    return Z_OK;
+}
+
 long ZEXPORT PREFIX(inflateMark)(PREFIX3(stream) *strm) {
     struct inflate_state *state;
 
@@ -1368,3 +1655,626 @@ unsigned long ZEXPORT PREFIX(inflateCodesUsed)(PREFIX3(stream) *strm) {
     state = (struct inflate_state *)strm->state;
     return (unsigned long)(state->next - state->codes);
 }
+
+#ifndef ZLIB_COMPAT
+size_t ZEXPORT zng_inflateArenaSize(int windowBits) {
+    size_t window;
+
+    /* Same windowBits handling as inflateReset2(), where 0 takes the size from the zlib header */
+    if (windowBits < 0)
+        windowBits = -windowBits;
+    else
+        windowBits &= 15;
+    if (windowBits == 0)
+        windowBits = 15;
+    if (windowBits < 8 || windowBits > 15)
+        return 0;
+
+    window = (size_t)1 << windowBits;
+#ifdef INFFAST_CHUNKSIZE
+    window += INFFAST_CHUNKSIZE;
+#endif
+    return ARENA_SIZE(ARENA_ROUND(sizeof(struct inflate_state)) + ARENA_ROUND(window) + INFLATE_ARENA_EXTRA);
+}
+
+int ZEXPORT zng_inflateInitArena(zng_stream *strm, void *arena, size_t arena_size, int windowBits) {
+    zng_arena *a;
+
+    if (strm == NULL)
+        return Z_STREAM_ERROR;
+    a = zng_arena_init(arena, arena_size);
+    if (a == NULL)
+        return Z_MEM_ERROR;
+    strm->zalloc = zng_arena_alloc;
+    strm->zfree = zng_arena_free;
+    strm->opaque = a;
+    return zng_inflateInit2_(strm, windowBits, ZLIBNG_VERSION, (int)sizeof(zng_stream));
+}
+
+struct zng_inflate_dict_s {
+    uint32_t adler;             /* Adler-32 of the whole dictionary */
+    uint32_t length;            /* bytes of dictionary kept */
+    unsigned char data[1];      /* the last length bytes, padded like the window */
+};
+
+zng_inflate_dict * ZEXPORT zng_inflatePrepareDictionary(const uint8_t *dictionary, uint32_t dictLength) {
+    zng_inflate_dict *dict;
+    uint32_t length, padding = 0;
+
+    if (dictionary == NULL)
+        return NULL;
+    length = dictLength < (1U << MAX_WBITS) ? dictLength : (1U << MAX_WBITS);
+#ifdef INFFAST_CHUNKSIZE
+    padding = INFFAST_CHUNKSIZE;
+#endif
+
+    dict = (zng_inflate_dict *)zng_calloc(NULL, 1, sizeof(zng_inflate_dict) + length + padding);
+    if (dict == NULL)
+        return NULL;
+    dict->adler = functable.adler32(1L, dictionary, dictLength);
+    dict->length = length;
+    memcpy(dict->data, dictionary + dictLength - length, length);
+    memset(dict->data + length, 0, padding + 1);
+    return dict;
+}
+
+int ZEXPORT zng_inflateSetPreparedDictionary(zng_stream *strm, const zng_inflate_dict *dict) {
+    struct inflate_state *state;
+
+    /* check state */
+    if (inflateStateCheck(strm) || dict == NULL)
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)strm->state;
+    if ((state->wrap != 0 && state->mode != DICT) || state->whave != 0)
+        return Z_STREAM_ERROR;
+
+    /* check for correct dictionary identifier */
+    if (state->mode == DICT && dict->adler != state->check)
+        return Z_DATA_ERROR;
+
+    /* arch-specific code that keeps its own history needs it in the window */
+    if (!INFLATE_NEED_UPDATEWINDOW(strm))
+        return PREFIX(inflateSetDictionary)(strm, dict->data, dict->length);
+
+    state->dict_end = dict->data + dict->length;
+    state->dict_have = dict->length;
+    if (state->dict_have > (1U << state->wbits))
+        state->dict_have = 1U << state->wbits;
+    state->havedict = 1;
+    Tracev((stderr, "inflate:   prepared dictionary set\n"));
+    return Z_OK;
+}
+
+void ZEXPORT zng_inflateFreePreparedDictionary(zng_inflate_dict *dict) {
+    if (dict != NULL)
+        zng_cfree(NULL, dict);
+}
+
+int ZEXPORT zng_inflateWholeBuffer(zng_stream *strm, int whole) {
+    return inflate_whole_buffer(strm, whole);
+}
+
+int ZEXPORT zng_inflateMaxOutput(zng_stream *strm, uint32_t max_output) {
+    if (inflateStateCheck(strm))
+        return Z_STREAM_ERROR;
+    ((struct inflate_state *)strm->state)->max_output = max_output;
+    return Z_OK;
+}
+
+/* Move next_in to the next nonempty input fragment of zng_inflatev(), if any */
+static void gather_next(struct inflate_state *state) {
+    PREFIX3(stream) *strm = state->strm;
+
+    while (strm->avail_in == 0 && state->gather_cnt != 0) {
+        strm->next_in = (const unsigned char *)state->gather->iov_base;
+        strm->avail_in = (uint32_t)state->gather->iov_len;
+        state->gather++;
+        state->gather_cnt--;
+    }
+}
+
+int ZEXPORT zng_inflatev(zng_stream *strm, const zng_iovec *iov, size_t iovcnt, size_t *consumed, int flush) {
+    struct inflate_state *state;
+    const unsigned char *next_in;
+    uint32_t avail_in;
+    size_t total_in, total_out, i;
+    int ret;
+
+    if (inflateStateCheck(strm) || (iov == NULL && iovcnt != 0) || consumed == NULL)
+        return Z_STREAM_ERROR;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len > UINT32_MAX || (iov[i].iov_base == NULL && iov[i].iov_len != 0))
+            return Z_STREAM_ERROR;
+    }
+    state = (struct inflate_state *)strm->state;
+    next_in = strm->next_in;
+    avail_in = strm->avail_in;
+    total_in = strm->total_in;
+    total_out = strm->total_out;
+
+    /* inflate() goes on to the next fragment by itself when one is used up,
+       except where it has to stop for Z_BLOCK or Z_TREES, in which case only
+       the input that it reached is consumed */
+    state->gather = iov;
+    state->gather_cnt = iovcnt;
+    strm->next_in = NULL;
+    strm->avail_in = 0;
+    gather_next(state);
+    for (;;) {
+        ret = PREFIX(inflate)(strm, flush);
+        if ((ret != Z_OK && ret != Z_BUF_ERROR) || strm->avail_out == 0 || strm->avail_in != 0 ||
+                state->gather_cnt == 0 || flush == Z_BLOCK || flush == Z_TREES)
+            break;
+        gather_next(state);
+    }
+    state->gather = NULL;
+    state->gather_cnt = 0;
+
+    *consumed = strm->total_in - total_in;
+    strm->next_in = next_in;
+    strm->avail_in = avail_in;
+    /* Like inflate(), only an error if no progress was made, or at Z_FINISH if the stream did not end */
+    if (ret == Z_BUF_ERROR && flush != Z_FINISH && (*consumed != 0 || strm->total_out != total_out))
+        ret = Z_OK;
+    return ret;
+}
+
+/* The output of zng_inflateVerify() goes to a buffer of the size of the
+   largest window, which stays in the cache while the window is updated from it
+   and the check value is computed on the way */
+#define VERIFY_SIZE (1U << MAX_WBITS)
+
+int ZEXPORT zng_inflateVerify(zng_stream *strm, int flush) {
+    struct inflate_state *state;
+    unsigned char *next_out;
+    uint32_t avail_out;
+    size_t total_in, total_out;
+    int ret;
+
+    if (inflateStateCheck(strm) || flush == Z_BLOCK || flush == Z_TREES)
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)strm->state;
+    if (state->whole)
+        return Z_STREAM_ERROR;
+    if (state->verify == NULL) {
+        state->verify = (unsigned char *)ZALLOC(strm, VERIFY_SIZE, sizeof(unsigned char));
+        if (state->verify == NULL)
+            return Z_MEM_ERROR;
+    }
+
+    next_out = strm->next_out;
+    avail_out = strm->avail_out;
+    total_in = strm->total_in;
+    total_out = strm->total_out;
+    do {
+        strm->next_out = state->verify;
+        strm->avail_out = VERIFY_SIZE;
+        ret = zng_inflate(strm, flush == Z_FINISH ? Z_NO_FLUSH : flush);
+    } while (ret == Z_OK && strm->avail_out == 0);
+    strm->next_out = next_out;
+    strm->avail_out = avail_out;
+
+    /* Like inflate(), only an error if no progress was made, or at Z_FINISH if the stream did not end */
+    if (ret == Z_BUF_ERROR && (strm->total_in != total_in || strm->total_out != total_out))
+        ret = Z_OK;
+    if (ret == Z_OK && flush == Z_FINISH)
+        ret = Z_BUF_ERROR;
+    return ret;
+}
+
+/* The code tables are not kept, so a stream can only hibernate where inflate()
+   builds them again or does not use them */
+#define HIBERNATE_PART1 offsetof(struct inflate_state, lens)
+#define HIBERNATE_PART2 (sizeof(struct inflate_state) - offsetof(struct inflate_state, sane))
+
+int ZEXPORT zng_inflateHibernate(zng_stream *strm, void *blob, size_t *blob_len) {
+    struct inflate_state *state;
+    hibernate_header head;
+    unsigned char *out;
+    size_t need;
+    uint32_t have = 0;
+
+    if (inflateStateCheck(strm) || blob_len == NULL || strm->zalloc == zng_arena_alloc)
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)strm->state;
+    if ((state->mode > COPY && state->mode < CHECK) || state->mode > DONE)
+        return Z_BUF_ERROR;
+    if (state->window != NULL)
+        have = state->whave;
+    need = sizeof(hibernate_header) + HIBERNATE_PART1 + HIBERNATE_PART2 + have;
+    if (blob == NULL) {
+        *blob_len = need;
+        return Z_OK;
+    }
+    if (*blob_len < need)
+        return Z_BUF_ERROR;
+
+    head.magic = HIBERNATE_INFLATE;
+    head.state_size = (uint32_t)(HIBERNATE_PART1 + HIBERNATE_PART2);
+    head.window_size = have;
+    head.data_type = strm->data_type;
+    head.adler = strm->adler;
+    head.total_in = strm->total_in;
+    head.total_out = strm->total_out;
+    out = (unsigned char *)blob;
+    memcpy(out, &head, sizeof(head));
+    out += sizeof(head);
+    memcpy(out, state, HIBERNATE_PART1);
+    out += HIBERNATE_PART1;
+    memcpy(out, &state->sane, HIBERNATE_PART2);
+    out += HIBERNATE_PART2;
+
+    /* The window is written oldest byte first */
+    if (have == state->wsize) {
+        memcpy(out, state->window + state->wnext, state->wsize - state->wnext);
+        memcpy(out + state->wsize - state->wnext, state->window, state->wnext);
+    } else if (have != 0) {
+        memcpy(out, state->window, have);
+    }
+    *blob_len = need;
+    return PREFIX(inflateEnd)(strm);
+}
+
+int ZEXPORT zng_inflateRestore(zng_stream *strm, const void *blob, size_t blob_len) {
+    struct inflate_state *state;
+    hibernate_header head;
+    const unsigned char *in;
+
+    if (strm == NULL || blob == NULL)
+        return Z_STREAM_ERROR;
+    if (blob_len < sizeof(head))
+        return Z_DATA_ERROR;
+    memcpy(&head, blob, sizeof(head));
+    if (head.magic != HIBERNATE_INFLATE || head.state_size != HIBERNATE_PART1 + HIBERNATE_PART2 ||
+        blob_len != sizeof(head) + head.state_size + head.window_size)
+        return Z_DATA_ERROR;
+
+    strm->msg = NULL;
+    if (strm->zalloc == NULL) {
+        strm->zalloc = zng_calloc;
+        strm->opaque = NULL;
+    }
+    if (strm->zfree == NULL)
+        strm->zfree = zng_cfree;
+    state = (struct inflate_state *) ZALLOC_STATE(strm, 1, sizeof(struct inflate_state));
+    if (state == NULL)
+        return Z_MEM_ERROR;
+    in = (const unsigned char *)blob + sizeof(head);
+    memcpy(state, in, HIBERNATE_PART1);
+    memcpy(&state->sane, in + HIBERNATE_PART1, HIBERNATE_PART2);
+    in += head.state_size;
+    if (head.window_size > state->wsize || (state->mode > COPY && state->mode < CHECK) ||
+        state->mode < HEAD || state->mode > DONE) {
+        ZFREE_STATE(strm, state);
+        return Z_DATA_ERROR;
+    }
+    state->strm = strm;
+    state->lencode = state->distcode = state->next = state->codes;
+    state->cache_nlen = 0;
+    state->cache_pairs = 0;
+    state->gather = NULL;
+    state->gather_cnt = 0;
+    state->share = NULL;
+    state->verify = NULL;
+    state->lane = 0;
+
+    /* A window that was not in use is allocated by inflate() when it needs it */
+    state->window = NULL;
+    if (head.window_size == 0) {
+        state->wsize = 0;
+    } else {
+        if (inflate_ensure_window(state)) {
+            ZFREE_STATE(strm, state);
+            return Z_MEM_ERROR;
+        }
+        memcpy(state->window, in, head.window_size);
+        state->whave = head.window_size;
+        state->wnext = head.window_size == state->wsize ? 0 : head.window_size;
+    }
+    strm->state = (struct internal_state *)state;
+    strm->data_type = head.data_type;
+    strm->adler = head.adler;
+    strm->total_in = head.total_in;
+    strm->total_out = head.total_out;
+    return Z_OK;
+}
+
+/* The code lengths that are kept: those read so far in LENLENS, in the order
+   of the header, and those of the tables of a dynamic block, from which the
+   tables are built again */
+static const uint16_t lens_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static unsigned serialize_lens(const struct inflate_state *state, int fixed) {
+    if (state->mode == LENLENS)
+        return state->have;
+    if (state->mode >= LEN_ && state->mode <= LIT && !fixed)
+        return state->nlen + state->ndist;
+    return 0;
+}
+
+int ZEXPORT zng_inflateSerialize(zng_stream *strm, void *buf, size_t *len) {
+    struct inflate_state *state;
+    zng_wire w;
+    uint32_t reach, n;
+    unsigned i, lens;
+    int fixed;
+
+    if (inflateStateCheck(strm) || len == NULL)
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)strm->state;
+    /* The code length code is not kept once the code lengths are being read */
+    if (state->mode == CODELENS || state->mode >= BAD)
+        return Z_BUF_ERROR;
+    fixed = state->lencode == lenfix;
+    lens = serialize_lens(state, fixed);
+
+    w.buf = (unsigned char *)buf;
+    w.size = buf == NULL ? 0 : *len;
+    w.len = 0;
+    zng_wire_put(&w, SERIALIZE_INFLATE, 4);
+    zng_wire_put(&w, SERIALIZE_VERSION, 1);
+    zng_wire_put(&w, (uint32_t)strm->data_type, 4);
+    zng_wire_put(&w, strm->adler, 4);
+    zng_wire_put(&w, strm->total_in, 8);
+    zng_wire_put(&w, strm->total_out, 8);
+
+    zng_wire_put(&w, state->mode - HEAD, 1);
+    zng_wire_put(&w, state->last, 1);
+    zng_wire_put(&w, state->wrap, 1);
+    zng_wire_put(&w, state->havedict, 1);
+    zng_wire_put(&w, (uint32_t)state->flags, 4);
+    zng_wire_put(&w, state->dmax, 4);
+    zng_wire_put(&w, state->check, 4);
+    zng_wire_put(&w, state->total, 8);
+    zng_wire_put(&w, state->wbits, 1);
+    zng_wire_put(&w, state->hold, 4);
+    zng_wire_put(&w, state->bits, 1);
+    zng_wire_put(&w, state->length, 4);
+    zng_wire_put(&w, state->offset, 4);
+    zng_wire_put(&w, state->extra, 1);
+    zng_wire_put(&w, (unsigned)fixed, 1);
+    if (state->mode >= LENLENS && state->mode <= LIT) {
+        zng_wire_put(&w, state->ncode, 2);
+        zng_wire_put(&w, state->nlen, 2);
+        zng_wire_put(&w, state->ndist, 2);
+        zng_wire_put(&w, state->have, 2);
+    }
+    for (i = 0; i < lens; i++)
+        zng_wire_put(&w, state->lens[state->mode == LENLENS ? lens_order[i] : i], 1);
+    zng_wire_put(&w, (unsigned)state->sane, 1);
+    zng_wire_put(&w, (uint32_t)state->back, 4);
+    zng_wire_put(&w, state->was, 4);
+
+    /* What matches can reach, oldest byte first: the output kept in place in
+       whole-buffer mode, or what is left of a prepared dictionary and then the
+       window */
+    if (state->whole) {
+        reach = state->whole_have;
+        if (state->wbits != 0 && reach > (1U << state->wbits))
+            reach = 1U << state->wbits;
+        zng_wire_put(&w, reach, 4);
+        zng_wire_put_buf(&w, strm->next_out - reach, reach);
+    } else {
+        n = state->window != NULL ? state->whave : 0;
+        zng_wire_put(&w, state->dict_have + n, 4);
+        if (state->dict_have != 0)
+            zng_wire_put_buf(&w, state->dict_end - state->dict_have, state->dict_have);
+        if (n != 0) {
+            zng_wire_put_buf(&w, state->window + state->wnext, n - state->wnext);
+            zng_wire_put_buf(&w, state->window, state->wnext);
+        }
+    }
+
+    if (buf != NULL && w.len > *len)
+        return Z_BUF_ERROR;
+    *len = w.len;
+    return Z_OK;
+}
+
+int ZEXPORT zng_inflateDeserialize(zng_stream *strm, const void *buf, size_t len) {
+    struct inflate_state *state;
+    const unsigned char *history;
+    zng_wire w;
+    unsigned i, n, lens, mode, fixed;
+    uint32_t reach;
+    int ret;
+
+    if (strm == NULL || buf == NULL)
+        return Z_STREAM_ERROR;
+    w.buf = (unsigned char *)buf;
+    w.size = len;
+    w.len = 0;
+    w.bad = 0;
+    if (zng_wire_get(&w, 4) != SERIALIZE_INFLATE)
+        return Z_DATA_ERROR;
+    if (zng_wire_get(&w, 1) != SERIALIZE_VERSION)
+        return Z_VERSION_ERROR;
+
+    strm->msg = NULL;
+    if (strm->zalloc == NULL) {
+        strm->zalloc = zng_calloc;
+        strm->opaque = NULL;
+    }
+    if (strm->zfree == NULL)
+        strm->zfree = zng_cfree;
+    state = (struct inflate_state *) ZALLOC_STATE(strm, 1, sizeof(struct inflate_state));
+    if (state == NULL)
+        return Z_MEM_ERROR;
+    state->strm = strm;
+    state->head = NULL;
+    state->window = NULL;
+    state->wsize = 0;
+    state->whave = 0;
+    state->wnext = 0;
+    state->dict_end = NULL;
+    state->dict_have = 0;
+    state->whole = 0;
+    state->whole_have = 0;
+    state->gather = NULL;
+    state->gather_cnt = 0;
+    state->share = NULL;
+    state->verify = NULL;
+    state->lane = 0;
+    state->max_output = 0;
+    state->cache_nlen = 0;
+    state->cache_pairs = 0;
+    state->lencode = state->distcode = state->next = state->codes;
+
+    strm->data_type = (int)zng_wire_get(&w, 4);
+    strm->adler = (uint32_t)zng_wire_get(&w, 4);
+    strm->total_in = (size_t)zng_wire_get(&w, 8);
+    strm->total_out = (size_t)zng_wire_get(&w, 8);
+
+    mode = (unsigned)zng_wire_get(&w, 1);
+    state->mode = (inflate_mode)(HEAD + mode);
+    state->last = (int)zng_wire_get(&w, 1);
+    state->wrap = (int)zng_wire_get(&w, 1);
+    state->havedict = (int)zng_wire_get(&w, 1);
+    state->flags = (int)(uint32_t)zng_wire_get(&w, 4);
+    state->dmax = (unsigned)zng_wire_get(&w, 4);
+    state->check = (unsigned long)zng_wire_get(&w, 4);
+    state->total = (unsigned long)zng_wire_get(&w, 8);
+    state->wbits = (unsigned)zng_wire_get(&w, 1);
+    state->hold = (uint32_t)zng_wire_get(&w, 4);
+    state->bits = (unsigned)zng_wire_get(&w, 1);
+    state->length = (uint32_t)zng_wire_get(&w, 4);
+    state->offset = (unsigned)zng_wire_get(&w, 4);
+    state->extra = (unsigned)zng_wire_get(&w, 1);
+    fixed = (unsigned)zng_wire_get(&w, 1);
+    state->ncode = state->nlen = state->ndist = state->have = 0;
+    if (state->mode >= LENLENS && state->mode <= LIT) {
+        state->ncode = (unsigned)zng_wire_get(&w, 2);
+        state->nlen = (unsigned)zng_wire_get(&w, 2);
+        state->ndist = (unsigned)zng_wire_get(&w, 2);
+        state->have = (uint32_t)zng_wire_get(&w, 2);
+    }
+    /* Only what inflate() itself could have left is taken, as the tables and
+       the copies are made from these without further checks */
+    ret = Z_DATA_ERROR;
+    if (w.bad || mode > DONE - HEAD || state->mode == CODELENS || state->wbits > MAX_WBITS ||
+        (state->wbits != 0 && state->wbits < 8) || state->bits > 32 ||
+        (state->bits < 32 && state->hold >> state->bits != 0) ||
+        state->ncode > 19 || state->nlen > 286 || state->ndist > 30 || state->have > 286 + 30 || fixed > 1)
+        goto fail;
+    if ((state->mode == COPY_ || state->mode == COPY) && state->length > 65535)
+        goto fail;
+    if ((state->mode == LENEXT || state->mode == DISTEXT) && state->extra > 15)
+        goto fail;
+    if ((state->mode >= LENEXT && state->mode <= MATCH && state->length > 258) ||
+        (state->mode >= DISTEXT && state->mode <= MATCH && state->offset > 32768))
+        goto fail;
+    lens = serialize_lens(state, fixed);
+    if ((state->mode == LENLENS && state->have > state->ncode) ||
+        (state->mode >= LEN_ && state->mode <= LIT && !fixed && state->have != state->nlen + state->ndist))
+        goto fail;
+    for (i = 0; i < lens; i++) {
+        n = (unsigned)zng_wire_get(&w, 1);
+        if (n > (state->mode == LENLENS ? 7U : 15U))
+            goto fail;
+        state->lens[state->mode == LENLENS ? lens_order[i] : i] = (uint16_t)n;
+    }
+    if (state->mode >= LEN_ && state->mode <= LIT && !fixed && state->lens[256] == 0)
+        goto fail;
+    /* The check of distances too far back cannot be turned off by the buffer */
+    state->sane = 1;
+    (void)zng_wire_get(&w, 1);
+    state->back = (int)(uint32_t)zng_wire_get(&w, 4);
+    state->was = (unsigned)zng_wire_get(&w, 4);
+    reach = (uint32_t)zng_wire_get(&w, 4);
+    history = zng_wire_get_buf(&w, reach);
+    if (w.bad || w.len != len || (reach != 0 && (state->wbits == 0 || reach > (1U << state->wbits))))
+        goto fail;
+
+    /* The tables of the block, built as in CODELENS or by fixedtables() */
+    if (state->mode >= LEN_ && state->mode <= LIT) {
+        if (fixed) {
+            fixedtables(state);
+        } else {
+            state->next = state->codes;
+            state->lencode = (const code *)(state->next);
+            state->lenbits = 9;
+            if (zng_inflate_table(LENS, state->lens, state->nlen, &(state->next), &(state->lenbits), state->work))
+                goto fail;
+            zng_inflate_table_pairs(state->lencode, state->lenbits, state->lenpair);
+            state->distcode = (const code *)(state->next);
+            state->distbits = 6;
+            if (zng_inflate_table(DISTS, state->lens + state->nlen, state->ndist, &(state->next), &(state->distbits),
+                                  state->work))
+                goto fail;
+        }
+    }
+
+    if (reach != 0) {
+        ret = Z_MEM_ERROR;
+        if (inflate_ensure_window(state))
+            goto fail;
+        memcpy(state->window, history, reach);
+        state->whave = reach;
+        state->wnext = reach == state->wsize ? 0 : reach;
+    }
+    strm->state = (struct internal_state *)state;
+    return Z_OK;
+
+fail:
+    if (state->window != NULL)
+        ZFREE_WINDOW(strm, state->window);
+    ZFREE_STATE(strm, state);
+    return ret;
+}
+
+/* Decode the n streams, at most INFLATE_LANES, each of them in whole-buffer
+   mode with all of its input and output given, and put what inflate() with
+   Z_FINISH finally returned for each in ret[]. Where inflate() would call
+   inflate_fast(), it returns instead, and the streams that did so are decoded
+   together by inflate_fast_lanes(), one symbol of each in turn, so that the
+   table lookups of one stream overlap with those of the others. */
+void ZLIB_INTERNAL inflate_lanes(PREFIX3(stream) **strm, int *ret, unsigned n) {
+    PREFIX3(stream) *fast[INFLATE_LANES];
+    const unsigned char *next_in[INFLATE_LANES];
+    unsigned char *next_out[INFLATE_LANES];
+    struct inflate_state *state;
+    unsigned i, k;
+    size_t in, out;
+
+    Assert(n <= INFLATE_LANES, "too many lanes");
+    for (i = 0; i < n; i++)
+        ret[i] = Z_OK;
+    for (;;) {
+        k = 0;
+        for (i = 0; i < n; i++) {
+            if (ret[i] != Z_OK)
+                continue;
+            state = (struct inflate_state *)strm[i]->state;
+            state->lane = 1;
+            ret[i] = PREFIX(inflate)(strm[i], Z_FINISH);
+            state->lane = 0;
+            if (state->mode == LEN && strm[i]->avail_in >= INFLATE_FAST_MIN_HAVE &&
+                strm[i]->avail_out >= INFLATE_FAST_MIN_LEFT) {
+                next_in[k] = strm[i]->next_in;
+                next_out[k] = strm[i]->next_out;
+                fast[k++] = strm[i];
+                ret[i] = Z_OK;
+            }
+        }
+        if (k == 0)
+            break;
+        zng_inflate_fast_lanes(fast, k);
+
+        /* Do what inflate() does after inflate_fast() and on its return */
+        for (i = 0; i < k; i++) {
+            state = (struct inflate_state *)fast[i]->state;
+            in = (size_t)(fast[i]->next_in - next_in[i]);
+            out = (size_t)(fast[i]->next_out - next_out[i]);
+            if (state->mode == TYPE)
+                state->back = -1;
+            state->whole_have = out < (1U << MAX_WBITS) - state->whole_have ? state->whole_have + (uint32_t)out
+                                                                               : (1U << MAX_WBITS);
+            fast[i]->total_in += in;
+            fast[i]->total_out += out;
+            state->total += out;
+            if ((state->wrap & 4) && out)
+                fast[i]->adler = state->check = UPDATE(state->check, next_out[i], out);
+        }
+    }
+}
+#endif
@@ -11,6 +11,10 @@
 #ifndef INFLATE_H_
 #define INFLATE_H_
 
+#ifndef ZLIB_COMPAT
+#  include "zthread.h"
+#endif
+
 /* define NO_GZIP when compiling if you want to disable gzip header and
    trailer decoding by inflate().  NO_GZIP would be used to avoid linking in
    the crc code when it is not needed.  For shared libraries, gzip decoding
@@ -80,7 +84,7 @@ typedef enum {
         CHECK -> LENGTH -> DONE
  */
 
-/* State maintained between inflate() calls -- approximately 7K bytes, not
+/* State maintained between inflate() calls -- approximately 15K bytes, not
    including the allocated sliding window, which is up to 32K bytes. */
 struct inflate_state {
     PREFIX3(stream) *strm;             /* pointer back to this zlib stream */
@@ -101,6 +105,8 @@ struct inflate_state {
     uint32_t whave;             /* valid bytes in the window */
     uint32_t wnext;             /* window write index */
     unsigned char *window;      /* allocated sliding window, if needed */
+    const unsigned char *dict_end; /* end of a prepared dictionary before the window */
+    uint32_t dict_have;         /* bytes of it within reach, or zero if none */
         /* bit accumulator */
     uint32_t hold;              /* input bit accumulator */
     unsigned bits;              /* number of bits in "in" */
@@ -123,12 +129,41 @@ struct inflate_state {
     uint16_t lens[320];         /* temporary storage for code lengths */
     uint16_t work[288];         /* work area for code table building */
     code codes[ENOUGH];         /* space for code tables */
+    code lenpair[1U << PAIR_BITS]; /* first lookup of inflate_fast() */
+    code lenlens[1U << 7];      /* code length code table, kept out of codes[] */
+        /* dynamic tables kept in codes[] for a later block with the same code lengths */
+    unsigned cache_nlen;        /* nlen of the tables in codes[], or zero if none */
+    unsigned cache_ndist;       /* ndist of the tables in codes[] */
+    unsigned cache_lenbits;     /* lenbits of the tables in codes[] */
+    unsigned cache_distbits;    /* distbits of the tables in codes[] */
+    unsigned cache_dist;        /* offset of the distance table in codes[] */
+    unsigned cache_used;        /* entries of codes[] used by the tables */
+    int cache_pairs;            /* true if lenpair[] was built from the tables in codes[] */
+    unsigned char cache_lens[320]; /* code lengths of the tables in codes[] */
     int sane;                   /* if false, allow invalid distance too far */
     int back;                   /* bits back of last unprocessed length/lit */
     unsigned was;               /* initial length of match */
+    int whole;                  /* true if the output since it was set stays in one buffer */
+    uint32_t whole_have;        /* bytes of that output within reach, up to 32K */
+#ifndef ZLIB_COMPAT
+    const zng_iovec *gather;    /* input fragments of zng_inflatev() not loaded yet, or NULL */
+    size_t gather_cnt;          /* number of them */
+    z_atomic_t *share;          /* streams using window after zng_inflateCopyShared(), or NULL */
+    unsigned char *verify;      /* output buffer of zng_inflateVerify(), or NULL */
+    int lane;                   /* true if inflate() returns instead of calling inflate_fast() */
+    uint32_t max_output;        /* output of one call of inflate() at most, or 0 for no limit */
+#endif
 };
 
 int ZLIB_INTERNAL inflate_ensure_window(struct inflate_state *state);
+int ZLIB_INTERNAL inflate_whole_buffer(PREFIX3(stream) *strm, int whole);
 void ZLIB_INTERNAL fixedtables(struct inflate_state *state);
 
+#ifndef ZLIB_COMPAT
+/* Most streams that inflate_lanes() decodes together */
+#define INFLATE_LANES 4
+
+void ZLIB_INTERNAL inflate_lanes(PREFIX3(stream) **strm, int *ret, unsigned n);
+#endif
+
 #endif /* INFLATE_H_ */
@@ -17,6 +17,14 @@
 #  define UPDATE(check, buf, len) functable.adler32(check, buf, len)
 #endif
 
+/* same as UPDATE(), while copying len bytes from src to dst */
+#ifdef GUNZIP
+#  define UPDATE_COPY(check, dst, src, len) \
+    (state->flags ? functable.crc32_copy(check, dst, src, len) : functable.adler32_copy(check, dst, src, len))
+#else
+#  define UPDATE_COPY(check, dst, src, len) functable.adler32_copy(check, dst, src, len)
+#endif
+
 /* check macros for header crc */
 #ifdef GUNZIP
 #  define CRC2(check, word) \
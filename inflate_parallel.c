@@ -0,0 +1,608 @@
+/* inflate_parallel.c -- decompress a buffer using several threads
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * A deflate stream does not say where its blocks start, so the compressed
+ * input is cut into chunks at guessed bit offsets and each chunk but the first
+ * is decoded speculatively.  A worker searches forward from the start of its
+ * chunk for a bit offset where a block plausibly starts: a dynamic block
+ * header whose code length code is complete, or the byte after the 00 00 ff ff
+ * of an empty stored block as left by a sync flush, the pattern inflateSync()
+ * looks for.  The header is then decoded by inflate() itself, stopping with
+ * Z_TREES in the LEN_ or COPY_ state, which checks the code lengths and builds
+ * the decoding tables as for any other block.  The blocks are decoded from
+ * there with those tables into 16-bit symbols.  A match that reaches back
+ * before the chunk cannot be resolved yet, since the 32K window before the
+ * chunk is unknown, and is written as markers for the positions in that
+ * window.  Any error means the guess was wrong, and the search goes on from
+ * the next bit.
+ *
+ * Every chunk, whether decoded here or speculatively, decodes blocks while
+ * its position is before the guessed start of the next chunk, so that where
+ * one chunk ends is exactly where a correct guess for the next one starts.
+ * The calling thread decodes the first chunk for real and then takes the
+ * chunks in order: one whose guess starts where the previous chunk ended has
+ * its markers replaced from the output before it, and any other is decoded
+ * again for real from there.  If the guess is further on, the decoding first
+ * goes up to it, since it may still be a block boundary, as after the empty
+ * stored block of a sync flush.  The result is therefore always that of a plain
+ * inflate(), and a wrong guess only costs time.  At the end, inflate() checks
+ * the trailer.
+ */
+
+#ifndef ZLIB_COMPAT
+
+#include "zbuild.h"
+#include "zutil.h"
+#include "inftrees.h"
+#include "inflate.h"
+#include "inflate_p.h"
+#include "functable.h"
+#include "zthread.h"
+
+#define PARALLEL_INFLATE_DEFAULT_CHUNK (1024*1024)
+
+#ifdef Z_HAVE_THREADS
+
+#define PARALLEL_WINDOW 32768U
+#define PARALLEL_MARKER 256U    /* symbol of the first byte of the unknown window */
+
+typedef struct {
+    uint64_t stop;              /* blocks are decoded while before this bit offset */
+    uint64_t start;             /* bit offset of the first block found */
+    uint64_t end;               /* bit offset after the last block decoded */
+    uint16_t *out;              /* decoded bytes, and markers for the unknown window */
+    size_t out_len;             /* number of symbols at out */
+    size_t out_size;            /* number of symbols allocated at out */
+    int found;                  /* true if blocks were decoded from start to end */
+    int last;                   /* true if the final block was decoded */
+    int ready;                  /* true once the worker is done with the chunk */
+} parallel_chunk;
+
+typedef struct {
+    zng_stream *strm;           /* parent stream, for allocation */
+    const unsigned char *in;    /* deflate data after the header */
+    size_t in_len;              /* bytes at in */
+    size_t out_max;             /* no chunk can decode to more than this */
+    parallel_chunk *chunks;
+    unsigned int count;         /* number of chunks */
+    uint64_t chunk_bits;        /* guessed distance between chunks, in bits */
+    z_mutex_t lock;             /* protects the members below and ready */
+    z_cond_t cond;              /* signals a change of any of them */
+    unsigned int next;          /* next chunk for a worker to take */
+    unsigned int used;          /* chunks before this one are used up */
+    unsigned int ahead;         /* chunks that may be decoded past used */
+    int quit;                   /* the workers should stop */
+} parallel_inflate;
+
+/* ===========================================================================
+ * Return the 64 bits of in from bit offset bit on, with zeros past the end.
+ */
+static uint64_t parallel_peek(const unsigned char *in, size_t in_len, uint64_t bit) {
+    size_t pos = (size_t)(bit >> 3), i;
+    unsigned shift = (unsigned)(bit & 7);
+    uint64_t val = 0, top = 0;
+
+    for (i = 0; i < 8 && pos + i < in_len; i++)
+        val |= (uint64_t)in[pos + i] << (i << 3);
+    if (shift && pos + 8 < in_len)
+        top = (uint64_t)in[pos + 8] << (64 - shift);
+    return (val >> shift) | top;
+}
+
+/* ===========================================================================
+ * Return true if a block could start at bit offset bit: there is the header
+ * of a dynamic block with a complete code length code, or the end of an empty
+ * stored block.
+ */
+static int parallel_candidate(const unsigned char *in, size_t in_len, uint64_t bit) {
+    size_t pos = (size_t)(bit >> 3);
+    uint64_t head, lens;
+    unsigned ncode, kraft, len, i;
+
+    if ((bit & 7) == 0 && pos >= 4 && in[pos - 4] == 0 && in[pos - 3] == 0 &&
+        in[pos - 2] == 0xff && in[pos - 1] == 0xff)
+        return 1;
+
+    head = parallel_peek(in, in_len, bit);
+    if (((head >> 1) & 3) != 2 || ((head >> 3) & 31) > 29 || ((head >> 8) & 31) > 29)
+        return 0;
+    ncode = (unsigned)((head >> 13) & 15) + 4;
+    lens = parallel_peek(in, in_len, bit + 17);
+    kraft = 0;
+    for (i = 0; i < ncode; i++) {
+        len = (unsigned)(lens >> (3 * i)) & 7;
+        if (len)
+            kraft += 128U >> len;
+    }
+    return kraft == 128;
+}
+
+/* ===========================================================================
+ * Decode the block header at bit offset *bit with strm, a raw inflate stream,
+ * leaving the decoding tables or the stored length in its state. Return true
+ * with *bit set to the offset after the header, or false if it is invalid.
+ */
+static int parallel_header(zng_stream *strm, const unsigned char *in, size_t in_len, uint64_t *bit) {
+    struct inflate_state *state = (struct inflate_state *)strm->state;
+    size_t pos = (size_t)(*bit >> 3);
+    unsigned char dummy;
+
+    if (pos >= in_len)
+        return 0;
+    zng_inflateReset(strm);
+    strm->next_in = in + pos;
+    strm->avail_in = (uint32_t)(in_len - pos);
+    if (*bit & 7) {
+        zng_inflatePrime(strm, 8 - (int)(*bit & 7), in[pos] >> (*bit & 7));
+        strm->next_in++;
+        strm->avail_in--;
+    }
+    strm->next_out = &dummy;
+    strm->avail_out = 1;
+    if (zng_inflate(strm, Z_TREES) != Z_OK || (state->mode != LEN_ && state->mode != COPY_))
+        return 0;
+    *bit = (uint64_t)(strm->next_in - in) * 8 - state->bits;
+    return 1;
+}
+
+/* ===========================================================================
+ * Make room for need symbols in the output of c, up to out_max. Return false
+ * if that is too many or there is not enough memory.
+ */
+static int parallel_grow(parallel_inflate *par, parallel_chunk *c, size_t need) {
+    zng_stream *strm = par->strm;
+    uint16_t *out;
+    size_t size;
+
+    if (need <= c->out_size)
+        return 1;
+    if (need > par->out_max)
+        return 0;
+    size = c->out_size ? c->out_size << 1 : (size_t)(par->chunk_bits >> 1);
+    if (size < need)
+        size = need;
+    if (size > par->out_max)
+        size = par->out_max;
+    out = (uint16_t *)ZALLOC(strm, (unsigned)size, sizeof(uint16_t));
+    if (out == NULL)
+        return 0;
+    if (c->out_len)
+        memcpy(out, c->out, c->out_len * sizeof(uint16_t));
+    TRY_FREE(strm, c->out);
+    c->out = out;
+    c->out_size = size;
+    return 1;
+}
+
+/* ===========================================================================
+ * Decode the codes of a fixed or dynamic block from bit offset *bit with the
+ * tables in state up to the end-of-block code, appending to the output of c.
+ * A match that reaches back before the chunk is written as markers. Return
+ * true with *bit updated, or false if the data is invalid.
+ */
+static int parallel_codes(parallel_inflate *par, parallel_chunk *c, const struct inflate_state *state,
+                          uint64_t *bit) {
+    const unsigned char *in = par->in;
+    const code *lcode = state->lencode, *dcode = state->distcode;
+    uint64_t lmask = (1U << state->lenbits) - 1, dmask = (1U << state->distbits) - 1;
+    size_t pos = (size_t)(*bit >> 3), have = c->out_len;
+    uint64_t hold = 0;
+    unsigned bits = 0, used, len, dist;
+    uint16_t *out = c->out;
+    code here, last;
+
+    if (pos >= par->in_len)
+        return 0;
+    hold = in[pos++] >> (*bit & 7);
+    bits = 8 - (unsigned)(*bit & 7);
+    for (;;) {
+        /* enough for a length and a distance with their extra bits */
+        while (bits <= 56 && pos < par->in_len) {
+            hold |= (uint64_t)in[pos++] << bits;
+            bits += 8;
+        }
+
+        here = lcode[hold & lmask];
+        used = 0;
+        if (here.op && (here.op & 0xf0) == 0) {
+            last = here;
+            here = lcode[last.val + ((hold & ((1U << (last.bits + last.op)) - 1)) >> last.bits)];
+            used = last.bits;
+        }
+        used += here.bits;
+        if (used > bits)
+            return 0;
+        hold >>= used;
+        bits -= used;
+
+        if (here.op == 0) {
+            if (have == c->out_size) {
+                c->out_len = have;
+                if (!parallel_grow(par, c, have + 1))
+                    return 0;
+                out = c->out;
+            }
+            out[have++] = here.val;
+            continue;
+        }
+        if (here.op & 32)
+            break;
+        if (here.op & 64)
+            return 0;
+
+        /* length and distance */
+        len = here.val + (unsigned)(hold & ((1U << (here.op & 15)) - 1));
+        if ((here.op & 15) > bits)
+            return 0;
+        hold >>= here.op & 15;
+        bits -= here.op & 15;
+        here = dcode[hold & dmask];
+        used = 0;
+        if ((here.op & 0xf0) == 0) {
+            last = here;
+            here = dcode[last.val + ((hold & ((1U << (last.bits + last.op)) - 1)) >> last.bits)];
+            used = last.bits;
+        }
+        used += here.bits;
+        if (used > bits || (here.op & 64))
+            return 0;
+        hold >>= used;
+        bits -= used;
+        dist = here.val + (unsigned)(hold & ((1U << (here.op & 15)) - 1));
+        if ((here.op & 15) > bits)
+            return 0;
+        hold >>= here.op & 15;
+        bits -= here.op & 15;
+
+        if (dist > have + PARALLEL_WINDOW)
+            return 0;
+        if (have + len > c->out_size) {
+            c->out_len = have;
+            if (!parallel_grow(par, c, have + len))
+                return 0;
+            out = c->out;
+        }
+        if (dist <= have && dist >= len) {
+            memcpy(out + have, out + have - dist, len * sizeof(uint16_t));
+            have += len;
+        } else {
+            while (len--) {
+                out[have] = dist <= have ? out[have - dist] :
+                            (uint16_t)(PARALLEL_MARKER + PARALLEL_WINDOW - (dist - have));
+                have++;
+            }
+        }
+    }
+    c->out_len = have;
+    *bit = (uint64_t)pos * 8 - bits;
+    return 1;
+}
+
+/* ===========================================================================
+ * Append the length bytes of a stored block at bit offset *bit, which is on a
+ * byte boundary, to the output of c. Return true with *bit updated, or false
+ * if the input ends first.
+ */
+static int parallel_stored(parallel_inflate *par, parallel_chunk *c, uint64_t *bit, unsigned length) {
+    const unsigned char *from = par->in + (*bit >> 3);
+    size_t i;
+
+    if ((size_t)(*bit >> 3) + length > par->in_len || !parallel_grow(par, c, c->out_len + length))
+        return 0;
+    for (i = 0; i < length; i++)
+        c->out[c->out_len++] = from[i];
+    *bit += (uint64_t)length * 8;
+    return 1;
+}
+
+/* ===========================================================================
+ * Search for the first block of chunk c from bit offset from on, before its
+ * stop, from which blocks can be decoded up to the stop or the final block,
+ * and decode them into the output of c with strm, a raw inflate stream.
+ */
+static void parallel_speculate(parallel_inflate *par, parallel_chunk *c, zng_stream *strm, uint64_t from) {
+    struct inflate_state *state = (struct inflate_state *)strm->state;
+    uint64_t bit, at, end = (uint64_t)par->in_len * 8;
+    int ok;
+
+    for (bit = from; bit < c->stop && bit < end; bit++) {
+        if (!parallel_candidate(par->in, par->in_len, bit))
+            continue;
+        c->out_len = 0;
+        at = bit;
+        while (parallel_header(strm, par->in, par->in_len, &at)) {
+            if (state->mode == COPY_)
+                ok = parallel_stored(par, c, &at, state->length);
+            else
+                ok = parallel_codes(par, c, state, &at);
+            if (!ok)
+                break;
+            if (state->last || at >= c->stop) {
+                c->start = bit;
+                c->end = at;
+                c->last = state->last;
+                c->found = 1;
+                return;
+            }
+        }
+    }
+    c->found = 0;
+}
+
+/* ===========================================================================
+ * Take chunks in order and decode them speculatively until told to quit.
+ */
+static void *parallel_worker(void *arg) {
+    parallel_inflate *par = (parallel_inflate *)arg;
+    zng_stream strm;
+    parallel_chunk *c;
+    int ok;
+
+    strm.zalloc = par->strm->zalloc;
+    strm.zfree = par->strm->zfree;
+    strm.opaque = par->strm->opaque;
+    strm.next_in = NULL;
+    strm.avail_in = 0;
+    ok = zng_inflateInit2(&strm, -MAX_WBITS) == Z_OK;
+
+    z_mutex_lock(&par->lock);
+    for (;;) {
+        while (!par->quit && par->next < par->count && par->next >= par->used + par->ahead)
+            z_cond_wait(&par->cond, &par->lock);
+        if (par->quit || par->next >= par->count)
+            break;
+        c = &par->chunks[par->next++];
+        z_mutex_unlock(&par->lock);
+
+        if (ok)
+            parallel_speculate(par, c, &strm, c == par->chunks ? 0 : c[-1].stop);
+
+        z_mutex_lock(&par->lock);
+        c->ready = 1;
+        z_cond_broadcast(&par->cond);
+    }
+    z_mutex_unlock(&par->lock);
+    if (ok)
+        zng_inflateEnd(&strm);
+    return NULL;
+}
+
+/* ===========================================================================
+ * Decode the blocks from bit offset *bit on while before stop with strm, a raw
+ * inflate stream, into dest at *have, with the output before it as the
+ * window. dest has room for out_max bytes. Return Z_OK with *bit, *have and
+ * *last updated, or the error from inflate().
+ */
+static int parallel_decode(zng_stream *strm, const unsigned char *in, size_t in_len, uint64_t *bit, uint64_t stop,
+                           unsigned char *dest, size_t *have, size_t out_max, int *last) {
+    struct inflate_state *state = (struct inflate_state *)strm->state;
+    size_t pos = (size_t)(*bit >> 3);
+    int ret;
+
+    if (*bit >= stop)
+        return Z_OK;
+    if (pos >= in_len)
+        return Z_BUF_ERROR;
+    zng_inflateReset(strm);
+    state->whole = 1;
+    state->whole_have = *have < PARALLEL_WINDOW ? (uint32_t)*have : PARALLEL_WINDOW;
+    strm->next_in = in + pos;
+    strm->avail_in = (uint32_t)(in_len - pos);
+    if (*bit & 7) {
+        zng_inflatePrime(strm, 8 - (int)(*bit & 7), in[pos] >> (*bit & 7));
+        strm->next_in++;
+        strm->avail_in--;
+    }
+    strm->next_out = dest + *have;
+    strm->avail_out = (uint32_t)(out_max - *have);
+    for (;;) {
+        ret = zng_inflate(strm, Z_BLOCK);
+        *have = (size_t)(strm->next_out - dest);
+        *bit = (uint64_t)(strm->next_in - in) * 8 - state->bits;
+        if (ret != Z_OK)
+            return ret;
+        if (state->mode == TYPE && (state->last || *bit >= stop)) {
+            *last = state->last;
+            return Z_OK;
+        }
+    }
+}
+
+/* ===========================================================================
+ * Replace the markers in the output of c with the bytes before dest + have
+ * and put it there. Return false if a marker reaches back before dest.
+ */
+static int parallel_resolve(const parallel_chunk *c, unsigned char *dest, size_t have) {
+    unsigned char *put = dest + have;
+    size_t i, dist;
+    unsigned sym;
+
+    for (i = 0; i < c->out_len; i++) {
+        sym = c->out[i];
+        if (sym < PARALLEL_MARKER) {
+            put[i] = (unsigned char)sym;
+        } else {
+            dist = PARALLEL_MARKER + PARALLEL_WINDOW - sym;
+            if (dist > have)
+                return 0;
+            put[i] = dest[have - dist];
+        }
+    }
+    return 1;
+}
+
+/* ===========================================================================
+ * Decode the deflate data at next_in with threads threads, leaving the stream
+ * just before the trailer. Return Z_OK if that was done, or Z_BUF_ERROR if it
+ * could not be, leaving the stream unchanged.
+ */
+static int parallel_inflate_run(zng_stream *strm, int threads, size_t chunk_size) {
+    parallel_inflate par;
+    parallel_chunk *chunks, *c;
+    z_thread_t *tids;
+    zng_stream seq;
+    unsigned int count, i, started;
+    unsigned char *dest = strm->next_out;
+    uint64_t bit = 0;
+    size_t have = 0, used;
+    int last = 0, err;
+
+    count = (unsigned int)((strm->avail_in + chunk_size - 1) / chunk_size);
+    if (count < 2)
+        return Z_BUF_ERROR;
+    if ((unsigned int)threads > count)
+        threads = (int)count;
+
+    seq.zalloc = strm->zalloc;
+    seq.zfree = strm->zfree;
+    seq.opaque = strm->opaque;
+    seq.next_in = NULL;
+    seq.avail_in = 0;
+    if (zng_inflateInit2(&seq, -MAX_WBITS) != Z_OK)
+        return Z_BUF_ERROR;
+    chunks = (parallel_chunk *)ZALLOC(strm, count, sizeof(parallel_chunk));
+    tids = (z_thread_t *)ZALLOC(strm, (unsigned int)threads - 1, sizeof(z_thread_t));
+    if (chunks == NULL || tids == NULL || z_mutex_init(&par.lock) != 0) {
+        TRY_FREE(strm, chunks);
+        TRY_FREE(strm, tids);
+        zng_inflateEnd(&seq);
+        return Z_BUF_ERROR;
+    }
+    if (z_cond_init(&par.cond) != 0) {
+        z_mutex_destroy(&par.lock);
+        ZFREE(strm, chunks);
+        ZFREE(strm, tids);
+        zng_inflateEnd(&seq);
+        return Z_BUF_ERROR;
+    }
+    memset(chunks, 0, count * sizeof(parallel_chunk));
+    for (i = 0; i < count; i++)
+        chunks[i].stop = i == count - 1 ? UINT64_MAX : (uint64_t)(i + 1) * chunk_size * 8;
+
+    par.strm = strm;
+    par.in = strm->next_in;
+    par.in_len = strm->avail_in;
+    par.out_max = strm->avail_out;
+    par.chunks = chunks;
+    par.count = count;
+    par.chunk_bits = (uint64_t)chunk_size * 8;
+    par.next = 1;               /* the first chunk is decoded here */
+    par.used = 1;
+    par.ahead = (unsigned int)threads << 1;
+    par.quit = 0;
+    for (started = 0; started < (unsigned int)threads - 1; started++) {
+        if (z_thread_create(&tids[started], parallel_worker, &par) != 0)
+            break;
+    }
+
+    /* Decode the first chunk, then use or redo the others in order */
+    err = started ? parallel_decode(&seq, par.in, par.in_len, &bit, chunks[0].stop, dest, &have, par.out_max, &last)
+                  : Z_BUF_ERROR;
+    for (i = 1; i < count && err == Z_OK && !last; i++) {
+        c = &chunks[i];
+        z_mutex_lock(&par.lock);
+        while (!c->ready)
+            z_cond_wait(&par.cond, &par.lock);
+        z_mutex_unlock(&par.lock);
+
+        /* A guess past where the last chunk ended may still be a block
+           boundary, as after an empty stored block */
+        if (c->found && c->start > bit)
+            err = parallel_decode(&seq, par.in, par.in_len, &bit, c->start, dest, &have, par.out_max, &last);
+        if (err == Z_OK && !last) {
+            if (c->found && c->start == bit && c->out_len <= par.out_max - have && parallel_resolve(c, dest, have)) {
+                have += c->out_len;
+                bit = c->end;
+                last = c->last;
+            } else {
+                err = parallel_decode(&seq, par.in, par.in_len, &bit, c->stop, dest, &have, par.out_max, &last);
+            }
+        }
+
+        z_mutex_lock(&par.lock);
+        TRY_FREE(strm, c->out);
+        c->out = NULL;
+        par.used = i + 1;
+        z_cond_broadcast(&par.cond);
+        z_mutex_unlock(&par.lock);
+    }
+
+    z_mutex_lock(&par.lock);
+    par.quit = 1;
+    z_cond_broadcast(&par.cond);
+    z_mutex_unlock(&par.lock);
+    for (i = 0; i < started; i++)
+        z_thread_join(tids[i]);
+    for (i = 0; i < count; i++)
+        TRY_FREE(strm, chunks[i].out);
+    z_cond_destroy(&par.cond);
+    z_mutex_destroy(&par.lock);
+    ZFREE(strm, chunks);
+    ZFREE(strm, tids);
+    zng_inflateEnd(&seq);
+    if (err != Z_OK || !last)
+        return Z_BUF_ERROR;
+
+    /* Account for the output as inflate() would, up to the trailer */
+    {
+        struct inflate_state *state = (struct inflate_state *)strm->state;
+
+        used = (size_t)((bit + 7) >> 3);
+        strm->next_in += used;
+        strm->avail_in -= (uint32_t)used;
+        strm->total_in += used;
+        if (state->wrap & 4)
+            strm->adler = state->check = UPDATE(state->check, dest, have);
+        strm->next_out += have;
+        strm->avail_out -= (uint32_t)have;
+        strm->total_out += have;
+        state->total += have;
+        state->last = 1;
+        state->hold = 0;
+        state->bits = 0;
+        state->mode = CHECK;
+    }
+    return Z_OK;
+}
+#endif /* Z_HAVE_THREADS */
+
+/* ========================================================================= */
+int ZEXPORT zng_inflateParallel(zng_stream *strm, int threads, size_t chunk_size) {
+    struct inflate_state *state;
+
+    if (strm == NULL || strm->zalloc == NULL || strm->zfree == NULL || strm->state == NULL)
+        return Z_STREAM_ERROR;
+    state = (struct inflate_state *)strm->state;
+    if (state->strm != strm || threads < 1)
+        return Z_STREAM_ERROR;
+
+    /* Only a fresh stream without a dictionary can be split up */
+    if (state->mode != HEAD || strm->total_in != 0)
+        return Z_STREAM_ERROR;
+    if (strm->next_out == NULL || (strm->avail_in != 0 && strm->next_in == NULL))
+        return Z_STREAM_ERROR;
+
+    if (chunk_size == 0)
+        chunk_size = PARALLEL_INFLATE_DEFAULT_CHUNK;
+    if (chunk_size < (1U << MAX_WBITS))
+        chunk_size = 1U << MAX_WBITS;
+    if (chunk_size > (1U << 30))
+        chunk_size = 1U << 30;
+
+#ifdef Z_HAVE_THREADS
+    if (threads > 1 && strm->avail_in > chunk_size && state->whave == 0 && state->dict_have == 0) {
+        /* Get through the zlib or gzip header to the first block */
+        if (state->wrap) {
+            int ret = zng_inflate(strm, Z_BLOCK);
+            if (ret != Z_OK && ret != Z_BUF_ERROR)
+                return ret;
+        }
+        if ((state->mode == HEAD || state->mode == TYPE) && state->bits == 0 &&
+            parallel_inflate_run(strm, threads, chunk_size) == Z_OK)
+            return zng_inflate(strm, Z_FINISH);
+    }
+#endif
+    return zng_inflate(strm, Z_FINISH);
+}
+
+#endif /* !ZLIB_COMPAT */
@@ -295,3 +295,37 @@ int ZLIB_INTERNAL zng_inflate_table(codetype type, uint16_t *lens, unsigned code
     *bits = root;
     return 0;
 }
+
+/*
+   Build a table with 2^PAIR_BITS entries that decodes the same literal/length
+   codes as the root table with 2^bits entries, but in which a literal is
+   combined with the literal that follows it whenever the index bits also hold
+   all of the second code.  These entries have op 10000000, val holds the first
+   literal in the low byte and the second one in the high byte, and bits is the
+   length of both codes.  All other entries are copied from root, so table
+   links still refer to root.  inflate_fast() uses this table for the first
+   lookup of each symbol, which lets it write two literals at once for the
+   short codes that are common in text.
+ */
+void ZLIB_INTERNAL zng_inflate_table_pairs(const code *root, unsigned bits, code *pairs) {
+    unsigned size = 1U << PAIR_BITS;    /* number of pair table entries */
+    unsigned mask = (1U << bits) - 1;   /* mask for root table index */
+    unsigned idx;                       /* pair table index */
+    code here;                          /* entry for the first code */
+    code next;                          /* entry for the code that follows it */
+
+    for (idx = 0; idx < size; idx++) {
+        here = root[idx & mask];
+        if (here.op == 0) {
+            /* the remaining index bits select the next entry, which is only
+               valid if its code fits in them entirely */
+            next = root[(idx >> here.bits) & mask];
+            if (next.op == 0 && here.bits + next.bits <= PAIR_BITS) {
+                here.op = 128;
+                here.bits = (unsigned char)(here.bits + next.bits);
+                here.val = (uint16_t)(here.val | (next.val << 8));
+            }
+        }
+        pairs[idx] = here;
+    }
+}
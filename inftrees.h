@@ -36,6 +36,8 @@ typedef struct {
     0001eeee - length or distance, eeee is the number of extra bits
     01100000 - end of block
     01000000 - invalid code
+   and by inflate_table_pairs():
+    10000000 - two literals, the first one in the low byte of val
  */
 
 /* Maximum size of the dynamic table.  The maximum number of code structures is
@@ -62,5 +64,9 @@ typedef enum {
 
 int ZLIB_INTERNAL zng_inflate_table (codetype type, uint16_t *lens, unsigned codes,
                                   code * *table, unsigned *bits, uint16_t *work);
+void ZLIB_INTERNAL zng_inflate_table_pairs(const code *root, unsigned bits, code *pairs);
+
+/* Index bits of the table built by inflate_table_pairs() */
+#define PAIR_BITS 11
 
 #endif /* INFTREES_H_ */
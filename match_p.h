@@ -50,7 +50,7 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
     const unsigned wmask = s->w_mask;
     const Pos *prev = s->prev;
 
-    unsigned chain_length;
+    unsigned chain_length, chain_start;
     IPos limit;
     unsigned int len, best_len, nice_match;
     unsigned char *scan, *match, *strend, scan_end, scan_end1;
@@ -65,9 +65,10 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
      * Do not waste too much time if we already have a good match
      */
     best_len = s->prev_length ? s->prev_length : 1;
-    chain_length = s->max_chain_length;
+    chain_length = s->max_chain_length >> s->chain_cut;
     if (best_len >= s->good_match)
         chain_length >>= 2;
+    chain_start = chain_length;
 
     /*
      * Do not looks for matches beyond the end of the input. This is
@@ -91,7 +92,13 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
         if (cur_match >= s->strstart) {
           break;
         }
+        STATS_ADD(s, chain_steps, 1);
         match = s->window + cur_match;
+#ifdef CHAIN_PREFETCH
+        /* As in match_tpl.h */
+        CHAIN_PREFETCH(s->window + POS_WINDOW(s, prev[cur_match & wmask]) + best_len - 1);
+        CHAIN_PREFETCH(prev + (prev[cur_match & wmask] & wmask));
+#endif
 
         /*
          * Skip to next match if the match length cannot increase
@@ -152,8 +159,9 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
             if (s->level < TRIGGER_LEVEL)
                 break;
         }
-    } while ((cur_match = prev[cur_match & wmask]) > limit && --chain_length);
+    } while ((cur_match = POS_WINDOW(s, prev[cur_match & wmask])) > limit && --chain_length);
 
+    CHAIN_GUARD(s, chain_start - chain_length);
     if ((unsigned int)best_len <= s->lookahead)
         return best_len;
     return s->lookahead;
@@ -170,7 +178,7 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
     const Pos *prev = s->prev;
 
     uint16_t scan_start, scan_end;
-    unsigned chain_length;
+    unsigned chain_length, chain_start;
     IPos limit;
     unsigned int len, best_len, nice_match;
     unsigned char *scan, *strend;
@@ -185,9 +193,10 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
      * Do not waste too much time if we already have a good match
      */
     best_len = s->prev_length ? s->prev_length : 1;
-    chain_length = s->max_chain_length;
+    chain_length = s->max_chain_length >> s->chain_cut;
     if (best_len >= s->good_match)
         chain_length >>= 2;
+    chain_start = chain_length;
 
     /*
      * Do not look for matches beyond the end of the input. This is
@@ -212,7 +221,13 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
         if (cur_match >= s->strstart) {
           break;
         }
+        STATS_ADD(s, chain_steps, 1);
         match = s->window + cur_match;
+#ifdef CHAIN_PREFETCH
+        /* As in match_tpl.h */
+        CHAIN_PREFETCH(s->window + POS_WINDOW(s, prev[cur_match & wmask]) + best_len - 1);
+        CHAIN_PREFETCH(prev + (prev[cur_match & wmask] & wmask));
+#endif
 
         /*
          * Skip to next match if the match length cannot increase
@@ -304,8 +319,9 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
             if (s->level < TRIGGER_LEVEL)
                 break;
         }
-    } while (--chain_length && (cur_match = prev[cur_match & wmask]) > limit);
+    } while (--chain_length && (cur_match = POS_WINDOW(s, prev[cur_match & wmask])) > limit);
 
+    CHAIN_GUARD(s, chain_start - chain_length);
     if ((unsigned)best_len <= s->lookahead)
         return best_len;
     return s->lookahead;
@@ -337,7 +353,8 @@ int __inline __builtin_ctzl(unsigned long mask)
 //    {
 static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
 
-    uint32_t chain_length = s->max_chain_length;      /* max hash chain length */
+    uint32_t chain_length = s->max_chain_length >> s->chain_cut; /* max hash chain length */
+    uint32_t chain_start;
     register uint8_t *scan = s->window + s->strstart; /* current string */
     register uint8_t *match;                          /* matched string */
     register int len;                                 /* length of current match */
@@ -365,6 +382,7 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
     if (s->prev_length >= s->good_match) {
         chain_length >>= 2;
     }
+    chain_start = chain_length;
     /* Do not look for matches beyond the end of the input. This is necessary
      * to make deflate deterministic.
      */
@@ -386,9 +404,15 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
          */
         cont = 1;
         do {
+            STATS_ADD(s, chain_steps, 1);
             match = s->window + cur_match;
+#ifdef CHAIN_PREFETCH
+            /* As in match_tpl.h */
+            CHAIN_PREFETCH(s->window + POS_WINDOW(s, prev[cur_match & wmask]) + best_len - 3);
+            CHAIN_PREFETCH(prev + (prev[cur_match & wmask] & wmask));
+#endif
             if (likely(*(uint32_t*)(match+best_len-3) != scan_end) || (*(uint32_t*)match != scan_start)) {
-                if ((cur_match = prev[cur_match & wmask]) > limit
+                if ((cur_match = POS_WINDOW(s, prev[cur_match & wmask])) > limit
                     && --chain_length != 0) {
                     continue;
                 } else
@@ -430,9 +454,10 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
             if (len >= nice_match) break;
             scan_end = *(uint32_t*)(scan+best_len-3);
         }
-    } while ((cur_match = prev[cur_match & wmask]) > limit
+    } while ((cur_match = POS_WINDOW(s, prev[cur_match & wmask])) > limit
              && --chain_length != 0);
 
+    CHAIN_GUARD(s, chain_start - chain_length);
     if ((uint32_t)best_len <= s->lookahead) return (uint32_t)best_len;
     return s->lookahead;
 }
@@ -505,7 +530,8 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
 
 static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
     unsigned int strstart = s->strstart;
-    unsigned chain_length = s->max_chain_length;/* max hash chain length */
+    unsigned chain_length = s->max_chain_length >> s->chain_cut; /* max hash chain length */
+    unsigned chain_start;
     unsigned char *window = s->window;
     register unsigned char *scan = window + strstart; /* current string */
     register unsigned char *match;                       /* matched string */
@@ -536,6 +562,7 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
     if (s->prev_length >= s->good_match) {
         chain_length >>= 2;
     }
+    chain_start = chain_length;
     /* Do not look for matches beyond the end of the input. This is necessary
      * to make deflate deterministic.
      */
@@ -558,10 +585,11 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
          */
         int cont = 1;
         do {
+            STATS_ADD(s, chain_steps, 1);
             match = window + cur_match;
             if (LIKELY(memcmp(match+best_len-1, &scan_end, sizeof(scan_end)) != 0
                 || memcmp(match, &scan_start, sizeof(scan_start)) != 0)) {
-                if ((cur_match = prev[cur_match & wmask]) > limit
+                if ((cur_match = POS_WINDOW(s, prev[cur_match & wmask])) > limit
                     && --chain_length != 0) {
                     continue;
                 } else {
@@ -626,8 +654,9 @@ static inline unsigned longest_match(deflate_state *const s, IPos cur_match) {
             if (s->level < TRIGGER_LEVEL)
                 break;
         }
-    } while ((cur_match = prev[cur_match & wmask]) > limit && --chain_length != 0);
+    } while ((cur_match = POS_WINDOW(s, prev[cur_match & wmask])) > limit && --chain_length != 0);
 
+    CHAIN_GUARD(s, chain_start - chain_length);
     if ((unsigned int)best_len <= s->lookahead)
         return (unsigned int)best_len;
     return s->lookahead;
@@ -0,0 +1,110 @@
+/* match_tpl.h -- longest_match built on top of a 258-byte compare primitive
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Include this file after defining LONGEST_MATCH, the name of the generated
+ * function, and COMPARE258(src0, src1), which returns the number of leading
+ * bytes that are equal in both strings, up to 258. The result is the same as
+ * the one of std3_longest_match in match_p.h, so the choice of compare
+ * primitive never changes the compressed output.
+ *
+ * Set match_start to the longest match starting at the given string and
+ * return its length. Matches shorter or equal to prev_length are discarded,
+ * in which case the result is equal to prev_length and match_start is garbage.
+ *
+ * IN assertions: cur_match is the head of the hash chain for the current
+ * string (strstart) and its distance is <= MAX_DIST, and prev_length >=1
+ * OUT assertion: the match length is not greater than s->lookahead
+ *
+ * With CHAIN_PREFETCH, each step prefetches the entry of prev[] and the
+ * string of the next candidate, so that the two cache misses of the next
+ * step, one after the other, overlap with the compare of this one instead.
+ */
+
+unsigned ZLIB_INTERNAL LONGEST_MATCH(deflate_state *const s, IPos cur_match) {
+    uint32_t chain_length = s->max_chain_length >> s->chain_cut; /* max hash chain length */
+    uint32_t chain_start;
+    unsigned char *window = s->window;
+    unsigned char *scan = window + s->strstart;       /* current string */
+    unsigned char *match;                             /* matched string */
+    unsigned int len;                                 /* length of current match */
+    int best_len = s->prev_length;                    /* best match length so far */
+    int nice_match = s->nice_match;                   /* stop if match long enough */
+    IPos limit = s->strstart > (IPos)MAX_DIST(s) ?
+        s->strstart - (IPos)MAX_DIST(s) : NIL;
+    /* Stop when cur_match becomes <= limit. To simplify the code,
+     * we prevent matches with the string of window index 0.
+     */
+    Pos *prev = s->prev;
+    uint32_t wmask = s->w_mask;
+    uint32_t scan_start, scan_end, mval;
+#ifdef DEFLATE_POS32
+    /* Follow the chain with the entries of prev[] as they are, see POS_ENTRY().
+     * pos_base is a multiple of w_size, so it does not change the index.
+     */
+    uint32_t pos_base = s->pos_base;
+
+    limit += pos_base;
+    cur_match += pos_base;
+#else
+    const uint32_t pos_base = 0;
+#endif
+
+    /* We optimize for a minimal match of four bytes */
+    memcpy(&scan_start, scan, sizeof(scan_start));
+    memcpy(&scan_end, scan+best_len-3, sizeof(scan_end));
+
+    Assert(s->hash_bits >= 8 && MAX_MATCH == 258, "Code too clever");
+
+    /* Do not waste too much time if we already have a good match: */
+    if (s->prev_length >= s->good_match) {
+        chain_length >>= 2;
+    }
+    chain_start = chain_length;
+    /* Do not look for matches beyond the end of the input. This is necessary
+     * to make deflate deterministic.
+     */
+    if ((uint32_t)nice_match > s->lookahead) nice_match = s->lookahead;
+
+    Assert((uint64_t)s->strstart <= s->window_size-MIN_LOOKAHEAD, "need lookahead");
+
+    do {
+        Assert(cur_match - pos_base < s->strstart, "no future");
+        STATS_ADD(s, chain_steps, 1);
+        match = window + (cur_match - pos_base);
+#ifdef CHAIN_PREFETCH
+        /* Where the chain ends, these only prefetch something unused */
+        CHAIN_PREFETCH(window + (prev[cur_match & wmask] - pos_base) + best_len - 3);
+        CHAIN_PREFETCH(prev + (prev[cur_match & wmask] & wmask));
+#endif
+
+        /* Skip to next match if the match length cannot increase or if the
+         * first four bytes differ. The compare below may then read past the
+         * lookahead, but the length of the match is limited to the lookahead,
+         * so the output of deflate is not affected by those values.
+         */
+        memcpy(&mval, match+best_len-3, sizeof(mval));
+        if (LIKELY(mval != scan_end))
+            continue;
+        memcpy(&mval, match, sizeof(mval));
+        if (mval != scan_start)
+            continue;
+
+        len = COMPARE258(scan, match);
+        Assert(scan+len <= window+(unsigned)(s->window_size-1), "wild scan");
+
+        if ((int)len > best_len) {
+            s->match_start = cur_match - pos_base;
+            best_len = (int)len;
+            if ((int)len >= nice_match) break;
+            memcpy(&scan_end, scan+best_len-3, sizeof(scan_end));
+        }
+    } while ((cur_match = prev[cur_match & wmask]) > limit
+             && --chain_length != 0);
+
+    CHAIN_GUARD(s, chain_start - chain_length);
+    if ((uint32_t)best_len <= s->lookahead) return (uint32_t)best_len;
+    return s->lookahead;
+}
+
+#undef LONGEST_MATCH
+#undef COMPARE258
@@ -0,0 +1,193 @@
+/* stream_node.c -- memory of a stream in huge pages on one NUMA node
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * zng_stream_set_numa_node() makes the stream allocate with zng_node_alloc()
+ * and zng_node_free(), and keeps the node in opaque until deflateInit2()
+ * knows how much memory the stream needs. deflateInit2() then maps a region
+ * of that size at once, in 2 MB pages where it can, and tells the kernel to
+ * take them from the node. The state, window, hash tables and symbol buffer
+ * are carved out of the region with the bump allocator of the InitArena
+ * functions, which keeps them on the fewest pages and TLB entries. What does
+ * not fit, such as buffers that zng_deflateSetParams() makes larger later, and
+ * everything allocated before or without a region, comes from the heap.
+ *
+ * The region needs mmap() and the mbind() system call, so it is only mapped
+ * on Linux. Elsewhere the stream allocates from the heap as with the default
+ * allocator.
+ */
+
+#ifndef ZLIB_COMPAT
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE   /* For MAP_ANONYMOUS, MAP_HUGETLB, madvise() and syscall(). */
+#endif
+
+#include "zbuild.h"
+#include "zutil.h"
+
+#ifdef __linux__
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+#define NODE_PAGE (2*1024*1024)     /* size of a huge page */
+#define NODE_MAX  1024              /* nodes that mbind() is given a mask for */
+#define MPOL_PREFERRED_ 1           /* the value of MPOL_PREFERRED in <numaif.h> */
+
+/* Before a region is mapped, opaque holds the node plus 2, which can never be
+   the address of a region: -1 for the node of the calling thread gives 1 */
+#define NODE_HINT(node) ((void *)(uintptr_t)((node) + 2))
+#define IS_HINT(opaque) ((uintptr_t)(opaque) <= NODE_MAX + 1)
+#define HINT_NODE(opaque) ((int)(uintptr_t)(opaque) - 2)
+
+typedef struct {
+    zng_arena arena;        /* allocations in the region, must be first */
+    void *base;             /* start of the mapping */
+    size_t len;             /* length of the mapping */
+    size_t size;            /* size asked for, the one of a copy */
+    int node;               /* node asked for, or -1 */
+} node_region;
+
+/* ========================================================================= */
+void ZLIB_INTERNAL *zng_node_alloc(void *opaque, unsigned items, unsigned size) {
+    void *ptr = NULL;
+
+    if (!IS_HINT(opaque))
+        ptr = zng_arena_alloc(opaque, items, size);
+    return ptr != NULL ? ptr : zng_calloc(NULL, items, size);
+}
+
+/* ========================================================================= */
+void ZLIB_INTERNAL zng_node_free(void *opaque, void *ptr) {
+    node_region *r = (node_region *)opaque;
+
+    if (!IS_HINT(opaque) && (unsigned char *)ptr >= (unsigned char *)r->base &&
+        (unsigned char *)ptr < (unsigned char *)r->base + r->len)
+        zng_arena_free(&r->arena, ptr);
+    else
+        zng_cfree(NULL, ptr);
+}
+
+#ifdef __linux__
+/* ===========================================================================
+ * Map len bytes, a multiple of NODE_PAGE, in huge pages: reserved ones if the
+ * system has them, and otherwise transparent ones, for which the mapping is
+ * aligned to NODE_PAGE. Return NULL if nothing could be mapped.
+ */
+static void *map_pages(size_t len) {
+    unsigned char *p, *start;
+    size_t head;
+
+#ifdef MAP_HUGETLB
+    p = (unsigned char *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+        return p;
+#endif
+    p = (unsigned char *)mmap(NULL, len + NODE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    start = (unsigned char *)(((uintptr_t)p + NODE_PAGE - 1) & ~(uintptr_t)(NODE_PAGE - 1));
+    head = (size_t)(start - p);
+    if (head != 0)
+        munmap(p, head);
+    munmap(start + len, NODE_PAGE - head);
+#ifdef MADV_HUGEPAGE
+    madvise(start, len, MADV_HUGEPAGE);
+#endif
+    return start;
+}
+
+/* ===========================================================================
+ * Ask for the pages of len bytes at p to come from node, or from the node of
+ * the calling thread if node is -1. The pages are not touched yet, so this
+ * applies to all of them. Failures, as on a kernel without NUMA, are ignored.
+ */
+static void bind_pages(void *p, size_t len, int node) {
+#if defined(SYS_mbind) && defined(SYS_getcpu)
+    unsigned long mask[NODE_MAX / (8 * sizeof(unsigned long))];
+    unsigned int cpu, here;
+
+    if (node < 0) {
+        if (syscall(SYS_getcpu, &cpu, &here, NULL) != 0)
+            return;
+        node = (int)here;
+    }
+    if (node >= NODE_MAX)
+        return;
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, p, len, MPOL_PREFERRED_, mask, (unsigned long)NODE_MAX + 1, 0);
+#else
+    (void)p;
+    (void)len;
+    (void)node;
+#endif
+}
+#endif
+
+/* ========================================================================= */
+void ZLIB_INTERNAL zng_node_map(zng_stream *strm, size_t size) {
+#ifdef __linux__
+    node_region *r;
+    size_t len;
+    void *p;
+
+    if (strm->zalloc != zng_node_alloc || !IS_HINT(strm->opaque) || size == 0)
+        return;
+    len = (ARENA_ROUND(sizeof(node_region)) + size + NODE_PAGE - 1) & ~(size_t)(NODE_PAGE - 1);
+    p = map_pages(len);
+    if (p == NULL)
+        return;
+    bind_pages(p, len, HINT_NODE(strm->opaque));
+
+    /* The arena header is the start of the region header, and the first
+       allocation comes after all of that */
+    r = (node_region *)p;
+    r->arena.next = (unsigned char *)p + ARENA_ROUND(sizeof(node_region));
+    r->arena.end = (unsigned char *)p + len;
+    r->arena.last = NULL;
+    r->base = p;
+    r->len = len;
+    r->size = size;
+    r->node = HINT_NODE(strm->opaque);
+    strm->opaque = r;
+#else
+    (void)strm;
+    (void)size;
+#endif
+}
+
+/* ========================================================================= */
+void ZLIB_INTERNAL zng_node_copy(zng_stream *dest) {
+    node_region *r = (node_region *)dest->opaque;
+
+    if (dest->zalloc != zng_node_alloc || IS_HINT(dest->opaque))
+        return;
+    dest->opaque = NODE_HINT(r->node);
+    zng_node_map(dest, r->size);
+}
+
+/* ========================================================================= */
+void ZLIB_INTERNAL zng_node_unmap(zng_stream *strm) {
+    node_region *r = (node_region *)strm->opaque;
+
+    if (strm->zalloc != zng_node_alloc || IS_HINT(strm->opaque))
+        return;
+    strm->opaque = NODE_HINT(r->node);
+#ifdef __linux__
+    munmap(r->base, r->len);
+#endif
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_stream_set_numa_node(zng_stream *strm, int node) {
+    if (strm == NULL || node < -1 || node >= NODE_MAX)
+        return Z_STREAM_ERROR;
+    strm->zalloc = zng_node_alloc;
+    strm->zfree = zng_node_free;
+    strm->opaque = NODE_HINT(node);
+    return Z_OK;
+}
+
+#endif
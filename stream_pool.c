@@ -0,0 +1,259 @@
+/* stream_pool.c -- reuse of initialized deflate and inflate streams
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * A pool keeps the streams given back to it for one set of parameters, so
+ * that handing out a stream costs a reset instead of an allocation and
+ * initialization.  The reset is done lazily when the stream is handed out
+ * again, and after short input deflateReset() only clears the hash table
+ * entries that were used.
+ *
+ * Idle streams are kept in per-thread caches of a few entries, with a shared
+ * list behind them for the overflow.  Each thread is given an index on its
+ * first use of any pool, which selects one of the pool's caches.  A cache is
+ * claimed with an atomic exchange, which only fails when more threads than
+ * there are caches use the pool at the same moment; the thread then goes to
+ * the shared list, which is protected by a mutex.
+ */
+
+#ifndef ZLIB_COMPAT
+
+#include "zbuild.h"
+#include "deflate.h"
+#include "zthread.h"
+
+#define POOL_CACHES      64     /* number of per-thread caches in a pool */
+#define POOL_CACHE_DEPTH 6      /* idle streams kept by each cache */
+#define POOL_ALIGN       64     /* keep each cache on its own cache line */
+
+typedef struct pool_entry_s {
+    zng_stream strm;            /* handed out to the caller, must be first */
+    struct pool_entry_s *next;  /* next idle entry in the shared list */
+    int dirty;                  /* used since the last reset */
+} pool_entry;
+
+typedef struct {
+    ALIGNED_(POOL_ALIGN) z_atomic_t busy;   /* claimed by a thread */
+    unsigned int count;                     /* number of idle entries */
+    pool_entry *entries[POOL_CACHE_DEPTH];
+} pool_cache;
+
+struct zng_stream_pool_s {
+    pool_cache caches[POOL_CACHES];
+    z_mutex_t lock;             /* protects idle */
+    pool_entry *idle;           /* idle entries that did not fit in a cache */
+    void *mem;                  /* allocation holding this pool */
+    int type;                   /* ZNG_POOL_DEFLATE or ZNG_POOL_INFLATE */
+    int level;
+    int windowBits;
+    int memLevel;
+    int strategy;
+    unsigned int hash_bits;     /* hash table size of new deflate streams */
+    unsigned int lit_bufsize;   /* symbol buffer size of new deflate streams */
+};
+
+/* Index of the calling thread, from 1, or 0 if not assigned yet */
+static __thread unsigned int pool_thread_id;
+static z_atomic_t pool_thread_count;
+
+static pool_cache *pool_thread_cache(zng_stream_pool *pool) {
+    if (pool_thread_id == 0)
+        pool_thread_id = (unsigned int)z_atomic_increment(&pool_thread_count);
+    return &pool->caches[(pool_thread_id - 1) % POOL_CACHES];
+}
+
+/* ===========================================================================
+ * Allocate and initialize a new stream with the pool's parameters.
+ */
+static pool_entry *pool_entry_new(zng_stream_pool *pool) {
+    pool_entry *entry;
+    int err;
+
+    entry = (pool_entry *)zng_calloc(NULL, 1, sizeof(pool_entry));
+    if (entry == NULL)
+        return NULL;
+    memset(entry, 0, sizeof(pool_entry));
+
+    if (pool->type == ZNG_POOL_DEFLATE)
+        err = zng_deflateInit2(&entry->strm, pool->level, Z_DEFLATED, pool->windowBits, pool->memLevel,
+                               pool->strategy);
+    else
+        err = zng_inflateInit2(&entry->strm, pool->windowBits);
+    if (err != Z_OK) {
+        zng_cfree(NULL, entry);
+        return NULL;
+    }
+    return entry;
+}
+
+static void pool_entry_free(zng_stream_pool *pool, pool_entry *entry) {
+    if (pool->type == ZNG_POOL_DEFLATE)
+        zng_deflateEnd(&entry->strm);
+    else
+        zng_inflateEnd(&entry->strm);
+    zng_cfree(NULL, entry);
+}
+
+/* ===========================================================================
+ * Bring a stream that has been used back to the state of a new one, undoing
+ * any deflateParams(), zng_deflateSetParams(), deflateSetHeader() or
+ * inflateReset2() by the caller.
+ */
+static int pool_entry_reset(zng_stream_pool *pool, pool_entry *entry) {
+    zng_stream *strm = &entry->strm;
+    deflate_state *s;
+    int err;
+
+    strm->zalloc = zng_calloc;
+    strm->zfree = zng_cfree;
+    strm->opaque = NULL;
+
+    if (pool->type == ZNG_POOL_INFLATE)
+        return zng_inflateReset2(strm, pool->windowBits);
+
+    err = zng_deflateReset(strm);
+    if (err != Z_OK)
+        return err;
+    s = strm->state;
+    s->gzhead = NULL;
+    s->block_split = -1;
+    s->search = SEARCH_DEFAULT;
+    if (s->level != pool->level || s->strategy != pool->strategy)
+        err = zng_deflateParams(strm, pool->level, pool->strategy);
+    if (err == Z_OK && (s->hash_bits != pool->hash_bits || s->hash_bytes != 0 ||
+                        s->hash_func != Z_HASH_DEFAULT || s->lit_bufsize != pool->lit_bufsize)) {
+        int hash_bits = (int)pool->hash_bits, hash_bytes = 0, lit_bufsize = (int)pool->lit_bufsize;
+        int hash_func = Z_HASH_DEFAULT;
+        zng_deflate_param_value params[4] = {
+            { Z_DEFLATE_HASH_BITS, &hash_bits, sizeof(hash_bits), Z_OK },
+            { Z_DEFLATE_HASH_BYTES, &hash_bytes, sizeof(hash_bytes), Z_OK },
+            { Z_DEFLATE_HASH_FUNC, &hash_func, sizeof(hash_func), Z_OK },
+            { Z_DEFLATE_LIT_BUFSIZE, &lit_bufsize, sizeof(lit_bufsize), Z_OK },
+        };
+        err = zng_deflateSetParams(strm, params, 4);
+    }
+    return err;
+}
+
+/* ========================================================================= */
+zng_stream_pool * ZEXPORT zng_stream_pool_create(int type, int level, int windowBits, int memLevel,
+                                                 int strategy) {
+    zng_stream_pool *pool;
+    pool_entry *entry;
+    unsigned char *mem;
+
+    if (type != ZNG_POOL_DEFLATE && type != ZNG_POOL_INFLATE)
+        return NULL;
+
+    mem = (unsigned char *)zng_calloc(NULL, 1, sizeof(zng_stream_pool) + POOL_ALIGN - 1);
+    if (mem == NULL)
+        return NULL;
+    pool = (zng_stream_pool *)(((uintptr_t)mem + POOL_ALIGN - 1) & ~(uintptr_t)(POOL_ALIGN - 1));
+    memset(pool, 0, sizeof(zng_stream_pool));
+    pool->mem = mem;
+    pool->type = type;
+    pool->level = level == Z_DEFAULT_COMPRESSION ? 6 : level;
+    pool->windowBits = windowBits;
+    pool->memLevel = memLevel;
+    pool->strategy = strategy;
+
+    /* Check the parameters by making the first stream */
+    entry = pool_entry_new(pool);
+    if (entry == NULL || z_mutex_init(&pool->lock) != 0) {
+        if (entry != NULL)
+            pool_entry_free(pool, entry);
+        zng_cfree(NULL, mem);
+        return NULL;
+    }
+    if (type == ZNG_POOL_DEFLATE) {
+        pool->hash_bits = entry->strm.state->hash_bits;
+        pool->lit_bufsize = entry->strm.state->lit_bufsize;
+    }
+    pool->idle = entry;
+    return pool;
+}
+
+/* ========================================================================= */
+zng_stream * ZEXPORT zng_stream_pool_get(zng_stream_pool *pool) {
+    pool_cache *cache;
+    pool_entry *entry = NULL;
+
+    if (pool == NULL)
+        return NULL;
+
+    cache = pool_thread_cache(pool);
+    if (z_atomic_exchange(&cache->busy, 1) == 0) {
+        if (cache->count != 0)
+            entry = cache->entries[--cache->count];
+        z_atomic_exchange(&cache->busy, 0);
+    }
+
+    if (entry == NULL) {
+        z_mutex_lock(&pool->lock);
+        entry = pool->idle;
+        if (entry != NULL)
+            pool->idle = entry->next;
+        z_mutex_unlock(&pool->lock);
+    }
+
+    if (entry == NULL)
+        entry = pool_entry_new(pool);
+    else if (entry->dirty && pool_entry_reset(pool, entry) != Z_OK) {
+        pool_entry_free(pool, entry);
+        entry = pool_entry_new(pool);
+    }
+    if (entry == NULL)
+        return NULL;
+    entry->dirty = 0;
+    return &entry->strm;
+}
+
+/* ========================================================================= */
+int ZEXPORT zng_stream_pool_put(zng_stream_pool *pool, zng_stream *strm) {
+    pool_entry *entry = (pool_entry *)strm;
+    pool_cache *cache;
+
+    if (pool == NULL || strm == NULL)
+        return Z_STREAM_ERROR;
+    entry->dirty = 1;
+
+    cache = pool_thread_cache(pool);
+    if (z_atomic_exchange(&cache->busy, 1) == 0) {
+        int cached = 0;
+        if (cache->count < POOL_CACHE_DEPTH) {
+            cache->entries[cache->count++] = entry;
+            cached = 1;
+        }
+        z_atomic_exchange(&cache->busy, 0);
+        if (cached)
+            return Z_OK;
+    }
+
+    z_mutex_lock(&pool->lock);
+    entry->next = pool->idle;
+    pool->idle = entry;
+    z_mutex_unlock(&pool->lock);
+    return Z_OK;
+}
+
+/* ========================================================================= */
+void ZEXPORT zng_stream_pool_destroy(zng_stream_pool *pool) {
+    pool_entry *entry;
+    unsigned int i;
+
+    if (pool == NULL)
+        return;
+
+    for (i = 0; i < POOL_CACHES; i++) {
+        pool_cache *cache = &pool->caches[i];
+        while (cache->count != 0)
+            pool_entry_free(pool, cache->entries[--cache->count]);
+    }
+    while ((entry = pool->idle) != NULL) {
+        pool->idle = entry->next;
+        pool_entry_free(pool, entry);
+    }
+    z_mutex_destroy(&pool->lock);
+    zng_cfree(NULL, pool->mem);
+}
+
+#endif
@@ -0,0 +1,426 @@
+/* benchmark.c -- throughput of the functable kernels and of deflate/inflate
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ * Each kernel is run over every corpus until at least the given time has
+ * elapsed, and one JSON record is written per kernel and corpus, so that
+ * results of different builds or machines can be compared by a script:
+ *
+ *   zlib-ng-bench [-t seconds] [-d datadir] [-o output.json] [files...]
+ *
+ * Without files, the corpora are the ones in test/data plus a few synthetic
+ * ones (zeros, random bytes and English text with random letters). The
+ * kernels are called through the functable, so the numbers are those of the
+ * implementation selected for this CPU.
+ */
+
+#define _POSIX_C_SOURCE 200112  /* For clock_gettime() and snprintf(). */
+
+#include "zbuild.h"
+#ifdef ZLIB_COMPAT
+#  include "zlib.h"
+#else
+#  include "zlib-ng.h"
+#endif
+#include "deflate.h"
+#include "functable.h"
+#include "memcopy.h"
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+
+#ifndef BENCH_DATA_DIR
+#  define BENCH_DATA_DIR "test/data"
+#endif
+
+#define SYNTHETIC_SIZE (1024 * 1024)
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct {
+    char name[64];
+    unsigned char *data;
+    size_t len;
+} corpus;
+
+static double min_time = 0.2;
+static FILE *out;
+static int first_record = 1;
+static volatile uint64_t sink;    /* keeps the results of the kernels alive */
+
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void report(const corpus *c, const char *bench, int level, uint64_t bytes, uint64_t iters, double secs,
+                   size_t compressed) {
+    double mbps = secs > 0 ? (double)bytes / secs / 1e6 : 0;
+
+    fprintf(out, "%s\n  {\"corpus\": \"%s\", \"benchmark\": \"%s\"", first_record ? "" : ",", c->name, bench);
+    if (level >= 0)
+        fprintf(out, ", \"level\": %d", level);
+    fprintf(out, ", \"bytes\": %" PRIu64 ", \"iterations\": %" PRIu64 ", \"seconds\": %.6f, \"mb_per_s\": %.2f",
+            bytes, iters, secs, mbps);
+    if (compressed)
+        fprintf(out, ", \"compressed\": %zu, \"ratio\": %.4f", compressed, (double)compressed / (double)c->len);
+    fprintf(out, "}");
+    first_record = 0;
+
+    if (out != stdout) {
+        if (level >= 0)
+            printf("%-16s %-14s %d %10.2f MB/s\n", c->name, bench, level, mbps);
+        else
+            printf("%-16s %-16s %10.2f MB/s\n", c->name, bench, mbps);
+    }
+}
+
+/* Run BODY, which processes BYTES bytes per iteration, until min_time has elapsed */
+#define TIMED(c, bench, level, bytes, body) do { \
+    uint64_t iters_ = 0; \
+    double start_ = now(), secs_; \
+    do { \
+        body; \
+        iters_++; \
+    } while ((secs_ = now() - start_) < min_time); \
+    report(c, bench, level, (uint64_t)(bytes) * iters_, iters_, secs_, 0); \
+} while (0)
+
+/* ===========================================================================
+ * Corpora
+ */
+static int load_file(corpus *c, const char *path) {
+    FILE *f = fopen(path, "rb");
+    const char *base;
+    long len;
+
+    if (f == NULL)
+        return 0;
+    if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return 0;
+    }
+    c->data = xmalloc((size_t)len);
+    c->len = fread(c->data, 1, (size_t)len, f);
+    fclose(f);
+
+    base = strrchr(path, '/');
+    snprintf(c->name, sizeof(c->name), "%s", base ? base + 1 : path);
+    return c->len > 0;
+}
+
+static uint32_t lcg(uint32_t *state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 16;
+}
+
+static void make_synthetic(corpus *c, const char *name) {
+    /* Letters in order of their frequency in English text */
+    static const char letters[] = "eeeeeeeeeeeetttttttttaaaaaaaaooooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrrddddllllcccuuummwwffggyyppbbvkjxqz";
+    uint32_t seed = 1;
+    size_t i;
+
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->len = SYNTHETIC_SIZE;
+    c->data = xmalloc(c->len);
+    if (strcmp(name, "zeros") == 0) {
+        memset(c->data, 0, c->len);
+    } else if (strcmp(name, "random") == 0) {
+        for (i = 0; i < c->len; i++)
+            c->data[i] = (unsigned char)lcg(&seed);
+    } else {
+        for (i = 0; i < c->len; i++)
+            c->data[i] = (lcg(&seed) % 6 == 0) ? ' ' : (unsigned char)letters[lcg(&seed) % (sizeof(letters) - 1)];
+    }
+}
+
+/* ===========================================================================
+ * Checksums and compare258
+ */
+static void bench_checksums(const corpus *c) {
+    unsigned char *dst = xmalloc(c->len);
+    uint64_t sum = 0;
+    size_t i, n;
+
+    TIMED(c, "adler32", -1, c->len, sum += functable.adler32(1, c->data, c->len));
+    TIMED(c, "adler32_copy", -1, c->len, sum += functable.adler32_copy(1, dst, c->data, c->len));
+    TIMED(c, "crc32", -1, c->len, sum += functable.crc32(0, c->data, c->len));
+    TIMED(c, "crc32_copy", -1, c->len, sum += functable.crc32_copy(0, dst, c->data, c->len));
+
+    /* Full length compares, which is where the primitive spends its time on
+     * long matches */
+    memcpy(dst, c->data, c->len);
+    n = c->len >= MAX_MATCH ? (c->len - MAX_MATCH) / MAX_MATCH : 0;
+    if (n > 0) {
+        TIMED(c, "compare258", -1, n * MAX_MATCH, {
+            for (i = 0; i < n; i++)
+                sum += functable.compare258(c->data + i * MAX_MATCH, dst + i * MAX_MATCH);
+        });
+    }
+
+    sink = sum;
+    free(dst);
+}
+
+#ifdef INFFAST_CHUNKSIZE
+/* Short copies at small distances, the pattern that inflate_fast() sees */
+static void bench_chunkmemset(const corpus *c) {
+    static const unsigned dists[] = {1, 2, 3, 4, 6, 8, 13, 16, 32, 100};
+    static const unsigned lens[] = {3, 8, 17, 32, 64, 258};
+    size_t size = 1024 * 1024;
+    unsigned char *buf = xmalloc(size + 2 * INFFAST_CHUNKSIZE);
+    unsigned char *end = buf + size - MAX_MATCH;
+    uint64_t bytes = 0;
+    unsigned char *p;
+    unsigned i = 0;
+
+    memcpy(buf, c->data, c->len < size ? c->len : size);
+    for (p = buf + 128; p < end; i++)
+        p += lens[i % 6];
+    bytes = (uint64_t)(p - (buf + 128));
+
+    TIMED(c, "chunkmemset", -1, bytes, {
+        for (i = 0, p = buf + 128; p < end; i++)
+            p = functable.chunkmemset(p, dists[i % 10], lens[i % 6]);
+    });
+
+    sink = buf[size / 2];
+    free(buf);
+}
+#endif
+
+/* ===========================================================================
+ * Kernels working on a deflate_state
+ */
+static void bench_deflate_kernels(const corpus *c) {
+    PREFIX3(stream) strm;
+    deflate_state *s;
+    Pos *heads;
+    uint64_t sum = 0;
+    unsigned p, count, wsize;
+
+    memset(&strm, 0, sizeof(strm));
+    if (PREFIX(deflateInit2)(&strm, 6, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "deflateInit2 failed\n");
+        exit(1);
+    }
+    s = (deflate_state *)strm.state;
+    wsize = s->w_size;
+
+    TIMED(c, "slide_hash", -1, (s->hash_size + wsize) * sizeof(Pos), functable.slide_hash(s));
+
+    /* fill_window copies the input into the window, sliding it when full */
+    TIMED(c, "fill_window", -1, c->len, {
+        strm.next_in = c->data;
+        strm.avail_in = (uint32_t)c->len;
+        s->strstart = 0;
+        s->block_start = 0;
+        s->insert = 0;
+        s->lookahead = 0;
+        do {
+            functable.fill_window(s);
+            s->strstart += s->lookahead;
+            s->block_start = (long)s->strstart;
+            s->lookahead = 0;
+        } while (strm.avail_in != 0);
+    });
+
+    /* The string kernels work on the first window of the corpus */
+    if (c->len < wsize) {
+        PREFIX(deflateEnd)(&strm);
+        return;
+    }
+    memcpy(s->window, c->data, wsize);
+    memset(s->window + wsize, 0, wsize);
+    count = wsize - MIN_LOOKAHEAD;
+
+    TIMED(c, "insert_string", -1, count, {
+        memset(s->head, 0, s->hash_size * sizeof(Pos));
+        for (p = 0; p < count; p++)
+            sum += functable.insert_string(s, (Pos)p, 1);
+    });
+
+    /* Runs as long as the longest matches, as inserted after one is emitted */
+    TIMED(c, "insert_string run", -1, count, {
+        memset(s->head, 0, s->hash_size * sizeof(Pos));
+        for (p = 0; p < count; p += MAX_MATCH)
+            sum += functable.insert_string(s, (Pos)p, count - p < MAX_MATCH ? count - p : MAX_MATCH);
+    });
+
+    /* Record the chain heads once, then search from every position that has one */
+    heads = xmalloc(count * sizeof(Pos));
+    memset(s->head, 0, s->hash_size * sizeof(Pos));
+    for (p = 0; p < count; p++)
+        heads[p] = functable.insert_string(s, (Pos)p, 1);
+
+    TIMED(c, "longest_match", -1, count, {
+        for (p = 1; p < count; p++) {
+            if (heads[p] == 0 || p - heads[p] > MAX_DIST(s))
+                continue;
+            s->strstart = p;
+            s->prev_length = MIN_MATCH - 1;
+            s->lookahead = wsize - p;
+            sum += functable.longest_match(s, heads[p]);
+        }
+    });
+
+    sink = sum;
+    free(heads);
+    PREFIX(deflateEnd)(&strm);
+}
+
+/* ===========================================================================
+ * End to end compression and decompression
+ */
+static void bench_levels(const corpus *c) {
+    size_t bound = PREFIX(deflateBound)(NULL, (unsigned long)c->len);
+    unsigned char *comp = xmalloc(bound);
+    unsigned char *decomp = xmalloc(c->len);
+    int level;
+
+    for (level = 0; level <= 9; level++) {
+        PREFIX3(stream) strm;
+        size_t comp_len = 0;
+        uint64_t iters = 0;
+        double start, secs;
+
+        memset(&strm, 0, sizeof(strm));
+        if (PREFIX(deflateInit2)(&strm, level, Z_DEFLATED, MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr, "deflateInit2 failed\n");
+            exit(1);
+        }
+        start = now();
+        do {
+            PREFIX(deflateReset)(&strm);
+            strm.next_in = c->data;
+            strm.avail_in = (uint32_t)c->len;
+            strm.next_out = comp;
+            strm.avail_out = (uint32_t)bound;
+            if (PREFIX(deflate)(&strm, Z_FINISH) != Z_STREAM_END) {
+                fprintf(stderr, "deflate failed at level %d\n", level);
+                exit(1);
+            }
+            comp_len = strm.total_out;
+            iters++;
+        } while ((secs = now() - start) < min_time);
+        PREFIX(deflateEnd)(&strm);
+        report(c, "deflate", level, (uint64_t)c->len * iters, iters, secs, comp_len);
+
+        memset(&strm, 0, sizeof(strm));
+        if (PREFIX(inflateInit2)(&strm, MAX_WBITS) != Z_OK) {
+            fprintf(stderr, "inflateInit2 failed\n");
+            exit(1);
+        }
+        iters = 0;
+        start = now();
+        do {
+            PREFIX(inflateReset)(&strm);
+            strm.next_in = comp;
+            strm.avail_in = (uint32_t)comp_len;
+            strm.next_out = decomp;
+            strm.avail_out = (uint32_t)c->len;
+            if (PREFIX(inflate)(&strm, Z_FINISH) != Z_STREAM_END || strm.total_out != c->len) {
+                fprintf(stderr, "inflate failed at level %d\n", level);
+                exit(1);
+            }
+            iters++;
+        } while ((secs = now() - start) < min_time);
+        PREFIX(inflateEnd)(&strm);
+        if (memcmp(decomp, c->data, c->len) != 0) {
+            fprintf(stderr, "inflate output differs at level %d\n", level);
+            exit(1);
+        }
+        report(c, "inflate", level, (uint64_t)c->len * iters, iters, secs, 0);
+    }
+
+    free(decomp);
+    free(comp);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: zlib-ng-bench [-t seconds] [-d datadir] [-o output.json] [files...]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *data_files[] = {"lcet10.txt", "paper-100k.pdf", "fireworks.jpg"};
+    static const char *synthetic[] = {"zeros", "random", "english"};
+    const char *data_dir = BENCH_DATA_DIR;
+    const char *out_path = NULL;
+    corpus corpora[16];
+    int ncorpora = 0;
+    char path[1024];
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else if (ncorpora < (int)ARRAY_SIZE(corpora)) {
+            if (!load_file(&corpora[ncorpora++], argv[i])) {
+                fprintf(stderr, "cannot read %s\n", argv[i]);
+                return 1;
+            }
+        }
+    }
+
+    if (ncorpora == 0) {
+        for (i = 0; i < (int)ARRAY_SIZE(data_files); i++) {
+            snprintf(path, sizeof(path), "%s/%s", data_dir, data_files[i]);
+            if (load_file(&corpora[ncorpora], path))
+                ncorpora++;
+            else
+                fprintf(stderr, "skipping %s\n", path);
+        }
+        for (i = 0; i < (int)ARRAY_SIZE(synthetic); i++)
+            make_synthetic(&corpora[ncorpora++], synthetic[i]);
+    }
+
+    out = stdout;
+    if (out_path != NULL && (out = fopen(out_path, "w")) == NULL) {
+        fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+
+    fprintf(out, "{\"version\": \"%s\", \"results\": [", ZLIBNG_VERSION);
+    for (i = 0; i < ncorpora; i++) {
+        bench_checksums(&corpora[i]);
+#ifdef INFFAST_CHUNKSIZE
+        bench_chunkmemset(&corpora[i]);
+#endif
+        bench_deflate_kernels(&corpora[i]);
+        bench_levels(&corpora[i]);
+        free(corpora[i].data);
+    }
+    fprintf(out, "\n]}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -39,6 +39,12 @@ static unsigned long dictId = 0; /* Adler32 value of the dictionary */
 
 void test_compress      (unsigned char *compr, z_size_t comprLen,unsigned char *uncompr, z_size_t uncomprLen);
 void test_gzio          (const char *fname, unsigned char *uncompr, z_size_t uncomprLen);
+void test_gzio_large    (const char *fname, const char *how);
+void test_gzindex       (const char *fname, const char *how);
+void test_gzbgzf        (const char *fname);
+void test_gzpeek        (const char *fname);
+void test_gzgetlines    (const char *fname);
+void test_gztest        (const char *fname);
 void test_deflate       (unsigned char *compr, size_t comprLen);
 void test_inflate       (unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen);
 void test_large_deflate (unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen, int zng_params);
@@ -77,6 +83,508 @@ void test_compress(unsigned char *compr, z_size_t comprLen, unsigned char *uncom
     }
 }
 
+#ifndef ZLIB_COMPAT
+/* ===========================================================================
+ * Test zng_compress_oneshot() and zng_uncompress_oneshot() on a short and a
+ * long input, and their errors
+ */
+void test_compress_oneshot(void)
+{
+    size_t lens[2] = { 0, 100000 };
+    size_t len, comprLen, uncomprLen, used, size, i;
+    unsigned char *in, *compr, *uncompr, *scratch;
+    uint32_t seed = 7;
+    int err, li;
+
+    lens[0] = strlen(hello)+1;
+    in = (unsigned char *)malloc(lens[1]);
+    compr = (unsigned char *)malloc(zng_compressBound(lens[1]));
+    uncompr = (unsigned char *)malloc(lens[1]);
+    size = zng_compress_oneshot_size(lens[1], 9);
+    if (zng_uncompress_oneshot_size() > size)
+        size = zng_uncompress_oneshot_size();
+    scratch = (unsigned char *)malloc(size);
+    if (in == NULL || compr == NULL || uncompr == NULL || scratch == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    memcpy(in, hello, lens[0]);
+    for (i = lens[0]; i < lens[1]; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 64 && (seed >> 16) % 4 ? in[i - 1 - (seed >> 24) % 64] : (unsigned char)(seed >> 16);
+    }
+
+    for (li = 0; li < 2; li++) {
+        len = lens[li];
+        if (zng_compress_oneshot_size(len, 9) > zng_compress_oneshot_size(lens[1], 9) ||
+            zng_compress_oneshot_size(len, 42) != 0) {
+            fprintf(stderr, "bad zng_compress_oneshot_size\n");
+            exit(1);
+        }
+        comprLen = zng_compressBound(len);
+        err = zng_compress_oneshot(compr, &comprLen, in, len, 9, scratch, zng_compress_oneshot_size(len, 9));
+        CHECK_ERR(err, "zng_compress_oneshot");
+
+        uncomprLen = len;
+        err = PREFIX(uncompress)(uncompr, &uncomprLen, compr, comprLen);
+        CHECK_ERR(err, "uncompress");
+        if (uncomprLen != len || memcmp(uncompr, in, len)) {
+            fprintf(stderr, "bad uncompress of zng_compress_oneshot output\n");
+            exit(1);
+        }
+
+        memset(uncompr, 0, len);
+        uncomprLen = len;
+        used = comprLen;
+        err = zng_uncompress_oneshot(uncompr, &uncomprLen, compr, &used, scratch, zng_uncompress_oneshot_size());
+        CHECK_ERR(err, "zng_uncompress_oneshot");
+        if (uncomprLen != len || used != comprLen || memcmp(uncompr, in, len)) {
+            fprintf(stderr, "bad zng_uncompress_oneshot\n");
+            exit(1);
+        }
+
+        /* Too little output space, and a truncated stream */
+        uncomprLen = len - 1;
+        used = comprLen;
+        err = zng_uncompress_oneshot(uncompr, &uncomprLen, compr, &used, scratch, zng_uncompress_oneshot_size());
+        if (err != Z_BUF_ERROR) {
+            fprintf(stderr, "zng_uncompress_oneshot should report Z_BUF_ERROR, not %d\n", err);
+            exit(1);
+        }
+        uncomprLen = len;
+        used = comprLen / 2;
+        err = zng_uncompress_oneshot(uncompr, &uncomprLen, compr, &used, scratch, zng_uncompress_oneshot_size());
+        if (err != Z_DATA_ERROR) {
+            fprintf(stderr, "zng_uncompress_oneshot should report Z_DATA_ERROR, not %d\n", err);
+            exit(1);
+        }
+    }
+
+    comprLen = zng_compressBound(lens[1]);
+    err = zng_compress_oneshot(compr, &comprLen, in, lens[1], 9, scratch, zng_compress_oneshot_size(lens[1], 9) / 2);
+    if (err != Z_MEM_ERROR || comprLen != 0) {
+        fprintf(stderr, "zng_compress_oneshot should report Z_MEM_ERROR\n");
+        exit(1);
+    }
+    uncomprLen = lens[1];
+    used = comprLen;
+    err = zng_uncompress_oneshot(uncompr, &uncomprLen, compr, &used, scratch, 64);
+    if (err != Z_MEM_ERROR) {
+        fprintf(stderr, "zng_uncompress_oneshot should report Z_MEM_ERROR\n");
+        exit(1);
+    }
+    printf("zng_compress_oneshot(), zng_uncompress_oneshot(): OK\n");
+
+    free(in);
+    free(compr);
+    free(uncompr);
+    free(scratch);
+}
+
+/* ===========================================================================
+ * Test zng_compress_batch() on records of different lengths, one of them
+ * empty, and with an output that is too small
+ */
+void test_compress_batch(void)
+{
+#define BATCH_RECORDS 50
+#define BATCH_OUT 2100
+    zng_iovec inputs[BATCH_RECORDS], outputs[BATCH_RECORDS];
+    unsigned char *in, *compr, uncompr[2000];
+    size_t at, len, i, j;
+    uint32_t seed = 5;
+    int err, level;
+
+    in = (unsigned char *)malloc(BATCH_RECORDS * 2000);
+    compr = (unsigned char *)malloc(BATCH_RECORDS * BATCH_OUT);
+    if (in == NULL || compr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0, at = 0; i < BATCH_RECORDS; i++) {
+        len = i == 7 ? 0 : 200 + (i * 997) % 1800;
+        inputs[i].iov_base = in + at;
+        inputs[i].iov_len = len;
+        for (j = 0; j < len; j++, at++) {
+            seed = seed * 1103515245 + 12345;
+            in[at] = j >= 16 && (seed >> 16) % 3 ? in[at - 1 - (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 26);
+        }
+    }
+
+    for (level = 1; level <= 9; level += 4) {
+        for (i = 0; i < BATCH_RECORDS; i++) {
+            outputs[i].iov_base = compr + i * BATCH_OUT;
+            outputs[i].iov_len = BATCH_OUT;
+        }
+        err = zng_compress_batch(inputs, outputs, BATCH_RECORDS, level);
+        CHECK_ERR(err, "zng_compress_batch");
+        for (i = 0; i < BATCH_RECORDS; i++) {
+            z_size_t uncomprLen = sizeof(uncompr);
+
+            err = PREFIX(uncompress)(uncompr, &uncomprLen, (unsigned char *)outputs[i].iov_base, outputs[i].iov_len);
+            CHECK_ERR(err, "uncompress");
+            if (uncomprLen != inputs[i].iov_len || memcmp(uncompr, inputs[i].iov_base, uncomprLen)) {
+                fprintf(stderr, "bad zng_compress_batch record %d at level %d\n", (int)i, level);
+                exit(1);
+            }
+        }
+    }
+
+    for (i = 0; i < BATCH_RECORDS; i++)
+        outputs[i].iov_len = i == 30 ? 100 : BATCH_OUT;
+    err = zng_compress_batch(inputs, outputs, BATCH_RECORDS, 6);
+    if (err != Z_BUF_ERROR || outputs[29].iov_len == 0 || outputs[30].iov_len != 0 ||
+        outputs[BATCH_RECORDS - 1].iov_len != 0 || zng_compress_batch(inputs, outputs, 1, 42) != Z_STREAM_ERROR ||
+        zng_compress_batch(NULL, outputs, 1, 6) != Z_STREAM_ERROR || zng_compress_batch(NULL, NULL, 0, 6) != Z_OK) {
+        fprintf(stderr, "zng_compress_batch errors not reported\n");
+        exit(1);
+    }
+    printf("zng_compress_batch(): %d records\n", BATCH_RECORDS);
+
+    free(in);
+    free(compr);
+#undef BATCH_RECORDS
+#undef BATCH_OUT
+}
+
+/* ===========================================================================
+ * Test zng_uncompress_batch() on a number of streams that is not a multiple
+ * of the lanes, short and long, and on a corrupt one, a truncated one, and
+ * one that does not fit
+ */
+void test_uncompress_batch(void)
+{
+#define BATCH_RECORDS 13
+#define BATCH_MAX 100000
+    zng_iovec inputs[BATCH_RECORDS], outputs[BATCH_RECORDS];
+    unsigned char *in, *compr, *uncompr;
+    size_t at, len[BATCH_RECORDS], i, j;
+    z_size_t comprLen;
+    uint32_t seed = 11;
+    int err;
+
+    in = (unsigned char *)malloc(BATCH_RECORDS * BATCH_MAX);
+    compr = (unsigned char *)malloc(BATCH_RECORDS * (BATCH_MAX + 1000));
+    uncompr = (unsigned char *)malloc(BATCH_RECORDS * BATCH_MAX);
+    if (in == NULL || compr == NULL || uncompr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0, at = 0; i < BATCH_RECORDS; i++) {
+        len[i] = i == 4 ? 0 : i % 3 == 0 ? BATCH_MAX - i * 1000 : 100 + i * 131;
+        for (j = 0; j < len[i]; j++) {
+            seed = seed * 1103515245 + 12345;
+            in[i * BATCH_MAX + j] = j >= 300 && (seed >> 16) % 4 ? in[i * BATCH_MAX + j - 1 - (seed >> 20) % 300]
+                                                                : (unsigned char)('a' + (seed >> 16) % 26);
+        }
+        comprLen = BATCH_MAX + 1000;
+        err = PREFIX(compress2)(compr + at, &comprLen, in + i * BATCH_MAX, len[i], (int)(i % 10));
+        CHECK_ERR(err, "compress2");
+        inputs[i].iov_base = compr + at;
+        inputs[i].iov_len = comprLen;
+        at += comprLen;
+    }
+
+    for (i = 0; i < BATCH_RECORDS; i++) {
+        outputs[i].iov_base = uncompr + i * BATCH_MAX;
+        outputs[i].iov_len = BATCH_MAX;
+    }
+    err = zng_uncompress_batch(inputs, outputs, BATCH_RECORDS);
+    CHECK_ERR(err, "zng_uncompress_batch");
+    for (i = 0; i < BATCH_RECORDS; i++) {
+        if (outputs[i].iov_len != len[i] || memcmp(uncompr + i * BATCH_MAX, in + i * BATCH_MAX, len[i])) {
+            fprintf(stderr, "bad zng_uncompress_batch record %d\n", (int)i);
+            exit(1);
+        }
+    }
+
+    /* one record alone, and then the errors */
+    outputs[3].iov_len = BATCH_MAX;
+    err = zng_uncompress_batch(inputs + 3, outputs + 3, 1);
+    CHECK_ERR(err, "zng_uncompress_batch");
+    if (outputs[3].iov_len != len[3]) {
+        fprintf(stderr, "bad zng_uncompress_batch single record\n");
+        exit(1);
+    }
+    for (i = 0; i < BATCH_RECORDS; i++)
+        outputs[i].iov_len = i == 9 ? len[9] - 1 : BATCH_MAX;
+    err = zng_uncompress_batch(inputs, outputs, BATCH_RECORDS);
+    if (err != Z_BUF_ERROR || outputs[8].iov_len != len[8] || outputs[9].iov_len != 0 || outputs[10].iov_len != 0) {
+        fprintf(stderr, "zng_uncompress_batch short output not reported\n");
+        exit(1);
+    }
+    for (i = 0; i < BATCH_RECORDS; i++)
+        outputs[i].iov_len = BATCH_MAX;
+    inputs[6].iov_len -= 10;
+    err = zng_uncompress_batch(inputs, outputs, BATCH_RECORDS);
+    inputs[6].iov_len += 10;
+    if (err != Z_DATA_ERROR || outputs[5].iov_len != len[5] || outputs[6].iov_len != 0) {
+        fprintf(stderr, "zng_uncompress_batch truncated input not reported\n");
+        exit(1);
+    }
+    for (i = 0; i < BATCH_RECORDS; i++)
+        outputs[i].iov_len = BATCH_MAX;
+    ((unsigned char *)inputs[2].iov_base)[inputs[2].iov_len / 2] ^= 0x55;
+    err = zng_uncompress_batch(inputs, outputs, BATCH_RECORDS);
+    if (err != Z_DATA_ERROR || outputs[1].iov_len != len[1] || outputs[2].iov_len != 0 ||
+        zng_uncompress_batch(NULL, outputs, 1) != Z_STREAM_ERROR || zng_uncompress_batch(NULL, NULL, 0) != Z_OK) {
+        fprintf(stderr, "zng_uncompress_batch errors not reported\n");
+        exit(1);
+    }
+    printf("zng_uncompress_batch(): %d records\n", BATCH_RECORDS);
+
+    free(in);
+    free(compr);
+    free(uncompr);
+#undef BATCH_RECORDS
+#undef BATCH_MAX
+}
+
+/* ===========================================================================
+ * Test zng_uncompress_inplace() on text and on random data with the margin
+ * it asks for, and on random data without a margin
+ */
+void test_uncompress_inplace(void)
+{
+#define INPLACE_LEN 200000
+    unsigned char *in, *buf;
+    size_t bufLen, destLen, margin, j;
+    z_size_t comprLen;
+    uint32_t seed = 3;
+    int err, level, random;
+
+    in = (unsigned char *)malloc(INPLACE_LEN);
+    buf = (unsigned char *)malloc(INPLACE_LEN + zng_uncompress_inplace_margin(INPLACE_LEN));
+    if (in == NULL || buf == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (random = 1; random >= 0; random--) {
+        for (j = 0; j < INPLACE_LEN; j++) {
+            seed = seed * 1103515245 + 12345;
+            in[j] = random ? (unsigned char)(seed >> 16) :
+                    j >= 100 && (seed >> 16) % 3 ? in[j - 1 - (seed >> 20) % 100] : (unsigned char)('a' + (seed >> 16) % 26);
+        }
+        for (level = 1; level <= 6; level += 5) {
+            margin = zng_uncompress_inplace_margin(INPLACE_LEN);
+            bufLen = INPLACE_LEN + margin;
+            comprLen = bufLen;
+            err = PREFIX(compress2)(buf, &comprLen, in, INPLACE_LEN, level);
+            CHECK_ERR(err, "compress2");
+            memmove(buf + bufLen - comprLen, buf, comprLen);
+            destLen = bufLen;
+            err = zng_uncompress_inplace(buf, &destLen, comprLen);
+            CHECK_ERR(err, "zng_uncompress_inplace");
+            if (destLen != INPLACE_LEN || memcmp(buf, in, INPLACE_LEN)) {
+                fprintf(stderr, "bad zng_uncompress_inplace at level %d\n", level);
+                exit(1);
+            }
+        }
+    }
+
+    /* text in a buffer of only its length, so that the output runs into the trailer */
+    comprLen = INPLACE_LEN;
+    err = PREFIX(compress2)(buf, &comprLen, in, INPLACE_LEN, 6);
+    CHECK_ERR(err, "compress2");
+    memmove(buf + INPLACE_LEN - comprLen, buf, comprLen);
+    destLen = INPLACE_LEN;
+    err = zng_uncompress_inplace(buf, &destLen, comprLen);
+    if (err != Z_BUF_ERROR || destLen >= INPLACE_LEN || memcmp(buf, in, destLen) ||
+        zng_uncompress_inplace(buf, &destLen, destLen + 1) != Z_STREAM_ERROR) {
+        fprintf(stderr, "zng_uncompress_inplace short buffer not reported\n");
+        exit(1);
+    }
+    printf("zng_uncompress_inplace(): margin %lu for %d bytes\n", (unsigned long)margin, INPLACE_LEN);
+
+    free(in);
+    free(buf);
+#undef INPLACE_LEN
+}
+
+/* ===========================================================================
+ * Test zng_uncompress_prefix() on the start of a zlib and of a gzip stream,
+ * on a prefix longer than the stream, and on a truncated stream
+ */
+void test_uncompress_prefix(void)
+{
+#define PREFIX_LEN 300000
+    unsigned char *in, *compr, *out;
+    size_t comprLen, destLen, sourceLen, j;
+    zng_stream c_stream;
+    uint32_t seed = 5;
+    int err, gzip;
+
+    in = (unsigned char *)malloc(PREFIX_LEN);
+    compr = (unsigned char *)malloc(PREFIX_LEN + 1024);
+    out = (unsigned char *)malloc(PREFIX_LEN + 1);
+    if (in == NULL || compr == NULL || out == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (j = 0; j < PREFIX_LEN; j++) {
+        seed = seed * 1103515245 + 12345;
+        in[j] = j >= 100 && (seed >> 16) % 3 ? in[j - 1 - (seed >> 20) % 100] : (unsigned char)('a' + (seed >> 16) % 26);
+    }
+
+    for (gzip = 0; gzip <= 1; gzip++) {
+        memset(&c_stream, 0, sizeof(c_stream));
+        err = zng_deflateInit2(&c_stream, 6, Z_DEFLATED, MAX_WBITS + (gzip ? 16 : 0), 8, Z_DEFAULT_STRATEGY);
+        CHECK_ERR(err, "deflateInit2");
+        c_stream.next_in = in;
+        c_stream.avail_in = PREFIX_LEN;
+        c_stream.next_out = compr;
+        c_stream.avail_out = PREFIX_LEN + 1024;
+        err = zng_deflate(&c_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        comprLen = (size_t)c_stream.total_out;
+        zng_deflateEnd(&c_stream);
+
+        /* a prefix stops early, without reading all of the input */
+        destLen = 1000;
+        sourceLen = comprLen;
+        err = zng_uncompress_prefix(out, &destLen, compr, &sourceLen);
+        CHECK_ERR(err, "zng_uncompress_prefix");
+        if (destLen != 1000 || memcmp(out, in, 1000) || sourceLen >= comprLen / 2) {
+            fprintf(stderr, "bad zng_uncompress_prefix of the %s stream\n", gzip ? "gzip" : "zlib");
+            exit(1);
+        }
+
+        /* room for more than the whole stream gives all of it */
+        destLen = PREFIX_LEN + 1;
+        sourceLen = comprLen;
+        err = zng_uncompress_prefix(out, &destLen, compr, &sourceLen);
+        CHECK_ERR(err, "zng_uncompress_prefix");
+        if (destLen != PREFIX_LEN || memcmp(out, in, PREFIX_LEN) || sourceLen != comprLen) {
+            fprintf(stderr, "bad zng_uncompress_prefix of the whole %s stream\n", gzip ? "gzip" : "zlib");
+            exit(1);
+        }
+
+        /* a stream that ends before the prefix is an error */
+        destLen = PREFIX_LEN;
+        sourceLen = comprLen / 2;
+        err = zng_uncompress_prefix(out, &destLen, compr, &sourceLen);
+        if (err != Z_DATA_ERROR || destLen >= PREFIX_LEN || memcmp(out, in, destLen)) {
+            fprintf(stderr, "zng_uncompress_prefix truncated stream not reported\n");
+            exit(1);
+        }
+    }
+    printf("zng_uncompress_prefix(): OK\n");
+
+    free(in);
+    free(compr);
+    free(out);
+#undef PREFIX_LEN
+}
+
+/* ===========================================================================
+ * Test zng_inflateBackInitRing() with a ring that is not a power of two, on
+ * stored and on compressed blocks
+ */
+typedef struct {
+    const unsigned char *in;
+    size_t in_len;
+    unsigned char *out;
+    size_t out_len;
+    unsigned calls;
+} ring_desc;
+
+static uint32_t ring_in(void *desc, const unsigned char **buf)
+{
+    ring_desc *d = (ring_desc *)desc;
+    uint32_t len = d->in_len > 5000 ? 5000 : (uint32_t)d->in_len;
+
+    *buf = d->in;
+    d->in += len;
+    d->in_len -= len;
+    return len;
+}
+
+static int ring_out(void *desc, unsigned char *buf, uint32_t len)
+{
+    ring_desc *d = (ring_desc *)desc;
+
+    memcpy(d->out + d->out_len, buf, len);
+    d->out_len += len;
+    d->calls++;
+    return 0;
+}
+
+void test_inflate_back_ring(void)
+{
+#define RING_LEN 1000000
+#define RING_SIZE (96*1024)
+    PREFIX3(stream) strm;
+    unsigned char *data, *compr, *uncompr, *ring;
+    z_size_t comprLen;
+    ring_desc desc;
+    size_t j;
+    uint32_t seed = 9;
+    int err, level;
+
+    data = (unsigned char *)malloc(RING_LEN);
+    compr = (unsigned char *)malloc(RING_LEN + RING_LEN / 8 + 1000);
+    uncompr = (unsigned char *)malloc(RING_LEN);
+    ring = (unsigned char *)malloc(RING_SIZE + 64);
+    if (data == NULL || compr == NULL || uncompr == NULL || ring == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (j = 0; j < RING_LEN; j++) {
+        seed = seed * 1103515245 + 12345;
+        data[j] = j >= 30000 && (seed >> 16) % 4 ? data[j - 1 - (seed >> 8) % 30000] : (unsigned char)('a' + (seed >> 16) % 26);
+    }
+
+    for (level = 0; level <= 6; level += 6) {
+        memset(&strm, 0, sizeof(strm));
+        err = PREFIX(deflateInit2)(&strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        CHECK_ERR(err, "deflateInit2");
+        strm.next_in = data;
+        strm.avail_in = RING_LEN;
+        strm.next_out = compr;
+        strm.avail_out = RING_LEN + RING_LEN / 8 + 1000;
+        err = PREFIX(deflate)(&strm, Z_FINISH);
+        comprLen = (z_size_t)strm.total_out;
+        PREFIX(deflateEnd)(&strm);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+
+        memset(&strm, 0, sizeof(strm));
+        err = zng_inflateBackInitRing(&strm, ring, RING_SIZE);
+        CHECK_ERR(err, "zng_inflateBackInitRing");
+        desc.in = compr;
+        desc.in_len = comprLen;
+        desc.out = uncompr;
+        desc.out_len = 0;
+        desc.calls = 0;
+        strm.next_in = NULL;
+        err = PREFIX(inflateBack)(&strm, ring_in, &desc, ring_out, &desc);
+        if (err != Z_STREAM_END || desc.out_len != RING_LEN || memcmp(uncompr, data, RING_LEN) ||
+            desc.calls > RING_LEN / (RING_SIZE / 2) + 1) {
+            fprintf(stderr, "bad zng_inflateBackInitRing at level %d: %d, %u writes\n", level, err, desc.calls);
+            exit(1);
+        }
+        PREFIX(inflateBackEnd)(&strm);
+    }
+    if (zng_inflateBackInitRing(&strm, ring, 1000) != Z_STREAM_ERROR) {
+        fprintf(stderr, "zng_inflateBackInitRing small ring not reported\n");
+        exit(1);
+    }
+    printf("zng_inflateBackInitRing(): %u writes\n", desc.calls);
+
+    free(data);
+    free(compr);
+    free(uncompr);
+    free(ring);
+#undef RING_LEN
+#undef RING_SIZE
+}
+#endif
+
 /* ===========================================================================
  * Test read/write of .gz files
  */
@@ -159,729 +667,5032 @@ void test_gzio(const char *fname, unsigned char *uncompr, z_size_t uncomprLen)
 }
 
 /* ===========================================================================
- * Test deflate() with small buffers
+ * Test writing and reading .gz files larger than the buffers with the gzopen()
+ * mode letter in how, including seeking backwards and reading the file again
+ * after a rewind, and seeking in a file that is not compressed
  */
-void test_deflate(unsigned char *compr, size_t comprLen)
+void test_gzio_large(const char *fname, const char *how)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-    size_t len = strlen(hello)+1;
+#ifdef NO_GZCOMPRESS
+    fprintf(stderr, "NO_GZCOMPRESS -- gz* functions cannot compress\n");
+#else
+    const unsigned int len = 1 << 20;
+    unsigned char *data, *back;
+    unsigned int i, have;
+    uint32_t x = 1;
+    int err, pass;
+    char mode[8];
+    gzFile file;
 
-    c_stream.zalloc = zalloc;
-    c_stream.zfree = zfree;
-    c_stream.opaque = (void *)0;
-    c_stream.total_in = 0;
-    c_stream.total_out = 0;
+    data = (unsigned char *)malloc(len);
+    back = (unsigned char *)malloc(len);
+    if (data == NULL || back == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        x = x * 1103515245 + 12345;
+        data[i] = i >= 64 && (x >> 24) < 192 ? data[i - 1 - (x >> 16) % 64] : (unsigned char)(x >> 16);
+    }
 
-    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
-    CHECK_ERR(err, "deflateInit");
+    /* store the gzip stream, then the same data as a second stream uncompressed */
+    for (pass = 0; pass < 2; pass++) {
+        snprintf(mode, sizeof(mode), "%s%s", pass ? "ab0" : "wb1", how);
+        file = PREFIX(gzopen)(fname, mode);
+        if (file == NULL || PREFIX(gzwrite)(file, data, len / 2) != (int)len / 2 ||
+            PREFIX(gzflush)(file, Z_SYNC_FLUSH) != Z_OK || PREFIX(gzoffset)(file) <= 0 ||
+            PREFIX(gzwrite)(file, data + len / 2, len / 2) != (int)len / 2) {
+            fprintf(stderr, "gzwrite error with \"%s\"\n", mode);
+            exit(1);
+        }
+        PREFIX(gzclose)(file);
+    }
 
-    c_stream.next_in  = (const unsigned char *)hello;
-    c_stream.next_out = compr;
+    snprintf(mode, sizeof(mode), "rb%s", how);
+    file = PREFIX(gzopen)(fname, mode);
+    if (file == NULL) {
+        fprintf(stderr, "gzopen error\n");
+        exit(1);
+    }
+    for (pass = 0; pass < 2; pass++) {
+        memset(back, 0, len);
+        have = 0;
+        while (have < len) {
+            int got = PREFIX(gzread)(file, back + have, len - have < 5000 ? len - have : 5000);
+            if (got <= 0) {
+                fprintf(stderr, "gzread err: %s\n", PREFIX(gzerror)(file, &err));
+                exit(1);
+            }
+            have += (unsigned int)got;
+        }
+        if (memcmp(back, data, len)) {
+            fprintf(stderr, "bad gzread with \"%s\"\n", mode);
+            exit(1);
+        }
+        if (PREFIX(gzseek)(file, len / 2, SEEK_SET) != (z_off_t)len / 2 ||
+            PREFIX(gzread)(file, back, 1000) != 1000 || memcmp(back, data + len / 2, 1000)) {
+            fprintf(stderr, "gzseek error with \"%s\"\n", mode);
+            exit(1);
+        }
+        PREFIX(gzseek)(file, len, SEEK_SET);
+        if (PREFIX(gzread)(file, back, len) != (int)len || memcmp(back, data, len) ||
+            PREFIX(gzread)(file, back, 1) != 0 || !PREFIX(gzeof)(file)) {
+            fprintf(stderr, "gzread of second stream error with \"%s\"\n", mode);
+            exit(1);
+        }
+        PREFIX(gzrewind)(file);
+    }
+    PREFIX(gzclose)(file);
 
-    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
-        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
-        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
-        CHECK_ERR(err, "deflate");
+    /* read a file that is not compressed, seeking within it directly */
+    snprintf(mode, sizeof(mode), "wbT%s", how);
+    file = PREFIX(gzopen)(fname, mode);
+    if (file == NULL || PREFIX(gzwrite)(file, data, len) != (int)len) {
+        fprintf(stderr, "gzwrite error with \"%s\"\n", mode);
+        exit(1);
     }
-    /* Finish the stream, still forcing small buffers: */
-    for (;;) {
-        c_stream.avail_out = 1;
-        err = PREFIX(deflate)(&c_stream, Z_FINISH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "deflate");
+    PREFIX(gzclose)(file);
+    snprintf(mode, sizeof(mode), "rb%s", how);
+    file = PREFIX(gzopen)(fname, mode);
+    if (file == NULL || PREFIX(gzread)(file, back, 3000) != 3000 || memcmp(back, data, 3000) ||
+        !PREFIX(gzdirect)(file) || PREFIX(gzseek)(file, len / 3, SEEK_SET) != (z_off_t)len / 3 ||
+        PREFIX(gzread)(file, back, len) != (int)(len - len / 3) || memcmp(back, data + len / 3, len - len / 3) ||
+        PREFIX(gzseek)(file, 100, SEEK_SET) != 100 || PREFIX(gzread)(file, back, 1000) != 1000 ||
+        memcmp(back, data + 100, 1000)) {
+        fprintf(stderr, "transparent gzread error with \"%s\"\n", mode);
+        exit(1);
     }
+    PREFIX(gzclose)(file);
 
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd");
+    free(data);
+    free(back);
+    printf("gzread() with \"%s\": OK\n", mode);
+#endif
 }
 
-/* ===========================================================================
- * Test inflate() with small buffers
+#ifndef ZLIB_COMPAT
+#ifndef NO_GZCOMPRESS
+/* Seek to random places in file, which has copies of the len bytes at data
+ * up to total, and check what is read there
  */
-void test_inflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+static void gzindex_seeks(gzFile file, const unsigned char *data, unsigned int len, unsigned int total, uint32_t *x)
 {
-    int err;
-    PREFIX3(stream) d_stream; /* decompression stream */
-
-    strcpy((char*)uncompr, "garbage");
-
-    d_stream.zalloc = zalloc;
-    d_stream.zfree = zfree;
-    d_stream.opaque = (void *)0;
-
-    d_stream.next_in  = compr;
-    d_stream.avail_in = 0;
-    d_stream.next_out = uncompr;
-    d_stream.total_in = 0;
-    d_stream.total_out = 0;
+    unsigned char back[1000];
+    unsigned int i, k;
 
-    err = PREFIX(inflateInit)(&d_stream);
-    CHECK_ERR(err, "inflateInit");
+    for (k = 0; k < 40; k++) {
+        z_off_t pos;
 
-    while (d_stream.total_out < uncomprLen && d_stream.total_in < comprLen) {
-        d_stream.avail_in = d_stream.avail_out = 1; /* force small buffers */
-        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "inflate");
+        *x = *x * 1103515245 + 12345;
+        pos = (z_off_t)(*x % (total - 1000));
+        if (PREFIX(gzseek)(file, pos, SEEK_SET) != pos || PREFIX(gzread)(file, back, 1000) != 1000) {
+            fprintf(stderr, "gzseek error with index\n");
+            exit(1);
+        }
+        for (i = 0; i < 1000; i++)
+            if (back[i] != data[(pos + i) % len]) {
+                fprintf(stderr, "bad gzread after gzseek with index\n");
+                exit(1);
+            }
     }
+}
 
-    err = PREFIX(inflateEnd)(&d_stream);
-    CHECK_ERR(err, "inflateEnd");
+/* Read all of file, which has copies of the len bytes at data up to total */
+static void gzindex_read_all(gzFile file, const unsigned char *data, unsigned int len, unsigned int total)
+{
+    unsigned char back[1000];
+    unsigned int i, got, at = 0;
 
-    if (strcmp((char*)uncompr, hello)) {
-        fprintf(stderr, "bad inflate\n");
+    if (PREFIX(gzrewind)(file) == -1) {
+        fprintf(stderr, "gzrewind error with index\n");
+        exit(1);
+    }
+    while ((got = (unsigned int)PREFIX(gzread)(file, back, sizeof(back))) > 0)
+        for (i = 0; i < got; i++, at++)
+            if (back[i] != data[at % len]) {
+                fprintf(stderr, "bad gzread with index at %u\n", at);
+                exit(1);
+            }
+    if (at != total || !PREFIX(gzeof)(file)) {
+        fprintf(stderr, "short gzread with index: %u\n", at);
         exit(1);
-    } else {
-        printf("inflate(): %s\n", (char *)uncompr);
     }
 }
-
-static unsigned int diff;
+#endif
 
 /* ===========================================================================
- * Test deflate() with large buffers and dynamic change of compression level
+ * Test gzseek() on two gzip streams with an index, built and then loaded, and
+ * read with threads. Then do the same for a file of BGZF members.
  */
-void test_large_deflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen, int zng_params)
+void test_gzindex(const char *fname, const char *how)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-#ifndef ZLIB_COMPAT
-    int level = -1;
-    int strategy = -1;
-    zng_deflate_param_value params[] = {
-        { .param = Z_DEFLATE_LEVEL, .buf = &level, .size = sizeof(level) },
-        { .param = Z_DEFLATE_STRATEGY, .buf = &strategy, .size = sizeof(strategy) },
-    };
+#ifdef NO_GZCOMPRESS
+    fprintf(stderr, "NO_GZCOMPRESS -- gz* functions cannot compress\n");
+#else
+    const unsigned int len = 1 << 20, span = 65536, block = 32768;
+    unsigned char *data, *back, *saved, *compr;
+    unsigned int i;
+    size_t size, at;
+    uint32_t x = 1;
+    int points, pass;
+    char mode[8];
+    gzFile file;
+    FILE *out;
+
+    data = (unsigned char *)malloc(len);
+    back = (unsigned char *)malloc(1000);
+    compr = (unsigned char *)malloc(2 * block);
+    if (data == NULL || back == NULL || compr == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        x = x * 1103515245 + 12345;
+        data[i] = i >= 64 && (x >> 24) < 192 ? data[i - 1 - (x >> 16) % 64] : (unsigned char)(x >> 16);
+    }
+
+    for (pass = 0; pass < 2; pass++) {
+        snprintf(mode, sizeof(mode), "%s%s", pass ? "ab2" : "wb9", how);
+        file = PREFIX(gzopen)(fname, mode);
+        if (file == NULL || PREFIX(gzwrite)(file, data, len) != (int)len) {
+            fprintf(stderr, "gzwrite error with \"%s\"\n", mode);
+            exit(1);
+        }
+        PREFIX(gzclose)(file);
+    }
+
+    /* build the index after reading a little, which should not move */
+    snprintf(mode, sizeof(mode), "rb%s", how);
+    file = PREFIX(gzopen)(fname, mode);
+    if (file == NULL || PREFIX(gzread)(file, back, 1000) != 1000) {
+        fprintf(stderr, "gzopen error\n");
+        exit(1);
+    }
+    points = zng_gzindex_build(file, span);
+    if (points < (int)(len / span) || PREFIX(gztell)(file) != 1000 ||
+        PREFIX(gzread)(file, back, 1000) != 1000 || memcmp(back, data + 1000, 1000)) {
+        fprintf(stderr, "zng_gzindex_build error with \"%s\": %d\n", mode, points);
+        exit(1);
+    }
+    size = zng_gzindex_save(file, NULL, 0);
+    saved = (unsigned char *)malloc(size);
+    if (saved == NULL || zng_gzindex_save(file, saved, size) != size) {
+        fprintf(stderr, "zng_gzindex_save error\n");
+        exit(1);
+    }
+
+    /* seek around both streams, then again in another file with the index
+       loaded, and in one read with threads */
+    for (pass = 0; pass < 3; pass++) {
+        gzindex_seeks(file, data, len, 2 * len, &x);
+        if (pass == 2)
+            gzindex_read_all(file, data, len, 2 * len);
+        PREFIX(gzclose)(file);
+        if (pass == 2)
+            break;
+
+        snprintf(mode, sizeof(mode), "rb%s%s", pass ? "P4" : "", how);
+        file = PREFIX(gzopen)(fname, mode);
+        if (file == NULL || zng_gzindex_load(file, saved, size - 1) != -1 ||
+            zng_gzindex_load(file, saved, size) != points || zng_gzindex_save(file, NULL, 0) != size) {
+            fprintf(stderr, "zng_gzindex_load error\n");
+            exit(1);
+        }
+        if (pass == 0) {
+            saved[0] ^= 1;
+            if (zng_gzindex_load(file, saved, size) != -1) {
+                fprintf(stderr, "zng_gzindex_load should reject a bad index\n");
+                exit(1);
+            }
+            saved[0] ^= 1;
+        }
+    }
+    printf("zng_gzindex_build() with \"%s\": %d points\n", mode, points);
+
+    /* write BGZF members of block bytes each, which should be indexed from
+       their headers alone, with no windows */
+    out = fopen(fname, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "fopen error\n");
+        exit(1);
+    }
+    for (at = 0; at < len; at += block) {
+        PREFIX3(stream) c_stream;
+        PREFIX(gz_header) head;
+        unsigned char extra[6] = {'B', 'C', 2, 0, 0, 0};
+        int err;
+
+        memset(&c_stream, 0, sizeof(c_stream));
+        memset(&head, 0, sizeof(head));
+        head.extra = extra;
+        head.extra_len = sizeof(extra);
+        err = PREFIX(deflateInit2)(&c_stream, 1, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+        CHECK_ERR(err, "deflateInit2");
+        err = PREFIX(deflateSetHeader)(&c_stream, &head);
+        CHECK_ERR(err, "deflateSetHeader");
+        c_stream.next_in = data + at;
+        c_stream.avail_in = block;
+        c_stream.next_out = compr;
+        c_stream.avail_out = 2 * block;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err != Z_STREAM_END || c_stream.total_out > 65536) {
+            fprintf(stderr, "BGZF deflate error: %d\n", err);
+            exit(1);
+        }
+        compr[16] = (unsigned char)(c_stream.total_out - 1);
+        compr[17] = (unsigned char)((c_stream.total_out - 1) >> 8);
+        fwrite(compr, 1, (size_t)c_stream.total_out, out);
+        PREFIX(deflateEnd)(&c_stream);
+    }
+    fclose(out);
+
+    snprintf(mode, sizeof(mode), "rbP4%s", how);
+    file = PREFIX(gzopen)(fname, mode);
+    if (file == NULL || (points = zng_gzindex_build(file, span)) != (int)(len / span) - 1 ||
+        zng_gzindex_save(file, NULL, 0) != 12 + 19 * (size_t)points) {
+        fprintf(stderr, "zng_gzindex_build error on BGZF with \"%s\": %d\n", mode, points);
+        exit(1);
+    }
+    gzindex_read_all(file, data, len, len);
+    gzindex_seeks(file, data, len, len, &x);
+    PREFIX(gzclose)(file);
+
+    free(saved);
+    free(compr);
+    free(data);
+    free(back);
+    printf("zng_gzindex_build() on BGZF with \"%s\": %d points\n", mode, points);
+#endif
+}
+
+/* ===========================================================================
+ * Test writing BGZF members with 'B', alone and with threads, and gzseek()
+ * with the index at the end of the file, read without and with threads
+ */
+void test_gzbgzf(const char *fname)
+{
+#ifdef NO_GZCOMPRESS
+    fprintf(stderr, "NO_GZCOMPRESS -- gz* functions cannot compress\n");
+#else
+    static const unsigned char eof[28] = {31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 66, 67, 2, 0,
+                                          27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    const unsigned int len = 1 << 20, first = 100000;
+    const unsigned int points = (first + 65279) / 65280 + (len - first + 65279) / 65280 - 1;
+    unsigned char *data, *compr, *again;
+    size_t size = 0, got;
+    unsigned int i;
+    uint32_t x = 1;
+    int pass;
+    char mode[8];
+    gzFile file;
+    FILE *in;
+
+    data = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(len);
+    again = (unsigned char *)malloc(len);
+    if (data == NULL || compr == NULL || again == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        x = x * 1103515245 + 12345;
+        data[i] = i >= 64 && (x >> 24) < 192 ? data[i - 1 - (x >> 16) % 64] : (unsigned char)(x >> 16);
+    }
+
+    for (pass = 0; pass < 2; pass++) {
+        snprintf(mode, sizeof(mode), "wb6B%s", pass ? "P4" : "");
+        file = PREFIX(gzopen)(fname, mode);
+        if (file == NULL || PREFIX(gzwrite)(file, data, first) != (int)first ||
+            PREFIX(gzflush)(file, Z_SYNC_FLUSH) != Z_OK ||
+            PREFIX(gzwrite)(file, data + first, len - first) != (int)(len - first) ||
+            PREFIX(gzclose)(file) != Z_OK) {
+            fprintf(stderr, "gzwrite error with \"%s\"\n", mode);
+            exit(1);
+        }
+
+        /* the threads must write the same members, and it must end as BGZF does */
+        in = fopen(fname, "rb");
+        if (in == NULL) {
+            fprintf(stderr, "fopen error\n");
+            exit(1);
+        }
+        got = fread(pass ? again : compr, 1, len, in);
+        fclose(in);
+        if (pass == 0)
+            size = got;
+        if (got != size || got < sizeof(eof) || memcmp(compr + size - sizeof(eof), eof, sizeof(eof)) ||
+            (pass && memcmp(again, compr, size))) {
+            fprintf(stderr, "bad BGZF output with \"%s\"\n", mode);
+            exit(1);
+        }
+
+        /* a seek loads the index from the end, and threads read with it */
+        snprintf(mode, sizeof(mode), "rb%s", pass ? "P4" : "");
+        file = PREFIX(gzopen)(fname, mode);
+        if (file == NULL) {
+            fprintf(stderr, "gzopen error\n");
+            exit(1);
+        }
+        gzindex_seeks(file, data, len, len, &x);
+        if (zng_gzindex_save(file, NULL, 0) != 12 + 19 * (size_t)points) {
+            fprintf(stderr, "no index from the end of the file with \"%s\"\n", mode);
+            exit(1);
+        }
+        gzindex_read_all(file, data, len, len);
+        if (zng_gzindex_build(file, 1) != (int)points) {
+            fprintf(stderr, "zng_gzindex_build error on 'B' output with \"%s\"\n", mode);
+            exit(1);
+        }
+        PREFIX(gzclose)(file);
+    }
+
+    free(again);
+    free(compr);
+    free(data);
+    printf("gzwrite() with \"wb6B\": %lu bytes, %u points\n", (unsigned long)size, points);
+#endif
+}
+
+/* ===========================================================================
+ * Test reading lines with zng_gzpeek() and zng_gzconsume() through a small
+ * buffer, so that lines straddle what is lent, also after gzungetc() and
+ * gzseek()
+ */
+void test_gzpeek(const char *fname)
+{
+#ifdef NO_GZCOMPRESS
+    fprintf(stderr, "NO_GZCOMPRESS -- gz* functions cannot compress\n");
+#else
+    const unsigned char *next;
+    const unsigned char *eol;
+    char line[128], want[128];
+    unsigned int have, n, at, lines, total;
+    gzFile file;
+
+    file = PREFIX(gzopen)(fname, "wb1");
+    if (file == NULL) {
+        fprintf(stderr, "gzopen error\n");
+        exit(1);
+    }
+    for (lines = 0, total = 0; lines < 2000; lines++)
+        total += (unsigned int)PREFIX(gzprintf)(file, "line %u %.*s\n", lines, (int)(lines % 97), hello);
+    PREFIX(gzclose)(file);
+
+    file = PREFIX(gzopen)(fname, "rb");
+    if (file == NULL || PREFIX(gzbuffer)(file, 100) != 0) {
+        fprintf(stderr, "gzopen error\n");
+        exit(1);
+    }
+    lines = 0;
+    at = 0;
+    while ((next = zng_gzpeek(file, &have)) != NULL) {
+        if (have == 0 || have > 200) {
+            fprintf(stderr, "zng_gzpeek error: %u bytes lent\n", have);
+            exit(1);
+        }
+        eol = (const unsigned char *)memchr(next, '\n', have);
+        n = eol == NULL ? have : (unsigned int)(eol - next) + 1;
+        if (at + n >= sizeof(line)) {
+            fprintf(stderr, "zng_gzpeek error: line too long\n");
+            exit(1);
+        }
+        memcpy(line + at, next, n);
+        at += n;
+        if (zng_gzconsume(file, n) != 0) {
+            fprintf(stderr, "zng_gzconsume error\n");
+            exit(1);
+        }
+        if (eol != NULL) {
+            line[at] = 0;
+            snprintf(want, sizeof(want), "line %u %.*s\n", lines, (int)(lines % 97), hello);
+            if (strcmp(line, want)) {
+                fprintf(stderr, "bad zng_gzpeek line: %s", line);
+                exit(1);
+            }
+            lines++;
+            at = 0;
+        }
+    }
+    if (have != 0 || lines != 2000 || at != 0 || !PREFIX(gzeof)(file) ||
+        PREFIX(gztell)(file) != (z_off_t)total) {
+        fprintf(stderr, "zng_gzpeek error at end: %u lines\n", lines);
+        exit(1);
+    }
+
+    /* a pushed back character is lent first, and a seek has to be looked at
+       with zng_gzpeek() before anything is consumed */
+    if (PREFIX(gzungetc)('x', file) != 'x' || (next = zng_gzpeek(file, &have)) == NULL ||
+        have != 1 || next[0] != 'x' || zng_gzconsume(file, 2) != -1 || zng_gzconsume(file, 1) != 0 ||
+        PREFIX(gzseek)(file, 5, SEEK_SET) != 5 || zng_gzconsume(file, 0) != -1 ||
+        (next = zng_gzpeek(file, &have)) == NULL || have == 0 || memcmp(next, "0 \nline 1 h", 11) ||
+        zng_gzconsume(file, 3) != 0 || PREFIX(gzgets)(file, line, sizeof(line)) == NULL ||
+        strcmp(line, "line 1 h\n")) {
+        fprintf(stderr, "zng_gzpeek error after gzungetc() or gzseek()\n");
+        exit(1);
+    }
+    PREFIX(gzclose)(file);
+    printf("zng_gzpeek(): %u lines\n", lines);
+#endif
+}
+
+#ifndef NO_GZCOMPRESS
+/* Make line n of the file for test_gzgetlines(), with the last one not ending
+ * in a newline, and return its length
+ */
+static size_t gzgetlines_make(char *buf, unsigned int n)
+{
+    size_t len;
+
+    if (n == 3000)
+        return (size_t)sprintf(buf, "end");
+    len = (size_t)sprintf(buf, "%u:", n);
+    memset(buf + len, 'a' + n % 26, (n * 37) % 300);
+    len += (n * 37) % 300;
+    buf[len++] = '\n';
+    return len;
+}
+
+struct gzgetlines_state {
+    unsigned int lines;
+    unsigned int stop;
+    z_off_t total;
+};
+
+static int gzgetlines_check(void *opaque, const char *line, size_t len)
+{
+    struct gzgetlines_state *s = (struct gzgetlines_state *)opaque;
+    char want[320];
+
+    if (len != gzgetlines_make(want, s->lines) || memcmp(line, want, len)) {
+        fprintf(stderr, "bad zng_gzgetlines() line %u\n", s->lines);
+        exit(1);
+    }
+    s->lines++;
+    s->total += (z_off_t)len;
+    return s->lines == s->stop ? 7 : 0;
+}
+#endif
+
+/* ===========================================================================
+ * Test zng_gzgetlines() with lines longer than the buffer, stopping in the
+ * middle and going on to the end
+ */
+void test_gzgetlines(const char *fname)
+{
+#ifdef NO_GZCOMPRESS
+    fprintf(stderr, "NO_GZCOMPRESS -- gz* functions cannot compress\n");
+#else
+    struct gzgetlines_state s;
+    char buf[320];
+    unsigned int n;
+    gzFile file;
+
+    file = PREFIX(gzopen)(fname, "wb1");
+    if (file == NULL) {
+        fprintf(stderr, "gzopen error\n");
+        exit(1);
+    }
+    for (n = 0; n <= 3000; n++)
+        PREFIX(gzwrite)(file, buf, (unsigned)gzgetlines_make(buf, n));
+    PREFIX(gzclose)(file);
+
+    file = PREFIX(gzopen)(fname, "rb");
+    if (file == NULL || PREFIX(gzbuffer)(file, 100) != 0) {
+        fprintf(stderr, "gzopen error\n");
+        exit(1);
+    }
+    s.lines = 0;
+    s.stop = 1500;
+    s.total = 0;
+    if (zng_gzgetlines(file, gzgetlines_check, &s) != 7 || s.lines != 1500 ||
+        PREFIX(gztell)(file) != s.total) {
+        fprintf(stderr, "zng_gzgetlines() error stopping: %u lines\n", s.lines);
+        exit(1);
+    }
+    if (zng_gzgetlines(file, gzgetlines_check, &s) != 0 || s.lines != 3001 ||
+        PREFIX(gztell)(file) != s.total || !PREFIX(gzeof)(file) ||
+        zng_gzgetlines(file, gzgetlines_check, &s) != 0 || s.lines != 3001) {
+        fprintf(stderr, "zng_gzgetlines() error at end: %u lines\n", s.lines);
+        exit(1);
+    }
+    PREFIX(gzclose)(file);
+    printf("zng_gzgetlines(): %u lines\n", s.lines);
+#endif
+}
+
+/* ===========================================================================
+ * Test zng_gztest() on a file of two gzip members, from the start and after
+ * some reading, and on the file with its last byte changed and cut short
+ */
+void test_gztest(const char *fname)
+{
+#ifdef NO_GZCOMPRESS
+    fprintf(stderr, "NO_GZCOMPRESS -- gz* functions cannot compress\n");
+#else
+    unsigned char buf[100], *cut;
+    unsigned int n, total;
+    long size;
+    int errnum;
+    gzFile file;
+    FILE *raw;
+
+    file = PREFIX(gzopen)(fname, "wb6");
+    if (file == NULL) {
+        fprintf(stderr, "gzopen error\n");
+        exit(1);
+    }
+    for (n = 0, total = 0; n < 5000; n++) {
+        total += (unsigned int)PREFIX(gzprintf)(file, "line %u %.*s\n", n * 7919 % 10007, (int)(n % 61), hello);
+        if (n == 2000)
+            PREFIX(gzflush)(file, Z_FINISH);
+    }
+    PREFIX(gzclose)(file);
+
+    file = PREFIX(gzopen)(fname, "rb");
+    if (file == NULL || zng_gztest(file) != 0 || PREFIX(gztell)(file) != (z_off_t)total ||
+        !PREFIX(gzeof)(file) || PREFIX(gzrewind)(file) != 0 ||
+        PREFIX(gzread)(file, buf, sizeof(buf)) != (int)sizeof(buf) || zng_gztest(file) != 0 ||
+        PREFIX(gztell)(file) != (z_off_t)total) {
+        fprintf(stderr, "zng_gztest() error on a good file\n");
+        exit(1);
+    }
+    PREFIX(gzclose)(file);
+
+    /* a wrong length in the last trailer, then a member cut short */
+    raw = fopen(fname, "r+b");
+    if (raw == NULL || fseek(raw, -1L, SEEK_END) != 0 || (size = ftell(raw)) <= 0 || fputc(0x55, raw) == EOF) {
+        fprintf(stderr, "cannot change %s\n", fname);
+        exit(1);
+    }
+    fclose(raw);
+    file = PREFIX(gzopen)(fname, "rb");
+    if (file == NULL || zng_gztest(file) != -1 || (PREFIX(gzerror)(file, &errnum), errnum) != Z_DATA_ERROR) {
+        fprintf(stderr, "zng_gztest() error on a wrong trailer\n");
+        exit(1);
+    }
+    PREFIX(gzclose)(file);
+    cut = (unsigned char *)malloc((size_t)size);
+    raw = fopen(fname, "rb");
+    if (cut == NULL || raw == NULL || fread(cut, 1, (size_t)size, raw) != (size_t)size) {
+        fprintf(stderr, "cannot read %s\n", fname);
+        exit(1);
+    }
+    fclose(raw);
+    raw = fopen(fname, "wb");
+    if (raw == NULL || fwrite(cut, 1, (size_t)size / 2, raw) != (size_t)size / 2) {
+        fprintf(stderr, "cannot write %s\n", fname);
+        exit(1);
+    }
+    fclose(raw);
+    free(cut);
+    file = PREFIX(gzopen)(fname, "rb");
+    if (file == NULL || zng_gztest(file) != -1 || (PREFIX(gzerror)(file, &errnum), errnum) != Z_BUF_ERROR) {
+        fprintf(stderr, "zng_gztest() error on a cut file\n");
+        exit(1);
+    }
+    PREFIX(gzclose)(file);
+    printf("zng_gztest(): %u bytes\n", total);
 #endif
+}
+#endif
+
+/* ===========================================================================
+ * Test deflate() with small buffers
+ */
+void test_deflate(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    size_t len = strlen(hello)+1;
 
     c_stream.zalloc = zalloc;
     c_stream.zfree = zfree;
     c_stream.opaque = (void *)0;
+    c_stream.total_in = 0;
+    c_stream.total_out = 0;
 
-    err = PREFIX(deflateInit)(&c_stream, Z_BEST_SPEED);
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
     CHECK_ERR(err, "deflateInit");
 
-    c_stream.next_out = compr;
-    c_stream.avail_out = (unsigned int)comprLen;
+    c_stream.next_in  = (const unsigned char *)hello;
+    c_stream.next_out = compr;
+
+    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
+        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+    }
+    /* Finish the stream, still forcing small buffers: */
+    for (;;) {
+        c_stream.avail_out = 1;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "deflate");
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+}
+
+/* ===========================================================================
+ * Test inflate() with small buffers
+ */
+void test_inflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    int err;
+    PREFIX3(stream) d_stream; /* decompression stream */
+
+    strcpy((char*)uncompr, "garbage");
+
+    d_stream.zalloc = zalloc;
+    d_stream.zfree = zfree;
+    d_stream.opaque = (void *)0;
+
+    d_stream.next_in  = compr;
+    d_stream.avail_in = 0;
+    d_stream.next_out = uncompr;
+    d_stream.total_in = 0;
+    d_stream.total_out = 0;
+
+    err = PREFIX(inflateInit)(&d_stream);
+    CHECK_ERR(err, "inflateInit");
+
+    while (d_stream.total_out < uncomprLen && d_stream.total_in < comprLen) {
+        d_stream.avail_in = d_stream.avail_out = 1; /* force small buffers */
+        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "inflate");
+    }
+
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+
+    if (strcmp((char*)uncompr, hello)) {
+        fprintf(stderr, "bad inflate\n");
+        exit(1);
+    } else {
+        printf("inflate(): %s\n", (char *)uncompr);
+    }
+}
+
+static unsigned int diff;
+
+/* ===========================================================================
+ * Test deflate() with large buffers and dynamic change of compression level
+ */
+void test_large_deflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen, int zng_params)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+#ifndef ZLIB_COMPAT
+    int level = -1;
+    int strategy = -1;
+    zng_deflate_param_value params[] = {
+        { .param = Z_DEFLATE_LEVEL, .buf = &level, .size = sizeof(level) },
+        { .param = Z_DEFLATE_STRATEGY, .buf = &strategy, .size = sizeof(strategy) },
+    };
+#endif
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_BEST_SPEED);
+    CHECK_ERR(err, "deflateInit");
+
+    c_stream.next_out = compr;
+    c_stream.avail_out = (unsigned int)comprLen;
+
+    /* At this point, uncompr is still mostly zeroes, so it should compress
+     * very well:
+     */
+    c_stream.next_in = uncompr;
+    c_stream.avail_in = (unsigned int)uncomprLen;
+    err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+    CHECK_ERR(err, "deflate");
+    if (c_stream.avail_in != 0) {
+        fprintf(stderr, "deflate not greedy\n");
+        exit(1);
+    }
+
+    /* Feed in already compressed data and switch to no compression: */
+    if (zng_params) {
+#ifndef ZLIB_COMPAT
+        zng_deflateGetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
+        if (level != Z_BEST_SPEED) {
+            fprintf(stderr, "Expected compression level Z_BEST_SPEED, got %d\n", level);
+            exit(1);
+        }
+        if (strategy != Z_DEFAULT_STRATEGY) {
+            fprintf(stderr, "Expected compression strategy Z_DEFAULT_STRATEGY, got %d\n", strategy);
+            exit(1);
+        }
+        level = Z_NO_COMPRESSION;
+        strategy = Z_DEFAULT_STRATEGY;
+        zng_deflateSetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
+#else
+        fprintf(stderr, "test_large_deflate() called with zng_params=1 in compat mode\n");
+        exit(1);
+#endif
+    } else {
+        PREFIX(deflateParams)(&c_stream, Z_NO_COMPRESSION, Z_DEFAULT_STRATEGY);
+    }
+    c_stream.next_in = compr;
+    diff = (unsigned int)(c_stream.next_out - compr);
+    c_stream.avail_in = diff;
+    err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+    CHECK_ERR(err, "deflate");
+
+    /* Switch back to compressing mode: */
+    if (zng_params) {
+#ifndef ZLIB_COMPAT
+        level = -1;
+        strategy = -1;
+        zng_deflateGetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
+        if (level != Z_NO_COMPRESSION) {
+            fprintf(stderr, "Expected compression level Z_NO_COMPRESSION, got %d\n", level);
+            exit(1);
+        }
+        if (strategy != Z_DEFAULT_STRATEGY) {
+            fprintf(stderr, "Expected compression strategy Z_DEFAULT_STRATEGY, got %d\n", strategy);
+            exit(1);
+        }
+        level = Z_BEST_COMPRESSION;
+        strategy = Z_FILTERED;
+        zng_deflateSetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
+#else
+        fprintf(stderr, "test_large_deflate() called with zng_params=1 in compat mode\n");
+        exit(1);
+#endif
+    } else {
+        PREFIX(deflateParams)(&c_stream, Z_BEST_COMPRESSION, Z_FILTERED);
+    }
+    c_stream.next_in = uncompr;
+    c_stream.avail_in = (unsigned int)uncomprLen;
+    err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+    CHECK_ERR(err, "deflate");
+
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "deflate should report Z_STREAM_END\n");
+        exit(1);
+    }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+}
+
+/* ===========================================================================
+ * Test inflate() with large buffers
+ */
+void test_large_inflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    int err;
+    PREFIX3(stream) d_stream; /* decompression stream */
+
+    strcpy((char*)uncompr, "garbage");
+
+    d_stream.zalloc = zalloc;
+    d_stream.zfree = zfree;
+    d_stream.opaque = (void *)0;
+
+    d_stream.next_in  = compr;
+    d_stream.avail_in = (unsigned int)comprLen;
+    d_stream.total_in = 0;
+    d_stream.total_out = 0;
+
+    err = PREFIX(inflateInit)(&d_stream);
+    CHECK_ERR(err, "inflateInit");
+
+    for (;;) {
+        d_stream.next_out = uncompr;            /* discard the output */
+        d_stream.avail_out = (unsigned int)uncomprLen;
+        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "large inflate");
+    }
+
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+
+    if (d_stream.total_out != 2*uncomprLen + diff) {
+        fprintf(stderr, "bad large inflate: %zu\n", d_stream.total_out);
+        exit(1);
+    } else {
+        printf("large_inflate(): OK\n");
+    }
+}
+
+/* ===========================================================================
+ * Test deflate() with full flush
+ */
+void test_flush(unsigned char *compr, z_size_t *comprLen)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    unsigned int len = (unsigned int)strlen(hello)+1;
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+
+    c_stream.next_in  = (const unsigned char *)hello;
+    c_stream.next_out = compr;
+    c_stream.avail_in = 3;
+    c_stream.avail_out = (unsigned int)*comprLen;
+    err = PREFIX(deflate)(&c_stream, Z_FULL_FLUSH);
+    CHECK_ERR(err, "deflate");
+
+    compr[3]++; /* force an error in first compressed block */
+    c_stream.avail_in = len - 3;
+
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        CHECK_ERR(err, "deflate");
+    }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    *comprLen = (z_size_t)c_stream.total_out;
+}
+
+/* ===========================================================================
+ * Test inflateSync()
+ */
+void test_sync(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    int err;
+    PREFIX3(stream) d_stream; /* decompression stream */
+
+    strcpy((char*)uncompr, "garbage");
+
+    d_stream.zalloc = zalloc;
+    d_stream.zfree = zfree;
+    d_stream.opaque = (void *)0;
+
+    d_stream.next_in  = compr;
+    d_stream.avail_in = 2; /* just read the zlib header */
+
+    err = PREFIX(inflateInit)(&d_stream);
+    CHECK_ERR(err, "inflateInit");
+
+    d_stream.next_out = uncompr;
+    d_stream.avail_out = (unsigned int)uncomprLen;
+
+    err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+    CHECK_ERR(err, "inflate");
+
+    d_stream.avail_in = (unsigned int)comprLen-2;   /* read all compressed data */
+    err = PREFIX(inflateSync)(&d_stream);           /* but skip the damaged part */
+    CHECK_ERR(err, "inflateSync");
+
+    err = PREFIX(inflate)(&d_stream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "inflate should report Z_STREAM_END\n");
+        exit(1);
+    }
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+
+    printf("after inflateSync(): hel%s\n", (char *)uncompr);
+}
+
+/* ===========================================================================
+ * Test deflate() with preset dictionary
+ */
+void test_dict_deflate(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+    c_stream.adler = 0;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_BEST_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+
+    err = PREFIX(deflateSetDictionary)(&c_stream,
+                (const unsigned char*)dictionary, (int)sizeof(dictionary));
+    CHECK_ERR(err, "deflateSetDictionary");
+
+    dictId = c_stream.adler;
+    c_stream.next_out = compr;
+    c_stream.avail_out = (unsigned int)comprLen;
+
+    c_stream.next_in = (const unsigned char *)hello;
+    c_stream.avail_in = (unsigned int)strlen(hello)+1;
+
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "deflate should report Z_STREAM_END\n");
+        exit(1);
+    }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+}
+
+/* ===========================================================================
+ * Test inflate() with a preset dictionary
+ */
+void test_dict_inflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    int err;
+    PREFIX3(stream) d_stream; /* decompression stream */
+
+    strcpy((char*)uncompr, "garbage garbage garbage");
+
+    d_stream.zalloc = zalloc;
+    d_stream.zfree = zfree;
+    d_stream.opaque = (void *)0;
+    d_stream.adler = 0;
+    d_stream.next_in  = compr;
+    d_stream.avail_in = (unsigned int)comprLen;
+
+    err = PREFIX(inflateInit)(&d_stream);
+    CHECK_ERR(err, "inflateInit");
+
+    d_stream.next_out = uncompr;
+    d_stream.avail_out = (unsigned int)uncomprLen;
+
+    for (;;) {
+        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+        if (err == Z_STREAM_END) break;
+        if (err == Z_NEED_DICT) {
+            if (d_stream.adler != dictId) {
+                fprintf(stderr, "unexpected dictionary");
+                exit(1);
+            }
+            err = PREFIX(inflateSetDictionary)(&d_stream, (const unsigned char*)dictionary,
+                                       (int)sizeof(dictionary));
+        }
+        CHECK_ERR(err, "inflate with dict");
+    }
+
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+
+    if (strncmp((char*)uncompr, hello, sizeof(hello))) {
+        fprintf(stderr, "bad inflate with dict\n");
+        exit(1);
+    } else {
+        printf("inflate with dictionary: %s\n", (char *)uncompr);
+    }
+}
+
+/* ===========================================================================
+ * Test adler32() against a bytewise reference, for lengths and alignments
+ * that exercise the tails and NMAX splitting of the vectorized versions
+ */
+static uint32_t adler32_ref(uint32_t adler, const unsigned char *buf, size_t len)
+{
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+
+    while (len--) {
+        a = (a + *buf++) % 65521;
+        b = (b + a) % 65521;
+    }
+    return a | (b << 16);
+}
+
+void test_adler32(void)
+{
+    static const size_t lens[] = { 0, 1, 15, 16, 31, 32, 33, 63, 64, 65, 100, 5551, 5552, 5553, 5583, 5584,
+                                   5585, 11104, 65536, 100000 };
+    size_t i, j, offset;
+    unsigned char *buf;
+    uint32_t seed = 7;
+
+    buf = (unsigned char *)malloc(100000 + 64);
+    if (buf == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < 100000 + 64; i++) {
+        seed = seed * 1103515245 + 12345;
+        /* mostly 0xff bytes to stress the sum bounds */
+        buf[i] = (seed >> 28) < 12 ? 0xff : (unsigned char)(seed >> 16);
+    }
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        for (offset = 0; offset < 32; offset += 7) {
+            uint32_t start[2] = { 1, 0xfff0fff0 };
+            for (j = 0; j < 2; j++) {
+                uint32_t expect = adler32_ref(start[j], buf + offset, lens[i]);
+                uint32_t got = PREFIX(adler32_z)(start[j], buf + offset, lens[i]);
+                if (got != expect) {
+                    fprintf(stderr, "adler32 mismatch for length %lu: %08x != %08x\n",
+                            (unsigned long)lens[i], (unsigned)got, (unsigned)expect);
+                    exit(1);
+                }
+            }
+        }
+    }
+    printf("adler32(): OK\n");
+    free(buf);
+}
+
+/* ===========================================================================
+ * Test crc32() against a bitwise reference, for lengths and alignments that
+ * exercise the partial blocks of the folding versions
+ */
+static uint32_t crc32_ref(uint32_t crc, const unsigned char *buf, size_t len)
+{
+    int k;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+    }
+    return ~crc;
+}
+
+void test_crc32(void)
+{
+    static const size_t lens[] = { 0, 1, 3, 4, 15, 16, 17, 47, 48, 63, 64, 65, 79, 80, 111, 127, 128, 255,
+                                   256, 257, 319, 511, 512, 1000, 4096, 65536, 100000 };
+    size_t i, j, offset;
+    unsigned char *buf;
+    uint32_t seed = 11;
+
+    buf = (unsigned char *)malloc(100000 + 64);
+    if (buf == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < 100000 + 64; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (unsigned char)(seed >> 16);
+    }
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        for (offset = 0; offset < 32; offset += 5) {
+            uint32_t start[3] = { 0, 0xffffffff, 0x12345678 };
+            for (j = 0; j < 3; j++) {
+                uint32_t expect = crc32_ref(start[j], buf + offset, lens[i]);
+                uint32_t got = (uint32_t)PREFIX(crc32_z)(start[j], buf + offset, lens[i]);
+                if (got != expect) {
+                    fprintf(stderr, "crc32 mismatch for length %lu: %08x != %08x\n",
+                            (unsigned long)lens[i], (unsigned)got, (unsigned)expect);
+                    exit(1);
+                }
+            }
+        }
+    }
+    printf("crc32(): OK\n");
+    free(buf);
+}
+
+/* ===========================================================================
+ * Test that combining the check values of the pieces of a buffer gives the
+ * check value of the whole, for pieces of random and of equal lengths
+ */
+static void crc32_combine_check(const char *what, uint32_t got, uint32_t expect)
+{
+    if (got != expect) {
+        fprintf(stderr, "%s mismatch: %08x != %08x\n", what, (unsigned)got, (unsigned)expect);
+        exit(1);
+    }
+}
+
+void test_crc32_combine(void)
+{
+#define COMBINE_LEN 65536
+#define COMBINE_PIECES 64
+    unsigned char *buf;
+    uint32_t whole, crc, crcs[COMBINE_PIECES], op[32];
+    z_off64_t lens[COMBINE_PIECES], big;
+    size_t i, n, pos;
+    uint32_t seed = 7;
+
+    buf = (unsigned char *)malloc(COMBINE_LEN);
+    if (buf == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < COMBINE_LEN; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (unsigned char)(seed >> 16);
+    }
+    whole = (uint32_t)PREFIX(crc32_z)(0, buf, COMBINE_LEN);
+
+    /* random lengths, some of them zero, and then all the same length */
+    for (n = 0; n < 2; n++) {
+        for (i = 0, pos = 0; i < COMBINE_PIECES; i++) {
+            size_t len = COMBINE_LEN / COMBINE_PIECES;
+
+            if (n == 0) {
+                seed = seed * 1103515245 + 12345;
+                len = i % 7 == 3 ? 0 : (seed >> 16) % (2 * COMBINE_LEN / COMBINE_PIECES);
+                if (len > COMBINE_LEN - pos || i == COMBINE_PIECES - 1)
+                    len = COMBINE_LEN - pos;
+            }
+            lens[i] = (z_off64_t)len;
+            crcs[i] = (uint32_t)PREFIX(crc32_z)(0, buf + pos, len);
+            pos += len;
+        }
+
+        crc = crcs[0];
+        for (i = 1; i < COMBINE_PIECES; i++)
+            crc = (uint32_t)PREFIX(crc32_combine64)(crc, crcs[i], lens[i]);
+        crc32_combine_check("crc32_combine", crc, whole);
+
+        crc = crcs[0];
+        for (i = 1; i < COMBINE_PIECES; i++) {
+            PREFIX(crc32_combine_gen64)(op, lens[i]);
+            crc = (uint32_t)PREFIX(crc32_combine_op)(crc, crcs[i], op);
+        }
+        crc32_combine_check("crc32_combine_op", crc, whole);
+
+#ifndef ZLIB_COMPAT
+        crc = PREFIX(crc32_combine_batch)(0, crcs, lens, COMBINE_PIECES);
+        crc32_combine_check("crc32_combine_batch", crc, whole);
+        crc = PREFIX(crc32_combine_batch)(crcs[0], crcs + 1, lens + 1, COMBINE_PIECES - 1);
+        crc32_combine_check("crc32_combine_batch", crc, whole);
+#endif
+    }
+
+    /* combining must be associative, also for lengths past 32 bits */
+    big = (z_off64_t)1 << 40;
+    crc = (uint32_t)PREFIX(crc32_combine64)(PREFIX(crc32_combine64)(crcs[0], crcs[1], big), crcs[2], big + 3);
+    whole = (uint32_t)PREFIX(crc32_combine64)(crcs[0], PREFIX(crc32_combine64)(crcs[1], crcs[2], big + 3),
+                                                2 * big + 3);
+    crc32_combine_check("crc32_combine64", crc, whole);
+
+    printf("crc32_combine(): OK\n");
+    free(buf);
+#undef COMBINE_LEN
+#undef COMBINE_PIECES
+}
+
+#ifndef ZLIB_COMPAT
+/* ===========================================================================
+ * Test that zng_adler32_parallel() and zng_crc32_parallel() give the check
+ * values of adler32_z() and crc32_z() for any number of threads
+ */
+void test_checksum_parallel(void)
+{
+    static const int threads[] = { 0, 1, 2, 3, 8 };
+    size_t len = 5*1024*1024 + 333, i;
+    unsigned char *buf;
+    uint32_t adler, crc, seed = 3;
+
+    buf = (unsigned char *)malloc(len);
+    if (buf == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (unsigned char)(seed >> 16);
+    }
+    adler = (uint32_t)PREFIX(adler32_z)(0x12345678, buf, len);
+    crc = (uint32_t)PREFIX(crc32_z)(0x12345678, buf, len);
+
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        if (zng_adler32_parallel(0x12345678, buf, len, threads[i]) != adler ||
+            zng_crc32_parallel(0x12345678, buf, len, threads[i]) != crc) {
+            fprintf(stderr, "parallel check value mismatch with %d threads\n", threads[i]);
+            exit(1);
+        }
+    }
+    if (zng_adler32_parallel(0, NULL, 0, 4) != 1 || zng_crc32_parallel(0, NULL, 0, 4) != 0) {
+        fprintf(stderr, "parallel check values should give the initial value for NULL\n");
+        exit(1);
+    }
+    printf("zng_adler32_parallel(), zng_crc32_parallel(): OK\n");
+    free(buf);
+}
+#endif
+
+/* ===========================================================================
+ * Test that the check value is right when inflate() sums the output while
+ * copying it to the window, for output buffers smaller and larger than it
+ */
+void test_inflate_check(void)
+{
+    static const uint32_t chunks[] = { 777, 40000, 0 };
+    PREFIX3(stream) c_stream, d_stream;
+    size_t len = 300000, compr_len = len + len / 8 + 1024;
+    size_t i, j;
+    unsigned char *data, *compr, *uncompr;
+    uint32_t seed = 5;
+    int err, window_bits;
+
+    data = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(compr_len);
+    uncompr = (unsigned char *)malloc(len);
+    if (data == NULL || compr == NULL || uncompr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (i >= 100 && (seed >> 28) < 8) ? data[i - 100] : (unsigned char)(seed >> 16);
+    }
+
+    for (window_bits = MAX_WBITS; window_bits <= MAX_WBITS + 16; window_bits += 16) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit2)(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+        CHECK_ERR(err, "deflateInit2");
+        c_stream.next_in = data;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)compr_len;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        for (j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+            d_stream.zalloc = zalloc;
+            d_stream.zfree = zfree;
+            d_stream.opaque = (void *)0;
+            d_stream.next_in = compr;
+            d_stream.avail_in = (uint32_t)c_stream.total_out;
+            err = PREFIX(inflateInit2)(&d_stream, window_bits);
+            CHECK_ERR(err, "inflateInit2");
+
+            d_stream.next_out = uncompr;
+            do {
+                size_t left = len - d_stream.total_out;
+                d_stream.avail_out = (uint32_t)(chunks[j] && chunks[j] < left ? chunks[j] : left);
+                err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+            } while (err == Z_OK);
+            if (err != Z_STREAM_END) {
+                fprintf(stderr, "inflate with %u byte output buffers failed: %d\n", (unsigned)chunks[j], err);
+                exit(1);
+            }
+            err = PREFIX(inflateEnd)(&d_stream);
+            CHECK_ERR(err, "inflateEnd");
+
+            if (d_stream.total_out != len || memcmp(data, uncompr, len) != 0) {
+                fprintf(stderr, "bad inflate output with %u byte output buffers\n", (unsigned)chunks[j]);
+                exit(1);
+            }
+        }
+    }
+    printf("inflate() check values: OK\n");
+
+    free(data);
+    free(compr);
+    free(uncompr);
+}
+
+/* ===========================================================================
+ * Test deflateBound() with small buffers
+ */
+void test_deflate_bound(void)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    unsigned int len = (unsigned int)strlen(hello)+1;
+    int estimateLen = 0;
+    unsigned char *outBuf = NULL;
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (voidpf)0;
+    c_stream.avail_in = len;
+    c_stream.next_in = (const unsigned char *)hello;
+    c_stream.avail_out = 0;
+    c_stream.next_out = outBuf;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+
+    /* calculate actual output length and update structure */
+    estimateLen = PREFIX(deflateBound)(&c_stream, len);
+    outBuf = malloc(estimateLen);
+
+    if (outBuf != NULL) {
+        /* update zlib configuration */
+        c_stream.avail_out = estimateLen;
+        c_stream.next_out = outBuf;
+
+        /* do the compression */
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err == Z_STREAM_END) {
+            printf("deflateBound(): OK\n");
+        } else {
+            CHECK_ERR(err, "deflate");
+        }
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    free(outBuf);
+}
+
+/* ===========================================================================
+ * Test the exact deflateBound() of levels 0 and 1 on incompressible data with
+ * any windowBits, which has to be enough to finish in one deflate() call
+ */
+void test_deflate_bound_levels(void)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    size_t len = 140000;
+    unsigned char *data, *compr;
+    uint32_t seed = 1;
+    unsigned long bound;
+    size_t i;
+    int err, level, bits;
+
+    data = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(len + len / 8 + 64);
+    if (data == NULL || compr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    /* Bytes that take 9 bits each with the fixed codes */
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (unsigned char)(144 + (seed >> 16) % 112);
+    }
+
+    for (level = 0; level <= 1; level++) {
+        for (bits = 9; bits <= 15; bits++) {
+            c_stream.zalloc = zalloc;
+            c_stream.zfree = zfree;
+            c_stream.opaque = (void *)0;
+            err = PREFIX(deflateInit2)(&c_stream, level, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY);
+            CHECK_ERR(err, "deflateInit2");
+
+            bound = PREFIX(deflateBound)(&c_stream, (unsigned long)len);
+            c_stream.next_in = data;
+            c_stream.avail_in = (uint32_t)len;
+            c_stream.next_out = compr;
+            c_stream.avail_out = (uint32_t)bound;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            if (err != Z_STREAM_END || (level == 0 && c_stream.total_out != bound)) {
+                fprintf(stderr, "deflateBound too small or not exact at level %d, windowBits %d\n", level, bits);
+                exit(1);
+            }
+            err = PREFIX(deflateEnd)(&c_stream);
+            CHECK_ERR(err, "deflateEnd");
+        }
+    }
+    printf("deflateBound() of levels 0 and 1: OK\n");
+
+    free(data);
+    free(compr);
+}
+
+/* ===========================================================================
+ * Test deflateCopy() with small buffers
+ */
+void test_deflate_copy(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream, c_stream_copy; /* compression stream */
+    int err;
+    size_t len = strlen(hello)+1;
+
+    memset(&c_stream, 0, sizeof(c_stream));
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (voidpf)0;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+
+    c_stream.next_in = (const unsigned char *)hello;
+    c_stream.next_out = compr;
+
+    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
+        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+    }
+
+    /* Finish the stream, still forcing small buffers: */
+    for (;;) {
+        c_stream.avail_out = 1;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "deflate");
+    }
+
+    err = PREFIX(deflateCopy)(&c_stream_copy, &c_stream);
+    CHECK_ERR(err, "deflate_copy");
+
+    if (c_stream.state->status == c_stream_copy.state->status) {
+        printf("deflate_copy(): OK\n");
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd original");
+
+    err = PREFIX(deflateEnd)(&c_stream_copy);
+    CHECK_ERR(err, "deflateEnd copy");
+}
+
+/* ===========================================================================
+ * Test deflateGetDictionary() with small buffers
+ */
+void test_deflate_get_dict(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    unsigned char *dictNew = NULL;
+    unsigned int *dictLen;
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (voidpf)0;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_BEST_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+
+    c_stream.next_out = compr;
+    c_stream.avail_out = (uInt)comprLen;
+
+    c_stream.next_in = (const unsigned char *)hello;
+    c_stream.avail_in = (unsigned int)strlen(hello)+1;
+
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "deflate should report Z_STREAM_END\n");
+        exit(1);
+    }
+
+    dictNew = calloc(256, 1);
+    dictLen = (unsigned int *)calloc(4, 1);
+    err = PREFIX(deflateGetDictionary)(&c_stream, dictNew, dictLen);
+
+    CHECK_ERR(err, "deflateGetDictionary");
+    if (err == Z_OK) {
+        printf("deflateGetDictionary(): %s\n", dictNew);
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    free(dictNew);
+    free(dictLen);
+}
+
+/* ===========================================================================
+ * Test deflatePending() with small buffers
+ */
+void test_deflate_pending(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    int *bits = calloc(256, 1);
+    unsigned *ped = calloc(256, 1);
+    size_t len = strlen(hello)+1;
+
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (voidpf)0;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+
+    c_stream.next_in = (const unsigned char *)hello;
+    c_stream.next_out = compr;
+
+    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
+        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+    }
+
+    err = PREFIX(deflatePending)(&c_stream, ped, bits);
+    CHECK_ERR(err, "deflatePending");
+
+    if (*bits >= 0 && *bits <= 7) {
+        printf("deflatePending(): OK\n");
+    } else {
+        printf("deflatePending(): error\n");
+    }
+
+    /* Finish the stream, still forcing small buffers: */
+    for (;;) {
+        c_stream.avail_out = 1;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "deflate");
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    free(bits);
+    free(ped);
+}
+
+/* ===========================================================================
+ * Test deflatePrime() with small buffers
+ */
+void test_deflate_prime(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    int bits = 0;
+    int values = 0;
+    size_t len = strlen(hello)+1;
+
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (voidpf)0;
+
+    // windowBits can also be -8..-15 for raw deflate,The default value is 15
+    err = PREFIX(deflateInit2)(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    CHECK_ERR(err, "deflateInit2");
+
+    err = PREFIX(deflatePrime)(&c_stream, bits,values);
+    CHECK_ERR(err, "deflatePrime");
+
+    if (err == Z_OK) {
+        printf("deflatePrime(): OK\n");
+    }
+
+    c_stream.next_in = (const unsigned char *)hello;
+    c_stream.next_out = compr;
+
+    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
+        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+    }
+
+    /* Finish the stream, still forcing small buffers: */
+    for (;;) {
+        c_stream.avail_out = 1;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "deflate");
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+}
+
+/* ===========================================================================
+ * Test deflateSetHeader() with small buffers
+ */
+void test_deflate_set_header(unsigned char *compr, size_t comprLen)
+{
+    PREFIX(gz_header) *head = calloc(256, 1);
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    size_t len = strlen(hello)+1;
+
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (voidpf)0;
+
+    /* gzip */
+    err = PREFIX(deflateInit2)(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+    CHECK_ERR(err, "deflateInit2");
+
+    head->text = 1;
+    err = PREFIX(deflateSetHeader)(&c_stream, head);
+    CHECK_ERR(err, "deflateSetHeader");
+    if (err == Z_OK) {
+        printf("deflateSetHeader(): OK\n");
+    }
+
+    c_stream.next_in  = (unsigned char *)hello;
+    c_stream.next_out = compr;
+
+    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
+        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+    }
+
+    /* Finish the stream, still forcing small buffers: */
+    for (;;) {
+        c_stream.avail_out = 1;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "deflate");
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    free(head);
+}
+
+/* ===========================================================================
+ * Test deflateTune() with small buffers
+ */
+void test_deflate_tune(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+    int good_length = 3;
+    int max_lazy = 5;
+    int nice_length = 18;
+    int max_chain = 6;
+    size_t len = strlen(hello)+1;
+
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (voidpf)0;
+
+    err = PREFIX(deflateInit)(&c_stream, Z_BEST_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+
+    err = PREFIX(deflateTune)(&c_stream,(uInt)good_length,(uInt)max_lazy,nice_length,(uInt)max_chain);
+    CHECK_ERR(err, "deflateTune");
+    if (err == Z_OK) {
+        printf("deflateTune(): OK\n");
+    }
+
+    c_stream.next_in = (const unsigned char *)hello;
+    c_stream.next_out = compr;
+
+    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
+        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+    }
+
+    /* Finish the stream, still forcing small buffers: */
+    for (;;) {
+        c_stream.avail_out = 1;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err == Z_STREAM_END) break;
+        CHECK_ERR(err, "deflate");
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+}
+
+/* ===========================================================================
+ * Test that deflateReset() after long and short input behaves like a new stream
+ */
+void test_deflate_reset(unsigned char *compr, size_t comprLen)
+{
+    PREFIX3(stream) c_stream, f_stream;
+    size_t lens[] = { 300, 2000, 20000, 40, 0, 5, 3000 };
+    unsigned char *data, *fresh;
+    uint32_t seed = 7;
+    size_t i;
+    int err, level;
+
+    data = (unsigned char *)malloc(lens[2]);
+    fresh = (unsigned char *)malloc(comprLen);
+    if (data == NULL || fresh == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    for (level = 1; level <= 9; level += 4) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, level);
+        CHECK_ERR(err, "deflateInit");
+
+        for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            size_t j;
+            for (j = 0; j < lens[i]; j++) {
+                seed = seed * 1103515245 + 12345;
+                data[j] = (j >= 8 && (seed >> 28) < 10) ? data[j - 1 - ((seed >> 16) & 7)]
+                                                       : (unsigned char)('a' + ((seed >> 16) % 20));
+            }
+
+            f_stream.zalloc = zalloc;
+            f_stream.zfree = zfree;
+            f_stream.opaque = (void *)0;
+            err = PREFIX(deflateInit)(&f_stream, level);
+            CHECK_ERR(err, "deflateInit");
+            f_stream.next_in = data;
+            f_stream.avail_in = (uint32_t)lens[i];
+            f_stream.next_out = fresh;
+            f_stream.avail_out = (uint32_t)comprLen;
+            err = PREFIX(deflate)(&f_stream, Z_FINISH);
+            if (err != Z_STREAM_END) {
+                fprintf(stderr, "deflate should report Z_STREAM_END\n");
+                exit(1);
+            }
+
+            c_stream.next_in = data;
+            c_stream.avail_in = (uint32_t)lens[i];
+            c_stream.next_out = compr;
+            c_stream.avail_out = (uint32_t)comprLen;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            if (err != Z_STREAM_END) {
+                fprintf(stderr, "deflate should report Z_STREAM_END\n");
+                exit(1);
+            }
+
+            if (c_stream.total_out != f_stream.total_out || memcmp(compr, fresh, f_stream.total_out)) {
+                fprintf(stderr, "deflateReset: output differs from a new stream at level %d\n", level);
+                exit(1);
+            }
+            err = PREFIX(deflateEnd)(&f_stream);
+            CHECK_ERR(err, "deflateEnd");
+            err = PREFIX(deflateReset)(&c_stream);
+            CHECK_ERR(err, "deflateReset");
+        }
+
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+    }
+    printf("deflateReset(): OK\n");
+
+    free(data);
+    free(fresh);
+}
+
+/* ===========================================================================
+ * Test inflate() on blocks whose dynamic headers repeat, with a fixed block
+ * and a different header in between, and across inflateReset()
+ */
+void test_table_cache(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_DEFAULT_STRATEGY, Z_FIXED, Z_DEFAULT_STRATEGY,
+                                      Z_HUFFMAN_ONLY, Z_DEFAULT_STRATEGY };
+    PREFIX3(stream) c_stream, d_stream;
+    unsigned char msg[3000];
+    uint32_t seed = 11;
+    size_t i, n = sizeof(strategies) / sizeof(strategies[0]);
+    int err, pass;
+
+    for (i = 0; i < sizeof(msg); i++) {
+        seed = seed * 1103515245 + 12345;
+        msg[i] = i >= 50 && (seed >> 16) % 3 ? msg[i - 50 + (seed >> 24) % 8] : (unsigned char)('a' + (seed >> 16) % 20);
+    }
+    if (uncomprLen < n * sizeof(msg)) {
+        fprintf(stderr, "test_table_cache: buffer too small\n");
+        exit(1);
+    }
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+    c_stream.next_out = compr;
+    c_stream.avail_out = (uint32_t)comprLen;
+    for (i = 0; i < n; i++) {
+        err = PREFIX(deflateParams)(&c_stream, Z_DEFAULT_COMPRESSION, strategies[i]);
+        CHECK_ERR(err, "deflateParams");
+        c_stream.next_in = msg;
+        c_stream.avail_in = sizeof(msg);
+        err = PREFIX(deflate)(&c_stream, i == n - 1 ? Z_FINISH : Z_FULL_FLUSH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+    }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    d_stream.zalloc = zalloc;
+    d_stream.zfree = zfree;
+    d_stream.opaque = (void *)0;
+    d_stream.next_in = compr;
+    d_stream.avail_in = 0;
+    err = PREFIX(inflateInit)(&d_stream);
+    CHECK_ERR(err, "inflateInit");
+    for (pass = 0; pass < 2; pass++) {
+        memset(uncompr, 0, uncomprLen);
+        d_stream.next_in = compr;
+        d_stream.avail_in = (uint32_t)c_stream.total_out;
+        d_stream.next_out = uncompr;
+        d_stream.avail_out = (uint32_t)uncomprLen;
+        err = PREFIX(inflate)(&d_stream, Z_FINISH);
+        if (err != Z_STREAM_END || d_stream.total_out != n * sizeof(msg)) {
+            fprintf(stderr, "inflate of repeated block headers failed: %d\n", err);
+            exit(1);
+        }
+        for (i = 0; i < n; i++) {
+            if (memcmp(uncompr + i * sizeof(msg), msg, sizeof(msg))) {
+                fprintf(stderr, "bad inflate of block %d with a repeated header\n", (int)i);
+                exit(1);
+            }
+        }
+        err = PREFIX(inflateReset)(&d_stream);
+        CHECK_ERR(err, "inflateReset");
+    }
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+    printf("inflate(): repeated block headers ok\n");
+}
+
+#ifndef ZLIB_COMPAT
+/* ===========================================================================
+ * Test zng_deflateParallel() with zlib and gzip wrappers
+ */
+static size_t deflate_parallel(int window_bits, int threads, const unsigned char *in, size_t len,
+                               unsigned char *out, size_t out_len)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+
+    err = PREFIX(deflateInit2)(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    CHECK_ERR(err, "deflateInit2");
+
+    c_stream.next_in = in;
+    c_stream.avail_in = (uint32_t)len;
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)out_len;
+
+    err = zng_deflateParallel(&c_stream, threads, 64*1024);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "zng_deflateParallel should report Z_STREAM_END\n");
+        exit(1);
+    }
+    /* Further calls must see a finished stream */
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "deflate after zng_deflateParallel should report Z_STREAM_END\n");
+        exit(1);
+    }
+
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+    return (size_t)c_stream.total_out;
+}
+
+void test_deflate_parallel(void)
+{
+    PREFIX3(stream) d_stream; /* decompression stream */
+    size_t len = 1024*1024 + 12345;
+    size_t compr_len = len + len / 8 + 1024;
+    size_t i, c1, c4;
+    unsigned char *data, *compr, *compr4, *uncompr;
+    uint32_t seed = 1;
+    int err, window_bits;
+
+    data = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(compr_len);
+    compr4 = (unsigned char *)malloc(compr_len);
+    uncompr = (unsigned char *)malloc(len);
+    if (data == NULL || compr == NULL || compr4 == NULL || uncompr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    /* Semi-compressible data with repeats crossing the chunk boundaries */
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i >= 1000 && (seed >> 28) < 12)
+            data[i] = data[i - 1000];
+        else
+            data[i] = (unsigned char)('a' + ((seed >> 16) % 26));
+    }
+
+    for (window_bits = MAX_WBITS; window_bits <= MAX_WBITS + 16; window_bits += 16) {
+        c1 = deflate_parallel(window_bits, 1, data, len, compr, compr_len);
+        c4 = deflate_parallel(window_bits, 4, data, len, compr4, compr_len);
+        if (c1 != c4 || memcmp(compr, compr4, c1) != 0) {
+            fprintf(stderr, "zng_deflateParallel output depends on thread count\n");
+            exit(1);
+        }
+
+        d_stream.zalloc = zalloc;
+        d_stream.zfree = zfree;
+        d_stream.opaque = (void *)0;
+        d_stream.next_in = compr4;
+        d_stream.avail_in = (uint32_t)c4;
+
+        err = PREFIX(inflateInit2)(&d_stream, window_bits);
+        CHECK_ERR(err, "inflateInit2");
+
+        d_stream.next_out = uncompr;
+        d_stream.avail_out = (uint32_t)len;
+
+        err = PREFIX(inflate)(&d_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "inflate of parallel deflate output failed: %d\n", err);
+            exit(1);
+        }
+        err = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(err, "inflateEnd");
+
+        if (d_stream.total_out != len || memcmp(data, uncompr, len) != 0) {
+            fprintf(stderr, "bad zng_deflateParallel round trip\n");
+            exit(1);
+        }
+    }
+    printf("zng_deflateParallel(): OK\n");
+
+    free(data);
+    free(compr);
+    free(compr4);
+    free(uncompr);
+}
+
+/* ===========================================================================
+ * Test zng_inflateParallel() on streams of dynamic, fixed and sync flushed
+ * blocks, with the zlib, gzip and raw wrappers, and on its fallbacks
+ */
+static int inflate_parallel(int window_bits, const unsigned char *in, size_t in_len, unsigned char *out,
+                            size_t out_len, size_t *total, size_t *left)
+{
+    PREFIX3(stream) d_stream; /* decompression stream */
+    int err, ret;
+
+    d_stream.zalloc = zalloc;
+    d_stream.zfree = zfree;
+    d_stream.opaque = (void *)0;
+    d_stream.next_in = in;
+    d_stream.avail_in = (uint32_t)in_len;
+
+    err = PREFIX(inflateInit2)(&d_stream, window_bits);
+    CHECK_ERR(err, "inflateInit2");
+
+    d_stream.next_out = out;
+    d_stream.avail_out = (uint32_t)out_len;
+    ret = zng_inflateParallel(&d_stream, 4, 32*1024);
+    if (ret == Z_BUF_ERROR && d_stream.avail_out == 0) {
+        /* It must go on as inflate() would with more room */
+        d_stream.avail_out = 1000;
+        ret = PREFIX(inflate)(&d_stream, Z_FINISH);
+    }
+    *total = (size_t)d_stream.total_out;
+    *left = d_stream.avail_in;
+
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+    return ret;
+}
+
+void test_inflate_parallel(void)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    size_t len = 2*1024*1024 + 777;
+    size_t compr_len = len + len / 8 + 1024;
+    size_t i, clen, total, left;
+    unsigned char *data, *compr, *uncompr;
+    uint32_t seed = 7;
+    int err, kind, wrap, window_bits;
+    static const int wraps[3] = { MAX_WBITS, MAX_WBITS + 16, -MAX_WBITS };
+
+    data = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(compr_len);
+    uncompr = (unsigned char *)malloc(len + 1000);
+    if (data == NULL || compr == NULL || uncompr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i >= 20000 && (seed >> 28) < 12)
+            data[i] = data[i - 1 - (seed >> 8) % 20000];
+        else
+            data[i] = (unsigned char)('a' + ((seed >> 16) % 26));
+    }
+
+    /* Level 9, level 1 and zng_deflateParallel() */
+    for (kind = 0; kind < 3; kind++) {
+        for (wrap = 0; wrap < 3; wrap++) {
+            window_bits = wraps[wrap];
+            c_stream.zalloc = zalloc;
+            c_stream.zfree = zfree;
+            c_stream.opaque = (void *)0;
+            err = PREFIX(deflateInit2)(&c_stream, kind == 1 ? 1 : 9, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+            CHECK_ERR(err, "deflateInit2");
+            c_stream.next_in = data;
+            c_stream.avail_in = (uint32_t)len;
+            c_stream.next_out = compr;
+            c_stream.avail_out = (uint32_t)compr_len;
+            err = kind == 2 ? zng_deflateParallel(&c_stream, 2, 256*1024) : PREFIX(deflate)(&c_stream, Z_FINISH);
+            if (err != Z_STREAM_END) {
+                fprintf(stderr, "deflate should report Z_STREAM_END\n");
+                exit(1);
+            }
+            clen = (size_t)c_stream.total_out;
+            err = PREFIX(deflateEnd)(&c_stream);
+            CHECK_ERR(err, "deflateEnd");
+            memcpy(compr + clen, "end", 3);
+
+            err = inflate_parallel(window_bits, compr, clen + 3, uncompr, len + 1000, &total, &left);
+            if (err != Z_STREAM_END || total != len || left != 3 || memcmp(uncompr, data, len)) {
+                fprintf(stderr, "bad zng_inflateParallel round trip (%d, %d): %d\n", kind, window_bits, err);
+                exit(1);
+            }
+            memset(uncompr, 0, len);
+            err = inflate_parallel(window_bits, compr, clen, uncompr, len - 1, &total, &left);
+            if (err != Z_STREAM_END || total != len || memcmp(uncompr, data, len)) {
+                fprintf(stderr, "zng_inflateParallel with too little output failed: %d\n", err);
+                exit(1);
+            }
+            err = inflate_parallel(window_bits, compr, clen - 2000, uncompr, len, &total, &left);
+            if (err != Z_BUF_ERROR) {
+                fprintf(stderr, "zng_inflateParallel of a truncated stream should report Z_BUF_ERROR, not %d\n", err);
+                exit(1);
+            }
+            if (wrap != 2) {
+                compr[clen / 2] ^= 0x20;
+                err = inflate_parallel(window_bits, compr, clen, uncompr, len, &total, &left);
+                if (err != Z_DATA_ERROR) {
+                    fprintf(stderr, "zng_inflateParallel of a damaged stream should report Z_DATA_ERROR, not %d\n",
+                            err);
+                    exit(1);
+                }
+            }
+        }
+    }
+    printf("zng_inflateParallel(): OK\n");
+
+    free(data);
+    free(compr);
+    free(uncompr);
+}
+
+/* ===========================================================================
+ * Test zng_deflateGetStats() at levels 0 and 6
+ */
+void test_deflate_stats(void)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    zng_deflate_stats stats;
+    size_t len = 256*1024;
+    size_t compr_len = len + len / 8 + 1024;
+    unsigned char *data, *compr;
+    uint32_t seed = 1;
+    size_t i;
+    int err, level;
+
+    data = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(compr_len);
+    if (data == NULL || compr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i >= 100 && (seed >> 28) < 12)
+            data[i] = data[i - 100];
+        else
+            data[i] = (unsigned char)('a' + ((seed >> 16) % 26));
+    }
+
+    for (level = 0; level <= 6; level += 6) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+
+        err = PREFIX(deflateInit)(&c_stream, level);
+        CHECK_ERR(err, "deflateInit");
+
+        c_stream.next_in = data;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)compr_len;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+
+        err = zng_deflateGetStats(&c_stream, &stats);
+        if (err == Z_VERSION_ERROR) {
+            if (stats.literals != 0 || stats.stored_blocks != 0) {
+                fprintf(stderr, "zng_deflateGetStats should clear the stats\n");
+                exit(1);
+            }
+            printf("zng_deflateGetStats(): not built in\n");
+            PREFIX(deflateEnd)(&c_stream);
+            break;
+        }
+        CHECK_ERR(err, "zng_deflateGetStats");
+
+        if (level == 0) {
+            if (stats.stored_blocks == 0 || stats.literals != 0 || stats.matches != 0) {
+                fprintf(stderr, "bad zng_deflateGetStats at level 0\n");
+                exit(1);
+            }
+        } else if (stats.fixed_blocks + stats.dynamic_blocks == 0 || stats.matches == 0 ||
+                   stats.literals + stats.match_bytes != len || stats.chain_steps < stats.matches ||
+                   stats.avg_match_length < MIN_MATCH || stats.avg_match_length > MAX_MATCH) {
+            fprintf(stderr, "bad zng_deflateGetStats at level %d\n", level);
+            exit(1);
+        }
+
+        /* Resetting the stream starts the counts over */
+        err = PREFIX(deflateReset)(&c_stream);
+        CHECK_ERR(err, "deflateReset");
+        err = zng_deflateGetStats(&c_stream, &stats);
+        CHECK_ERR(err, "zng_deflateGetStats");
+        if (stats.stored_blocks + stats.fixed_blocks + stats.dynamic_blocks + stats.literals != 0) {
+            fprintf(stderr, "deflateReset should clear the stats\n");
+            exit(1);
+        }
+
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+        if (level == 6)
+            printf("zng_deflateGetStats(): OK\n");
+    }
+
+    free(data);
+    free(compr);
+}
+
+/* ===========================================================================
+ * Test zng_deflateEstimate() on text, random and short input
+ */
+void test_deflate_estimate(void)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    size_t lens[3] = {64*1024, 700*1024, 10};
+    unsigned char *data, *compr;
+    unsigned long bound, estimate;
+    uint32_t seed = 1;
+    size_t i, len;
+    int err, k;
+
+    data = (unsigned char *)malloc(lens[1]);
+    compr = (unsigned char *)malloc(lens[1] + lens[1] / 8 + 1024);
+    if (data == NULL || compr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    for (k = 0; k < 3; k++) {
+        len = lens[k];
+        /* Words with repeats for the text, and all of the bytes for the rest */
+        for (i = 0; i < len; i++) {
+            seed = seed * 1103515245 + 12345;
+            if (k != 0)
+                data[i] = (unsigned char)(seed >> 16);
+            else if (i >= 100 && (seed >> 28) < 12)
+                data[i] = data[i - 100];
+            else
+                data[i] = (unsigned char)('a' + ((seed >> 16) % 26));
+        }
+
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+        CHECK_ERR(err, "deflateInit");
+
+        bound = PREFIX(deflateBound)(&c_stream, (unsigned long)len);
+        estimate = zng_deflateEstimate(&c_stream, data, (unsigned long)len);
+        c_stream.next_in = data;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)bound;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        if (estimate > bound || estimate < c_stream.total_out - c_stream.total_out / 8 ||
+            estimate > c_stream.total_out + c_stream.total_out / 4 + 16) {
+            fprintf(stderr, "zng_deflateEstimate is %lu for %lu bytes of output\n", estimate,
+                    (unsigned long)c_stream.total_out);
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+    }
+
+    if (zng_deflateEstimate(NULL, data, 1000) != PREFIX(deflateBound)(NULL, 1000)) {
+        fprintf(stderr, "zng_deflateEstimate should give the bound for a NULL stream\n");
+        exit(1);
+    }
+    printf("zng_deflateEstimate(): OK\n");
+
+    free(data);
+    free(compr);
+}
+
+/* ===========================================================================
+ * Test zng_deflateInitArena() and zng_inflateInitArena(), reusing one block
+ */
+void test_arena(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    PREFIX3(stream) c_stream, d_stream;
+    size_t d_size = zng_deflateArenaSize(6, MAX_WBITS, 8);
+    size_t i_size = zng_inflateArenaSize(MAX_WBITS);
+    size_t len = strlen(hello)+1;
+    unsigned char *arena;
+    int err, pass;
+
+    if (d_size == 0 || i_size == 0 || zng_deflateArenaSize(6, 16, 8) != 0 ||
+        zng_inflateArenaSize(7) != 0) {
+        fprintf(stderr, "bad arena size\n");
+        exit(1);
+    }
+    arena = (unsigned char *)malloc(d_size > i_size ? d_size : i_size);
+    if (arena == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    /* A block that is too small must not be overrun */
+    err = zng_deflateInitArena(&c_stream, arena, d_size / 2, 6, Z_DEFLATED, MAX_WBITS, 8,
+                               Z_DEFAULT_STRATEGY);
+    if (err != Z_MEM_ERROR) {
+        fprintf(stderr, "zng_deflateInitArena should report Z_MEM_ERROR\n");
+        exit(1);
+    }
+
+    for (pass = 0; pass < 2; pass++) {
+        err = zng_deflateInitArena(&c_stream, arena, d_size, 6, Z_DEFLATED, MAX_WBITS, 8,
+                                   Z_DEFAULT_STRATEGY);
+        CHECK_ERR(err, "zng_deflateInitArena");
+        c_stream.next_in = (const unsigned char *)hello;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)comprLen;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        memset(uncompr, 0, uncomprLen);
+        err = zng_inflateInitArena(&d_stream, arena, i_size, MAX_WBITS);
+        CHECK_ERR(err, "zng_inflateInitArena");
+        d_stream.next_in = compr;
+        d_stream.avail_in = (uint32_t)c_stream.total_out;
+        d_stream.next_out = uncompr;
+        d_stream.avail_out = (uint32_t)uncomprLen;
+        err = PREFIX(inflate)(&d_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "inflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        err = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(err, "inflateEnd");
+
+        if (strcmp((char *)uncompr, hello)) {
+            fprintf(stderr, "bad arena inflate\n");
+            exit(1);
+        }
+    }
+    printf("zng_deflateInitArena(): %s\n", (char *)uncompr);
+
+    free(arena);
+}
+
+/* ===========================================================================
+ * Test zng_stream_pool, checking that reused streams behave like new ones
+ */
+/* ===========================================================================
+ * Test zng_stream_set_numa_node(), with a copy of the stream and with a
+ * symbol buffer too large for the region
+ */
+void test_numa_node(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    zng_stream c_stream, copy;
+    size_t len = strlen(hello)+1, copy_len, back_len;
+    unsigned char *copy_out;
+    int err, pass, lit_bufsize = 1 << 18;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_LIT_BUFSIZE, .buf = &lit_bufsize, .size = sizeof(int) };
+
+    if (zng_stream_set_numa_node(&c_stream, -2) != Z_STREAM_ERROR || zng_stream_set_numa_node(NULL, 0) != Z_STREAM_ERROR) {
+        fprintf(stderr, "bad zng_stream_set_numa_node\n");
+        exit(1);
+    }
+    copy_out = (unsigned char *)malloc(comprLen);
+    if (copy_out == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    /* The node is kept by deflateEnd() for the second pass */
+    err = zng_stream_set_numa_node(&c_stream, -1);
+    CHECK_ERR(err, "zng_stream_set_numa_node");
+    for (pass = 0; pass < 2; pass++) {
+        err = PREFIX(deflateInit)(&c_stream, Z_BEST_COMPRESSION);
+        CHECK_ERR(err, "deflateInit");
+        if (pass == 1) {
+            err = zng_deflateSetParams(&c_stream, &param, 1);
+            CHECK_ERR(err, "zng_deflateSetParams");
+        }
+        c_stream.next_in = (const unsigned char *)hello;
+        c_stream.avail_in = (uint32_t)len / 2;
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)comprLen;
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+
+        err = PREFIX(deflateCopy)(&copy, &c_stream);
+        CHECK_ERR(err, "deflateCopy");
+        copy.next_out = copy_out + (c_stream.next_out - compr);
+        copy.avail_out = c_stream.avail_out;
+        memcpy(copy_out, compr, c_stream.next_out - compr);
+        c_stream.avail_in += (uint32_t)len - (uint32_t)len / 2;
+        copy.avail_in += (uint32_t)len - (uint32_t)len / 2;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        err = PREFIX(deflate)(&copy, Z_FINISH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        copy_len = (size_t)copy.total_out;
+        err = PREFIX(deflateEnd)(&copy);
+        CHECK_ERR(err, "deflateEnd");
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+        if (copy_len != (size_t)c_stream.total_out || memcmp(copy_out, compr, copy_len)) {
+            fprintf(stderr, "deflateCopy on a NUMA node differs\n");
+            exit(1);
+        }
+
+        back_len = uncomprLen;
+        err = PREFIX(uncompress)(uncompr, &back_len, compr, (z_size_t)copy_len);
+        CHECK_ERR(err, "uncompress");
+        if (back_len != len || strcmp((char *)uncompr, hello)) {
+            fprintf(stderr, "bad deflate on a NUMA node\n");
+            exit(1);
+        }
+    }
+    free(copy_out);
+    printf("zng_stream_set_numa_node(): %s\n", (char *)uncompr);
+}
+
+/* ===========================================================================
+ * Test zng_deflateIdle() between the messages of one stream, keeping none of
+ * the window and then all of it
+ */
+void test_deflate_idle(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    static const int levels[] = { 0, 1, 2, 6, 9, 12 };
+    zng_stream c_stream;
+    unsigned char msg[2000];
+    size_t i, back_len, sizes[3];
+    uint32_t seed = 7;
+    int err, l, level, m;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_LEVEL, .buf = &level, .size = sizeof(level) };
+
+    for (i = 0; i < sizeof(msg); i++) {
+        seed = seed * 1103515245 + 12345;
+        msg[i] = (unsigned char)('a' + (seed >> 16) % 26);
+    }
+
+    for (l = 0; l < (int)(sizeof(levels) / sizeof(levels[0])); l++) {
+        level = levels[l];
+        if (level >= 4 && level <= 6 && (PREFIX(zlibCompileFlags)() & (1 << 8)))
+            continue;
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+        CHECK_ERR(err, "deflateInit");
+        err = zng_deflateSetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateSetParams");
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)comprLen;
+
+        /* Not at the end of a block */
+        c_stream.next_in = msg;
+        c_stream.avail_in = 100;
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+        if (zng_deflateIdle(&c_stream, 0) != Z_BUF_ERROR) {
+            fprintf(stderr, "zng_deflateIdle in a block did not fail\n");
+            exit(1);
+        }
+        c_stream.avail_in = sizeof(msg) - 100;
+
+        for (m = 0; m < 3; m++) {
+            i = (size_t)c_stream.total_out;
+            err = PREFIX(deflate)(&c_stream, m == 2 ? Z_FINISH : Z_SYNC_FLUSH);
+            CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+            sizes[m] = (size_t)c_stream.total_out - i;
+            if (m < 2) {
+                err = zng_deflateIdle(&c_stream, m == 0 ? 0 : 32768);
+                CHECK_ERR(err, "zng_deflateIdle");
+                err = zng_deflateIdle(&c_stream, 0);
+                CHECK_ERR(err, "zng_deflateIdle");
+                c_stream.next_in = msg;
+                c_stream.avail_in = sizeof(msg);
+            }
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        /* The message after the whole window was kept refers to it, except
+           where deflate_quick() may hash the window its own way */
+        if (level >= 2 && sizes[2] >= sizes[1] / 2) {
+            fprintf(stderr, "zng_deflateIdle at level %d lost the window: %lu %lu\n", level,
+                    (unsigned long)sizes[1], (unsigned long)sizes[2]);
+            exit(1);
+        }
+        back_len = uncomprLen;
+        err = PREFIX(uncompress)(uncompr, &back_len, compr, (z_size_t)c_stream.total_out);
+        CHECK_ERR(err, "uncompress");
+        for (m = 0; m < 3; m++) {
+            if (back_len != 3 * sizeof(msg) || memcmp(uncompr + m * sizeof(msg), msg, sizeof(msg))) {
+                fprintf(stderr, "bad deflate after zng_deflateIdle at level %d\n", level);
+                exit(1);
+            }
+        }
+    }
+    printf("zng_deflateIdle(): ok\n");
+}
+
+/* ===========================================================================
+ * Test zng_deflateHibernate() and zng_inflateHibernate() between the messages
+ * of a gzip stream, restoring both into other zng_stream structures
+ */
+void test_hibernate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    zng_stream c_stream, d_stream;
+    unsigned char msg[2000], *c_blob, *d_blob;
+    size_t i, c_len, d_len, sizes[3];
+    uint32_t seed = 11;
+    int err, m;
+
+    for (i = 0; i < sizeof(msg); i++) {
+        seed = seed * 1103515245 + 12345;
+        msg[i] = (unsigned char)('a' + (seed >> 16) % 26);
+    }
+    memset(&c_stream, 0, sizeof(c_stream));
+    memset(&d_stream, 0, sizeof(d_stream));
+    err = PREFIX(deflateInit2)(&c_stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+    CHECK_ERR(err, "deflateInit2");
+    err = PREFIX(inflateInit2)(&d_stream, MAX_WBITS + 16);
+    CHECK_ERR(err, "inflateInit2");
+    c_stream.next_out = compr;
+    c_stream.avail_out = (uint32_t)comprLen;
+    d_stream.next_out = uncompr;
+    d_stream.avail_out = (uint32_t)uncomprLen;
+
+    for (m = 0; m < 3; m++) {
+        c_stream.next_in = msg;
+        c_stream.avail_in = sizeof(msg);
+        i = (size_t)c_stream.total_out;
+        if (m == 0) {
+            /* Not at the end of a block */
+            err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+            CHECK_ERR(err, "deflate");
+            c_len = 1 << 16;
+            c_blob = (unsigned char *)malloc(c_len);
+            if (c_blob == NULL) {
+                printf("out of memory\n");
+                exit(1);
+            }
+            if (zng_deflateHibernate(&c_stream, 32768, c_blob, &c_len) != Z_BUF_ERROR) {
+                fprintf(stderr, "zng_deflateHibernate in a block did not fail\n");
+                exit(1);
+            }
+            free(c_blob);
+        }
+        err = PREFIX(deflate)(&c_stream, m == 2 ? Z_FINISH : Z_SYNC_FLUSH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        sizes[m] = (size_t)c_stream.total_out - i;
+        d_stream.next_in = compr + i;
+        d_stream.avail_in = (uint32_t)sizes[m];
+        err = PREFIX(inflate)(&d_stream, Z_SYNC_FLUSH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "inflate");
+        if (d_stream.avail_in != 0 || d_stream.total_out != (m + 1) * sizeof(msg)) {
+            fprintf(stderr, "inflate before hibernating is short\n");
+            exit(1);
+        }
+        if (m == 2)
+            break;
+
+        err = zng_deflateHibernate(&c_stream, 32768, NULL, &c_len);
+        CHECK_ERR(err, "zng_deflateHibernate");
+        err = zng_inflateHibernate(&d_stream, NULL, &d_len);
+        CHECK_ERR(err, "zng_inflateHibernate");
+        c_blob = (unsigned char *)malloc(c_len);
+        d_blob = (unsigned char *)malloc(d_len);
+        if (c_blob == NULL || d_blob == NULL) {
+            printf("out of memory\n");
+            exit(1);
+        }
+        d_len--;
+        if (zng_inflateHibernate(&d_stream, d_blob, &d_len) != Z_BUF_ERROR) {
+            fprintf(stderr, "zng_inflateHibernate into a short blob did not fail\n");
+            exit(1);
+        }
+        d_len++;
+        err = zng_deflateHibernate(&c_stream, 32768, c_blob, &c_len);
+        CHECK_ERR(err, "zng_deflateHibernate");
+        err = zng_inflateHibernate(&d_stream, d_blob, &d_len);
+        CHECK_ERR(err, "zng_inflateHibernate");
+
+        /* Restored into streams that only keep where their output goes */
+        memset(&c_stream, 0xa5, sizeof(c_stream));
+        memset(&d_stream, 0xa5, sizeof(d_stream));
+        c_stream.zalloc = d_stream.zalloc = zalloc;
+        c_stream.zfree = d_stream.zfree = zfree;
+        c_stream.opaque = d_stream.opaque = (void *)0;
+        if (zng_inflateRestore(&d_stream, c_blob, c_len) != Z_DATA_ERROR) {
+            fprintf(stderr, "zng_inflateRestore of a deflate blob did not fail\n");
+            exit(1);
+        }
+        err = zng_deflateRestore(&c_stream, c_blob, c_len);
+        CHECK_ERR(err, "zng_deflateRestore");
+        err = zng_inflateRestore(&d_stream, d_blob, d_len);
+        CHECK_ERR(err, "zng_inflateRestore");
+        free(c_blob);
+        free(d_blob);
+        c_stream.next_out = compr + c_stream.total_out;
+        c_stream.avail_out = (uint32_t)(comprLen - c_stream.total_out);
+        d_stream.next_out = uncompr + d_stream.total_out;
+        d_stream.avail_out = (uint32_t)(uncomprLen - d_stream.total_out);
+    }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+
+    if (sizes[1] >= sizes[0] / 2 || sizes[2] >= sizes[0] / 2) {
+        fprintf(stderr, "zng_deflateHibernate lost the window: %lu %lu %lu\n",
+                (unsigned long)sizes[0], (unsigned long)sizes[1], (unsigned long)sizes[2]);
+        exit(1);
+    }
+    for (m = 0; m < 3; m++) {
+        if (memcmp(uncompr + m * sizeof(msg), msg, sizeof(msg))) {
+            fprintf(stderr, "bad inflate after zng_inflateRestore\n");
+            exit(1);
+        }
+    }
+    printf("zng_deflateHibernate(): ok\n");
+}
+
+/* ===========================================================================
+ * Test zng_deflateSerialize() between the messages of a gzip stream, and
+ * zng_inflateSerialize() after every few bytes of its input
+ */
+void test_serialize(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    zng_stream c_stream, d_stream;
+    unsigned char msg[3000], *blob, *scratch, saved;
+    size_t i, j, len, in_len = 0, blob_size = 70000, reach;
+    uint32_t seed = 5;
+    int err, m, hash_bits = 12, serialized = 0, refused = 0, corrupted = 0;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_HASH_BITS, .buf = &hash_bits, .size = sizeof(int) };
+
+    for (i = 0; i < sizeof(msg); i++) {
+        seed = seed * 1103515245 + 12345;
+        msg[i] = i >= 100 && (seed >> 16) % 3 ? msg[i - 100 + (seed >> 24) % 8] : (unsigned char)('a' + (seed >> 16) % 26);
+    }
+    blob = (unsigned char *)malloc(blob_size);
+    scratch = (unsigned char *)malloc(sizeof(msg));
+    if (blob == NULL || scratch == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+
+    memset(&c_stream, 0, sizeof(c_stream));
+    err = PREFIX(deflateInit2)(&c_stream, 7, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+    CHECK_ERR(err, "deflateInit2");
+    err = zng_deflateSetParams(&c_stream, &param, 1);
+    CHECK_ERR(err, "zng_deflateSetParams");
+    c_stream.next_out = compr;
+    c_stream.avail_out = (uint32_t)comprLen;
+    for (m = 0; m < 3; m++) {
+        c_stream.next_in = msg;
+        c_stream.avail_in = sizeof(msg);
+        err = PREFIX(deflate)(&c_stream, m == 2 ? Z_FINISH : Z_PARTIAL_FLUSH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        if (m == 2)
+            break;
+
+        err = zng_deflateSerialize(&c_stream, NULL, &len);
+        CHECK_ERR(err, "zng_deflateSerialize");
+        if (len > blob_size) {
+            fprintf(stderr, "zng_deflateSerialize is too large: %lu\n", (unsigned long)len);
+            exit(1);
+        }
+        err = zng_deflateSerialize(&c_stream, blob, &len);
+        CHECK_ERR(err, "zng_deflateSerialize");
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err == Z_DATA_ERROR ? Z_OK : err, "deflateEnd");
+
+        memset(&c_stream, 0xa5, sizeof(c_stream));
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        if (zng_deflateDeserialize(&c_stream, blob, len - 1) != Z_DATA_ERROR) {
+            fprintf(stderr, "zng_deflateDeserialize of a short buffer did not fail\n");
+            exit(1);
+        }
+        err = zng_deflateDeserialize(&c_stream, blob, len);
+        CHECK_ERR(err, "zng_deflateDeserialize");
+        hash_bits = 0;
+        err = zng_deflateGetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateGetParams");
+        if (hash_bits != 12) {
+            fprintf(stderr, "zng_deflateDeserialize lost Z_DEFLATE_HASH_BITS\n");
+            exit(1);
+        }
+        c_stream.next_out = compr + c_stream.total_out;
+        c_stream.avail_out = (uint32_t)(comprLen - c_stream.total_out);
+    }
+    len = (size_t)c_stream.total_out;
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    /* Inflate a few bytes at a time, going on each time from a stream
+       deserialized into another structure */
+    memset(&d_stream, 0, sizeof(d_stream));
+    err = PREFIX(inflateInit2)(&d_stream, MAX_WBITS + 16);
+    CHECK_ERR(err, "inflateInit2");
+    d_stream.next_out = uncompr;
+    d_stream.avail_out = (uint32_t)uncomprLen;
+    for (err = Z_OK; err != Z_STREAM_END; ) {
+        d_stream.next_in = compr + in_len;
+        d_stream.avail_in = len - in_len < 7 ? (uint32_t)(len - in_len) : 7;
+        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+        if (err != Z_STREAM_END)
+            CHECK_ERR(err, "inflate");
+        in_len = (size_t)d_stream.total_in;
+
+        i = blob_size;
+        m = zng_inflateSerialize(&d_stream, blob, &i);
+        if (m == Z_BUF_ERROR) {
+            refused++;
+            continue;
+        }
+        CHECK_ERR(m, "zng_inflateSerialize");
+        m = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(m, "inflateEnd");
+
+        /* The blob ends with the sane flag, back, was, the length of the
+           history and the history, which is the output so far up to the
+           window size. The byte before the sane flag is the last code length
+           of a dynamic block, or else a field that cannot be 0xff, so that
+           the blob must be refused with it set to that. Every other byte
+           before the history is also set to 0xff in some of the blobs, which
+           must be refused or go on inflating within the buffers. */
+        reach = d_stream.total_out < 32768 ? (size_t)d_stream.total_out : 32768;
+        if (i >= reach + 14 && blob[i - reach - 4] == (unsigned char)reach &&
+            blob[i - reach - 3] == (unsigned char)(reach >> 8)) {
+            for (j = 0; j < i - reach - 4; j++) {
+                if (j != i - reach - 14 && serialized % 16 != 0)
+                    continue;
+                saved = blob[j];
+                blob[j] = 0xff;
+                memset(&d_stream, 0xa5, sizeof(d_stream));
+                d_stream.zalloc = zalloc;
+                d_stream.zfree = zfree;
+                d_stream.opaque = (void *)0;
+                m = zng_inflateDeserialize(&d_stream, blob, i);
+                if (m == Z_OK) {
+                    if (j == i - reach - 14) {
+                        fprintf(stderr, "zng_inflateDeserialize of a corrupted buffer did not fail\n");
+                        exit(1);
+                    }
+                    d_stream.next_in = compr + in_len;
+                    d_stream.avail_in = (uint32_t)(len - in_len);
+                    d_stream.next_out = scratch;
+                    d_stream.avail_out = sizeof(msg);
+                    (void)PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+                    (void)PREFIX(inflateEnd)(&d_stream);
+                } else if (m != Z_DATA_ERROR && m != Z_VERSION_ERROR) {
+                    CHECK_ERR(m, "zng_inflateDeserialize");
+                }
+                blob[j] = saved;
+            }
+            corrupted++;
+        }
+
+        memset(&d_stream, 0xa5, sizeof(d_stream));
+        d_stream.zalloc = zalloc;
+        d_stream.zfree = zfree;
+        d_stream.opaque = (void *)0;
+        m = zng_inflateDeserialize(&d_stream, blob, i);
+        CHECK_ERR(m, "zng_inflateDeserialize");
+        d_stream.next_out = uncompr + d_stream.total_out;
+        d_stream.avail_out = (uint32_t)(uncomprLen - d_stream.total_out);
+        serialized++;
+    }
+    if (d_stream.total_in != len || d_stream.total_out != 3 * sizeof(msg) || serialized == 0 || corrupted == 0) {
+        fprintf(stderr, "bad inflate after zng_inflateDeserialize\n");
+        exit(1);
+    }
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+    for (m = 0; m < 3; m++) {
+        if (memcmp(uncompr + m * sizeof(msg), msg, sizeof(msg))) {
+            fprintf(stderr, "bad data after zng_inflateDeserialize\n");
+            exit(1);
+        }
+    }
+    free(blob);
+    free(scratch);
+    printf("zng_inflateSerialize(): %d times, %d refused\n", serialized, refused);
+}
+
+void test_copy_shared(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    static const int levels[] = { 1, 9 };
+    zng_stream c_stream, c_copy, c_extra, d_stream, d_copy;
+    unsigned char msg[3000];
+    size_t i, len, start, half = comprLen / 2;
+    uint32_t seed = 9;
+    int err, l;
+
+    for (i = 0; i < sizeof(msg); i++) {
+        seed = seed * 1103515245 + 12345;
+        msg[i] = i >= 100 && (seed >> 16) % 3 ? msg[i - 100 + (seed >> 24) % 8] : (unsigned char)('a' + (seed >> 16) % 26);
+    }
+
+    for (l = 0; l < (int)(sizeof(levels) / sizeof(levels[0])); l++) {
+        /* Fork a stream in the middle of a block, with a copy of the copy that
+           is ended first, and finish the original before the copy */
+        memset(&c_stream, 0, sizeof(c_stream));
+        err = PREFIX(deflateInit)(&c_stream, levels[l]);
+        CHECK_ERR(err, "deflateInit");
+        c_stream.next_in = msg;
+        c_stream.avail_in = sizeof(msg);
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)half;
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
+        start = (size_t)c_stream.total_out;
+        err = zng_deflateCopyShared(&c_copy, &c_stream);
+        CHECK_ERR(err, "zng_deflateCopyShared");
+        err = zng_deflateCopyShared(&c_extra, &c_copy);
+        CHECK_ERR(err, "zng_deflateCopyShared");
+        err = PREFIX(deflateEnd)(&c_extra);
+        CHECK_ERR(err == Z_DATA_ERROR ? Z_OK : err, "deflateEnd");
+
+        c_stream.next_in = msg;
+        c_stream.avail_in = sizeof(msg);
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        c_copy.next_in = msg;
+        c_copy.avail_in = sizeof(msg);
+        c_copy.next_out = compr + half + start;
+        c_copy.avail_out = (uint32_t)(half - start);
+        err = PREFIX(deflate)(&c_copy, Z_FINISH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        len = (size_t)c_stream.total_out;
+        if (c_copy.total_out != len || memcmp(compr + half + start, compr + start, len - start) != 0) {
+            fprintf(stderr, "zng_deflateCopyShared changed the output at level %d\n", levels[l]);
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_copy);
+        CHECK_ERR(err, "deflateEnd");
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        /* Fork an inflate stream with a window in use, and finish both */
+        memset(&d_stream, 0, sizeof(d_stream));
+        err = PREFIX(inflateInit)(&d_stream);
+        CHECK_ERR(err, "inflateInit");
+        d_stream.next_in = compr;
+        d_stream.avail_in = (uint32_t)len;
+        d_stream.next_out = uncompr;
+        d_stream.avail_out = 2000;
+        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "inflate");
+        err = zng_inflateCopyShared(&d_copy, &d_stream);
+        CHECK_ERR(err, "zng_inflateCopyShared");
+        d_copy.next_out = uncompr + uncomprLen / 2;
+        d_copy.avail_out = (uint32_t)(uncomprLen / 2);
+        d_stream.avail_out = (uint32_t)(uncomprLen / 2 - 2000);
+        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "inflate");
+        err = PREFIX(inflate)(&d_copy, Z_NO_FLUSH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "inflate");
+        if (d_stream.total_out != 2 * sizeof(msg) || d_copy.total_out != 2 * sizeof(msg) ||
+            memcmp(uncompr, msg, sizeof(msg)) || memcmp(uncompr + sizeof(msg), msg, sizeof(msg)) ||
+            memcmp(uncompr + uncomprLen / 2, uncompr + 2000, 2 * sizeof(msg) - 2000)) {
+            fprintf(stderr, "bad inflate after zng_inflateCopyShared at level %d\n", levels[l]);
+            exit(1);
+        }
+        err = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(err, "inflateEnd");
+        err = PREFIX(inflateEnd)(&d_copy);
+        CHECK_ERR(err, "inflateEnd");
+    }
+    printf("zng_deflateCopyShared(): ok\n");
+}
+
+void test_stream_pool(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    zng_stream_pool *d_pool, *i_pool;
+    zng_stream *c_stream, *d_stream, *first;
+    size_t len = strlen(hello)+1;
+    unsigned long first_len = 0;
+    int err, pass;
+
+    d_pool = zng_stream_pool_create(ZNG_POOL_DEFLATE, Z_BEST_COMPRESSION, MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    i_pool = zng_stream_pool_create(ZNG_POOL_INFLATE, 0, MAX_WBITS, 0, 0);
+    if (d_pool == NULL || i_pool == NULL ||
+        zng_stream_pool_create(ZNG_POOL_DEFLATE, 13, MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != NULL) {
+        fprintf(stderr, "bad zng_stream_pool_create\n");
+        exit(1);
+    }
+
+    first = zng_stream_pool_get(d_pool);
+    for (pass = 0; pass < 3; pass++) {
+        c_stream = pass == 0 ? first : zng_stream_pool_get(d_pool);
+        if (c_stream == NULL || c_stream != first) {
+            fprintf(stderr, "zng_stream_pool_get should reuse the stream\n");
+            exit(1);
+        }
+        if (pass == 1) {
+            /* Left over by the previous user, must be undone by the pool */
+            err = PREFIX(deflateParams)(c_stream, Z_NO_COMPRESSION, Z_HUFFMAN_ONLY);
+            CHECK_ERR(err, "deflateParams");
+        }
+
+        c_stream->next_in = (const unsigned char *)hello;
+        c_stream->avail_in = (uint32_t)len;
+        c_stream->next_out = compr;
+        c_stream->avail_out = (uint32_t)comprLen;
+        err = PREFIX(deflate)(c_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        if (pass == 0)
+            first_len = (unsigned long)c_stream->total_out;
+        else if (pass == 2 && c_stream->total_out != first_len) {
+            fprintf(stderr, "pooled deflate stream was not reset\n");
+            exit(1);
+        }
+        err = zng_stream_pool_put(d_pool, c_stream);
+        CHECK_ERR(err, "zng_stream_pool_put");
+    }
+
+    d_stream = zng_stream_pool_get(i_pool);
+    for (pass = 0; pass < 2; pass++) {
+        memset(uncompr, 0, uncomprLen);
+        d_stream->next_in = compr;
+        d_stream->avail_in = (uint32_t)first_len;
+        d_stream->next_out = uncompr;
+        d_stream->avail_out = (uint32_t)uncomprLen;
+        err = PREFIX(inflate)(d_stream, Z_FINISH);
+        if (err != Z_STREAM_END || strcmp((char *)uncompr, hello)) {
+            fprintf(stderr, "bad pooled inflate\n");
+            exit(1);
+        }
+        err = zng_stream_pool_put(i_pool, d_stream);
+        CHECK_ERR(err, "zng_stream_pool_put");
+        d_stream = zng_stream_pool_get(i_pool);
+    }
+    zng_stream_pool_put(i_pool, d_stream);
+
+    zng_stream_pool_destroy(d_pool);
+    zng_stream_pool_destroy(i_pool);
+    printf("zng_stream_pool_get(): %s\n", (char *)uncompr);
+}
+/* ===========================================================================
+ * Test zng_deflateSetPreparedDictionary() against deflateSetDictionary(), and
+ * zng_inflateSetPreparedDictionary() on the output
+ */
+static size_t deflate_with_dict(int level, int window_bits, const unsigned char *dict, size_t dict_len,
+                                const zng_deflate_dict *prepared, const unsigned char *in, size_t len,
+                                unsigned char *out, size_t out_len)
+{
+    PREFIX3(stream) c_stream; /* compression stream */
+    int err;
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+
+    err = PREFIX(deflateInit2)(&c_stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY);
+    CHECK_ERR(err, "deflateInit2");
+    if (prepared != NULL) {
+        err = zng_deflateSetPreparedDictionary(&c_stream, prepared);
+        CHECK_ERR(err, "zng_deflateSetPreparedDictionary");
+    } else {
+        err = PREFIX(deflateSetDictionary)(&c_stream, dict, (uint32_t)dict_len);
+        CHECK_ERR(err, "deflateSetDictionary");
+    }
+
+    c_stream.next_in = in;
+    c_stream.avail_in = (uint32_t)len;
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)out_len;
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "deflate should report Z_STREAM_END\n");
+        exit(1);
+    }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+    return (size_t)c_stream.total_out;
+}
+
+void test_prepared_dict(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    PREFIX3(stream) c_stream, d_stream;
+    zng_deflate_dict *prepared;
+    zng_inflate_dict *i_prepared;
+    size_t dict_len = 40000, len = 6000, i, expected, got, piece;
+    unsigned char *dict, *in, *plain;
+    uint32_t seed = 3;
+    int levels[] = { 1, 3, 9 };
+    int li, raw, pass, err;
+
+    dict = (unsigned char *)malloc(dict_len + len);
+    plain = (unsigned char *)malloc(comprLen);
+    if (dict == NULL || plain == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < dict_len + len; i++) {
+        seed = seed * 1103515245 + 12345;
+        dict[i] = (unsigned char)('a' + ((seed >> 16) % 26));
+    }
+    /* Input made of pieces of the end of the dictionary */
+    in = dict + dict_len;
+    for (i = 0; i < len; i += 50)
+        memcpy(in + i, dict + dict_len - 20000 + (i * 7) % 19000, 50);
+
+    for (li = 0; li < (int)(sizeof(levels) / sizeof(levels[0])); li++) {
+        prepared = zng_deflatePrepareDictionary(dict, (uint32_t)dict_len, levels[li], MAX_WBITS, 8);
+        if (prepared == NULL) {
+            fprintf(stderr, "zng_deflatePrepareDictionary failed\n");
+            exit(1);
+        }
+        for (raw = 0; raw < 2; raw++) {
+            int window_bits = raw ? -MAX_WBITS : MAX_WBITS;
+            expected = deflate_with_dict(levels[li], window_bits, dict, dict_len, NULL, in, len, plain, comprLen);
+            got = deflate_with_dict(levels[li], window_bits, NULL, 0, prepared, in, len, compr, comprLen);
+            if (got != expected || memcmp(compr, plain, got)) {
+                fprintf(stderr, "prepared dictionary output differs at level %d\n", levels[li]);
+                exit(1);
+            }
+        }
+
+        /* A stream with other parameters must not take it */
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit2)(&c_stream, levels[li] == 1 ? 2 : 1, Z_DEFLATED, MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        CHECK_ERR(err, "deflateInit2");
+        if (zng_deflateSetPreparedDictionary(&c_stream, prepared) != Z_DATA_ERROR) {
+            fprintf(stderr, "zng_deflateSetPreparedDictionary should report Z_DATA_ERROR\n");
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+        zng_deflateFreePreparedDictionary(prepared);
+    }
+
+    /* The output must inflate with a prepared dictionary, in one go and with
+     * the output in pieces, so that matches also span the window */
+    got = deflate_with_dict(levels[li - 1], MAX_WBITS, dict, dict_len, NULL, in, len, compr, comprLen);
+    i_prepared = zng_inflatePrepareDictionary(dict, (uint32_t)dict_len);
+    if (i_prepared == NULL) {
+        fprintf(stderr, "zng_inflatePrepareDictionary failed\n");
+        exit(1);
+    }
+    for (pass = 0; pass < 2; pass++) {
+        piece = pass ? uncomprLen : 1000;
+        memset(uncompr, 0, uncomprLen);
+        d_stream.zalloc = zalloc;
+        d_stream.zfree = zfree;
+        d_stream.opaque = (void *)0;
+        d_stream.next_in = compr;
+        d_stream.avail_in = (uint32_t)got;
+        err = PREFIX(inflateInit)(&d_stream);
+        CHECK_ERR(err, "inflateInit");
+        do {
+            d_stream.next_out = uncompr + d_stream.total_out;
+            d_stream.avail_out = (uint32_t)piece;
+            err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+            if (err == Z_NEED_DICT)
+                err = zng_inflateSetPreparedDictionary(&d_stream, i_prepared);
+        } while (err == Z_OK && d_stream.total_out + piece <= uncomprLen);
+        if (err != Z_STREAM_END || d_stream.total_out != len || memcmp(uncompr, in, len)) {
+            fprintf(stderr, "bad inflate with prepared dictionary\n");
+            exit(1);
+        }
+        err = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(err, "inflateEnd");
+    }
+    zng_inflateFreePreparedDictionary(i_prepared);
+    printf("zng_deflateSetPreparedDictionary(), zng_inflateSetPreparedDictionary(): OK\n");
+
+    free(dict);
+    free(plain);
+}
+
+/* ===========================================================================
+ * Test deflate with other hash table sizes and hash lengths
+ */
+void test_hash_params(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    PREFIX3(stream) c_stream;
+    static const int settings[][2] = { { 20, 5 }, { 18, 4 }, { 8, 3 }, { 16, 0 } };
+    int levels[] = { 1, 3, 7, 9 };
+    int hash_bits, hash_bytes, li, si, err;
+    size_t len = uncomprLen / 2, i;
+    unsigned char *in;
+    uint32_t seed = 7;
+    zng_deflate_param_value params[] = {
+        { .param = Z_DEFLATE_HASH_BITS, .buf = &hash_bits, .size = sizeof(hash_bits) },
+        { .param = Z_DEFLATE_HASH_BYTES, .buf = &hash_bytes, .size = sizeof(hash_bytes) },
+    };
+
+    in = (unsigned char *)malloc(len);
+    if (in == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
+
+    for (li = 0; li < (int)(sizeof(levels) / sizeof(levels[0])); li++) {
+        for (si = 0; si < (int)(sizeof(settings) / sizeof(settings[0])); si++) {
+            c_stream.zalloc = zalloc;
+            c_stream.zfree = zfree;
+            c_stream.opaque = (void *)0;
+            err = PREFIX(deflateInit)(&c_stream, levels[li]);
+            CHECK_ERR(err, "deflateInit");
+
+            hash_bits = settings[si][0];
+            hash_bytes = settings[si][1];
+            err = zng_deflateSetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
+            CHECK_ERR(err, "zng_deflateSetParams");
+            hash_bits = hash_bytes = -1;
+            err = zng_deflateGetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
+            CHECK_ERR(err, "zng_deflateGetParams");
+            if (hash_bits != settings[si][0] || hash_bytes != settings[si][1]) {
+                fprintf(stderr, "zng_deflateGetParams: got %d and %d\n", hash_bits, hash_bytes);
+                exit(1);
+            }
+
+            c_stream.next_in = in;
+            c_stream.avail_in = (uint32_t)len / 2;
+            c_stream.next_out = compr;
+            c_stream.avail_out = (uint32_t)comprLen;
+            err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+            CHECK_ERR(err, "deflate");
+
+            /* Too late to change the hash table */
+            err = zng_deflateSetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
+            if (err != Z_STREAM_ERROR || params[0].status != Z_STREAM_ERROR || params[1].status != Z_STREAM_ERROR) {
+                fprintf(stderr, "zng_deflateSetParams should fail after input\n");
+                exit(1);
+            }
+
+            c_stream.avail_in = (uint32_t)(len - len / 2);
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            if (err != Z_STREAM_END) {
+                fprintf(stderr, "deflate should report Z_STREAM_END\n");
+                exit(1);
+            }
+            memset(uncompr, 0, uncomprLen);
+            i = uncomprLen;
+            err = PREFIX(uncompress)(uncompr, &i, compr, (z_size_t)c_stream.total_out);
+            CHECK_ERR(err, "uncompress");
+            if (i != len || memcmp(uncompr, in, len)) {
+                fprintf(stderr, "bad round trip with hash bits %d, hash bytes %d\n", settings[si][0],
+                        settings[si][1]);
+                exit(1);
+            }
+            err = PREFIX(deflateEnd)(&c_stream);
+            CHECK_ERR(err, "deflateEnd");
+        }
+    }
+    printf("zng_deflateSetParams() hash parameters: OK\n");
+
+    free(in);
+}
+
+/* ===========================================================================
+ * Test deflate with Z_BUCKET, also switching to and from the hash chains
+ */
+void test_deflate_bucket(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    PREFIX3(stream) c_stream;
+    int levels[] = { 1, 2, 6, 9 };
+    int li, pass, err;
+    size_t len = uncomprLen / 2, i, first_len = 0;
+    unsigned char *in;
+    uint32_t seed = 11;
+
+    in = (unsigned char *)malloc(len);
+    if (in == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
+
+    for (li = 0; li < (int)(sizeof(levels) / sizeof(levels[0])); li++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit2)(&c_stream, levels[li], Z_DEFLATED, MAX_WBITS, 8, Z_BUCKET);
+        CHECK_ERR(err, "deflateInit2");
+
+        /* Pass 0 stays with Z_BUCKET, pass 1 switches halfway through, and
+         * pass 2 repeats pass 0 after a reset, which must give the same output */
+        for (pass = 0; pass < 3; pass++) {
+            c_stream.next_in = in;
+            c_stream.avail_in = (uint32_t)len / 2;
+            c_stream.next_out = compr;
+            c_stream.avail_out = (uint32_t)comprLen;
+            err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+            CHECK_ERR(err, "deflate");
+            c_stream.avail_in += (uint32_t)(len - len / 2);
+            if (pass == 1) {
+                err = PREFIX(deflateParams)(&c_stream, levels[li], Z_DEFAULT_STRATEGY);
+                CHECK_ERR(err, "deflateParams");
+            }
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            if (err != Z_STREAM_END) {
+                fprintf(stderr, "deflate should report Z_STREAM_END\n");
+                exit(1);
+            }
+            if (pass == 0)
+                first_len = c_stream.total_out;
+            else if (pass == 2 && c_stream.total_out != first_len) {
+                fprintf(stderr, "Z_BUCKET output changed after deflateReset\n");
+                exit(1);
+            }
+
+            memset(uncompr, 0, uncomprLen);
+            i = uncomprLen;
+            err = PREFIX(uncompress)(uncompr, &i, compr, (z_size_t)c_stream.total_out);
+            CHECK_ERR(err, "uncompress");
+            if (i != len || memcmp(uncompr, in, len)) {
+                fprintf(stderr, "bad round trip with Z_BUCKET at level %d\n", levels[li]);
+                exit(1);
+            }
+
+            err = PREFIX(deflateReset)(&c_stream);
+            CHECK_ERR(err, "deflateReset");
+            err = PREFIX(deflateParams)(&c_stream, levels[li], Z_BUCKET);
+            CHECK_ERR(err, "deflateParams");
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+    }
+    printf("deflate() with Z_BUCKET: OK\n");
+
+    free(in);
+}
 
-    /* At this point, uncompr is still mostly zeroes, so it should compress
-     * very well:
-     */
-    c_stream.next_in = uncompr;
-    c_stream.avail_in = (unsigned int)uncomprLen;
-    err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
-    CHECK_ERR(err, "deflate");
-    if (c_stream.avail_in != 0) {
-        fprintf(stderr, "deflate not greedy\n");
+/* ===========================================================================
+ * Test the levels above 9, with little output space at a time so that the
+ * parse of a segment is sent over several calls
+ */
+void test_deflate_optimal(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    PREFIX3(stream) c_stream;
+    int level, err;
+    size_t len = uncomprLen / 2, i, level9_len = 0;
+    unsigned char *in;
+    uint32_t seed = 13;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_LEVEL, .buf = &level, .size = sizeof(level) };
+
+    in = (unsigned char *)malloc(len);
+    if (in == NULL) {
+        printf("out of memory\n");
         exit(1);
     }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
-    /* Feed in already compressed data and switch to no compression: */
-    if (zng_params) {
-#ifndef ZLIB_COMPAT
-        zng_deflateGetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
-        if (level != Z_BEST_SPEED) {
-            fprintf(stderr, "Expected compression level Z_BEST_SPEED, got %d\n", level);
+    for (level = 9; level <= 12; level++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, 9);
+        CHECK_ERR(err, "deflateInit");
+        err = zng_deflateSetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateSetParams");
+
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = compr;
+        do {
+            c_stream.avail_out = 100;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        } while (err == Z_OK && c_stream.total_out + 100 <= comprLen);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate at level %d should report Z_STREAM_END\n", level);
             exit(1);
         }
-        if (strategy != Z_DEFAULT_STRATEGY) {
-            fprintf(stderr, "Expected compression strategy Z_DEFAULT_STRATEGY, got %d\n", strategy);
+        if (level == 9)
+            level9_len = c_stream.total_out;
+        else if (c_stream.total_out > level9_len) {
+            fprintf(stderr, "level %d output is larger than level 9: %lu > %lu\n", level,
+                    (unsigned long)c_stream.total_out, (unsigned long)level9_len);
             exit(1);
         }
-        level = Z_NO_COMPRESSION;
-        strategy = Z_DEFAULT_STRATEGY;
-        zng_deflateSetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
-#else
-        fprintf(stderr, "test_large_deflate() called with zng_params=1 in compat mode\n");
+
+        memset(uncompr, 0, uncomprLen);
+        i = uncomprLen;
+        err = PREFIX(uncompress)(uncompr, &i, compr, (z_size_t)c_stream.total_out);
+        CHECK_ERR(err, "uncompress");
+        if (i != len || memcmp(uncompr, in, len)) {
+            fprintf(stderr, "bad round trip at level %d\n", level);
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+    }
+    printf("deflate() at levels 10 to 12: OK\n");
+
+    free(in);
+}
+
+/* ===========================================================================
+ * Test Z_DEFLATE_BLOCK_SPLIT on text followed by random bytes, which should
+ * be given a block of their own
+ */
+void test_block_split(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    PREFIX3(stream) c_stream;
+    int levels[] = { 2, 9 };
+    int li, split, err;
+    size_t len = uncomprLen / 2, i, split_len[2] = { 0, 0 };
+    unsigned char *in;
+    uint32_t seed = 17;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_BLOCK_SPLIT, .buf = &split, .size = sizeof(split) };
+
+    in = (unsigned char *)malloc(len);
+    if (in == NULL) {
+        printf("out of memory\n");
         exit(1);
-#endif
-    } else {
-        PREFIX(deflateParams)(&c_stream, Z_NO_COMPRESSION, Z_DEFAULT_STRATEGY);
     }
-    c_stream.next_in = compr;
-    diff = (unsigned int)(c_stream.next_out - compr);
-    c_stream.avail_in = diff;
-    err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
-    CHECK_ERR(err, "deflate");
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i >= len / 2)
+            in[i] = (unsigned char)(seed >> 24);
+        else
+            in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
-    /* Switch back to compressing mode: */
-    if (zng_params) {
-#ifndef ZLIB_COMPAT
-        level = -1;
-        strategy = -1;
-        zng_deflateGetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
-        if (level != Z_NO_COMPRESSION) {
-            fprintf(stderr, "Expected compression level Z_NO_COMPRESSION, got %d\n", level);
-            exit(1);
+    for (li = 0; li < (int)(sizeof(levels) / sizeof(levels[0])); li++) {
+        for (split = 0; split <= 1; split++) {
+            c_stream.zalloc = zalloc;
+            c_stream.zfree = zfree;
+            c_stream.opaque = (void *)0;
+            err = PREFIX(deflateInit)(&c_stream, levels[li]);
+            CHECK_ERR(err, "deflateInit");
+            err = zng_deflateSetParams(&c_stream, &param, 1);
+            CHECK_ERR(err, "zng_deflateSetParams");
+
+            c_stream.next_in = in;
+            c_stream.avail_in = (uint32_t)len;
+            c_stream.next_out = compr;
+            c_stream.avail_out = (uint32_t)comprLen;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            if (err != Z_STREAM_END) {
+                fprintf(stderr, "deflate should report Z_STREAM_END\n");
+                exit(1);
+            }
+            split_len[split] = c_stream.total_out;
+
+            memset(uncompr, 0, uncomprLen);
+            i = uncomprLen;
+            err = PREFIX(uncompress)(uncompr, &i, compr, (z_size_t)c_stream.total_out);
+            CHECK_ERR(err, "uncompress");
+            if (i != len || memcmp(uncompr, in, len)) {
+                fprintf(stderr, "bad round trip at level %d with Z_DEFLATE_BLOCK_SPLIT %d\n", levels[li], split);
+                exit(1);
+            }
+            err = PREFIX(deflateEnd)(&c_stream);
+            CHECK_ERR(err, "deflateEnd");
         }
-        if (strategy != Z_DEFAULT_STRATEGY) {
-            fprintf(stderr, "Expected compression strategy Z_DEFAULT_STRATEGY, got %d\n", strategy);
+        if (split_len[1] >= split_len[0]) {
+            fprintf(stderr, "block splitting did not help at level %d: %lu >= %lu\n", levels[li],
+                    (unsigned long)split_len[1], (unsigned long)split_len[0]);
             exit(1);
         }
-        level = Z_BEST_COMPRESSION;
-        strategy = Z_FILTERED;
-        zng_deflateSetParams(&c_stream, params, sizeof(params) / sizeof(params[0]));
-#else
-        fprintf(stderr, "test_large_deflate() called with zng_params=1 in compat mode\n");
-        exit(1);
-#endif
-    } else {
-        PREFIX(deflateParams)(&c_stream, Z_BEST_COMPRESSION, Z_FILTERED);
     }
-    c_stream.next_in = uncompr;
-    c_stream.avail_in = (unsigned int)uncomprLen;
-    err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
-    CHECK_ERR(err, "deflate");
 
-    err = PREFIX(deflate)(&c_stream, Z_FINISH);
-    if (err != Z_STREAM_END) {
-        fprintf(stderr, "deflate should report Z_STREAM_END\n");
+    /* Only -1, 0 and 1 are valid */
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+    split = 2;
+    if (zng_deflateSetParams(&c_stream, &param, 1) != Z_STREAM_ERROR || param.status != Z_STREAM_ERROR) {
+        fprintf(stderr, "Z_DEFLATE_BLOCK_SPLIT 2 should be rejected\n");
+        exit(1);
+    }
+    err = zng_deflateGetParams(&c_stream, &param, 1);
+    CHECK_ERR(err, "zng_deflateGetParams");
+    if (split != -1) {
+        fprintf(stderr, "Z_DEFLATE_BLOCK_SPLIT should still be -1, not %d\n", split);
         exit(1);
     }
     err = PREFIX(deflateEnd)(&c_stream);
     CHECK_ERR(err, "deflateEnd");
+
+    printf("Z_DEFLATE_BLOCK_SPLIT: %lu -> %lu bytes\n", (unsigned long)split_len[0], (unsigned long)split_len[1]);
+
+    free(in);
 }
 
 /* ===========================================================================
- * Test inflate() with large buffers
+ * Test Z_DEFLATE_LIT_BUFSIZE with blocks of more than 64K symbols, where
+ * single symbols occur more than 64K times
  */
-void test_large_inflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+void test_lit_bufsize(void)
 {
-    int err;
-    PREFIX3(stream) d_stream; /* decompression stream */
+    PREFIX3(stream) c_stream;
+    int strategies[] = { Z_HUFFMAN_ONLY, Z_DEFAULT_STRATEGY };
+    int si, lit_bufsize, err;
+    size_t len = 300000, out_len = len + len / 8 + 64, i, back_len;
+    unsigned char *in, *out, *back;
+    uint32_t seed = 19;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_LIT_BUFSIZE, .buf = &lit_bufsize, .size = sizeof(lit_bufsize) };
+
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(out_len);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = (seed >> 16) % 4 ? 'a' : (unsigned char)('b' + (seed >> 24) % 2);
+    }
 
-    strcpy((char*)uncompr, "garbage");
+    for (si = 0; si < (int)(sizeof(strategies) / sizeof(strategies[0])); si++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit2)(&c_stream, 2, Z_DEFLATED, MAX_WBITS, 8, strategies[si]);
+        CHECK_ERR(err, "deflateInit2");
+        lit_bufsize = 1 << 18;
+        err = zng_deflateSetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateSetParams");
+        lit_bufsize = 0;
+        err = zng_deflateGetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateGetParams");
+        if (lit_bufsize != 1 << 18) {
+            fprintf(stderr, "Z_DEFLATE_LIT_BUFSIZE should be %d, not %d\n", 1 << 18, lit_bufsize);
+            exit(1);
+        }
 
-    d_stream.zalloc = zalloc;
-    d_stream.zfree = zfree;
-    d_stream.opaque = (void *)0;
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = out;
+        c_stream.avail_out = (uint32_t)out_len;
+        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+        CHECK_ERR(err, "deflate");
 
-    d_stream.next_in  = compr;
-    d_stream.avail_in = (unsigned int)comprLen;
-    d_stream.total_in = 0;
-    d_stream.total_out = 0;
+        /* Too late to change once there is input */
+        lit_bufsize = 1 << 14;
+        if (zng_deflateSetParams(&c_stream, &param, 1) != Z_STREAM_ERROR || param.status != Z_STREAM_ERROR) {
+            fprintf(stderr, "Z_DEFLATE_LIT_BUFSIZE should not change after input\n");
+            exit(1);
+        }
 
-    err = PREFIX(inflateInit)(&d_stream);
-    CHECK_ERR(err, "inflateInit");
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
 
-    for (;;) {
-        d_stream.next_out = uncompr;            /* discard the output */
-        d_stream.avail_out = (unsigned int)uncomprLen;
-        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "large inflate");
-    }
+        /* The literals take 1.25 bits each with codes built from the right counts */
+        if (strategies[si] == Z_HUFFMAN_ONLY && c_stream.total_out > len * 3 / 16) {
+            fprintf(stderr, "Z_DEFLATE_LIT_BUFSIZE gave %lu bytes\n", (unsigned long)c_stream.total_out);
+            exit(1);
+        }
 
-    err = PREFIX(inflateEnd)(&d_stream);
-    CHECK_ERR(err, "inflateEnd");
+        back_len = len;
+        err = PREFIX(uncompress)(back, &back_len, out, (z_size_t)c_stream.total_out);
+        CHECK_ERR(err, "uncompress");
+        if (back_len != len || memcmp(back, in, len)) {
+            fprintf(stderr, "bad round trip with Z_DEFLATE_LIT_BUFSIZE\n");
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+    }
 
-    if (d_stream.total_out != 2*uncomprLen + diff) {
-        fprintf(stderr, "bad large inflate: %zu\n", d_stream.total_out);
+    /* Out of range */
+    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    CHECK_ERR(err, "deflateInit");
+    lit_bufsize = (1 << 18) + 1;
+    if (zng_deflateSetParams(&c_stream, &param, 1) != Z_STREAM_ERROR) {
+        fprintf(stderr, "Z_DEFLATE_LIT_BUFSIZE above the maximum should be rejected\n");
         exit(1);
-    } else {
-        printf("large_inflate(): OK\n");
     }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+
+    printf("Z_DEFLATE_LIT_BUFSIZE: OK\n");
+
+    free(in);
+    free(out);
+    free(back);
 }
 
 /* ===========================================================================
- * Test deflate() with full flush
+ * Test Z_DEFLATE_AUTO_FLUSH with small messages, checking after each one that
+ * inflate can get all but the input since the last flush, and that
+ * Z_PARTIAL_FLUSH per message makes all of each available and is smaller
+ * than Z_SYNC_FLUSH
  */
-void test_flush(unsigned char *compr, z_size_t *comprLen)
+void test_auto_flush(void)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-    unsigned int len = (unsigned int)strlen(hello)+1;
+    PREFIX3(stream) c_stream, d_stream;
+    int auto_flush, pass, err;
+    size_t msg, len, i;
+    unsigned long flushed[2] = { 0, 0 };
+    unsigned char in[150], out[4096], back[8192];
+    uint32_t seed = 5;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_AUTO_FLUSH, .buf = &auto_flush, .size = sizeof(auto_flush) };
+
+    for (pass = 0; pass < 3; pass++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit2)(&c_stream, 9, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        CHECK_ERR(err, "deflateInit2");
+        d_stream.zalloc = zalloc;
+        d_stream.zfree = zfree;
+        d_stream.opaque = (void *)0;
+        d_stream.next_in = NULL;
+        d_stream.avail_in = 0;
+        err = PREFIX(inflateInit2)(&d_stream, -MAX_WBITS);
+        CHECK_ERR(err, "inflateInit2");
+        if (pass == 0) {
+            auto_flush = 1000;
+            err = zng_deflateSetParams(&c_stream, &param, 1);
+            CHECK_ERR(err, "zng_deflateSetParams");
+            auto_flush = 0;
+            err = zng_deflateGetParams(&c_stream, &param, 1);
+            CHECK_ERR(err, "zng_deflateGetParams");
+            if (auto_flush != 1000) {
+                fprintf(stderr, "Z_DEFLATE_AUTO_FLUSH should be 1000, not %d\n", auto_flush);
+                exit(1);
+            }
+        }
 
-    c_stream.zalloc = zalloc;
-    c_stream.zfree = zfree;
-    c_stream.opaque = (void *)0;
+        for (msg = 0; msg < 500; msg++) {
+            len = 20 + msg % 117;
+            for (i = 0; i < len; i++) {
+                seed = seed * 1103515245 + 12345;
+                in[i] = (unsigned char)("abcdefgh \n"[(seed >> 16) % 10]);
+            }
+            c_stream.next_in = in;
+            c_stream.avail_in = (uint32_t)len;
+            c_stream.next_out = out;
+            c_stream.avail_out = sizeof(out);
+            err = PREFIX(deflate)(&c_stream, pass == 0 ? Z_NO_FLUSH : pass == 1 ? Z_PARTIAL_FLUSH : Z_SYNC_FLUSH);
+            CHECK_ERR(err, "deflate");
+            if (c_stream.avail_in != 0 || c_stream.avail_out == 0) {
+                fprintf(stderr, "deflate did not take a message\n");
+                exit(1);
+            }
+
+            d_stream.next_in = out;
+            d_stream.avail_in = (uint32_t)(sizeof(out) - c_stream.avail_out);
+            do {
+                d_stream.next_out = back;
+                d_stream.avail_out = sizeof(back);
+                err = PREFIX(inflate)(&d_stream, Z_SYNC_FLUSH);
+                if (err != Z_OK && err != Z_BUF_ERROR) {
+                    fprintf(stderr, "inflate error %d with Z_DEFLATE_AUTO_FLUSH\n", err);
+                    exit(1);
+                }
+            } while (d_stream.avail_in != 0);
+            if (pass == 0 ? d_stream.total_out + 1000 <= c_stream.total_in : d_stream.total_out != c_stream.total_in) {
+                fprintf(stderr, "only %lu of %lu bytes decompressed after message %lu in pass %d\n",
+                        (unsigned long)d_stream.total_out, (unsigned long)c_stream.total_in, (unsigned long)msg, pass);
+                exit(1);
+            }
+        }
+        if (pass)
+            flushed[pass - 1] = (unsigned long)c_stream.total_out;
+        (void)PREFIX(deflateEnd)(&c_stream);   /* Z_DATA_ERROR, since it was not finished */
+        err = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(err, "inflateEnd");
+    }
+    if (flushed[0] >= flushed[1]) {
+        fprintf(stderr, "Z_PARTIAL_FLUSH gave %lu bytes, Z_SYNC_FLUSH %lu\n", flushed[0], flushed[1]);
+        exit(1);
+    }
 
+    /* Out of range */
     err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
     CHECK_ERR(err, "deflateInit");
+    auto_flush = -1;
+    if (zng_deflateSetParams(&c_stream, &param, 1) != Z_STREAM_ERROR) {
+        fprintf(stderr, "Z_DEFLATE_AUTO_FLUSH below zero should be rejected\n");
+        exit(1);
+    }
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
 
-    c_stream.next_in  = (const unsigned char *)hello;
-    c_stream.next_out = compr;
-    c_stream.avail_in = 3;
-    c_stream.avail_out = (unsigned int)*comprLen;
-    err = PREFIX(deflate)(&c_stream, Z_FULL_FLUSH);
-    CHECK_ERR(err, "deflate");
+    printf("Z_DEFLATE_AUTO_FLUSH: Z_PARTIAL_FLUSH %lu, Z_SYNC_FLUSH %lu bytes\n", flushed[0], flushed[1]);
+}
 
-    compr[3]++; /* force an error in first compressed block */
-    c_stream.avail_in = len - 3;
+/* ===========================================================================
+ * Test level 1 with Z_DEFLATE_QUICK_DYNAMIC off, on, and switched back and
+ * forth between calls with little output space at a time
+ */
+void test_quick_dynamic(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+{
+    PREFIX3(stream) c_stream;
+    int quick_dynamic, pass, err;
+    size_t len = uncomprLen / 2, i, sizes[3];
+    unsigned char *in;
+    uint32_t seed = 13;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_QUICK_DYNAMIC, .buf = &quick_dynamic,
+                                      .size = sizeof(quick_dynamic) };
+
+    in = (unsigned char *)malloc(len);
+    if (in == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
-    err = PREFIX(deflate)(&c_stream, Z_FINISH);
-    if (err != Z_STREAM_END) {
-        CHECK_ERR(err, "deflate");
+    for (pass = 0; pass < 3; pass++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, 1);
+        CHECK_ERR(err, "deflateInit");
+        quick_dynamic = pass != 0;
+        err = zng_deflateSetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateSetParams");
+
+        c_stream.next_in = in;
+        c_stream.next_out = compr;
+        if (pass < 2) {
+            c_stream.avail_in = (uint32_t)len;
+            c_stream.avail_out = (uint32_t)comprLen;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        } else {
+            /* a switch is refused only while a block of fixed codes is open */
+            do {
+                c_stream.avail_in = (uint32_t)(len - c_stream.total_in < 3000 ? len - c_stream.total_in : 3000);
+                c_stream.avail_out = 200;
+                err = PREFIX(deflate)(&c_stream, c_stream.total_in + c_stream.avail_in == len ? Z_FINISH : Z_NO_FLUSH);
+                if (err == Z_STREAM_END)
+                    break;
+                CHECK_ERR(err, "deflate");
+                quick_dynamic = !quick_dynamic;
+                if (zng_deflateSetParams(&c_stream, &param, 1) != Z_OK)
+                    quick_dynamic = !quick_dynamic;
+            } while (c_stream.total_out < comprLen - 200);
+        }
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        sizes[pass] = (size_t)c_stream.total_out;
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        memset(uncompr, 0, uncomprLen);
+        i = uncomprLen;
+        err = PREFIX(uncompress)(uncompr, &i, compr, (z_size_t)sizes[pass]);
+        CHECK_ERR(err, "uncompress");
+        if (i != len || memcmp(uncompr, in, len)) {
+            fprintf(stderr, "bad round trip with Z_DEFLATE_QUICK_DYNAMIC in pass %d\n", pass);
+            exit(1);
+        }
     }
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd");
+    if (sizes[1] > sizes[0]) {
+        fprintf(stderr, "Z_DEFLATE_QUICK_DYNAMIC gave %lu bytes, fixed codes %lu\n",
+                (unsigned long)sizes[1], (unsigned long)sizes[0]);
+        exit(1);
+    }
+    printf("Z_DEFLATE_QUICK_DYNAMIC: %lu bytes, fixed codes %lu\n", (unsigned long)sizes[1], (unsigned long)sizes[0]);
 
-    *comprLen = (z_size_t)c_stream.total_out;
+    free(in);
 }
 
 /* ===========================================================================
- * Test inflateSync()
+ * Compress with each hash function, twice on the same stream so that the
+ * reset clears the hash table with it, and check that the data comes back.
  */
-void test_sync(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+void test_hash_func(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
 {
-    int err;
-    PREFIX3(stream) d_stream; /* decompression stream */
+    static const int levels[2] = { 2, 9 };
+    PREFIX3(stream) c_stream;
+    int hash_func, got, lvl, pass, err;
+    size_t len = uncomprLen / 2, i, size;
+    unsigned char *in;
+    uint32_t seed = 29;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_HASH_FUNC, .buf = &hash_func, .size = sizeof(hash_func) };
+    zng_deflate_param_value get = { .param = Z_DEFLATE_HASH_FUNC, .buf = &got, .size = sizeof(got) };
+
+    in = (unsigned char *)malloc(len);
+    if (in == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 500 && (seed >> 16) % 3 ? in[i - 500 + (seed >> 24) % 32] : (unsigned char)('a' + (seed >> 16) % 16);
+    }
 
-    strcpy((char*)uncompr, "garbage");
+    for (hash_func = Z_HASH_DEFAULT; hash_func <= Z_HASH_ROLLING + 1; hash_func++) {
+        for (lvl = 0; lvl < 2; lvl++) {
+            c_stream.zalloc = zalloc;
+            c_stream.zfree = zfree;
+            c_stream.opaque = (void *)0;
+            err = PREFIX(deflateInit)(&c_stream, levels[lvl]);
+            CHECK_ERR(err, "deflateInit");
+            err = zng_deflateSetParams(&c_stream, &param, 1);
+            if (hash_func > Z_HASH_ROLLING || (hash_func == Z_HASH_CRC && err != Z_OK)) {
+                /* out of range, or no CRC instructions */
+                if (err != Z_STREAM_ERROR || param.status != Z_STREAM_ERROR) {
+                    fprintf(stderr, "Z_DEFLATE_HASH_FUNC %d should be refused\n", hash_func);
+                    exit(1);
+                }
+                PREFIX(deflateEnd)(&c_stream);
+                break;
+            }
+            CHECK_ERR(err, "zng_deflateSetParams");
+            err = zng_deflateGetParams(&c_stream, &get, 1);
+            CHECK_ERR(err, "zng_deflateGetParams");
+            if (got != hash_func) {
+                fprintf(stderr, "Z_DEFLATE_HASH_FUNC reads back %d, not %d\n", got, hash_func);
+                exit(1);
+            }
 
-    d_stream.zalloc = zalloc;
-    d_stream.zfree = zfree;
-    d_stream.opaque = (void *)0;
+            for (pass = 0; pass < 2; pass++) {
+                c_stream.next_in = in + pass * 1000;
+                c_stream.avail_in = (uint32_t)(len - pass * 1000);
+                c_stream.next_out = compr;
+                c_stream.avail_out = (uint32_t)comprLen;
+                err = PREFIX(deflate)(&c_stream, Z_FINISH);
+                if (err != Z_STREAM_END) {
+                    fprintf(stderr, "deflate should report Z_STREAM_END\n");
+                    exit(1);
+                }
+                size = (size_t)c_stream.total_out;
+                if (pass == 0) {
+                    /* the hash cannot change once there is input */
+                    if (zng_deflateSetParams(&c_stream, &param, 1) != Z_STREAM_ERROR) {
+                        fprintf(stderr, "Z_DEFLATE_HASH_FUNC should be refused after input\n");
+                        exit(1);
+                    }
+                    err = PREFIX(deflateReset)(&c_stream);
+                    CHECK_ERR(err, "deflateReset");
+                }
+
+                memset(uncompr, 0, uncomprLen);
+                i = uncomprLen;
+                err = PREFIX(uncompress)(uncompr, &i, compr, (z_size_t)size);
+                CHECK_ERR(err, "uncompress");
+                if (i != len - pass * 1000 || memcmp(uncompr, in + pass * 1000, i)) {
+                    fprintf(stderr, "bad round trip with Z_DEFLATE_HASH_FUNC %d at level %d\n", hash_func,
+                            levels[lvl]);
+                    exit(1);
+                }
+            }
+            err = PREFIX(deflateEnd)(&c_stream);
+            CHECK_ERR(err, "deflateEnd");
+            if (lvl == 0)
+                printf("Z_DEFLATE_HASH_FUNC %d: %lu bytes at level 2\n", hash_func, (unsigned long)size);
+        }
+    }
 
-    d_stream.next_in  = compr;
-    d_stream.avail_in = 2; /* just read the zlib header */
+    free(in);
+}
 
-    err = PREFIX(inflateInit)(&d_stream);
-    CHECK_ERR(err, "inflateInit");
+/* ===========================================================================
+ * Compress random bytes between two pieces of text with Z_DEFLATE_PRESCAN,
+ * with little output space at a time so that deflate() returns in the middle
+ * of the pieces, and check that only the random bytes lose their matches.
+ */
+void test_prescan(void)
+{
+    static const int levels[3] = { 1, 2, 9 };
+    PREFIX3(stream) c_stream;
+    int prescan, lvl, err;
+    size_t piece = 65536, len = 3 * piece, bound, i, sizes[2];
+    unsigned char *in, *out, *back;
+    uint32_t seed = 41;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_PRESCAN, .buf = &prescan, .size = sizeof(prescan) };
+
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i >= piece && i < 2 * piece)
+            in[i] = (unsigned char)(seed >> 24);
+        else
+            in[i] = i % piece >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16]
+                                                          : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
-    d_stream.next_out = uncompr;
-    d_stream.avail_out = (unsigned int)uncomprLen;
+    prescan = 2;
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit)(&c_stream, 1);
+    CHECK_ERR(err, "deflateInit");
+    if (zng_deflateSetParams(&c_stream, &param, 1) != Z_STREAM_ERROR) {
+        fprintf(stderr, "Z_DEFLATE_PRESCAN 2 should be refused\n");
+        exit(1);
+    }
+    PREFIX(deflateEnd)(&c_stream);
+
+    for (lvl = 0; lvl < 3; lvl++) {
+        for (prescan = 0; prescan < 2; prescan++) {
+            err = PREFIX(deflateInit)(&c_stream, levels[lvl]);
+            CHECK_ERR(err, "deflateInit");
+            err = zng_deflateSetParams(&c_stream, &param, 1);
+            CHECK_ERR(err, "zng_deflateSetParams");
+
+            c_stream.next_in = in;
+            c_stream.avail_in = (uint32_t)len;
+            c_stream.next_out = out;
+            do {
+                c_stream.avail_out = (uint32_t)(bound - c_stream.total_out < 1000 ? bound - c_stream.total_out : 1000);
+                err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            } while (err == Z_OK);
+            CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+            sizes[prescan] = (size_t)c_stream.total_out;
+            err = PREFIX(deflateEnd)(&c_stream);
+            CHECK_ERR(err, "deflateEnd");
+
+            memset(back, 0, len);
+            i = len;
+            err = PREFIX(uncompress)(back, &i, out, (z_size_t)sizes[prescan]);
+            CHECK_ERR(err, "uncompress");
+            if (i != len || memcmp(back, in, len)) {
+                fprintf(stderr, "bad round trip with Z_DEFLATE_PRESCAN %d at level %d\n", prescan, levels[lvl]);
+                exit(1);
+            }
+        }
+        if (sizes[1] > sizes[0] + sizes[0] / 100) {
+            fprintf(stderr, "Z_DEFLATE_PRESCAN gave %lu bytes at level %d, without it %lu\n",
+                    (unsigned long)sizes[1], levels[lvl], (unsigned long)sizes[0]);
+            exit(1);
+        }
+        if (lvl == 2)
+            printf("Z_DEFLATE_PRESCAN: %lu bytes at level 9, without it %lu\n", (unsigned long)sizes[1],
+                   (unsigned long)sizes[0]);
+    }
 
-    err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
-    CHECK_ERR(err, "inflate");
+    free(in);
+    free(out);
+    free(back);
+}
 
-    d_stream.avail_in = (unsigned int)comprLen-2;   /* read all compressed data */
-    err = PREFIX(inflateSync)(&d_stream);           /* but skip the damaged part */
-    CHECK_ERR(err, "inflateSync");
+/* ===========================================================================
+ * Test Z_RLE on runs of every length up to past MAX_MATCH, each ending on a
+ * different byte, so that the run search stops at every offset of a vector.
+ */
+void test_rle(void)
+{
+    PREFIX3(stream) c_stream;
+    int err;
+    size_t len = 0, bound, i, run;
+    unsigned char *in, *out, *back;
+    size_t back_len;
+
+    for (run = 1; run <= 300; run++)
+        len += run;
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (run = 1, i = 0; run <= 300; run++) {
+        memset(in + i, (int)(run * 7 % 251), run);
+        i += run;
+    }
+
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit2)(&c_stream, 9, Z_DEFLATED, MAX_WBITS, 8, Z_RLE);
+    CHECK_ERR(err, "deflateInit2");
+    c_stream.next_in = in;
+    c_stream.avail_in = (uint32_t)len;
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)bound;
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
 
-    err = PREFIX(inflate)(&d_stream, Z_FINISH);
-    if (err != Z_STREAM_END) {
-        fprintf(stderr, "inflate should report Z_STREAM_END\n");
+    /* Every run costs a literal and a match or two, far less than its length */
+    if (c_stream.total_out > len / 20) {
+        fprintf(stderr, "Z_RLE gave %lu bytes for %lu bytes of runs\n", (unsigned long)c_stream.total_out,
+                (unsigned long)len);
         exit(1);
     }
-    err = PREFIX(inflateEnd)(&d_stream);
-    CHECK_ERR(err, "inflateEnd");
+    back_len = len;
+    err = PREFIX(uncompress)(back, &back_len, out, (z_size_t)c_stream.total_out);
+    CHECK_ERR(err, "uncompress");
+    if (back_len != len || memcmp(back, in, len)) {
+        fprintf(stderr, "bad round trip with Z_RLE\n");
+        exit(1);
+    }
+    printf("Z_RLE: %lu bytes for %lu bytes of runs\n", (unsigned long)c_stream.total_out, (unsigned long)len);
 
-    printf("after inflateSync(): hel%s\n", (char *)uncompr);
+    free(in);
+    free(out);
+    free(back);
 }
 
 /* ===========================================================================
- * Test deflate() with preset dictionary
+ * Compress at levels 4 to 6 with Z_DEFLATE_PIPELINE, which must give the same
+ * stream as without it when next_out has room for all of it, and also when
+ * deflate() runs out of room now and then, with or without a deflateCopy()
+ * half way.
  */
-void test_dict_deflate(unsigned char *compr, size_t comprLen)
+void test_pipeline(void)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
+    PREFIX3(stream) c_stream, copy;
+    int pipeline, lvl, err;
+    size_t len = 300000, bound, i, sizes[2], lens[2];
+    unsigned char *in, *out, *back;
+    unsigned char *outs[2];
+    uint32_t seed = 29;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_PIPELINE, .buf = &pipeline, .size = sizeof(pipeline) };
+
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(3 * bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
+    pipeline = 2;
     c_stream.zalloc = zalloc;
     c_stream.zfree = zfree;
     c_stream.opaque = (void *)0;
-    c_stream.adler = 0;
-
-    err = PREFIX(deflateInit)(&c_stream, Z_BEST_COMPRESSION);
+    err = PREFIX(deflateInit)(&c_stream, 6);
     CHECK_ERR(err, "deflateInit");
+    if (zng_deflateSetParams(&c_stream, &param, 1) != Z_STREAM_ERROR) {
+        fprintf(stderr, "Z_DEFLATE_PIPELINE 2 should be refused\n");
+        exit(1);
+    }
+    PREFIX(deflateEnd)(&c_stream);
+
+    /* Levels 4 to 6 do not pass their own checks in debug builds */
+    if (PREFIX(zlibCompileFlags)() & (1 << 8)) {
+        printf("Z_DEFLATE_PIPELINE: skipped in debug builds\n");
+        free(in);
+        free(out);
+        free(back);
+        return;
+    }
 
-    err = PREFIX(deflateSetDictionary)(&c_stream,
-                (const unsigned char*)dictionary, (int)sizeof(dictionary));
-    CHECK_ERR(err, "deflateSetDictionary");
+    for (lvl = 4; lvl <= 6; lvl++) {
+        for (pipeline = 0; pipeline < 2; pipeline++) {
+            err = PREFIX(deflateInit)(&c_stream, lvl);
+            CHECK_ERR(err, "deflateInit");
+            err = zng_deflateSetParams(&c_stream, &param, 1);
+            CHECK_ERR(err, "zng_deflateSetParams");
+            c_stream.next_in = in;
+            c_stream.avail_in = (uint32_t)len;
+            c_stream.next_out = out + pipeline * bound;
+            c_stream.avail_out = (uint32_t)bound;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+            sizes[pipeline] = (size_t)c_stream.total_out;
+            err = PREFIX(deflateEnd)(&c_stream);
+            CHECK_ERR(err, "deflateEnd");
+        }
+        if (sizes[0] != sizes[1] || memcmp(out, out + bound, sizes[0])) {
+            fprintf(stderr, "Z_DEFLATE_PIPELINE changed the output at level %d\n", lvl);
+            exit(1);
+        }
 
-    dictId = c_stream.adler;
-    c_stream.next_out = compr;
-    c_stream.avail_out = (unsigned int)comprLen;
+        /* Little room at a time, with a copy taken half way finishing on its own */
+        pipeline = 1;
+        err = PREFIX(deflateInit)(&c_stream, lvl);
+        CHECK_ERR(err, "deflateInit");
+        err = zng_deflateSetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateSetParams");
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = out;
+        while (c_stream.total_out < sizes[0] / 2) {
+            c_stream.avail_out = 1000;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+            CHECK_ERR(err, "deflate");
+        }
+        err = PREFIX(deflateCopy)(&copy, &c_stream);
+        CHECK_ERR(err, "deflateCopy");
+        memcpy(out + 2 * bound, out, (size_t)c_stream.total_out);
+        copy.next_out = out + 2 * bound + copy.total_out;
+        outs[0] = out;
+        outs[1] = out + 2 * bound;
+        for (i = 0; i < 2; i++) {
+            PREFIX3(stream) *strm = i ? &copy : &c_stream;
+
+            do {
+                strm->avail_out = 1000;
+                err = PREFIX(deflate)(strm, Z_FINISH);
+            } while (err == Z_OK);
+            CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+            lens[i] = (size_t)strm->total_out;
+            err = PREFIX(deflateEnd)(strm);
+            CHECK_ERR(err, "deflateEnd");
+        }
+        for (i = 0; i < 2; i++) {
+            size_t back_len = len;
 
-    c_stream.next_in = (const unsigned char *)hello;
-    c_stream.avail_in = (unsigned int)strlen(hello)+1;
+            err = PREFIX(uncompress)(back, &back_len, outs[i], (z_size_t)lens[i]);
+            CHECK_ERR(err, "uncompress");
+            if (back_len != len || memcmp(back, in, len)) {
+                fprintf(stderr, "bad round trip with Z_DEFLATE_PIPELINE at level %d\n", lvl);
+                exit(1);
+            }
+        }
+        for (i = 0; i < 2; i++) {
+            if (lens[i] != sizes[1] || memcmp(outs[i], out + bound, sizes[1])) {
+                fprintf(stderr, "Z_DEFLATE_PIPELINE gave %lu bytes at level %d with little room, %lu with room for all\n",
+                        (unsigned long)lens[i], lvl, (unsigned long)sizes[1]);
+                exit(1);
+            }
+        }
+    }
+    printf("Z_DEFLATE_PIPELINE: %lu bytes at level 6\n", (unsigned long)sizes[0]);
+
+    free(in);
+    free(out);
+    free(back);
+}
+
+/* ===========================================================================
+ * Compress len bytes of in as raw deflate data at level with the given
+ * parameters, and return the length written to out.
+ */
+static size_t deflate_raw_with(int level, zng_deflate_param_value *params, size_t count, unsigned char *in,
+                               size_t len, unsigned char *out, size_t out_len) {
+    PREFIX3(stream) c_stream;
+    int err;
 
+    c_stream.zalloc = zalloc;
+    c_stream.zfree = zfree;
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit2)(&c_stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    CHECK_ERR(err, "deflateInit2");
+    err = zng_deflateSetParams(&c_stream, params, count);
+    CHECK_ERR(err, "zng_deflateSetParams");
+    c_stream.next_in = in;
+    c_stream.avail_in = (uint32_t)len;
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)out_len;
     err = PREFIX(deflate)(&c_stream, Z_FINISH);
-    if (err != Z_STREAM_END) {
-        fprintf(stderr, "deflate should report Z_STREAM_END\n");
-        exit(1);
-    }
+    CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
     err = PREFIX(deflateEnd)(&c_stream);
     CHECK_ERR(err, "deflateEnd");
+    return (size_t)c_stream.total_out;
 }
 
 /* ===========================================================================
- * Test inflate() with a preset dictionary
+ * Compress data of two letters at random, where every search runs out the
+ * hash chain, so that deflate() follows shorter chains for it. The streams
+ * must still decompress, and Z_DEFLATE_MAX_CHAIN must read back as it was set.
  */
-void test_dict_inflate(unsigned char *compr, size_t comprLen, unsigned char *uncompr, size_t uncomprLen)
+void test_chain_guard(void)
 {
-    int err;
-    PREFIX3(stream) d_stream; /* decompression stream */
-
-    strcpy((char*)uncompr, "garbage garbage garbage");
-
-    d_stream.zalloc = zalloc;
-    d_stream.zfree = zfree;
-    d_stream.opaque = (void *)0;
-    d_stream.adler = 0;
-    d_stream.next_in  = compr;
-    d_stream.avail_in = (unsigned int)comprLen;
-
-    err = PREFIX(inflateInit)(&d_stream);
-    CHECK_ERR(err, "inflateInit");
-
-    d_stream.next_out = uncompr;
-    d_stream.avail_out = (unsigned int)uncomprLen;
+    PREFIX3(stream) c_stream;
+    size_t len = 256 * 1024, bound, i, back_len;
+    unsigned char *in, *out, *back;
+    int level, max_chain = 0, err;
+    uint32_t seed = 5;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_MAX_CHAIN, .buf = &max_chain, .size = sizeof(max_chain) };
+
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = (unsigned char)('a' + (seed >> 16) % 2);
+    }
 
-    for (;;) {
-        err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
-        if (err == Z_STREAM_END) break;
-        if (err == Z_NEED_DICT) {
-            if (d_stream.adler != dictId) {
-                fprintf(stderr, "unexpected dictionary");
-                exit(1);
-            }
-            err = PREFIX(inflateSetDictionary)(&d_stream, (const unsigned char*)dictionary,
-                                       (int)sizeof(dictionary));
+    for (level = 4; level <= 9; level++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, level);
+        CHECK_ERR(err, "deflateInit");
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = out;
+        c_stream.avail_out = (uint32_t)bound;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        err = zng_deflateGetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateGetParams");
+        if (level == 9 && max_chain != 4096) {
+            fprintf(stderr, "Z_DEFLATE_MAX_CHAIN read back %d at level 9\n", max_chain);
+            exit(1);
         }
-        CHECK_ERR(err, "inflate with dict");
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        back_len = len;
+        err = PREFIX(uncompress)(back, &back_len, out, (z_size_t)c_stream.total_out);
+        CHECK_ERR(err, "uncompress");
+        if (back_len != len || memcmp(back, in, len)) {
+            fprintf(stderr, "bad round trip of long chains at level %d\n", level);
+            exit(1);
+        }
+        if (level == 9)
+            printf("long hash chains: %lu bytes at level 9\n", (unsigned long)c_stream.total_out);
     }
 
-    err = PREFIX(inflateEnd)(&d_stream);
-    CHECK_ERR(err, "inflateEnd");
-
-    if (strncmp((char*)uncompr, hello, sizeof(hello))) {
-        fprintf(stderr, "bad inflate with dict\n");
-        exit(1);
-    } else {
-        printf("inflate with dictionary: %s\n", (char *)uncompr);
-    }
+    free(in);
+    free(out);
+    free(back);
 }
 
 /* ===========================================================================
- * Test deflateBound() with small buffers
+ * Set the search limits and the match search of a level, which must read
+ * back and give the same stream as the level that has them in its own
+ * configuration, and be refused out of range or in the middle of the input.
  */
-void test_deflate_bound(void)
+void test_search_params(void)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-    unsigned int len = (unsigned int)strlen(hello)+1;
-    int estimateLen = 0;
-    unsigned char *outBuf = NULL;
+    /* good, lazy, nice, chain and search of levels 6 and 7 */
+    static const int table[2][5] = { { 8, 16, 128, 128, Z_SEARCH_MEDIUM }, { 8, 32, 128, 256, Z_SEARCH_LAZY } };
+    static const zng_deflate_param ids[5] = { Z_DEFLATE_GOOD_LENGTH, Z_DEFLATE_MAX_LAZY, Z_DEFLATE_NICE_LENGTH,
+                                              Z_DEFLATE_MAX_CHAIN, Z_DEFLATE_SEARCH };
+    static const int bad[5] = { 259, 0, 2, 3, 4 };
+    PREFIX3(stream) c_stream;
+    zng_deflate_param_value params[6];
+    int vals[6], level, j, from, err;
+    size_t len = 200000, bound, i, sizes[2];
+    unsigned char *in, *out;
+    uint32_t seed = 31;
+
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(2 * bound);
+    if (in == NULL || out == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
+    for (j = 0; j < 6; j++) {
+        params[j].param = j < 5 ? ids[j] : Z_DEFLATE_LEVEL;
+        params[j].buf = &vals[j];
+        params[j].size = sizeof(int);
+    }
 
+    /* The limits of a level read back, also right after a change of level */
     c_stream.zalloc = zalloc;
     c_stream.zfree = zfree;
-    c_stream.opaque = (voidpf)0;
-    c_stream.avail_in = len;
-    c_stream.next_in = (const unsigned char *)hello;
-    c_stream.avail_out = 0;
-    c_stream.next_out = outBuf;
-
-    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit)(&c_stream, 6);
     CHECK_ERR(err, "deflateInit");
+    err = zng_deflateGetParams(&c_stream, params, 5);
+    CHECK_ERR(err, "zng_deflateGetParams");
+    for (j = 0; j < 4; j++) {
+        if (vals[j] != table[0][j]) {
+            fprintf(stderr, "parameter %d of level 6 reads back %d, not %d\n", (int)ids[j], vals[j], table[0][j]);
+            exit(1);
+        }
+    }
+    if (vals[4] != Z_SEARCH_DEFAULT) {
+        fprintf(stderr, "Z_DEFLATE_SEARCH reads back %d, not Z_SEARCH_DEFAULT\n", vals[4]);
+        exit(1);
+    }
+    vals[3] = 8;
+    vals[5] = 7;
+    err = zng_deflateSetParams(&c_stream, &params[3], 3);
+    CHECK_ERR(err, "zng_deflateSetParams");
+    vals[1] = vals[3] = 0;
+    err = zng_deflateGetParams(&c_stream, &params[1], 3);
+    CHECK_ERR(err, "zng_deflateGetParams");
+    if (vals[1] != 32 || vals[3] != 8) {
+        fprintf(stderr, "level 7 with a chain of 8 reads back lazy %d and chain %d\n", vals[1], vals[3]);
+        exit(1);
+    }
 
-    /* calculate actual output length and update structure */
-    estimateLen = PREFIX(deflateBound)(&c_stream, len);
-    outBuf = malloc(estimateLen);
-
-    if (outBuf != NULL) {
-        /* update zlib configuration */
-        c_stream.avail_out = estimateLen;
-        c_stream.next_out = outBuf;
-
-        /* do the compression */
-        err = PREFIX(deflate)(&c_stream, Z_FINISH);
-        if (err == Z_STREAM_END) {
-            printf("deflateBound(): OK\n");
-        } else {
-            CHECK_ERR(err, "deflate");
+    for (j = 0; j < 5; j++) {
+        vals[j] = bad[j];
+        if (zng_deflateSetParams(&c_stream, &params[j], 1) != Z_STREAM_ERROR || params[j].status != Z_STREAM_ERROR) {
+            fprintf(stderr, "parameter %d of %d should be refused\n", (int)ids[j], bad[j]);
+            exit(1);
         }
     }
 
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd");
+    /* The search cannot change with input left, only after a flush */
+    vals[4] = Z_SEARCH_GREEDY;
+    c_stream.next_in = in;
+    c_stream.avail_in = 10000;
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)bound;
+    err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+    CHECK_ERR(err, "deflate");
+    if (zng_deflateSetParams(&c_stream, &params[4], 1) != Z_STREAM_ERROR) {
+        fprintf(stderr, "Z_DEFLATE_SEARCH should be refused in the middle of the input\n");
+        exit(1);
+    }
+    err = PREFIX(deflate)(&c_stream, Z_SYNC_FLUSH);
+    CHECK_ERR(err, "deflate");
+    err = zng_deflateSetParams(&c_stream, &params[4], 1);
+    CHECK_ERR(err, "zng_deflateSetParams");
+    PREFIX(deflateEnd)(&c_stream);
+
+    /* Each of levels 6 and 7 given the configuration of the other gives the
+       stream of the other. Levels 4 to 6 do not pass their own checks in debug
+       builds, so there only level 6 is given that of level 7. */
+    for (from = 0; from < 2; from++) {
+        if (from == 0 && (PREFIX(zlibCompileFlags)() & (1 << 8)))
+            continue;
+        level = from ? 6 : 7;
+        for (j = 0; j < 5; j++)
+            vals[j] = table[from][j];
+        sizes[0] = deflate_raw_with(6 + from, params, 0, in, len, out, bound);
+        sizes[1] = deflate_raw_with(level, params, 5, in, len, out + bound, bound);
+        if (sizes[0] != sizes[1] || memcmp(out, out + bound, sizes[0])) {
+            fprintf(stderr, "level %d with the configuration of level %d gave %lu bytes, not %lu\n", level, 6 + from,
+                    (unsigned long)sizes[1], (unsigned long)sizes[0]);
+            exit(1);
+        }
+    }
+    printf("Z_DEFLATE_SEARCH and the search limits: OK\n");
 
-    free(outBuf);
+    free(in);
+    free(out);
 }
 
 /* ===========================================================================
- * Test deflateCopy() with small buffers
+ * Test deflateParams() going on in the same block through changes of level
+ * and strategy, with the stream still decompressing right.
  */
-void test_deflate_copy(unsigned char *compr, size_t comprLen)
+void test_params_switch(void)
 {
-    PREFIX3(stream) c_stream, c_stream_copy; /* compression stream */
-    int err;
-    size_t len = strlen(hello)+1;
-
-    memset(&c_stream, 0, sizeof(c_stream));
+    PREFIX3(stream) c_stream;
+    static const int levels[] = { 2, 3, 6, 9, 7, 4, 2, 8, 5, 3 };
+    static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE };
+    int search = Z_SEARCH_LAZY, err;
+    size_t piece = 16384, len = 40 * piece, bound, i, back_len;
+    unsigned long total_out;
+    unsigned char *in, *out, *back;
+    uint32_t seed = 41;
+    zng_deflate_param_value param = { .param = Z_DEFLATE_SEARCH, .buf = &search, .size = sizeof(int) };
+
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
     c_stream.zalloc = zalloc;
     c_stream.zfree = zfree;
-    c_stream.opaque = (voidpf)0;
-
-    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit)(&c_stream, 2);
     CHECK_ERR(err, "deflateInit");
+    /* Levels 4 to 6 do not pass their own checks in debug builds */
+    if (PREFIX(zlibCompileFlags)() & (1 << 8)) {
+        err = zng_deflateSetParams(&c_stream, &param, 1);
+        CHECK_ERR(err, "zng_deflateSetParams");
+    }
 
-    c_stream.next_in = (const unsigned char *)hello;
-    c_stream.next_out = compr;
-
-    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
-        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+    /* Each change of level and strategy goes on in the same block, with the
+       input of the last call still in the window and nothing written */
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)bound;
+    for (i = 0; i < len / piece; i++) {
+        c_stream.next_in = in + i * piece;
+        c_stream.avail_in = (uint32_t)piece;
         err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
         CHECK_ERR(err, "deflate");
+        total_out = (unsigned long)c_stream.total_out;
+        err = PREFIX(deflateParams)(&c_stream, levels[i % 10], strategies[i / 10]);
+        CHECK_ERR(err, "deflateParams");
+        if ((unsigned long)c_stream.total_out != total_out) {
+            fprintf(stderr, "deflateParams to level %d ended the block\n", levels[i % 10]);
+            exit(1);
+        }
     }
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
 
-    /* Finish the stream, still forcing small buffers: */
-    for (;;) {
-        c_stream.avail_out = 1;
-        err = PREFIX(deflate)(&c_stream, Z_FINISH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "deflate");
+    back_len = len;
+    err = PREFIX(uncompress)(back, &back_len, out, (z_size_t)c_stream.total_out);
+    CHECK_ERR(err, "uncompress");
+    if (back_len != len || memcmp(back, in, len)) {
+        fprintf(stderr, "bad deflateParams switch\n");
+        exit(1);
     }
+    printf("deflateParams switch: %lu bytes\n", (unsigned long)c_stream.total_out);
+    free(in);
+    free(out);
+    free(back);
+}
 
-    err = PREFIX(deflateCopy)(&c_stream_copy, &c_stream);
-    CHECK_ERR(err, "deflate_copy");
+/* ===========================================================================
+ * Test deflateParams() leaving level 9 while the output of the last block is
+ * still pending, which is written into next_out a little at a time. The
+ * data does not compress, so that the pending output of a stored block
+ * reaches into the symbols of the next one.
+ */
+void test_params_switch_pending(void)
+{
+    PREFIX3(stream) c_stream;
+    static const int levels[] = { 6, 3, 9, 9, 1 };
+    static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_DEFAULT_STRATEGY, Z_HUFFMAN_ONLY, Z_RLE, Z_DEFAULT_STRATEGY };
+    size_t piece = 3000, len = 256 * 1024, bound, i, at, back_len;
+    unsigned char *in, *out, *back;
+    unsigned k, n;
+    uint32_t seed = 43;
+    int err;
 
-    if (c_stream.state->status == c_stream_copy.state->status) {
-        printf("deflate_copy(): OK\n");
+    bound = (size_t)PREFIX(deflateBound)(NULL, (unsigned long)len) + len;
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = (unsigned char)(seed >> 16);
     }
 
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd original");
-
-    err = PREFIX(deflateEnd)(&c_stream_copy);
-    CHECK_ERR(err, "deflateEnd copy");
+    for (k = 0; k < sizeof(levels) / sizeof(levels[0]); k++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, 9);
+        CHECK_ERR(err, "deflateInit");
+
+        /* Switch away from level 9 and back whenever next_out is full */
+        c_stream.next_out = out;
+        at = 0;
+        n = 0;
+        do {
+            c_stream.next_in = in + at;
+            c_stream.avail_in = (uint32_t)(len - at < piece ? len - at : piece);
+            c_stream.avail_out = 200;
+            err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+            CHECK_ERR(err == Z_BUF_ERROR ? Z_OK : err, "deflate");
+            at = (size_t)(c_stream.next_in - in);
+            if (c_stream.avail_out == 0) {
+                c_stream.avail_out = 7;
+                err = PREFIX(deflateParams)(&c_stream, n & 1 ? 9 : levels[k], n & 1 ? Z_DEFAULT_STRATEGY : strategies[k]);
+                CHECK_ERR(err == Z_BUF_ERROR ? Z_OK : err, "deflateParams");
+                n++;
+            }
+        } while (at < len);
+        do {
+            c_stream.avail_out = 200;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        } while (err == Z_OK);
+        CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        back_len = len;
+        err = PREFIX(uncompress)(back, &back_len, out, (z_size_t)c_stream.total_out);
+        CHECK_ERR(err, "uncompress");
+        if (back_len != len || memcmp(back, in, len)) {
+            fprintf(stderr, "bad deflateParams switch to level %d with output pending\n", levels[k]);
+            exit(1);
+        }
+    }
+    printf("deflateParams switch with output pending: %lu bytes\n", (unsigned long)c_stream.total_out);
+    free(in);
+    free(out);
+    free(back);
 }
 
 /* ===========================================================================
- * Test deflateGetDictionary() with small buffers
+ * Compress with targets for the speed of output and of input that no level
+ * can miss, so that the level must go all the way up, and then down again,
+ * in one stream that must still decompress right.
  */
-void test_deflate_get_dict(unsigned char *compr, size_t comprLen)
+void test_target_speed(void)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-    unsigned char *dictNew = NULL;
-    unsigned int *dictLen;
+    PREFIX3(stream) c_stream;
+    int level, targets[2], search = Z_SEARCH_LAZY, err, phase;
+    size_t piece = 1024 * 1024, len = 2 * piece, bound, i, back_len;
+    unsigned char *in, *out, *back;
+    uint32_t seed = 37;
+    zng_deflate_param_value get = { .param = Z_DEFLATE_LEVEL, .buf = &level, .size = sizeof(level) };
+    zng_deflate_param_value params[3] = {
+        { .param = Z_DEFLATE_TARGET_SPEED, .buf = &targets[0], .size = sizeof(int) },
+        { .param = Z_DEFLATE_TARGET_OUTPUT, .buf = &targets[1], .size = sizeof(int) },
+        { .param = Z_DEFLATE_SEARCH, .buf = &search, .size = sizeof(int) },
+    };
+
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
     c_stream.zalloc = zalloc;
     c_stream.zfree = zfree;
-    c_stream.opaque = (voidpf)0;
-
-    err = PREFIX(deflateInit)(&c_stream, Z_BEST_COMPRESSION);
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit)(&c_stream, 1);
     CHECK_ERR(err, "deflateInit");
-
-    c_stream.next_out = compr;
-    c_stream.avail_out = (uInt)comprLen;
-
-    c_stream.next_in = (const unsigned char *)hello;
-    c_stream.avail_in = (unsigned int)strlen(hello)+1;
-
-    err = PREFIX(deflate)(&c_stream, Z_FINISH);
-
-    if (err != Z_STREAM_END) {
-        fprintf(stderr, "deflate should report Z_STREAM_END\n");
+    targets[0] = -1;
+    if (zng_deflateSetParams(&c_stream, params, 1) != Z_STREAM_ERROR) {
+        fprintf(stderr, "Z_DEFLATE_TARGET_SPEED -1 should be refused\n");
         exit(1);
     }
 
-    dictNew = calloc(256, 1);
-    dictLen = (unsigned int *)calloc(4, 1);
-    err = PREFIX(deflateGetDictionary)(&c_stream, dictNew, dictLen);
-
-    CHECK_ERR(err, "deflateGetDictionary");
-    if (err == Z_OK) {
-        printf("deflateGetDictionary(): %s\n", dictNew);
-    }
-
+    /* At 1 KB/s of output, every level compresses faster than the output
+       goes. Levels 4 to 6 do not pass their own checks in debug builds, so
+       there each level gets the lazy search. */
+    targets[0] = 0;
+    targets[1] = 1;
+    err = zng_deflateSetParams(&c_stream, params, (PREFIX(zlibCompileFlags)() & (1 << 8)) ? 3 : 2);
+    CHECK_ERR(err, "zng_deflateSetParams");
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)bound;
+    for (phase = 0; phase < 2; phase++) {
+        for (i = 0; i < piece; i += 16384) {
+            c_stream.next_in = in + phase * piece + i;
+            c_stream.avail_in = 16384;
+            err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
+            CHECK_ERR(err, "deflate");
+        }
+        err = zng_deflateGetParams(&c_stream, &get, 1);
+        CHECK_ERR(err, "zng_deflateGetParams");
+        if (level != (phase ? 1 : 9)) {
+            fprintf(stderr, "Z_DEFLATE_TARGET_%s left level %d\n", phase ? "SPEED" : "OUTPUT", level);
+            exit(1);
+        }
+
+        /* No level comes close to 2 TB/s */
+        targets[0] = 2000000000;
+        targets[1] = 0;
+        err = zng_deflateSetParams(&c_stream, params, 2);
+        CHECK_ERR(err, "zng_deflateSetParams");
+    }
+    err = PREFIX(deflate)(&c_stream, Z_FINISH);
+    CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
     err = PREFIX(deflateEnd)(&c_stream);
     CHECK_ERR(err, "deflateEnd");
 
-    free(dictNew);
-    free(dictLen);
+    back_len = len;
+    err = PREFIX(uncompress)(back, &back_len, out, (z_size_t)c_stream.total_out);
+    CHECK_ERR(err, "uncompress");
+    if (back_len != len || memcmp(back, in, len)) {
+        fprintf(stderr, "bad round trip with Z_DEFLATE_TARGET_SPEED\n");
+        exit(1);
+    }
+    printf("Z_DEFLATE_TARGET_OUTPUT, Z_DEFLATE_TARGET_SPEED: levels 1 to 9 and back\n");
+
+    free(in);
+    free(out);
+    free(back);
 }
 
 /* ===========================================================================
- * Test deflatePending() with small buffers
+ * Test Z_DEFLATE_MAX_INPUT and zng_inflateMaxOutput(), which must bound what
+ * each call takes or makes without changing the stream, Z_FINISH included.
  */
-void test_deflate_pending(unsigned char *compr, size_t comprLen)
+void test_max_work(void)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-    int *bits = calloc(256, 1);
-    unsigned *ped = calloc(256, 1);
-    size_t len = strlen(hello)+1;
-
+    PREFIX3(stream) c_stream, d_stream;
+    int max_input = 10000, err, calls;
+    size_t len = 1024 * 1024, bound, i, whole_len, consumed;
+    unsigned char *in, *out, *whole, *back;
+    unsigned long last;
+    uint32_t seed = 11;
+    zng_iovec iov[3];
+    zng_deflate_param_value param = { .param = Z_DEFLATE_MAX_INPUT, .buf = &max_input, .size = sizeof(max_input) };
+
+    bound = (size_t)zng_deflateBound(NULL, (unsigned long)len);
+    in = (unsigned char *)malloc(len);
+    out = (unsigned char *)malloc(bound);
+    whole = (unsigned char *)malloc(bound);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || out == NULL || whole == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 100 && (seed >> 16) % 8 ? in[i - 100 + (seed >> 24) % 4] : (unsigned char)('a' + (seed >> 16) % 4);
+    }
+    whole_len = bound;
+    err = PREFIX(compress2)(whole, &whole_len, in, len, 9);
+    CHECK_ERR(err, "compress2");
 
     c_stream.zalloc = zalloc;
     c_stream.zfree = zfree;
-    c_stream.opaque = (voidpf)0;
-
-    err = PREFIX(deflateInit)(&c_stream, Z_DEFAULT_COMPRESSION);
+    c_stream.opaque = (void *)0;
+    err = PREFIX(deflateInit)(&c_stream, 9);
     CHECK_ERR(err, "deflateInit");
-
-    c_stream.next_in = (const unsigned char *)hello;
-    c_stream.next_out = compr;
-
-    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
-        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
-        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
-        CHECK_ERR(err, "deflate");
+    err = zng_deflateSetParams(&c_stream, &param, 1);
+    CHECK_ERR(err, "zng_deflateSetParams");
+    c_stream.next_in = in;
+    c_stream.avail_in = (uint32_t)len;
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)bound;
+    calls = 0;
+    do {
+        last = c_stream.total_in;
+        err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        calls++;
+        if ((err != Z_OK && err != Z_STREAM_END) || c_stream.total_in - last > (unsigned long)max_input ||
+            (err == Z_STREAM_END) != (c_stream.avail_in == 0)) {
+            fprintf(stderr, "deflate took %lu bytes with Z_DEFLATE_MAX_INPUT, error %d\n",
+                    c_stream.total_in - last, err);
+            exit(1);
+        }
+    } while (err != Z_STREAM_END);
+    err = PREFIX(deflateEnd)(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
+    if (calls < (int)(len / (size_t)max_input) || c_stream.total_out != whole_len || memcmp(out, whole, whole_len)) {
+        fprintf(stderr, "Z_DEFLATE_MAX_INPUT changed the stream\n");
+        exit(1);
     }
 
-    err = PREFIX(deflatePending)(&c_stream, ped, bits);
-    CHECK_ERR(err, "deflatePending");
-
-    if (*bits >= 0 && *bits <= 7) {
-        printf("deflatePending(): OK\n");
-    } else {
-        printf("deflatePending(): error\n");
+    /* The limit is for all the fragments of one zng_deflatev() call */
+    err = PREFIX(deflateInit)(&c_stream, 6);
+    CHECK_ERR(err, "deflateInit");
+    err = zng_deflateSetParams(&c_stream, &param, 1);
+    CHECK_ERR(err, "zng_deflateSetParams");
+    iov[0].iov_base = in;
+    iov[0].iov_len = 6000;
+    iov[1].iov_base = in + 6000;
+    iov[1].iov_len = 3000;
+    iov[2].iov_base = in + 9000;
+    iov[2].iov_len = 5000;
+    c_stream.next_out = out;
+    c_stream.avail_out = (uint32_t)bound;
+    err = zng_deflatev(&c_stream, iov, 3, &consumed, Z_FINISH);
+    if (err != Z_OK || consumed != (size_t)max_input) {
+        fprintf(stderr, "zng_deflatev took %lu bytes with Z_DEFLATE_MAX_INPUT, error %d\n", (unsigned long)consumed, err);
+        exit(1);
     }
+    PREFIX(deflateEnd)(&c_stream);
 
-    /* Finish the stream, still forcing small buffers: */
-    for (;;) {
-        c_stream.avail_out = 1;
-        err = PREFIX(deflate)(&c_stream, Z_FINISH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "deflate");
+    d_stream.zalloc = zalloc;
+    d_stream.zfree = zfree;
+    d_stream.opaque = (void *)0;
+    d_stream.next_in = whole;
+    d_stream.avail_in = (uint32_t)whole_len;
+    err = PREFIX(inflateInit)(&d_stream);
+    CHECK_ERR(err, "inflateInit");
+    err = zng_inflateMaxOutput(&d_stream, 4096);
+    CHECK_ERR(err, "zng_inflateMaxOutput");
+    d_stream.next_out = back;
+    d_stream.avail_out = (uint32_t)len;
+    do {
+        last = d_stream.total_out;
+        err = PREFIX(inflate)(&d_stream, Z_FINISH);
+        if ((err != Z_OK && err != Z_STREAM_END) || d_stream.total_out - last > 4096 ||
+            d_stream.avail_out != len - d_stream.total_out) {
+            fprintf(stderr, "inflate made %lu bytes with zng_inflateMaxOutput(), error %d\n",
+                    d_stream.total_out - last, err);
+            exit(1);
+        }
+    } while (err != Z_STREAM_END);
+    err = PREFIX(inflateEnd)(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+    if (d_stream.total_out != len || memcmp(back, in, len)) {
+        fprintf(stderr, "bad round trip with zng_inflateMaxOutput()\n");
+        exit(1);
     }
+    printf("Z_DEFLATE_MAX_INPUT, zng_inflateMaxOutput(): %d calls to deflate\n", calls);
 
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd");
-
-    free(bits);
-    free(ped);
+    free(in);
+    free(out);
+    free(whole);
+    free(back);
 }
 
 /* ===========================================================================
- * Test deflatePrime() with small buffers
+ * Compress with the output going to a list of buffers, which must give the
+ * same stream as deflate() into small pieces of next_out, where no block can
+ * be written to next_out directly.
  */
-void test_deflate_prime(unsigned char *compr, size_t comprLen)
+void test_deflateScatter(void)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-    int bits = 0;
-    int values = 0;
-    size_t len = strlen(hello)+1;
-
-
-    c_stream.zalloc = zalloc;
-    c_stream.zfree = zfree;
-    c_stream.opaque = (voidpf)0;
+    PREFIX3(stream) c_stream;
+    int levels[] = { 2, 9 };
+    size_t sizes[] = { 0, 7, 1000, 40000, 5 };
+    zng_iovec iov[6];
+    int li, err;
+    size_t len = 300000, out_len = len + len / 8 + 64, i, ref_len, pos, written;
+    unsigned char *in, *ref, *out;
+    uint32_t seed = 23;
+
+    in = (unsigned char *)malloc(len);
+    ref = (unsigned char *)malloc(out_len);
+    out = (unsigned char *)malloc(out_len);
+    if (in == NULL || ref == NULL || out == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
+    }
 
-    // windowBits can also be -8..-15 for raw deflate,The default value is 15
-    err = PREFIX(deflateInit2)(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
-    CHECK_ERR(err, "deflateInit2");
+    for (li = 0; li < (int)(sizeof(levels) / sizeof(levels[0])); li++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, levels[li]);
+        CHECK_ERR(err, "deflateInit");
+
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        do {
+            c_stream.next_out = ref + c_stream.total_out;
+            c_stream.avail_out = 64;
+            err = PREFIX(deflate)(&c_stream, Z_FINISH);
+        } while (err == Z_OK);
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        ref_len = c_stream.total_out;
+
+        /* All at once, with the last buffer large enough for the rest */
+        err = PREFIX(deflateReset)(&c_stream);
+        CHECK_ERR(err, "deflateReset");
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = NULL;
+        c_stream.avail_out = 0;
+        for (i = 0, pos = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            iov[i].iov_base = out + pos;
+            iov[i].iov_len = sizes[i];
+            pos += sizes[i];
+        }
+        iov[i].iov_base = out + pos;
+        iov[i].iov_len = out_len - pos;
+        err = zng_deflateScatter(&c_stream, iov, 6, &written, Z_FINISH);
+        if (err != Z_STREAM_END || written != ref_len || c_stream.total_out != ref_len || memcmp(out, ref, ref_len)) {
+            fprintf(stderr, "zng_deflateScatter at level %d gave %d with %lu bytes, expected %lu\n", levels[li], err,
+                    (unsigned long)written, (unsigned long)ref_len);
+            exit(1);
+        }
+        if (c_stream.next_out != NULL || c_stream.avail_out != 0) {
+            fprintf(stderr, "zng_deflateScatter should not change next_out\n");
+            exit(1);
+        }
 
-    err = PREFIX(deflatePrime)(&c_stream, bits,values);
-    CHECK_ERR(err, "deflatePrime");
+        /* A few small buffers at a time */
+        err = PREFIX(deflateReset)(&c_stream);
+        CHECK_ERR(err, "deflateReset");
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        pos = 0;
+        do {
+            iov[0].iov_base = out + pos;
+            iov[0].iov_len = 300;
+            iov[1].iov_base = out + pos + 300;
+            iov[1].iov_len = 700;
+            err = zng_deflateScatter(&c_stream, iov, 2, &written, Z_FINISH);
+            pos += written;
+        } while (err == Z_OK && written == 1000);
+        if (err != Z_STREAM_END || pos != ref_len || memcmp(out, ref, ref_len)) {
+            fprintf(stderr, "zng_deflateScatter in small buffers at level %d gave %d with %lu bytes\n", levels[li], err,
+                    (unsigned long)pos);
+            exit(1);
+        }
 
-    if (err == Z_OK) {
-        printf("deflatePrime(): OK\n");
+        if (zng_deflateScatter(&c_stream, NULL, 1, &written, Z_FINISH) != Z_STREAM_ERROR) {
+            fprintf(stderr, "zng_deflateScatter should reject a NULL iov\n");
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
     }
 
-    c_stream.next_in = (const unsigned char *)hello;
-    c_stream.next_out = compr;
+    printf("zng_deflateScatter(): OK\n");
 
-    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
-        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
-        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
-        CHECK_ERR(err, "deflate");
-    }
+    free(in);
+    free(ref);
+    free(out);
+}
 
-    /* Finish the stream, still forcing small buffers: */
-    for (;;) {
-        c_stream.avail_out = 1;
-        err = PREFIX(deflate)(&c_stream, Z_FINISH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "deflate");
+/* ===========================================================================
+ * Fill iov with up to max pieces of buf from pos to end, of varying sizes.
+ */
+static size_t gather_pieces(zng_iovec *iov, size_t max, unsigned char *buf, size_t pos, size_t end) {
+    size_t n = 0, piece;
+
+    while (n < max && pos < end) {
+        piece = n % 3 == 2 ? 0 : 1 + (pos * 7 + n) % 97;
+        if (piece > end - pos)
+            piece = end - pos;
+        iov[n].iov_base = buf + pos;
+        iov[n].iov_len = piece;
+        pos += piece;
+        n++;
     }
-
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd");
+    return n;
 }
 
 /* ===========================================================================
- * Test deflateSetHeader() with small buffers
+ * Compress and decompress input given in fragments, which must give the same
+ * results as the input in one buffer. Level 1 ends its block whenever deflate()
+ * returns early, so there only the decompressed data can be compared.
  */
-void test_deflate_set_header(unsigned char *compr, size_t comprLen)
+void test_deflatev_inflatev(void)
 {
-    PREFIX(gz_header) *head = calloc(256, 1);
-    PREFIX3(stream) c_stream; /* compression stream */
-    int err;
-    size_t len = strlen(hello)+1;
-
-
-    c_stream.zalloc = zalloc;
-    c_stream.zfree = zfree;
-    c_stream.opaque = (voidpf)0;
-
-    /* gzip */
-    err = PREFIX(deflateInit2)(&c_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
-    CHECK_ERR(err, "deflateInit2");
-
-    head->text = 1;
-    err = PREFIX(deflateSetHeader)(&c_stream, head);
-    CHECK_ERR(err, "deflateSetHeader");
-    if (err == Z_OK) {
-        printf("deflateSetHeader(): OK\n");
+    PREFIX3(stream) c_stream, d_stream;
+    int levels[] = { 1, 3, 9 };
+    size_t sizes[] = { 0, 1, 4999, 0, 70000 };
+    zng_iovec iov[16];
+    int li, err;
+    size_t len = 300000, out_len = len + len / 8 + 64, i, n, ref_len, pos, consumed;
+    unsigned char *in, *ref, *out, *back;
+    uint32_t seed = 29;
+
+    in = (unsigned char *)malloc(len);
+    ref = (unsigned char *)malloc(out_len);
+    out = (unsigned char *)malloc(out_len);
+    back = (unsigned char *)malloc(len);
+    if (in == NULL || ref == NULL || out == NULL || back == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 1000 && (seed >> 16) % 4 ? in[i - 1000 + (seed >> 24) % 16] : (unsigned char)('a' + (seed >> 16) % 8);
     }
 
-    c_stream.next_in  = (unsigned char *)hello;
-    c_stream.next_out = compr;
-
-    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
-        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
+    for (li = 0; li < (int)(sizeof(levels) / sizeof(levels[0])); li++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, levels[li]);
+        CHECK_ERR(err, "deflateInit");
+
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = ref;
+        c_stream.avail_out = (uint32_t)out_len;
         err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
         CHECK_ERR(err, "deflate");
-    }
-
-    /* Finish the stream, still forcing small buffers: */
-    for (;;) {
-        c_stream.avail_out = 1;
         err = PREFIX(deflate)(&c_stream, Z_FINISH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "deflate");
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        ref_len = c_stream.total_out;
+
+        /* Fragments of all sizes in one call */
+        err = PREFIX(deflateReset)(&c_stream);
+        CHECK_ERR(err, "deflateReset");
+        c_stream.next_in = NULL;
+        c_stream.avail_in = 0;
+        c_stream.next_out = out;
+        c_stream.avail_out = (uint32_t)out_len;
+        for (i = 0, pos = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            iov[i].iov_base = in + pos;
+            iov[i].iov_len = sizes[i];
+            pos += sizes[i];
+        }
+        iov[i].iov_base = in + pos;
+        iov[i].iov_len = len - pos;
+        err = zng_deflatev(&c_stream, iov, 6, &consumed, Z_FINISH);
+        if (err != Z_STREAM_END || consumed != len ||
+            (levels[li] != 1 && (c_stream.total_out != ref_len || memcmp(out, ref, ref_len)))) {
+            fprintf(stderr, "zng_deflatev at level %d gave %d with %lu bytes, expected %lu\n", levels[li], err,
+                    (unsigned long)c_stream.total_out, (unsigned long)ref_len);
+            exit(1);
+        }
+        ref_len = c_stream.total_out;
+        if (c_stream.next_in != NULL || c_stream.avail_in != 0) {
+            fprintf(stderr, "zng_deflatev should not change next_in\n");
+            exit(1);
+        }
+        if (zng_deflatev(&c_stream, NULL, 1, &consumed, Z_FINISH) != Z_STREAM_ERROR) {
+            fprintf(stderr, "zng_deflatev should reject a NULL iov\n");
+            exit(1);
+        }
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        /* Small fragments and little output space at a time */
+        d_stream.zalloc = zalloc;
+        d_stream.zfree = zfree;
+        d_stream.opaque = (void *)0;
+        d_stream.next_in = NULL;
+        d_stream.avail_in = 0;
+        err = PREFIX(inflateInit)(&d_stream);
+        CHECK_ERR(err, "inflateInit");
+        pos = 0;
+        do {
+            n = gather_pieces(iov, 16, out, pos, ref_len);
+            d_stream.next_out = back + d_stream.total_out;
+            d_stream.avail_out = (uint32_t)(len - d_stream.total_out < 1000 ? len - d_stream.total_out : 1000);
+            err = zng_inflatev(&d_stream, iov, n, &consumed, Z_NO_FLUSH);
+            pos += consumed;
+        } while (err == Z_OK);
+        if (err != Z_STREAM_END || pos != ref_len || d_stream.total_in != ref_len || d_stream.total_out != len ||
+            memcmp(back, in, len)) {
+            fprintf(stderr, "zng_inflatev at level %d gave %d after %lu bytes of input\n", levels[li], err,
+                    (unsigned long)pos);
+            exit(1);
+        }
+        if (zng_inflatev(&d_stream, NULL, 1, &consumed, Z_NO_FLUSH) != Z_STREAM_ERROR) {
+            fprintf(stderr, "zng_inflatev should reject a NULL iov\n");
+            exit(1);
+        }
+        err = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(err, "inflateEnd");
     }
 
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd");
+    printf("zng_deflatev() and zng_inflatev(): OK\n");
 
-    free(head);
+    free(in);
+    free(ref);
+    free(out);
+    free(back);
+}
+
+static unsigned whole_allocs;
+
+static void *whole_alloc(void *opaque, unsigned int items, unsigned int size) {
+    (void)opaque;
+    whole_allocs++;
+    return calloc(items, size);
+}
+
+static void whole_free(void *opaque, void *address) {
+    (void)opaque;
+    free(address);
 }
 
 /* ===========================================================================
- * Test deflateTune() with small buffers
+ * Check a zlib stream with zng_inflateVerify() in pieces, which must leave the
+ * output alone, and find it cut short and with a wrong check value.
  */
-void test_deflate_tune(unsigned char *compr, size_t comprLen)
+void test_inflate_verify(void)
 {
-    PREFIX3(stream) c_stream; /* compression stream */
+    zng_stream c_stream, d_stream;
+    size_t len = 300000, out_len = len + len / 8 + 64, i, compr_len, at;
+    unsigned char *in, *compr, out[16];
+    uint32_t seed = 17;
+    unsigned long adler;
     int err;
-    int good_length = 3;
-    int max_lazy = 5;
-    int nice_length = 18;
-    int max_chain = 6;
-    size_t len = strlen(hello)+1;
-
 
-    c_stream.zalloc = zalloc;
-    c_stream.zfree = zfree;
-    c_stream.opaque = (voidpf)0;
-
-    err = PREFIX(deflateInit)(&c_stream, Z_BEST_COMPRESSION);
+    in = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(out_len);
+    if (in == NULL || compr == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 32768 && (seed >> 16) % 4 ? in[i - 1 - (seed >> 20) % 32768] : (unsigned char)('a' + (seed >> 16) % 26);
+    }
+    memset(&c_stream, 0, sizeof(c_stream));
+    err = zng_deflateInit(&c_stream, 6);
     CHECK_ERR(err, "deflateInit");
+    c_stream.next_in = in;
+    c_stream.avail_in = (uint32_t)len;
+    c_stream.next_out = compr;
+    c_stream.avail_out = (uint32_t)out_len;
+    err = zng_deflate(&c_stream, Z_FINISH);
+    CHECK_ERR(err == Z_STREAM_END ? Z_OK : err, "deflate");
+    compr_len = c_stream.total_out;
+    adler = c_stream.adler;
+    err = zng_deflateEnd(&c_stream);
+    CHECK_ERR(err, "deflateEnd");
 
-    err = PREFIX(deflateTune)(&c_stream,(uInt)good_length,(uInt)max_lazy,nice_length,(uInt)max_chain);
-    CHECK_ERR(err, "deflateTune");
-    if (err == Z_OK) {
-        printf("deflateTune(): OK\n");
+    /* In pieces of input, without touching the output */
+    memset(&d_stream, 0, sizeof(d_stream));
+    err = zng_inflateInit(&d_stream);
+    CHECK_ERR(err, "inflateInit");
+    memset(out, 0x5a, sizeof(out));
+    d_stream.next_out = out;
+    d_stream.avail_out = 1;
+    for (at = 0, err = Z_OK; at < compr_len && err == Z_OK; at += 5000) {
+        d_stream.next_in = compr + at;
+        d_stream.avail_in = (uint32_t)(compr_len - at < 5000 ? compr_len - at : 5000);
+        err = zng_inflateVerify(&d_stream, Z_NO_FLUSH);
+    }
+    if (err != Z_STREAM_END || d_stream.total_out != len || d_stream.adler != adler || d_stream.next_out != out ||
+        d_stream.avail_out != 1 || out[0] != 0x5a) {
+        fprintf(stderr, "zng_inflateVerify error: %d\n", err);
+        exit(1);
     }
 
-    c_stream.next_in = (const unsigned char *)hello;
-    c_stream.next_out = compr;
+    /* Cut short at Z_FINISH, and with a wrong check value */
+    err = zng_inflateReset(&d_stream);
+    CHECK_ERR(err, "inflateReset");
+    d_stream.next_in = compr;
+    d_stream.avail_in = (uint32_t)(compr_len - 10);
+    err = zng_inflateVerify(&d_stream, Z_FINISH);
+    if (err != Z_BUF_ERROR) {
+        fprintf(stderr, "zng_inflateVerify should report Z_BUF_ERROR: %d\n", err);
+        exit(1);
+    }
+    err = zng_inflateReset(&d_stream);
+    CHECK_ERR(err, "inflateReset");
+    compr[compr_len - 1] ^= 1;
+    d_stream.next_in = compr;
+    d_stream.avail_in = (uint32_t)compr_len;
+    err = zng_inflateVerify(&d_stream, Z_FINISH);
+    if (err != Z_DATA_ERROR) {
+        fprintf(stderr, "zng_inflateVerify should report Z_DATA_ERROR: %d\n", err);
+        exit(1);
+    }
+    err = zng_inflateEnd(&d_stream);
+    CHECK_ERR(err, "inflateEnd");
+    printf("zng_inflateVerify(): %lu bytes\n", (unsigned long)len);
 
-    while (c_stream.total_in != len && c_stream.total_out < comprLen) {
-        c_stream.avail_in = c_stream.avail_out = 1; /* force small buffers */
-        err = PREFIX(deflate)(&c_stream, Z_NO_FLUSH);
-        CHECK_ERR(err, "deflate");
+    free(in);
+    free(compr);
+}
+
+/* ===========================================================================
+ * Decompress into one buffer in small parts with zng_inflateWholeBuffer(),
+ * with and without a dictionary, which must not allocate a window.
+ */
+void test_inflate_whole(void)
+{
+    PREFIX3(stream) c_stream, d_stream;
+    size_t len = 200000, out_len = len + len / 8 + 64, i, compr_len;
+    unsigned char *in, *compr, *out;
+    const unsigned char dict[] = "abcdefghijklmnopqrstuvwxyz";
+    uint32_t seed = 31;
+    int err, pass;
+
+    in = (unsigned char *)malloc(len);
+    compr = (unsigned char *)malloc(out_len);
+    out = (unsigned char *)malloc(len);
+    if (in == NULL || compr == NULL || out == NULL) {
+        printf("out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = i >= 40000 && (seed >> 16) % 4 ? in[i - 1 - (seed >> 20) % 32768] : (unsigned char)('a' + (seed >> 16) % 26);
     }
 
-    /* Finish the stream, still forcing small buffers: */
-    for (;;) {
-        c_stream.avail_out = 1;
+    for (pass = 0; pass < 2; pass++) {
+        c_stream.zalloc = zalloc;
+        c_stream.zfree = zfree;
+        c_stream.opaque = (void *)0;
+        err = PREFIX(deflateInit)(&c_stream, 6);
+        CHECK_ERR(err, "deflateInit");
+        if (pass == 1) {
+            err = PREFIX(deflateSetDictionary)(&c_stream, dict, sizeof(dict));
+            CHECK_ERR(err, "deflateSetDictionary");
+        }
+        c_stream.next_in = in;
+        c_stream.avail_in = (uint32_t)len;
+        c_stream.next_out = compr;
+        c_stream.avail_out = (uint32_t)out_len;
         err = PREFIX(deflate)(&c_stream, Z_FINISH);
-        if (err == Z_STREAM_END) break;
-        CHECK_ERR(err, "deflate");
+        if (err != Z_STREAM_END) {
+            fprintf(stderr, "deflate should report Z_STREAM_END\n");
+            exit(1);
+        }
+        compr_len = c_stream.total_out;
+        err = PREFIX(deflateEnd)(&c_stream);
+        CHECK_ERR(err, "deflateEnd");
+
+        whole_allocs = 0;
+        d_stream.zalloc = whole_alloc;
+        d_stream.zfree = whole_free;
+        d_stream.opaque = (void *)0;
+        d_stream.next_in = compr;
+        d_stream.avail_in = 0;
+        err = PREFIX(inflateInit)(&d_stream);
+        CHECK_ERR(err, "inflateInit");
+        err = zng_inflateWholeBuffer(&d_stream, 1);
+        CHECK_ERR(err, "zng_inflateWholeBuffer");
+        d_stream.next_out = out;
+        do {
+            d_stream.avail_in = (uint32_t)(compr_len - d_stream.total_in < 777 ? compr_len - d_stream.total_in : 777);
+            d_stream.avail_out = (uint32_t)(len - d_stream.total_out < 1000 ? len - d_stream.total_out : 1000);
+            err = PREFIX(inflate)(&d_stream, Z_NO_FLUSH);
+            if (err == Z_NEED_DICT) {
+                if (zng_inflateWholeBuffer(&d_stream, 0) != Z_OK) {
+                    fprintf(stderr, "zng_inflateWholeBuffer should be undone before any output\n");
+                    exit(1);
+                }
+                zng_inflateWholeBuffer(&d_stream, 1);
+                err = PREFIX(inflateSetDictionary)(&d_stream, dict, sizeof(dict));
+                CHECK_ERR(err, "inflateSetDictionary");
+            } else if (err == Z_OK && d_stream.total_out == 1000 && pass == 1 &&
+                       zng_inflateWholeBuffer(&d_stream, 0) != Z_OK) {
+                fprintf(stderr, "zng_inflateWholeBuffer should be undone after output\n");
+                exit(1);
+            }
+        } while (err == Z_OK);
+        if (err != Z_STREAM_END || d_stream.total_out != len || memcmp(out, in, len)) {
+            fprintf(stderr, "inflate as a whole buffer gave %d with %lu bytes\n", err, (unsigned long)d_stream.total_out);
+            exit(1);
+        }
+        if (whole_allocs != (unsigned)(pass == 0 ? 1 : 2)) {
+            fprintf(stderr, "inflate as a whole buffer made %u allocations\n", whole_allocs);
+            exit(1);
+        }
+        err = PREFIX(inflateEnd)(&d_stream);
+        CHECK_ERR(err, "inflateEnd");
     }
 
-    err = PREFIX(deflateEnd)(&c_stream);
-    CHECK_ERR(err, "deflateEnd");
+    printf("zng_inflateWholeBuffer(): OK\n");
+
+    free(in);
+    free(compr);
+    free(out);
 }
+#endif
 
 /* ===========================================================================
  * Usage:  example [output.gz  [input.gz]]
@@ -918,6 +5729,24 @@ int main(int argc, char *argv[])
 
     test_gzio((argc > 1 ? argv[1] : TESTFILE),
               uncompr, uncomprLen);
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "m");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "A");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "P4");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "H");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "AH");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "D");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "B");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "BP4");
+    test_gzio_large(argc > 1 ? argv[1] : TESTFILE, "p");
+#ifndef ZLIB_COMPAT
+    test_gzindex(argc > 1 ? argv[1] : TESTFILE, "");
+    test_gzindex(argc > 1 ? argv[1] : TESTFILE, "m");
+    test_gzindex(argc > 1 ? argv[1] : TESTFILE, "A");
+    test_gzbgzf(argc > 1 ? argv[1] : TESTFILE);
+    test_gzpeek(argc > 1 ? argv[1] : TESTFILE);
+    test_gzgetlines(argc > 1 ? argv[1] : TESTFILE);
+    test_gztest(argc > 1 ? argv[1] : TESTFILE);
+#endif
 
     test_deflate(compr, comprLen);
     test_inflate(compr, comprLen, uncompr, uncomprLen);
@@ -937,13 +5766,64 @@ int main(int argc, char *argv[])
     test_dict_deflate(compr, comprLen);
     test_dict_inflate(compr, comprLen, uncompr, uncomprLen);
 
+    test_adler32();
+    test_crc32();
+    test_crc32_combine();
+#ifndef ZLIB_COMPAT
+    test_checksum_parallel();
+#endif
+    test_inflate_check();
     test_deflate_bound();
+    test_deflate_bound_levels();
     test_deflate_copy(compr, comprLen);
     test_deflate_get_dict(compr, comprLen);
     test_deflate_set_header(compr, comprLen);
     test_deflate_tune(compr, comprLen);
     test_deflate_pending(compr, comprLen);
     test_deflate_prime(compr, comprLen);
+    test_deflate_reset(compr, comprLen);
+    test_table_cache(compr, comprLen, uncompr, uncomprLen);
+#ifndef ZLIB_COMPAT
+    test_deflate_parallel();
+    test_inflate_parallel();
+    test_deflate_stats();
+    test_deflate_estimate();
+    test_arena(compr, comprLen, uncompr, uncomprLen);
+    test_compress_oneshot();
+    test_compress_batch();
+    test_uncompress_batch();
+    test_uncompress_inplace();
+    test_uncompress_prefix();
+    test_inflate_back_ring();
+    test_stream_pool(compr, comprLen, uncompr, uncomprLen);
+    test_numa_node(compr, comprLen, uncompr, uncomprLen);
+    test_deflate_idle(compr, comprLen, uncompr, uncomprLen);
+    test_hibernate(compr, comprLen, uncompr, uncomprLen);
+    test_serialize(compr, comprLen, uncompr, uncomprLen);
+    test_copy_shared(compr, comprLen, uncompr, uncomprLen);
+    test_prepared_dict(compr, comprLen, uncompr, uncomprLen);
+    test_hash_params(compr, comprLen, uncompr, uncomprLen);
+    test_deflate_bucket(compr, comprLen, uncompr, uncomprLen);
+    test_deflate_optimal(compr, comprLen, uncompr, uncomprLen);
+    test_block_split(compr, comprLen, uncompr, uncomprLen);
+    test_lit_bufsize();
+    test_auto_flush();
+    test_quick_dynamic(compr, comprLen, uncompr, uncomprLen);
+    test_hash_func(compr, comprLen, uncompr, uncomprLen);
+    test_prescan();
+    test_rle();
+    test_pipeline();
+    test_search_params();
+    test_chain_guard();
+    test_params_switch();
+    test_params_switch_pending();
+    test_target_speed();
+    test_max_work();
+    test_deflateScatter();
+    test_deflatev_inflatev();
+    test_inflate_whole();
+    test_inflate_verify();
+#endif
 
     free(compr);
     free(uncompr);
@@ -10,22 +10,13 @@
 #include "crc32_p.h"
 
 static uint32_t crc_table[8][256];
-static uint32_t crc_comb[GF2_DIM][GF2_DIM];
+static uint32_t x2n_table[GF2_DIM];
 
-static void gf2_matrix_square(uint32_t *square, const uint32_t *mat);
 static void make_crc_table(void);
 static void print_crc32_tables();
 static void write_table(const uint32_t *, int);
 
 
-/* ========================================================================= */
-static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
-    int n;
-
-    for (n = 0; n < GF2_DIM; n++)
-        square[n] = gf2_matrix_times(mat, mat[n]);
-}
-
 /* =========================================================================
   Generate tables for a byte-wise 32-bit CRC calculation on the polynomial:
   x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x+1.
@@ -84,30 +75,14 @@ static void make_crc_table() {
         }
     }
 
-    /* generate zero operators table for crc32_combine() */
-
-    /* generate the operator to apply a single zero bit to a CRC -- the
-       first row adds the polynomial if the low bit is a 1, and the
-       remaining rows shift the CRC right one bit */
-    k = GF2_DIM - 3;
-    crc_comb[k][0] = 0xedb88320UL;      /* CRC-32 polynomial */
-    uint32_t row = 1;
-    for (n = 1; n < GF2_DIM; n++) {
-        crc_comb[k][n] = row;
-        row <<= 1;
-    }
-    /* generate operators that apply 2, 4, and 8 zeros to a CRC, putting
-       the last one, the operator for one zero byte, at the 0 position */
-    gf2_matrix_square(crc_comb[k + 1], crc_comb[k]);
-    gf2_matrix_square(crc_comb[k + 2], crc_comb[k + 1]);
-    gf2_matrix_square(crc_comb[0], crc_comb[k + 2]);
-
-    /* generate operators for applying 2^n zero bytes to a CRC, filling out
-       the remainder of the table -- the operators repeat after GF2_DIM
-       values of n, so the table only needs GF2_DIM entries, regardless of
-       the size of the length being processed */
-    for (n = 1; n < k; n++)
-        gf2_matrix_square(crc_comb[n], crc_comb[n - 1]);
+    /* generate the powers x^(2^n) mod p for crc32_combine() -- appending
+       2^n zero bits to a message multiplies its CRC by x^(2^n), and the
+       powers repeat after GF2_DIM values of n, so the table only needs
+       GF2_DIM entries, regardless of the size of the length being processed */
+    c = (uint32_t)1 << 30;              /* x^1 */
+    x2n_table[0] = c;
+    for (n = 1; n < GF2_DIM; n++)
+        x2n_table[n] = c = multmodp(c, c);
 }
 
 static void print_crc32_tables() {
@@ -127,15 +102,11 @@ static void print_crc32_tables() {
     }
     printf("  }\n};\n");
 
-    /* print zero operator table */
+    /* print table of powers of x for crc32_combine() */
     printf("\nstatic const uint32_t ");
-    printf("crc_comb[%d][%d] =\n{\n  {\n", GF2_DIM, GF2_DIM);
-    write_table(crc_comb[0], GF2_DIM);
-    for (k = 1; k < GF2_DIM; k++) {
-        printf("  },\n  {\n");
-        write_table(crc_comb[k], GF2_DIM);
-    }
-    printf("  }\n};\n");
+    printf("x2n_table[%d] =\n{\n", GF2_DIM);
+    write_table(x2n_table, GF2_DIM);
+    printf("};\n");
     printf("#endif /* CRC32_H_ */\n");
 }
 
@@ -0,0 +1,417 @@
+/* pargzip.c -- compress and decompress gzip files with several threads
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ *   pargzip [-d] [-c] [-1 to -9] [-p threads] [-b KB] [--verify] [files...]
+ *   pargzip --bench [-1 to -9] [-p threads] [-b KB] [-t seconds] files...
+ *
+ * Each file is compressed to the file with ".gz" added, or with -d
+ * decompressed to the file without it, and the files given are kept. With -c,
+ * or with no files, the output goes to the standard output, from the standard
+ * input if there are no files. Compression splits the data into chunks of -b
+ * KB (128 by default) that zng_deflateParallel() compresses in -p threads (as
+ * many as there are processors by default), in a gzip member for each 1G of
+ * data. Decompression decodes each member with zng_inflateParallel(), which
+ * finds the chunks again without an index. The whole of a file, compressed
+ * and not, is held in memory.
+ *
+ * --verify decompresses what was compressed and compares it with the data,
+ * and with -d only checks that the files decompress, writing nothing.
+ *
+ * --bench compresses and decompresses the files in memory at the level given,
+ * or at each of the levels 1 to 9, over and over for at least -t seconds
+ * (0.5 by default) each, checking every round trip, and prints the ratio of
+ * the sizes and the speeds in MB/s of data, which makes it a reference
+ * workload for the parallel paths.
+ */
+
+#define _POSIX_C_SOURCE 200112  /* For clock_gettime(). */
+
+#include "zbuild.h"
+#ifdef ZLIB_COMPAT
+#  include "zlib.h"
+#else
+#  include "zlib-ng.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+#if defined(WIN32) || defined(__CYGWIN__)
+#  include <fcntl.h>
+#  include <io.h>
+#  define SET_BINARY_MODE(file) setmode(fileno(file), O_BINARY)
+#else
+#  define SET_BINARY_MODE(file)
+#endif
+
+#ifdef ZLIB_COMPAT
+int main(void) {
+    fprintf(stderr, "pargzip needs the zlib-ng API, and this is a zlib compatible build\n");
+    return 1;
+}
+#else
+
+#define SEGMENT (1UL << 30)     /* most data in one gzip member */
+#define MB (1024.0 * 1024.0)
+
+typedef struct {
+    unsigned char *data;
+    size_t len, size;
+} buffer;
+
+static int threads = 1;
+static size_t chunk = 0;        /* 0 for the default of zng_deflateParallel() */
+static double min_time = 0.5;
+
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static int processors(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : n > 256 ? 256 : (int)n;
+#else
+    return 1;
+#endif
+}
+
+/* Make room for at least more bytes after the data of buf. */
+static void reserve(buffer *buf, size_t more) {
+    unsigned char *data;
+    size_t size = buf->size ? buf->size : 65536;
+
+    if (buf->size - buf->len >= more)
+        return;
+    while (size - buf->len < more)
+        size *= 2;
+    data = (unsigned char *)realloc(buf->data, size);
+    if (data == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    buf->data = data;
+    buf->size = size;
+}
+
+static int load(FILE *in, buffer *buf) {
+    size_t got;
+
+    buf->len = 0;
+    do {
+        reserve(buf, 65536);
+        got = fread(buf->data + buf->len, 1, buf->size - buf->len, in);
+        buf->len += got;
+    } while (got != 0);
+    return ferror(in) ? -1 : 0;
+}
+
+/* Compress len bytes at data into out as gzip members of up to SEGMENT bytes
+   each at level. Return Z_OK or an error of deflate. */
+static int gzip_buffer(const unsigned char *data, size_t len, int level, buffer *out) {
+    zng_stream strm;
+    size_t at = 0, n, room;
+    int err;
+
+    memset(&strm, 0, sizeof(strm));
+    err = zng_deflateInit2(&strm, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK)
+        return err;
+    out->len = 0;
+    do {
+        n = len - at < SEGMENT ? len - at : SEGMENT;
+        room = (size_t)zng_deflateBound(&strm, (unsigned long)n) + (n / (chunk ? chunk : 65536) + 1) * 16;
+        reserve(out, room);
+        strm.next_in = data + at;
+        strm.avail_in = (uint32_t)n;
+        strm.next_out = out->data + out->len;
+        strm.avail_out = (uint32_t)room;
+        err = zng_deflateParallel(&strm, threads, chunk);
+        if (err != Z_STREAM_END)
+            break;
+        out->len += room - strm.avail_out;
+        at += n;
+        err = zng_deflateReset(&strm);
+    } while (err == Z_OK && at < len);
+    zng_deflateEnd(&strm);
+    return err == Z_STREAM_END ? Z_OK : err;
+}
+
+/* Decompress the gzip members of len bytes at data into out, making room for
+   hint bytes before each member so that it can be decoded in parallel if it
+   is not longer than that. Trailing data that is not a gzip member is
+   ignored, as gzip does. Return Z_OK or an error of inflate. */
+static int gunzip_buffer(const unsigned char *data, size_t len, size_t hint, buffer *out) {
+    const uint32_t max = (uint32_t)-1;
+    zng_stream strm;
+    size_t left = len, room;
+    int err;
+
+    memset(&strm, 0, sizeof(strm));
+    err = zng_inflateInit2(&strm, MAX_WBITS + 16);
+    if (err != Z_OK)
+        return err;
+    out->len = 0;
+    strm.next_in = data;
+    while (left >= 2 && strm.next_in[0] == 31 && strm.next_in[1] == 139) {
+        /* all of a member at once in parallel, if the room is there */
+        reserve(out, hint ? hint : 1);
+        room = out->size - out->len;
+        strm.avail_in = left > max ? max : (uint32_t)left;
+        left -= strm.avail_in;
+        strm.next_out = out->data + out->len;
+        strm.avail_out = room > max ? max : (uint32_t)room;
+        room = strm.avail_out;
+        err = zng_inflateParallel(&strm, threads, 0);
+        out->len += room - strm.avail_out;
+
+        /* then the rest of it, if not */
+        while (err == Z_OK || err == Z_BUF_ERROR) {
+            if (strm.avail_in == 0 && left == 0)
+                break;
+            if (strm.avail_in == 0) {
+                strm.avail_in = left > max ? max : (uint32_t)left;
+                left -= strm.avail_in;
+            }
+            reserve(out, 65536);
+            room = out->size - out->len;
+            strm.next_out = out->data + out->len;
+            strm.avail_out = room > max ? max : (uint32_t)room;
+            room = strm.avail_out;
+            err = zng_inflate(&strm, Z_NO_FLUSH);
+            out->len += room - strm.avail_out;
+        }
+        if (err != Z_STREAM_END) {
+            zng_inflateEnd(&strm);
+            return err == Z_BUF_ERROR || err == Z_OK ? Z_DATA_ERROR : err;
+        }
+        left += strm.avail_in;
+        zng_inflateReset(&strm);
+    }
+    zng_inflateEnd(&strm);
+    return Z_OK;
+}
+
+/* The length of the data of the last gzip member, or 0 if that is not there.
+   It is the length modulo 4G, so it only serves as a first guess. */
+static size_t last_isize(const unsigned char *data, size_t len) {
+    if (len < 18)
+        return 0;
+    data += len - 4;
+    return (size_t)data[0] | (size_t)data[1] << 8 | (size_t)data[2] << 16 | (size_t)data[3] << 24;
+}
+
+/* Compress or decompress the file name, or the standard input if it is NULL,
+   to the file named after it, or to the standard output if to_stdout is set.
+   Return 0 on success or 1 on failure. */
+static int process(const char *name, int decompress, int level, int to_stdout, int verify) {
+    buffer in = { NULL, 0, 0 }, out = { NULL, 0, 0 }, back = { NULL, 0, 0 };
+    char *out_name = NULL;
+    FILE *file;
+    size_t len;
+    int err, ret = 1;
+
+    if (!to_stdout && !(decompress && verify) && name != NULL) {
+        len = strlen(name);
+        out_name = (char *)malloc(len + 4);
+        if (out_name == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        if (!decompress)
+            snprintf(out_name, len + 4, "%s.gz", name);
+        else if (len > 3 && strcmp(name + len - 3, ".gz") == 0)
+            snprintf(out_name, len + 4, "%.*s", (int)(len - 3), name);
+        else {
+            fprintf(stderr, "pargzip: %s does not end in .gz\n", name);
+            goto done;
+        }
+    }
+
+    file = name == NULL ? stdin : fopen(name, "rb");
+    if (file == NULL || load(file, &in)) {
+        fprintf(stderr, "pargzip: cannot read %s\n", name == NULL ? "standard input" : name);
+        goto done;
+    }
+    if (name != NULL)
+        fclose(file);
+
+    if (decompress) {
+        len = in.len < SEGMENT / 4 ? 4 * in.len : SEGMENT;
+        if (len < last_isize(in.data, in.len))
+            len = last_isize(in.data, in.len);
+        err = gunzip_buffer(in.data, in.len, len, &out);
+        if (err == Z_OK && in.len != 0 && out.len == 0 && (in.len < 2 || in.data[0] != 31 || in.data[1] != 139))
+            err = Z_DATA_ERROR;
+        if (err != Z_OK) {
+            fprintf(stderr, "pargzip: %s: %s\n", name == NULL ? "standard input" : name, zng_zError(err));
+            goto done;
+        }
+        if (verify) {
+            ret = 0;
+            goto done;
+        }
+    } else {
+        err = gzip_buffer(in.data, in.len, level, &out);
+        if (err == Z_OK && verify) {
+            err = gunzip_buffer(out.data, out.len, in.len, &back);
+            if (err == Z_OK && (back.len != in.len || (in.len && memcmp(back.data, in.data, in.len))))
+                err = Z_DATA_ERROR;
+        }
+        if (err != Z_OK) {
+            fprintf(stderr, "pargzip: %s: %s\n", name == NULL ? "standard input" : name,
+                    verify && err == Z_DATA_ERROR ? "verify failed" : zng_zError(err));
+            goto done;
+        }
+    }
+
+    if (out_name == NULL) {
+        SET_BINARY_MODE(stdout);
+        file = stdout;
+    } else
+        file = fopen(out_name, "wb");
+    if (file == NULL || fwrite(out.data, 1, out.len, file) != out.len || (file == stdout ? fflush(file) : fclose(file))) {
+        fprintf(stderr, "pargzip: cannot write %s\n", out_name == NULL ? "standard output" : out_name);
+        goto done;
+    }
+    ret = 0;
+
+done:
+    free(out_name);
+    free(in.data);
+    free(out.data);
+    free(back.data);
+    return ret;
+}
+
+/* Compress and decompress the nfiles files at the levels from first to last,
+   and print the ratios and speeds. Return 0 on success or 1 on failure. */
+static int bench(char **names, int nfiles, int first, int last) {
+    buffer *files, out = { NULL, 0, 0 }, back = { NULL, 0, 0 };
+    size_t total = 0, packed;
+    double start, comp_time, decomp_time, comp_bytes, decomp_bytes;
+    FILE *file;
+    int i, level;
+
+    files = (buffer *)calloc((size_t)nfiles, sizeof(buffer));
+    if (files == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < nfiles; i++) {
+        file = fopen(names[i], "rb");
+        if (file == NULL || load(file, &files[i])) {
+            fprintf(stderr, "pargzip: cannot read %s\n", names[i]);
+            return 1;
+        }
+        fclose(file);
+        total += files[i].len;
+    }
+
+    printf("%d files, %lu bytes, %d threads, chunks of %luK\n", nfiles, (unsigned long)total, threads,
+           (unsigned long)(chunk ? chunk : 131072) / 1024);
+    printf("level   ratio   compress MB/s   decompress MB/s\n");
+    for (level = first; level <= last; level++) {
+        packed = 0;
+        comp_time = decomp_time = comp_bytes = decomp_bytes = 0;
+        for (i = 0; i < nfiles; i++) {
+            start = now();
+            do {
+                if (gzip_buffer(files[i].data, files[i].len, level, &out) != Z_OK) {
+                    fprintf(stderr, "pargzip: cannot compress %s\n", names[i]);
+                    return 1;
+                }
+                comp_bytes += (double)files[i].len;
+            } while (now() - start < min_time / nfiles);
+            comp_time += now() - start;
+            packed += out.len;
+
+            start = now();
+            do {
+                if (gunzip_buffer(out.data, out.len, files[i].len, &back) != Z_OK || back.len != files[i].len ||
+                    (back.len && memcmp(back.data, files[i].data, back.len))) {
+                    fprintf(stderr, "pargzip: bad round trip of %s at level %d\n", names[i], level);
+                    return 1;
+                }
+                decomp_bytes += (double)files[i].len;
+            } while (now() - start < min_time / nfiles);
+            decomp_time += now() - start;
+        }
+        printf("%5d %7.3f %15.1f %17.1f\n", level, packed ? (double)total / (double)packed : 0,
+               comp_bytes / MB / comp_time, decomp_bytes / MB / decomp_time);
+    }
+
+    for (i = 0; i < nfiles; i++)
+        free(files[i].data);
+    free(files);
+    free(out.data);
+    free(back.data);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: pargzip [-d] [-c] [-1 to -9] [-p threads] [-b KB] [--verify] [files...]\n"
+                    "       pargzip --bench [-1 to -9] [-p threads] [-b KB] [-t seconds] files...\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int decompress = 0, to_stdout = 0, verify = 0, run_bench = 0, level = -1, ret = 0, i;
+
+    threads = processors();
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != 0; i++) {
+        if (!strcmp(argv[i], "--bench"))
+            run_bench = 1;
+        else if (!strcmp(argv[i], "--verify"))
+            verify = 1;
+        else if (!strcmp(argv[i], "-d"))
+            decompress = 1;
+        else if (!strcmp(argv[i], "-c"))
+            to_stdout = 1;
+        else if (argv[i][1] >= '1' && argv[i][1] <= '9' && argv[i][2] == 0)
+            level = argv[i][1] - '0';
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+            chunk = (size_t)atol(argv[++i]) * 1024;
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            min_time = atof(argv[++i]);
+        else
+            usage();
+    }
+    if (threads < 1 || (chunk != 0 && chunk < 1024) || min_time <= 0 || (run_bench && (decompress || i == argc)))
+        usage();
+
+    if (run_bench)
+        return bench(argv + i, argc - i, level < 0 ? 1 : level, level < 0 ? 9 : level);
+    if (level < 0)
+        level = 6;
+    if (i == argc) {
+        SET_BINARY_MODE(stdin);
+        return process(NULL, decompress, level, 1, verify);
+    }
+    for (; i < argc; i++)
+        ret |= process(argv[i], decompress, level, to_stdout, verify);
+    return ret;
+}
+#endif
@@ -0,0 +1,340 @@
+/* traindict.c -- build a preset dictionary from a sample corpus
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ *   traindict [-s size] [-k length] [-g length] [-l level] -o dictionary files...
+ *
+ * Each file is one sample, such as a message of the kind that is to be
+ * compressed with the dictionary. The substrings of -k bytes (6 by default)
+ * are counted by how many samples they are in, or by how often they occur if
+ * there is only one sample. The corpus is then cut into as many parts as
+ * segments of -g bytes (64 by default) fit into the dictionary of -s bytes
+ * (32768 by default), and the segment of each part with the most common
+ * substrings is taken, counting each substring only once over the whole
+ * dictionary. The segments are written to the dictionary in order of that
+ * count, the most common last, so that they are nearest to the data and stay
+ * within reach of a smaller window.
+ *
+ * The dictionary can be given to deflateSetDictionary() and
+ * inflateSetDictionary() or to zng_deflatePrepareDictionary() and
+ * zng_inflatePrepareDictionary() as it is. The samples are compressed at
+ * level -l (6 by default) with and without it to show the gain.
+ */
+
+#include "zbuild.h"
+#ifdef ZLIB_COMPAT
+#  include "zlib.h"
+#else
+#  include "zlib-ng.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ZLIB_COMPAT
+int main(void) {
+    fprintf(stderr, "traindict needs the zlib-ng API, and this is a zlib compatible build\n");
+    return 1;
+}
+#else
+
+/* Substrings are counted in a hash table of this many bits, without telling
+   apart the ones that collide */
+#define HASH_BITS 20
+#define HASH_SIZE (1U << HASH_BITS)
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+} sample;
+
+typedef struct {
+    const unsigned char *start;
+    size_t len;
+    uint64_t score;     /* sum of the counts of its substrings when it was taken */
+} segment;
+
+static sample *samples;
+static unsigned nsamples;
+static size_t total_len, max_len;
+static size_t dict_size = 32768, kmer = 6, seg_len = 64;
+static int level = 6;
+
+static uint32_t *counts;    /* samples or occurrences of each substring */
+static uint32_t *seen;      /* last sample counted in counts, plus one */
+static uint16_t *active;    /* occurrences of each substring in the window of best_segment() */
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void load(const char *name) {
+    FILE *in = fopen(name, "rb");
+    sample *s;
+    size_t size = 65536, got;
+
+    if (in == NULL) {
+        fprintf(stderr, "traindict: cannot open %s\n", name);
+        exit(1);
+    }
+    s = &samples[nsamples++];
+    s->data = (unsigned char *)xmalloc(size);
+    s->len = 0;
+    while ((got = fread(s->data + s->len, 1, size - s->len, in)) != 0) {
+        s->len += got;
+        if (s->len == size) {
+            unsigned char *more = (unsigned char *)realloc(s->data, size *= 2);
+            if (more == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            s->data = more;
+        }
+    }
+    if (ferror(in)) {
+        fprintf(stderr, "traindict: cannot read %s\n", name);
+        exit(1);
+    }
+    fclose(in);
+    total_len += s->len;
+    if (s->len > max_len)
+        max_len = s->len;
+}
+
+/* Return the hash of the kmer bytes at p. */
+static uint32_t hash(const unsigned char *p) {
+    uint64_t h = 0;
+    size_t i;
+
+    for (i = 0; i < kmer; i++)
+        h = (h + p[i]) * UINT64_C(0x9e3779b97f4a7c15);
+    return (uint32_t)(h >> (64 - HASH_BITS));
+}
+
+static void count_substrings(void) {
+    unsigned s;
+    size_t i;
+
+    for (s = 0; s < nsamples; s++) {
+        for (i = 0; i + kmer <= samples[s].len; i++) {
+            uint32_t h = hash(samples[s].data + i);
+
+            if (nsamples > 1 && seen[h] == s + 1)
+                continue;
+            seen[h] = s + 1;
+            counts[h]++;
+        }
+    }
+}
+
+/* Find the segment of seg_len bytes of sample s that starts in [from, to)
+   with the highest sum of the counts of its distinct substrings, and put it
+   in best if that is higher than best->score. */
+static void best_segment(unsigned s, size_t from, size_t to, segment *best) {
+    const unsigned char *data = samples[s].data;
+    size_t len = samples[s].len, i, first;
+    uint64_t score = 0;
+
+    if (len < seg_len)
+        return;
+    if (to > len - seg_len + 1)
+        to = len - seg_len + 1;
+    if (from >= to)
+        return;
+
+    /* The window holds the substrings that start at first to i */
+    first = from;
+    for (i = from; i < to + seg_len - kmer; i++) {
+        uint32_t h = hash(data + i);
+
+        if (active[h]++ == 0)
+            score += counts[h];
+        if (i - first == seg_len - kmer + 1) {
+            h = hash(data + first++);
+            if (--active[h] == 0)
+                score -= counts[h];
+        }
+        if (i - first == seg_len - kmer && score > best->score) {
+            best->start = data + first;
+            best->len = seg_len;
+            best->score = score;
+        }
+    }
+    for (; first < i; first++)
+        active[hash(data + first)]--;
+}
+
+static int by_score(const void *a, const void *b) {
+    const segment *x = (const segment *)a, *y = (const segment *)b;
+
+    return x->score < y->score ? -1 : x->score > y->score;
+}
+
+/* Pick the segments of one part of the corpus after another and write them
+   to dict, returning the length of the dictionary. */
+static size_t build(unsigned char *dict) {
+    segment *segs;
+    size_t nsegs = dict_size / seg_len, part, at, n = 0, used = 0, i;
+    unsigned s;
+
+    segs = (segment *)xmalloc((nsegs ? nsegs : 1) * sizeof(segment));
+    part = (total_len + nsegs - 1) / (nsegs ? nsegs : 1);
+    for (at = 0; nsegs && at < total_len; at += part) {
+        segment best = { NULL, 0, 0 };
+        size_t base = 0;
+
+        /* The part may span several samples */
+        for (s = 0; s < nsamples; base += samples[s++].len) {
+            if (base + samples[s].len <= at || base >= at + part)
+                continue;
+            best_segment(s, at > base ? at - base : 0, at + part - base, &best);
+        }
+        if (best.score == 0)
+            continue;
+
+        /* Count its substrings only once */
+        for (i = 0; i + kmer <= best.len; i++)
+            counts[hash(best.start + i)] = 0;
+        segs[n++] = best;
+    }
+
+    qsort(segs, n, sizeof(segment), by_score);
+    for (i = 0; i < n; i++) {
+        memcpy(dict + used, segs[i].start, segs[i].len);
+        used += segs[i].len;
+    }
+    free(segs);
+    return used;
+}
+
+/* Compress sample s into out, with the dictionary if pdict is not NULL, check
+   that it decompresses with idict into back, and return the compressed length. */
+static size_t compress_one(const sample *s, const zng_deflate_dict *pdict, const zng_inflate_dict *idict,
+                           unsigned char *out, size_t out_size, unsigned char *back) {
+    zng_stream strm;
+    size_t len;
+    int err;
+
+    memset(&strm, 0, sizeof(strm));
+    if (zng_deflateInit(&strm, level) != Z_OK ||
+        (pdict != NULL && zng_deflateSetPreparedDictionary(&strm, pdict) != Z_OK)) {
+        fprintf(stderr, "traindict: cannot set up deflate\n");
+        exit(1);
+    }
+    strm.next_in = s->data;
+    strm.avail_in = (uint32_t)s->len;
+    strm.next_out = out;
+    strm.avail_out = (uint32_t)out_size;
+    err = zng_deflate(&strm, Z_FINISH);
+    len = (size_t)strm.total_out;
+    zng_deflateEnd(&strm);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "traindict: deflate failed\n");
+        exit(1);
+    }
+
+    memset(&strm, 0, sizeof(strm));
+    if (zng_inflateInit(&strm) != Z_OK) {
+        fprintf(stderr, "traindict: cannot set up inflate\n");
+        exit(1);
+    }
+    strm.next_in = out;
+    strm.avail_in = (uint32_t)len;
+    strm.next_out = back;
+    strm.avail_out = (uint32_t)(s->len ? s->len : 1);
+    err = zng_inflate(&strm, Z_FINISH);
+    if (err == Z_NEED_DICT && idict != NULL && zng_inflateSetPreparedDictionary(&strm, idict) == Z_OK)
+        err = zng_inflate(&strm, Z_FINISH);
+    if (err != Z_STREAM_END || strm.total_out != s->len || memcmp(back, s->data, s->len)) {
+        fprintf(stderr, "traindict: bad round trip of a sample\n");
+        exit(1);
+    }
+    zng_inflateEnd(&strm);
+    return len;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: traindict [-s size] [-k length] [-g length] [-l level] -o dictionary files...\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *name = NULL;
+    unsigned char *dict, *out, *back;
+    zng_deflate_dict *pdict;
+    zng_inflate_dict *idict;
+    size_t dict_len, out_size, plain = 0, with = 0;
+    FILE *file;
+    int i;
+    unsigned s;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (i + 1 == argc)
+            usage();
+        if (!strcmp(argv[i], "-s"))
+            dict_size = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "-k"))
+            kmer = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "-g"))
+            seg_len = (size_t)atol(argv[++i]);
+        else if (!strcmp(argv[i], "-l"))
+            level = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-o"))
+            name = argv[++i];
+        else
+            usage();
+    }
+    if (i == argc || name == NULL || dict_size < 1 || dict_size > 32768 || kmer < 3 || kmer > 16 ||
+        seg_len < kmer || seg_len > dict_size || level < 0 || level > 9)
+        usage();
+
+    samples = (sample *)xmalloc((size_t)(argc - i) * sizeof(sample));
+    for (; i < argc; i++)
+        load(argv[i]);
+
+    counts = (uint32_t *)xmalloc(HASH_SIZE * sizeof(uint32_t));
+    seen = (uint32_t *)xmalloc(HASH_SIZE * sizeof(uint32_t));
+    active = (uint16_t *)xmalloc(HASH_SIZE * sizeof(uint16_t));
+    memset(counts, 0, HASH_SIZE * sizeof(uint32_t));
+    memset(seen, 0, HASH_SIZE * sizeof(uint32_t));
+    memset(active, 0, HASH_SIZE * sizeof(uint16_t));
+    count_substrings();
+
+    dict = (unsigned char *)xmalloc(dict_size);
+    dict_len = build(dict);
+    file = fopen(name, "wb");
+    if (file == NULL || fwrite(dict, 1, dict_len, file) != dict_len || fclose(file)) {
+        fprintf(stderr, "traindict: cannot write %s\n", name);
+        return 1;
+    }
+
+    /* Show what the dictionary gains on the samples themselves */
+    pdict = zng_deflatePrepareDictionary(dict, (uint32_t)dict_len, level, MAX_WBITS, 8);
+    idict = zng_inflatePrepareDictionary(dict, (uint32_t)dict_len);
+    if (pdict == NULL || idict == NULL) {
+        fprintf(stderr, "traindict: cannot prepare the dictionary\n");
+        return 1;
+    }
+    out_size = (size_t)zng_deflateBound(NULL, (unsigned long)max_len);
+    out = (unsigned char *)xmalloc(out_size);
+    back = (unsigned char *)xmalloc(max_len ? max_len : 1);
+    for (s = 0; s < nsamples; s++) {
+        plain += compress_one(&samples[s], NULL, NULL, out, out_size, back);
+        with += compress_one(&samples[s], pdict, idict, out, out_size, back);
+    }
+    printf("%u files, %lu bytes, dictionary of %lu bytes\n", nsamples, (unsigned long)total_len,
+           (unsigned long)dict_len);
+    printf("level %d without dictionary: %10lu bytes\n", level, (unsigned long)plain);
+    printf("level %d with dictionary:    %10lu bytes, %.1f%% smaller\n", level, (unsigned long)with,
+           plain ? 100.0 * ((double)plain - (double)with) / (double)plain : 0);
+
+    zng_deflateFreePreparedDictionary(pdict);
+    zng_inflateFreePreparedDictionary(idict);
+    return 0;
+}
+#endif
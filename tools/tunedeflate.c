@@ -0,0 +1,339 @@
+/* tunedeflate.c -- search the configuration of a compression level for a sample corpus
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ *
+ *   tunedeflate [-l level] [-s MB/s | -r ratio] [-t seconds] files...
+ *
+ * Starting from the configuration of the level, each of the search limits of
+ * zng_deflateSetParams() and the match search is tried in turn at each value
+ * of a list, with the others left where they are, until a round over all of
+ * them changes nothing. With -s the smallest output compressed at least that
+ * fast wins, with -r the fastest one with at least that ratio of input to
+ * output size, and with neither the smallest one at least as fast as the
+ * level as it is. Each file is compressed on its own, over and over for at
+ * least the given time (0.2 seconds by default) to measure the speed.
+ *
+ * The result is printed as the values to give zng_deflateSetParams() and as
+ * an entry of configuration_table in deflate.c.
+ */
+
+#define _POSIX_C_SOURCE 200112  /* For clock_gettime(). */
+
+#include "zbuild.h"
+#ifdef ZLIB_COMPAT
+#  include "zlib.h"
+#else
+#  include "zlib-ng.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+
+#ifdef ZLIB_COMPAT
+int main(void) {
+    fprintf(stderr, "tunedeflate needs the zlib-ng API, and this is a zlib compatible build\n");
+    return 1;
+}
+#else
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* The parameters tuned, in the order of configuration_table */
+#define GOOD   0
+#define LAZY   1
+#define NICE   2
+#define CHAIN  3
+#define SEARCH 4
+#define PARAMS 5
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+} sample;
+
+typedef struct {
+    int vals[PARAMS];
+    size_t size;        /* total compressed size */
+    double speed;       /* MB/s of input */
+} config;
+
+static const zng_deflate_param param_ids[PARAMS] = {
+    Z_DEFLATE_GOOD_LENGTH, Z_DEFLATE_MAX_LAZY, Z_DEFLATE_NICE_LENGTH, Z_DEFLATE_MAX_CHAIN, Z_DEFLATE_SEARCH
+};
+static const char *const param_names[PARAMS] = { "good", "lazy", "nice", "chain", "search" };
+static const char *const search_names[] = { "default", "greedy", "lazy", "medium" };
+static const char *const search_ids[] = { "Z_SEARCH_DEFAULT", "Z_SEARCH_GREEDY", "Z_SEARCH_LAZY", "Z_SEARCH_MEDIUM" };
+static const char *const search_funcs[] = { NULL, "deflate_fast", "deflate_slow", "deflate_medium" };
+
+/* The values tried for each parameter, ending with -1 */
+static const int good_list[] = { 4, 8, 16, 32, 64, 128, 258, -1 };
+static const int lazy_list[] = { 4, 8, 16, 32, 64, 128, 258, -1 };
+static const int passes_list[] = { 1, 2, 3, 4, 6, 8, 10, -1 };      /* lazy of levels 10 to 12 */
+static const int nice_list[] = { 8, 16, 32, 64, 128, 258, -1 };
+static const int chain_list[] = { 4, 8, 16, 32, 64, 128, 256, 512, 1024, 4096, -1 };
+static const int search_list[] = { Z_SEARCH_DEFAULT, Z_SEARCH_GREEDY, Z_SEARCH_LAZY, Z_SEARCH_MEDIUM, -1 };
+
+static sample *samples;
+static unsigned nsamples;
+static size_t total_len, max_len;
+static unsigned char *out_buf, *back_buf;
+static size_t out_size;
+static int level = 6;
+static double min_time = 0.2;
+static double target_speed = 0, target_ratio = 0;
+
+static double now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void *xmalloc(size_t size) {
+    void *p = malloc(size);
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void load(const char *name) {
+    FILE *in = fopen(name, "rb");
+    sample *s;
+    size_t size = 65536, got;
+
+    if (in == NULL) {
+        fprintf(stderr, "tunedeflate: cannot open %s\n", name);
+        exit(1);
+    }
+    s = &samples[nsamples++];
+    s->data = (unsigned char *)xmalloc(size);
+    s->len = 0;
+    while ((got = fread(s->data + s->len, 1, size - s->len, in)) != 0) {
+        s->len += got;
+        if (s->len == size) {
+            unsigned char *more = (unsigned char *)realloc(s->data, size *= 2);
+            if (more == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            s->data = more;
+        }
+    }
+    if (ferror(in)) {
+        fprintf(stderr, "tunedeflate: cannot read %s\n", name);
+        exit(1);
+    }
+    fclose(in);
+    total_len += s->len;
+    if (s->len > max_len)
+        max_len = s->len;
+}
+
+/* Compress sample s with the configuration c into out_buf, and return the
+   compressed length. */
+static size_t compress_one(const config *c, const sample *s) {
+    zng_stream strm;
+    zng_deflate_param_value params[PARAMS];
+    int vals[PARAMS], i, err;
+
+    memset(&strm, 0, sizeof(strm));
+    if (zng_deflateInit(&strm, level) != Z_OK) {
+        fprintf(stderr, "tunedeflate: deflateInit failed\n");
+        exit(1);
+    }
+    for (i = 0; i < PARAMS; i++) {
+        vals[i] = c->vals[i];
+        params[i].param = param_ids[i];
+        params[i].buf = &vals[i];
+        params[i].size = sizeof(int);
+    }
+    if (zng_deflateSetParams(&strm, params, PARAMS) != Z_OK) {
+        fprintf(stderr, "tunedeflate: zng_deflateSetParams failed\n");
+        exit(1);
+    }
+    strm.next_in = s->data;
+    strm.avail_in = (uint32_t)s->len;
+    strm.next_out = out_buf;
+    strm.avail_out = (uint32_t)out_size;
+    err = zng_deflate(&strm, Z_FINISH);
+    zng_deflateEnd(&strm);
+    if (err != Z_STREAM_END) {
+        fprintf(stderr, "tunedeflate: deflate failed\n");
+        exit(1);
+    }
+    return (size_t)strm.total_out;
+}
+
+/* Fill in the size and speed of the configuration c. */
+static void measure(config *c) {
+    double start = now(), secs;
+    uint64_t bytes = 0;
+    unsigned i;
+
+    do {
+        c->size = 0;
+        for (i = 0; i < nsamples; i++)
+            c->size += compress_one(c, &samples[i]);
+        bytes += total_len;
+        secs = now() - start;
+    } while (secs < min_time);
+    c->speed = secs > 0 ? (double)bytes / secs / 1e6 : 0;
+}
+
+/* Return whether a is closer to the target than b. */
+static int better(const config *a, const config *b) {
+    if (target_ratio > 0) {
+        int a_ok = (double)total_len >= target_ratio * (double)a->size;
+        int b_ok = (double)total_len >= target_ratio * (double)b->size;
+
+        if (a_ok != b_ok)
+            return a_ok;
+        return a_ok ? a->speed > b->speed : a->size < b->size;
+    } else {
+        int a_ok = a->speed >= target_speed, b_ok = b->speed >= target_speed;
+
+        if (a_ok != b_ok)
+            return a_ok;
+        return a_ok ? a->size < b->size : a->speed > b->speed;
+    }
+}
+
+static void describe(const char *what, const config *c) {
+    printf("%-10s good %3d lazy %3d nice %3d chain %4d search %-7s: %10lu bytes, ratio %.3f, %.1f MB/s\n", what,
+           c->vals[GOOD], c->vals[LAZY], c->vals[NICE], c->vals[CHAIN], search_names[c->vals[SEARCH]],
+           (unsigned long)c->size, c->size ? (double)total_len / (double)c->size : 0, c->speed);
+}
+
+/* Check that the configuration c compresses every sample right. */
+static void verify(const config *c) {
+    unsigned i;
+
+    for (i = 0; i < nsamples; i++) {
+        size_t len = compress_one(c, &samples[i]), back_len = samples[i].len;
+
+        if (zng_uncompress(back_buf, &back_len, out_buf, len) != Z_OK || back_len != samples[i].len ||
+            memcmp(back_buf, samples[i].data, back_len)) {
+            fprintf(stderr, "tunedeflate: bad round trip of sample %u\n", i + 1);
+            exit(1);
+        }
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: tunedeflate [-l level] [-s MB/s | -r ratio] [-t seconds] files...\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    zng_stream strm;
+    zng_deflate_param_value params[PARAMS];
+    const int *lists[PARAMS];
+    config base, best, trial;
+    int i, p, changed, round = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (i + 1 == argc)
+            usage();
+        if (!strcmp(argv[i], "-l"))
+            level = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s"))
+            target_speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-r"))
+            target_ratio = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-t"))
+            min_time = atof(argv[++i]);
+        else
+            usage();
+    }
+    if (i == argc || level < 1 || level > 12 || target_speed < 0 || target_ratio < 0 ||
+        (target_speed > 0 && target_ratio > 0))
+        usage();
+
+    samples = (sample *)xmalloc((size_t)(argc - i) * sizeof(sample));
+    for (; i < argc; i++)
+        load(argv[i]);
+    out_size = (size_t)zng_deflateBound(NULL, (unsigned long)max_len);
+    out_buf = (unsigned char *)xmalloc(out_size);
+    back_buf = (unsigned char *)xmalloc(max_len ? max_len : 1);
+
+    /* Start from the configuration of the level */
+    memset(&strm, 0, sizeof(strm));
+    if (zng_deflateInit(&strm, level) != Z_OK) {
+        fprintf(stderr, "tunedeflate: deflateInit failed\n");
+        return 1;
+    }
+    for (p = 0; p < PARAMS; p++) {
+        params[p].param = param_ids[p];
+        params[p].buf = &base.vals[p];
+        params[p].size = sizeof(int);
+    }
+    if (zng_deflateGetParams(&strm, params, PARAMS) != Z_OK) {
+        fprintf(stderr, "tunedeflate: zng_deflateGetParams failed\n");
+        return 1;
+    }
+    zng_deflateEnd(&strm);
+    measure(&base);
+    if (target_speed == 0 && target_ratio == 0)
+        target_speed = base.speed;
+    printf("level %d, %u files, %lu bytes\n", level, nsamples, (unsigned long)total_len);
+    describe("level", &base);
+
+    lists[GOOD] = good_list;
+    lists[LAZY] = level > 9 ? passes_list : lazy_list;
+    lists[NICE] = nice_list;
+    lists[CHAIN] = chain_list;
+    lists[SEARCH] = search_list;
+
+    /* Try each value of each parameter in turn, keeping whatever is better */
+    best = base;
+    do {
+        changed = 0;
+        round++;
+        for (p = 0; p < PARAMS; p++) {
+            const int *v;
+
+            if (p == SEARCH && level > 9)
+                continue;   /* levels 10 to 12 have a search of their own */
+            for (v = lists[p]; *v != -1; v++) {
+                if (*v == best.vals[p])
+                    continue;
+                trial = best;
+                trial.vals[p] = *v;
+                measure(&trial);
+                if (better(&trial, &best)) {
+                    best = trial;
+                    changed = 1;
+                    printf("round %d, %-6s:", round, param_names[p]);
+                    describe("", &best);
+                }
+            }
+        }
+    } while (changed && round < 10);
+
+    verify(&best);
+    describe("tuned", &best);
+    if ((target_ratio > 0 ? (double)total_len < target_ratio * (double)best.size : best.speed < target_speed))
+        printf("the target was not reached\n");
+
+    printf("\nZ_DEFLATE_GOOD_LENGTH %d, Z_DEFLATE_MAX_LAZY %d, Z_DEFLATE_NICE_LENGTH %d, Z_DEFLATE_MAX_CHAIN %d",
+           best.vals[GOOD], best.vals[LAZY], best.vals[NICE], best.vals[CHAIN]);
+    if (level <= 9)
+        printf(", Z_DEFLATE_SEARCH %s", search_ids[best.vals[SEARCH]]);
+    printf("\n/* %d */ {%d, %d, %d, %d, %s},\n", level, best.vals[GOOD], best.vals[LAZY], best.vals[NICE],
+           best.vals[CHAIN], level <= 9 && search_funcs[best.vals[SEARCH]] ? search_funcs[best.vals[SEARCH]]
+                                                                           : "/* function of the level */");
+    return 0;
+}
+#endif
@@ -28,6 +28,14 @@
  *      Sedgewick, R.
  *          Algorithms, p290.
  *          Addison-Wesley, 1983. ISBN 0-201-06672-6.
+ *
+ *      Moffat, A. and Katajainen, J.
+ *          In-place calculation of minimum-redundancy codes.
+ *          WADS 1995, LNCS 955, pp. 393-402.
+ *
+ *      Larmore, L.L. and Hirschberg, D.S.
+ *          A fast algorithm for optimal length-limited Huffman codes.
+ *          JACM 37(3), 1990, pp. 464-473.
  */
 
 /* @(#) $Id$ */
@@ -36,6 +44,7 @@
 #include "deflate.h"
 #include "trees_p.h"
 #include "trees.h"
+#include "ztrace.h"
 
 #ifdef ZLIB_DEBUG
 #  include <ctype.h>
@@ -66,20 +75,35 @@ static const static_tree_desc  static_d_desc =
 static const static_tree_desc  static_bl_desc =
 {(const ct_data *)0, extra_blbits, 0,   BL_CODES, MAX_BL_BITS};
 
+/* Adaptive block splitting, see zng_tr_block_end() */
+#define SPLIT_INTERVAL 512      /* symbols between checks */
+#define SPLIT_MIN      2048     /* symbols in a block before it may be ended early */
+#define SPLIT_CUTOFF   100      /* difference in proportions that ends a block, in 256ths */
+
+/* Room in next_out needed besides the block to write it there directly: the
+ * bits left in bi_buf from the previous block and the final bi_windup().
+ */
+#define DIRECT_SLACK   16
+
+/* Blocks of up to this many symbols are checked for whether the dynamic trees
+ * can beat the static ones before they are built, see tr_early_choice()
+ */
+#define EARLY_SYMBOLS  2048
+
 /* ===========================================================================
  * Local (static) routines in this file.
  */
 
 static void init_block       (deflate_state *s);
-static void pqdownheap       (deflate_state *s, ct_data *tree, int k);
-static void gen_bitlen       (deflate_state *s, tree_desc *desc);
 static void build_tree       (deflate_state *s, tree_desc *desc);
 static void scan_tree        (deflate_state *s, ct_data *tree, int max_code);
 static void send_tree        (deflate_state *s, ct_data *tree, int max_code);
 static int  build_bl_tree    (deflate_state *s);
 static void send_all_trees   (deflate_state *s, int lcodes, int dcodes, int blcodes);
 static void compress_block   (deflate_state *s, const ct_data *ltree, const ct_data *dtree);
+static void compress_lits    (deflate_state *s, const ct_data *ltree, const unsigned char *buf, unsigned long len);
 static int  detect_data_type (deflate_state *s);
+static int  tr_early_choice  (deflate_state *s, unsigned long stored_len, int stored_ok);
 static void bi_flush         (deflate_state *s);
 
 /* ===========================================================================
@@ -123,11 +147,171 @@ static void init_block(deflate_state *s) {
     s->dyn_ltree[END_BLOCK].Freq = 1;
     s->opt_len = s->static_len = 0L;
     s->sym_next = s->matches = 0;
+    s->lit_block = 0;
+    s->sym_check = s->sym_end < SPLIT_INTERVAL * 3 ? s->sym_end : SPLIT_INTERVAL * 3;
+    memset(s->split_obs, 0, sizeof(s->split_obs));
 }
 
-#define SMALLEST 1
-/* Index within the heap array of least frequent node in the Huffman tree */
+/* Symbols up to this many are sorted by insertion instead of by radix sort */
+#define SORT_INSERT 32
+
+/* ===========================================================================
+ * Sort the n symbols at sym by increasing frequency in tree, keeping symbols
+ * of equal frequency in increasing order, with tmp as scratch space for n
+ * more. A byte of the frequencies at a time is counted and distributed, for
+ * as many bytes as max_freq has.
+ */
+static void sort_symbols(const ct_data *tree, int *sym, int *tmp, int n, uint32_t max_freq) {
+    unsigned int count[256];
+    unsigned int shift, pos, c, k;
+    int *from = sym, *to = tmp, *t;
+    int i, j, v;
+
+    if (n <= SORT_INSERT) {
+        for (i = 1; i < n; i++) {
+            v = sym[i];
+            for (j = i; j > 0 && tree[sym[j-1]].Freq > tree[v].Freq; j--)
+                sym[j] = sym[j-1];
+            sym[j] = v;
+        }
+        return;
+    }
+
+    for (shift = 0; shift < 32 && (max_freq >> shift) != 0; shift += 8) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; i++)
+            count[(tree[from[i]].Freq >> shift) & 0xff]++;
+        for (pos = 0, c = 0; c < 256; c++) {
+            k = count[c];
+            count[c] = pos;
+            pos += k;
+        }
+        for (i = 0; i < n; i++)
+            to[count[(tree[from[i]].Freq >> shift) & 0xff]++] = from[i];
+        t = from, from = to, to = t;
+    }
+    if (from != sym)
+        memcpy(sym, from, (size_t)n * sizeof(int));
+}
+
+/* ===========================================================================
+ * Replace the n >= 2 frequencies in increasing order at a by the lengths of
+ * an optimal prefix code for them, in place, with the algorithm of Moffat and
+ * Katajainen. The first pass combines the two smallest leaves or internal
+ * nodes, taking a leaf first on a tie, which keeps the longest code as short
+ * as possible, and leaves each internal node with the index of its parent.
+ * The second pass turns those into depths, and the third gives the leaves
+ * their depths from the number of internal nodes at each depth.
+ */
+static void huffman_lengths(uint32_t *a, int n) {
+    int root, leaf, next, avail, used;
+    uint32_t depth;
+
+    a[0] += a[1];
+    root = 0;
+    leaf = 2;
+    for (next = 1; next < n - 1; next++) {
+        if (leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = (uint32_t)next;
+        } else {
+            a[next] = a[leaf++];
+        }
+        if (leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = (uint32_t)next;
+        } else {
+            a[next] += a[leaf++];
+        }
+    }
+
+    a[n-2] = 0;
+    for (next = n - 3; next >= 0; next--)
+        a[next] = a[a[next]] + 1;
+
+    avail = 1;
+    used = 0;
+    depth = 0;
+    root = n - 2;
+    next = n - 1;
+    while (avail > 0) {
+        while (root >= 0 && a[root] == depth) {
+            used++;
+            root--;
+        }
+        while (avail > used) {
+            a[next--] = depth;
+            avail--;
+        }
+        avail = 2 * used;
+        depth++;
+        used = 0;
+    }
+}
+
+/* ===========================================================================
+ * Set the lengths at len of an optimal prefix code of at most max_length bits
+ * for the n frequencies in increasing order at freq, with the package-merge
+ * algorithm of Larmore and Hirschberg. Each list, from the one for the
+ * longest codes up, merges the leaves with the pairs of the list before it,
+ * and 2n-2 items are taken from the last list. The leaves taken from each list
+ * are always the first ones, so a code's length is the number of lists that
+ * take its leaf, and only whether each item is a leaf needs to be kept. Used
+ * when the Huffman code is too long, which is rare, so it need not be fast.
+ */
+static void limit_lengths(const uint32_t *freq, uint32_t *len, int n, unsigned int max_length) {
+    uint32_t list[2][2*L_CODES];
+    uint32_t is_leaf[MAX_BITS][(2*L_CODES+31)/32];
+    int items[MAX_BITS], leaves[MAX_BITS];
+    int i, j, k, m, pairs;
+    unsigned int level;
+
+    for (i = 0; i < n; i++)
+        list[0][i] = freq[i];
+    memset(is_leaf, 0, sizeof(is_leaf));
+    for (i = 0; i < n; i++)
+        is_leaf[0][i >> 5] |= 1U << (i & 31);
+    items[0] = n;
+
+    for (level = 1; level < max_length; level++) {
+        const uint32_t *prev = list[(level - 1) & 1];
+        uint32_t *cur = list[level & 1];
+
+        pairs = items[level-1] >> 1;
+        i = j = k = 0;
+        while (i < n || j < pairs) {
+            if (j == pairs || (i < n && freq[i] <= prev[2*j] + prev[2*j+1])) {
+                is_leaf[level][k >> 5] |= 1U << (k & 31);
+                cur[k++] = freq[i++];
+            } else {
+                cur[k++] = prev[2*j] + prev[2*j+1];
+                j++;
+            }
+        }
+        items[level] = k;
+    }
 
+    m = 2 * n - 2;
+    for (level = max_length; level-- != 0;) {
+        for (i = 0, k = 0; k < m; k++)
+            i += (is_leaf[level][k >> 5] >> (k & 31)) & 1;
+        leaves[level] = i;
+        m = 2 * (m - i);
+    }
+
+    for (i = 0; i < n; i++) {
+        len[i] = 0;
+        for (level = 0; level < max_length; level++)
+            len[i] += i < leaves[level];
+    }
+}
+
+#ifdef ZLIB_DEBUG
+/* ===========================================================================
+ * The classic construction with a heap, kept in debug builds to check that
+ * build_tree() never does worse. heap[SMALLEST] is the least frequent node.
+ */
+#define SMALLEST 1
 
 /* ===========================================================================
  * Remove the smallest element from the heap and recreate the heap with
@@ -179,99 +363,77 @@ static void pqdownheap(deflate_state *s, ct_data *tree, int k) {
 }
 
 /* ===========================================================================
- * Compute the optimal bit lengths for a tree and update the total bit length
- * for the current block.
- * IN assertion: the fields freq and dad are set, heap[heap_max] and
- *    above are the tree nodes sorted by increasing frequency.
- * OUT assertions: the field len is set to the optimal bit length, the
- *     array bl_count contains the frequencies for each bit length.
- *     The length opt_len is updated; static_len is also updated if stree is
- *     not null.
+ * Return the bits taken by the symbols of desc's tree with the lengths that
+ * the heap construction and its length limiting give them, for a tree with
+ * at least two symbols of non zero frequency.
  */
-static void gen_bitlen(deflate_state *s, tree_desc *desc) {
-    /* desc: the tree descriptor */
-    ct_data *tree           = desc->dyn_tree;
-    int max_code            = desc->max_code;
-    const ct_data *stree    = desc->stat_desc->static_tree;
-    const int *extra        = desc->stat_desc->extra_bits;
-    int base                = desc->stat_desc->extra_base;
+static unsigned long heap_tree_cost(deflate_state *s, const tree_desc *desc) {
+    ct_data tree[HEAP_SIZE];
+    const int *extra = desc->stat_desc->extra_bits;
+    int base         = desc->stat_desc->extra_base;
+    int elems        = desc->stat_desc->elems;
     unsigned int max_length = desc->stat_desc->max_length;
-    int h;              /* heap index */
-    int n, m;           /* iterate over the tree elements */
-    unsigned int bits;  /* bit length */
-    int xbits;          /* extra bits */
-    uint16_t f;         /* frequency */
-    int overflow = 0;   /* number of elements with bit length too large */
+    uint16_t bl_count[MAX_BITS+1];
+    unsigned long cost = 0;
+    unsigned int bits;
+    int n, m, h, node, overflow = 0;
 
-    for (bits = 0; bits <= MAX_BITS; bits++)
-        s->bl_count[bits] = 0;
-
-    /* In a first pass, compute the optimal bit lengths (which may
-     * overflow in the case of the bit length tree).
-     */
-    tree[s->heap[s->heap_max]].Len = 0; /* root of the heap */
+    s->heap_len = 0, s->heap_max = HEAP_SIZE;
+    for (n = 0; n < elems; n++) {
+        tree[n].Freq = desc->dyn_tree[n].Freq;
+        if (tree[n].Freq != 0) {
+            s->heap[++(s->heap_len)] = n;
+            s->depth[n] = 0;
+        }
+    }
+    for (n = s->heap_len/2; n >= 1; n--)
+        pqdownheap(s, tree, n);
+    node = elems;
+    do {
+        pqremove(s, tree, n);
+        m = s->heap[SMALLEST];
+        s->heap[--(s->heap_max)] = n;
+        s->heap[--(s->heap_max)] = m;
+        tree[node].Freq = tree[n].Freq + tree[m].Freq;
+        s->depth[node] = (unsigned char)((s->depth[n] >= s->depth[m] ? s->depth[n] : s->depth[m]) + 1);
+        tree[n].Dad = tree[m].Dad = (uint16_t)node;
+        s->heap[SMALLEST] = node++;
+        pqdownheap(s, tree, SMALLEST);
+    } while (s->heap_len >= 2);
+    s->heap[--(s->heap_max)] = s->heap[SMALLEST];
 
+    /* the lengths, then the same fix of the counts as zlib if too long */
+    memset(bl_count, 0, sizeof(bl_count));
+    tree[s->heap[s->heap_max]].Len = 0;
     for (h = s->heap_max+1; h < HEAP_SIZE; h++) {
         n = s->heap[h];
-        bits = tree[tree[n].Dad].Len + 1;
+        bits = tree[tree[n].Dad].Len + 1u;
         if (bits > max_length)
             bits = max_length, overflow++;
         tree[n].Len = (uint16_t)bits;
-        /* We overwrite tree[n].Dad which is no longer needed */
-
-        if (n > max_code) /* not a leaf node */
-            continue;
-
-        s->bl_count[bits]++;
-        xbits = 0;
-        if (n >= base)
-            xbits = extra[n-base];
-        f = tree[n].Freq;
-        s->opt_len += (unsigned long)f * (unsigned int)(bits + xbits);
-        if (stree)
-            s->static_len += (unsigned long)f * (unsigned int)(stree[n].Len + xbits);
+        if (n < elems)
+            bl_count[bits]++;
     }
-    if (overflow == 0)
-        return;
-
-    Tracev((stderr, "\nbit length overflow\n"));
-    /* This happens for example on obj2 and pic of the Calgary corpus */
-
-    /* Find the first bit length which could increase: */
-    do {
+    while (overflow > 0) {
         bits = max_length-1;
-        while (s->bl_count[bits] == 0)
+        while (bl_count[bits] == 0)
             bits--;
-        s->bl_count[bits]--;      /* move one leaf down the tree */
-        s->bl_count[bits+1] += 2; /* move one overflow item as its brother */
-        s->bl_count[max_length]--;
-        /* The brother of the overflow item also moves one step up,
-         * but this does not affect bl_count[max_length]
-         */
+        bl_count[bits]--;
+        bl_count[bits+1] += 2;
+        bl_count[max_length]--;
         overflow -= 2;
-    } while (overflow > 0);
-
-    /* Now recompute all bit lengths, scanning in increasing frequency.
-     * h is still equal to HEAP_SIZE. (It is simpler to reconstruct all
-     * lengths instead of fixing only the wrong ones. This idea is taken
-     * from 'ar' written by Haruhiko Okumura.)
-     */
+    }
     for (bits = max_length; bits != 0; bits--) {
-        n = s->bl_count[bits];
-        while (n != 0) {
-            m = s->heap[--h];
-            if (m > max_code)
-                continue;
-            if (tree[m].Len != bits) {
-                Tracev((stderr, "code %d bits %d->%u\n", m, tree[m].Len, bits));
-                s->opt_len += (unsigned long)(bits * tree[m].Freq);
-                s->opt_len -= (unsigned long)(tree[m].Len * tree[m].Freq);
-                tree[m].Len = (uint16_t)bits;
-            }
-            n--;
+        for (n = bl_count[bits]; n != 0; n--) {
+            do {
+                m = s->heap[--h];
+            } while (m >= elems);
+            cost += (unsigned long)tree[m].Freq * (bits + (m >= base ? (unsigned int)extra[m-base] : 0u));
         }
     }
+    return cost;
 }
+#endif
 
 /* ===========================================================================
  * Generate the codes for a given tree and bit counts (which need not be
@@ -322,26 +484,34 @@ ZLIB_INTERNAL void gen_codes(ct_data *tree, int max_code, uint16_t *bl_count) {
  * OUT assertions: the fields len and code are set to the optimal bit length
  *     and corresponding code. The length opt_len is updated; static_len is
  *     also updated if stree is not null. The field max_code is set.
+ *
+ * The symbols are sorted by frequency and given their lengths by
+ * huffman_lengths(), or by limit_lengths() if that makes a code longer than
+ * allowed, so the lengths are optimal also then. heap holds the sorted
+ * symbols.
  */
 static void build_tree(deflate_state *s, tree_desc *desc) {
     /* desc: the tree descriptor */
-    ct_data *tree         = desc->dyn_tree;
-    const ct_data *stree  = desc->stat_desc->static_tree;
-    int elems             = desc->stat_desc->elems;
-    int n, m;          /* iterate over heap elements */
-    int max_code = -1; /* largest code with non zero frequency */
-    int node;          /* new node being created */
-
-    /* Construct the initial heap, with least frequent element in
-     * heap[SMALLEST]. The sons of heap[n] are heap[2*n] and heap[2*n+1].
-     * heap[0] is not used.
-     */
-    s->heap_len = 0, s->heap_max = HEAP_SIZE;
-
-    for (n = 0; n < elems; n++) {
+    ct_data *tree           = desc->dyn_tree;
+    const ct_data *stree    = desc->stat_desc->static_tree;
+    const int *extra        = desc->stat_desc->extra_bits;
+    int base                = desc->stat_desc->extra_base;
+    int elems               = desc->stat_desc->elems;
+    unsigned int max_length = desc->stat_desc->max_length;
+    int *sym = s->heap;         /* symbols of non zero frequency */
+    uint32_t len[L_CODES];      /* their lengths, in the same order */
+    uint32_t max_freq = 0;
+    unsigned long cost = 0;
+    unsigned int bits;
+    int n, m, xbits;
+    int max_code = -1;          /* largest code with non zero frequency */
+    int node;
+
+    for (n = 0, m = 0; n < elems; n++) {
         if (tree[n].Freq != 0) {
-            s->heap[++(s->heap_len)] = max_code = n;
-            s->depth[n] = 0;
+            sym[m++] = max_code = n;
+            if (tree[n].Freq > max_freq)
+                max_freq = tree[n].Freq;
         } else {
             tree[n].Len = 0;
         }
@@ -352,10 +522,11 @@ static void build_tree(deflate_state *s, tree_desc *desc) {
      * possible code. So to avoid special checks later on we force at least
      * two codes of non zero frequency.
      */
-    while (s->heap_len < 2) {
-        node = s->heap[++(s->heap_len)] = (max_code < 2 ? ++max_code : 0);
+    while (m < 2) {
+        node = sym[m++] = (max_code < 2 ? ++max_code : 0);
         tree[node].Freq = 1;
-        s->depth[node] = 0;
+        if (max_freq == 0)
+            max_freq = 1;
         s->opt_len--;
         if (stree)
             s->static_len -= stree[node].Len;
@@ -363,45 +534,40 @@ static void build_tree(deflate_state *s, tree_desc *desc) {
     }
     desc->max_code = max_code;
 
-    /* The elements heap[heap_len/2+1 .. heap_len] are leaves of the tree,
-     * establish sub-heaps of increasing lengths:
-     */
-    for (n = s->heap_len/2; n >= 1; n--)
-        pqdownheap(s, tree, n);
-
-    /* Construct the Huffman tree by repeatedly combining the least two
-     * frequent nodes.
-     */
-    node = elems;              /* next internal node of the tree */
-    do {
-        pqremove(s, tree, n);  /* n = node of least frequency */
-        m = s->heap[SMALLEST]; /* m = node of next least frequency */
-
-        s->heap[--(s->heap_max)] = n; /* keep the nodes sorted by frequency */
-        s->heap[--(s->heap_max)] = m;
+    sort_symbols(tree, sym, sym + L_CODES, m, max_freq);
+    for (n = 0; n < m; n++)
+        len[n] = tree[sym[n]].Freq;
+    huffman_lengths(len, m);
+    if (len[0] > max_length) {
+        uint32_t freq[L_CODES];
+
+        Tracev((stderr, "\nbit length overflow\n"));
+        /* This happens for example on obj2 and pic of the Calgary corpus */
+        for (n = 0; n < m; n++)
+            freq[n] = tree[sym[n]].Freq;
+        limit_lengths(freq, len, m, max_length);
+    }
 
-        /* Create a new node father of n and m */
-        tree[node].Freq = tree[n].Freq + tree[m].Freq;
-        s->depth[node] = (unsigned char)((s->depth[n] >= s->depth[m] ?
-                                          s->depth[n] : s->depth[m]) + 1);
-        tree[n].Dad = tree[m].Dad = (uint16_t)node;
+    for (bits = 0; bits <= MAX_BITS; bits++)
+        s->bl_count[bits] = 0;
+    for (n = 0; n < m; n++) {
+        node = sym[n];
+        bits = len[n];
+        tree[node].Len = (uint16_t)bits;
+        s->bl_count[bits]++;
+        xbits = node >= base ? extra[node-base] : 0;
+        cost += (unsigned long)tree[node].Freq * (bits + (unsigned int)xbits);
+        if (stree)
+            s->static_len += (unsigned long)tree[node].Freq * (unsigned int)(stree[node].Len + xbits);
+    }
+    s->opt_len += cost;
 #ifdef DUMP_BL_TREE
-        if (tree == s->bl_tree) {
-            fprintf(stderr, "\nnode %d(%d), sons %d(%d) %d(%d)",
-                    node, tree[node].Freq, n, tree[n].Freq, m, tree[m].Freq);
-        }
+    if (tree == s->bl_tree) {
+        for (n = 0; n < m; n++)
+            fprintf(stderr, "\nbl code %d(%u) len %u", sym[n], tree[sym[n]].Freq, tree[sym[n]].Len);
+    }
 #endif
-        /* and insert the new node in the heap */
-        s->heap[SMALLEST] = node++;
-        pqdownheap(s, tree, SMALLEST);
-    } while (s->heap_len >= 2);
-
-    s->heap[--(s->heap_max)] = s->heap[SMALLEST];
-
-    /* At this point, the fields freq and dad are set. We can now
-     * generate the bit lengths.
-     */
-    gen_bitlen(s, (tree_desc *)desc);
+    Assert(cost <= heap_tree_cost(s, desc), "worse code lengths than the heap construction");
 
     /* The field len is now set, we can generate the bit codes */
     gen_codes((ct_data *)tree, max_code, s->bl_count);
@@ -476,7 +642,7 @@ static void send_tree(deflate_state *s, ct_data *tree, int max_code) {
 
     // Temp local variables
     int filled = s->bi_valid;
-    uint16_t bit_buf = s->bi_buf;
+    uint64_t bit_buf = s->bi_buf;
 
     for (n = 0; n <= max_code; n++) {
         curlen = nextlen;
@@ -566,7 +732,7 @@ static void send_all_trees(deflate_state *s, int lcodes, int dcodes, int blcodes
 
     // Temp local variables
     int filled = s->bi_valid;
-    uint16_t bit_buf = s->bi_buf;
+    uint64_t bit_buf = s->bi_buf;
 
     Tracev((stderr, "\nbl counts: "));
     send_bits(s, lcodes-257, 5, bit_buf, filled); /* not +255 as stated in appnote.txt */
@@ -597,6 +763,7 @@ void ZLIB_INTERNAL zng_tr_stored_block(deflate_state *s, char *buf, unsigned lon
     /* stored_len: length of input block */
     /* last: one if this is the last block for a file */
     send_bits(s, (STORED_BLOCK << 1)+last, 3, s->bi_buf, s->bi_valid);    /* send block type */
+    STATS_ADD(s, stored_blocks, 1);
     bi_windup(s);        /* align on byte boundary */
     put_short(s, (uint16_t)stored_len);
     put_short(s, (uint16_t)~stored_len);
@@ -631,6 +798,196 @@ void ZLIB_INTERNAL zng_tr_align(deflate_state *s) {
     bi_flush(s);
 }
 
+/* ===========================================================================
+ * Build the code lengths for the symbol frequencies in freq with the same
+ * construction as a dynamic block, without touching the block's own trees.
+ * Symbols that do not occur get one bit more than the longest code, as an
+ * estimate of what they would cost if they were used.
+ */
+static void tr_code_lengths(deflate_state *s, const uint32_t *freq, const static_tree_desc *stat_desc,
+                            unsigned char *len) {
+    ct_data tree[HEAP_SIZE];
+    tree_desc desc;
+    unsigned long opt_len = s->opt_len, static_len = s->static_len;
+    unsigned int max_len = 0;
+    int n;
+
+    for (n = 0; n < stat_desc->elems; n++)
+        tree[n].Freq = freq[n];
+
+    desc.dyn_tree = tree;
+    desc.max_code = 0;
+    desc.stat_desc = stat_desc;
+    build_tree(s, &desc);
+    /* build_tree() adds to the block lengths, which are not about this tree */
+    s->opt_len = opt_len;
+    s->static_len = static_len;
+
+    for (n = 0; n < stat_desc->elems; n++) {
+        if (tree[n].Len > max_len)
+            max_len = tree[n].Len;
+    }
+    if (max_len < MAX_BITS)
+        max_len++;
+    for (n = 0; n < stat_desc->elems; n++)
+        len[n] = (unsigned char)(tree[n].Len != 0 ? tree[n].Len : max_len);
+}
+
+/* ===========================================================================
+ * Set the cost in bits of each literal, match length and distance code,
+ * including extra bits, for the dynamic trees of the current block with
+ * the frequencies in lfreq and dfreq added to it. If lfreq is NULL, use the
+ * static trees instead. Used as the cost model of deflate_optimal().
+ */
+void ZLIB_INTERNAL zng_tr_costs(deflate_state *s, const uint32_t *lfreq, const uint32_t *dfreq,
+                                unsigned char *lit_cost, unsigned char *len_cost, unsigned char *dist_cost) {
+    uint32_t freq[L_CODES];
+    unsigned char llen[L_CODES], dlen[D_CODES];
+    int n, code;
+
+    if (lfreq == NULL) {
+        for (n = 0; n < L_CODES; n++)
+            llen[n] = (unsigned char)static_ltree[n].Len;
+        for (n = 0; n < D_CODES; n++)
+            dlen[n] = (unsigned char)static_dtree[n].Len;
+    } else {
+        for (n = 0; n < L_CODES; n++)
+            freq[n] = s->dyn_ltree[n].Freq + lfreq[n];
+        tr_code_lengths(s, freq, &static_l_desc, llen);
+        for (n = 0; n < D_CODES; n++)
+            freq[n] = s->dyn_dtree[n].Freq + dfreq[n];
+        tr_code_lengths(s, freq, &static_d_desc, dlen);
+    }
+
+    for (n = 0; n < LITERALS; n++)
+        lit_cost[n] = llen[n];
+    for (n = 0; n < MAX_MATCH-MIN_MATCH+1; n++) {
+        code = zng_length_code[n];
+        len_cost[n] = (unsigned char)(llen[code+LITERALS+1] + extra_lbits[code]);
+    }
+    for (n = 0; n < D_CODES; n++)
+        dist_cost[n] = (unsigned char)(dlen[n] + extra_dbits[n]);
+}
+
+/* log2(1 + i/64) in 4096ths of a bit, rounded down */
+static const uint16_t log2_frac[65] = {
+       0,   91,  181,  270,  358,  444,  529,  613,  696,  777,  857,  937, 1015,
+    1092, 1169, 1244, 1318, 1392, 1464, 1536, 1606, 1676, 1745, 1814, 1881, 1948,
+    2014, 2079, 2144, 2208, 2271, 2334, 2396, 2457, 2517, 2577, 2637, 2696, 2754,
+    2811, 2869, 2925, 2981, 3037, 3092, 3146, 3200, 3253, 3306, 3359, 3411, 3463,
+    3514, 3565, 3615, 3665, 3714, 3763, 3812, 3860, 3908, 3955, 4002, 4049, 4096
+};
+
+/* ===========================================================================
+ * Return log2(x) for x > 0 in 4096ths of a bit, rounded down if up is zero and
+ * up otherwise.
+ */
+static uint32_t log2_bound(uint32_t x, int up) {
+    unsigned int e, i;
+
+#if defined(__GNUC__)
+    e = 31 - (unsigned int)__builtin_clz(x);
+#else
+    for (e = 0; x >> e > 1; e++)
+        ;
+#endif
+    i = (e >= 6 ? x >> (e - 6) : x << (6 - e)) & 63;
+    return (e << 12) + (up ? log2_frac[i + 1] + 1U : log2_frac[i]);
+}
+
+/* ===========================================================================
+ * Return a lower bound of the bits that the total symbols of tree take with
+ * any prefix code, which is their count times their entropy.
+ */
+static unsigned long tree_entropy(const ct_data *tree, int elems, uint32_t total) {
+    uint64_t sum = 0, all;
+    int n;
+
+    if (total == 0)
+        return 0;
+    for (n = 0; n < elems; n++)
+        if (tree[n].Freq != 0)
+            sum += (uint64_t)tree[n].Freq * log2_bound(tree[n].Freq, 1);
+    all = (uint64_t)total * log2_bound(total, 0);
+    return all > sum ? (unsigned long)((all - sum) >> 12) : 0;
+}
+
+/* ===========================================================================
+ * Decide between the static trees and a stored block without building the
+ * dynamic trees, if they cannot change the choice, and return true if so.
+ * static_len is then set, and opt_len too, to the same value. The dynamic
+ * trees are not needed:
+ * - when the static trees take no more bits than a lower bound of opt_len,
+ *   the entropy of the symbols plus the least that the tree representations
+ *   take, which is 3 bits for each of the first four bit length codes, the
+ *   counts, and half a bit for each code length that is not zero
+ * - when a stored block is no larger than the static trees or than that
+ *   bound
+ * - with Z_FIXED, when a stored block is larger than the static trees.
+ * The block is sent as the full decision in zng_tr_flush_block() would send
+ * it. The bound is only computed for text blocks of fewer than EARLY_SYMBOLS
+ * symbols, as the dynamic trees all but always win on longer ones and on
+ * binary data, and only if its upper limit, with the entropy at its most,
+ * could make a difference. The static lengths of the literals are 8 bits
+ * below 144 and 9 bits from there on, so they are summed, as are the codes
+ * used, without a branch on each code.
+ */
+static int tr_early_choice(deflate_state *s, unsigned long stored_len, int stored_ok) {
+    unsigned long static_len, extra = 0, lower, upper;
+    unsigned long static_lenb;
+    unsigned int lused = 1, dused = 0, xbits;    /* lused counts END_BLOCK */
+    uint32_t lo = 0, hi = 0, lsyms, dsyms = 0;
+    int n;
+
+    if (s->strategy != Z_FIXED && (s->strm->data_type != Z_TEXT || s->sym_next / 3 >= EARLY_SYMBOLS))
+        return 0;
+    for (n = 0; n < 144; n++) {
+        lo += s->dyn_ltree[n].Freq;
+        lused += s->dyn_ltree[n].Freq != 0;
+    }
+    for (n = 144; n < LITERALS; n++) {
+        hi += s->dyn_ltree[n].Freq;
+        lused += s->dyn_ltree[n].Freq != 0;
+    }
+    lsyms = lo + hi + s->dyn_ltree[END_BLOCK].Freq;
+    static_len = 8 * (unsigned long)lo + 9 * (unsigned long)hi + 7 * (unsigned long)s->dyn_ltree[END_BLOCK].Freq;
+    for (n = LITERALS + 1; n < L_CODES; n++) {
+        xbits = (unsigned int)extra_lbits[n - LITERALS - 1];
+        lsyms += s->dyn_ltree[n].Freq;
+        lused += s->dyn_ltree[n].Freq != 0;
+        static_len += (unsigned long)s->dyn_ltree[n].Freq * (static_ltree[n].Len + xbits);
+        extra += (unsigned long)s->dyn_ltree[n].Freq * xbits;
+    }
+    for (n = 0; n < D_CODES; n++) {
+        xbits = (unsigned int)extra_dbits[n];
+        dsyms += s->dyn_dtree[n].Freq;
+        dused += s->dyn_dtree[n].Freq != 0;
+        static_len += (unsigned long)s->dyn_dtree[n].Freq * (static_dtree[n].Len + xbits);
+        extra += (unsigned long)s->dyn_dtree[n].Freq * xbits;
+    }
+    static_lenb = (static_len+3+7) >> 3;
+    stored_ok = stored_ok && stored_len+4 <= static_lenb;
+
+    if (s->strategy == Z_FIXED && !stored_ok)
+        goto early;
+    if (lsyms + dsyms > EARLY_SYMBOLS)
+        return 0;
+
+    extra += 3*4 + 5+5+4 + (lused + dused) / 2;
+    upper = extra + (unsigned long)(((uint64_t)lsyms * log2_bound(lused, 1) +
+                                     (dused ? (uint64_t)dsyms * log2_bound(dused, 1) : 0) + 4095) >> 12);
+    if (static_len > upper && !(stored_ok && stored_len+4 <= (upper+3+7) >> 3))
+        return 0;
+    lower = extra + tree_entropy(s->dyn_ltree, L_CODES, lsyms) + tree_entropy(s->dyn_dtree, D_CODES, dsyms);
+    if (static_len <= lower || (stored_ok && stored_len+4 <= (lower+3+7) >> 3))
+        goto early;
+    return 0;
+
+early:
+    s->static_len = s->opt_len = static_len;
+    return 1;
+}
+
 /* ===========================================================================
  * Determine the best encoding for the current block: dynamic trees, static
  * trees or store, and write out the encoded block.
@@ -640,7 +997,13 @@ void ZLIB_INTERNAL zng_tr_flush_block(deflate_state *s, char *buf, unsigned long
     /* stored_len: length of input block */
     /* last: one if this is the last block for a file */
     unsigned long opt_lenb, static_lenb; /* opt_len and static_len in bytes */
+    unsigned long max_lenb;               /* largest size the block is sent with */
+    unsigned char *pending_buf = NULL;    /* saved pending_buf while writing to next_out */
+    unsigned long pending_buf_size = 0;
     int max_blindex = 0;  /* index of last bit length code of non zero freq */
+    STATS_TIMER_START(start);
+
+    ZTRACE2(deflate_block_start, s->strm, stored_len);
 
     /* Build the Huffman trees unless a stored block is forced */
     if (s->level > 0) {
@@ -648,35 +1011,54 @@ void ZLIB_INTERNAL zng_tr_flush_block(deflate_state *s, char *buf, unsigned long
         if (s->strm->data_type == Z_UNKNOWN)
             s->strm->data_type = detect_data_type(s);
 
-        /* Construct the literal and distance trees */
-        build_tree(s, (tree_desc *)(&(s->l_desc)));
-        Tracev((stderr, "\nlit data: dyn %lu, stat %lu", s->opt_len, s->static_len));
-
-        build_tree(s, (tree_desc *)(&(s->d_desc)));
-        Tracev((stderr, "\ndist data: dyn %lu, stat %lu", s->opt_len, s->static_len));
-        /* At this point, opt_len and static_len are the total bit lengths of
-         * the compressed block data, excluding the tree representations.
-         */
-
-        /* Build the bit length tree for the above two trees, and get the index
-         * in bl_order of the last bit length code to send.
-         */
-        max_blindex = build_bl_tree(s);
-
-        /* Determine the best encoding. Compute the block lengths in bytes. */
-        opt_lenb = (s->opt_len+3+7) >> 3;
-        static_lenb = (s->static_len+3+7) >> 3;
-
-        Tracev((stderr, "\nopt %lu(%lu) stat %lu(%lu) stored %lu lit %u ",
-                opt_lenb, s->opt_len, static_lenb, s->static_len, stored_len,
-                s->sym_next / 3));
-
-        if (static_lenb <= opt_lenb)
-            opt_lenb = static_lenb;
-
+        if (tr_early_choice(s, stored_len, buf != NULL)) {
+            /* The dynamic trees cannot change the choice */
+            opt_lenb = static_lenb = max_lenb = (s->static_len+3+7) >> 3;
+            Tracev((stderr, "\nearly stat %lu(%lu) stored %lu lit %u ", static_lenb, s->static_len, stored_len,
+                    s->sym_next / 3));
+        } else {
+            /* Construct the literal and distance trees */
+            build_tree(s, (tree_desc *)(&(s->l_desc)));
+            Tracev((stderr, "\nlit data: dyn %lu, stat %lu", s->opt_len, s->static_len));
+
+            build_tree(s, (tree_desc *)(&(s->d_desc)));
+            Tracev((stderr, "\ndist data: dyn %lu, stat %lu", s->opt_len, s->static_len));
+            /* At this point, opt_len and static_len are the total bit lengths of
+             * the compressed block data, excluding the tree representations.
+             */
+
+            /* Build the bit length tree for the above two trees, and get the index
+             * in bl_order of the last bit length code to send.
+             */
+            max_blindex = build_bl_tree(s);
+
+            /* Determine the best encoding. Compute the block lengths in bytes. */
+            opt_lenb = (s->opt_len+3+7) >> 3;
+            static_lenb = (s->static_len+3+7) >> 3;
+
+            Tracev((stderr, "\nopt %lu(%lu) stat %lu(%lu) stored %lu lit %u ",
+                    opt_lenb, s->opt_len, static_lenb, s->static_len, stored_len,
+                    s->sym_next / 3));
+
+            max_lenb = opt_lenb > static_lenb ? opt_lenb : static_lenb;
+            if (static_lenb <= opt_lenb)
+                opt_lenb = static_lenb;
+        }
     } else {
         Assert(buf != NULL, "lost buf");
         opt_lenb = static_lenb = stored_len + 5; /* force a stored block */
+        max_lenb = opt_lenb;
+    }
+
+    /* If nothing is pending and the block fits in next_out, write it there
+     * instead of to pending_buf, which saves copying it in flush_pending().
+     * The symbols are read from sym_buf, so pending_buf is left as it is.
+     */
+    if (s->pending == 0 && s->strm->avail_out >= max_lenb + DIRECT_SLACK) {
+        pending_buf = s->pending_buf;
+        pending_buf_size = s->pending_buf_size;
+        s->pending_buf = s->strm->next_out;
+        s->pending_buf_size = s->strm->avail_out;
     }
 
 #ifdef FORCE_STORED
@@ -699,14 +1081,22 @@ void ZLIB_INTERNAL zng_tr_flush_block(deflate_state *s, char *buf, unsigned long
     } else if (s->strategy == Z_FIXED || static_lenb == opt_lenb) {
 #endif
         send_bits(s, (STATIC_TREES << 1)+last, 3, s->bi_buf, s->bi_valid);
-        compress_block(s, (const ct_data *)static_ltree, (const ct_data *)static_dtree);
+        if (s->lit_block)
+            compress_lits(s, (const ct_data *)static_ltree, (const unsigned char *)buf, stored_len);
+        else
+            compress_block(s, (const ct_data *)static_ltree, (const ct_data *)static_dtree);
+        STATS_ADD(s, fixed_blocks, 1);
 #ifdef ZLIB_DEBUG
         s->compressed_len += 3 + s->static_len;
 #endif
     } else {
         send_bits(s, (DYN_TREES << 1)+last, 3, s->bi_buf, s->bi_valid);
         send_all_trees(s, s->l_desc.max_code+1, s->d_desc.max_code+1, max_blindex+1);
-        compress_block(s, (const ct_data *)s->dyn_ltree, (const ct_data *)s->dyn_dtree);
+        if (s->lit_block)
+            compress_lits(s, (const ct_data *)s->dyn_ltree, (const unsigned char *)buf, stored_len);
+        else
+            compress_block(s, (const ct_data *)s->dyn_ltree, (const ct_data *)s->dyn_dtree);
+        STATS_ADD(s, dynamic_blocks, 1);
 #ifdef ZLIB_DEBUG
         s->compressed_len += 3 + s->opt_len;
 #endif
@@ -723,7 +1113,21 @@ void ZLIB_INTERNAL zng_tr_flush_block(deflate_state *s, char *buf, unsigned long
         s->compressed_len += 7;  /* align on byte boundary */
 #endif
     }
+
+    if (pending_buf != NULL) {
+        PREFIX3(stream) *strm = s->strm;
+
+        strm->next_out += s->pending;
+        strm->avail_out -= s->pending;
+        strm->total_out += s->pending;
+        s->pending = 0;
+        s->pending_buf = pending_buf;
+        s->pending_buf_size = pending_buf_size;
+        s->pending_out = pending_buf;
+    }
     Tracev((stderr, "\ncomprlen %lu(%lu) ", s->compressed_len>>3, s->compressed_len-7*last));
+    ZTRACE4(deflate_block_done, s->strm, stored_len, s->strm->total_out + s->pending, last);
+    STATS_TIMER_END(s, flush_block_ns, start);
 }
 
 /* ===========================================================================
@@ -739,8 +1143,11 @@ int ZLIB_INTERNAL zng_tr_tally(deflate_state *s, unsigned dist, unsigned lc) {
     if (dist == 0) {
         /* lc is the unmatched char */
         s->dyn_ltree[lc].Freq++;
+        STATS_ADD(s, literals, 1);
     } else {
         s->matches++;
+        STATS_ADD(s, matches, 1);
+        STATS_ADD(s, match_bytes, lc + MIN_MATCH);
         /* Here, lc is the match length - MIN_MATCH */
         dist--;             /* dist = match distance - 1 */
         Assert((uint16_t)dist < (uint16_t)MAX_DIST(s) &&
@@ -750,7 +1157,127 @@ int ZLIB_INTERNAL zng_tr_tally(deflate_state *s, unsigned dist, unsigned lc) {
         s->dyn_ltree[zng_length_code[lc]+LITERALS+1].Freq++;
         s->dyn_dtree[d_code(dist)].Freq++;
     }
-    return (s->sym_next == s->sym_end);
+    return (s->sym_next == s->sym_check && zng_tr_block_end(s));
+}
+
+/* ===========================================================================
+ * Tally the len literals at buf, which must continue the input of the current
+ * block in the window, without writing them to sym_buf: the block is then
+ * sent straight from its input by compress_lits(). sym_next still counts
+ * three bytes per literal, so that the block ends where it would have
+ * otherwise. Long runs are counted into four tables, so that increments of
+ * the same counter do not wait on each other, and then added together.
+ * Return true if the current block must be flushed.
+ */
+int ZLIB_INTERNAL zng_tr_tally_lits(deflate_state *s, const unsigned char *buf, unsigned len) {
+    unsigned i = 0;
+    int n;
+
+    Assert(s->lit_block || s->sym_next == 0, "literals after symbols");
+    Assert(len <= (s->sym_check - s->sym_next) / 3, "literals past the check");
+    s->lit_block = 1;
+    if (len >= 1024) {
+        uint32_t freq[4][LITERALS];
+
+        memset(freq, 0, sizeof(freq));
+        for (; i + 4 <= len; i += 4) {
+            freq[0][buf[i]]++;
+            freq[1][buf[i+1]]++;
+            freq[2][buf[i+2]]++;
+            freq[3][buf[i+3]]++;
+        }
+        for (n = 0; n < LITERALS; n++)
+            s->dyn_ltree[n].Freq += freq[0][n] + freq[1][n] + freq[2][n] + freq[3][n];
+    }
+    for (; i < len; i++)
+        s->dyn_ltree[buf[i]].Freq++;
+    s->sym_next += len * 3;
+    STATS_ADD(s, literals, len);
+    return (s->sym_next == s->sym_check && zng_tr_block_end(s));
+}
+
+/* ===========================================================================
+ * Write the literals tallied by zng_tr_tally_lits() from buf, the input of
+ * the current block, to sym_buf, so that other symbols can follow them.
+ */
+void ZLIB_INTERNAL zng_tr_lits_to_syms(deflate_state *s, const unsigned char *buf) {
+    unsigned sx;
+
+    Assert(s->lit_block && buf != NULL, "no literals to write");
+    for (sx = 0; sx < s->sym_next; sx += 3) {
+        s->sym_buf[sx] = 0;
+        s->sym_buf[sx+1] = 0;
+        s->sym_buf[sx+2] = *buf++;
+    }
+    s->lit_block = 0;
+}
+
+/* ===========================================================================
+ * Count the symbols of the current block by type: eight ranges of literals,
+ * short and long lengths, and near and far distances.
+ */
+static void tr_split_count(const deflate_state *s, uint32_t *obs) {
+    int n, t;
+
+    for (t = 0; t < 8; t++) {
+        uint32_t sum = 0;
+        for (n = t << 5; n < (t + 1) << 5; n++)
+            sum += s->dyn_ltree[n].Freq;
+        obs[t] = sum;
+    }
+    obs[8] = obs[9] = obs[10] = obs[11] = 0;
+    for (n = LITERALS+1; n < LITERALS+1+8; n++)     /* lengths 3..10 */
+        obs[8] += s->dyn_ltree[n].Freq;
+    for (; n < L_CODES; n++)
+        obs[9] += s->dyn_ltree[n].Freq;
+    for (n = 0; n < 10; n++)                        /* distances 1..32 */
+        obs[10] += s->dyn_dtree[n].Freq;
+    for (; n < D_CODES; n++)
+        obs[11] += s->dyn_dtree[n].Freq;
+}
+
+/* ===========================================================================
+ * Called by the tally functions when sym_next reaches sym_check. Return true
+ * if the current block must be flushed, either because sym_buf is full or
+ * because the symbols since the last check, SPLIT_INTERVAL of them, are
+ * distributed differently enough from the ones before them that the rest of
+ * the data would be better off with Huffman codes of its own. The
+ * distributions are compared by the types of tr_split_count(), which gives
+ * few enough types for a short interval to be a usable sample.
+ */
+int ZLIB_INTERNAL zng_tr_block_end(deflate_state *s) {
+    uint32_t obs[SPLIT_TYPES], old_n = 0, new_n = 0;
+    uint64_t delta = 0, cutoff;
+    int t;
+
+    if (s->sym_next == s->sym_end)
+        return 1;
+    if (s->block_split < 0 ? s->level < 4 : !s->block_split) {
+        s->sym_check = s->sym_end;
+        return 0;
+    }
+    s->sym_check = s->sym_end - s->sym_next < SPLIT_INTERVAL * 3 ? s->sym_end : s->sym_next + SPLIT_INTERVAL * 3;
+
+    tr_split_count(s, obs);
+    for (t = 0; t < SPLIT_TYPES; t++) {
+        old_n += s->split_obs[t];
+        new_n += obs[t] - s->split_obs[t];
+    }
+    if (s->sym_next >= SPLIT_MIN * 3) {
+        /* Sum of the differences in proportion, scaled by old_n * new_n */
+        for (t = 0; t < SPLIT_TYPES; t++) {
+            uint64_t expected = (uint64_t)s->split_obs[t] * new_n;
+            uint64_t actual = (uint64_t)(obs[t] - s->split_obs[t]) * old_n;
+            delta += actual > expected ? actual - expected : expected - actual;
+        }
+        cutoff = (uint64_t)old_n * new_n * SPLIT_CUTOFF / 256;
+        if (delta > cutoff) {
+            s->sym_check = s->sym_end;
+            return 1;
+        }
+    }
+    memcpy(s->split_obs, obs, sizeof(obs));
+    return 0;
 }
 
 /* ===========================================================================
@@ -767,7 +1294,7 @@ static void compress_block(deflate_state *s, const ct_data *ltree, const ct_data
 
     // Temp local variables
     int filled = s->bi_valid;
-    uint16_t bit_buf = s->bi_buf;
+    uint64_t bit_buf = s->bi_buf;
 
     if (s->sym_next != 0) {
         do {
@@ -810,6 +1337,29 @@ static void compress_block(deflate_state *s, const ct_data *ltree, const ct_data
     s->bi_valid = filled;
 }
 
+/* ===========================================================================
+ * Send the literals of a block tallied by zng_tr_tally_lits() from its input
+ */
+static void compress_lits(deflate_state *s, const ct_data *ltree, const unsigned char *buf, unsigned long len) {
+    unsigned long i;
+
+    // Temp local variables
+    int filled = s->bi_valid;
+    uint64_t bit_buf = s->bi_buf;
+
+    Assert(buf != NULL && len == s->sym_next / 3, "lost literals");
+    for (i = 0; i < len; i++) {
+        send_code(s, buf[i], ltree, bit_buf, filled);
+        Tracecv(isgraph(buf[i]), (stderr, " '%c' ", buf[i]));
+    }
+
+    send_code(s, END_BLOCK, ltree, bit_buf, filled);
+
+    // Store back temp variables
+    s->bi_buf = bit_buf;
+    s->bi_valid = filled;
+}
+
 /* ===========================================================================
  * Check if the data type is TEXT or BINARY, using the following algorithm:
  * - TEXT if the two conditions below are satisfied:
@@ -850,30 +1400,67 @@ static int detect_data_type(deflate_state *s) {
 }
 
 /* ===========================================================================
- * Reverse the first len bits of a code, using straightforward code (a faster
- * method would use a table)
+ * Reverse the first len bits of a code, with the instruction for it where
+ * there is one, and otherwise by swapping the two bytes and reversing each
+ * one with a table. Called for every code of every dynamic tree, while the
+ * codes of the static trees in trees.h are reversed already.
  * IN assertion: 1 <= len <= 15
  */
+#if defined(__GNUC__) && defined(__aarch64__)
+#  define BI_REVERSE_RBIT "rbit %w0, %w1"
+#elif defined(__GNUC__) && defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7 && \
+      (defined(__ARM_ARCH_ISA_ARM) || (defined(__ARM_ARCH_ISA_THUMB) && __ARM_ARCH_ISA_THUMB >= 2))
+#  define BI_REVERSE_RBIT "rbit %0, %1"
+#endif
+
+#ifndef BI_REVERSE_RBIT
+static const unsigned char bit_reverse[256] = {
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+    0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+    0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+    0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+    0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+    0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+    0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+    0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+    0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+    0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+    0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
+};
+#endif
+
 ZLIB_INTERNAL unsigned bi_reverse(unsigned code, int len) {
     /* code: the value to invert */
     /* len: its bit length */
-    register unsigned res = 0;
-    do {
-        res |= code & 1;
-        code >>= 1, res <<= 1;
-    } while (--len > 0);
-    return res >> 1;
+#ifdef BI_REVERSE_RBIT
+    unsigned res;
+    __asm__(BI_REVERSE_RBIT : "=r"(res) : "r"(code));
+    return res >> (32 - len);
+#else
+    return ((unsigned)bit_reverse[code & 0xff] << 8 | bit_reverse[(code >> 8) & 0xff]) >> (16 - len);
+#endif
 }
 
 /* ===========================================================================
  * Flush the bit buffer, keeping at most 7 bits in it.
  */
 static void bi_flush(deflate_state *s) {
-    if (s->bi_valid == 16) {
-        put_short(s, s->bi_buf);
-        s->bi_buf = 0;
-        s->bi_valid = 0;
-    } else if (s->bi_valid >= 8) {
+    if (s->bi_valid >= 32) {
+        put_uint32(s, (uint32_t)s->bi_buf);
+        s->bi_buf >>= 32;
+        s->bi_valid -= 32;
+    }
+    if (s->bi_valid >= 16) {
+        put_short(s, (uint16_t)s->bi_buf);
+        s->bi_buf >>= 16;
+        s->bi_valid -= 16;
+    }
+    if (s->bi_valid >= 8) {
         put_byte(s, (unsigned char)s->bi_buf);
         s->bi_buf >>= 8;
         s->bi_valid -= 8;
@@ -884,11 +1471,9 @@ static void bi_flush(deflate_state *s) {
  * Flush the bit buffer and align the output on a byte boundary
  */
 ZLIB_INTERNAL void bi_windup(deflate_state *s) {
-    if (s->bi_valid > 8) {
-        put_short(s, s->bi_buf);
-    } else if (s->bi_valid > 0) {
+    bi_flush(s);
+    if (s->bi_valid > 0)
         put_byte(s, (unsigned char)s->bi_buf);
-    }
     s->bi_buf = 0;
     s->bi_valid = 0;
 #ifdef ZLIB_DEBUG
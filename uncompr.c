@@ -13,6 +13,64 @@
 # include "zlib-ng.h"
 #endif
 
+extern int inflate_whole_buffer(PREFIX3(stream) *strm, int whole);
+#ifndef ZLIB_COMPAT
+extern void inflate_lanes(PREFIX3(stream) **strm, int *ret, unsigned n);
+
+#define UNCOMPRESS_LANES 4  /* INFLATE_LANES of inflate.h */
+#endif
+
+/* ===========================================================================
+ * Decompress source with the initialized stream and end it.
+ */
+static int uncompress_stream(PREFIX3(stream) *stream, unsigned char *dest, z_size_t *destLen,
+                             const unsigned char *source, z_size_t *sourceLen) {
+    int err;
+    const unsigned int max = (unsigned int)-1;
+    z_size_t len, left;
+    unsigned char buf[1];    /* for detection of incomplete stream when *destLen == 0 */
+
+    len = *sourceLen;
+    if (*destLen) {
+        left = *destLen;
+        *destLen = 0;
+    }
+    else {
+        left = 1;
+        dest = buf;
+    }
+
+    stream->next_in = (const unsigned char *)source;
+    stream->avail_in = 0;
+    stream->next_out = dest;
+    stream->avail_out = 0;
+    inflate_whole_buffer(stream, 1);
+
+    do {
+        if (stream->avail_out == 0) {
+            stream->avail_out = left > (unsigned long)max ? max : (unsigned int)left;
+            left -= stream->avail_out;
+        }
+        if (stream->avail_in == 0) {
+            stream->avail_in = len > (unsigned long)max ? max : (unsigned int)len;
+            len -= stream->avail_in;
+        }
+        err = PREFIX(inflate)(stream, Z_NO_FLUSH);
+    } while (err == Z_OK);
+
+    *sourceLen -= len + stream->avail_in;
+    if (dest != buf)
+        *destLen = (z_size_t)stream->total_out;
+    else if (stream->total_out && err == Z_BUF_ERROR)
+        left = 1;
+
+    PREFIX(inflateEnd)(stream);
+    return err == Z_STREAM_END ? Z_OK :
+           err == Z_NEED_DICT ? Z_DATA_ERROR  :
+           err == Z_BUF_ERROR && left + stream->avail_out ? Z_DATA_ERROR :
+           err;
+}
+
 /* ===========================================================================
      Decompresses the source buffer into the destination buffer.  *sourceLen is
    the byte length of the source buffer. Upon entry, *destLen is the total size
@@ -32,58 +90,197 @@
 int ZEXPORT PREFIX(uncompress2)(unsigned char *dest, z_size_t *destLen, const unsigned char *source, z_size_t *sourceLen) {
     PREFIX3(stream) stream;
     int err;
+
+    stream.next_in = (const unsigned char *)source;
+    stream.avail_in = 0;
+    stream.zalloc = NULL;
+    stream.zfree = NULL;
+    stream.opaque = NULL;
+
+    err = PREFIX(inflateInit)(&stream);
+    if (err != Z_OK) return err;
+    return uncompress_stream(&stream, dest, destLen, source, sourceLen);
+}
+
+int ZEXPORT PREFIX(uncompress)(unsigned char *dest, z_size_t *destLen, const unsigned char *source, z_size_t sourceLen)
+{
+    return PREFIX(uncompress2)(dest, destLen, source, &sourceLen);
+}
+
+#ifndef ZLIB_COMPAT
+size_t ZEXPORT zng_uncompress_oneshot_size(void) {
+    return zng_inflateArenaSize(MAX_WBITS);
+}
+
+int ZEXPORT zng_uncompress_oneshot(unsigned char *dest, size_t *destLen, const unsigned char *source, size_t *sourceLen,
+                                   void *scratch, size_t scratch_size) {
+    zng_stream stream;
+    int err;
+
+    stream.next_in = source;
+    stream.avail_in = 0;
+    err = zng_inflateInitArena(&stream, scratch, scratch_size, MAX_WBITS);
+    if (err != Z_OK)
+        return err;
+    return uncompress_stream(&stream, dest, destLen, source, sourceLen);
+}
+
+int ZEXPORT zng_uncompress_batch(const zng_iovec *inputs, zng_iovec *outputs, size_t n) {
+    zng_stream stream[UNCOMPRESS_LANES];
+    zng_stream *strm[UNCOMPRESS_LANES];
+    int ret[UNCOMPRESS_LANES];
+    unsigned char buf[1];    /* next_out of an empty output */
     const unsigned int max = (unsigned int)-1;
-    z_size_t len, left;
-    unsigned char buf[1];    /* for detection of incomplete stream when *destLen == 0 */
+    unsigned lanes, k, i;
+    size_t at, fail;
+    int err = Z_OK;
 
-    len = *sourceLen;
-    if (*destLen) {
-        left = *destLen;
-        *destLen = 0;
+    if (n == 0)
+        return Z_OK;
+    if (inputs == NULL || outputs == NULL)
+        return Z_STREAM_ERROR;
+
+    /* One stream per lane, reset for each record it decodes */
+    lanes = n < UNCOMPRESS_LANES ? (unsigned)n : UNCOMPRESS_LANES;
+    for (k = 0; k < lanes; k++) {
+        stream[k].next_in = NULL;
+        stream[k].avail_in = 0;
+        stream[k].zalloc = NULL;
+        stream[k].zfree = NULL;
+        stream[k].opaque = NULL;
+        err = zng_inflateInit(&stream[k]);
+        if (err != Z_OK) {
+            while (k)
+                zng_inflateEnd(&stream[--k]);
+            for (at = 0; at < n; at++)
+                outputs[at].iov_len = 0;
+            return err;
+        }
+        strm[k] = &stream[k];
     }
-    else {
-        left = 1;
-        dest = buf;
+
+    fail = n;
+    for (at = 0; at < n && fail == n; at += k) {
+        k = n - at < lanes ? (unsigned)(n - at) : lanes;
+        for (i = 0; i < k; i++) {
+            zng_inflateReset(strm[i]);
+            strm[i]->next_in = (const unsigned char *)inputs[at + i].iov_base;
+            strm[i]->avail_in = inputs[at + i].iov_len > max ? max : (unsigned int)inputs[at + i].iov_len;
+            strm[i]->next_out = outputs[at + i].iov_len ? (unsigned char *)outputs[at + i].iov_base : buf;
+            strm[i]->avail_out = outputs[at + i].iov_len > max ? max : (unsigned int)outputs[at + i].iov_len;
+            inflate_whole_buffer(strm[i], 1);
+        }
+        inflate_lanes(strm, ret, k);
+        for (i = 0; i < k; i++) {
+            outputs[at + i].iov_len = strm[i]->total_out;
+            if (ret[i] == Z_STREAM_END || fail != n)
+                continue;
+            fail = at + i;
+            err = ret[i] == Z_NEED_DICT ? Z_DATA_ERROR :
+                  ret[i] == Z_BUF_ERROR && strm[i]->avail_out ? Z_DATA_ERROR :
+                  ret[i];
+        }
     }
+    for (at = fail; at < n; at++)
+        outputs[at].iov_len = 0;
 
-    stream.next_in = (const unsigned char *)source;
+    for (k = 0; k < lanes; k++)
+        zng_inflateEnd(strm[k]);
+    return err;
+}
+
+size_t ZEXPORT zng_uncompress_inplace_margin(size_t destLen) {
+    /* The conservative expansion of deflateBound(), and the zlib wrapper */
+    return ((destLen + 7) >> 3) + ((destLen + 63) >> 6) + 5 + 6;
+}
+
+int ZEXPORT zng_uncompress_inplace(unsigned char *buf, size_t *destLen, size_t sourceLen) {
+    zng_stream stream;
+    const unsigned int max = (unsigned int)-1;
+    const unsigned char *end;
+    size_t room;
+    int err;
+
+    if (buf == NULL || destLen == NULL || sourceLen > *destLen)
+        return Z_STREAM_ERROR;
+
+    end = buf + *destLen;
+    stream.next_in = end - sourceLen;
     stream.avail_in = 0;
     stream.zalloc = NULL;
     stream.zfree = NULL;
     stream.opaque = NULL;
+    err = zng_inflateInit(&stream);
+    if (err != Z_OK)
+        return err;
+    stream.next_out = buf;
+    inflate_whole_buffer(&stream, 1);
 
-    err = PREFIX(inflateInit)(&stream);
-    if (err != Z_OK) return err;
+    /* Each call may only write up to the first byte not read yet, which is
+       never before next_in, so the input is overwritten only once used */
+    do {
+        room = (size_t)(stream.next_in - stream.next_out);
+        stream.avail_out = room > max ? max : (unsigned int)room;
+        room = (size_t)(end - stream.next_in);
+        stream.avail_in = room > max ? max : (unsigned int)room;
+        err = zng_inflate(&stream, Z_NO_FLUSH);
+    } while (err == Z_OK);
+
+    *destLen = (size_t)stream.total_out;
+    zng_inflateEnd(&stream);
+    return err == Z_STREAM_END ? Z_OK :
+           err == Z_NEED_DICT ? Z_DATA_ERROR :
+           err == Z_BUF_ERROR && stream.avail_out ? Z_DATA_ERROR :
+           err;
+}
 
+int ZEXPORT zng_uncompress_prefix(unsigned char *dest, size_t *destLen, const unsigned char *source, size_t *sourceLen) {
+    zng_stream stream;
+    const unsigned int max = (unsigned int)-1;
+    size_t len, left;
+    int err;
+
+    if (dest == NULL || destLen == NULL || sourceLen == NULL)
+        return Z_STREAM_ERROR;
+    len = *sourceLen;
+    left = *destLen;
+    *sourceLen = 0;
+    if (left == 0)
+        return Z_OK;
+
+    stream.next_in = source;
+    stream.avail_in = 0;
+    stream.zalloc = NULL;
+    stream.zfree = NULL;
+    stream.opaque = NULL;
+    err = zng_inflateInit2(&stream, MAX_WBITS + 32);
+    if (err != Z_OK)
+        return err;
     stream.next_out = dest;
     stream.avail_out = 0;
+    inflate_whole_buffer(&stream, 1);
 
+    /* Stop as soon as dest is full, without looking at the rest of the stream */
     do {
         if (stream.avail_out == 0) {
-            stream.avail_out = left > (unsigned long)max ? max : (unsigned int)left;
+            if (left == 0)
+                break;
+            stream.avail_out = left > max ? max : (unsigned int)left;
             left -= stream.avail_out;
         }
         if (stream.avail_in == 0) {
-            stream.avail_in = len > (unsigned long)max ? max : (unsigned int)len;
+            stream.avail_in = len > max ? max : (unsigned int)len;
             len -= stream.avail_in;
         }
-        err = PREFIX(inflate)(&stream, Z_NO_FLUSH);
+        err = zng_inflate(&stream, Z_NO_FLUSH);
     } while (err == Z_OK);
 
-    *sourceLen -= len + stream.avail_in;
-    if (dest != buf)
-        *destLen = (z_size_t)stream.total_out;
-    else if (stream.total_out && err == Z_BUF_ERROR)
-        left = 1;
-
-    PREFIX(inflateEnd)(&stream);
-    return err == Z_STREAM_END ? Z_OK :
-           err == Z_NEED_DICT ? Z_DATA_ERROR  :
-           err == Z_BUF_ERROR && left + stream.avail_out ? Z_DATA_ERROR :
+    *sourceLen = (size_t)stream.total_in;
+    *destLen = (size_t)stream.total_out;
+    zng_inflateEnd(&stream);
+    return err == Z_OK || err == Z_STREAM_END ? Z_OK :
+           err == Z_NEED_DICT ? Z_DATA_ERROR :
+           err == Z_BUF_ERROR ? (left + stream.avail_out ? Z_DATA_ERROR : Z_OK) :
            err;
 }
-
-int ZEXPORT PREFIX(uncompress)(unsigned char *dest, z_size_t *destLen, const unsigned char *source, z_size_t sourceLen)
-{
-    return PREFIX(uncompress2)(dest, destLen, source, &sourceLen);
-}
+#endif
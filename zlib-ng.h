@@ -186,9 +186,22 @@ typedef zng_gz_header *zng_gz_headerp;
 #define Z_HUFFMAN_ONLY        2
 #define Z_RLE                 3
 #define Z_FIXED               4
+#define Z_BUCKET              5
 #define Z_DEFAULT_STRATEGY    0
 /* compression strategy; see deflateInit2() below for details */
 
+#define Z_HASH_DEFAULT   0
+#define Z_HASH_MULTIPLY  1
+#define Z_HASH_CRC       2
+#define Z_HASH_ROLLING   3
+/* hash functions; see Z_DEFLATE_HASH_FUNC below for details */
+
+#define Z_SEARCH_DEFAULT 0
+#define Z_SEARCH_GREEDY  1
+#define Z_SEARCH_LAZY    2
+#define Z_SEARCH_MEDIUM  3
+/* match searches; see Z_DEFLATE_SEARCH below for details */
+
 #define Z_BINARY   0
 #define Z_TEXT     1
 #define Z_ASCII    Z_TEXT   /* for compatibility with 1.2.2 and earlier */
@@ -224,7 +237,10 @@ int zng_deflateInit(zng_stream *strm, int level);
    1 gives best speed, 9 gives best compression, 0 gives no compression at all
    (the input data is simply copied a block at a time).  Z_DEFAULT_COMPRESSION
    requests a default compromise between speed and compression (currently
-   equivalent to level 6).
+   equivalent to level 6).  Levels 10 to 12 choose the matches of each part of
+   the input together, based on the cost of their codes in the block being
+   built, for a smaller output than level 9 at several times the compression
+   time and about 360K of extra memory.  Decompression is not slower.
 
      deflateInit returns Z_OK if success, Z_MEM_ERROR if there was not enough
    memory, Z_STREAM_ERROR if level is not a valid compression level, or
@@ -286,9 +302,9 @@ int zng_deflate(zng_stream *strm, int flush);
   output buffer, but the output is not aligned to a byte boundary.  All of the
   input data so far will be available to the decompressor, as for Z_SYNC_FLUSH.
   This completes the current deflate block and follows it with an empty fixed
-  codes block that is 10 bits long.  This assures that enough bytes are output
-  in order for the decompressor to finish the block before the empty fixed
-  codes block.
+  codes block that is 10 bits long, unless the block ended on a byte boundary.
+  This assures that enough bytes are output in order for the decompressor to
+  finish the block before the empty fixed codes block.
 
     If flush is set to Z_BLOCK, a deflate block is completed and emitted, as
   for Z_SYNC_FLUSH, but the output is not aligned on a byte boundary, and up to
@@ -586,7 +602,11 @@ int zng_deflateInit2(zng_stream *strm, int  level, int  method, int  windowBits,
    strategy parameter only affects the compression ratio but not the
    correctness of the compressed output even if it is not set appropriately.
    Z_FIXED prevents the use of dynamic Huffman codes, allowing for a simpler
-   decoder for special applications.
+   decoder for special applications.  Z_BUCKET keeps only the last four strings
+   for each hash value instead of chains of all of them, which finds matches
+   faster than level 2 while compressing about as well as level 3.  The level
+   then only sets how long a match ends the search and how many of the strings
+   inside a match are remembered.
 
      deflateInit2 returns Z_OK if success, Z_MEM_ERROR if there was not enough
    memory, Z_STREAM_ERROR if any parameter is invalid (such as an invalid
@@ -701,9 +721,12 @@ int zng_deflateParams(zng_stream *strm, int level, int strategy);
    strategy is changed, and if there have been any deflate() calls since the
    state was initialized or reset, then the input available so far is
    compressed with the old level and strategy using deflate(strm, Z_BLOCK).
-   There are three approaches for the compression levels 0, 1..3, and 4..9
-   respectively.  The new level and strategy will take effect at the next call
-   of deflate().
+   There are four approaches for the compression levels 0, 1..3, 4..9 and
+   10..12 respectively.  The new level and strategy will take effect at the
+   next call of deflate().  Between the levels 1..9, other than to or from the
+   Z_BUCKET strategy, the new approach can mostly go on in the deflate block of
+   the old one, and then deflateParams() compresses and writes nothing, and
+   leaves any input that deflate() has not taken.
 
      If a deflate(strm, Z_BLOCK) is performed by deflateParams(), and it does
    not have enough output space to complete, then the parameter change will not
@@ -719,10 +742,11 @@ int zng_deflateParams(zng_stream *strm, int level, int strategy);
    applied to the the data compressed after deflateParams().
 
      deflateParams returns Z_OK on success, Z_STREAM_ERROR if the source stream
-   state was inconsistent or if a parameter was invalid, or Z_BUF_ERROR if
-   there was not enough output space to complete the compression of the
-   available input data before a change in the strategy or approach.  Note that
-   in the case of a Z_BUF_ERROR, the parameters are not changed.  A return
+   state was inconsistent or if a parameter was invalid, Z_MEM_ERROR if there
+   was not enough memory for a level above 9, or Z_BUF_ERROR if there was not
+   enough output space to complete the compression of the available input data
+   before a change in the strategy or approach.  Note that in the case of a
+   Z_BUF_ERROR, the parameters are not changed.  A return
    value of Z_BUF_ERROR is not fatal, in which case deflateParams() can be
    retried with more output space.
 */
@@ -1304,6 +1328,44 @@ gzFile zng_gzopen(const char *path, const char *mode);
    "x" when writing will create the file exclusively, which fails if the file
    already exists.  On systems that support it, the addition of "e" when
    reading or writing will set the flag to close the file on an execve() call.
+   Where mmap() is available, the addition of "m" when reading will map a
+   regular file that is larger than the input buffer and decompress straight
+   from the mapping instead of copying the input with read().  The file must
+   not be truncated while it is open.  There also, "H" will allocate the
+   buffers aligned to huge pages and ask the system to use huge pages for
+   them, which saves TLB misses when streaming through buffers of 1M or more.
+   Where posix_fadvise() is available, "D" will drop what was read or written
+   from the system's file cache every 8M or so, waiting for written data to
+   reach the disk first, so that streaming through a large file does not
+   evict the cached data of everything else.
+   Where threads are available, the addition of "A" will read ahead or write behind in a background thread, so
+   that the file input or output overlaps with decompression or compression.
+   A flush with gzflush() or gzclose() still waits for its data to be written.
+   This pays off when the file is slow to access, and with a buffer larger
+   than the default set with gzbuffer().  When writing, "P" followed by a
+   number of threads, as in "wb9P8", will compress chunks of 128K in parallel
+   in that many threads, each using the 32K before it as a dictionary, and
+   write them in order as one gzip stream.  The output depends on the chunk
+   boundaries made by the flushes, but not on the number of threads.  When
+   reading a file with an index from gzindex_build() or gzindex_load(), "P"
+   followed by a number of threads will decompress the data between access
+   points in that many threads, and gzread() returns it in order.  When
+   writing, "B" will write BGZF members as bgzip does, each an independent
+   gzip stream of up to 65280 bytes of data with its compressed length in a
+   "BC" extra subfield, and a flush ends the member being filled.  gzclose()
+   then ends the file with an index of the members, held in empty members
+   that any gzip reader skips, and the empty member that BGZF ends with.  With
+   "P" as well, the members are compressed in parallel, giving the same output.
+   When reading a file that ends with such an index, the first gzseek(), or
+   the first read with "P", takes it as the index if there is none, so that a
+   seek decompresses at most one member and "P" can decompress them in
+   parallel.  A file appended to after it was written this way has no usable
+   index.
+   When reading, "p" says that only the start of the file is wanted, as for a
+   preview: the buffers are then sized by the first read, to hold twice its
+   length, and the data is decompressed into the output buffer without
+   setting up the 32K window for as long as it fits there.  Reading on past
+   that still works, with the window set up where it is first needed.
 
      These functions, as well as gzip, will read and decode a sequence of gzip
    streams in a file.  The append function of gzopen() can be used to create
@@ -1352,7 +1414,10 @@ ZEXTERN ZEXPORT
 int zng_gzbuffer(gzFile file, unsigned size);
 /*
      Set the internal buffer size used by this library's functions.  The
-   default buffer size is 8192 bytes.  This function must be called after
+   default buffer size is 8192 bytes, or where fstat() is available, the
+   block size of the file if that is larger, doubled when reading a regular
+   file for as long as it is less than an eighth of the file, up to 1M bytes.
+   This function must be called after
    gzopen() or gzdopen(), and before any other calls that read or write the
    file.  The buffer memory allocation is always deferred to the first read or
    write.  Three times that size in buffer space is allocated.  A larger buffer
@@ -1521,6 +1586,58 @@ int zng_gzungetc(int c, gzFile file);
    gzseek() or gzrewind().
 */
 
+ZEXTERN ZEXPORT
+const unsigned char * zng_gzpeek(gzFile file, unsigned *len);
+ZEXTERN ZEXPORT
+int zng_gzconsume(gzFile file, unsigned len);
+/*
+     gzpeek() lends the next decompressed data of file straight from the
+   internal output buffer instead of copying it like gzread(), for example to
+   scan it for the end of a line.  It returns a pointer to *len bytes, after
+   decompressing more if none are left in the buffer, or NULL with *len set to
+   zero at the end of the file or on an error, which gzerror() tells apart.
+   *len is at most twice the buffer size set with gzbuffer().  The data stays
+   where it is until the next call on file other than gzconsume(), and it is
+   not consumed by looking at it: gzpeek() returns the same data again.
+
+     gzconsume() advances past the first len bytes of what gzpeek() returned,
+   as if they were read with gzread().  Consuming less than all of it leaves
+   the rest to the next gzpeek() or read.  gzconsume() returns 0, or -1 if len
+   is more than what is left of the data lent, or if file was repositioned
+   since.
+*/
+
+typedef int (*gzline_func) (void *opaque, const char *line, size_t len);
+
+ZEXTERN ZEXPORT
+int zng_gzgetlines(gzFile file, gzline_func line, void *opaque);
+/*
+     Calls line(opaque, start, len) for each of the lines in the rest of file,
+   which are the len bytes at start, up to and including a newline character
+   except maybe for the last line.  Unlike gzgets(), the lines are not copied,
+   except for a line that continues past the end of the internal buffer, and
+   there is no limit to their length.  A line, which is not null-terminated, is
+   only there for the duration of the call, in which file must not be used.
+   If line returns non-zero, gzgetlines() stops there with the file positioned
+   after that line, and returns what line returned.
+
+     gzgetlines returns 0 at the end of the file, the non-zero return value of
+   line, or -1 on an error, which is available from gzerror().
+*/
+
+ZEXTERN ZEXPORT
+int zng_gztest(gzFile file);
+/*
+     Reads the rest of file to check it, without returning the data, as gzip -t
+   would.  The gzip members are checked with zng_inflateVerify(), so that the
+   decompressed data is not copied anywhere, and gztell() afterwards gives the
+   length of the uncompressed data.
+
+     gztest returns 0 if the rest of file is intact, or -1 on an error, which
+   is available from gzerror(), including a file that ends in the middle of
+   a gzip member.
+*/
+
 ZEXTERN ZEXPORT
 int zng_gzflush(gzFile file, int flush);
 /*
@@ -1588,6 +1705,49 @@ z_off_t zng_gzoffset(gzFile file);
    for a progress indicator.  On error, gzoffset() returns -1.
 */
 
+ZEXTERN ZEXPORT
+int zng_gzindex_build(gzFile file, z_off64_t span);
+/*
+     Builds an index of access points for gzseek() on a file opened for
+   reading, by decompressing all of it once.  An access point is kept at the
+   first deflate block boundary after every span bytes of uncompressed data,
+   together with the 32K of data before it.  After that, gzseek() starts
+   decompressing from the last access point before the requested position when
+   that is ahead of what has been decompressed already, so a seek costs at
+   most about span bytes of decompression instead of everything up to the
+   position.  Each access point takes up to 32K of memory, so a span of a few
+   megabytes suits large files.  For concatenated gzip streams, access points
+   can be in any of them.  If every gzip stream in the file is a BGZF member,
+   which gives its compressed length in a "BC" extra subfield, the access
+   points are put at the starts of the members from their headers and
+   trailers alone, without decompressing anything, and need no memory for
+   the data before them, or from the index at the end of a file written with
+   "B" alone.  The file is left at the position it had.
+
+     gzindex_build returns the number of access points, which is zero for a
+   file that is not compressed or shorter than span, or -1 on error, in which
+   case the error is available from gzerror() and there is no index.
+*/
+
+ZEXTERN ZEXPORT
+size_t zng_gzindex_save(gzFile file, void *buf, size_t len);
+ZEXTERN ZEXPORT
+int zng_gzindex_load(gzFile file, const void *buf, size_t len);
+/*
+     gzindex_save() stores the index of file in a portable form, so that it
+   can be kept with the compressed file and given to gzindex_load() when the
+   file is opened again, instead of decompressing it all with
+   gzindex_build().  gzindex_save() returns the length of the saved index, and
+   writes it to buf only if buf is not NULL and len is at least that.  It
+   returns 0 if there is no index.
+
+     gzindex_load() replaces the index of file with the one in the len bytes at
+   buf.  It returns the number of access points, or -1 if buf does not hold a
+   saved index or if there is not enough memory.  The index is not checked
+   against the file, so one saved for a different file makes reading fail
+   after a gzseek().
+*/
+
 ZEXTERN ZEXPORT
 int zng_gzeof(gzFile file);
 /*
@@ -1779,6 +1939,29 @@ uint32_t zng_crc32_combine_op(uint32_t crc1, uint32_t crc2, const uint32_t *op);
    crc32_combine() if the generated op is used many times.
 */
 
+ZEXTERN ZEXPORT
+uint32_t zng_crc32_combine_batch(uint32_t crc, const uint32_t *crcs, const z_off64_t *lens, size_t count);
+/*
+     Combine the CRC-32 check values of count sequences of bytes that follow
+   a sequence with the CRC-32 check value crc.  crcs[i] is the check value of
+   sequence i, and lens[i] its length.  This returns the check value of all of
+   them concatenated, the same as calling crc32_combine() for each in turn.
+   For chunks of equal lengths, the work for the length is done only once.
+   Start with a crc of zero to combine only the count sequences.
+*/
+
+ZEXTERN ZEXPORT
+uint32_t zng_adler32_parallel(uint32_t adler, const unsigned char *buf, size_t len, int threads);
+ZEXTERN ZEXPORT
+uint32_t zng_crc32_parallel(uint32_t crc, const unsigned char *buf, size_t len, int threads);
+/*
+     Same as adler32_z() and crc32_z(), but for large buffers split the work
+   across up to threads threads and combine the results.  Each thread gets at
+   least 1M of the buffer, so smaller buffers, a threads of 1 or less, or a
+   build without threads simply compute the check value on the calling thread.
+   The result does not depend on the number of threads.
+*/
+
                         /* various hacks, don't look :) */
 
 /* zng_deflateInit and zng_inflateInit are macros to allow checking the zlib version
@@ -1861,6 +2044,152 @@ typedef enum {
        reproducibility is strictly required. Reproducibility is guaranteed only when using an identical zlib-ng build.
        Default is 0.
     */
+    Z_DEFLATE_HASH_BITS = 3,
+    /*
+         Base two logarithm of the number of hash table entries, represented as an int from 8 to 20. A larger table
+       gives fewer collisions on large inputs at the cost of memory, as 2 bytes per entry. It can only be set before
+       any input or dictionary has been given to the stream. Default is set by memLevel, or 15 where the CRC-32
+       instructions are used for hashing.
+    */
+    Z_DEFLATE_HASH_BYTES = 4,
+    /*
+         Number of bytes hashed to look up match candidates, represented as an int of 3, 4 or 5, or 0 to choose it
+       by the compression level. Hashing more bytes skips candidates that cannot give a useful match, which helps
+       the faster levels on large or repetitive inputs, but makes matches of fewer bytes than hashed unlikely to be
+       found. It can only be set before any input or dictionary has been given to the stream. On x86 with SSE4.2 and
+       on ARM with the CRC32 instructions, level 1 always hashes 4 bytes. Default is 0.
+    */
+    Z_DEFLATE_BLOCK_SPLIT = 5,
+    /*
+         Whether to end deflate blocks where the statistics of the data change, so that each part gets Huffman codes
+       of its own, rather than only when the symbol buffer set by memLevel is full. Represented as an int, where 0
+       means never, 1 means always, and -1 means at levels 4 and above. It can be changed at any time and applies
+       from the next symbols compressed. Default is -1.
+    */
+    Z_DEFLATE_LIT_BUFSIZE = 6,
+    /*
+         Number of symbols, literals or matches, that the symbol buffer holds, represented as an int from 128 to
+       262144. A block ends at the latest when the buffer is full, so a larger buffer gives fewer and larger blocks,
+       with fewer Huffman trees to build and send, at the cost of 4 bytes of memory per symbol. It can only be set
+       before any input, dictionary or deflatePrime() bits have been given to the stream. Default is set by
+       memLevel, as 1 << (memLevel + 6).
+    */
+    Z_DEFLATE_AUTO_FLUSH = 7,
+    /*
+         Number of input bytes after which deflate() flushes as for Z_PARTIAL_FLUSH by itself, represented as an
+       int, or 0 for never. When at least that much input was compressed since the last flush, a call with
+       Z_NO_FLUSH or Z_BLOCK ends with a flush, so that a stream of small writes reaches the other side with a
+       bounded delay without a flush for each. A Z_PARTIAL_FLUSH is ten bits at most, and nothing at all when the
+       block ends on a byte boundary, where a Z_SYNC_FLUSH is four or five bytes. Like every flush it ends the
+       deflate block, so the Huffman codes are built again from the input that follows. It can be changed at any
+       time. Default is 0.
+    */
+    Z_DEFLATE_QUICK_DYNAMIC = 8,
+    /*
+         Whether level 1 sends its matches with dynamic Huffman codes built for each block, rather than with the
+       fixed codes, represented as an int of 0 or 1. The search is the same single probe per position either way, so
+       this costs only the building of the codes once per block, and compresses noticeably better than the fixed
+       codes on most data. It has an effect only where level 1 has a strategy of its own, on x86 with SSE4.2
+       and on ARM with the CRC32 instructions. It cannot be changed while deflate() is in the middle of a block of
+       fixed codes, which happens only when it ran out of output space. Default is 0.
+    */
+    Z_DEFLATE_HASH_FUNC = 9,
+    /*
+         Hash function used to look up match candidates, represented as an int of Z_HASH_DEFAULT, Z_HASH_MULTIPLY,
+       Z_HASH_CRC or Z_HASH_ROLLING. Z_HASH_MULTIPLY multiplies the bytes hashed by a large odd constant, which
+       spreads them well and is fast on every CPU. Z_HASH_CRC takes their CRC-32C, and can only be set on x86 with
+       SSE4.2 or on ARM with the CRC32 instructions. Z_HASH_ROLLING is the hash of zlib, which always covers 3
+       bytes, updates in a few operations per byte, and suits text. Z_HASH_DEFAULT is Z_HASH_CRC where it can be
+       set, and otherwise a hash of the bytes that is neither of the others. Level 1 where it has a strategy of
+       its own (see Z_DEFLATE_QUICK_DYNAMIC) and the Z_BUCKET strategy keep their own hash whatever is set here.
+       It can only be set before any input or dictionary has been given to the stream. Default is
+       Z_HASH_DEFAULT.
+    */
+    Z_DEFLATE_PRESCAN = 10,
+    /*
+         Whether deflate() first samples each 64K of input, represented as an int of 0 or 1. A piece whose sampled
+       bytes are spread too evenly over all byte values to be coded in much less than 8 bits each, as with JPEG,
+       compressed or encrypted data, is given only literals without any search for matches. The block is then
+       written stored as usual if that is smaller. This saves most of the time spent on such data, and loses
+       only the matches that the sampling missed. It has no effect at level 0 or with the Z_HUFFMAN_ONLY, Z_RLE
+       and Z_BUCKET strategies. Default is 0.
+    */
+    Z_DEFLATE_PIPELINE = 11,
+    /*
+         Whether the matches of levels 4 to 6 are found by a helper thread of the stream, represented as an int of
+       0 or 1. The calling thread then only codes the matches and writes the blocks, so that compressing one large
+       stream keeps two cores busy. The output does not depend on the timing of the threads, and is the same as
+       without it, except that a match may come out a little different where deflate() without it ran out of room
+       in next_out and returned. Input given a few KB at a time is not worth the hand-over and stays on the calling
+       thread. Without thread support this has no effect. The thread is started when first needed and ends in
+       deflateEnd(). Default is 0.
+    */
+    Z_DEFLATE_GOOD_LENGTH = 12,
+    /*
+         Length of the previous match above which the search for a better one follows only a quarter of the hash
+       chain, represented as an int from 0 to 258. It has no effect at levels 1 to 3. This and the three below are
+       the search limits of deflateTune(). They can be changed at any time, and are set back to the values of the
+       level by a change of level and by deflateReset(). Set together with Z_DEFLATE_LEVEL, they apply to the new
+       level. Default is set by the level.
+    */
+    Z_DEFLATE_MAX_LAZY = 13,
+    /*
+         Length of the current match from which no better one is searched for at the next position, represented
+       as an int from 1 to 258. At levels 1 to 3 it is instead the longest match whose strings are all added to the
+       hash table, and at levels 10 to 12 the number of passes of the optimal parse. Default is set by the level.
+    */
+    Z_DEFLATE_NICE_LENGTH = 14,
+    /*
+         Length of a match that ends the search of the hash chain, represented as an int from 3 to 258. Default is
+       set by the level.
+    */
+    Z_DEFLATE_MAX_CHAIN = 15,
+    /*
+         Number of entries of the hash chain searched for a match at most, represented as an int from 4 to 65535.
+       While most searches go to the end of the chain without a match of Z_DEFLATE_NICE_LENGTH, as on long runs of
+       a few nearly identical patterns, deflate() halves the entries searched down to 64, and doubles them back when
+       the searches end early again, so that such data does not take twenty times as long as other data at the
+       higher levels. The value read back is the one set. Default is set by the level.
+    */
+    Z_DEFLATE_SEARCH = 16,
+    /*
+         Match search used at levels 1 to 9, represented as an int of Z_SEARCH_DEFAULT, Z_SEARCH_GREEDY,
+       Z_SEARCH_LAZY or Z_SEARCH_MEDIUM. Z_SEARCH_GREEDY takes the match found at each position, as levels 2 and 3
+       do, Z_SEARCH_LAZY first checks whether the next position has a longer one, as levels 7 to 9 do, and
+       Z_SEARCH_MEDIUM looks ahead for a better split of two matches, as levels 4 to 6 do, or is Z_SEARCH_LAZY when
+       those use it. Z_SEARCH_DEFAULT is the search of the level. It stays the same through changes of level and
+       deflateReset(), and it can only be changed where deflateParams() could change the search, before any input
+       or after a flush that left no input behind. Default is Z_SEARCH_DEFAULT.
+    */
+    Z_DEFLATE_TARGET_SPEED = 17,
+    /*
+         Speed at which deflate() should take input, in KB/s (1000 bytes per second) represented as an int, or 0
+       for none. While set, deflate() times itself over every 64K or so of input, and moves the level one down when
+       it was slower than that, or one up when it was faster by a quarter, staying between levels 1 and 9. The time
+       is that spent in deflate() only. A new level that has another compression function than the current one, as
+       a move between levels 3 and 4 or 6 and 7, is taken as by deflateParams() once a call of deflate() took all
+       of its input, and so ends the block. A level of 0 or above 9 and the Z_HUFFMAN_ONLY, Z_RLE and Z_BUCKET
+       strategies are left as they are. The level reads back as Z_DEFLATE_LEVEL. Default is 0.
+    */
+    Z_DEFLATE_TARGET_OUTPUT = 18,
+    /*
+         Speed at which the output of deflate() can be taken away, as by a network connection, in KB/s represented
+       as an int, or 0 for none. This works as Z_DEFLATE_TARGET_SPEED, aiming for the speed of input that, at the
+       ratio measured, gives output at that speed: a lower level when compressing cannot keep up with the
+       connection, and a higher one when the connection is what holds the data back. The caller can set it again
+       as the speed of the connection changes. With both, the level is kept fast enough for both. Default is 0.
+    */
+    Z_DEFLATE_MAX_INPUT = 19,
+    /*
+         Number of input bytes that one call of deflate() takes at most, represented as an int, or 0 for no limit.
+       The rest of avail_in is left for the next call, and the call returns Z_OK as when it runs out of room in
+       next_out, with a flush, including Z_FINISH, only made by the call that takes the last of the input. As the
+       work for each byte is bounded by the level, at worst Z_DEFLATE_MAX_CHAIN entries of the hash chain, this
+       bounds the time that a call takes, so that an event loop can give deflate() all the input it has and still
+       get back control often enough. A call may also compress up to 262 bytes that the call before it took but
+       held back to look ahead. zng_deflatev() takes at most this much input over all of its fragments. It can be
+       changed at any time. Default is 0.
+    */
 } zng_deflate_param;
 
 typedef struct {
@@ -1899,6 +2228,571 @@ int zng_deflateGetParams(zng_stream *strm, zng_deflate_param_value *params, size
    entire value of the corresponding parameter.
 */
 
+ZEXTERN ZEXPORT
+int zng_deflateParallel(zng_stream *strm, int threads, size_t chunk_size);
+/*
+     Compresses all of the input in next_in/avail_in at once and finishes the stream, like deflate() with Z_FINISH,
+   but splits the input into chunks of chunk_size bytes that are compressed independently by up to threads threads.
+   Each chunk is primed with the preceding window of input as a dictionary, and the chunks are joined at sync flush
+   boundaries into a single zlib, gzip or raw deflate stream as selected by deflateInit2(). A chunk_size of 0 selects
+   a default of 128K, or 1M where the chunks are compressed by the DFLTCC instruction of IBM Z, each thread with a
+   parameter block of its own. The output depends on chunk_size but not on the number of threads.
+
+     The stream must have been just initialized or reset, and no dictionary may have been set. The joined output is
+   written only if it fits entirely in avail_out; deflateBound() of avail_in plus a few bytes per chunk is always
+   enough. If the input fits in a single chunk, or if a gzip header was set with deflateSetHeader(), this simply
+   calls deflate() with Z_FINISH. When threads is more than 1, the zalloc and zfree functions of the stream are
+   called from several threads at once.
+
+     Returns Z_STREAM_END if success, Z_BUF_ERROR if the output does not fit in avail_out (in which case the stream
+   is left unchanged), Z_MEM_ERROR if there was not enough memory, or Z_STREAM_ERROR if the stream state was
+   inconsistent or not fresh, or if threads is less than 1.
+*/
+
+ZEXTERN ZEXPORT
+int zng_inflateParallel(zng_stream *strm, int threads, size_t chunk_size);
+/*
+     Decompresses all of the input in next_in/avail_in at once, like inflate() with Z_FINISH, but decodes the single
+   zlib, gzip or raw deflate stream with up to threads threads without needing an index. The compressed data is cut
+   into chunks of chunk_size bytes, and the threads guess where the first deflate block of each chunk starts and
+   decode from there, leaving the matches that reach back before the chunk to be filled in once the data before it
+   is known. A wrong guess is found out when the chunks are joined, and that chunk is then decoded again after the
+   one before it. A chunk_size of 0 selects a default of 1M. Streams made of dynamic blocks, or with sync flushes
+   as written by zng_deflateParallel(), are the ones that can be decoded in parallel.
+
+     The stream must have been just initialized or reset. Each chunk is held as two bytes per decoded byte until it
+   is joined, for up to twice threads chunks at a time. If the input fits in a single chunk, if threads is 1 or
+   threads are not available, if a dictionary was set, or if the output does not fit in avail_out or the input is
+   not a complete valid stream, this simply calls inflate() with Z_FINISH from where the deflate data starts, so
+   the return value and the state of the stream are always those of inflate() with Z_FINISH. When threads is more
+   than 1, the zalloc and zfree functions of the stream are called from several threads at once.
+
+     Returns Z_STREAM_END if success, Z_STREAM_ERROR if the stream state was inconsistent or not fresh or if threads
+   is less than 1, or otherwise what inflate() with Z_FINISH returns.
+*/
+
+ZEXTERN ZEXPORT
+int zng_inflateBackInitRing(zng_stream *strm, unsigned char *window, size_t window_size);
+/*
+     Like zng_inflateBackInit() with a windowBits of 15, but with a window of window_size bytes, from 32K to 1G,
+   that inflateBack() uses as a ring. out() is then called when the ring is full, and at the end of a deflate block
+   once at least half of the ring is waiting to be written, so that the uncompressed data can be written straight
+   from the ring with about one write per window_size / 2 bytes, rather than one per 32K. The length given to out()
+   is at most window_size. window must have room for 64 more bytes after the ring, window_size + 64 in all, which
+   inflateBack() may read past the end of the ring when it copies in wide chunks, but never gives to out().
+
+     Returns the same values as zng_inflateBackInit(), with Z_STREAM_ERROR if window_size is out of range.
+*/
+
+typedef struct {
+    uint64_t stored_blocks;     /* number of stored blocks emitted */
+    uint64_t fixed_blocks;      /* number of blocks emitted with the fixed Huffman codes */
+    uint64_t dynamic_blocks;    /* number of blocks emitted with dynamic Huffman codes */
+    uint64_t literals;          /* number of literals tallied */
+    uint64_t matches;           /* number of matches tallied */
+    uint64_t match_bytes;       /* total length of those matches */
+    double   avg_match_length;  /* match_bytes / matches, or 0 without matches */
+    uint64_t chain_steps;       /* hash chain entries visited by longest_match */
+    uint64_t slide_hash;        /* number of times the hash tables were slid */
+    uint64_t fill_window_ns;    /* time spent reading input into the window, in nanoseconds */
+    uint64_t match_ns;          /* time spent searching for matches and tallying symbols */
+    uint64_t flush_block_ns;    /* time spent building trees and emitting blocks */
+} zng_deflate_stats;
+
+ZEXTERN ZEXPORT
+int zng_deflateGetStats(zng_stream *strm, zng_deflate_stats *stats);
+/*
+     Copies the statistics gathered by deflate since the stream was initialized or last reset into stats. The
+   counters are only maintained if zlib-ng was built with WITH_DEFLATE_STATS (-DDEFLATE_STATS); otherwise they cost
+   nothing and stats is cleared. After zng_deflateParallel(), the counts and times of all of its threads are
+   summed.
+
+     Returns Z_OK if success, Z_VERSION_ERROR if the library was built without statistics, or Z_STREAM_ERROR if the
+   stream state is inconsistent or stats is NULL.
+*/
+
+ZEXTERN ZEXPORT
+unsigned long zng_deflateEstimate(zng_stream *strm, const unsigned char *source, unsigned long sourceLen);
+/*
+     Returns the expected compressed size of the sourceLen bytes at source with the parameters and wrapper of strm,
+   for sizing an output buffer closer than deflateBound() does, with a way to continue if it turns out too small.
+   The input is parsed greedily with one probe of a small table of 4-byte strings per position, all of it or eight
+   samples of 64K when it is longer than 512K, and the literals and matches found are priced by their histograms.
+   That takes about as long as compressing at level 1, a fraction of the time of the default level. The estimate
+   is within a few percent of the output of levels 1 and 2, and of the other levels up to a few K of input, and
+   above their output by up to about 20% for larger input that compresses well. It is never more than
+   deflateBound(), which is returned as it is at level 0, or if the stream state is inconsistent or source is NULL.
+*/
+
+typedef struct {
+    void *iov_base;           /* start of the buffer */
+    size_t iov_len;           /* size of the buffer in bytes */
+} zng_iovec;
+
+ZEXTERN ZEXPORT
+int zng_deflateScatter(zng_stream *strm, const zng_iovec *iov, size_t iovcnt, size_t *written, int flush);
+/*
+     Like deflate(), but writes the output to the iovcnt buffers of iov, which has the same members as the POSIX
+   struct iovec, instead of to next_out. Each buffer is filled before the next one is started, and the number of
+   bytes written to all of them is stored in *written. next_out and avail_out are not used and are left unchanged,
+   while total_out counts the output as usual. As with deflate(), if every buffer is filled, there may be more
+   output, to be written by calling zng_deflateScatter() again with more buffers.
+
+     Blocks are compressed directly into the buffers instead of through the internal pending buffer when no other
+   output is pending and the block fits in the buffer, which holds for most blocks once the buffers are tens of
+   kilobytes. deflate() does the same with next_out, so it helps there too when avail_out is large.
+
+     Returns the same values as deflate(), or Z_STREAM_ERROR if iov is NULL with a nonzero iovcnt or written is
+   NULL.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflatev(zng_stream *strm, const zng_iovec *iov, size_t iovcnt, size_t *consumed, int flush);
+ZEXTERN ZEXPORT
+int zng_inflatev(zng_stream *strm, const zng_iovec *iov, size_t iovcnt, size_t *consumed, int flush);
+/*
+     Like deflate() and inflate(), but take the input from the iovcnt fragments of iov in order, as if they were
+   one buffer, instead of from next_in. The output still goes to next_out, and the number of input bytes used is
+   stored in *consumed. next_in and avail_in are not used and are left unchanged, while total_in counts the input
+   as usual. If the output space runs out, or inflate() stops at a block boundary for Z_BLOCK or Z_TREES, the input
+   after *consumed bytes has to be given again in the next call. For zng_deflatev(), flush only takes effect once
+   all of the fragments have been used.
+
+     This saves gathering input that arrives in pieces into one buffer, and the work that deflate() and inflate()
+   do on each return, such as inflate() copying the end of its output to the window, which happens once per call
+   here rather than once per fragment.
+
+     Returns the same values as deflate() and inflate(), or Z_STREAM_ERROR if iov is NULL with a nonzero iovcnt,
+   consumed is NULL, or a fragment is longer than 4 GB - 1 or has a NULL iov_base with a nonzero iov_len.
+*/
+
+ZEXTERN ZEXPORT
+int zng_inflateVerify(zng_stream *strm, int flush);
+/*
+     Like inflate(), but only check the compressed data instead of writing the output anywhere: all of the
+   input from next_in is decoded, into a buffer of 32K that inflate keeps for the purpose, and the check value
+   and the length in the trailer are verified as inflate() would. next_out and avail_out are not used and are
+   left unchanged, while total_out, adler and data_type are updated as usual. This is gzip -t without an
+   output buffer, and without most of the memory traffic of writing the output and reading it back.
+
+     flush is Z_NO_FLUSH, Z_SYNC_FLUSH or Z_FINISH. Returns Z_STREAM_END at the end of the stream, Z_OK if more
+   input is needed, or an error as from inflate(), where Z_BUF_ERROR means that no input could be used, or
+   that the stream did not end at Z_FINISH. Returns Z_STREAM_ERROR for Z_BLOCK or Z_TREES and in
+   zng_inflateWholeBuffer() mode, which keeps its window in the output.
+*/
+
+ZEXTERN ZEXPORT
+size_t zng_deflateArenaSize(int level, int windowBits, int memLevel);
+/*
+     Returns the size of the memory block that zng_deflateInitArena() needs for a stream with the given parameters,
+   on this machine and with this build of zlib-ng, or 0 if the parameters are invalid. The parameters have the same
+   meaning as for deflateInit2(), and the size includes the padding needed to align the block.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateInitArena(zng_stream *strm, void *arena, size_t arena_size, int level, int method, int windowBits,
+                         int memLevel, int strategy);
+/*
+     Like deflateInit2(), but places the deflate state, window, hash tables and symbol buffer in the caller-supplied
+   block of arena_size bytes instead of calling an allocator, with each of them aligned to 64 bytes. The zalloc,
+   zfree and opaque fields of strm are overwritten. The block must stay valid until deflateEnd() and is not freed
+   by it; after deflateEnd() the same block can be passed to zng_deflateInitArena() again, or the stream can be
+   reused with deflateReset() without touching the block. deflateCopy() of such a stream allocates the copy from
+   the same block, and so fails with Z_MEM_ERROR unless the block was made large enough for both.
+
+     Returns Z_MEM_ERROR if arena_size is smaller than zng_deflateArenaSize() for these parameters, and otherwise
+   the same values as deflateInit2().
+*/
+
+ZEXTERN ZEXPORT
+size_t zng_inflateArenaSize(int windowBits);
+/*
+     Returns the size of the memory block that zng_inflateInitArena() needs for the given windowBits, with the
+   same meaning as for inflateInit2(), or 0 if windowBits is invalid. A windowBits of 0 is sized for the largest
+   window.
+*/
+
+ZEXTERN ZEXPORT
+int zng_inflateInitArena(zng_stream *strm, void *arena, size_t arena_size, int windowBits);
+/*
+     Like inflateInit2(), but places the inflate state and window in the caller-supplied block of arena_size bytes
+   instead of calling an allocator. The same rules as for zng_deflateInitArena() apply, including for
+   inflateCopy(). Since the window is only allocated once it is needed, a block that is too small for the window,
+   for example after inflateReset2() with a larger windowBits, makes inflate() return Z_MEM_ERROR.
+*/
+
+ZEXTERN ZEXPORT
+int zng_stream_set_numa_node(zng_stream *strm, int node);
+/*
+     Makes the next deflateInit2() of strm, or the next deflateInit(), place the deflate state, window, hash
+   tables and symbol buffer together in one region of 2 MB pages on the given NUMA node, or on the node of the
+   calling thread if node is -1. With many streams on a NUMA system, this keeps the buffers that longest_match()
+   reads on few pages, and so in few TLB entries. It must be called before the stream is initialized, and
+   overwrites the zalloc, zfree and opaque fields of strm. The setting is kept after deflateEnd(), so the stream
+   can be initialized again the same way, and deflateCopy() maps a region of its own for the copy.
+
+     Reserved huge pages are used if the system has them, and transparent huge pages otherwise. The region is
+   only mapped on Linux. Elsewhere, and if the region cannot be mapped, the stream allocates from the heap as
+   with the default allocator, which is also what an inflate stream does with this setting. Buffers that the
+   region has no room for, such as a larger Z_DEFLATE_LIT_BUFSIZE set later, come from the heap as well.
+
+     Returns Z_OK, or Z_STREAM_ERROR if strm is NULL or node is less than -1 or 1024 or more.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateIdle(zng_stream *strm, unsigned keep);
+/*
+     Frees the window, hash tables, pending and symbol buffer and tree scratch space of a deflate stream that
+   sits between messages, keeping only the last keep bytes of the window, at most the window size, so that the
+   stream holds under 4K besides those bytes until it is used again. This suits servers with many mostly idle
+   connections, and small systems. The next call that needs the buffers, such as deflate(), deflateParams(),
+   deflateReset() or deflateCopy() of the stream, allocates them again and hashes the kept bytes, so the next
+   message can still refer to them. Keeping fewer bytes than the window size only costs compression ratio: the
+   output is a valid continuation of the stream either way. That call returns Z_MEM_ERROR if the buffers cannot
+   be allocated, in which case the stream stays idle and the call can be retried.
+
+     The stream must be at the end of a block with all of its output delivered, as after deflate() with
+   Z_SYNC_FLUSH or Z_FULL_FLUSH has returned with avail_out nonzero. Input that deflate() has not read yet stays
+   in next_in and avail_in. Calling zng_deflateIdle() on a stream that is already idle does nothing.
+
+     Returns Z_OK, Z_BUF_ERROR if the stream is in the middle of a block or has output pending, Z_MEM_ERROR if
+   the kept bytes could not be allocated, or Z_STREAM_ERROR if the stream state is inconsistent or the stream
+   was initialized with zng_deflateInitArena(), which cannot allocate again after freeing.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateHibernate(zng_stream *strm, unsigned keep, void *blob, size_t *blob_len);
+ZEXTERN ZEXPORT
+int zng_inflateHibernate(zng_stream *strm, void *blob, size_t *blob_len);
+/*
+     Write what a stream needs to go on later into blob, and free all of the memory of the stream, as deflateEnd()
+   or inflateEnd() would. The blob is the stream state without its buffers, about 700 bytes for deflate and 250
+   for inflate on 64-bit systems, followed by the last keep bytes of the deflate window, as with zng_deflateIdle(), or by the
+   bytes that inflate has in its window, which for a stream that received the whole window is 32K. Apart from the
+   allocator fields, strm can then be reused or freed until zng_deflateRestore() or zng_inflateRestore().
+
+     If blob is NULL, only *blob_len is set to the size that the blob needs. Otherwise *blob_len is the size of
+   blob on entry and is set to the size written. The blob refers to memory outside of it, such as the gzip header
+   given to deflateSetHeader() or inflateGetHeader(), and to the code of the library, so it can only be restored
+   in the same process, and that memory must still be there.
+
+     A deflate stream must be at the end of a block with its output delivered, as for zng_deflateIdle(). An
+   inflate stream must not be in the header or the codes of a Huffman block: it can hibernate in the zlib or gzip
+   header, between blocks, in a stored block and in the trailer, which covers a stream that has just read a flush
+   marker of deflate() with Z_SYNC_FLUSH or Z_FULL_FLUSH.
+
+     Return Z_OK, Z_BUF_ERROR if the stream cannot hibernate at this point or blob is too small, in which case the
+   stream is left as it was, or Z_STREAM_ERROR if the stream state is inconsistent or the stream was initialized
+   with zng_deflateInitArena() or zng_inflateInitArena(). zng_deflateHibernate() can also return Z_MEM_ERROR, as
+   zng_deflateIdle() can.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateRestore(zng_stream *strm, const void *blob, size_t blob_len);
+ZEXTERN ZEXPORT
+int zng_inflateRestore(zng_stream *strm, const void *blob, size_t blob_len);
+/*
+     Make strm the stream that was written to blob, with total_in, total_out, adler and data_type as they were.
+   The zalloc, zfree and opaque fields are used as with deflateInit() or inflateInit() and need not be the ones
+   of the stream that hibernated. A deflate stream gets its buffers back when they are next used, as after
+   zng_deflateIdle(), and an inflate stream gets its window back at once. The blob is not needed afterwards.
+
+     Return Z_OK, Z_DATA_ERROR if blob is not one written by the matching hibernate function of this library,
+   Z_MEM_ERROR if there was not enough memory, or Z_STREAM_ERROR if strm or blob is NULL.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateSerialize(zng_stream *strm, void *buf, size_t *len);
+ZEXTERN ZEXPORT
+int zng_inflateSerialize(zng_stream *strm, void *buf, size_t *len);
+/*
+     Write the live state of a stream into buf in a portable form, which zng_deflateDeserialize() or
+   zng_inflateDeserialize() can turn back into a stream on another machine, or in another process, to go on
+   from there without processing the stream again. Unlike the hibernate functions, the stream is left as it
+   was. If buf is NULL, only *len is set to the size needed. Otherwise *len is the size of buf on entry and is
+   set to the size written.
+
+     The inflate state is the window, or what matches can still reach of a dictionary or of the output in
+   zng_inflateWholeBuffer() mode, the bit buffer, the position in the stream format and the code lengths of a
+   dynamic block, from which the code tables are built again. It can be written anywhere except while the code
+   lengths of a dynamic block header are read, where more input is needed first, and after an error. The
+   deflate state is the window, the bit buffer, the wrapper state and every parameter that
+   zng_deflateGetParams() reports. It can be written where zng_deflateIdle() can be called.
+
+     The gzip header structures of deflateSetHeader() and inflateGetHeader() are not written. A deflate stream
+   cannot be serialized while, or before, it writes a header given to deflateSetHeader(), and an inflate stream
+   that was filling in one goes on without it. A deserialized deflate stream makes a valid continuation of the
+   compressed data, but hashes the window afresh, so the bytes may differ from what the original stream would
+   have written.
+
+     Return Z_OK, Z_BUF_ERROR if buf is too small or the stream cannot be written at this point, or
+   Z_STREAM_ERROR if the stream state is inconsistent.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateDeserialize(zng_stream *strm, const void *buf, size_t len);
+ZEXTERN ZEXPORT
+int zng_inflateDeserialize(zng_stream *strm, const void *buf, size_t len);
+/*
+     Initialize strm as the stream that was written to buf by zng_deflateSerialize() or zng_inflateSerialize(),
+   with the same total_in, total_out, adler and data_type. The zalloc, zfree and opaque fields are used as with
+   deflateInit() or inflateInit(). An inflate stream restarts out of zng_inflateWholeBuffer() mode, and checks for
+   distances too far back even if inflateUndermine() had turned that off.
+
+     Return Z_OK, Z_DATA_ERROR if buf is not a valid serialized stream of that kind, Z_VERSION_ERROR if it was
+   written by a version of the library with a format or parameters that this one does not know, Z_MEM_ERROR if
+   there was not enough memory, or Z_STREAM_ERROR if strm or buf is NULL.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateCopyShared(zng_stream *dest, zng_stream *source);
+ZEXTERN ZEXPORT
+int zng_inflateCopyShared(zng_stream *dest, zng_stream *source);
+/*
+     Copy source to dest as deflateCopy() or inflateCopy() would, but let the two streams share the window, and
+   for deflate the hash tables, until one of them writes to them. That stream then takes a copy of its own,
+   and the last one left keeps the original, so forking a stream to try two ways of going on costs the state
+   and, for deflate, the pending output instead of some 64K to 300K of buffers. The copying is only put off:
+   a deflate stream takes its copy on the next call of deflate() or of a function that changes the state, and
+   an inflate stream once it has output for the window, which it then copies only in part or not at all.
+   Either stream, and further copies of either, can be used and ended in any order, and from different
+   threads, as long as each stream is used by one thread at a time.
+
+     A stream initialized with zng_deflateInitArena(), zng_inflateInitArena() or zng_stream_set_numa_node(),
+   whose copy is allocated elsewhere, and an inflate stream without a window yet, are copied in full. Return
+   values are those of deflateCopy() and inflateCopy(), and a stream that cannot get its own copy when it needs
+   one returns Z_MEM_ERROR, as for any other memory that it needs.
+*/
+
+ZEXTERN ZEXPORT
+int zng_inflateWholeBuffer(zng_stream *strm, int whole);
+/*
+     If whole is nonzero, inflate() copies matches straight from the output of the earlier calls instead of
+   keeping that output in a window, and never allocates one. The caller must then keep all of the output since
+   this call, or since the next inflateReset(), in one buffer, with each call to inflate() continuing where the
+   last one stopped, and must not change or move the last 32K of it. This is cheaper than the window when the
+   data is decompressed into a buffer that holds it all, but still arrives or is decompressed in parts.
+   inflateGetDictionary() then only returns a dictionary set before the output started. The setting is kept by
+   inflateReset(), and is made by uncompress() and uncompress2() for their own streams. If whole is zero after
+   output was made in this mode, the last 32K of it, which must still be before next_out as inflate() left it,
+   is copied into a window, and the output can go anywhere from then on.
+
+     Returns Z_OK, Z_MEM_ERROR if the window could not be allocated, or Z_STREAM_ERROR if the stream state is
+   inconsistent.
+*/
+
+ZEXTERN ZEXPORT
+int zng_inflateMaxOutput(zng_stream *strm, uint32_t max_output);
+/*
+     Makes each call of inflate() write at most max_output bytes to next_out, or any number if max_output is 0.
+   The rest of avail_out is left as it was, and the call returns Z_OK when it stopped there, also with Z_FINISH,
+   which otherwise returns Z_BUF_ERROR when the output does not fit. The work of inflate() goes with its output,
+   at most a few hundred bytes of output for every byte of input, so this bounds the time that a call takes
+   however much of both is given, and the caller calls again as long as the output is not done, as when it ran
+   out of room. It is not worth less than a few KB, as decoding is fastest with at least 258 bytes of room. The
+   limit applies over all the fragments of zng_inflatev(), is kept by inflateReset() and inflateCopy(), and can be
+   changed at any time.
+
+     Returns Z_OK, or Z_STREAM_ERROR if the stream state is inconsistent.
+*/
+
+ZEXTERN ZEXPORT
+size_t zng_compress_oneshot_size(size_t sourceLen, int level);
+ZEXTERN ZEXPORT
+int zng_compress_oneshot(unsigned char *dest, size_t *destLen, const unsigned char *source, size_t sourceLen,
+                         int level, void *scratch, size_t scratch_size);
+/*
+     Like compress2(), but with the stream placed in the caller-supplied block of scratch_size bytes as with
+   zng_deflateInitArena(), so that nothing is allocated. The window and hash table are sized for sourceLen, which
+   leaves less to set up for small inputs, and zng_compress_oneshot_size() returns the size of the block needed for
+   sourceLen and level, or 0 if level is invalid. The block is not used after the call returns. The output is a
+   zlib stream as from compress2(), though not necessarily the same bytes, and is written straight into dest when
+   destLen is at least compressBound(sourceLen).
+
+     Returns the same values as compress2(), with Z_MEM_ERROR if scratch_size is too small.
+*/
+
+ZEXTERN ZEXPORT
+int zng_compress_batch(const zng_iovec *inputs, zng_iovec *outputs, size_t n, int level);
+/*
+     Compresses each of the n buffers of inputs into the buffer of outputs with the same index, as compress2()
+   would, each into a zlib stream of its own. The iov_len of each output is its size on entry, and the length of
+   the compressed data on return. One stream is set up for all of them, with the window and hash table sized
+   for the longest input as by zng_compress_oneshot(), and reset between them, which only clears what the last
+   input used. Many short records, such as log lines or telemetry, then cost little more than their compression.
+
+     Returns Z_OK if all of the inputs were compressed, or the error of the first one that could not be, as from
+   compress2(), with the iov_len of that output and the ones after it set to 0. Returns Z_STREAM_ERROR if
+   inputs or outputs is NULL with a nonzero n.
+*/
+
+ZEXTERN ZEXPORT
+size_t zng_uncompress_oneshot_size(void);
+ZEXTERN ZEXPORT
+int zng_uncompress_oneshot(unsigned char *dest, size_t *destLen, const unsigned char *source, size_t *sourceLen,
+                           void *scratch, size_t scratch_size);
+/*
+     Like uncompress2(), but with the stream placed in the caller-supplied block of scratch_size bytes, which must
+   be at least zng_uncompress_oneshot_size(). As with uncompress2(), matches are copied from dest itself as with
+   zng_inflateWholeBuffer(), so no window is set up and the data is not copied again once decompressed.
+
+     Returns the same values as uncompress2(), with Z_MEM_ERROR if scratch_size is too small.
+*/
+
+ZEXTERN ZEXPORT
+int zng_uncompress_batch(const zng_iovec *inputs, zng_iovec *outputs, size_t n);
+/*
+     Decompresses each of the n zlib streams of inputs into the buffer of outputs with the same index, as
+   uncompress() would. The iov_len of each output is its size on entry, and the length of the decompressed data
+   on return. Up to four of the streams are decoded at a time, a symbol of each in turn, so that the table
+   lookups of one overlap with those of the others, which gives more throughput on one core than decoding them
+   one after another when there are many short streams. Each input and output must be less than 4 GB.
+
+     Returns Z_OK if all of the inputs were decompressed, or the error of the first one that could not be, as from
+   uncompress(), with the iov_len of that output and the ones after it set to 0. Returns Z_STREAM_ERROR if
+   inputs or outputs is NULL with a nonzero n.
+*/
+
+ZEXTERN ZEXPORT
+size_t zng_uncompress_inplace_margin(size_t destLen);
+ZEXTERN ZEXPORT
+int zng_uncompress_inplace(unsigned char *buf, size_t *destLen, size_t sourceLen);
+/*
+     Decompresses a zlib stream into the buffer that holds it, so that only one buffer is needed. Upon entry,
+   *destLen is the size of buf, and the sourceLen bytes of compressed data are at its end, from
+   buf + *destLen - sourceLen. The decompressed data is written from buf on, and upon exit *destLen is its length.
+   Each byte of the compressed data is read before it is written over, whatever the data, and the compressed data
+   is not left in buf.
+
+     For a stream of destLen bytes of decompressed data made by deflate, a buffer of destLen plus
+   zng_uncompress_inplace_margin(destLen) bytes is large enough, which is some 14% more than destLen rather than
+   the sum of the two buffers that uncompress() needs.
+
+     Returns Z_OK if success, Z_MEM_ERROR if there was not enough memory, Z_DATA_ERROR if the input data was
+   corrupted or incomplete, Z_STREAM_ERROR if buf or destLen is NULL or sourceLen is more than *destLen, or
+   Z_BUF_ERROR if the output caught up with the input that was not read yet or there was no room left for it, in
+   which case the decompressed data so far is in buf but the compressed data is lost.
+*/
+
+ZEXTERN ZEXPORT
+int zng_uncompress_prefix(unsigned char *dest, size_t *destLen, const unsigned char *source, size_t *sourceLen);
+/*
+     Decompresses only the first *destLen bytes of the zlib or gzip stream of *sourceLen bytes at source, such as
+   to read a header or to show a preview, and stops there without decoding the rest. As with uncompress2(),
+   matches are copied from dest itself, so no window is set up, however long the stream. Upon exit, *destLen is
+   the number of bytes decompressed, which is less than on entry only if the stream ended first, and *sourceLen
+   is the number of source bytes consumed. The check value of the stream is only verified if it ended within
+   dest.
+
+     Returns Z_OK if dest was filled or the whole stream fit in it, Z_MEM_ERROR if there was not enough memory,
+   Z_DATA_ERROR if the input data was corrupted, or ended before dest was filled, or Z_STREAM_ERROR if dest,
+   destLen or sourceLen is NULL.
+*/
+
+typedef struct zng_stream_pool_s zng_stream_pool;
+
+#define ZNG_POOL_DEFLATE 0
+#define ZNG_POOL_INFLATE 1
+/* Types of streams kept by a zng_stream_pool */
+
+ZEXTERN ZEXPORT
+zng_stream_pool *zng_stream_pool_create(int type, int level, int windowBits, int memLevel, int strategy);
+/*
+     Creates a pool of deflate streams initialized as by deflateInit2() with the given level, windowBits, memLevel
+   and strategy, if type is ZNG_POOL_DEFLATE, or of inflate streams initialized as by inflateInit2() with the given
+   windowBits, if type is ZNG_POOL_INFLATE, in which case level, memLevel and strategy are ignored. The streams use
+   the default allocation functions. Returns NULL if there was not enough memory or the parameters are invalid.
+*/
+
+ZEXTERN ZEXPORT
+zng_stream *zng_stream_pool_get(zng_stream_pool *pool);
+/*
+     Hands out a stream from the pool, ready for use as if it had just been initialized. Streams given back with
+   zng_stream_pool_put() are reset when they are handed out again; that reset is cheaper than deflateInit2() or
+   inflateInit2(), and a deflate stream given back without having been used is not reset at all. Only next_in,
+   avail_in, next_out and avail_out need to be set. Returns NULL if a new stream was needed and there was not
+   enough memory.
+
+     zng_stream_pool_get() and zng_stream_pool_put() may be called from any number of threads at once. Each thread
+   mostly works from its own small cache of idle streams, so that the threads do not contend with each other.
+*/
+
+ZEXTERN ZEXPORT
+int zng_stream_pool_put(zng_stream_pool *pool, zng_stream *strm);
+/*
+     Gives a stream handed out by zng_stream_pool_get() back to the same pool, in whatever state it is in. The
+   stream must not be used after that, and must not be given to deflateEnd() or inflateEnd(). Changes made with
+   deflateParams(), deflateSetHeader() or inflateReset2() are undone when the stream is handed out again. Returns
+   Z_OK, or Z_STREAM_ERROR if pool or strm is NULL.
+*/
+
+ZEXTERN ZEXPORT
+void zng_stream_pool_destroy(zng_stream_pool *pool);
+/*
+     Frees the pool and all of the streams in it. Every stream handed out must have been given back first, and no
+   other thread may be using the pool.
+*/
+
+typedef struct zng_deflate_dict_s zng_deflate_dict;
+
+ZEXTERN ZEXPORT
+zng_deflate_dict *zng_deflatePrepareDictionary(const uint8_t *dictionary, uint32_t dictLength, int level,
+                                               int windowBits, int memLevel);
+/*
+     Builds the window contents and hash chains that deflateSetDictionary() would make from the given dictionary
+   on a stream initialized by deflateInit2() with this level, windowBits and memLevel, so that they can be given
+   to any number of streams with zng_deflateSetPreparedDictionary(). Whether windowBits asks for a zlib, gzip or
+   raw stream does not matter. The result is never changed and may be shared by streams in different threads.
+   Returns NULL if there was not enough memory or the parameters are invalid.
+*/
+
+ZEXTERN ZEXPORT
+int zng_deflateSetPreparedDictionary(zng_stream *strm, const zng_deflate_dict *dict);
+/*
+     Has the same effect as deflateSetDictionary() with the dictionary dict was prepared from, but copies the
+   prepared state instead of hashing the dictionary again. Unlike deflateSetDictionary(), it can only be called
+   before the first deflate() call after deflateInit2() or deflateReset(), also for raw streams. The stream must
+   have the same level, windowBits and memLevel as dict was prepared for.
+
+     Returns Z_OK, Z_STREAM_ERROR if the stream state is inconsistent or it is called at the wrong time, or
+   Z_DATA_ERROR if the stream parameters do not match dict.
+*/
+
+ZEXTERN ZEXPORT
+void zng_deflateFreePreparedDictionary(zng_deflate_dict *dict);
+/*
+     Frees a prepared dictionary. No stream may be using it in a zng_deflateSetPreparedDictionary() call at the time,
+   but streams it was given to can go on compressing, since they keep their own copy.
+*/
+
+typedef struct zng_inflate_dict_s zng_inflate_dict;
+
+ZEXTERN ZEXPORT
+zng_inflate_dict *zng_inflatePrepareDictionary(const uint8_t *dictionary, uint32_t dictLength);
+/*
+     Makes a read-only copy of the last 32K bytes of the dictionary, with its Adler-32 value, that any number of
+   inflate streams can use at the same time through zng_inflateSetPreparedDictionary(). Returns NULL if there was
+   not enough memory or dictionary is NULL.
+*/
+
+ZEXTERN ZEXPORT
+int zng_inflateSetPreparedDictionary(zng_stream *strm, const zng_inflate_dict *dict);
+/*
+     Has the same effect as inflateSetDictionary() with the dictionary dict was prepared from, but instead of
+   copying it into the window, distances that reach back past the output so far are copied from dict itself.
+   A stream that is decompressed by a single inflate() call then never allocates a window. It can be called when
+   inflate() returns Z_NEED_DICT, or for a raw stream before the first inflate() call after inflateInit2() or
+   inflateReset(). dict must not be freed before inflateEnd() or inflateReset() of the streams it was given to.
+
+     Returns Z_OK, Z_STREAM_ERROR if the stream state is inconsistent or it is called at the wrong time, or
+   Z_DATA_ERROR if dict is not the dictionary the zlib stream asks for.
+*/
+
+ZEXTERN ZEXPORT
+void zng_inflateFreePreparedDictionary(zng_inflate_dict *dict);
+/*
+     Frees a prepared dictionary.
+*/
 
 /* provide 64-bit offset functions if _LARGEFILE64_SOURCE defined, and/or
  * change the regular functions to 64 bits if _FILE_OFFSET_BITS is 64 (if
@@ -295,9 +295,9 @@ ZEXTERN int ZEXPORT deflate(z_stream *strm, int flush);
   output buffer, but the output is not aligned to a byte boundary.  All of the
   input data so far will be available to the decompressor, as for Z_SYNC_FLUSH.
   This completes the current deflate block and follows it with an empty fixed
-  codes block that is 10 bits long.  This assures that enough bytes are output
-  in order for the decompressor to finish the block before the empty fixed
-  codes block.
+  codes block that is 10 bits long, unless the block ended on a byte boundary.
+  This assures that enough bytes are output in order for the decompressor to
+  finish the block before the empty fixed codes block.
 
     If flush is set to Z_BLOCK, a deflate block is completed and emitted, as
   for Z_SYNC_FLUSH, but the output is not aligned on a byte boundary, and up to
@@ -709,7 +709,9 @@ ZEXTERN int ZEXPORT deflateParams(z_stream *strm, int level, int strategy);
    compressed with the old level and strategy using deflate(strm, Z_BLOCK).
    There are three approaches for the compression levels 0, 1..3, and 4..9
    respectively.  The new level and strategy will take effect at the next call
-   of deflate().
+   of deflate().  Between the levels 1..9, the new approach can mostly go on in
+   the deflate block of the old one, and then deflateParams() compresses and
+   writes nothing, and leaves any input that deflate() has not taken.
 
      If a deflate(strm, Z_BLOCK) is performed by deflateParams(), and it does
    not have enough output space to complete, then the parameter change will not
@@ -1286,6 +1288,28 @@ ZEXTERN gzFile ZEXPORT gzopen(const char *path, const char *mode);
    "x" when writing will create the file exclusively, which fails if the file
    already exists.  On systems that support it, the addition of "e" when
    reading or writing will set the flag to close the file on an execve() call.
+   Where mmap() is available, the addition of "m" when reading will map a
+   regular file that is larger than the input buffer and decompress straight
+   from the mapping instead of copying the input with read().  The file must
+   not be truncated while it is open.  There also, "H" will allocate the
+   buffers aligned to huge pages and ask the system to use huge pages for
+   them, which saves TLB misses when streaming through buffers of 1M or more.
+   Where posix_fadvise() is available, "D" will drop what was read or written
+   from the system's file cache every 8M or so, waiting for written data to
+   reach the disk first, so that streaming through a large file does not
+   evict the cached data of everything else.
+   Where threads are available, the addition of "A" will read ahead or write behind in a background thread, so
+   that the file input or output overlaps with decompression or compression.
+   A flush with gzflush() or gzclose() still waits for its data to be written.
+   This pays off when the file is slow to access, and with a buffer larger
+   than the default set with gzbuffer().  When writing, "P" followed by a
+   number of threads, as in "wb9P8", will compress chunks of 128K in parallel
+   in that many threads, each using the 32K before it as a dictionary, and
+   write them in order as one gzip stream.  The output depends on the chunk
+   boundaries made by the flushes, but not on the number of threads.
+   When reading, "p" says that only the start of the file is wanted, as for a
+   preview, and the buffers are then sized by the first read, to hold twice
+   its length.
 
      These functions, as well as gzip, will read and decode a sequence of gzip
    streams in a file.  The append function of gzopen() can be used to create
@@ -1332,7 +1356,10 @@ ZEXTERN gzFile ZEXPORT gzdopen(int fd, const char *mode);
 ZEXTERN int ZEXPORT gzbuffer(gzFile file, unsigned size);
 /*
      Set the internal buffer size used by this library's functions.  The
-   default buffer size is 8192 bytes.  This function must be called after
+   default buffer size is 8192 bytes, or where fstat() is available, the
+   block size of the file if that is larger, doubled when reading a regular
+   file for as long as it is less than an eighth of the file, up to 1M bytes.
+   This function must be called after
    gzopen() or gzdopen(), and before any other calls that read or write the
    file.  The buffer memory allocation is always deferred to the first read or
    write.  Three times that size in buffer space is allocated.  A larger buffer
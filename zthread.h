@@ -0,0 +1,212 @@
+#ifndef ZTHREAD_H_
+#define ZTHREAD_H_
+/* zthread.h -- minimal portable threading primitives used internally
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+#include <stdlib.h>
+
+#if defined(HAVE_PTHREAD)
+#  include <pthread.h>
+#  define Z_HAVE_THREADS
+
+typedef pthread_t z_thread_t;
+
+static inline int z_thread_create(z_thread_t *thread, void *(*func)(void *), void *arg) {
+    return pthread_create(thread, NULL, func, arg);
+}
+
+static inline void z_thread_join(z_thread_t thread) {
+    pthread_join(thread, NULL);
+}
+
+typedef pthread_mutex_t z_mutex_t;
+
+static inline int z_mutex_init(z_mutex_t *mutex) {
+    return pthread_mutex_init(mutex, NULL);
+}
+
+static inline void z_mutex_lock(z_mutex_t *mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+static inline void z_mutex_unlock(z_mutex_t *mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+static inline void z_mutex_destroy(z_mutex_t *mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+typedef pthread_cond_t z_cond_t;
+
+static inline int z_cond_init(z_cond_t *cond) {
+    return pthread_cond_init(cond, NULL);
+}
+
+static inline void z_cond_wait(z_cond_t *cond, z_mutex_t *mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+static inline void z_cond_signal(z_cond_t *cond) {
+    pthread_cond_signal(cond);
+}
+
+static inline void z_cond_broadcast(z_cond_t *cond) {
+    pthread_cond_broadcast(cond);
+}
+
+static inline void z_cond_destroy(z_cond_t *cond) {
+    pthread_cond_destroy(cond);
+}
+
+#elif defined(_WIN32)
+#  include <windows.h>
+#  define Z_HAVE_THREADS
+
+typedef HANDLE z_thread_t;
+
+typedef struct {
+    void *(*func)(void *);
+    void *arg;
+} z_thread_start_t;
+
+static DWORD WINAPI z_thread_start(LPVOID param) {
+    z_thread_start_t start = *(z_thread_start_t *)param;
+    free(param);
+    start.func(start.arg);
+    return 0;
+}
+
+static inline int z_thread_create(z_thread_t *thread, void *(*func)(void *), void *arg) {
+    z_thread_start_t *start = (z_thread_start_t *)malloc(sizeof(z_thread_start_t));
+    if (start == NULL)
+        return -1;
+    start->func = func;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, z_thread_start, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void z_thread_join(z_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+typedef CRITICAL_SECTION z_mutex_t;
+
+static inline int z_mutex_init(z_mutex_t *mutex) {
+    InitializeCriticalSection(mutex);
+    return 0;
+}
+
+static inline void z_mutex_lock(z_mutex_t *mutex) {
+    EnterCriticalSection(mutex);
+}
+
+static inline void z_mutex_unlock(z_mutex_t *mutex) {
+    LeaveCriticalSection(mutex);
+}
+
+static inline void z_mutex_destroy(z_mutex_t *mutex) {
+    DeleteCriticalSection(mutex);
+}
+
+typedef CONDITION_VARIABLE z_cond_t;
+
+static inline int z_cond_init(z_cond_t *cond) {
+    InitializeConditionVariable(cond);
+    return 0;
+}
+
+static inline void z_cond_wait(z_cond_t *cond, z_mutex_t *mutex) {
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+static inline void z_cond_signal(z_cond_t *cond) {
+    WakeConditionVariable(cond);
+}
+
+static inline void z_cond_broadcast(z_cond_t *cond) {
+    WakeAllConditionVariable(cond);
+}
+
+static inline void z_cond_destroy(z_cond_t *cond) {
+    (void)cond;
+}
+
+#else
+
+/* Without threads there is nothing to lock */
+typedef int z_mutex_t;
+
+static inline int z_mutex_init(z_mutex_t *mutex) {
+    *mutex = 0;
+    return 0;
+}
+
+static inline void z_mutex_lock(z_mutex_t *mutex) {
+    (void)mutex;
+}
+
+static inline void z_mutex_unlock(z_mutex_t *mutex) {
+    (void)mutex;
+}
+
+static inline void z_mutex_destroy(z_mutex_t *mutex) {
+    (void)mutex;
+}
+
+#endif
+
+/* Atomic exchange, increment, decrement and load, sequentially consistent */
+#if defined(_MSC_VER)
+#  include <windows.h>
+typedef volatile long z_atomic_t;
+
+static inline long z_atomic_exchange(z_atomic_t *ptr, long value) {
+    return InterlockedExchange(ptr, value);
+}
+
+static inline long z_atomic_increment(z_atomic_t *ptr) {
+    return InterlockedIncrement(ptr);
+}
+
+static inline long z_atomic_decrement(z_atomic_t *ptr) {
+    return InterlockedDecrement(ptr);
+}
+
+static inline long z_atomic_load(z_atomic_t *ptr) {
+    return InterlockedCompareExchange(ptr, 0, 0);
+}
+
+#else
+typedef long z_atomic_t;
+
+static inline long z_atomic_exchange(z_atomic_t *ptr, long value) {
+    return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline long z_atomic_increment(z_atomic_t *ptr) {
+    return __atomic_add_fetch(ptr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline long z_atomic_decrement(z_atomic_t *ptr) {
+    return __atomic_sub_fetch(ptr, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline long z_atomic_load(z_atomic_t *ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+#endif
+
+#endif /* ZTHREAD_H_ */
@@ -0,0 +1,51 @@
+#ifndef ZTRACE_H_
+#define ZTRACE_H_
+/* ztrace.h -- static tracepoints on the hot paths of the library
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/* Built with ZLIB_USDT, the probes below are USDT probes of <sys/sdt.h> in
+   the provider zlib_ng. Each one is a single nop until a tracer such as
+   bpftrace or perf attaches to it in a running process, for example
+
+     bpftrace -e 'usdt:/path/to/libz-ng.so:zlib_ng:deflate_block_start { @t[tid] = nsecs; }
+                  usdt:/path/to/libz-ng.so:zlib_ng:deflate_block_done /@t[tid]/ {
+                      @ns = hist(nsecs - @t[tid]); @in = hist(arg1); delete(@t[tid]); }'
+
+   Without ZLIB_USDT they compile to nothing. The _start and _done probes
+   come in pairs on the same thread, so the time between them is the time
+   taken.
+
+   deflate_block_start(strm, stored_len)
+        zng_tr_flush_block() starts to write a block of stored_len bytes of input
+   deflate_block_done(strm, stored_len, out, last)
+        and has written it, out being total_out plus the pending bytes, which
+        is the same at deflate_block_start() plus the size of the block
+   deflate_slide(strm, slide, total_in)
+        fill_window() moved the window down by slide bytes
+   inflate_table_start(strm, nlen, ndist, ncode)
+        inflate() starts to read the code lengths of a dynamic block
+   inflate_table_done(strm, nlen, ndist, cached)
+        and has its tables, cached if those of an earlier block were reused
+   gz_load_start(fd, len), gz_load_done(fd, have)
+        gz_load() reads up to len bytes, and got have of them
+   gz_comp_start(fd, len), gz_comp_done(fd, got)
+        gz_comp() writes len bytes, and wrote got of them, or -1 on an error
+ */
+#ifdef ZLIB_USDT
+#  include <sys/sdt.h>
+#  define ZTRACE2(name, a, b) DTRACE_PROBE2(zlib_ng, name, a, b)
+#  define ZTRACE3(name, a, b, c) DTRACE_PROBE3(zlib_ng, name, a, b, c)
+#  define ZTRACE4(name, a, b, c, d) DTRACE_PROBE4(zlib_ng, name, a, b, c, d)
+#else
+#  define ZTRACE2(name, a, b) do {} while (0)
+#  define ZTRACE3(name, a, b, c) do {} while (0)
+#  define ZTRACE4(name, a, b, c, d) do {} while (0)
+#endif
+
+#endif /* ZTRACE_H_ */
@@ -5,6 +5,8 @@
 
 /* @(#) $Id$ */
 
+#define _POSIX_C_SOURCE 200112  /* For clock_gettime(). */
+
 #include "zbuild.h"
 #include "zutil.h"
 #ifdef WITH_GZFILEOP
@@ -13,6 +15,11 @@
 #ifndef UNALIGNED_OK
 #  include "malloc.h"
 #endif
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
 
 const char * const zng_errmsg[10] = {
     (const char *)"need dictionary",     /* Z_NEED_DICT       2  */
@@ -135,3 +142,98 @@ void ZLIB_INTERNAL zng_cfree (void *opaque, void *ptr)
 }
 
 #endif /* MY_ZCALLOC */
+
+zng_arena ZLIB_INTERNAL *zng_arena_init(void *buf, size_t size) {
+    unsigned char *start = (unsigned char *)ARENA_ROUND((uintptr_t)buf);
+    unsigned char *end = (unsigned char *)buf + size;
+    zng_arena *arena;
+
+    if (buf == NULL || size < ARENA_SIZE(0))
+        return NULL;
+    arena = (zng_arena *)start;
+    arena->next = start + ARENA_ROUND(sizeof(zng_arena));
+    arena->end = end;
+    arena->last = NULL;
+    return arena;
+}
+
+void ZLIB_INTERNAL *zng_arena_alloc(void *opaque, unsigned items, unsigned size) {
+    zng_arena *arena = (zng_arena *)opaque;
+    size_t len = ARENA_ROUND((size_t)items * size);
+    unsigned char *ptr = arena->next;
+
+    if (len > (size_t)(arena->end - ptr))
+        return NULL;
+    arena->next = ptr + len;
+    arena->last = ptr;
+    return ptr;
+}
+
+void ZLIB_INTERNAL zng_arena_free(void *opaque, void *ptr) {
+    zng_arena *arena = (zng_arena *)opaque;
+
+    /* Give back the most recent allocation, so a window reallocated by
+     * inflateReset2() can take the space of the one it replaces. */
+    if (ptr != NULL && ptr == arena->last) {
+        arena->next = arena->last;
+        arena->last = NULL;
+    }
+}
+
+#ifndef ZLIB_COMPAT
+void ZLIB_INTERNAL zng_wire_put(zng_wire *w, uint64_t val, unsigned bytes) {
+    for (; bytes != 0; bytes--, val >>= 8) {
+        if (w->len < w->size)
+            w->buf[w->len] = (unsigned char)val;
+        w->len++;
+    }
+}
+
+void ZLIB_INTERNAL zng_wire_put_buf(zng_wire *w, const unsigned char *buf, size_t len) {
+    if (len != 0 && w->len < w->size && len <= w->size - w->len)
+        memcpy(w->buf + w->len, buf, len);
+    w->len += len;
+}
+
+uint64_t ZLIB_INTERNAL zng_wire_get(zng_wire *w, unsigned bytes) {
+    uint64_t val = 0;
+    unsigned i;
+
+    if (bytes > w->size - w->len) {
+        w->len = w->size;
+        w->bad = 1;
+        return 0;
+    }
+    for (i = 0; i < bytes; i++)
+        val |= (uint64_t)w->buf[w->len++] << (8 * i);
+    return val;
+}
+
+const unsigned char ZLIB_INTERNAL *zng_wire_get_buf(zng_wire *w, size_t len) {
+    const unsigned char *buf = w->buf + w->len;
+
+    if (len > w->size - w->len) {
+        w->len = w->size;
+        w->bad = 1;
+        return NULL;
+    }
+    w->len += len;
+    return buf;
+}
+#endif
+
+uint64_t ZLIB_INTERNAL deflate_clock(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#else
+    /* processor time, which is what is spent in deflate() all the same */
+    return (uint64_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
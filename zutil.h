@@ -162,6 +162,81 @@ extern const char * const zng_errmsg[10]; /* indexed by 2-zlib_error */
 void ZLIB_INTERNAL *zng_calloc(void *opaque, unsigned items, unsigned size);
 void ZLIB_INTERNAL   zng_cfree(void *opaque, void *ptr);
 
+/* Bump allocator over a caller-provided block, used by the InitArena functions.
+ * The header lives at the start of the block, and every allocation is aligned
+ * to a cache line. Freeing only gives back the most recent allocation.
+ */
+#define ARENA_ALIGN 64
+#define ARENA_ROUND(size) (((size_t)(size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+typedef struct {
+    unsigned char *next;    /* first free byte */
+    unsigned char *end;     /* end of the block */
+    unsigned char *last;    /* most recent allocation */
+} zng_arena;
+
+/* Block size that holds the header and allocations of the given total rounded size */
+#define ARENA_SIZE(allocs) (ARENA_ALIGN - 1 + ARENA_ROUND(sizeof(zng_arena)) + (allocs))
+
+zng_arena ZLIB_INTERNAL *zng_arena_init(void *buf, size_t size);
+void ZLIB_INTERNAL *zng_arena_alloc(void *opaque, unsigned items, unsigned size);
+void ZLIB_INTERNAL  zng_arena_free(void *opaque, void *ptr);
+
+#ifndef ZLIB_COMPAT
+/* Allocator of zng_stream_set_numa_node(), which takes the memory of a stream
+ * from one region in huge pages on a NUMA node once zng_node_map() has mapped
+ * it, and otherwise from the heap. zng_node_copy() maps a region of the same
+ * size for a copy of the stream, and zng_node_unmap() unmaps the region after
+ * the stream has freed its memory.
+ */
+void ZLIB_INTERNAL *zng_node_alloc(void *opaque, unsigned items, unsigned size);
+void ZLIB_INTERNAL  zng_node_free(void *opaque, void *ptr);
+void ZLIB_INTERNAL  zng_node_map(zng_stream *strm, size_t size);
+void ZLIB_INTERNAL  zng_node_copy(zng_stream *dest);
+void ZLIB_INTERNAL  zng_node_unmap(zng_stream *strm);
+
+/* Start of a blob of zng_deflateHibernate() or zng_inflateHibernate(), which
+ * is followed by the state and then by the window bytes. Blobs are only good
+ * for the process that wrote them.
+ */
+#define HIBERNATE_DEFLATE 0x7a6e6744    /* "Dgnz" */
+#define HIBERNATE_INFLATE 0x7a6e6749    /* "Ignz" */
+
+typedef struct {
+    uint32_t magic;                 /* HIBERNATE_DEFLATE or HIBERNATE_INFLATE */
+    uint32_t state_size;            /* bytes of state */
+    uint32_t window_size;           /* bytes of window */
+    int data_type;                  /* the fields of the stream */
+    uint32_t adler;
+    size_t total_in;
+    size_t total_out;
+} hibernate_header;
+
+/* Little-endian fields of zng_deflateSerialize() and zng_inflateSerialize().
+ * Writing counts len past size without storing, so a first pass with size 0
+ * gives the size needed. Reading past size sets bad and returns zeros.
+ */
+typedef struct {
+    unsigned char *buf;
+    size_t size;
+    size_t len;                     /* bytes written or read so far */
+    int bad;                        /* true if the reading ran out */
+} zng_wire;
+
+#define SERIALIZE_DEFLATE 0x447a6e67    /* "gnzD" */
+#define SERIALIZE_INFLATE 0x497a6e67    /* "gnzI" */
+#define SERIALIZE_VERSION 1
+
+void ZLIB_INTERNAL zng_wire_put(zng_wire *w, uint64_t val, unsigned bytes);
+void ZLIB_INTERNAL zng_wire_put_buf(zng_wire *w, const unsigned char *buf, size_t len);
+uint64_t ZLIB_INTERNAL zng_wire_get(zng_wire *w, unsigned bytes);
+const unsigned char ZLIB_INTERNAL *zng_wire_get_buf(zng_wire *w, size_t len);
+#endif
+
+/* Monotonic clock in nanoseconds, for the phase times of zng_deflateGetStats
+   and the speed of Z_DEFLATE_TARGET_SPEED */
+uint64_t ZLIB_INTERNAL deflate_clock(void);
+
 #define ZALLOC(strm, items, size) (*((strm)->zalloc))((strm)->opaque, (items), (size))
 #define ZFREE(strm, addr)         (*((strm)->zfree))((strm)->opaque, (void *)(addr))
 #define TRY_FREE(s, p) {if (p) ZFREE(s, p);}